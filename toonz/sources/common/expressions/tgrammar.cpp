@@ -86,6 +86,150 @@ public:
   }
 };
 
+//===================================================================
+// CalculatorProgram
+//-------------------------------------------------------------------
+
+void CalculatorProgram::clear() {
+  m_code.clear();
+  m_depth = m_maxDepth = 0;
+}
+
+//-------------------------------------------------------------------
+
+void CalculatorProgram::add(const Instruction &instruction, int depthChange) {
+  m_code.push_back(instruction);
+  m_depth += depthChange;
+  if (m_depth > m_maxDepth) m_maxDepth = m_depth;
+}
+
+//-------------------------------------------------------------------
+
+void CalculatorProgram::addNumber(double value) {
+  Instruction instruction(PushNumber);
+  instruction.m_value = value;
+  add(instruction, 1);
+}
+
+void CalculatorProgram::addVariable(int varIdx) {
+  Instruction instruction(PushVariable);
+  instruction.m_arg = varIdx;
+  add(instruction, 1);
+}
+
+void CalculatorProgram::addOp1(Op1 op) {
+  Instruction instruction(CallOp1);
+  instruction.m_op1 = op;
+  add(instruction, 0);
+}
+
+void CalculatorProgram::addOp2(Op2 op) {
+  Instruction instruction(CallOp2);
+  instruction.m_op2 = op;
+  add(instruction, -1);
+}
+
+void CalculatorProgram::addOp3(Op3 op) {
+  Instruction instruction(CallOp3);
+  instruction.m_op3 = op;
+  add(instruction, -2);
+}
+
+void CalculatorProgram::addChs() {
+  add(Instruction(Chs), 0);
+}
+
+void CalculatorProgram::addNot() {
+  add(Instruction(Not), 0);
+}
+
+void CalculatorProgram::addNode(const CalculatorNode *node) {
+  Instruction instruction(ComputeNode);
+  instruction.m_node = node;
+  add(instruction, 1);
+}
+
+//-------------------------------------------------------------------
+
+int CalculatorProgram::addJumpIfZero() {
+  Instruction instruction(JumpIfZero);
+  instruction.m_arg = -1;
+  add(instruction, -1);
+  return (int)m_code.size() - 1;
+}
+
+int CalculatorProgram::addJump() {
+  Instruction instruction(Jump);
+  instruction.m_arg = -1;
+  add(instruction, -1);
+  return (int)m_code.size() - 1;
+}
+
+void CalculatorProgram::setJumpTarget(int jump) {
+  assert(0 <= jump && jump < (int)m_code.size());
+  m_code[jump].m_arg = (int)m_code.size();
+}
+
+//-------------------------------------------------------------------
+
+double CalculatorProgram::run(double vars[3]) const {
+  if (m_code.empty()) return 0;
+
+  // Expressions are short - their stack usually fits the local one
+  double localStack[32];
+  std::vector<double> heapStack;
+
+  double *stack = localStack;
+  if (m_maxDepth > 32) {
+    heapStack.resize(m_maxDepth);
+    stack = &heapStack[0];
+  }
+
+  const Instruction *code = &m_code[0];
+  int pc, size = (int)m_code.size(), sp = 0;
+  for (pc = 0; pc < size; ++pc) {
+    const Instruction &instruction = code[pc];
+    switch (instruction.m_opCode) {
+    case PushNumber:
+      stack[sp++] = instruction.m_value;
+      break;
+    case PushVariable:
+      stack[sp++] = vars[instruction.m_arg];
+      break;
+    case CallOp1:
+      stack[sp - 1] = instruction.m_op1(stack[sp - 1]);
+      break;
+    case CallOp2:
+      --sp;
+      stack[sp - 1] = instruction.m_op2(stack[sp - 1], stack[sp]);
+      break;
+    case CallOp3:
+      sp -= 2;
+      stack[sp - 1] =
+          instruction.m_op3(stack[sp - 1], stack[sp], stack[sp + 1]);
+      break;
+    case Chs:
+      stack[sp - 1] = -stack[sp - 1];
+      break;
+    case Not:
+      stack[sp - 1] = (stack[sp - 1] == 0);
+      break;
+    case JumpIfZero:
+      if (stack[--sp] == 0) pc = instruction.m_arg - 1;
+      break;
+    case Jump:
+      pc = instruction.m_arg - 1;
+      break;
+    case ComputeNode:
+      stack[sp++] = instruction.m_node->compute(vars);
+      break;
+    }
+  }
+
+  assert(sp == 1);
+  return stack[0];
+}
+
 //===================================================================
 // Calculator
 //-------------------------------------------------------------------
@@ -103,6 +247,9 @@ void Calculator::setRootNode(CalculatorNode *node) {
     delete m_rootNode;
     m_rootNode = node;
   }
+
+  m_program.clear();
+  if (m_rootNode) m_rootNode->compile(m_program);
 }
 
 //===================================================================
@@ -136,6 +283,17 @@ public:
   }
 
   void accept(CalculatorNodeVisitor &visitor) override { m_a->accept(visitor); }
+
+  void compile(CalculatorProgram &program) const override {
+    m_a->compile(program);
+    program.addOp1(&call);
+  }
+
+private:
+  static double call(double a) {
+    Op op;
+    return op(a);
+  }
 };
 
 //-------------------------------------------------------------------
@@ -157,6 +315,17 @@ public:
   void accept(CalculatorNodeVisitor &visitor) override {
     m_a->accept(visitor), m_b->accept(visitor);
   }
+
+  void compile(CalculatorProgram &program) const override {
+    m_a->compile(program), m_b->compile(program);
+    program.addOp2(&call);
+  }
+
+private:
+  static double call(double a, double b) {
+    Op op;
+    return op(a, b);
+  }
 };
 
 //-------------------------------------------------------------------
@@ -179,6 +348,17 @@ public:
   void accept(CalculatorNodeVisitor &visitor) override {
     m_a->accept(visitor), m_b->accept(visitor), m_c->accept(visitor);
   }
+
+  void compile(CalculatorProgram &program) const override {
+    m_a->compile(program), m_b->compile(program), m_c->compile(program);
+    program.addOp3(&call);
+  }
+
+private:
+  static double call(double a, double b, double c) {
+    Op op;
+    return op(a, b, c);
+  }
 };
 
 //-------------------------------------------------------------------
@@ -191,6 +371,11 @@ public:
 
   double compute(double vars[3]) const override { return -m_a->compute(vars); }
   void accept(CalculatorNodeVisitor &visitor) override { m_a->accept(visitor); }
+
+  void compile(CalculatorProgram &program) const override {
+    m_a->compile(program);
+    program.addChs();
+  }
 };
 
 //-------------------------------------------------------------------
@@ -210,6 +395,16 @@ public:
   void accept(CalculatorNodeVisitor &visitor) override {
     m_a->accept(visitor), m_b->accept(visitor), m_c->accept(visitor);
   }
+
+  void compile(CalculatorProgram &program) const override {
+    m_a->compile(program);
+    int toC = program.addJumpIfZero();
+    m_b->compile(program);
+    int toEnd = program.addJump();
+    program.setJumpTarget(toC);
+    m_c->compile(program);
+    program.setJumpTarget(toEnd);
+  }
 };
 
 //-------------------------------------------------------------------
@@ -224,6 +419,11 @@ public:
     return m_a->compute(vars) == 0;
   }
   void accept(CalculatorNodeVisitor &visitor) override { m_a->accept(visitor); }
+
+  void compile(CalculatorProgram &program) const override {
+    m_a->compile(program);
+    program.addNot();
+  }
 };
 //-------------------------------------------------------------------
 
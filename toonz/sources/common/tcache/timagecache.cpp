@@ -38,7 +38,9 @@
 
 #include "tstream.h"
 #include "tenv.h"
+#include <atomic>
 #include <deque>
+#include <limits>
 #include <numeric>
 #include <sstream>
 #ifdef _WIN32
@@ -65,28 +67,6 @@ class ImageInfo;
 
 // std::ofstream os("C:\\cache.txt");
 
-TUINT32 HistoryCount = 0;
-//------------------------------------------------------------------------------
-
-class TheCodec final : public TRasterCodecLz4 {
-public:
-  static TheCodec *instance() {
-    if (!_instance) _instance = new TheCodec();
-
-    return _instance;
-  }
-
-  void reset() {
-    if (_instance) _instance->TRasterCodecLz4::reset();
-  }
-
-private:
-  static TheCodec *_instance;
-  TheCodec() : TRasterCodecLz4("Lz4_Codec", false) {}
-};
-
-TheCodec *TheCodec::_instance = 0;
-
 //------------------------------------------------------------------------------
 
 class CacheItem : public TSmartObject {
@@ -97,15 +77,22 @@ public:
       , m_builder(0)
       , m_imageInfo(0)
       , m_modified(false)
-      , m_palette(0) {}
+      , m_palette(0)
+      , m_lruSize(0)
+      , m_lruStamp(0)
+      , m_lruPrev(0)
+      , m_lruNext(0) {}
 
   CacheItem(ImageBuilder *builder, ImageInfo *imageInfo, TPalette *palette)
       : m_cantCompress(false)
       , m_builder(builder)
       , m_imageInfo(imageInfo)
-      , m_historyCount(0)
       , m_modified(false)
-      , m_palette(palette) {}
+      , m_palette(palette)
+      , m_lruSize(0)
+      , m_lruStamp(0)
+      , m_lruPrev(0)
+      , m_lruNext(0) {}
 
   virtual ~CacheItem() {}
 
@@ -118,9 +105,16 @@ public:
   ImageBuilder *m_builder;
   ImageInfo *m_imageInfo;
   std::string m_id;
-  TUINT32 m_historyCount;
   bool m_modified;
   TPalette *m_palette;
+
+  // Bookkeeping of the owning cache shard: the size accounted for the item
+  // when it was inserted, the time of its last access across all shards, and
+  // the links of the shard's LRU list (uncompressed items only; m_lruNext
+  // points toward the most recently used item).
+  TUINT32 m_lruSize;
+  TUINT64 m_lruStamp;
+  CacheItem *m_lruPrev, *m_lruNext;
 };
 
 #ifdef _WIN32
@@ -381,9 +375,10 @@ TUINT32 UncompressedOnMemoryCacheItem::getSize() const {
 
 class CompressedOnMemoryCacheItem final : public CacheItem {
 public:
-  CompressedOnMemoryCacheItem(const TImageP &img);
+  CompressedOnMemoryCacheItem(const TImageP &img, TRasterCodec &codec);
 
   CompressedOnMemoryCacheItem(const TRasterP &compressedRas,
+                              const std::string &codecName,
                               ImageBuilder *builder, ImageInfo *info,
                               TPalette *palette);
 
@@ -393,6 +388,7 @@ public:
   TImageP getImage() const override;
 
   TRasterP m_compressedRas;
+  std::string m_codecName;  //!< The codec that compressed m_compressedRas
 };
 
 #ifdef _WIN32
@@ -405,15 +401,15 @@ typedef TDerivedSmartPointerT<CompressedOnMemoryCacheItem, CacheItem>
 
 //------------------------------------------------------------------------------
 
-CompressedOnMemoryCacheItem::CompressedOnMemoryCacheItem(const TImageP &img)
-    : m_compressedRas() {
+CompressedOnMemoryCacheItem::CompressedOnMemoryCacheItem(const TImageP &img,
+                                                         TRasterCodec &codec)
+    : m_compressedRas(), m_codecName(codec.getName()) {
   TRasterImageP ri = img;
   if (ri) {
     m_imageInfo     = new RasterImageInfo(ri);
     m_builder       = new RasterImageBuilder();
     TINT32 buffSize = 0;
-    m_compressedRas =
-        TheCodec::instance()->compress(ri->getRaster(), 1, buffSize);
+    m_compressedRas = codec.compress(ri->getRaster(), 1, buffSize);
     m_palette       = img->getPalette();
   }
 #ifndef TNZCORE_LIGHT
@@ -424,7 +420,7 @@ CompressedOnMemoryCacheItem::CompressedOnMemoryCacheItem(const TImageP &img)
       m_builder            = new ToonzImageBuilder();
       TRasterCM32P rasCM32 = ti->getRaster();
       TINT32 buffSize      = 0;
-      m_compressedRas = TheCodec::instance()->compress(rasCM32, 1, buffSize);
+      m_compressedRas      = codec.compress(rasCM32, 1, buffSize);
       m_palette       = ti->getPalette();
     } else
       assert(false);
@@ -437,11 +433,12 @@ CompressedOnMemoryCacheItem::CompressedOnMemoryCacheItem(const TImageP &img)
 
 //------------------------------------------------------------------------------
 
-CompressedOnMemoryCacheItem::CompressedOnMemoryCacheItem(const TRasterP &ras,
-                                                         ImageBuilder *builder,
-                                                         ImageInfo *info,
-                                                         TPalette *palette)
-    : CacheItem(builder, info, palette), m_compressedRas(ras) {}
+CompressedOnMemoryCacheItem::CompressedOnMemoryCacheItem(
+    const TRasterP &ras, const std::string &codecName, ImageBuilder *builder,
+    ImageInfo *info, TPalette *palette)
+    : CacheItem(builder, info, palette)
+    , m_compressedRas(ras)
+    , m_codecName(codecName) {}
 
 //------------------------------------------------------------------------------
 
@@ -466,7 +463,10 @@ TImageP CompressedOnMemoryCacheItem::getImage() const {
   // PER IL MOMENTO DISCRIMINO: DA ELIMINARE
   TRasterP ras;
 
-  TheCodec::instance()->decompress(m_compressedRas, ras);
+  // Decompression is stateless - a temporary codec instance will do
+  std::unique_ptr<TRasterCodec> codec(TRasterCodec::create(m_codecName));
+  assert(codec);
+  codec->decompress(m_compressedRas, ras);
 #ifdef _DEBUGTOONZ
   ras->m_cashed = true;
 #endif
@@ -484,6 +484,7 @@ TImageP CompressedOnMemoryCacheItem::getImage() const {
 class CompressedOnDiskCacheItem final : public CacheItem {
 public:
   CompressedOnDiskCacheItem(const TFilePath &fp, const TRasterP &compressedRas,
+                            const std::string &codecName,
                             ImageBuilder *builder, ImageInfo *info,
                             TPalette *palette);
 
@@ -492,6 +493,7 @@ public:
   TUINT32 getSize() const override { return 0; }
   TImageP getImage() const override;
   TFilePath m_fp;
+  std::string m_codecName;
 };
 
 #ifdef _WIN32
@@ -505,9 +507,10 @@ typedef TDerivedSmartPointerT<CompressedOnDiskCacheItem, CacheItem>
 //------------------------------------------------------------------------------
 
 CompressedOnDiskCacheItem::CompressedOnDiskCacheItem(
-    const TFilePath &fp, const TRasterP &compressedRas, ImageBuilder *builder,
-    ImageInfo *info, TPalette *palette)
-    : CacheItem(builder, info, palette), m_fp(fp) {
+    const TFilePath &fp, const TRasterP &compressedRas,
+    const std::string &codecName, ImageBuilder *builder, ImageInfo *info,
+    TPalette *palette)
+    : CacheItem(builder, info, palette), m_fp(fp), m_codecName(codecName) {
   compressedRas->lock();
 
   Tofstream oss(m_fp);
@@ -539,7 +542,7 @@ TImageP CompressedOnDiskCacheItem::getImage() const {
   is.read((char *)data, dataSize);
   assert(!is.fail());
   ras->unlock();
-  CompressedOnMemoryCacheItem item(ras, m_builder->clone(),
+  CompressedOnMemoryCacheItem item(ras, m_codecName, m_builder->clone(),
                                    m_imageInfo->clone(), m_palette);
   return item.getImage();
 }
@@ -702,9 +705,175 @@ std::string TImageCache::getUniqueId(void) {
   return "IMAGECACHEUNIQUEID" + ss.str();
 }
 
+//------------------------------------------------------------------------------
+
+namespace {
+
+//! Number of shards the cache is partitioned into. Each shard has its own
+//! lock, so that threads accessing images under different ids rarely contend.
+const int ShardsCount = 16;
+
+//! Access counter shared by all the shards, so that their least recently used
+//! items can be compared.
+std::atomic<TUINT64> lruClock(0);
+
+//------------------------------------------------------------------------------
+
+//! Intrusive list of the uncompressed items of a cache shard, ordered from the
+//! least to the most recently used one. All operations are O(1).
+class LruList {
+  CacheItem *m_oldest, *m_newest;
+
+public:
+  LruList() : m_oldest(0), m_newest(0) {}
+
+  CacheItem *oldest() const { return m_oldest; }
+
+  void pushNewest(CacheItem *item) {
+    assert(!item->m_lruPrev && !item->m_lruNext && item != m_oldest);
+
+    item->m_lruStamp = ++lruClock;
+    item->m_lruPrev  = m_newest;
+    if (m_newest)
+      m_newest->m_lruNext = item;
+    else
+      m_oldest = item;
+    m_newest = item;
+  }
+
+  void erase(CacheItem *item) {
+    if (item->m_lruPrev)
+      item->m_lruPrev->m_lruNext = item->m_lruNext;
+    else {
+      assert(m_oldest == item);
+      m_oldest = item->m_lruNext;
+    }
+
+    if (item->m_lruNext)
+      item->m_lruNext->m_lruPrev = item->m_lruPrev;
+    else {
+      assert(m_newest == item);
+      m_newest = item->m_lruPrev;
+    }
+
+    item->m_lruPrev = item->m_lruNext = 0;
+  }
+
+  void touch(CacheItem *item) {
+    if (item == m_newest) return;
+    erase(item);
+    pushNewest(item);
+  }
+
+  void clear() {
+    for (CacheItem *item = m_oldest; item;) {
+      CacheItem *next = item->m_lruNext;
+      item->m_lruPrev = item->m_lruNext = 0;
+      item                              = next;
+    }
+    m_oldest = m_newest = 0;
+  }
+};
+
+//------------------------------------------------------------------------------
+
+//! A partition of the image cache, holding the items whose id hashes to it.
+//! Every field is guarded by m_mutex.
+class CacheShard {
+public:
+  typedef std::map<std::string, CacheItemP>::iterator Iterator;
+
+  TThread::Mutex m_mutex;
+
+  std::map<std::string, CacheItemP> m_uncompressedItems;
+  std::map<std::string, CacheItemP> m_compressedItems;
+  std::map<std::string, std::string> m_duplicatedItems;  // for duplicated items
+                                                         // (when id1!=id2 but
+                                                         // image1==image2) in
+                                                         // the map: key is dup
+                                                         // id, value is main id
+  LruList m_lru;  // uncompressed items, by last access
+
+  // Each shard uses its own codec, since the codec's compression buffer can't
+  // be shared among threads
+  std::unique_ptr<TRasterCodec> m_codec;
+
+public:
+  CacheShard(std::atomic<TINT64> &memUsage, const std::string &codecName)
+      : m_codec(TRasterCodec::create(codecName)), m_memUsage(memUsage) {}
+
+  void insertUncompressed(const std::string &id, const CacheItemP &item) {
+    assert(m_uncompressedItems.find(id) == m_uncompressedItems.end());
+
+    item->m_id      = id;
+    item->m_lruSize = item->getSize();
+    m_uncompressedItems[id] = item;
+    m_lru.pushNewest(item.getPointer());
+    m_memUsage += item->m_lruSize;
+  }
+
+  void eraseUncompressed(Iterator it) {
+    CacheItem *item = it->second.getPointer();
+    m_lru.erase(item);
+    m_memUsage -= item->m_lruSize;
+    m_uncompressedItems.erase(it);
+  }
+
+  void setCompressed(const std::string &id, const CacheItemP &item) {
+    CacheItemP &slot = m_compressedItems[id];
+    if (slot) m_memUsage -= slot->m_lruSize;
+
+    item->m_lruSize = item->getSize();
+    slot            = item;
+    m_memUsage += item->m_lruSize;
+  }
+
+  void eraseCompressed(Iterator it) {
+    m_memUsage -= it->second->m_lruSize;
+    m_compressedItems.erase(it);
+  }
+
+  void clear() {
+    for (Iterator it = m_uncompressedItems.begin();
+         it != m_uncompressedItems.end(); ++it)
+      m_memUsage -= it->second->m_lruSize;
+    for (Iterator it = m_compressedItems.begin(); it != m_compressedItems.end();
+         ++it)
+      m_memUsage -= it->second->m_lruSize;
+
+    m_lru.clear();
+    m_uncompressedItems.clear();
+    m_compressedItems.clear();
+    m_duplicatedItems.clear();
+  }
+
+private:
+  std::atomic<TINT64> &m_memUsage;  // shared by all the shards
+
+  // not implemented
+  CacheShard(const CacheShard &);
+  CacheShard &operator=(const CacheShard &);
+};
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+
 class TImageCache::Imp {
 public:
-  Imp() : m_rootDir() {
+  Imp()
+      : m_rootDir()
+      , m_codecName("LZ4")
+      , m_memUsage(0)
+      , m_memoryBudget(0) {
+    // Compression may reenter the cache through compressAndMalloc() when the
+    // big memory manager is active; a single shard keeps that deadlock-free.
+    int shardsCount =
+        TBigMemoryManager::instance()->isActive() ? 1 : ShardsCount;
+    for (int i = 0; i < shardsCount; ++i)
+      m_shards.push_back(
+          std::unique_ptr<CacheShard>(new CacheShard(m_memUsage, m_codecName)));
+
     // ATTENZIONE: e' molto piu' veloce se si usa memoria fisica
     // invece che virtuale: la virtuale e' tanta, non c'e' quindi bisogno
     // di comprimere le immagini, che grandi come sono vengono swappate su disco
@@ -722,10 +891,21 @@ public:
     if (TBigMemoryManager::instance()->isActive())
       return TBigMemoryManager::instance()->getAvailableMemoryinKb() <
              50 * 1024;
+    else if (TUINT64 budget = m_memoryBudget)
+      return (TUINT64)std::max(m_memUsage.load(), (TINT64)0) > budget;
     else
       return TSystem::memoryShortage();
   }
 
+  CacheShard &getShard(const std::string &id) {
+    return *m_shards[std::hash<std::string>()(id) % m_shards.size()];
+  }
+
+  TFilePath getSwapFilePath() {
+    assert(m_rootDir != TFilePath());
+    return m_rootDir + TFilePath(std::to_string(m_fileid++));
+  }
+
   void doCompress();
   void doCompress(std::string id);
   UCHAR *compressAndMalloc(TUINT32 requestedSize);  // compress in the cache
@@ -736,32 +916,42 @@ public:
   void remap(const std::string &dstId, const std::string &srcId);
   TImageP get(const std::string &id, bool toBeModified);
   void add(const std::string &id, const TImageP &img, bool overwrite);
+
+  void compressItem(CacheShard &shard, const CacheItemP &item);
+  bool compressShard(CacheShard &shard, TUINT64 lastStamp);
+  void swapShardToDisk(CacheShard &shard);
+
+  bool findImagePointer(void *pointer, std::string &id);
+  void setImagePointer(void *pointer, const std::string &id);
+  void eraseImagePointer(void *pointer);
+
   TFilePath m_rootDir;
 
+  std::string m_codecName;  // Guarded by the shards' mutexes
+
 #ifndef TNZCORE_LIGHT
   QThreadStorage<bool *> m_isEnabled;
 #else
   bool m_isEnabled;
 #endif
 
-  std::map<std::string, CacheItemP> m_uncompressedItems;
-  std::map<TUINT32, std::string> m_itemHistory;
-  std::map<std::string, CacheItemP> m_compressedItems;
-  std::map<void *, std::string>
-      m_itemsByImagePointer;  // items ordered by ImageP.getPointer()
-  std::map<std::string, std::string> m_duplicatedItems;  // for duplicated items
-                                                         // (when id1!=id2 but
-                                                         // image1==image2) in
-                                                         // the map: key is dup
-                                                         // id, value is main id
+  std::vector<std::unique_ptr<CacheShard>> m_shards;
+
+  // Items by ImageP.getPointer(), across all shards. The mutex may be locked
+  // while holding a shard's, but never the other way around.
+  std::map<void *, std::string> m_itemsByImagePointer;
+  TThread::Mutex m_pointersMutex;
+
+  std::atomic<TINT64> m_memUsage;       // bytes of RAM held by cached items
+  std::atomic<TUINT64> m_memoryBudget;  // 0 = use system memory shortage
+
   // memoria fisica totale della macchina che non puo' essere utilizzata;
   TINT64 m_reservedMemory;
-  TThread::Mutex m_mutex;
 
-  static int m_fileid;
+  static std::atomic<int> m_fileid;
 };
 
-int TImageCache::Imp::m_fileid;
+std::atomic<int> TImageCache::Imp::m_fileid(0);
 
 //------------------------------------------------------------------------------
 namespace {
@@ -798,278 +988,258 @@ inline TINT32 hasExternalReferences(const TImageP &img) {
 
   return std::max(refCount, img->getRefCount()) > 1;
 }
+
+inline bool isCompressible(const CacheItemP &item) {
+  UncompressedOnMemoryCacheItemP uitem = item;
+  return !(item->m_cantCompress ||
+           (uitem && (!uitem->m_image || hasExternalReferences(uitem->m_image))));
+}
+
+inline bool isSceneIndependent(const std::string &id) {
+  return id.size() >= 2 && id[0] == '$' && id[1] == ':';
+}
+
+//! Returns the least recently used item of the shard that can be compressed,
+//! or 0. The shard must be locked by the caller.
+CacheItem *oldestCompressible(const CacheShard &shard) {
+  CacheItem *item = shard.m_lru.oldest();
+  while (item && !isCompressible(CacheItemP(item))) item = item->m_lruNext;
+  return item;
+}
 }
 //------------------------------------------------------------------------------
 
-void TImageCache::Imp::doCompress() {
-  // se la memoria usata per mantenere le immagini decompresse e' superiore
-  // a un dato valore, comprimo alcune immagini non compresse non checked-out
-  // in modo da liberare memoria
+bool TImageCache::Imp::findImagePointer(void *pointer, std::string &id) {
+  TThread::MutexLocker sl(&m_pointersMutex);
 
-  // per il momento scorre tutte le immagini alla ricerca di immagini
-  // non compresse non checked-out
+  std::map<void *, std::string>::iterator it =
+      m_itemsByImagePointer.find(pointer);
+  if (it == m_itemsByImagePointer.end()) return false;
 
-  TThread::MutexLocker sl(&m_mutex);
+  id = it->second;
+  return true;
+}
 
-  std::map<TUINT32, std::string>::iterator itu = m_itemHistory.begin();
+//------------------------------------------------------------------------------
 
-  for (; itu != m_itemHistory.end() && notEnoughMemory();) {
-    std::map<std::string, CacheItemP>::iterator it =
-        m_uncompressedItems.find(itu->second);
-    assert(it != m_uncompressedItems.end());
-    CacheItemP item = it->second;
+void TImageCache::Imp::setImagePointer(void *pointer, const std::string &id) {
+  TThread::MutexLocker sl(&m_pointersMutex);
+  m_itemsByImagePointer[pointer] = id;
+}
 
-    UncompressedOnMemoryCacheItemP uitem = item;
-    if (item->m_cantCompress ||
-        (uitem && (!uitem->m_image || hasExternalReferences(uitem->m_image)))) {
-      ++itu;
-      continue;
-    }
-    std::string id = it->first;
+//------------------------------------------------------------------------------
 
-#ifdef _WIN32
-    assert(itu->first == it->second->m_historyCount);
-    itu = m_itemHistory.erase(itu);
-    m_itemsByImagePointer.erase(getPointer(item->getImage()));
-    m_uncompressedItems.erase(it);
-#else
-    std::map<TUINT32, std::string>::iterator itu2 = itu;
-    itu++;
-    m_itemHistory.erase(itu2);
-    m_itemsByImagePointer.erase(item->getImage().getPointer());
-    m_uncompressedItems.erase(it);
-#endif
+void TImageCache::Imp::eraseImagePointer(void *pointer) {
+  TThread::MutexLocker sl(&m_pointersMutex);
+  m_itemsByImagePointer.erase(pointer);
+}
 
-    if (m_compressedItems.find(id) == m_compressedItems.end()) {
-      assert(uitem);
-      item->m_cantCompress = true;
-      CacheItemP newItem   = new CompressedOnMemoryCacheItem(
-          item->getImage());  // WARNING the codec buffer allocation can CHANGE
-                              // the cache.
-      item->m_cantCompress = false;
-      if (newItem->getSize() ==
-          0)  /// non c'era memoria sufficiente per il buffer compresso....
-      {
-        assert(m_rootDir != TFilePath());
-        TFilePath fp =
-            m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
-        newItem = new UncompressedOnDiskCacheItem(
-            fp, item->getImage(), item->getImage()->getPalette());
-      }
-      m_compressedItems[id] = newItem;
-      item                  = CacheItemP();
-      uitem                 = UncompressedOnMemoryCacheItemP();
-      // doCompress();//restart, since iterators could have been changed (see
-      // comment above)
-      // return;
-      itu = m_itemHistory.begin();
-    }
-  }
+//------------------------------------------------------------------------------
 
-  // se il quantitativo di memoria utilizzata e' superiore a un dato valore,
-  // sposto
-  // su disco alcune immagini compresse in modo da liberare memoria
+//! Replaces the passed uncompressed item with a compressed copy (or a swap
+//! file, if there is no memory left for the compressed buffer).
+//! The shard must be locked by the caller.
+void TImageCache::Imp::compressItem(CacheShard &shard, const CacheItemP &item) {
+  std::string id = item->m_id;
+
+  CacheShard::Iterator it = shard.m_uncompressedItems.find(id);
+  assert(it != shard.m_uncompressedItems.end() && it->second == item);
+
+  eraseImagePointer(getPointer(item->getImage()));
+  shard.eraseUncompressed(it);
 
-  if (itu != m_itemHistory.end())  // memory is enough!
+  // check if item has been already compressed
+  if (shard.m_compressedItems.find(id) != shard.m_compressedItems.end())
     return;
 
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.begin();
-  for (; itc != m_compressedItems.end() && notEnoughMemory(); ++itc) {
-    CacheItemP item = itc->second;
-    if (item->m_cantCompress) continue;
+  assert((UncompressedOnMemoryCacheItemP)item);
+  item->m_cantCompress = true;
+  CacheItemP newItem   = new CompressedOnMemoryCacheItem(
+      item->getImage(), *shard.m_codec);  // WARNING the codec buffer allocation
+                                         // can CHANGE the cache.
+  item->m_cantCompress = false;
+  if (newItem->getSize() ==
+      0)  /// non c'era memoria sufficiente per il buffer compresso....
+    newItem = new UncompressedOnDiskCacheItem(getSwapFilePath(),
+                                              item->getImage(),
+                                              item->getImage()->getPalette());
 
-    CompressedOnMemoryCacheItemP citem = itc->second;
-    if (citem) {
-      assert(m_rootDir != TFilePath());
-      TFilePath fp =
-          m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
+  shard.setCompressed(id, newItem);
+}
 
-      CacheItemP newItem = new CompressedOnDiskCacheItem(
-          fp, citem->m_compressedRas, citem->m_builder->clone(),
-          citem->m_imageInfo->clone(), citem->m_palette);
+//------------------------------------------------------------------------------
+
+//! Compresses the least recently used items of the shard, up to the one
+//! accessed at lastStamp. Returns false if no item was compressed.
+bool TImageCache::Imp::compressShard(CacheShard &shard, TUINT64 lastStamp) {
+  TThread::MutexLocker sl(&shard.m_mutex);
 
-      itc->second                   = 0;
-      m_compressedItems[itc->first] = newItem;
+  // When compression may reenter the cache, the list must be scanned again
+  // from its start after each compressed item
+  bool restart = TBigMemoryManager::instance()->isActive(), done = false;
+
+  CacheItem *item = shard.m_lru.oldest();
+  while (item && item->m_lruStamp <= lastStamp && notEnoughMemory()) {
+    CacheItemP itemP(item);
+    if (!isCompressible(itemP)) {
+      item = item->m_lruNext;
+      continue;
     }
+
+    CacheItem *next = item->m_lruNext;
+    compressItem(shard, itemP);
+    done = true;
+    item = restart ? shard.m_lru.oldest() : next;
   }
+
+  shard.m_codec->reset();
+  return done;
 }
 
 //------------------------------------------------------------------------------
 
-void TImageCache::Imp::doCompress(std::string id) {
-  TThread::MutexLocker sl(&m_mutex);
+void TImageCache::Imp::swapShardToDisk(CacheShard &shard) {
+  TThread::MutexLocker sl(&shard.m_mutex);
 
-  // search id in m_uncompressedItems
-  std::map<std::string, CacheItemP>::iterator it = m_uncompressedItems.find(id);
-  if (it == m_uncompressedItems.end()) return;  // id not found: return
+  CacheShard::Iterator itc = shard.m_compressedItems.begin();
+  for (; itc != shard.m_compressedItems.end() && notEnoughMemory(); ++itc) {
+    CacheItemP item = itc->second;
+    if (item->m_cantCompress) continue;
 
-  // is item suitable for compression ?
-  CacheItemP item                      = it->second;
-  UncompressedOnMemoryCacheItemP uitem = item;
-  if (item->m_cantCompress ||
-      (uitem && (!uitem->m_image || hasExternalReferences(uitem->m_image))))
-    return;
+    CompressedOnMemoryCacheItemP citem = item;
+    if (citem) {
+      CacheItemP newItem = new CompressedOnDiskCacheItem(
+          getSwapFilePath(), citem->m_compressedRas, citem->m_codecName,
+          citem->m_builder->clone(), citem->m_imageInfo->clone(),
+          citem->m_palette);
 
-  // search id in m_itemHistory
-  std::map<TUINT32, std::string>::iterator itu = m_itemHistory.begin();
-  while (itu != m_itemHistory.end() && itu->second != id) ++itu;
-  if (itu == m_itemHistory.end()) return;  // id not found: return
+      shard.setCompressed(itc->first, newItem);
+    }
+  }
+}
 
-// delete itu from m_itemHistory
-#ifdef _WIN32
-  assert(itu->first == it->second->m_historyCount);
-  itu = m_itemHistory.erase(itu);
-  m_itemsByImagePointer.erase(getPointer(item->getImage()));
-#else
-  std::map<TUINT32, std::string>::iterator itu2 = itu;
-  itu++;
-  m_itemHistory.erase(itu2);
-  m_itemsByImagePointer.erase(item->getImage().getPointer());
-#endif
+//------------------------------------------------------------------------------
 
-  // delete item from m_uncompressedItems
-  m_uncompressedItems.erase(it);
+void TImageCache::Imp::doCompress() {
+  // se la memoria usata per mantenere le immagini decompresse e' superiore
+  // a un dato valore, comprimo alcune immagini non compresse non checked-out
+  // in modo da liberare memoria
 
-  // check if item has been already compressed. this should never happen
-  if (m_compressedItems.find(id) != m_compressedItems.end()) return;
+  // Items are compressed in global LRU order. Shards are locked one at a
+  // time: each round finds the shard holding the least recently used item,
+  // and compresses its items up to the oldest one of the other shards.
+  if (!notEnoughMemory()) return;
+
+  size_t s, count = m_shards.size();
+  while (notEnoughMemory()) {
+    const TUINT64 none = (std::numeric_limits<TUINT64>::max)();
+    TUINT64 oldestStamp = none, nextStamp = none;
+    CacheShard *oldestShard = 0;
+
+    for (s = 0; s < count; ++s) {
+      CacheShard &shard = *m_shards[s];
+      TThread::MutexLocker sl(&shard.m_mutex);
+
+      CacheItem *item = oldestCompressible(shard);
+      if (!item) continue;
+
+      if (item->m_lruStamp < oldestStamp) {
+        nextStamp   = oldestStamp;
+        oldestStamp = item->m_lruStamp;
+        oldestShard = &shard;
+      } else if (item->m_lruStamp < nextStamp)
+        nextStamp = item->m_lruStamp;
+    }
 
-  assert(uitem);
-  item->m_cantCompress = true;  // ??
-  CacheItemP newItem   = new CompressedOnMemoryCacheItem(
-      item->getImage());  // WARNING the codec buffer  allocation can CHANGE the
-                          // cache.
-  item->m_cantCompress = false;  // ??
-  if (newItem->getSize() ==
-      0)  /// non c'era memoria sufficiente per il buffer compresso....
-  {
-    assert(m_rootDir != TFilePath());
-    TFilePath fp =
-        m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
-    newItem = new UncompressedOnDiskCacheItem(fp, item->getImage(),
-                                              item->getImage()->getPalette());
+    // Items used meanwhile are left to the next call
+    if (!oldestShard || !compressShard(*oldestShard, nextStamp)) break;
   }
-  m_compressedItems[id] = newItem;
-  item                  = CacheItemP();
-  uitem                 = UncompressedOnMemoryCacheItemP();
-}
 
-/*
   // se il quantitativo di memoria utilizzata e' superiore a un dato valore,
-  sposto
-  // su disco alcune immagini compresse in modo da liberare memoria
+  // sposto su disco alcune immagini compresse in modo da liberare memoria
+  for (s = 0; s < count && notEnoughMemory(); ++s)
+    swapShardToDisk(*m_shards[s]);
+}
 
-  if (itu != m_itemHistory.end()) //memory is enough!
-    return;
+//------------------------------------------------------------------------------
 
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.begin();
-  for ( ; itc != m_compressedItems.end() && notEnoughMemory(); ++itc)
-        {
-          CacheItemP item = itc->second;
-          if (item->m_cantCompress)
-                  continue;
-
-          CompressedOnMemoryCacheItemP citem = itc->second;
-          if (citem)
-                {
-                  assert(m_rootDir!=TFilePath());
-                  TFilePath fp = m_rootDir +
-  TFilePath(toString(TImageCache::Imp::m_fileid++));
-
-                  CacheItemP newItem = new CompressedOnDiskCacheItem(fp,
-  citem->m_compressedRas,
-                                                                                                                                                                                                                           citem->m_builder->clone(), citem->m_imageInfo->clone());
-
-                  itc->second = 0;
-                  m_compressedItems[itc->first] = newItem;
-                }
-        }
-  */
+void TImageCache::Imp::doCompress(std::string id) {
+  CacheShard &shard = getShard(id);
+  TThread::MutexLocker sl(&shard.m_mutex);
 
-//------------------------------------------------------------------------------
+  // search id in m_uncompressedItems
+  CacheShard::Iterator it = shard.m_uncompressedItems.find(id);
+  if (it == shard.m_uncompressedItems.end()) return;  // id not found: return
 
-UCHAR *TImageCache::Imp::compressAndMalloc(TUINT32 size) {
-  UCHAR *buf = 0;
+  // is item suitable for compression ?
+  CacheItemP item = it->second;
+  if (!isCompressible(item)) return;
 
-  TThread::MutexLocker sl(&m_mutex);
+  compressItem(shard, item);
+  shard.m_codec->reset();
+}
 
-  TheCodec::instance()->reset();
+//------------------------------------------------------------------------------
 
-  // if (size!=0)
-  //  size = size>>10;
+UCHAR *TImageCache::Imp::compressAndMalloc(TUINT32 size) {
+  UCHAR *buf = 0;
 
-  // assert(size==0 || TBigMemoryManager::instance()->isActive());
+  size_t s, count = m_shards.size();
+  for (s = 0; s < count; ++s) {
+    CacheShard &shard = *m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    shard.m_codec->reset();
+
+    CacheItem *item = shard.m_lru.oldest();
+    while ((buf = TBigMemoryManager::instance()->getBuffer(size)) == 0 &&
+           item) {
+      CacheItemP itemP(item);
+      CacheItem *next = item->m_lruNext;
+      if (!isCompressible(itemP)) {
+        item = next;
+        continue;
+      }
 
-  std::map<TUINT32, std::string>::iterator itu = m_itemHistory.begin();
-  while (
-      (buf = TBigMemoryManager::instance()->getBuffer(size)) == 0 &&
-      itu !=
-          m_itemHistory
-              .end())  //>TBigMemoryManager::instance()->getAvailableMemoryinKb()))
-  {
-    std::map<std::string, CacheItemP>::iterator it =
-        m_uncompressedItems.find(itu->second);
-    assert(it != m_uncompressedItems.end());
-    CacheItemP item = it->second;
-
-    UncompressedOnMemoryCacheItemP uitem = item;
-    if (item->m_cantCompress ||
-        (uitem && (!uitem->m_image || hasExternalReferences(uitem->m_image)))) {
-      ++itu;
-      continue;
-    }
+      if (shard.m_compressedItems.find(item->m_id) ==
+          shard.m_compressedItems.end()) {
+        assert((UncompressedOnMemoryCacheItemP)itemP);
+        shard.setCompressed(item->m_id, new UncompressedOnDiskCacheItem(
+                                            getSwapFilePath(), item->getImage(),
+                                            item->getImage()->getPalette()));
+      }
 
-    if (m_compressedItems.find(it->first) == m_compressedItems.end()) {
-      assert(uitem);
-      CacheItemP newItem;
-      // newItem = new CompressedOnMemoryCacheItem(item->getImage());
-      // if (newItem->getSize()==0)
-      //  {
-      assert(m_rootDir != TFilePath());
-      TFilePath fp =
-          m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
-      newItem = new UncompressedOnDiskCacheItem(fp, item->getImage(),
-                                                item->getImage()->getPalette());
-      //  }
-
-      m_compressedItems[it->first] = newItem;
+      eraseImagePointer(getPointer(item->getImage()));
+      shard.eraseUncompressed(shard.m_uncompressedItems.find(item->m_id));
+      item = next;
     }
 
-#ifdef _WIN32
-    assert(itu->first == it->second->m_historyCount);
-    itu = m_itemHistory.erase(itu);
-    m_itemsByImagePointer.erase(getPointer(item->getImage()));
-    m_uncompressedItems.erase(it);
-#else
-    std::map<TUINT32, std::string>::iterator itu2 = itu;
-    itu++;
-    m_itemHistory.erase(itu2);
-    m_itemsByImagePointer.erase(item->getImage().getPointer());
-    m_uncompressedItems.erase(it);
-#endif
+    if (buf != 0) return buf;
   }
 
-  if (buf != 0) return buf;
-
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.begin();
-  for (; itc != m_compressedItems.end() &&
-         (buf = TBigMemoryManager::instance()->getBuffer(size)) == 0;
-       ++itc) {
-    CacheItemP item = itc->second;
-    if (item->m_cantCompress) continue;
-
-    CompressedOnMemoryCacheItemP citem = itc->second;
-    if (citem) {
-      assert(m_rootDir != TFilePath());
-      TFilePath fp =
-          m_rootDir + TFilePath(std::to_string(TImageCache::Imp::m_fileid++));
-
-      CacheItemP newItem = new CompressedOnDiskCacheItem(
-          fp, citem->m_compressedRas, citem->m_builder->clone(),
-          citem->m_imageInfo->clone(), citem->m_palette);
-
-      itc->second                   = 0;
-      m_compressedItems[itc->first] = newItem;
+  for (s = 0; s < count; ++s) {
+    CacheShard &shard = *m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    CacheShard::Iterator itc = shard.m_compressedItems.begin();
+    for (; itc != shard.m_compressedItems.end() &&
+           (buf = TBigMemoryManager::instance()->getBuffer(size)) == 0;
+         ++itc) {
+      CacheItemP item = itc->second;
+      if (item->m_cantCompress) continue;
+
+      CompressedOnMemoryCacheItemP citem = item;
+      if (citem) {
+        CacheItemP newItem = new CompressedOnDiskCacheItem(
+            getSwapFilePath(), citem->m_compressedRas, citem->m_codecName,
+            citem->m_builder->clone(), citem->m_imageInfo->clone(),
+            citem->m_palette);
+
+        shard.setCompressed(itc->first, newItem);
+      }
     }
+
+    if (buf != 0) return buf;
   }
 
   return buf;
@@ -1144,6 +1314,46 @@ bool TImageCache::isEnabled() {
 
 //------------------------------------------------------------------------------
 
+void TImageCache::setMemoryBudget(TUINT64 bytes) {
+  m_imp->m_memoryBudget = bytes;
+  m_imp->doCompress();
+}
+
+//------------------------------------------------------------------------------
+
+TUINT64 TImageCache::getMemoryBudget() const { return m_imp->m_memoryBudget; }
+
+//------------------------------------------------------------------------------
+
+bool TImageCache::setCompressionCodec(const std::string &codecName) {
+  size_t s, count = m_imp->m_shards.size();
+  for (s = 0; s < count; ++s) {
+    std::unique_ptr<TRasterCodec> codec(TRasterCodec::create(codecName));
+    if (!codec) return false;
+
+    // Items keep track of their codec - so, already compressed ones are
+    // still decompressed correctly
+    CacheShard &shard = *m_imp->m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    shard.m_codec.swap(codec);
+    if (s == 0) m_imp->m_codecName = codecName;
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+std::string TImageCache::getCompressionCodec() const {
+  CacheShard &shard = *m_imp->m_shards[0];
+  TThread::MutexLocker sl(&shard.m_mutex);
+
+  return m_imp->m_codecName;
+}
+
+//------------------------------------------------------------------------------
+
 void TImageCache::setRootDir(const TFilePath &cacheDir) {
   if (m_imp->m_rootDir != TFilePath()) return;
 
@@ -1183,101 +1393,73 @@ void TImageCache::add(const std::string &id, const TImageP &img,
 
 void TImageCache::Imp::add(const std::string &id, const TImageP &img,
                            bool overwrite) {
-  TThread::MutexLocker sl(&m_mutex);
-
-#ifdef LEVO
-  std::map<std::string, CacheItemP>::iterator it1 = m_uncompressedItems.begin();
-
-  for (; it1 != m_uncompressedItems.end(); ++it1) {
-    UncompressedOnMemoryCacheItemP item =
-        (UncompressedOnMemoryCacheItemP)it1->second;
-    // m_memUsage -= item->getSize();
-    assert(item);
-    TImageP refImg = item->getImage();
-    if (refImg.getPointer() == img.getPointer() && it1->first != id)
-      assert(!"opps gia' esiste in cache!");
-  }
-#endif
+  {
+    CacheShard &shard = getShard(id);
+    TThread::MutexLocker sl(&shard.m_mutex);
 
-  std::map<std::string, CacheItemP>::iterator itUncompr =
-      m_uncompressedItems.find(id);
-  std::map<std::string, CacheItemP>::iterator itCompr =
-      m_compressedItems.find(id);
+    CacheShard::Iterator itUncompr = shard.m_uncompressedItems.find(id);
+    CacheShard::Iterator itCompr   = shard.m_compressedItems.find(id);
 
 #ifdef _DEBUGTOONZ
-  TRasterImageP rimg = (TRasterImageP)img;
-  TToonzImageP timg  = (TToonzImageP)img;
+    TRasterImageP rimg = (TRasterImageP)img;
+    TToonzImageP timg  = (TToonzImageP)img;
 #endif
 
-  if (itUncompr != m_uncompressedItems.end() ||
-      itCompr !=
-          m_compressedItems.end())  // already present in cache with same id...
-  {
-    if (overwrite) {
+    if (itUncompr != shard.m_uncompressedItems.end() ||
+        itCompr != shard.m_compressedItems
+                       .end())  // already present in cache with same id...
+    {
+      if (overwrite) {
 #ifdef _DEBUGTOONZ
-      if (rimg)
-        rimg->getRaster()->m_cashed = true;
-      else if (timg)
-        timg->getRaster()->m_cashed = true;
+        if (rimg)
+          rimg->getRaster()->m_cashed = true;
+        else if (timg)
+          timg->getRaster()->m_cashed = true;
 #endif
-      std::map<std::string, CacheItemP>::iterator it;
-
-      if (itUncompr != m_uncompressedItems.end()) {
-        assert(m_itemHistory.find(itUncompr->second->m_historyCount) !=
-               m_itemHistory.end());
-        m_itemHistory.erase(itUncompr->second->m_historyCount);
-        m_itemsByImagePointer.erase(getPointer(itUncompr->second->getImage()));
-        m_uncompressedItems.erase(itUncompr);
+        if (itUncompr != shard.m_uncompressedItems.end()) {
+          eraseImagePointer(getPointer(itUncompr->second->getImage()));
+          shard.eraseUncompressed(itUncompr);
+        }
+        if (itCompr != shard.m_compressedItems.end())
+          shard.eraseCompressed(itCompr);
+      } else
+        return;
+    } else {
+      std::map<std::string, std::string>::iterator dt =
+          shard.m_duplicatedItems.find(id);
+      if ((dt != shard.m_duplicatedItems.end()) && !overwrite) return;
+
+      std::string mainId;
+      if (findImagePointer(getPointer(img),
+                           mainId))  // already present in cache with another
+                                     // id...
+      {
+        shard.m_duplicatedItems[id] = mainId;
+        return;
       }
-      if (itCompr != m_compressedItems.end()) m_compressedItems.erase(id);
-    } else
-      return;
-  } else {
-    std::map<std::string, std::string>::iterator dt =
-        m_duplicatedItems.find(id);
-    if ((dt != m_duplicatedItems.end()) && !overwrite) return;
-
-    std::map<void *, std::string>::iterator it;
-    if ((it = m_itemsByImagePointer.find(getPointer(img))) !=
-        m_itemsByImagePointer
-            .end())  // already present in cache with another id...
-    {
-      m_duplicatedItems[id] = it->second;
-      return;
-    }
 
-    if (dt != m_duplicatedItems.end()) m_duplicatedItems.erase(dt);
-  }
-
-  CacheItemP item;
+      if (dt != shard.m_duplicatedItems.end())
+        shard.m_duplicatedItems.erase(dt);
+    }
 
 #ifdef _DEBUGTOONZ
-  if (rimg)
-    rimg->getRaster()->m_cashed = true;
-  else if (timg)
-    timg->getRaster()->m_cashed = true;
+    if (rimg)
+      rimg->getRaster()->m_cashed = true;
+    else if (timg)
+      timg->getRaster()->m_cashed = true;
 #endif
 
-  item = new UncompressedOnMemoryCacheItem(img);
+    CacheItemP item = new UncompressedOnMemoryCacheItem(img);
 #ifdef TNZCORE_LIGHT
-  item->m_cantCompress = false;
+    item->m_cantCompress = false;
 #else
-  item->m_cantCompress = (TVectorImageP(img) ? true : false);
+    item->m_cantCompress = (TVectorImageP(img) ? true : false);
 #endif
-  item->m_id                             = id;
-  m_uncompressedItems[id]                = item;
-  m_itemsByImagePointer[getPointer(img)] = id;
-  item->m_historyCount                   = HistoryCount;
-  m_itemHistory[HistoryCount]            = id;
-  HistoryCount++;
+    shard.insertUncompressed(id, item);
+    setImagePointer(getPointer(img), id);
+  }
 
   doCompress();
-
-#ifdef _DEBUGTOONZ
-// int itemCount =
-// m_imp->m_uncompressedItems.size()+m_imp->m_compressedItems.size();
-// m_imp->outputDebug();
-#endif
 }
 
 void TImageCache::remove(const std::string &id) { m_imp->remove(id); }
@@ -1290,38 +1472,53 @@ void TImageCache::Imp::remove(const std::string &id) {
              // imagecache was already freed!
 
   assert(check == magic);
-  TThread::MutexLocker sl(&m_mutex);
 
-  std::map<std::string, std::string>::iterator it1;
-  if ((it1 = m_duplicatedItems.find(id)) !=
-      m_duplicatedItems.end())  // it's a duplicated id...
+  CacheShard &shard = getShard(id);
+
   {
-    m_duplicatedItems.erase(it1);
-    return;
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    std::map<std::string, std::string>::iterator it1;
+    if ((it1 = shard.m_duplicatedItems.find(id)) !=
+        shard.m_duplicatedItems.end())  // it's a duplicated id...
+    {
+      shard.m_duplicatedItems.erase(it1);
+      return;
+    }
   }
 
-  for (it1 = m_duplicatedItems.begin(); it1 != m_duplicatedItems.end(); ++it1)
-    if (it1->second == id) break;
+  // Duplicates of id may be stored in any shard
+  std::string sonId;
+  for (size_t s = 0; s < m_shards.size() && sonId.empty(); ++s) {
+    CacheShard &dupShard = *m_shards[s];
+    TThread::MutexLocker sl(&dupShard.m_mutex);
+
+    std::map<std::string, std::string>::iterator it1;
+    for (it1 = dupShard.m_duplicatedItems.begin();
+         it1 != dupShard.m_duplicatedItems.end(); ++it1)
+      if (it1->second == id) break;
+
+    if (it1 != dupShard.m_duplicatedItems.end()) {
+      sonId = it1->first;
+      dupShard.m_duplicatedItems.erase(it1);
+    }
+  }
 
-  if (it1 != m_duplicatedItems.end())  // it has duplicated, so cannot erase it;
-                                       // I erase the duplicate, and assign its
-                                       // id has the main id
+  if (!sonId.empty())  // it has duplicated, so cannot erase it;
+                       // I erase the duplicate, and assign its
+                       // id has the main id
   {
-    std::string sonId = it1->first;
-    m_duplicatedItems.erase(it1);
     remap(sonId, id);
     return;
   }
 
-  std::map<std::string, CacheItemP>::iterator it = m_uncompressedItems.find(id);
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.find(id);
-  if (it != m_uncompressedItems.end()) {
-    const CacheItemP &item = it->second;
-    assert((UncompressedOnMemoryCacheItemP)item);
-    assert(m_itemHistory.find(it->second->m_historyCount) !=
-           m_itemHistory.end());
-    m_itemHistory.erase(it->second->m_historyCount);
-    m_itemsByImagePointer.erase(getPointer(it->second->getImage()));
+  TThread::MutexLocker sl(&shard.m_mutex);
+
+  CacheShard::Iterator it  = shard.m_uncompressedItems.find(id);
+  CacheShard::Iterator itc = shard.m_compressedItems.find(id);
+  if (it != shard.m_uncompressedItems.end()) {
+    assert((UncompressedOnMemoryCacheItemP)it->second);
+    eraseImagePointer(getPointer(it->second->getImage()));
 
 #ifdef _DEBUGTOONZ
     if ((TRasterImageP)it->second->getImage())
@@ -1330,9 +1527,9 @@ void TImageCache::Imp::remove(const std::string &id) {
       ((TToonzImageP)it->second->getImage())->getRaster()->m_cashed = false;
 #endif
 
-    m_uncompressedItems.erase(it);
+    shard.eraseUncompressed(it);
   }
-  if (itc != m_compressedItems.end()) m_compressedItems.erase(itc);
+  if (itc != shard.m_compressedItems.end()) shard.eraseCompressed(itc);
 }
 
 //------------------------------------------------------------------------------
@@ -1343,49 +1540,67 @@ void TImageCache::remap(const std::string &dstId, const std::string &srcId) {
 
 void TImageCache::Imp::remap(const std::string &dstId,
                              const std::string &srcId) {
-  TThread::MutexLocker sl(&m_mutex);
-  std::map<std::string, CacheItemP>::iterator it =
-      m_uncompressedItems.find(srcId);
-  if (it != m_uncompressedItems.end()) {
-    CacheItemP citem = it->second;
-    assert(m_itemHistory.find(citem->m_historyCount) != m_itemHistory.end());
-    m_itemHistory.erase(citem->m_historyCount);
-    m_itemsByImagePointer.erase(getPointer(citem->getImage()));
-    m_uncompressedItems.erase(it);
-
-    m_uncompressedItems[dstId]                           = citem;
-    m_itemHistory[citem->m_historyCount]                 = dstId;
-    m_itemsByImagePointer[getPointer(citem->getImage())] = dstId;
-  }
-  it = m_compressedItems.find(srcId);
-  if (it != m_compressedItems.end()) {
-    CacheItemP citem = it->second;
-    m_compressedItems.erase(it);
-    m_compressedItems[dstId] = citem;
+  {
+    // The two shards are always locked in the same order
+    CacheShard &srcShard = getShard(srcId), &dstShard = getShard(dstId);
+    CacheShard *first = std::min(&srcShard, &dstShard),
+               *second = std::max(&srcShard, &dstShard);
+
+    TThread::MutexLocker sl1(&first->m_mutex);
+    TThread::MutexLocker sl2(&second->m_mutex);
+
+    CacheShard::Iterator it = srcShard.m_uncompressedItems.find(srcId);
+    if (it != srcShard.m_uncompressedItems.end()) {
+      CacheItemP citem = it->second;
+      srcShard.eraseUncompressed(it);
+
+      // The item's history is not preserved: remapping counts as an access
+      dstShard.insertUncompressed(dstId, citem);
+      setImagePointer(getPointer(citem->getImage()), dstId);
+    }
+    it = srcShard.m_compressedItems.find(srcId);
+    if (it != srcShard.m_compressedItems.end()) {
+      CacheItemP citem = it->second;
+      srcShard.eraseCompressed(it);
+      dstShard.setCompressed(dstId, citem);
+    }
+    std::map<std::string, std::string>::iterator it2 =
+        srcShard.m_duplicatedItems.find(srcId);
+    if (it2 != srcShard.m_duplicatedItems.end()) {
+      std::string id = it2->second;
+      srcShard.m_duplicatedItems.erase(it2);
+      dstShard.m_duplicatedItems[dstId] = id;
+    }
   }
-  std::map<std::string, std::string>::iterator it2 =
-      m_duplicatedItems.find(srcId);
-  if (it2 != m_duplicatedItems.end()) {
-    std::string id = it2->second;
-    m_duplicatedItems.erase(it2);
-    m_duplicatedItems[dstId] = id;
+
+  for (size_t s = 0; s < m_shards.size(); ++s) {
+    CacheShard &shard = *m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    std::map<std::string, std::string>::iterator it2;
+    for (it2 = shard.m_duplicatedItems.begin();
+         it2 != shard.m_duplicatedItems.end(); ++it2)
+      if (it2->second == srcId) it2->second = dstId;
   }
-  for (it2 = m_duplicatedItems.begin(); it2 != m_duplicatedItems.end(); ++it2)
-    if (it2->second == srcId) it2->second = dstId;
 }
 
 //------------------------------------------------------------------------------
 
 void TImageCache::remapIcons(const std::string &dstId,
                              const std::string &srcId) {
-  std::map<std::string, CacheItemP>::iterator it;
   std::map<std::string, std::string> table;
   std::string prefix = srcId + ":";
   int j              = (int)prefix.length();
-  for (it = m_imp->m_uncompressedItems.begin();
-       it != m_imp->m_uncompressedItems.end(); ++it) {
-    std::string id                      = it->first;
-    if (id.find(prefix) == 0) table[id] = dstId + ":" + id.substr(j);
+  for (size_t s = 0; s < m_imp->m_shards.size(); ++s) {
+    CacheShard &shard = *m_imp->m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    CacheShard::Iterator it;
+    for (it = shard.m_uncompressedItems.begin();
+         it != shard.m_uncompressedItems.end(); ++it) {
+      std::string id = it->first;
+      if (id.find(prefix) == 0) table[id] = dstId + ":" + id.substr(j);
+    }
   }
   for (std::map<std::string, std::string>::iterator it2 = table.begin();
        it2 != table.end(); ++it2) {
@@ -1396,12 +1611,15 @@ void TImageCache::remapIcons(const std::string &dstId,
 //------------------------------------------------------------------------------
 
 void TImageCache::clear(bool deleteFolder) {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-  m_imp->m_uncompressedItems.clear();
-  m_imp->m_itemHistory.clear();
-  m_imp->m_compressedItems.clear();
-  m_imp->m_duplicatedItems.clear();
-  m_imp->m_itemsByImagePointer.clear();
+  for (size_t s = 0; s < m_imp->m_shards.size(); ++s) {
+    CacheShard &shard = *m_imp->m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+    shard.clear();
+  }
+  {
+    TThread::MutexLocker sl(&m_imp->m_pointersMutex);
+    m_imp->m_itemsByImagePointer.clear();
+  }
   if (deleteFolder && m_imp->m_rootDir != TFilePath())
     TSystem::rmDirTree(m_imp->m_rootDir);
 }
@@ -1409,285 +1627,145 @@ void TImageCache::clear(bool deleteFolder) {
 //------------------------------------------------------------------------------
 
 void TImageCache::clearSceneImages() {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-
-  // note the ';' - which follows ':' in the ascii table
-  m_imp->m_uncompressedItems.erase(
-      m_imp->m_uncompressedItems.begin(),
-      m_imp->m_uncompressedItems.lower_bound("$:"));
-  m_imp->m_uncompressedItems.erase(m_imp->m_uncompressedItems.lower_bound("$;"),
-                                   m_imp->m_uncompressedItems.end());
+  for (size_t s = 0; s < m_imp->m_shards.size(); ++s) {
+    CacheShard &shard = *m_imp->m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    CacheShard::Iterator it;
+    for (it = shard.m_uncompressedItems.begin();
+         it != shard.m_uncompressedItems.end();) {
+      if (isSceneIndependent(it->first))
+        ++it;
+      else
+        shard.eraseUncompressed(it++);
+    }
 
-  m_imp->m_compressedItems.erase(m_imp->m_compressedItems.begin(),
-                                 m_imp->m_compressedItems.lower_bound("$:"));
-  m_imp->m_compressedItems.erase(m_imp->m_compressedItems.lower_bound("$;"),
-                                 m_imp->m_compressedItems.end());
+    for (it = shard.m_compressedItems.begin();
+         it != shard.m_compressedItems.end();) {
+      if (isSceneIndependent(it->first))
+        ++it;
+      else
+        shard.eraseCompressed(it++);
+    }
 
-  m_imp->m_duplicatedItems.erase(m_imp->m_duplicatedItems.begin(),
-                                 m_imp->m_duplicatedItems.lower_bound("$:"));
-  m_imp->m_duplicatedItems.erase(m_imp->m_duplicatedItems.lower_bound("$;"),
-                                 m_imp->m_duplicatedItems.end());
+    std::map<std::string, std::string>::iterator dt;
+    for (dt = shard.m_duplicatedItems.begin();
+         dt != shard.m_duplicatedItems.end();) {
+      if (isSceneIndependent(dt->first))
+        ++dt;
+      else
+        shard.m_duplicatedItems.erase(dt++);
+    }
+  }
 
   // Clear maps whose id is on the second of map pairs.
 
-  std::map<TUINT32, std::string>::iterator it;
-  for (it = m_imp->m_itemHistory.begin(); it != m_imp->m_itemHistory.end();) {
-    if (it->second.size() >= 2 && it->second[0] == '$' && it->second[1] == ':')
-      ++it;
-    else {
-      std::map<TUINT32, std::string>::iterator app = it;
-      app++;
-      m_imp->m_itemHistory.erase(it);
-      it = app;
-    }
-  }
+  TThread::MutexLocker sl(&m_imp->m_pointersMutex);
 
   std::map<void *, std::string>::iterator jt;
   for (jt = m_imp->m_itemsByImagePointer.begin();
        jt != m_imp->m_itemsByImagePointer.end();) {
-    if (jt->second.size() >= 2 && jt->second[0] == '$' && jt->second[1] == ':')
+    if (isSceneIndependent(jt->second))
       ++jt;
-    else {
-      std::map<void *, std::string>::iterator app = jt;
-      app++;
-      m_imp->m_itemsByImagePointer.erase(jt);
-      jt = app;
-    }
+    else
+      m_imp->m_itemsByImagePointer.erase(jt++);
   }
 }
 
 //------------------------------------------------------------------------------
 
 bool TImageCache::isCached(const std::string &id) const {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-  return (m_imp->m_uncompressedItems.find(id) !=
-              m_imp->m_uncompressedItems.end() ||
-          m_imp->m_compressedItems.find(id) != m_imp->m_compressedItems.end() ||
-          m_imp->m_duplicatedItems.find(id) != m_imp->m_duplicatedItems.end());
-}
-
-//------------------------------------------------------------------------------
-#ifdef LEVO
-
-bool TImageCache::getSize(const std::string &id, TDimension &size) const {
-  QMutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) {
-    UncompressedOnMemoryCacheItemP uncompressed = it->second;
-    assert(uncompressed);
-    TToonzImageP ti = uncompressed->getImage();
-    if (ti) {
-      size = ti->getSize();
-      return true;
-    }
-
-    TRasterImageP ri = uncompressed->getImage();
-    if (ri && ri->getRaster()) {
-      size = ri->getRaster()->getSize();
-      return true;
-    }
-    return false;
-  }
-  std::map<std::string, CacheItemP>::iterator itc =
-      m_imp->m_compressedItems.find(id);
-  if (itc == m_imp->m_compressedItems.end()) return false;
-  CacheItemP cacheItem = itc->second;
-
-  if (cacheItem->m_imageInfo) {
-    RasterImageInfo *rimageInfo =
-        dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo);
-    if (rimageInfo) {
-      size = rimageInfo->m_size;
-      return true;
-    }
-    ToonzImageInfo *timageInfo =
-        dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo);
-    if (timageInfo) {
-      size = timageInfo->m_size;
-      return true;
-    }
-  }
-
-  return false;
+  CacheShard &shard = m_imp->getShard(id);
+  TThread::MutexLocker sl(&shard.m_mutex);
+  return (shard.m_uncompressedItems.find(id) !=
+              shard.m_uncompressedItems.end() ||
+          shard.m_compressedItems.find(id) != shard.m_compressedItems.end() ||
+          shard.m_duplicatedItems.find(id) != shard.m_duplicatedItems.end());
 }
 
 //------------------------------------------------------------------------------
 
-bool TImageCache::getSavebox(const std::string &id, TRect &savebox) const {
-  QMutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) {
-    UncompressedOnMemoryCacheItemP uncompressed = it->second;
-    assert(uncompressed);
-
-    TToonzImageP ti = uncompressed->getImage();
-    if (ti) {
-      savebox = ti->getSavebox();
-      return true;
-    }
-    TRasterImageP ri = uncompressed->getImage();
-    if (ri) {
-      savebox = ri->getSavebox();
-      return true;
-    }
-    return false;
-  }
-  std::map<std::string, CacheItemP>::iterator itc =
-      m_imp->m_compressedItems.find(id);
-  if (itc == m_imp->m_compressedItems.end()) return false;
-
-  CacheItemP cacheItem = itc->second;
-
-  assert(cacheItem->m_imageInfo);
-
-  RasterImageInfo *rimageInfo =
-      dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo);
-  if (rimageInfo) {
-    savebox = rimageInfo->m_savebox;
-    return true;
-  }
-#ifndef TNZCORE_LIGHT
-  ToonzImageInfo *timageInfo =
-      dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo);
-  if (timageInfo) {
-    savebox = timageInfo->m_savebox;
-    return true;
-  }
-#endif
-  return false;
-}
-
-//------------------------------------------------------------------------------
+bool TImageCache::getSubsampling(const std::string &id, int &subs) const {
+  std::string mainId;
 
-bool TImageCache::getDpi(const std::string &id, double &dpiX,
-                         double &dpiY) const {
-  QMutexLocker sl(&m_imp->m_mutex);
+  {
+    CacheShard &shard = m_imp->getShard(id);
+    TThread::MutexLocker sl(&shard.m_mutex);
 
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) {
-    UncompressedOnMemoryCacheItemP uncompressed = it->second;
-    assert(uncompressed);
-    TToonzImageP ti = uncompressed->getImage();
-    if (ti) {
-      ti->getDpi(dpiX, dpiY);
-      return true;
-    }
-    TRasterImageP ri = uncompressed->getImage();
-    if (ri) {
-      ri->getDpi(dpiX, dpiY);
-      return true;
-    }
-    return false;
-  }
-  std::map<std::string, CacheItemP>::iterator itc =
-      m_imp->m_compressedItems.find(id);
-  if (itc == m_imp->m_compressedItems.end()) return false;
-  CacheItemP cacheItem = itc->second;
-  assert(cacheItem->m_imageInfo);
-
-  RasterImageInfo *rimageInfo =
-      dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo);
-  if (rimageInfo) {
-    dpiX = rimageInfo->m_dpix;
-    dpiY = rimageInfo->m_dpiy;
-    return true;
-  }
+    std::map<std::string, std::string>::iterator it1;
+    if ((it1 = shard.m_duplicatedItems.find(id)) !=
+        shard.m_duplicatedItems.end())
+      mainId = it1->second;
+    else {
+      CacheShard::Iterator it = shard.m_uncompressedItems.find(id);
+      if (it != shard.m_uncompressedItems.end()) {
+        UncompressedOnMemoryCacheItemP uncompressed = it->second;
+        assert(uncompressed);
 #ifndef TNZCORE_LIGHT
-  ToonzImageInfo *timageInfo =
-      dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo);
-  if (timageInfo) {
-    dpiX = timageInfo->m_dpix;
-    dpiY = timageInfo->m_dpiy;
-    return true;
-  }
-#endif
-  return false;
-}
+        if (TToonzImageP ti = uncompressed->getImage()) {
+          subs = ti->getSubsampling();
+          return true;
+        }
 
-//------------------------------------------------------------------------------
+        else
 #endif
-
-bool TImageCache::getSubsampling(const std::string &id, int &subs) const {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, std::string>::iterator it1;
-  if ((it1 = m_imp->m_duplicatedItems.find(id)) !=
-      m_imp->m_duplicatedItems.end()) {
-    assert(m_imp->m_duplicatedItems.find(it1->second) ==
-           m_imp->m_duplicatedItems.end());
-    return getSubsampling(it1->second, subs);
-  }
-
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) {
-    UncompressedOnMemoryCacheItemP uncompressed = it->second;
-    assert(uncompressed);
+            if (TRasterImageP ri = uncompressed->getImage()) {
+          subs = ri->getSubsampling();
+          return true;
+        } else
+          return false;
+      }
+      CacheShard::Iterator itc = shard.m_compressedItems.find(id);
+      if (itc == shard.m_compressedItems.end()) return false;
+      CacheItemP cacheItem = itc->second;
+      assert(cacheItem->m_imageInfo);
+      if (RasterImageInfo *rimageInfo =
+              dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo)) {
+        subs = rimageInfo->m_subs;
+        return true;
+      }
 #ifndef TNZCORE_LIGHT
-    if (TToonzImageP ti = uncompressed->getImage()) {
-      subs = ti->getSubsampling();
-      return true;
-    }
-
-    else
+      else if (ToonzImageInfo *timageInfo =
+                   dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo)) {
+        subs = timageInfo->m_subs;
+        return true;
+      }
 #endif
-        if (TRasterImageP ri = uncompressed->getImage()) {
-      subs = ri->getSubsampling();
-      return true;
-    } else
-      return false;
-  }
-  std::map<std::string, CacheItemP>::iterator itc =
-      m_imp->m_compressedItems.find(id);
-  if (itc == m_imp->m_compressedItems.end()) return false;
-  CacheItemP cacheItem = itc->second;
-  assert(cacheItem->m_imageInfo);
-  if (RasterImageInfo *rimageInfo =
-          dynamic_cast<RasterImageInfo *>(cacheItem->m_imageInfo)) {
-    subs = rimageInfo->m_subs;
-    return true;
-  }
-#ifndef TNZCORE_LIGHT
-  else if (ToonzImageInfo *timageInfo =
-               dynamic_cast<ToonzImageInfo *>(cacheItem->m_imageInfo)) {
-    subs = timageInfo->m_subs;
-    return true;
+      else
+        return false;
+    }
   }
-#endif
-  else
-    return false;
+
+  return getSubsampling(mainId, subs);
 }
 
 //------------------------------------------------------------------------------
 
 bool TImageCache::hasBeenModified(const std::string &id, bool reset) const {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-
-  std::map<std::string, std::string>::iterator it;
-  if ((it = m_imp->m_duplicatedItems.find(id)) !=
-      m_imp->m_duplicatedItems.end()) {
-    assert(m_imp->m_duplicatedItems.find(it->second) ==
-           m_imp->m_duplicatedItems.end());
-    return hasBeenModified(it->second, reset);
-  }
+  std::string mainId;
 
-  TImageP img;
+  {
+    CacheShard &shard = m_imp->getShard(id);
+    TThread::MutexLocker sl(&shard.m_mutex);
 
-  std::map<std::string, CacheItemP>::iterator itu =
-      m_imp->m_uncompressedItems.find(id);
-  if (itu != m_imp->m_uncompressedItems.end()) {
-    if (reset && itu->second->m_modified) {
-      itu->second->m_modified = false;
-      return true;
-    } else
-      return itu->second->m_modified;
+    std::map<std::string, std::string>::iterator it;
+    if ((it = shard.m_duplicatedItems.find(id)) !=
+        shard.m_duplicatedItems.end())
+      mainId = it->second;
+    else {
+      CacheShard::Iterator itu = shard.m_uncompressedItems.find(id);
+      if (itu != shard.m_uncompressedItems.end()) {
+        if (reset && itu->second->m_modified) {
+          itu->second->m_modified = false;
+          return true;
+        } else
+          return itu->second->m_modified;
+      }
+      return true;  // not present in cache==modified (for particle purposes...)
+    }
   }
-  return true;  // not present in cache==modified (for particle purposes...)
+
+  return hasBeenModified(mainId, reset);
 }
 
 //------------------------------------------------------------------------------
@@ -1699,78 +1777,70 @@ TImageP TImageCache::get(const std::string &id, bool toBeModified) const {
 //------------------------------------------------------------------------------
 
 TImageP TImageCache::Imp::get(const std::string &id, bool toBeModified) {
-  TThread::MutexLocker sl(&m_mutex);
-
-  std::map<std::string, std::string>::const_iterator it;
-  if ((it = m_duplicatedItems.find(id)) != m_duplicatedItems.end()) {
-    assert(m_duplicatedItems.find(it->second) == m_duplicatedItems.end());
-    return get(it->second, toBeModified);
-  }
-
   TImageP img;
+  std::string mainId;
+  bool isDuplicate = false;
 
-  std::map<std::string, CacheItemP>::iterator itu =
-      m_uncompressedItems.find(id);
-  if (itu != m_uncompressedItems.end()) {
-    img = itu->second->getImage();
-    if (itu->second->m_historyCount !=
-        HistoryCount - 1)  // significa che l'ultimo get non era sulla stessa
-                           // immagine, quindi  serve aggiornare l'history!
-    {
-      assert(m_itemHistory.find(itu->second->m_historyCount) !=
-             m_itemHistory.end());
-      m_itemHistory.erase(itu->second->m_historyCount);
-      m_itemHistory[HistoryCount] = id;
-      itu->second->m_historyCount = HistoryCount;
-      HistoryCount++;
-    }
-    if (toBeModified) {
-      itu->second->m_modified = true;
-      std::map<std::string, CacheItemP>::iterator itc =
-          m_compressedItems.find(id);
-      if (itc != m_compressedItems.end()) m_compressedItems.erase(itc);
-    }
-    return img;
-  }
-
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.find(id);
-  if (itc == m_compressedItems.end()) return 0;
+  {
+    CacheShard &shard = getShard(id);
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    std::map<std::string, std::string>::const_iterator it;
+    if ((it = shard.m_duplicatedItems.find(id)) !=
+        shard.m_duplicatedItems.end()) {
+      mainId      = it->second;
+      isDuplicate = true;
+    } else {
+      CacheShard::Iterator itu = shard.m_uncompressedItems.find(id);
+      if (itu != shard.m_uncompressedItems.end()) {
+        img = itu->second->getImage();
+        shard.m_lru.touch(itu->second.getPointer());
+        if (toBeModified) {
+          itu->second->m_modified = true;
+          CacheShard::Iterator itc = shard.m_compressedItems.find(id);
+          if (itc != shard.m_compressedItems.end())
+            shard.eraseCompressed(itc);
+        }
+        return img;
+      }
 
-  CacheItemP cacheItem = itc->second;
+      CacheShard::Iterator itc = shard.m_compressedItems.find(id);
+      if (itc == shard.m_compressedItems.end()) return 0;
 
-  img = cacheItem->getImage();
+      CacheItemP cacheItem = itc->second;
 
-  CacheItemP uncompressed;
-  uncompressed                    = new UncompressedOnMemoryCacheItem(img);
-  m_uncompressedItems[itc->first] = uncompressed;
-  m_itemsByImagePointer[getPointer(img)] = itc->first;
+      img = cacheItem->getImage();
 
-  m_itemHistory[HistoryCount]  = itc->first;
-  uncompressed->m_historyCount = HistoryCount;
-  HistoryCount++;
+      CacheItemP uncompressed = new UncompressedOnMemoryCacheItem(img);
+      shard.insertUncompressed(itc->first, uncompressed);
+      setImagePointer(getPointer(img), itc->first);
 
-  if (CompressedOnMemoryCacheItemP(cacheItem))
-  // l'immagine compressa non la tengo insieme alla
-  // uncompressa se e' troppo grande
-  {
-    if (10 * cacheItem->getSize() > uncompressed->getSize()) {
-      m_compressedItems.erase(itc);
-      itc = m_compressedItems.end();
+      if (CompressedOnMemoryCacheItemP(cacheItem))
+      // l'immagine compressa non la tengo insieme alla
+      // uncompressa se e' troppo grande
+      {
+        if (10 * cacheItem->getSize() > uncompressed->getSize()) {
+          shard.eraseCompressed(itc);
+          itc = shard.m_compressedItems.end();
+        }
+      } else
+        assert((CompressedOnDiskCacheItemP)cacheItem ||
+               (UncompressedOnDiskCacheItemP)
+                   cacheItem);  // deve essere compressa!
+
+      if (toBeModified && itc != shard.m_compressedItems.end()) {
+        uncompressed->m_modified = true;
+        shard.eraseCompressed(itc);
+      }
     }
-  } else
-    assert((CompressedOnDiskCacheItemP)cacheItem ||
-           (UncompressedOnDiskCacheItemP)cacheItem);  // deve essere compressa!
-
-  if (toBeModified && itc != m_compressedItems.end()) {
-    uncompressed->m_modified = true;
-    m_compressedItems.erase(itc);
   }
 
-  uncompressed->m_cantCompress = toBeModified;
-  // se la memoria utilizzata e' superiore al massimo consentito, comprime
-  doCompress();
+  if (isDuplicate) return get(mainId, toBeModified);
 
-  uncompressed->m_cantCompress = false;
+  // se la memoria utilizzata e' superiore al massimo consentito, comprime.
+  // The returned image is externally referenced, so it won't be compressed
+  // back by this pass.
+  doCompress();
 
 //#define DO_MEMCHECK
 #ifdef DO_MEMCHECK
@@ -1782,26 +1852,8 @@ TImageP TImageCache::Imp::get(const std::string &id, bool toBeModified) {
 
 //------------------------------------------------------------------------------
 
-namespace {
-
-class AccumulateMemUsage {
-public:
-  int operator()(int oldValue, std::pair<std::string, CacheItemP> item) {
-    return oldValue + item.second->getSize();
-  }
-};
-}
-
-UINT TImageCache::getMemUsage() const {
-  TThread::MutexLocker sl(&m_imp->m_mutex);
-
-  int ret = std::accumulate(m_imp->m_uncompressedItems.begin(),
-                            m_imp->m_uncompressedItems.end(), 0,
-                            AccumulateMemUsage());
-
-  return ret + std::accumulate(m_imp->m_compressedItems.begin(),
-                               m_imp->m_compressedItems.end(), 0,
-                               AccumulateMemUsage());
+TUINT64 TImageCache::getMemUsage() const {
+  return (TUINT64)std::max(m_imp->m_memUsage.load(), (TINT64)0);
 }
 
 //------------------------------------------------------------------------------
@@ -1811,28 +1863,23 @@ UINT TImageCache::getDiskUsage() const { return 0; }
 //------------------------------------------------------------------------------
 
 UINT TImageCache::getMemUsage(const std::string &id) const {
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) return it->second->getSize();
+  CacheShard &shard = m_imp->getShard(id);
+  TThread::MutexLocker sl(&shard.m_mutex);
 
-  it = m_imp->m_compressedItems.find(id);
-  if (it != m_imp->m_compressedItems.end()) return it->second->getSize();
+  CacheShard::Iterator it = shard.m_uncompressedItems.find(id);
+  if (it != shard.m_uncompressedItems.end()) return it->second->getSize();
+
+  it = shard.m_compressedItems.find(id);
+  if (it != shard.m_compressedItems.end()) return it->second->getSize();
   return 0;
 }
 
 //------------------------------------------------------------------------------
 
-//! Returns the uncompressed image size (in KB) of the image associated with
+//! Returns the uncompressed image size (bytes) of the image associated with
 //! passd id, or 0 if none was found.
 UINT TImageCache::getUncompressedMemUsage(const std::string &id) const {
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.find(id);
-  if (it != m_imp->m_uncompressedItems.end()) return it->second->getSize();
-
-  it = m_imp->m_compressedItems.find(id);
-  if (it != m_imp->m_compressedItems.end()) return it->second->getSize();
-
-  return 0;
+  return getMemUsage(id);
 }
 
 //------------------------------------------------------------------------------
@@ -1851,10 +1898,14 @@ UINT TImageCache::getDiskUsage(const std::string &id) const { return 0; }
 
 void TImageCache::dump(std::ostream &os) const {
   os << "mem: " << getMemUsage() << std::endl;
-  std::map<std::string, CacheItemP>::iterator it =
-      m_imp->m_uncompressedItems.begin();
-  for (; it != m_imp->m_uncompressedItems.end(); ++it) {
-    os << it->first << std::endl;
+  for (size_t s = 0; s < m_imp->m_shards.size(); ++s) {
+    CacheShard &shard = *m_imp->m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    CacheShard::Iterator it = shard.m_uncompressedItems.begin();
+    for (; it != shard.m_uncompressedItems.end(); ++it) {
+      os << it->first << std::endl;
+    }
   }
 }
 
@@ -1867,7 +1918,6 @@ void TImageCache::outputMap(UINT chunkRequested, std::string filename) {
 //------------------------------------------------------------------------------
 
 void TImageCache::Imp::outputMap(UINT chunkRequested, std::string filename) {
-  TThread::MutexLocker sl(&m_mutex);
   //#ifdef _DEBUG
   // static int Count = 0;
 
@@ -1891,37 +1941,40 @@ void TImageCache::Imp::outputMap(UINT chunkRequested, std::string filename) {
   TUINT64 umsize  = 0;
   TUINT64 udsize  = 0;
 
-  std::map<std::string, CacheItemP>::iterator itu = m_uncompressedItems.begin();
-
-  for (; itu != m_uncompressedItems.end(); ++itu) {
-    UncompressedOnMemoryCacheItemP uitem = itu->second;
-    if (uitem->m_image && hasExternalReferences(uitem->m_image)) {
-      umcount1++;
-      umsize1 += (TUINT64)(itu->second->getSize() / 1024.0);
-    } else if (uitem->m_cantCompress) {
-      umcount2++;
-      umsize2 += (TUINT64)(itu->second->getSize() / 1024.0);
-    } else {
-      umcount3++;
-      umsize3 += (TUINT64)(itu->second->getSize() / 1024.0);
+  for (size_t s = 0; s < m_shards.size(); ++s) {
+    CacheShard &shard = *m_shards[s];
+    TThread::MutexLocker sl(&shard.m_mutex);
+
+    CacheShard::Iterator itu = shard.m_uncompressedItems.begin();
+    for (; itu != shard.m_uncompressedItems.end(); ++itu) {
+      UncompressedOnMemoryCacheItemP uitem = itu->second;
+      if (uitem->m_image && hasExternalReferences(uitem->m_image)) {
+        umcount1++;
+        umsize1 += (TUINT64)(itu->second->getSize() / 1024.0);
+      } else if (uitem->m_cantCompress) {
+        umcount2++;
+        umsize2 += (TUINT64)(itu->second->getSize() / 1024.0);
+      } else {
+        umcount3++;
+        umsize3 += (TUINT64)(itu->second->getSize() / 1024.0);
+      }
     }
-  }
-  std::map<std::string, CacheItemP>::iterator itc = m_compressedItems.begin();
-  for (; itc != m_compressedItems.end(); ++itc) {
-    CacheItemP boh                      = itc->second;
-    CompressedOnMemoryCacheItemP cmitem = itc->second;
-    CompressedOnDiskCacheItemP cditem   = itc->second;
-    UncompressedOnDiskCacheItemP uditem = itc->second;
-    if (cmitem) {
-      cmcount++;
-      cmsize += cmitem->getSize();
-    } else if (cditem) {
-      cdcount++;
-      cdsize += cditem->getSize();
-    } else {
-      assert(uditem);
-      udcount++;
-      udsize += uditem->getSize();
+    CacheShard::Iterator itc = shard.m_compressedItems.begin();
+    for (; itc != shard.m_compressedItems.end(); ++itc) {
+      CompressedOnMemoryCacheItemP cmitem = itc->second;
+      CompressedOnDiskCacheItemP cditem   = itc->second;
+      UncompressedOnDiskCacheItemP uditem = itc->second;
+      if (cmitem) {
+        cmcount++;
+        cmsize += cmitem->getSize();
+      } else if (cditem) {
+        cdcount++;
+        cdsize += cditem->getSize();
+      } else {
+        assert(uditem);
+        udcount++;
+        udsize += uditem->getSize();
+      }
     }
   }
 
@@ -1942,6 +1995,10 @@ void TImageCache::Imp::outputMap(UINT chunkRequested, std::string filename) {
             std::to_string(
                 (int)((currPhisMemoryAvail * 100) / m_reservedMemory)) +
             "\n";
+  if (TUINT64 budget = m_memoryBudget)
+    os << "***cache budget " + std::to_string(budget / 1048576.0) +
+              " MB; used " + std::to_string(m_memUsage.load() / 1048576.0) +
+              " MB\n";
   // os<<"***bigmem available" +
   // std::to_string((int)TBigMemoryManager::instance()->getAvailableMemoryinKb());
   os << "***uncompressed NOT compressible(refcount>1)   " +
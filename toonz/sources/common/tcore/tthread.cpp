@@ -13,15 +13,14 @@
 #include "tthreadp.h"
 
 // STL includes
+#include <exception>
 #include <set>
+#include <map>
 #include <deque>
-
-// tcg includes
-#include "tcg/tcg_pool.h"
+#include <vector>
+#include <algorithm>
 
 // Qt includes
-#include <QMultiMap>
-#include <QMutableMapIterator>
 #include <QMutex>
 #include <QWaitCondition>
 #include <QMetaType>
@@ -34,19 +33,25 @@
 //--------------------------------------------------
 
 // Basics:
-//  * Tasks added by Executors are always stored in a global QMultiMap first -
-//    ordering primarily being the schedulingPriority(), and insertion instant
-//    (implicit) when they have the same scheduling priority.
-//  * The QMultiMap needs to be reverse-iterated to do that, since values with
-//    the same key are ordered from the most recent to the oldest one (see Qt's
-//    manual).
+//  * Tasks added by Executors are stored in a queue private to their
+//    ExecutorId - ordering primarily being the schedulingPriority(), and
+//    insertion instant when they have the same scheduling priority.
+//  * The global task order is obtained through an index of the executors'
+//    queue heads, sorted the same way. Since all the tasks of an Executor
+//    following a non-executable one are skipped anyway, visiting heads only
+//    is equivalent to traversing all tasks - but it does not degrade when
+//    many tasks are accumulated by a serialized Executor.
 //  * Worker threads are stored in a global set.
 //  * When a task is added or a task has been performed, the workers list is
 //    refreshed, possibly adding new Workers for some executable tasks.
 //  * When a worker ends a task, it automatically takes a new one before
 //  refreshing
-//    the workers list. If no task can be taken, by default the thread exits and
-//    invokes its own destruction.
+//    the workers list. If no task can be taken, the thread is parked for a
+//    while, to be recycled by later tasks; when too many threads are already
+//    parked, or the parking time expires, the thread exits and invokes its
+//    own destruction.
+//  * Parked threads can be assigned tasks from any thread, whereas new threads
+//    are always created in the main thread (see ExecutorImpSlots).
 //  * The thread may instead be put to rest if explicitly told by the user with
 //    the appropriate method.
 
@@ -175,6 +180,26 @@ namespace TThread {
 
 //==============================================================================
 
+//=====================
+//    TaskKey class
+//---------------------
+
+//! Scheduling order of a task: higher priorities first, then insertion order.
+struct TaskKey {
+  int m_priority;
+  unsigned long long m_insertionIdx;
+
+  bool operator<(const TaskKey &other) const {
+    return (m_priority > other.m_priority) ||
+           (m_priority == other.m_priority &&
+            m_insertionIdx < other.m_insertionIdx);
+  }
+};
+
+typedef std::map<TaskKey, RunnableP> TasksQueue;
+
+//==============================================================================
+
 //===========================
 //    Worker Thread class
 //---------------------------
@@ -188,6 +213,7 @@ public:
   TSmartPointerT<ExecutorId> m_master;
 
   bool m_exit;
+  bool m_parked;
   QWaitCondition m_waitCondition;
 
   Worker();
@@ -222,7 +248,7 @@ public:
 //! \sa Executor and Runnable class.
 class ExecutorId final : public TSmartObject {
 public:
-  size_t m_id;
+  TasksQueue m_tasks;  //!< Tasks waiting for execution
 
   int m_activeTasks;
   int m_maxActiveTasks;
@@ -239,7 +265,7 @@ public:
 
   inline void accumulate(const RunnableP &task);
 
-  void newWorker(RunnableP &task);
+  bool newWorker(RunnableP &task, bool canSpawn);
   void refreshDedicatedList();
 };
 
@@ -256,11 +282,14 @@ public:
 //! and event-looped thread - typically the main thread in GUI applications.
 class ExecutorImp {
 public:
-  QMultiMap<int, RunnableP> m_tasks;
-  std::set<Worker *> m_workers;  // Used just for debugging purposes
+  typedef std::map<TaskKey, ExecutorId *> HeadsMap;
 
-  tcg::indices_pool<> m_executorIdPool;
-  std::vector<UCHAR> m_waitingFlagsPool;
+  HeadsMap m_heads;  // Executors with waiting tasks, by their first task
+  unsigned long long m_insertionsCount;
+
+  std::set<Worker *> m_workers;  // Used just for debugging purposes
+  std::vector<Worker *> m_parkedWorkers;
+  int m_maxParkedWorkers;
 
   int m_activeLoad;
   int m_maxLoad;
@@ -271,8 +300,12 @@ public:
   ~ExecutorImp();
 
   inline void insertTask(int schedulingPriority, RunnableP &task);
+  inline HeadsMap::iterator takeHead(HeadsMap::iterator it);
+  inline bool removeTask(const RunnableP &task);
+  inline void removeTasks(ExecutorId *id, std::vector<RunnableP> &tasks);
 
-  void refreshAssignments();
+  bool refreshAssignments(bool canSpawn = true);
+  inline void refreshFromWorker();
 
   inline bool isExecutable(RunnableP &task);
 };
@@ -291,6 +324,8 @@ namespace {
 ExecutorImp *globalImp           = 0;
 ExecutorImpSlots *globalImpSlots = 0;
 bool shutdownVar                 = false;
+
+const unsigned long parkingTime = 5000;  // Msecs a parked worker waits
 }
 
 //=====================================================================
@@ -300,7 +335,9 @@ bool shutdownVar                 = false;
 //-----------------------------
 
 ExecutorImp::ExecutorImp()
-    : m_activeLoad(0)
+    : m_insertionsCount(0)
+    , m_maxParkedWorkers(TSystem::getProcessorCount())
+    , m_activeLoad(0)
     , m_maxLoad(TSystem::getProcessorCount() * 100)
     , m_transitionMutex()  // NOTE: We'll wait on this mutex - so it can't be
                            // recursive
@@ -323,7 +360,80 @@ inline bool ExecutorImp::isExecutable(RunnableP &task) {
 
 inline void ExecutorImp::insertTask(int schedulingPriority, RunnableP &task) {
   task->m_schedulingPriority = schedulingPriority;
-  m_tasks.insert(schedulingPriority, task);
+
+  ExecutorId *id = task->m_id;
+  TaskKey key    = {schedulingPriority, m_insertionsCount++};
+
+  // Update the executor's head in case the new task comes first
+  if (!id->m_tasks.empty()) {
+    const TaskKey &headKey = id->m_tasks.begin()->first;
+    if (key < headKey) {
+      m_heads.erase(headKey);
+      m_heads.insert(std::make_pair(key, id));
+    }
+  } else
+    m_heads.insert(std::make_pair(key, id));
+
+  id->m_tasks.insert(std::make_pair(key, task));
+}
+
+//---------------------------------------------------------------------
+
+// Removes the first task of the executor pointed by it. Returns the
+// iterator to the next head to be visited - which may be the one of the
+// same executor.
+inline ExecutorImp::HeadsMap::iterator ExecutorImp::takeHead(
+    HeadsMap::iterator it) {
+  ExecutorId *id = it->second;
+  TaskKey key    = it->first;
+
+  m_heads.erase(it);
+  id->m_tasks.erase(id->m_tasks.begin());
+
+  if (!id->m_tasks.empty())
+    m_heads.insert(std::make_pair(id->m_tasks.begin()->first, id));
+
+  return m_heads.upper_bound(key);
+}
+
+//---------------------------------------------------------------------
+
+inline bool ExecutorImp::removeTask(const RunnableP &task) {
+  ExecutorId *id = task->m_id;
+
+  TasksQueue::iterator it, end = id->m_tasks.end();
+  for (it = id->m_tasks.begin(); it != end; ++it) {
+    if (it->second == task) {
+      if (it == id->m_tasks.begin()) {
+        m_heads.erase(it->first);
+        id->m_tasks.erase(it);
+
+        if (!id->m_tasks.empty())
+          m_heads.insert(std::make_pair(id->m_tasks.begin()->first, id));
+      } else
+        id->m_tasks.erase(it);
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//---------------------------------------------------------------------
+
+// Moves all tasks waiting for execution (from the specified executor, or
+// every one if none) to the passed vector, preserving their order.
+inline void ExecutorImp::removeTasks(ExecutorId *id,
+                                     std::vector<RunnableP> &tasks) {
+  HeadsMap::iterator it = m_heads.begin();
+  while (it != m_heads.end()) {
+    if (!id || it->second == id) {
+      tasks.push_back(it->second->m_tasks.begin()->second);
+      it = takeHead(it);
+    } else
+      ++it;
+  }
 }
 
 //=====================================================================
@@ -518,12 +628,7 @@ ExecutorId::ExecutorId()
     , m_activeLoad(0)
     , m_maxActiveLoad((std::numeric_limits<int>::max)())
     , m_dedicatedThreads(false)
-    , m_persistentThreads(false) {
-  QMutexLocker transitionLocker(&globalImp->m_transitionMutex);
-
-  m_id = globalImp->m_executorIdPool.acquire();
-  globalImp->m_waitingFlagsPool.resize(globalImp->m_executorIdPool.size());
-}
+    , m_persistentThreads(false) {}
 
 //---------------------------------------------------------------------
 
@@ -534,8 +639,6 @@ ExecutorId::~ExecutorId() {
     m_persistentThreads = 0;
     refreshDedicatedList();
   }
-
-  globalImp->m_executorIdPool.release(m_id);
 }
 
 //---------------------------------------------------------------------
@@ -566,7 +669,8 @@ void ExecutorId::refreshDedicatedList() {
 //      Worker methods
 //---------------------------
 
-Worker::Worker() : QThread(), m_task(0), m_master(0), m_exit(true) {}
+Worker::Worker()
+    : QThread(), m_task(0), m_master(0), m_exit(true), m_parked(false) {}
 
 //---------------------------------------------------------------------
 
@@ -608,12 +712,30 @@ void Worker::run() {
       onFinish();
 
       if (!m_exit && !shutdownVar) {
-        // Put the worker to sleep
-        m_waitCondition.wait(sl.mutex());
-
-        // Upon thread destruction the wait condition is implicitly woken up.
-        // If this is the case, m_task == 0 and we return.
-        if (!m_task || shutdownVar) return;
+        if (m_parked) {
+          // Wait for a while for another task to be assigned
+          m_waitCondition.wait(sl.mutex(), parkingTime);
+
+          if (!m_task) {
+            // No task came in time (or shutdown) - quit
+            std::vector<Worker *> &parked = globalImp->m_parkedWorkers;
+            parked.erase(std::find(parked.begin(), parked.end(), this));
+
+            m_parked = false;
+            m_exit   = true;
+            globalImp->m_workers.erase(this);
+            return;
+          }
+
+          if (shutdownVar) return;
+        } else {
+          // Put the worker to sleep
+          m_waitCondition.wait(sl.mutex());
+
+          // Upon thread destruction the wait condition is implicitly woken up.
+          // If this is the case, m_task == 0 and we return.
+          if (!m_task || shutdownVar) return;
+        }
       } else
         return;
     }
@@ -652,6 +774,13 @@ inline void Worker::onFinish() {
     // in that case
 
     globalImp->m_transitionMutex.lock();
+  } else if (!m_master && (int)globalImp->m_parkedWorkers.size() <
+                              globalImp->m_maxParkedWorkers) {
+    // Keep the thread around, sparing the creation of a new one if tasks
+    // keep coming
+    m_exit   = false;
+    m_parked = true;
+    globalImp->m_parkedWorkers.push_back(this);
   } else {
     m_exit = true;
     globalImp->m_workers.erase(this);
@@ -724,6 +853,10 @@ void Executor::init() {
 //! slot make it quit.
 void Executor::shutdown() {
   {
+    // Released tasks may release their ExecutorId, which locks the transition
+    // mutex in turn - so they must be destroyed outside the lock
+    std::vector<RunnableP> tasks;
+
     // Updating tasks list - lock against state transitions
     QMutexLocker transitionLocker(&globalImp->m_transitionMutex);
 
@@ -737,14 +870,11 @@ void Executor::shutdown() {
       if (task) Q_EMIT task->canceled(task);
     }
 
-    // Finally, deal with the global queue tasks
-    QMutableMapIterator<int, RunnableP> jt(globalImp->m_tasks);
-    while (jt.hasNext()) {
-      jt.next();
-      RunnableP task = jt.value();
-      Q_EMIT task->canceled(task);
-      jt.remove();
-    }
+    // Finally, deal with the queued tasks
+    globalImp->removeTasks(0, tasks);
+
+    std::vector<RunnableP>::iterator jt, jEnd = tasks.end();
+    for (jt = tasks.begin(); jt != jEnd; ++jt) Q_EMIT(*jt)->canceled(*jt);
 
     // Now, send the terminate() signal to all active tasks
     for (it = globalImp->m_workers.begin(); it != globalImp->m_workers.end();
@@ -752,6 +882,11 @@ void Executor::shutdown() {
       RunnableP task = (*it)->m_task;
       if (task) Q_EMIT task->terminated(task);
     }
+
+    // Wake parked workers, so they quit
+    std::vector<Worker *>::iterator kt, kEnd = globalImp->m_parkedWorkers.end();
+    for (kt = globalImp->m_parkedWorkers.begin(); kt != kEnd; ++kt)
+      (*kt)->m_waitCondition.wakeOne();
   }
 
   // Just placing a convenience processEvents() to make sure that queued slots
@@ -802,6 +937,7 @@ void Executor::setDedicatedThreads(bool dedicated, bool persistent) {
 //! Submits a task for execution. The task is executed according to
 //! its task load, insertion time and scheduling priority.
 void Executor::addTask(RunnableP task) {
+  bool needsRefresh;
   {
     if (task->m_id)  // Must be done outside transition lock, since eventually
       task->m_id->release();  // invoked ~ExecutorId will lock it
@@ -813,11 +949,15 @@ void Executor::addTask(RunnableP task) {
     m_id->addRef();
 
     globalImp->insertTask(task->schedulingPriority(), task);
+
+    // Parked workers can be assigned right away, from any thread. Only if
+    // some task remains, the main thread is requested to spawn new workers.
+    needsRefresh = !globalImp->refreshAssignments(false);
   }
 
   // If addTask is called in the main thread, the emit works directly -
   // so it is necessary to unlock the mutex *before* emitting the refresh.
-  globalImpSlots->emitRefreshAssignments();
+  if (needsRefresh) globalImpSlots->emitRefreshAssignments();
 }
 
 //---------------------------------------------------------------------
@@ -835,9 +975,9 @@ void Executor::removeTask(RunnableP task) {
   // Updating tasks list - lock against state transitions
   QMutexLocker transitionLocker(&globalImp->m_transitionMutex);
 
-  // Then, look in the global queue - if it is found, emiminate the task and
-  // send the canceled signal.
-  if (globalImp->m_tasks.remove(task->m_schedulingPriority, task)) {
+  // Then, look in the executor's queue - if it is found, emiminate the task
+  // and send the canceled signal.
+  if (globalImp->removeTask(task)) {
     Q_EMIT task->canceled(task);
     return;
   }
@@ -858,6 +998,9 @@ void Executor::removeTask(RunnableP task) {
 //! described in the \b removeTask method apply here.
 //! \sa \b Runnable::canceled signal and the \b removeTask method.
 void Executor::cancelAll() {
+  // Removed tasks must be released outside the lock - see shutdown()
+  std::vector<RunnableP> tasks;
+
   // Updating tasks list - lock against state transitions
   QMutexLocker transitionLocker(&globalImp->m_transitionMutex);
 
@@ -870,18 +1013,11 @@ void Executor::cancelAll() {
     if (task && task->m_id == m_id) Q_EMIT task->canceled(task);
   }
 
-  // Finally, clear the global tasks list from all tasks inserted by this
-  // executor
-  // NOTE: An easier way here?
-  QMutableMapIterator<int, RunnableP> jt(globalImp->m_tasks);
-  while (jt.hasNext()) {
-    jt.next();
-    if (jt.value()->m_id == m_id) {
-      RunnableP task = jt.value();
-      Q_EMIT task->canceled(task);
-      jt.remove();
-    }
-  }
+  // Finally, clear the executor's queue
+  globalImp->removeTasks(m_id, tasks);
+
+  std::vector<RunnableP>::iterator jt, jEnd = tasks.end();
+  for (jt = tasks.begin(); jt != jEnd; ++jt) Q_EMIT(*jt)->canceled(*jt);
 }
 
 //---------------------------------------------------------------------
@@ -929,6 +1065,127 @@ int Executor::maxActiveLoad() const {
 
 //=====================================================================
 
+//==================================
+//     Parallel loops
+//----------------------------------
+
+namespace {
+
+// Shares the items of a parallelFor() call among the calling thread and a
+// number of helper tasks.
+class ParallelItems final : public TSmartObject {
+  std::function<void(int)> m_func;
+  int m_count, m_next, m_completed;
+  std::exception_ptr m_exception;  // the first one thrown by m_func
+
+  QMutex m_mutex;
+  QWaitCondition m_allDone;
+
+public:
+  ParallelItems(const std::function<void(int)> &func, int count)
+      : m_func(func), m_count(count), m_next(0), m_completed(0) {}
+
+  bool processNext() {
+    int i;
+    {
+      QMutexLocker locker(&m_mutex);
+      if (m_next >= m_count) return false;
+
+      i = m_next++;
+    }
+
+    std::exception_ptr exception;
+    try {
+      m_func(i);
+    } catch (...) {
+      exception = std::current_exception();
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    if (exception) {
+      if (!m_exception) m_exception = exception;
+      m_next = m_count;  // the remaining items are skipped
+    }
+
+    ++m_completed;
+    m_allDone.wakeAll();
+
+    return true;
+  }
+
+  void waitAll() {
+    QMutexLocker locker(&m_mutex);
+    while (m_completed < m_next) m_allDone.wait(&m_mutex);
+
+    if (m_exception) std::rethrow_exception(m_exception);
+  }
+};
+
+//---------------------------------------------------------------------
+
+class ParallelItemsTask final : public Runnable {
+  TSmartPointerT<ParallelItems> m_items;
+
+public:
+  ParallelItemsTask(ParallelItems *items) : m_items(items) {}
+
+  void run() override {
+    while (m_items->processNext())
+      ;
+  }
+};
+
+}  // namespace
+
+//---------------------------------------------------------------------
+
+Executor &TThread::sharedExecutor() {
+  // Never destroyed, since its tasks may outlive static destruction
+  static Executor *executor = [] {
+    Executor *executor = new Executor;
+    executor->setMaxActiveTasks(TSystem::getProcessorCount());
+    return executor;
+  }();
+
+  return *executor;
+}
+
+//---------------------------------------------------------------------
+
+void TThread::parallelFor(int count, const std::function<void(int)> &func,
+                          int maxThreads) {
+  if (maxThreads <= 0) maxThreads = TSystem::getProcessorCount();
+
+  int helpersCount = std::min(count, maxThreads) - 1;
+  if (helpersCount <= 0) {
+    for (int i = 0; i < count; ++i) func(i);
+    return;
+  }
+
+  // Helper tasks may outlive this call - allocate the data on the heap. Tasks
+  // started late find no item left, and don't call func.
+  TSmartPointerT<ParallelItems> items(new ParallelItems(func, count));
+
+  Executor &executor = sharedExecutor();
+
+  std::vector<RunnableP> helpers;
+  for (int i = 0; i < helpersCount; ++i) {
+    RunnableP helper(new ParallelItemsTask(items.getPointer()));
+    helpers.push_back(helper);
+    executor.addTask(helper);
+  }
+
+  while (items->processNext())
+    ;
+
+  // Helpers that did not start yet are not needed anymore
+  for (int i = 0; i < helpersCount; ++i) executor.removeTask(helpers[i]);
+  items->waitAll();
+}
+
+//=====================================================================
+
 //==================================
 //     ExecutorImpSlots methods
 //----------------------------------
@@ -962,16 +1219,30 @@ void ExecutorImpSlots::onTerminated() { delete QObject::sender(); }
 //      Task adoption methods
 //---------------------------------------------------------------------
 
-inline void ExecutorId::newWorker(RunnableP &task) {
+// Assigns the task to a sleeping worker, if any - otherwise, a new worker is
+// created if allowed. Returns false if the task could not be assigned.
+inline bool ExecutorId::newWorker(RunnableP &task, bool canSpawn) {
   Worker *worker;
 
+  std::vector<Worker *> &parked = globalImp->m_parkedWorkers;
+
   if (m_sleepings.size()) {
     worker = m_sleepings.front();
     m_sleepings.pop_front();
     worker->m_task = task;
     worker->updateCountsOnTake();
     worker->m_waitCondition.wakeOne();
-  } else {
+  } else if (!parked.empty()) {
+    // Recycle the most recently parked worker
+    worker = parked.back();
+    parked.pop_back();
+    worker->m_parked = false;
+    worker->m_task   = task;
+    worker->updateCountsOnTake();
+    worker->m_waitCondition.wakeOne();
+  } else if (!canSpawn)
+    return false;
+  else {
     worker = new Worker;
     globalImp->m_workers.insert(worker);
     QObject::connect(worker, SIGNAL(finished()), globalImpSlots,
@@ -980,6 +1251,8 @@ inline void ExecutorId::newWorker(RunnableP &task) {
     worker->updateCountsOnTake();
     worker->start();
   }
+
+  return true;
 }
 
 //---------------------------------------------------------------------
@@ -1017,41 +1290,40 @@ inline void Worker::adoptTask(RunnableP &task) {
 //  b) Then look for tasks in the id's accumulation queue
 //  c) Finally search in the remaining global tasks queue
 
-void ExecutorImp::refreshAssignments() {
+bool ExecutorImp::refreshAssignments(bool canSpawn) {
   // QMutexLocker transitionLocker(&globalImp->m_transitionMutex);  //Already
   // covered
 
-  if (m_tasks.isEmpty()) return;
-
-  // Erase the id vector data
-  assert(m_executorIdPool.size() == m_waitingFlagsPool.size());
-  memset(&m_waitingFlagsPool.front(), 0, m_waitingFlagsPool.size());
+  if (m_heads.empty()) return true;
 
-  // c) Try with the global queue
-  int e, executorsCount = m_executorIdPool.acquiredSize();
-
-  int i, tasksCount = m_tasks.size();
-  QMultiMap<int, RunnableP>::iterator it;
-  for (i = 0, e = 0, it = m_tasks.end() - 1;
-       i < tasksCount && e < executorsCount; ++i, --it) {
+  // c) Try with the global queue. Executors whose first task does not
+  // satisfy custom conditions are skipped.
+  HeadsMap::iterator it = m_heads.begin();
+  while (it != m_heads.end()) {
     // std::cout<< "global tasks-refreshAss" << std::endl;
     // Take the task
-    RunnableP task = it.value();
+    RunnableP task = it->second->m_tasks.begin()->second;
     task->m_load   = task->taskLoad();
 
-    UCHAR &idWaitingForAnotherTask = m_waitingFlagsPool[task->m_id->m_id];
-    if (idWaitingForAnotherTask) continue;
-
     if (!isExecutable(task)) break;
 
-    if (!task->customConditions()) {
-      ++e;
-      idWaitingForAnotherTask = 1;
-    } else {
-      task->m_id->newWorker(task);
-      it = m_tasks.erase(it);
+    if (!task->customConditions())
+      ++it;
+    else {
+      if (!task->m_id->newWorker(task, canSpawn)) break;
+      it = takeHead(it);
     }
   }
+
+  return m_heads.empty();
+}
+
+//---------------------------------------------------------------------
+
+// Used by workers to assign tasks to parked workers directly - requesting
+// the main thread to spawn new ones only when necessary.
+inline void ExecutorImp::refreshFromWorker() {
+  if (!refreshAssignments(false)) globalImpSlots->emitRefreshAssignments();
 }
 
 //---------------------------------------------------------------------
@@ -1091,27 +1363,15 @@ inline void Worker::takeTask() {
 
   globalImp->m_transitionMutex.lock();
 
-  // Erase the executor id status pool
-  tcg::indices_pool<> &executorIdPool  = globalImp->m_executorIdPool;
-  std::vector<UCHAR> &waitingFlagsPool = globalImp->m_waitingFlagsPool;
-
-  assert(waitingFlagsPool.size() == globalImp->m_executorIdPool.size());
-  memset(&waitingFlagsPool.front(), 0, waitingFlagsPool.size());
+  ExecutorImp::HeadsMap &heads = globalImp->m_heads;
 
-  int e, executorsCount = executorIdPool.acquiredSize();
-
-  int i, tasksCount = globalImp->m_tasks.size();
-  QMultiMap<int, RunnableP>::iterator it;
-  for (i = 0, e = 0, it = globalImp->m_tasks.end() - 1;
-       i < tasksCount && e < executorsCount; ++i, --it) {
+  ExecutorImp::HeadsMap::iterator it;
+  for (it = heads.begin(); it != heads.end(); ++it) {
     // std::cout<< "global tasks-takeTask" << std::endl;
     // Take the first task
-    RunnableP task = it.value();
+    RunnableP task = it->second->m_tasks.begin()->second;
     task->m_load   = task->taskLoad();
 
-    UCHAR &idWaitingForAnotherTask = waitingFlagsPool[task->m_id->m_id];
-    if (idWaitingForAnotherTask) continue;
-
     if (!globalImp->isExecutable(task)) break;
 
     // In case the worker was captured for dedication, check the task
@@ -1123,14 +1383,11 @@ inline void Worker::takeTask() {
     }
 
     // Test its custom conditions
-    if (!task->customConditions()) {
-      ++e;
-      idWaitingForAnotherTask = 1;
-    } else {
+    if (task->customConditions()) {
       adoptTask(task);
-      it = globalImp->m_tasks.erase(it);
+      globalImp->takeHead(it);
 
-      globalImpSlots->emitRefreshAssignments();
+      globalImp->refreshFromWorker();
       break;
     }
   }
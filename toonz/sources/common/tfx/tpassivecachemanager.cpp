@@ -7,6 +7,7 @@
 #include "tcacheresourcepool.h"
 
 #include "tpassivecachemanager.h"
+#include "tpersistentfxcache.h"
 
 //#define USE_SQLITE_HDPOOL
 
@@ -785,6 +786,9 @@ void TPassiveCacheManager::invalidateLevel(const std::string &levelName) {
   // Store the level name until the invalidation is forced
   m_invalidatedLevels.insert(levelName);
 #endif
+
+  // Results on disk may refer to the level's old content, too
+  TPersistentFxCache::instance()->invalidateLevel(levelName);
 }
 
 //-------------------------------------------------------------------------
@@ -0,0 +1,748 @@
+
+
+// TnzCore includes
+#include "tsystem.h"
+#include "ttile.h"
+#include "traster.h"
+#include "trastercm.h"
+#include "tconvert.h"
+
+// TnzBase includes
+#include "trasterfx.h"
+
+// Qt includes
+#include <QCryptographicHash>
+#include <QByteArray>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QThread>
+
+// STD includes
+#include <deque>
+#include <set>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+
+#include "tpersistentfxcache.h"
+
+//****************************************************************************************************
+//    Local namespace
+//****************************************************************************************************
+
+namespace {
+
+const char fileMagic[4]   = {'O', 'T', 'F', 'C'};
+const TUINT32 fileVersion = 1;
+const QString fileSuffix("otfc");
+
+// Entries are removed down to this fraction of the maximum size, so that
+// eviction scans do not take place on every single store.
+const double evictionRatio = 0.9;
+
+// The in-memory index of the folder is rebuilt after this time (msecs), to
+// see the entries stored by other processes.
+const qint64 indexRefreshTime = 30000;
+
+// Maximum bytes of results waiting for the writer thread.
+const TINT64 maxQueuedBytes = TINT64(512) << 20;
+
+enum RasterType { NONE, RGBM32, RGBM64, RGBMFloat, CM32 };
+
+struct EntryHeader {
+  char m_magic[4];
+  TUINT32 m_version;
+  TINT32 m_rasterType;
+  TINT32 m_lx, m_ly;
+  TINT32 m_linear;
+  TUINT32 m_dataSize;
+};
+
+//----------------------------------------------------------------------------
+
+RasterType getRasterType(const TRasterP &ras) {
+  if ((TRaster32P)ras) return RGBM32;
+  if ((TRaster64P)ras) return RGBM64;
+  if ((TRasterFP)ras) return RGBMFloat;
+  if ((TRasterCM32P)ras) return CM32;
+  return NONE;
+}
+
+//----------------------------------------------------------------------------
+
+struct EntryInfo {
+  QString m_path;
+  QDateTime m_lastUse;
+  TINT64 m_size;
+
+  bool operator<(const EntryInfo &other) const {
+    return m_lastUse < other.m_lastUse;
+  }
+};
+
+//----------------------------------------------------------------------------
+
+// Lists the entries in the cache folder. Accesses the disk only - no lock is
+// needed.
+void scanFolder(const QString &path, std::vector<EntryInfo> &entries,
+                std::unordered_set<std::string> &keys, TINT64 &size) {
+  size = 0;
+
+  QDirIterator it(path, QStringList("*." + fileSuffix), QDir::Files,
+                  QDirIterator::Subdirectories);
+  while (it.hasNext()) {
+    it.next();
+
+    const QFileInfo &fi = it.fileInfo();
+    EntryInfo entry     = {fi.absoluteFilePath(), fi.lastModified(), fi.size()};
+    entries.push_back(entry);
+    keys.insert(fi.completeBaseName().toStdString());
+
+    size += entry.m_size;
+  }
+}
+
+//----------------------------------------------------------------------------
+
+// Removes the least recently used entries until the folder size is below
+// targetSize. Returns the keys of the removed entries.
+std::vector<std::string> removeOldest(std::vector<EntryInfo> &entries,
+                                      TINT64 &size, TINT64 targetSize) {
+  std::vector<std::string> removedKeys;
+  if (size <= targetSize) return removedKeys;
+
+  std::sort(entries.begin(), entries.end());
+
+  std::vector<EntryInfo>::iterator it, end = entries.end();
+  for (it = entries.begin(); it != end && size > targetSize; ++it) {
+    // Another process may have removed it already
+    if (QFile::remove(it->m_path) || !QFile::exists(it->m_path)) {
+      removedKeys.push_back(
+          QFileInfo(it->m_path).completeBaseName().toStdString());
+      size -= it->m_size;
+    }
+  }
+
+  return removedKeys;
+}
+
+//----------------------------------------------------------------------------
+
+// Writes an entry file. Returns false if the entry could not be written, or
+// was stored by another process meanwhile.
+bool writeEntry(const QString &entryPath, EntryHeader header,
+                const QByteArray &rawData, TINT64 &fileSize) {
+  if (QFile::exists(entryPath)) return false;
+
+  QByteArray data(qCompress(rawData, 1));
+  header.m_dataSize = data.size();
+
+  // Write to a temporary file first, so that concurrent readers (possibly
+  // from other processes) never access incomplete entries
+  QDir().mkpath(QFileInfo(entryPath).absolutePath());
+
+  QString tempPath =
+      entryPath + "." + QString::number(QCoreApplication::applicationPid()) +
+      "_" + QString::number((qulonglong)QThread::currentThreadId()) + ".tmp";
+  {
+    QFile file(tempPath);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    bool ok = file.write((const char *)&header, sizeof(EntryHeader)) ==
+                  sizeof(EntryHeader) &&
+              file.write(data) == data.size();
+    file.close();
+
+    if (!ok) {
+      QFile::remove(tempPath);
+      return false;
+    }
+  }
+
+  // The rename fails if another process stored the same entry meanwhile
+  if (!QFile::rename(tempPath, entryPath)) {
+    QFile::remove(tempPath);
+    return false;
+  }
+
+  fileSize = sizeof(EntryHeader) + data.size();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+// Calls func on each level path embedded in the alias. Column fxs embed them
+// as the first field between brackets, eg "...[+drawings/A.0001.pli,...]".
+template <class Func>
+bool anyLevelPath(const std::string &alias, Func func) {
+  std::string::size_type pos = 0;
+  while ((pos = alias.find('[', pos)) != std::string::npos) {
+    std::string::size_type end = alias.find_first_of(",]", ++pos);
+    if (end == std::string::npos) break;
+    if (end > pos && func(alias.substr(pos, end - pos))) return true;
+    pos = end;
+  }
+  return false;
+}
+
+}  // namespace
+
+//****************************************************************************************************
+//    TPersistentFxCache::Imp
+//****************************************************************************************************
+
+class TPersistentFxCache::Imp {
+public:
+  class WriterThread;
+
+  struct StoreJob {
+    std::string m_key;
+    EntryHeader m_header;
+    QByteArray m_rawData;
+  };
+
+public:
+  mutable QMutex m_mutex;
+
+  QString m_path;
+  TINT64 m_maxSize;      //!< In bytes
+  int m_minComputeTime;  //!< In msecs
+  TINT64 m_currentSize;  //!< Estimated folder size, -1 if unknown
+
+  // The keys of the folder entries, and the time since they were scanned
+  std::unordered_set<std::string> m_keys;
+  QElapsedTimer m_indexTimer;
+
+  // The writer thread's jobs. Everything accessing the disk runs there, out
+  // of m_mutex.
+  std::unique_ptr<WriterThread> m_writer;
+  QWaitCondition m_jobsCond;
+  std::deque<StoreJob> m_storeJobs;
+  TINT64 m_queuedBytes;
+  bool m_scanQueued, m_busy, m_quit;
+
+  // Invalidated level paths, with frame and without. They are read for each
+  // fx computation, and written on level editing only.
+  mutable QReadWriteLock m_invalidationsLock;
+  std::set<std::string> m_invalidatedFrames, m_invalidatedLevels;
+
+public:
+  Imp()
+      : m_maxSize(TINT64(2048) << 20)
+      , m_minComputeTime(200)
+      , m_currentSize(-1)
+      , m_queuedBytes(0)
+      , m_scanQueued(false)
+      , m_busy(false)
+      , m_quit(false) {}
+  ~Imp();
+
+  // Must be called with m_mutex locked. The index is rebuilt by the writer
+  // thread, meanwhile the current one is used.
+  void updateIndex() {
+    if (m_path.isEmpty() || m_scanQueued ||
+        (m_indexTimer.isValid() && !m_indexTimer.hasExpired(indexRefreshTime)))
+      return;
+
+    m_indexTimer.start();
+    m_scanQueued = true;
+    startWriter();
+  }
+
+  QString getEntryPath(const std::string &key) const {
+    // Use a first level of subfolders to keep directory listings short
+    QString qKey(QString::fromStdString(key));
+    return m_path + "/" + qKey.left(2) + "/" + qKey + "." + fileSuffix;
+  }
+
+  // Must be called with m_mutex locked
+  void startWriter();
+
+  //! The writer thread's loop.
+  void runJobs();
+  void runScan(QMutexLocker &locker);
+  void runStore(QMutexLocker &locker);
+};
+
+//----------------------------------------------------------------------------
+
+class TPersistentFxCache::Imp::WriterThread final : public QThread {
+  Imp *m_imp;
+
+public:
+  WriterThread(Imp *imp) : m_imp(imp) {}
+
+protected:
+  void run() override { m_imp->runJobs(); }
+};
+
+//----------------------------------------------------------------------------
+
+TPersistentFxCache::Imp::~Imp() {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_quit = true;
+    m_storeJobs.clear();
+    m_jobsCond.wakeAll();
+  }
+
+  if (m_writer) m_writer->wait();
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::Imp::startWriter() {
+  if (!m_writer) {
+    m_writer.reset(new WriterThread(this));
+    m_writer->start(QThread::LowPriority);
+  }
+
+  m_jobsCond.wakeAll();
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::Imp::runJobs() {
+  QMutexLocker locker(&m_mutex);
+
+  for (;;) {
+    while (!m_quit && !m_scanQueued && m_storeJobs.empty())
+      m_jobsCond.wait(&m_mutex);
+    if (m_quit) return;
+
+    m_busy = true;
+    if (m_scanQueued)
+      runScan(locker);
+    else
+      runStore(locker);
+    m_busy = false;
+
+    // Wake flush() too
+    m_jobsCond.wakeAll();
+  }
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::Imp::runScan(QMutexLocker &locker) {
+  m_scanQueued = false;
+  QString path = m_path;
+
+  locker.unlock();
+
+  std::vector<EntryInfo> entries;
+  std::unordered_set<std::string> keys;
+  TINT64 size;
+  scanFolder(path, entries, keys, size);
+
+  locker.relock();
+
+  // Only the new index is swapped in under the lock
+  if (path != m_path) return;
+  m_keys.swap(keys);
+  m_currentSize = size;
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::Imp::runStore(QMutexLocker &locker) {
+  StoreJob job;
+  std::swap(job, m_storeJobs.front());
+  m_storeJobs.pop_front();
+  m_queuedBytes -= job.m_rawData.size();
+
+  QString path = m_path, entryPath = getEntryPath(job.m_key);
+  TINT64 maxSize = m_maxSize, currentSize = m_currentSize;
+
+  locker.unlock();
+
+  TINT64 fileSize = 0;
+  bool stored = writeEntry(entryPath, job.m_header, job.m_rawData, fileSize);
+  job.m_rawData.clear();
+
+  // The folder could be shared with other processes - so the actual size
+  // is always rebuilt from disk before removing anything
+  std::vector<EntryInfo> entries;
+  std::unordered_set<std::string> keys;
+  std::vector<std::string> removedKeys;
+
+  bool rescanned = false;
+  if (stored) {
+    if (currentSize >= 0) currentSize += fileSize;
+    if (currentSize < 0 || currentSize > maxSize) {
+      scanFolder(path, entries, keys, currentSize);
+      removedKeys = removeOldest(entries, currentSize,
+                                 (TINT64)(maxSize * evictionRatio));
+      rescanned = true;
+    }
+  }
+
+  locker.relock();
+
+  if (path != m_path) return;
+
+  if (QFile::exists(entryPath)) m_keys.insert(job.m_key);
+  if (!stored) return;
+
+  if (rescanned) {
+    std::vector<std::string>::iterator it, end = removedKeys.end();
+    for (it = removedKeys.begin(); it != end; ++it) m_keys.erase(*it);
+    m_currentSize = currentSize;
+  } else
+    m_currentSize += fileSize;
+}
+
+//****************************************************************************************************
+//    TPersistentFxCache implementation
+//****************************************************************************************************
+
+TPersistentFxCache::TPersistentFxCache() : m_imp(new Imp) {}
+
+//----------------------------------------------------------------------------
+
+TPersistentFxCache::~TPersistentFxCache() {}
+
+//----------------------------------------------------------------------------
+
+TPersistentFxCache *TPersistentFxCache::instance() {
+  static TPersistentFxCache theInstance;
+  return &theInstance;
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::setPath(const TFilePath &path) {
+  QString qPath;
+  {
+    QMutexLocker locker(&m_imp->m_mutex);
+
+    m_imp->m_path        = QString();
+    m_imp->m_currentSize = -1;
+    m_imp->m_keys.clear();
+    m_imp->m_indexTimer.invalidate();
+
+    // Entries queued for the old folder are dropped
+    m_imp->m_storeJobs.clear();
+    m_imp->m_queuedBytes = 0;
+
+    if (path.isEmpty()) return;
+
+    try {
+      TSystem::mkDir(path);
+    } catch (...) {
+    }
+
+    if (!TFileStatus(path).isWritableDir()) return;
+    qPath = m_imp->m_path = path.getQString();
+  }
+
+  // The first index is built right away, so that the first renders can
+  // find the entries of previous sessions
+  std::vector<EntryInfo> entries;
+  std::unordered_set<std::string> keys;
+  TINT64 size;
+  scanFolder(qPath, entries, keys, size);
+
+  QMutexLocker locker(&m_imp->m_mutex);
+  if (m_imp->m_path != qPath) return;
+
+  m_imp->m_keys.swap(keys);
+  m_imp->m_currentSize = size;
+  m_imp->m_indexTimer.start();
+}
+
+//----------------------------------------------------------------------------
+
+TFilePath TPersistentFxCache::getPath() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return TFilePath(m_imp->m_path);
+}
+
+//----------------------------------------------------------------------------
+
+bool TPersistentFxCache::isEnabled() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return !m_imp->m_path.isEmpty() && m_imp->m_maxSize > 0;
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::setMaximumSize(int megaBytes) {
+  QMutexLocker locker(&m_imp->m_mutex);
+  m_imp->m_maxSize = TINT64(std::max(megaBytes, 0)) << 20;
+}
+
+//----------------------------------------------------------------------------
+
+int TPersistentFxCache::getMaximumSize() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return (int)(m_imp->m_maxSize >> 20);
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::setMinimumComputeTime(int msec) {
+  QMutexLocker locker(&m_imp->m_mutex);
+  m_imp->m_minComputeTime = msec;
+}
+
+//----------------------------------------------------------------------------
+
+int TPersistentFxCache::getMinimumComputeTime() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return m_imp->m_minComputeTime;
+}
+
+//----------------------------------------------------------------------------
+
+bool TPersistentFxCache::isEmpty() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+
+  m_imp->updateIndex();
+  return m_imp->m_keys.empty();
+}
+
+//----------------------------------------------------------------------------
+
+std::string TPersistentFxCache::getKey(const std::string &alias, double frame,
+                                       const TRectD &rect,
+                                       const TRenderSettings &info) const {
+  // Only the settings affecting the output pixels are considered. See
+  // TRenderSettings::toString() for the complete list.
+  std::string desc =
+      alias + ";" + std::to_string(frame) + ";" + std::to_string(rect.x0) +
+      "," + std::to_string(rect.y0) + "," + std::to_string(rect.x1) + "," +
+      std::to_string(rect.y1) + ";" + std::to_string(info.m_bpp) + ";" +
+      std::to_string(info.m_quality) + ";" + std::to_string(info.m_gamma) +
+      ";" + std::to_string(info.m_timeStretchFrom) + "," +
+      std::to_string(info.m_timeStretchTo) + ";" +
+      std::to_string(info.m_fieldPrevalence) + ";" +
+      std::to_string(info.m_shrinkX) + "," + std::to_string(info.m_shrinkY) +
+      ";" + std::to_string(info.m_affine.a11) + "," +
+      std::to_string(info.m_affine.a12) + "," +
+      std::to_string(info.m_affine.a13) + "," +
+      std::to_string(info.m_affine.a21) + "," +
+      std::to_string(info.m_affine.a22) + "," +
+      std::to_string(info.m_affine.a23) + ";" +
+      std::to_string(info.m_stereoscopic) + "," +
+      std::to_string(info.m_stereoscopicShift) + ";" +
+      std::to_string(info.m_linearColorSpace) + "," +
+      std::to_string(info.m_colorSpaceGamma) + ";{";
+  for (int i = 0; i < (int)info.m_data.size(); ++i)
+    if (info.m_data[i]) desc += info.m_data[i]->toString() + ",";
+  desc += "}";
+
+  QByteArray hash = QCryptographicHash::hash(
+      QByteArray(desc.data(), (int)desc.size()), QCryptographicHash::Sha1);
+  return hash.toHex().toStdString();
+}
+
+//----------------------------------------------------------------------------
+
+bool TPersistentFxCache::load(const std::string &key, const TTile &tile) {
+  QString entryPath;
+  {
+    QMutexLocker locker(&m_imp->m_mutex);
+    if (m_imp->m_path.isEmpty()) return false;
+
+    // Misses are resolved in memory
+    m_imp->updateIndex();
+    if (m_imp->m_keys.count(key) == 0) return false;
+
+    entryPath = m_imp->getEntryPath(key);
+  }
+
+  QFile file(entryPath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    // Removed by another process
+    QMutexLocker locker(&m_imp->m_mutex);
+    m_imp->m_keys.erase(key);
+    return false;
+  }
+
+  TRasterP ras(tile.getRaster());
+  if (!ras) return false;
+
+  EntryHeader header;
+  if (file.read((char *)&header, sizeof(EntryHeader)) != sizeof(EntryHeader) ||
+      memcmp(header.m_magic, fileMagic, sizeof(fileMagic)) != 0 ||
+      header.m_version != fileVersion ||
+      header.m_rasterType != getRasterType(ras) ||
+      header.m_lx != ras->getLx() || header.m_ly != ras->getLy() ||
+      (header.m_linear != 0) != ras->isLinear())
+    return false;
+
+  QByteArray data(qUncompress(file.read(header.m_dataSize)));
+  file.close();
+
+  int rowSize = ras->getRowSize();
+  if (data.size() != rowSize * ras->getLy()) return false;
+
+  ras->lock();
+  {
+    const char *src = data.constData();
+    UCHAR *dst      = ras->getRawData();
+    int dstRowSize  = ras->getWrap() * ras->getPixelSize();
+    for (int y = 0; y < ras->getLy(); ++y, src += rowSize, dst += dstRowSize)
+      memcpy(dst, src, rowSize);
+  }
+  ras->unlock();
+
+  // Mark the entry as recently used
+  try {
+    TSystem::touchFile(TFilePath(entryPath));
+  } catch (...) {
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::store(const std::string &key, const TTile &tile) {
+  TRasterP ras(tile.getRaster());
+  RasterType rasType = ras ? getRasterType(ras) : NONE;
+  if (rasType == NONE) return;
+
+  int rowSize = ras->getRowSize();
+  TINT64 bytes = (TINT64)rowSize * ras->getLy();
+  {
+    QMutexLocker locker(&m_imp->m_mutex);
+    if (m_imp->m_path.isEmpty() || m_imp->m_keys.count(key)) return;
+
+    // Results are dropped rather than stalling the render when the writer
+    // can't keep up
+    if (m_imp->m_queuedBytes + bytes > maxQueuedBytes) return;
+    m_imp->m_queuedBytes += bytes;
+  }
+
+  Imp::StoreJob job;
+  job.m_key = key;
+
+  EntryHeader &header = job.m_header;
+  memcpy(header.m_magic, fileMagic, sizeof(fileMagic));
+  header.m_version    = fileVersion;
+  header.m_rasterType = rasType;
+  header.m_lx         = ras->getLx();
+  header.m_ly         = ras->getLy();
+  header.m_linear     = ras->isLinear() ? 1 : 0;
+  header.m_dataSize   = 0;
+
+  // Gather the rows in a contiguous buffer, as the tile raster is typically
+  // extracted from a wider one. Compression is left to the writer thread.
+  job.m_rawData = QByteArray((int)bytes, Qt::Uninitialized);
+
+  ras->lock();
+  {
+    char *dst        = job.m_rawData.data();
+    const UCHAR *src = ras->getRawData();
+    int srcRowSize   = ras->getWrap() * ras->getPixelSize();
+    for (int y = 0; y < ras->getLy(); ++y, src += srcRowSize, dst += rowSize)
+      memcpy(dst, src, rowSize);
+  }
+  ras->unlock();
+
+  QMutexLocker locker(&m_imp->m_mutex);
+
+  // The folder may have changed meanwhile, see setPath()
+  if (m_imp->m_path.isEmpty()) {
+    m_imp->m_queuedBytes -= bytes;
+    return;
+  }
+
+  m_imp->m_storeJobs.push_back(job);
+  m_imp->startWriter();
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::flush() {
+  QMutexLocker locker(&m_imp->m_mutex);
+  while (!m_imp->m_storeJobs.empty() || m_imp->m_busy)
+    m_imp->m_jobsCond.wait(&m_imp->m_mutex);
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::invalidateLevel(const std::string &levelPath) {
+  TFilePath fp(::to_wstring(levelPath));
+  TFrameId fid(fp.getFrame());
+
+  QWriteLocker locker(&m_imp->m_invalidationsLock);
+  if (fid.isNoFrame() || fid.isEmptyFrame())
+    m_imp->m_invalidatedLevels.insert(::to_string(fp.withNoFrame()));
+  else
+    m_imp->m_invalidatedFrames.insert(levelPath);
+}
+
+//----------------------------------------------------------------------------
+
+bool TPersistentFxCache::isCachable(const std::string &alias) const {
+  if (alias.find(uncachableToken()) != std::string::npos) return false;
+
+  QReadLocker locker(&m_imp->m_invalidationsLock);
+
+  const std::set<std::string> &frames = m_imp->m_invalidatedFrames,
+                              &levels = m_imp->m_invalidatedLevels;
+  if (frames.empty() && levels.empty()) return true;
+
+  // Only whole level paths match - not any alias substring
+  return !anyLevelPath(alias, [&frames, &levels](const std::string &path) {
+    if (frames.count(path)) return true;
+    if (levels.empty()) return false;
+
+    TFilePath fp(::to_wstring(path));
+    return levels.count(::to_string(fp.withNoFrame())) > 0;
+  });
+}
+
+//----------------------------------------------------------------------------
+
+void TPersistentFxCache::clear() {
+  QString path;
+  {
+    QMutexLocker locker(&m_imp->m_mutex);
+    if (m_imp->m_path.isEmpty()) return;
+
+    path = m_imp->m_path;
+    m_imp->m_storeJobs.clear();
+    m_imp->m_queuedBytes = 0;
+    m_imp->m_keys.clear();
+    m_imp->m_currentSize = 0;
+  }
+
+  std::vector<EntryInfo> entries;
+  std::unordered_set<std::string> keys;
+  TINT64 size;
+  scanFolder(path, entries, keys, size);
+
+  std::vector<EntryInfo>::iterator it, end = entries.end();
+  for (it = entries.begin(); it != end; ++it) QFile::remove(it->m_path);
+}
+
+//----------------------------------------------------------------------------
+
+std::string TPersistentFxCache::getFileStamp(const TFilePath &fp,
+                                             bool modified) {
+  QFileInfo fi(fp.getQString());
+  if (modified || !fi.exists()) {
+    static const std::string sessionStamp =
+        "session" + std::to_string(QCoreApplication::applicationPid()) + "_" +
+        std::to_string(QDateTime::currentMSecsSinceEpoch());
+    return sessionStamp;
+  }
+
+  return std::to_string(fi.size()) + "@" +
+         std::to_string(fi.lastModified().toMSecsSinceEpoch());
+}
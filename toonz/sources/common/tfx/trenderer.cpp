@@ -13,6 +13,7 @@
 #include "trop.h"
 #include "timagecache.h"
 #include "tstopwatch.h"
+#include "trendertracer.h"
 
 // TnzBase includes
 #include "trenderresourcemanager.h"
@@ -25,6 +26,7 @@
 #include <QReadLocker>
 #include <QWriteLocker>
 #include <QThreadStorage>
+#include <QWaitCondition>
 
 // Debug
 // #define DIAGNOSTICS
@@ -315,8 +317,11 @@ public:
   unsigned long m_rendererId;
 
   Executor m_executor;
+  Executor m_tilesExecutor;  //!< Executes the helpers of tiled frames
+  int m_threadsCount;
 
   bool m_precomputingEnabled;
+  bool m_tiledRenderingEnabled;
   RasterPool m_rasterPool;
 
   std::vector<TRenderResourceManager *> m_managers;
@@ -352,7 +357,14 @@ public:
   void enablePrecomputing(bool on) { m_precomputingEnabled = on; }
   bool isPrecomputingEnabled() const { return m_precomputingEnabled; }
 
-  void setThreadsCount(int nThreads) { m_executor.setMaxActiveTasks(nThreads); }
+  void enableTiledRendering(bool on) { m_tiledRenderingEnabled = on; }
+  bool isTiledRenderingEnabled() const { return m_tiledRenderingEnabled; }
+
+  void setThreadsCount(int nThreads) {
+    m_threadsCount = nThreads;
+    m_executor.setMaxActiveTasks(nThreads);
+    m_tilesExecutor.setMaxActiveTasks(nThreads);
+  }
 
   inline void declareRenderStart(unsigned long renderId);
   inline void declareRenderEnd(unsigned long renderId);
@@ -375,6 +387,77 @@ unsigned long TRendererImp::m_renderIdCounter   = 0;
 
 //================================================================================
 
+//========================
+//    TileComputation
+//------------------------
+
+//! Shares the computation of a frame's tiles among the rendering thread and
+//! a number of helper tasks. Tiles are taken in order by whoever is free, so
+//! the rendering thread never waits for a helper that has not yet started.
+class TileComputation final : public TSmartObject {
+public:
+  TRasterFxP m_fx;
+  TRasterP m_ras;
+  TPointD m_pos;
+  double m_frame;
+  const TRenderSettings *m_info;  //!< Owned by the RenderTask
+
+  TRendererImp *m_rendererImp;
+  unsigned long m_renderId;
+
+  std::vector<TRect> m_rects;  //!< Tiles geometry, in m_ras coordinates
+
+  QMutex m_mutex;
+  QWaitCondition m_allDone;
+  int m_next, m_completed;
+  bool m_failed;
+  std::wstring m_error;
+
+public:
+  TileComputation(const TRasterFxP &fx, const TTile &tile, double frame,
+                  const TRenderSettings &info, TRendererImp *rendererImp,
+                  unsigned long renderId, const std::vector<TRect> &rects)
+      : m_fx(fx)
+      , m_ras(tile.getRaster())
+      , m_pos(tile.m_pos)
+      , m_frame(frame)
+      , m_info(&info)
+      , m_rendererImp(rendererImp)
+      , m_renderId(renderId)
+      , m_rects(rects)
+      , m_next(0)
+      , m_completed(0)
+      , m_failed(false) {}
+
+  bool computeNext(bool installRenderer);
+  void waitAll();
+};
+
+//================================================================================
+
+//===================
+//    TileTask
+//-------------------
+
+class TileTask final : public TThread::Runnable {
+  TSmartPointerT<TileComputation> m_computation;
+
+public:
+  TileTask(TileComputation *computation) : m_computation(computation) {}
+
+  void run() override {
+    while (m_computation->computeNext(true))
+      ;
+  }
+
+  int taskLoad() override { return 100; }
+
+  // Complete frames under computation before starting new ones
+  int schedulingPriority() override { return 10; }
+};
+
+//================================================================================
+
 //===================
 //    RenderTask
 //-------------------
@@ -394,6 +477,8 @@ class RenderTask final : public TThread::Runnable {
 
   bool m_fieldRender, m_stereoscopic;
 
+  int m_parallelism;  //!< Threads available to compute the frame's tiles
+
   Mutex m_rasterGuard;
   TTile m_tileA;  // in normal and field rendering, Rendered at given frame; in
                   // stereoscopic, rendered left frame
@@ -409,10 +494,15 @@ public:
   ~RenderTask() {}
 
   void addFrame(double frame) { m_frames.push_back(frame); }
+  void setParallelism(int parallelism) { m_parallelism = parallelism; }
 
   void buildTile(TTile &tile);
   void releaseTiles();
 
+  void getTilesGeometry(const TRasterFxP &fx, double frame,
+                        std::vector<TRect> &rects);
+  void computeTile(const TRasterFxP &fx, TTile &tile, double frame);
+
   void onFrameStarted();
   void onFrameCompleted();
   void onFrameFailed(TException &e);
@@ -608,6 +698,18 @@ bool TRenderer::isPrecomputingEnabled() const {
 
 //---------------------------------------------------------
 
+void TRenderer::enableTiledRendering(bool on) {
+  m_imp->enableTiledRendering(on);
+}
+
+//---------------------------------------------------------
+
+bool TRenderer::isTiledRenderingEnabled() const {
+  return m_imp->isTiledRenderingEnabled();
+}
+
+//---------------------------------------------------------
+
 void TRenderer::setThreadsCount(int nThreads) {
   m_imp->setThreadsCount(nThreads);
 }
@@ -689,8 +791,11 @@ TRendererImp::TRendererImp(int nThreads)
     : m_executor()
     , m_undoneTasks()
     , m_rendererId(m_rendererIdCounter++)
-    , m_precomputingEnabled(true) {
+    , m_threadsCount(nThreads)
+    , m_precomputingEnabled(true)
+    , m_tiledRenderingEnabled(false) {
   m_executor.setMaxActiveTasks(nThreads);
+  m_tilesExecutor.setMaxActiveTasks(nThreads);
 
   std::vector<TRenderResourceManagerGenerator *> &generators =
       TRenderResourceManagerGenerator::generators(false);
@@ -911,6 +1016,75 @@ TRectD &TRenderPort::getRenderArea() { return m_renderArea; }
 
 //================================================================================
 
+//=============================
+//    TileComputation
+//-----------------------------
+
+// Takes the next tile and computes it. Returns false if no tile remains.
+bool TileComputation::computeNext(bool installRenderer) {
+  int idx;
+  {
+    QMutexLocker locker(&m_mutex);
+    if (m_next >= (int)m_rects.size() || m_failed) return false;
+
+    idx = m_next++;
+  }
+
+  if (installRenderer) {
+    // Install the renderer in current thread
+    rendererStorage.setLocalData(new (TRendererImp *)(m_rendererImp));
+    renderIdsStorage.setLocalData(new unsigned long(m_renderId));
+  }
+
+  bool failed = false;
+  std::wstring error;
+
+  try {
+    TRect rect(m_rects[idx]);
+    TRasterP ras(m_ras->extract(rect));
+
+    TTile tile(ras, m_pos + TPointD(rect.x0, rect.y0));
+    m_fx->compute(tile, m_frame, *m_info);
+
+    // Fxs are allowed to replace the tile's raster
+    TRasterP outRas(tile.getRaster());
+    if (outRas->getRawData() != ras->getRawData()) TRop::copy(ras, outRas);
+  } catch (TException &e) {
+    failed = true;
+    error  = e.getMessage();
+  } catch (...) {
+    failed = true;
+    error  = L"Unknown render exception";
+  }
+
+  if (installRenderer) {
+    rendererStorage.setLocalData(0);
+    renderIdsStorage.setLocalData(0);
+  }
+
+  QMutexLocker locker(&m_mutex);
+
+  if (failed && !m_failed) {
+    m_failed = true;
+    m_error  = error;
+  }
+
+  ++m_completed;
+  m_allDone.wakeAll();
+
+  return true;
+}
+
+//---------------------------------------------------------
+
+// Waits until all the tiles that have been taken are computed.
+void TileComputation::waitAll() {
+  QMutexLocker locker(&m_mutex);
+  while (m_completed < m_next) m_allDone.wait(&m_mutex);
+}
+
+//================================================================================
+
 //===================
 //    RenderTask
 //-------------------
@@ -928,7 +1102,8 @@ RenderTask::RenderTask(unsigned long renderId, unsigned long taskId,
     , m_framePos(framePos)
     , m_rendererImp(rendererImp)
     , m_fieldRender(ri.m_fieldPrevalence != TRenderSettings::NoField)
-    , m_stereoscopic(ri.m_stereoscopic) {
+    , m_stereoscopic(ri.m_stereoscopic)
+    , m_parallelism(1) {
   m_frames.push_back(frame);
 
   // Connect the onFinished slot
@@ -946,13 +1121,26 @@ RenderTask::RenderTask(unsigned long renderId, unsigned long taskId,
 //---------------------------------------------------------
 
 void RenderTask::preRun() {
-  TRectD geom(m_framePos, TDimensionD(m_frameSize.lx, m_frameSize.ly));
+  // Simulate the same tiles that will be computed
+  struct locals {
+    static void dryCompute(RenderTask *task, const TRasterFxP &fx,
+                           double frame) {
+      std::vector<TRect> rects;
+      task->getTilesGeometry(fx, frame, rects);
+
+      for (int i = 0; i < (int)rects.size(); ++i) {
+        TPointD pos(task->m_framePos + TPointD(rects[i].x0, rects[i].y0));
+        TRectD geom(pos, TDimensionD(rects[i].getLx(), rects[i].getLy()));
+        fx->dryCompute(geom, frame, task->m_info);
+      }
+    }
+  };
 
-  if (m_fx.m_frameA) m_fx.m_frameA->dryCompute(geom, m_frames[0], m_info);
+  if (m_fx.m_frameA) locals::dryCompute(this, m_fx.m_frameA, m_frames[0]);
 
   if (m_fx.m_frameB)
-    m_fx.m_frameB->dryCompute(
-        geom, m_fieldRender ? m_frames[0] + 0.5 : m_frames[0], m_info);
+    locals::dryCompute(this, m_fx.m_frameB,
+                       m_fieldRender ? m_frames[0] + 0.5 : m_frames[0]);
 }
 
 //---------------------------------------------------------
@@ -984,37 +1172,44 @@ void RenderTask::run() {
   try {
     onFrameStarted();
 
+    TRenderTraceScope trace("render", "Frame");
+    if (trace.isEnabled()) {
+      trace.addArg("frame", t);
+      trace.addArg("lx", m_frameSize.lx);
+      trace.addArg("ly", m_frameSize.ly);
+    }
+
     TStopWatch::global(8).start();
 
     if (!m_fieldRender && !m_stereoscopic) {
       // Common case - just build the first tile
       buildTile(m_tileA);
       /*-- Normally, Fx rendering process is performed here --*/
-      m_fx.m_frameA->compute(m_tileA, t, m_info);
+      computeTile(m_fx.m_frameA, m_tileA, t);
     } else {
       assert(!(m_stereoscopic && m_fieldRender));
       // Field rendering  or stereoscopic case
       if (m_stereoscopic) {
         buildTile(m_tileA);
-        m_fx.m_frameA->compute(m_tileA, t, m_info);
+        computeTile(m_fx.m_frameA, m_tileA, t);
 
         buildTile(m_tileB);
-        m_fx.m_frameB->compute(m_tileB, t, m_info);
+        computeTile(m_fx.m_frameB, m_tileB, t);
       }
       // if fieldPrevalence, Decide the rendering frames depending on field
       // prevalence
       else if (m_info.m_fieldPrevalence == TRenderSettings::EvenField) {
         buildTile(m_tileA);
-        m_fx.m_frameA->compute(m_tileA, t, m_info);
+        computeTile(m_fx.m_frameA, m_tileA, t);
 
         buildTile(m_tileB);
-        m_fx.m_frameB->compute(m_tileB, t + 0.5, m_info);
+        computeTile(m_fx.m_frameB, m_tileB, t + 0.5);
       } else {
         buildTile(m_tileB);
-        m_fx.m_frameA->compute(m_tileB, t, m_info);
+        computeTile(m_fx.m_frameA, m_tileB, t);
 
         buildTile(m_tileA);
-        m_fx.m_frameB->compute(m_tileA, t + 0.5, m_info);
+        computeTile(m_fx.m_frameB, m_tileA, t + 0.5);
       }
     }
 
@@ -1052,6 +1247,90 @@ void RenderTask::buildTile(TTile &tile) {
 
 //---------------------------------------------------------
 
+// Returns the subdivision of the frame into tiles to be computed in parallel.
+// Fxs may deny any subdivision of their input through a negative memory
+// requirement - just like in the raster granularity case.
+void RenderTask::getTilesGeometry(const TRasterFxP &fx, double frame,
+                                  std::vector<TRect> &rects) {
+  static const int minTileSide = 256;
+
+  int lx = m_frameSize.lx, ly = m_frameSize.ly;
+  TRect bounds(0, 0, lx - 1, ly - 1);
+
+  rects.clear();
+  rects.push_back(bounds);
+
+  if (m_parallelism <= 1) return;
+
+  // Use some more tiles than threads, as tiles may be unevenly demanding
+  int tilesCount = 2 * m_parallelism;
+  int cols = (int)ceil(sqrt(tilesCount * lx / (double)ly));
+  cols     = std::max(std::min(cols, lx / minTileSide), 1);
+  int rows = (tilesCount + cols - 1) / cols;
+  rows     = std::max(std::min(rows, ly / minTileSide), 1);
+
+  if (cols * rows < 2) return;
+
+  TRectD geom(m_framePos, TDimensionD(lx, ly));
+
+  std::vector<const TFx *> fxs = calculateSortedFxs(fx);
+  for (int i = 0; i < (int)fxs.size(); ++i) {
+    TRasterFx *rfx = dynamic_cast<TRasterFx *>(const_cast<TFx *>(fxs[i]));
+    if (rfx && rfx->getMemoryRequirement(geom, frame, m_info) < 0) return;
+  }
+
+  rects.clear();
+  for (int r = 0; r < rows; ++r) {
+    int y0 = (r * ly) / rows, y1 = ((r + 1) * ly) / rows - 1;
+    for (int c = 0; c < cols; ++c) {
+      int x0 = (c * lx) / cols, x1 = ((c + 1) * lx) / cols - 1;
+      rects.push_back(TRect(x0, y0, x1, y1));
+    }
+  }
+}
+
+//---------------------------------------------------------
+
+// Computes the fx on the passed tile - sharing its subdivision tiles with
+// helper tasks if possible. The TRasterFx::compute() contract is unchanged,
+// each tile being an independent compute() call.
+void RenderTask::computeTile(const TRasterFxP &fx, TTile &tile,
+                             double frame) {
+  std::vector<TRect> rects;
+  getTilesGeometry(fx, frame, rects);
+
+  if (rects.size() < 2) {
+    fx->compute(tile, frame, m_info);
+    return;
+  }
+
+  TSmartPointerT<TileComputation> computation(new TileComputation(
+      fx, tile, frame, m_info, m_rendererImp.getPointer(), m_renderId, rects));
+
+  // Launch the helpers - this thread will compute tiles too
+  int helpersCount = std::min(m_parallelism, (int)rects.size()) - 1;
+
+  std::vector<RunnableP> helpers;
+  for (int i = 0; i < helpersCount; ++i) {
+    RunnableP helper(new TileTask(computation.getPointer()));
+    helpers.push_back(helper);
+    m_rendererImp->m_tilesExecutor.addTask(helper);
+  }
+
+  while (computation->computeNext(false))
+    ;
+
+  // Helpers that did not start yet are useless now
+  for (int i = 0; i < helpersCount; ++i)
+    m_rendererImp->m_tilesExecutor.removeTask(helpers[i]);
+
+  computation->waitAll();
+
+  if (computation->m_failed) throw TException(computation->m_error);
+}
+
+//---------------------------------------------------------
+
 void RenderTask::releaseTiles() {
   m_rendererImp->m_rasterPool.releaseRaster(m_tileA.getRaster());
   m_tileA.setRaster(TRasterP());
@@ -1448,6 +1727,13 @@ void TRendererImp::startRendering(
   // Release the clusters - we'll just need the tasks vector from now on
   clusters.clear();
 
+  // Threads exceeding the frames count may be used to compute frames in tiles
+  if (m_tiledRenderingEnabled && !tasksVector.empty()) {
+    int parallelism = m_threadsCount / (int)tasksVector.size();
+    for (int i = 0; i < (int)tasksVector.size(); ++i)
+      tasksVector[i]->setParallelism(parallelism);
+  }
+
   std::vector<RenderTask *>::iterator kt, kEnd = tasksVector.end();
   {
     // Install TRenderer on current thread before proceeding
@@ -0,0 +1,287 @@
+// TnzCore includes
+#include "tconvert.h"
+
+// Qt includes
+#include <QElapsedTimer>
+#include <QFile>
+#include <QByteArray>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+// STD includes
+#include <map>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+
+#include "trendertracer.h"
+
+//****************************************************************************************************
+//    Local namespace
+//****************************************************************************************************
+
+namespace {
+
+struct TraceEvent {
+  std::string m_name, m_category;
+  char m_phase;
+  long long m_start, m_duration;
+  int m_threadId;
+  TRenderTracer::Args m_args;
+};
+
+}  // namespace
+
+//****************************************************************************************************
+//    TRenderTracer::Imp definition
+//****************************************************************************************************
+
+class TRenderTracer::Imp {
+public:
+  QMutex m_mutex;
+
+  // The timer is never restarted, so that it can be read without locking;
+  // the time the tracer was enabled is stored apart, in microseconds
+  QElapsedTimer m_timer;
+  std::atomic<long long> m_origin;
+  std::atomic<bool> m_enabled;
+
+  std::vector<TraceEvent> m_events;
+  std::map<Qt::HANDLE, int> m_threadIds;  //!< Sequential ids, for readability
+
+public:
+  Imp() : m_origin(0), m_enabled(false) { m_timer.start(); }
+
+  long long elapsed() const { return m_timer.nsecsElapsed() / 1000; }
+
+  // Must be called with m_mutex locked
+  int threadId() {
+    Qt::HANDLE handle = QThread::currentThreadId();
+
+    std::map<Qt::HANDLE, int>::iterator it = m_threadIds.find(handle);
+    if (it != m_threadIds.end()) return it->second;
+
+    int id = (int)m_threadIds.size() + 1;
+    m_threadIds.insert(std::make_pair(handle, id));
+    return id;
+  }
+
+  void addEvent(TraceEvent &ev) {
+    QMutexLocker locker(&m_mutex);
+    if (!m_enabled) return;
+
+    ev.m_threadId = threadId();
+    m_events.push_back(ev);
+  }
+};
+
+//****************************************************************************************************
+//    TRenderTracer implementation
+//****************************************************************************************************
+
+TRenderTracer::TRenderTracer() : m_imp(new Imp) {}
+
+//----------------------------------------------------------------------------
+
+TRenderTracer::~TRenderTracer() {}
+
+//----------------------------------------------------------------------------
+
+TRenderTracer *TRenderTracer::instance() {
+  static TRenderTracer theInstance;
+  return &theInstance;
+}
+
+//----------------------------------------------------------------------------
+
+void TRenderTracer::setEnabled(bool enabled) {
+  QMutexLocker locker(&m_imp->m_mutex);
+
+  if (enabled && !m_imp->m_enabled) m_imp->m_origin = m_imp->elapsed();
+  m_imp->m_enabled = enabled;
+}
+
+//----------------------------------------------------------------------------
+
+bool TRenderTracer::isEnabled() const {
+  // Just an atomic flag read - not worth locking in the hot path
+  return m_imp->m_enabled;
+}
+
+//----------------------------------------------------------------------------
+
+void TRenderTracer::clear() {
+  QMutexLocker locker(&m_imp->m_mutex);
+
+  m_imp->m_events.clear();
+  m_imp->m_threadIds.clear();
+}
+
+//----------------------------------------------------------------------------
+
+long long TRenderTracer::now() const {
+  return m_imp->elapsed() - m_imp->m_origin;
+}
+
+//----------------------------------------------------------------------------
+
+void TRenderTracer::addCompleteEvent(const std::string &name,
+                                     const std::string &category,
+                                     long long start, long long duration,
+                                     const Args &args) {
+  if (!m_imp->m_enabled) return;
+
+  TraceEvent ev = {name, category, 'X', start, duration, 0, args};
+  m_imp->addEvent(ev);
+}
+
+//----------------------------------------------------------------------------
+
+void TRenderTracer::addInstantEvent(const std::string &name,
+                                    const std::string &category,
+                                    const Args &args) {
+  if (!m_imp->m_enabled) return;
+
+  TraceEvent ev = {name, category, 'i', now(), 0, 0, args};
+  m_imp->addEvent(ev);
+}
+
+//----------------------------------------------------------------------------
+
+std::string TRenderTracer::toJson(const std::string &str) {
+  std::string result("\"");
+
+  for (std::string::const_iterator it = str.begin(); it != str.end(); ++it) {
+    unsigned char c = *it;
+    switch (c) {
+    case '"':
+      result += "\\\"";
+      break;
+    case '\\':
+      result += "\\\\";
+      break;
+    case '\n':
+      result += "\\n";
+      break;
+    default:
+      if (c < 0x20) {
+        char buf[8];
+        sprintf(buf, "\\u%04x", c);
+        result += buf;
+      } else
+        result += c;
+    }
+  }
+
+  return result + "\"";
+}
+
+//----------------------------------------------------------------------------
+
+std::string TRenderTracer::toJson(double value) {
+  // JSON has no representation for infinities and NaNs
+  if (!std::isfinite(value)) return "null";
+
+  char buf[32];
+  sprintf(buf, "%.10g", value);
+  return buf;
+}
+
+//----------------------------------------------------------------------------
+
+bool TRenderTracer::save(const TFilePath &fp) const {
+  QFile file(fp.getQString());
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+  QMutexLocker locker(&m_imp->m_mutex);
+
+  file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  // Name the threads
+  bool first = true;
+
+  std::map<Qt::HANDLE, int>::const_iterator tt,
+      tEnd = m_imp->m_threadIds.end();
+  for (tt = m_imp->m_threadIds.begin(); tt != tEnd; ++tt) {
+    std::string line =
+        std::string(first ? "" : ",\n") +
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" +
+        std::to_string(tt->second) + ",\"args\":{\"name\":" +
+        toJson("Render thread " + std::to_string(tt->second)) + "}}";
+    file.write(line.c_str(), (qint64)line.size());
+    first = false;
+  }
+
+  std::vector<TraceEvent>::const_iterator et, eEnd = m_imp->m_events.end();
+  for (et = m_imp->m_events.begin(); et != eEnd; ++et) {
+    const TraceEvent &ev = *et;
+
+    std::string line = std::string(first ? "" : ",\n") +
+                       "{\"name\":" + toJson(ev.m_name) +
+                       ",\"cat\":" + toJson(ev.m_category) + ",\"ph\":\"" +
+                       ev.m_phase + "\",\"ts\":" + std::to_string(ev.m_start);
+
+    if (ev.m_phase == 'X')
+      line += ",\"dur\":" + std::to_string(ev.m_duration);
+    else
+      line += ",\"s\":\"t\"";
+
+    line += ",\"pid\":1,\"tid\":" + std::to_string(ev.m_threadId);
+
+    if (!ev.m_args.empty()) {
+      line += ",\"args\":{";
+      for (int a = 0; a < (int)ev.m_args.size(); ++a)
+        line += std::string(a ? "," : "") + toJson(ev.m_args[a].first) + ":" +
+                ev.m_args[a].second;
+      line += "}";
+    }
+
+    line += "}";
+
+    file.write(line.c_str(), (qint64)line.size());
+    first = false;
+  }
+
+  file.write("\n]}\n");
+  return true;
+}
+
+//****************************************************************************************************
+//    TRenderTraceScope implementation
+//****************************************************************************************************
+
+TRenderTraceScope::TRenderTraceScope(const std::string &category,
+                                     const std::string &name)
+    : m_start(0), m_enabled(TRenderTracer::instance()->isEnabled()) {
+  if (!m_enabled) return;
+
+  m_name     = name;
+  m_category = category;
+  m_start    = TRenderTracer::instance()->now();
+}
+
+//----------------------------------------------------------------------------
+
+TRenderTraceScope::~TRenderTraceScope() {
+  if (!m_enabled) return;
+
+  TRenderTracer *tracer = TRenderTracer::instance();
+  tracer->addCompleteEvent(m_name, m_category, m_start,
+                           tracer->now() - m_start, m_args);
+}
+
+//----------------------------------------------------------------------------
+
+void TRenderTraceScope::addArg(const std::string &name,
+                               const std::string &value) {
+  if (m_enabled)
+    m_args.push_back(std::make_pair(name, TRenderTracer::toJson(value)));
+}
+
+//----------------------------------------------------------------------------
+
+void TRenderTraceScope::addArg(const std::string &name, double value) {
+  if (m_enabled)
+    m_args.push_back(std::make_pair(name, TRenderTracer::toJson(value)));
+}
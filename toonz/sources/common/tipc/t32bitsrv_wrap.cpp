@@ -4,10 +4,15 @@
 
 #include "t32bitsrv_wrap.h"
 
+// TnzCore includes
+#include "trasterimage.h"
+
 //================================================================================
 
 int t32bitsrv::BufferExchanger::read(const char *srcBuf, int len) {
-  m_data = (UCHAR *)memcpy(m_data, srcBuf, len);
+  memcpy(m_data, srcBuf, len);
+  m_data += len;
+
   return len;
 }
 
@@ -35,7 +40,8 @@ int t32bitsrv::RasterExchanger<PIXEL>::read(const char *srcBuf, int len) {
         (int)((m_ras->getLx() - xStart) * sizeof(PIXEL)), remainingData);
 
     for (; remainingData > 0;
-         m_pix += (m_ras->getWrap() - xStart), remainingData -= lineDataToRead,
+         m_pix += (m_ras->getWrap() - xStart), srcBuf += lineDataToRead,
+         remainingData -= lineDataToRead,
          lineDataToRead = std::min(lineData, remainingData), xStart = 0)
       memcpy(m_pix, srcBuf, lineDataToRead);
   }
@@ -61,7 +67,8 @@ int t32bitsrv::RasterExchanger<PIXEL>::write(char *dstBuf, int len) {
         (int)((m_ras->getLx() - xStart) * sizeof(PIXEL)), remainingData);
 
     for (; remainingData > 0;
-         m_pix += (m_ras->getWrap() - xStart), remainingData -= lineDataToWrite,
+         m_pix += (m_ras->getWrap() - xStart), dstBuf += lineDataToWrite,
+         remainingData -= lineDataToWrite,
          lineDataToWrite = std::min(lineData, remainingData), xStart = 0)
       memcpy(dstBuf, m_pix, lineDataToWrite);
   }
@@ -75,3 +82,53 @@ int t32bitsrv::RasterExchanger<PIXEL>::write(char *dstBuf, int len) {
 template class DVAPI t32bitsrv::RasterExchanger<TPixel32>;
 
 //================================================================================
+
+t32bitsrv::RasterSaver::RasterSaver(const TImageWriterP &iw, int lx, int ly)
+    : m_iw(iw)
+    , m_lx(lx)
+    , m_ly(ly)
+    , m_received(0)
+    , m_saved(false)
+    , m_ok(false) {}
+
+//--------------------------------------------------------------------------------
+
+int t32bitsrv::RasterSaver::read(const char *srcBuf, int len) {
+  int size = m_lx * m_ly * sizeof(TPixel32);
+
+  if (m_received == 0 && len == size) {
+    // The whole raster is in the segment - save it from there
+    TRaster32P ras(m_lx, m_ly, m_lx, (TPixel32 *)srcBuf);
+    save(ras);
+  } else {
+    if (!m_ras) m_ras = TRaster32P(m_lx, m_ly);
+
+    len = std::min(len, size - m_received);
+    memcpy(m_ras->getRawData() + m_received, srcBuf, len);
+  }
+
+  m_received += len;
+  return len;
+}
+
+//--------------------------------------------------------------------------------
+
+void t32bitsrv::RasterSaver::save(const TRaster32P &ras) {
+  m_saved = true;
+  if (!m_iw) return;
+
+  try {
+    m_iw->save(TRasterImageP(ras));
+    m_ok = true;
+  } catch (...) {
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+bool t32bitsrv::RasterSaver::save() {
+  if (!m_saved && m_ras) save(m_ras);
+  return m_ok;
+}
+
+//================================================================================
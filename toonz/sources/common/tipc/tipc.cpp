@@ -11,6 +11,12 @@
 #include <QAtomicInt>
 #include <QEventLoop>
 #include <QTimer>
+#include <QHash>
+
+// STL includes
+#include <algorithm>
+#include <functional>
+#include <vector>
 
 // System-specific includes
 #if defined(_WIN32)
@@ -75,6 +81,325 @@ int shm_max = -1;
 int shm_all = -1;
 int shm_seg = -1;
 int shm_mni = -1;
+
+// Max number of segments simultaneously used by writeShMemBuffer() - as many
+// idle ones are kept for reuse afterwards
+const int maxPooledSegments = 4;
+
+// Idle segments are released once no transfer used them for this time
+const int idleSegmentsTime = 10000;  // msecs
+
+//-------------------------------------------------------------
+
+//! Calls func in the application's thread after msecs. Returns false if
+//! there is no application to do it.
+bool callLater(int msecs, const std::function<void()> &func) {
+  QCoreApplication *app = QCoreApplication::instance();
+  if (!app) return false;
+
+  QTimer::singleShot(msecs, app, func);
+  return true;
+}
+
+//-------------------------------------------------------------
+
+/*!
+  Keeps the shared memory segments used by writeShMemBuffer() for later
+  transfers. Creating a segment per transfer costs several system calls -
+  and page faults on all its fresh pages, for every frame sent.
+*/
+class ShMemPool {
+  QMutex m_mutex;
+  std::vector<QSharedMemory *> m_segments;  //!< Idle segments
+  int m_inUseCount;
+  QElapsedTimer m_idleTimer;  //!< Restarted by every release()
+  bool m_trimScheduled;
+
+public:
+  ShMemPool() : m_inUseCount(0), m_trimScheduled(false) {}
+  ~ShMemPool() { clear(); }
+
+  QSharedMemory *acquire(int size);
+  void release(QSharedMemory *shmem);
+  //! Deletes an acquired segment, rather than releasing it to the pool
+  void discard(QSharedMemory *shmem);
+  void clear();
+
+private:
+  void trim();
+  void scheduleTrim(int msecs);  // To be called with m_mutex locked
+};
+
+//-------------------------------------------------------------
+
+QSharedMemory *ShMemPool::acquire(int size) {
+  size = std::min(size, tipc::shm_maxSegmentSize());
+
+  {
+    QMutexLocker locker(&m_mutex);
+
+    // Take the smallest idle segment that fits
+    std::vector<QSharedMemory *>::iterator st, sEnd = m_segments.end(),
+                                               best = sEnd;
+    for (st = m_segments.begin(); st != sEnd; ++st)
+      if ((*st)->size() >= size &&
+          (best == sEnd || (*st)->size() < (*best)->size()))
+        best = st;
+
+    if (best != sEnd) {
+      QSharedMemory *shmem = *best;
+      m_segments.erase(best);
+      ++m_inUseCount;
+      return shmem;
+    }
+  }
+
+  QSharedMemory *shmem = new QSharedMemory(tipc::uniqueId());
+  if (tipc::create(*shmem, size) <= 0) {
+    // Idle segments may be taking the system's shared memory - which is
+    // scarce on MACOSX. Retry without them.
+    clear();
+    if (tipc::create(*shmem, size) <= 0) {
+      delete shmem;
+      return 0;
+    }
+  }
+
+  QMutexLocker locker(&m_mutex);
+  ++m_inUseCount;
+
+  return shmem;
+}
+
+//-------------------------------------------------------------
+
+void ShMemPool::release(QSharedMemory *shmem) {
+  QMutexLocker locker(&m_mutex);
+  --m_inUseCount;
+  m_segments.push_back(shmem);
+
+  if ((int)m_segments.size() > maxPooledSegments) {
+    // Drop the smallest segment
+    std::vector<QSharedMemory *>::iterator st, sEnd = m_segments.end(),
+                                               smallest = m_segments.begin();
+    for (st = smallest + 1; st != sEnd; ++st)
+      if ((*st)->size() < (*smallest)->size()) smallest = st;
+
+    delete *smallest;
+    m_segments.erase(smallest);
+  }
+
+  m_idleTimer.start();
+  scheduleTrim(idleSegmentsTime);
+}
+
+//-------------------------------------------------------------
+
+void ShMemPool::discard(QSharedMemory *shmem) {
+  if (!shmem) return;
+
+  delete shmem;
+
+  QMutexLocker locker(&m_mutex);
+  --m_inUseCount;
+}
+
+//-------------------------------------------------------------
+
+void ShMemPool::clear() {
+  QMutexLocker locker(&m_mutex);
+
+  std::vector<QSharedMemory *>::iterator st, sEnd = m_segments.end();
+  for (st = m_segments.begin(); st != sEnd; ++st) delete *st;
+  m_segments.clear();
+}
+
+//-------------------------------------------------------------
+
+void ShMemPool::trim() {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_trimScheduled = false;
+
+    // Running transfers will release() their segments, scheduling a new trim
+    if (m_inUseCount > 0) return;
+
+    qint64 idleTime = m_idleTimer.elapsed();
+    if (idleTime < idleSegmentsTime) {
+      scheduleTrim(idleSegmentsTime - idleTime);
+      return;
+    }
+  }
+
+  clear();
+}
+
+//-------------------------------------------------------------
+
+void ShMemPool::scheduleTrim(int msecs) {
+  if (!m_trimScheduled)
+    m_trimScheduled = callLater(msecs, [this]() { trim(); });
+}
+
+//-------------------------------------------------------------
+
+ShMemPool &shMemPool() {
+  static ShMemPool pool;
+  return pool;
+}
+
+//-------------------------------------------------------------
+
+/*!
+  Keeps the segments attached by readShMemBuffer(). Since writers reuse
+  their segments, the same ones are attached again and again.
+*/
+class ShMemAttachments {
+  struct Attachment {
+    QSharedMemory *m_shmem;
+    int m_usersCount;
+  };
+
+  QMutex m_mutex;
+  QHash<QString, Attachment> m_segments;
+  std::vector<QString> m_ids;  //!< Least recently used first
+  QElapsedTimer m_idleTimer;   //!< Restarted by every release()
+  bool m_trimScheduled;
+
+public:
+  ShMemAttachments() : m_trimScheduled(false) {}
+  ~ShMemAttachments();
+
+  //! Returns the segment attached with the specified id, to be released once
+  //! read.
+  QSharedMemory *attach(const QString &id, int size);
+  void release(const QString &id);
+
+  //! Detaches all the segments not being read. Writers ask for it when they
+  //! run out of shared memory, since the attachments keep the segments they
+  //! dropped alive.
+  void clear();
+
+private:
+  // To be called with m_mutex locked
+  void detach(const QString &id);
+  void scheduleTrim(int msecs);
+
+  void trim();
+};
+
+//-------------------------------------------------------------
+
+ShMemAttachments::~ShMemAttachments() {
+  QHash<QString, Attachment>::iterator st, sEnd = m_segments.end();
+  for (st = m_segments.begin(); st != sEnd; ++st) delete st->m_shmem;
+}
+
+//-------------------------------------------------------------
+
+QSharedMemory *ShMemAttachments::attach(const QString &id, int size) {
+  QMutexLocker locker(&m_mutex);
+
+  QHash<QString, Attachment>::iterator st = m_segments.find(id);
+  if (st != m_segments.end() && st->m_usersCount == 0 &&
+      st->m_shmem->size() < size) {
+    // A segment smaller than the transfer cannot be the writer's one
+    detach(id);
+    st = m_segments.end();
+  }
+
+  if (st == m_segments.end()) {
+    QSharedMemory *shmem = new QSharedMemory(id);
+    if (!shmem->attach()) {
+      delete shmem;
+      return 0;
+    }
+
+    Attachment attachment = {shmem, 0};
+    st = m_segments.insert(id, attachment);
+  } else
+    m_ids.erase(std::find(m_ids.begin(), m_ids.end(), id));
+
+  ++st->m_usersCount;
+  QSharedMemory *shmem = st->m_shmem;
+
+  m_ids.push_back(id);
+
+  if ((int)m_ids.size() > maxPooledSegments) {
+    // Writers have dropped the least recently used ones, or will soon
+    std::vector<QString>::iterator it, iEnd = m_ids.end();
+    for (it = m_ids.begin(); it != iEnd; ++it)
+      if (m_segments.value(*it).m_usersCount == 0) {
+        detach(*it);
+        break;
+      }
+  }
+
+  return shmem;
+}
+
+//-------------------------------------------------------------
+
+void ShMemAttachments::release(const QString &id) {
+  QMutexLocker locker(&m_mutex);
+
+  QHash<QString, Attachment>::iterator st = m_segments.find(id);
+  if (st != m_segments.end()) --st->m_usersCount;
+
+  m_idleTimer.start();
+  scheduleTrim(idleSegmentsTime);
+}
+
+//-------------------------------------------------------------
+
+void ShMemAttachments::clear() {
+  QMutexLocker locker(&m_mutex);
+
+  std::vector<QString> ids(m_ids);
+  std::vector<QString>::iterator it, iEnd = ids.end();
+  for (it = ids.begin(); it != iEnd; ++it)
+    if (m_segments.value(*it).m_usersCount == 0) detach(*it);
+}
+
+//-------------------------------------------------------------
+
+void ShMemAttachments::detach(const QString &id) {
+  delete m_segments.take(id).m_shmem;
+  m_ids.erase(std::find(m_ids.begin(), m_ids.end(), id));
+}
+
+//-------------------------------------------------------------
+
+void ShMemAttachments::trim() {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_trimScheduled = false;
+
+    qint64 idleTime = m_idleTimer.elapsed();
+    if (idleTime < idleSegmentsTime) {
+      scheduleTrim(idleSegmentsTime - idleTime);
+      return;
+    }
+  }
+
+  // Segments still being read schedule a new trim on release()
+  clear();
+}
+
+//-------------------------------------------------------------
+
+void ShMemAttachments::scheduleTrim(int msecs) {
+  if (!m_trimScheduled)
+    m_trimScheduled = callLater(msecs, [this]() { trim(); });
+}
+
+//-------------------------------------------------------------
+
+ShMemAttachments &shMemAttachments() {
+  static ShMemAttachments attachments;
+  return attachments;
+}
+
 }  // namespace
 
 //********************************************************
@@ -636,27 +961,37 @@ bool tipc::writeShMemBuffer(Stream &stream, Message &msg, int bufSize,
   tipc_debug(QTime time; time.start());
   tipc_debug(qDebug("tipc::writeShMemBuffer entry"));
 
-  static QSemaphore sem(tipc::shm_maxSegmentCount());
+  // Segments are reused, and their number is bounded: writers exceeding it
+  // wait until a transfer is complete
+  static QSemaphore sem(
+      std::min(tipc::shm_maxSegmentCount(), maxPooledSegments));
   sem.acquire(1);
 
-  {
-    // Create a shared memory segment, possibly of passed size
-    QSharedMemory shmem(tipc::uniqueId());
-    bool ok = (tipc::create(shmem, bufSize) > 0);
-    if (!ok) goto err;
+  QSharedMemory *shmem = shMemPool().acquire(bufSize);
+  if (!shmem) {
+    // The reader's attachments keep alive the segments we dropped. Have it
+    // detach them, and retry.
+    stream << (msg << QString("shmdrop"));
+    if (tipc::readMessage(stream, msg) != "ok") goto err;
+
+    msg.clear();
+    shmem = shMemPool().acquire(bufSize);
+    if (!shmem) goto err;
+  }
 
+  {
     // Communicate the shared memory id and bufSize to the reader
-    msg << QString("shm") << shmem.key() << bufSize;
+    msg << QString("shm") << shmem->key() << bufSize;
 
     // Fill in data until all the buffer has been sent
     int chunkData, remainingData = bufSize;
     while (remainingData > 0) {
       // Write to the shared memory segment
       tipc_debug(QTime xchTime; xchTime.start());
-      shmem.lock();
+      shmem->lock();
       remainingData -= chunkData = dataWriter->write(
-          (char *)shmem.data(), std::min(shmem.size(), remainingData));
-      shmem.unlock();
+          (char *)shmem->data(), std::min(shmem->size(), remainingData));
+      shmem->unlock();
       tipc_debug(qDebug() << "exchange time:" << xchTime.elapsed());
 
       stream << (msg << QString("chk") << chunkData);
@@ -667,6 +1002,7 @@ bool tipc::writeShMemBuffer(Stream &stream, Message &msg, int bufSize,
     }
   }
 
+  shMemPool().release(shmem);
   sem.release(1);
   tipc_debug(qDebug("tipc::writeShMemBuffer exit"));
   tipc_debug(qDebug() << "tipc::writeShMemBuffer time:" << time.elapsed());
@@ -676,6 +1012,9 @@ err:
 
   tipc_debug(qDebug("tipc::writeShMemBuffer exit (error)"));
 
+  // The reader may still be using the segment
+  shMemPool().discard(shmem);
+
   msg.clear();
   sem.release(1);
   return false;
@@ -693,6 +1032,14 @@ bool tipc::readShMemBuffer(Stream &stream, Message &msg,
 
   // Read the id from stream
   QString res(tipc::readMessage(stream, msg));
+  while (res == "shmdrop") {
+    // The writer ran out of shared memory
+    shMemAttachments().clear();
+
+    stream << (msg << clr << QString("ok"));
+    res = tipc::readMessage(stream, msg);
+  }
+
   if (res != "shm") {
     tipc_debug(qDebug("tipc::readShMemBuffer exit (res != \"shm\")"));
     return false;
@@ -704,9 +1051,9 @@ bool tipc::readShMemBuffer(Stream &stream, Message &msg,
   msg >> id >> bufSize >> chkStr;
 
   // Data is ready to be read - attach to the shared memory segment.
-  QSharedMemory shmem(id);
-  shmem.attach();
-  if (!shmem.isAttached()) {
+  QSharedMemory *shmem = shMemAttachments().attach(
+      id, std::min(bufSize, tipc::shm_maxSegmentSize()));
+  if (!shmem) {
     tipc_debug(qDebug("tipc::readShMemBuffer exit (shmem not attached)"));
     return false;
   }
@@ -717,9 +1064,9 @@ bool tipc::readShMemBuffer(Stream &stream, Message &msg,
     msg >> chunkData;
 
     tipc_debug(QTime xchTime; xchTime.start());
-    shmem.lock();
-    remainingData -= dataReader->read((const char *)shmem.data(), chunkData);
-    shmem.unlock();
+    shmem->lock();
+    remainingData -= dataReader->read((const char *)shmem->data(), chunkData);
+    shmem->unlock();
     tipc_debug(qDebug() << "exchange time:" << xchTime.elapsed());
 
     // Data was read. Inform the writer
@@ -732,11 +1079,13 @@ bool tipc::readShMemBuffer(Stream &stream, Message &msg,
     if (tipc::readMessage(stream, msg) != "chk") {
       tipc_debug(
           qDebug("tipc::readShMemBuffer exit (unexpected chunk absence)"));
+      shMemAttachments().release(id);
       return false;
     }
   }
 
-  shmem.detach();
+  shMemAttachments().release(id);
+
   tipc_debug(qDebug("tipc::readShMemBuffer exit"));
   tipc_debug(qDebug() << "tipc::readShMemBuffer time:" << time.elapsed());
   return true;
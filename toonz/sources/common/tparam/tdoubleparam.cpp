@@ -332,6 +332,9 @@ public:
     for (; it != m_observers.end(); ++it) (*it)->onChange(change);
   }
 
+  int lowerBound(double frame, int &hint) const;
+  double computeValue(double frame, bool leftmost, int &hint);
+
   double getValue(int segmentIndex, double frame);
   double getSpeed(int segmentIndex, double frame);
   TPointD getSpeedIn(int kIndex);
@@ -340,6 +343,24 @@ public:
 
 //---------------------------------------------------------
 
+//! Same as std::lower_bound() on the keyframes. Frames are mostly asked in
+//! sequence, so the hint from the previous search and the keyframe after it
+//! are tried first.
+int TDoubleParam::Imp::lowerBound(double frame, int &hint) const {
+  int i, count = (int)m_keyframes.size();
+  for (i = std::max(hint, 0); i < hint + 2 && i < count; ++i) {
+    if (m_keyframes[i].m_frame >= frame &&
+        (i == 0 || m_keyframes[i - 1].m_frame < frame))
+      return hint = i;
+  }
+
+  DoubleKeyframeVector::const_iterator it = std::lower_bound(
+      m_keyframes.begin(), m_keyframes.end(), TDoubleKeyframe(frame));
+  return hint = std::distance(m_keyframes.begin(), it);
+}
+
+//---------------------------------------------------------
+
 double TDoubleParam::Imp::getValue(int segmentIndex, double frame) {
   assert(0 <= segmentIndex && segmentIndex + 1 < (int)m_keyframes.size());
   const TActualDoubleKeyframe &k0 = m_keyframes[segmentIndex];
@@ -525,13 +546,13 @@ bool TDoubleParam::isCycleEnabled() const { return m_imp->m_cycleEnabled; }
 
 //=========================================================
 
-double TDoubleParam::getValue(double frame, bool leftmost) const {
-  double value = 0;
-  assert(m_imp);
-  const DoubleKeyframeVector &keyframes = m_imp->m_keyframes;
+double TDoubleParam::Imp::computeValue(double frame, bool leftmost,
+                                       int &hint) {
+  double value                          = 0;
+  const DoubleKeyframeVector &keyframes = m_keyframes;
   if (keyframes.empty()) {
     // no keyframes: return the default value
-    value = m_imp->m_defaultValue;
+    value = m_defaultValue;
   } else if (keyframes.size() == 1) {
     // a single keyframe. Type must be keyframe based (no expression/file)
     value = keyframes[0].m_value;
@@ -541,11 +562,11 @@ double TDoubleParam::getValue(double frame, bool leftmost) const {
     double f1 = keyframes.back().m_frame;
     if (frame < f0)
       frame = f0;
-    else if (frame > f1 && !m_imp->m_cycleEnabled)
+    else if (frame > f1 && !m_cycleEnabled)
       frame = f1;
     double valueOffset = 0;
 
-    if (m_imp->m_cycleEnabled) {
+    if (m_cycleEnabled) {
       double dist   = (f1 - f0);
       double dvalue = keyframes.back().m_value - keyframes.begin()->m_value;
       while (frame >= f1) {
@@ -561,8 +582,7 @@ double TDoubleParam::getValue(double frame, bool leftmost) const {
     assert(f0 <= frame && frame <= f1);
 
     DoubleKeyframeVector::const_iterator b;
-    b = std::lower_bound(keyframes.begin(), keyframes.end(),
-                         TDoubleKeyframe(frame));
+    b = keyframes.begin() + lowerBound(frame, hint);
     assert(b != keyframes.end());
     DoubleKeyframeVector::const_iterator a;
     if (b->m_frame == frame && (b + 1) != keyframes.end()) {
@@ -595,15 +615,18 @@ double TDoubleParam::getValue(double frame, bool leftmost) const {
           !TDoubleKeyframe::isKeyframeBased(b->m_type)) {
         tmpKeyframe[0] = *b;
         if (b->m_type != TDoubleKeyframe::Expression ||
-            !b->m_expression.isCycling())
-          tmpKeyframe[0].m_value = getValue(b->m_frame);
+            !b->m_expression.isCycling()) {
+          int bHint              = -1;
+          tmpKeyframe[0].m_value = computeValue(b->m_frame, false, bHint);
+        }
         b = tmpKeyframe.begin();
       }
       // .. and/or if prev segment is not then update the a value
       if (a != keyframes.begin() &&
           !TDoubleKeyframe::isKeyframeBased(a[-1].m_type)) {
+        int aHint              = -1;
         tmpKeyframe[1]         = *a;
-        tmpKeyframe[1].m_value = getValue(a->m_frame, true);
+        tmpKeyframe[1].m_value = computeValue(a->m_frame, true, aHint);
         a                      = tmpKeyframe.begin() + 1;
       }
     }
@@ -621,8 +644,8 @@ double TDoubleParam::getValue(double frame, bool leftmost) const {
       frame = a->m_frame + tfloor(tfloor(frame - a->m_frame), step);
     }
 
-    assert(0 <= kIndex && kIndex + 1 < (int)m_imp->m_keyframes.size());
-    value            = m_imp->m_defaultValue;
+    assert(0 <= kIndex && kIndex + 1 < (int)m_keyframes.size());
+    value            = m_defaultValue;
     bool convertUnit = false;
     switch (a->m_type) {
     case TDoubleKeyframe::Constant:
@@ -645,15 +668,15 @@ double TDoubleParam::getValue(double frame, bool leftmost) const {
       value = getExponentialValue(*a, *b, frame);
       break;
     case TDoubleKeyframe::Expression:
-      value       = getExpressionValue(*a, *b, frame, m_imp->m_measure);
+      value       = getExpressionValue(*a, *b, frame, m_measure);
       convertUnit = true;
       break;
     case TDoubleKeyframe::File:
-      value       = a->m_fileData.getValue(frame, m_imp->m_defaultValue);
+      value       = a->m_fileData.getValue(frame, m_defaultValue);
       convertUnit = true;
       break;
     case TDoubleKeyframe::SimilarShape:
-      value = getSimilarShapeValue(*a, *b, frame, m_imp->m_measure);
+      value = getSimilarShapeValue(*a, *b, frame, m_measure);
       // convertUnit = true;
       break;
 
@@ -661,16 +684,37 @@ double TDoubleParam::getValue(double frame, bool leftmost) const {
       value = 0.0;
     }
     value += valueOffset;
-    if (convertUnit) value = a->convertFrom(m_imp->m_measure, value);
+    if (convertUnit) value = a->convertFrom(m_measure, value);
   }
 
   // if (cropped)
-  //  value = tcrop(value, m_imp->m_minValue, m_imp->m_maxValue);
+  //  value = tcrop(value, m_minValue, m_maxValue);
   return value;
 }
 
 //---------------------------------------------------------
 
+double TDoubleParam::getValue(double frame, bool leftmost) const {
+  assert(m_imp);
+
+  int hint = -1;
+  return m_imp->computeValue(frame, leftmost, hint);
+}
+
+//---------------------------------------------------------
+
+void TDoubleParam::getValues(double frame, int count, double *values,
+                             double step) const {
+  assert(m_imp);
+
+  // The search hint follows the frames
+  int hint = -1;
+  for (int i = 0; i < count; ++i)
+    values[i] = m_imp->computeValue(frame + i * step, false, hint);
+}
+
+//---------------------------------------------------------
+
 bool TDoubleParam::setValue(double frame, double value) {
   assert(m_imp);
   DoubleKeyframeVector &keyframes = m_imp->m_keyframes;
@@ -8,6 +8,7 @@
 //#include "tstopwatch.h"
 #include "timagecache.h"
 #include "trasterimage.h"
+#include "tthread.h"
 
 //#include "snappy-c.h"
 #if defined(LZ4_STATIC)
@@ -19,6 +20,10 @@
 #include <QDir>
 #include <QProcess>
 #include <QCoreApplication>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <map>
 
 using namespace std;
 
@@ -30,6 +35,7 @@ class Header {
     Raster32CM,
     RasterGR8,
     RasterGR16,
+    RasterFloatRGBM,
     RasterUnknown
   };
 
@@ -73,8 +79,13 @@ Header::Header(const TRasterP &ras) {
           if (rasGR16)
             m_rasType = RasterGR16;
           else {
-            assert(!"Unknown RasterType");
-            m_rasType = RasterUnknown;
+            TRasterFP rasF(ras);
+            if (rasF)
+              m_rasType = RasterFloatRGBM;
+            else {
+              assert(!"Unknown RasterType");
+              m_rasType = RasterUnknown;
+            }
           }
         }
       }
@@ -101,6 +112,9 @@ TRasterP Header::createRaster() const {
   case RasterGR16:
     return TRasterGR16P(m_lx, m_ly);
     break;
+  case RasterFloatRGBM:
+    return TRasterFP(m_lx, m_ly);
+    break;
   default:
     assert(0);
     return TRasterP();
@@ -125,15 +139,99 @@ int Header::getRasterSize() const {
   case RasterGR8:
     return m_lx * m_ly;
     break;
+  case RasterGR16:
+    return 2 * m_lx * m_ly;
+    break;
+  case RasterFloatRGBM:
+    return 16 * m_lx * m_ly;
+    break;
   default:
     assert(0);
     return 0;
     break;
   }
 }
+//------------------------------------------------------------------------------
+
+int codecLevel(const std::string &name, int defaultLevel) {
+  std::string::size_type pos = name.find(':');
+  return (pos == std::string::npos) ? defaultLevel
+                                    : std::atoi(name.c_str() + pos + 1);
+}
+
+TRasterCodec *createLz4(const std::string &name) {
+  return new TRasterCodecLz4(name, false, codecLevel(name, 0));
+}
+
+TRasterCodec *createLz4HC(const std::string &name) {
+  // 9 is LZ4HC_CLEVEL_DEFAULT - not a public symbol in older lz4 releases
+  return new TRasterCodecLz4(name, false, codecLevel(name, 9));
+}
+
+TRasterCodec *createLZO(const std::string &name) {
+  return new TRasterCodecLZO(name, false);
+}
+
+//------------------------------------------------------------------------------
+
+typedef std::map<std::string, TRasterCodec::Creator> CreatorsMap;
+
+// Must be called with creatorsMutex() locked
+CreatorsMap &creators() {
+  static CreatorsMap theMap;
+  if (theMap.empty()) {
+    // Built-in codecs - declared on first use, so that they are available
+    // during static initialization too
+    theMap["LZ4"]    = createLz4;
+    theMap["LZ4-HC"] = createLz4HC;
+    theMap["LZO"]    = createLZO;
+  }
+
+  return theMap;
+}
+
+QMutex &creatorsMutex() {
+  static QMutex mutex;
+  return mutex;
+}
+
 //------------------------------------------------------------------------------
 }  // anonymous namespace
 
+//------------------------------------------------------------------------------
+//	TRasterCodec
+//------------------------------------------------------------------------------
+
+void TRasterCodec::declare(const std::string &name, Creator creator) {
+  QMutexLocker locker(&creatorsMutex());
+  creators()[name] = creator;
+}
+
+//------------------------------------------------------------------------------
+
+void TRasterCodec::getDeclaredNames(std::vector<std::string> &names) {
+  QMutexLocker locker(&creatorsMutex());
+
+  CreatorsMap::iterator it, end = creators().end();
+  for (it = creators().begin(); it != end; ++it) names.push_back(it->first);
+}
+
+//------------------------------------------------------------------------------
+
+TRasterCodec *TRasterCodec::create(const std::string &name) {
+  Creator creator = 0;
+  {
+    QMutexLocker locker(&creatorsMutex());
+
+    std::string baseName(name.substr(0, name.find(':')));
+
+    CreatorsMap::iterator it = creators().find(baseName);
+    if (it != creators().end()) creator = it->second;
+  }
+
+  return creator ? creator(name) : 0;
+}
+
 //------------------------------------------------------------------------------
 //	TRasterCodecSnappy
 //------------------------------------------------------------------------------
@@ -375,10 +473,91 @@ bool lz4decompress(LZ4F_decompressionContext_t lz4dctx, char *out,
 
   return true;
 }
+
+//------------------------------------------------------------------------------
+
+inline void lz4preferences(LZ4F_preferences_t &prefs, int level) {
+  memset(&prefs, 0, sizeof(LZ4F_preferences_t));
+  prefs.compressionLevel = level;
+}
+
+//------------------------------------------------------------------------------
+
+// Rasters are split into bands no smaller than this, in bytes
+const size_t minBandSize = 1 << 20;
+
+//! The bands of a raster, each compressed as an independent LZ4 frame at the
+//! start of its own slot of the output buffer.
+class Lz4BandsCompression {
+public:
+  const char *m_in;
+  char *m_out;
+  int m_level;
+
+  std::vector<size_t> m_inOffsets, m_outOffsets;  //!< Bands count + 1 each
+  std::vector<size_t> m_outSizes;                 //!< 0 on failure
+
+public:
+  Lz4BandsCompression(const char *in, char *out, int level)
+      : m_in(in), m_out(out), m_level(level) {}
+
+  int bandsCount() const { return (int)m_outSizes.size(); }
+
+  void compressBand(int b) {
+    LZ4F_preferences_t prefs;
+    lz4preferences(prefs, m_level);
+
+    size_t outSize = LZ4F_compressFrame(
+        m_out + m_outOffsets[b], m_outOffsets[b + 1] - m_outOffsets[b],
+        m_in + m_inOffsets[b], m_inOffsets[b + 1] - m_inOffsets[b], &prefs);
+
+    m_outSizes[b] = LZ4F_isError(outSize) ? 0 : outSize;
+  }
+};
+
+//------------------------------------------------------------------------------
+
+// Splits the specified raster in bands and returns the output buffer size
+// required to compress them.
+size_t prepareBands(const TRasterP &ras, Lz4BandsCompression &compression) {
+  int ly          = ras->getLy();
+  size_t rowSize  = ras->getLx() * ras->getPixelSize();
+  size_t dataSize = rowSize * ly;
+
+  int bandsCount = std::min<int>(dataSize / minBandSize, ly);
+  bandsCount     = tcrop(bandsCount, 1, TSystem::getProcessorCount());
+
+  LZ4F_preferences_t prefs;
+  lz4preferences(prefs, compression.m_level);
+
+  compression.m_inOffsets.push_back(0);
+  compression.m_outOffsets.push_back(0);
+
+  for (int b = 1; b <= bandsCount; ++b) {
+    size_t inOffset = rowSize * ((ly * b) / bandsCount);
+    size_t inSize   = inOffset - compression.m_inOffsets.back();
+
+    compression.m_inOffsets.push_back(inOffset);
+    compression.m_outOffsets.push_back(compression.m_outOffsets.back() +
+                                       LZ4F_compressFrameBound(inSize, &prefs));
+  }
+
+  compression.m_outSizes.resize(bandsCount, 0);
+
+  return compression.m_outOffsets.back();
+}
+
 }  // namespace
 
-TRasterCodecLz4::TRasterCodecLz4(const std::string &name, bool useCache)
-    : TRasterCodec(name), m_raster(), m_useCache(useCache), m_cacheId("") {}
+//------------------------------------------------------------------------------
+
+TRasterCodecLz4::TRasterCodecLz4(const std::string &name, bool useCache,
+                                 int compressionLevel)
+    : TRasterCodec(name)
+    , m_raster()
+    , m_useCache(useCache)
+    , m_cacheId("")
+    , m_compressionLevel(compressionLevel) {}
 
 //------------------------------------------------------------------------------
 
@@ -397,8 +576,8 @@ UINT TRasterCodecLz4::doCompress(const TRasterP &inRas, int allocUnit,
 
   assert(inRas->getLx() == inRas->getWrap());
 
-  size_t inDataSize = inRas->getLx() * inRas->getLy() * inRas->getPixelSize();
-  size_t maxReqSize = LZ4F_compressFrameBound(inDataSize, NULL);
+  Lz4BandsCompression compression(0, 0, m_compressionLevel);
+  size_t maxReqSize = prepareBands(inRas, compression);
 
   if (m_useCache) {
     if (m_cacheId == "")
@@ -425,14 +604,30 @@ UINT TRasterCodecLz4::doCompress(const TRasterP &inRas, int allocUnit,
   if (!buffer) return 0;
 
   inRas->lock();
-  const void *inData = (const void *)inRas->getRawData();
 
-  size_t outSize =
-      LZ4F_compressFrame(buffer, maxReqSize, inData, inDataSize, NULL);
+  compression.m_in  = (const char *)inRas->getRawData();
+  compression.m_out = (char *)buffer;
+
+  TThread::parallelFor(compression.bandsCount(),
+                       [&compression](int b) { compression.compressBand(b); });
+
+  // Compact the frames - consecutive frames are decompressed as a whole
+  const std::vector<size_t> &outOffsets = compression.m_outOffsets;
+  const std::vector<size_t> &outSizes   = compression.m_outSizes;
+
+  bool failed    = (outSizes[0] == 0);
+  size_t outSize = outSizes[0];
+  for (int b = 1; b < compression.bandsCount(); ++b) {
+    failed = failed || outSizes[b] == 0;
+    memmove((char *)buffer + outSize, (char *)buffer + outOffsets[b],
+            outSizes[b]);
+    outSize += outSizes[b];
+  }
+
   outRas->unlock();
   inRas->unlock();
 
-  if (LZ4F_isError(outSize)) throw TException("compress... something goes bad");
+  if (failed) throw TException("compress... something goes bad");
 
   return outSize;
 }
@@ -716,8 +911,10 @@ bool TRasterCodecLZO::decompress(const UCHAR *inData, TINT32 inDataSize,
 
   size_t outSize = outDataSize;  // Calculate output buffer size
 
+  // The input may point straight into a file mapping - don't copy it
   QByteArray decompressedBuffer;
-  if (!lzoDecompress(QByteArray(mc, ds), outSize, decompressedBuffer))
+  if (!lzoDecompress(QByteArray::fromRawData(mc, ds), outSize,
+                     decompressedBuffer))
     throw TException("LZO decompression failed");
 
   outRas->lock();
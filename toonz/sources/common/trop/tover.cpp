@@ -7,12 +7,24 @@
 #include "tropcm.h"
 #include "tpalette.h"
 
-#if defined(_WIN32) && defined(x64)
+#if (defined(_WIN32) && defined(x64)) || defined(__SSE2__)
 #define USE_SSE2
 #endif
 
 #ifdef USE_SSE2
 #include <emmintrin.h>  // per SSE2
+
+#if defined(_MSC_VER) || defined(__GNUC__)
+#define USE_AVX2
+#include <immintrin.h>
+
+// AVX2 kernels are compiled for that target only, and selected at runtime
+#ifdef _MSC_VER
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
 #endif
 
 //-----------------------------------------------------------------------------
@@ -28,11 +40,425 @@ inline bool opaque(const TPixel64 &p) { return p.m == 0xffff; }
 
 //-----------------------------------------------------------------------------
 
+#ifdef USE_SSE2
+
+// Index of the matte channel in the pixel types
+#if defined(TNZ_MACHINE_CHANNEL_ORDER_MBGR) ||                                 \
+    defined(TNZ_MACHINE_CHANNEL_ORDER_MRGB)
+#define MATTE_INDEX 0
+#else
+#define MATTE_INDEX 3
+#endif
+
+#define MATTE_SHUFFLE                                                          \
+  _MM_SHUFFLE(MATTE_INDEX, MATTE_INDEX, MATTE_INDEX, MATTE_INDEX)
+
+/*
+  The following kernels perform the premultiplied over of a row of pixels,
+  writing up + dn * (1 - up.m) to out (which may coincide with dn). Integer
+  kernels give the same results as the scalar code: channels are rounded
+  down, except for the matte channel when ceilMatte is true - which is how
+  overPix() rounds it. Pixels whose up matte is 0 are left to dn.
+*/
+
+//! Scalar over of the pixels not filling a whole SIMD register.
+template <class T, class Q>
+void overTail(T *out, const T *dn, const T *up, int count, bool ceilMatte) {
+  UINT max = T::maxChannelValue;
+
+  for (; count > 0; --count, ++out, ++dn, ++up) {
+    if (ceilMatte)
+      *out = overPix(*dn, *up);
+    else if (up->m == max)
+      *out = *up;
+    else if (up->m > 0) {
+      TUINT32 r = up->r + dn->r * (max - up->m) / max;
+      TUINT32 g = up->g + dn->g * (max - up->m) / max;
+      TUINT32 b = up->b + dn->b * (max - up->m) / max;
+
+      out->r = (r < max) ? (Q)r : (Q)max;
+      out->g = (g < max) ? (Q)g : (Q)max;
+      out->b = (b < max) ? (Q)b : (Q)max;
+      out->m = up->m + dn->m * (max - up->m) / max;
+    } else
+      *out = *dn;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void overTail(TPixelF *out, const TPixelF *dn, const TPixelF *up, int count,
+              bool) {
+  for (; count > 0; --count, ++out, ++dn, ++up) {
+    if (up->m >= 1.f)
+      *out = *up;
+    else if (up->m > 0.f) {
+      out->r = up->r + dn->r * (1.f - up->m);
+      out->g = up->g + dn->g * (1.f - up->m);
+      out->b = up->b + dn->b * (1.f - up->m);
+      out->m = up->m + dn->m * (1.f - up->m);
+    } else
+      *out = *dn;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void overRow_SSE2(TPixel32 *out, const TPixel32 *dn, const TPixel32 *up,
+                  int count, bool ceilMatte) {
+  const __m128i zeros = _mm_setzero_si128();
+  const __m128i ones  = _mm_set1_epi16(1);
+  const __m128i maxs  = _mm_set1_epi16(0xff);
+
+  TPixel32 matteMask(0, 0, 0, 0xff);
+  const __m128i matteMask_packed = _mm_set1_epi32(*(int *)&matteMask);
+
+  // Rounding up x / 255 is rounding down (x + 254) / 255
+  short bias[8] = {0};
+  if (ceilMatte) bias[MATTE_INDEX] = bias[4 + MATTE_INDEX] = 254;
+  const __m128i bias_packed = _mm_loadu_si128((const __m128i *)bias);
+
+  for (; count >= 4; count -= 4, out += 4, dn += 4, up += 4) {
+    __m128i up_packed = _mm_loadu_si128((const __m128i *)up);
+    __m128i dn_packed = _mm_loadu_si128((const __m128i *)dn);
+
+    // Fully transparent or opaque blocks are just copied
+    __m128i matte = _mm_and_si128(up_packed, matteMask_packed);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(matte, zeros)) == 0xffff) {
+      _mm_storeu_si128((__m128i *)out, dn_packed);
+      continue;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(matte, matteMask_packed)) ==
+        0xffff) {
+      _mm_storeu_si128((__m128i *)out, up_packed);
+      continue;
+    }
+
+    __m128i upLo = _mm_unpacklo_epi8(up_packed, zeros);
+    __m128i upHi = _mm_unpackhi_epi8(up_packed, zeros);
+    __m128i dnLo = _mm_unpacklo_epi8(dn_packed, zeros);
+    __m128i dnHi = _mm_unpackhi_epi8(dn_packed, zeros);
+
+    __m128i mLo =
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(upLo, MATTE_SHUFFLE),
+                            MATTE_SHUFFLE);
+    __m128i mHi =
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(upHi, MATTE_SHUFFLE),
+                            MATTE_SHUFFLE);
+
+    // dn * (255 - m) / 255, with the exact division (x + 1 + (x >> 8)) >> 8
+    __m128i xLo = _mm_add_epi16(
+        _mm_mullo_epi16(dnLo, _mm_sub_epi16(maxs, mLo)), bias_packed);
+    __m128i xHi = _mm_add_epi16(
+        _mm_mullo_epi16(dnHi, _mm_sub_epi16(maxs, mHi)), bias_packed);
+    xLo = _mm_srli_epi16(
+        _mm_add_epi16(_mm_add_epi16(xLo, ones), _mm_srli_epi16(xLo, 8)), 8);
+    xHi = _mm_srli_epi16(
+        _mm_add_epi16(_mm_add_epi16(xHi, ones), _mm_srli_epi16(xHi, 8)), 8);
+
+    // Saturated packing clamps the channels
+    __m128i out_packed =
+        _mm_packus_epi16(_mm_add_epi16(upLo, xLo), _mm_add_epi16(upHi, xHi));
+
+    __m128i transp = _mm_packs_epi16(_mm_cmpeq_epi16(mLo, zeros),
+                                     _mm_cmpeq_epi16(mHi, zeros));
+    out_packed = _mm_or_si128(_mm_and_si128(transp, dn_packed),
+                              _mm_andnot_si128(transp, out_packed));
+
+    _mm_storeu_si128((__m128i *)out, out_packed);
+  }
+
+  overTail<TPixel32, UCHAR>(out, dn, up, count, ceilMatte);
+}
+
+//-----------------------------------------------------------------------------
+
+void overRow_SSE2(TPixel64 *out, const TPixel64 *dn, const TPixel64 *up,
+                  int count, bool ceilMatte) {
+  const __m128i zeros    = _mm_setzero_si128();
+  const __m128i maxs     = _mm_set1_epi16(-1);
+  const __m128i ones32   = _mm_set1_epi32(1);
+  const __m128i offset32 = _mm_set1_epi32(0x8000);
+  const __m128i offset16 = _mm_set1_epi16(-0x8000);
+
+  int bias[4] = {0};
+  if (ceilMatte) bias[MATTE_INDEX] = 0xfffe;
+  const __m128i bias_packed = _mm_loadu_si128((const __m128i *)bias);
+
+  for (; count >= 2; count -= 2, out += 2, dn += 2, up += 2) {
+    __m128i up_packed = _mm_loadu_si128((const __m128i *)up);
+    __m128i dn_packed = _mm_loadu_si128((const __m128i *)dn);
+
+    __m128i m =
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(up_packed, MATTE_SHUFFLE),
+                            MATTE_SHUFFLE);
+
+    __m128i transp = _mm_cmpeq_epi16(m, zeros);
+    if (_mm_movemask_epi8(transp) == 0xffff) {
+      _mm_storeu_si128((__m128i *)out, dn_packed);
+      continue;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(m, maxs)) == 0xffff) {
+      _mm_storeu_si128((__m128i *)out, up_packed);
+      continue;
+    }
+
+    // 32-bit products dn * (65535 - m)
+    __m128i invM = _mm_xor_si128(m, maxs);
+    __m128i lo   = _mm_mullo_epi16(dn_packed, invM);
+    __m128i hi   = _mm_mulhi_epu16(dn_packed, invM);
+
+    __m128i x0 = _mm_add_epi32(_mm_unpacklo_epi16(lo, hi), bias_packed);
+    __m128i x1 = _mm_add_epi32(_mm_unpackhi_epi16(lo, hi), bias_packed);
+
+    // Exact division by 65535: (x + 1 + (x >> 16)) >> 16
+    x0 = _mm_srli_epi32(
+        _mm_add_epi32(_mm_add_epi32(x0, ones32), _mm_srli_epi32(x0, 16)), 16);
+    x1 = _mm_srli_epi32(
+        _mm_add_epi32(_mm_add_epi32(x1, ones32), _mm_srli_epi32(x1, 16)), 16);
+
+    // Unsigned 32 to 16 bits packing, through the signed one
+    __m128i x = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(x0, offset32),
+                                              _mm_sub_epi32(x1, offset32)),
+                              offset16);
+
+    __m128i out_packed = _mm_adds_epu16(up_packed, x);
+    out_packed         = _mm_or_si128(_mm_and_si128(transp, dn_packed),
+                                      _mm_andnot_si128(transp, out_packed));
+
+    _mm_storeu_si128((__m128i *)out, out_packed);
+  }
+
+  overTail<TPixel64, USHORT>(out, dn, up, count, ceilMatte);
+}
+
+//-----------------------------------------------------------------------------
+
+//! The float kernel implements the in-place over only - ceilMatte is ignored.
+void overRow_SSE2(TPixelF *out, const TPixelF *dn, const TPixelF *up,
+                  int count, bool ceilMatte) {
+  const __m128 zeros = _mm_setzero_ps();
+  const __m128 ones  = _mm_set1_ps(1.f);
+
+  for (; count > 0; --count, ++out, ++dn, ++up) {
+    __m128 up_packed = _mm_loadu_ps((const float *)up);
+    __m128 dn_packed = _mm_loadu_ps((const float *)dn);
+    __m128 m         = _mm_shuffle_ps(up_packed, up_packed, MATTE_SHUFFLE);
+
+    __m128 out_packed =
+        _mm_add_ps(up_packed, _mm_mul_ps(dn_packed, _mm_sub_ps(ones, m)));
+
+    __m128 opaque = _mm_cmpge_ps(m, ones);
+    out_packed    = _mm_or_ps(_mm_and_ps(opaque, up_packed),
+                              _mm_andnot_ps(opaque, out_packed));
+
+    __m128 visible = _mm_cmpgt_ps(m, zeros);
+    out_packed     = _mm_or_ps(_mm_and_ps(visible, out_packed),
+                               _mm_andnot_ps(visible, dn_packed));
+
+    _mm_storeu_ps((float *)out, out_packed);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+#ifdef USE_AVX2
+
+// Same as the SSE2 kernels, on twice the pixels. Unpacking and packing work
+// on each 128-bit lane separately, preserving the pixels order.
+
+AVX2_TARGET void overRow_AVX2(TPixel32 *out, const TPixel32 *dn,
+                              const TPixel32 *up, int count, bool ceilMatte) {
+  const __m256i zeros = _mm256_setzero_si256();
+  const __m256i ones  = _mm256_set1_epi16(1);
+  const __m256i maxs  = _mm256_set1_epi16(0xff);
+
+  TPixel32 matteMask(0, 0, 0, 0xff);
+  const __m256i matteMask_packed = _mm256_set1_epi32(*(int *)&matteMask);
+
+  short bias[16] = {0};
+  if (ceilMatte)
+    bias[MATTE_INDEX] = bias[4 + MATTE_INDEX] = bias[8 + MATTE_INDEX] =
+        bias[12 + MATTE_INDEX]                = 254;
+  const __m256i bias_packed = _mm256_loadu_si256((const __m256i *)bias);
+
+  for (; count >= 8; count -= 8, out += 8, dn += 8, up += 8) {
+    __m256i up_packed = _mm256_loadu_si256((const __m256i *)up);
+    __m256i dn_packed = _mm256_loadu_si256((const __m256i *)dn);
+
+    __m256i matte = _mm256_and_si256(up_packed, matteMask_packed);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(matte, zeros)) == -1) {
+      _mm256_storeu_si256((__m256i *)out, dn_packed);
+      continue;
+    }
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(matte, matteMask_packed)) ==
+        -1) {
+      _mm256_storeu_si256((__m256i *)out, up_packed);
+      continue;
+    }
+
+    __m256i upLo = _mm256_unpacklo_epi8(up_packed, zeros);
+    __m256i upHi = _mm256_unpackhi_epi8(up_packed, zeros);
+    __m256i dnLo = _mm256_unpacklo_epi8(dn_packed, zeros);
+    __m256i dnHi = _mm256_unpackhi_epi8(dn_packed, zeros);
+
+    __m256i mLo = _mm256_shufflehi_epi16(
+        _mm256_shufflelo_epi16(upLo, MATTE_SHUFFLE), MATTE_SHUFFLE);
+    __m256i mHi = _mm256_shufflehi_epi16(
+        _mm256_shufflelo_epi16(upHi, MATTE_SHUFFLE), MATTE_SHUFFLE);
+
+    __m256i xLo = _mm256_add_epi16(
+        _mm256_mullo_epi16(dnLo, _mm256_sub_epi16(maxs, mLo)), bias_packed);
+    __m256i xHi = _mm256_add_epi16(
+        _mm256_mullo_epi16(dnHi, _mm256_sub_epi16(maxs, mHi)), bias_packed);
+    xLo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(xLo, ones),
+                                             _mm256_srli_epi16(xLo, 8)),
+                            8);
+    xHi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(xHi, ones),
+                                             _mm256_srli_epi16(xHi, 8)),
+                            8);
+
+    __m256i out_packed = _mm256_packus_epi16(_mm256_add_epi16(upLo, xLo),
+                                             _mm256_add_epi16(upHi, xHi));
+
+    __m256i transp = _mm256_packs_epi16(_mm256_cmpeq_epi16(mLo, zeros),
+                                        _mm256_cmpeq_epi16(mHi, zeros));
+    out_packed     = _mm256_blendv_epi8(out_packed, dn_packed, transp);
+
+    _mm256_storeu_si256((__m256i *)out, out_packed);
+  }
+
+  overTail<TPixel32, UCHAR>(out, dn, up, count, ceilMatte);
+}
+
+//-----------------------------------------------------------------------------
+
+AVX2_TARGET void overRow_AVX2(TPixel64 *out, const TPixel64 *dn,
+                              const TPixel64 *up, int count, bool ceilMatte) {
+  const __m256i zeros    = _mm256_setzero_si256();
+  const __m256i maxs     = _mm256_set1_epi16(-1);
+  const __m256i ones32   = _mm256_set1_epi32(1);
+  const __m256i offset32 = _mm256_set1_epi32(0x8000);
+  const __m256i offset16 = _mm256_set1_epi16(-0x8000);
+
+  int bias[8] = {0};
+  if (ceilMatte) bias[MATTE_INDEX] = bias[4 + MATTE_INDEX] = 0xfffe;
+  const __m256i bias_packed = _mm256_loadu_si256((const __m256i *)bias);
+
+  for (; count >= 4; count -= 4, out += 4, dn += 4, up += 4) {
+    __m256i up_packed = _mm256_loadu_si256((const __m256i *)up);
+    __m256i dn_packed = _mm256_loadu_si256((const __m256i *)dn);
+
+    __m256i m = _mm256_shufflehi_epi16(
+        _mm256_shufflelo_epi16(up_packed, MATTE_SHUFFLE), MATTE_SHUFFLE);
+
+    __m256i transp = _mm256_cmpeq_epi16(m, zeros);
+    if (_mm256_movemask_epi8(transp) == -1) {
+      _mm256_storeu_si256((__m256i *)out, dn_packed);
+      continue;
+    }
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(m, maxs)) == -1) {
+      _mm256_storeu_si256((__m256i *)out, up_packed);
+      continue;
+    }
+
+    __m256i invM = _mm256_xor_si256(m, maxs);
+    __m256i lo   = _mm256_mullo_epi16(dn_packed, invM);
+    __m256i hi   = _mm256_mulhi_epu16(dn_packed, invM);
+
+    __m256i x0 = _mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), bias_packed);
+    __m256i x1 = _mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), bias_packed);
+
+    x0 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x0, ones32),
+                                            _mm256_srli_epi32(x0, 16)),
+                           16);
+    x1 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x1, ones32),
+                                            _mm256_srli_epi32(x1, 16)),
+                           16);
+
+    __m256i x = _mm256_xor_si256(
+        _mm256_packs_epi32(_mm256_sub_epi32(x0, offset32),
+                           _mm256_sub_epi32(x1, offset32)),
+        offset16);
+
+    __m256i out_packed = _mm256_adds_epu16(up_packed, x);
+    out_packed         = _mm256_blendv_epi8(out_packed, dn_packed, transp);
+
+    _mm256_storeu_si256((__m256i *)out, out_packed);
+  }
+
+  overTail<TPixel64, USHORT>(out, dn, up, count, ceilMatte);
+}
+
+//-----------------------------------------------------------------------------
+
+AVX2_TARGET void overRow_AVX2(TPixelF *out, const TPixelF *dn,
+                              const TPixelF *up, int count, bool ceilMatte) {
+  const __m256 zeros = _mm256_setzero_ps();
+  const __m256 ones  = _mm256_set1_ps(1.f);
+
+  for (; count >= 2; count -= 2, out += 2, dn += 2, up += 2) {
+    __m256 up_packed = _mm256_loadu_ps((const float *)up);
+    __m256 dn_packed = _mm256_loadu_ps((const float *)dn);
+    __m256 m         = _mm256_shuffle_ps(up_packed, up_packed, MATTE_SHUFFLE);
+
+    __m256 out_packed = _mm256_add_ps(
+        up_packed, _mm256_mul_ps(dn_packed, _mm256_sub_ps(ones, m)));
+
+    out_packed = _mm256_blendv_ps(out_packed, up_packed,
+                                  _mm256_cmp_ps(m, ones, _CMP_GE_OQ));
+    out_packed = _mm256_blendv_ps(dn_packed, out_packed,
+                                  _mm256_cmp_ps(m, zeros, _CMP_GT_OQ));
+
+    _mm256_storeu_ps((float *)out, out_packed);
+  }
+
+  overTail(out, dn, up, count, ceilMatte);
+}
+
+#endif  // USE_AVX2
+
+//-----------------------------------------------------------------------------
+
+//! Performs the over with the best kernel supported by the CPU. Returns false
+//! if none is available, leaving the job to the scalar code.
+template <class T>
+bool do_over_SIMD(TRasterPT<T> rout, const TRasterPT<T> &rdn,
+                  const TRasterPT<T> &rup, bool ceilMatte) {
+  void (*overRow)(T *, const T *, const T *, int, bool) = 0;
+
+  long cpuExtensions = TSystem::getCPUExtensions();
+#ifdef USE_AVX2
+  if (cpuExtensions & TSystem::CpuSupportsAvx2) overRow = overRow_AVX2;
+#endif
+  if (!overRow && (cpuExtensions & TSystem::CpuSupportsSse2))
+    overRow = overRow_SSE2;
+
+  if (!overRow) return false;
+
+  assert(rout->getSize() == rup->getSize());
+  assert(rout->getSize() == rdn->getSize());
+
+  int y, lx = rout->getLx(), ly = rout->getLy();
+  for (y = 0; y < ly; ++y)
+    overRow(rout->pixels(y), rdn->pixels(y), rup->pixels(y), lx, ceilMatte);
+
+  return true;
+}
+
+#endif  // USE_SSE2
+
+//-----------------------------------------------------------------------------
+
 #define MODO2
 #define VELOCE
 template <class T>
 void do_overT3(TRasterPT<T> rout, const TRasterPT<T> &rdn,
                const TRasterPT<T> &rup) {
+#ifdef USE_SSE2
+  if (do_over_SIMD(rout, rdn, rup, true)) return;
+#endif
+
   for (int y = 0; y < rout->getLy(); y++) {
 #ifdef MODO1
     const T *dn_pix = rdn->pixels(y);
@@ -131,6 +557,10 @@ void do_over(TRasterCM32P rout, const TRasterCM32P &rup) {
 
 template <class T, class Q>
 void do_overT2(TRasterPT<T> rout, const TRasterPT<T> &rup) {
+#ifdef USE_SSE2
+  if (do_over_SIMD(rout, rout, rup, false)) return;
+#endif
+
   UINT max    = T::maxChannelValue;
   double maxD = max;
 
@@ -160,59 +590,6 @@ void do_overT2(TRasterPT<T> rout, const TRasterPT<T> &rup) {
 
 //-----------------------------------------------------------------------------
 
-#ifdef USE_SSE2
-
-void do_over_SSE2(TRaster32P rout, const TRaster32P &rup) {
-  __m128i zeros = _mm_setzero_si128();
-  __m128i out_pix_packed_i, up_pix_packed_i;
-  __m128 out_pix_packed, up_pix_packed;
-
-  float maxChannelValue    = 255.0;
-  float maxChannelValueInv = 1.0f / maxChannelValue;
-
-  __m128 maxChanneValue_packed = _mm_load1_ps(&maxChannelValue);
-
-  assert(rout->getSize() == rup->getSize());
-  for (int y = 0; y < rout->getLy(); y++) {
-    TPixel32 *out_pix       = rout->pixels(y);
-    TPixel32 *const out_end = out_pix + rout->getLx();
-    const TPixel32 *up_pix  = rup->pixels(y);
-
-    for (; out_pix < out_end; ++out_pix, ++up_pix) {
-      if (up_pix->m == 0xff)
-        *out_pix = *up_pix;
-      else if (up_pix->m > 0) {
-        float factor         = (255.0f - up_pix->m) / 255.0f;
-        __m128 factor_packed = _mm_load1_ps(&factor);
-
-        // carica up_pix e out_pix in due registri a 128 bit
-        up_pix_packed_i =
-            _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(DWORD *)up_pix), zeros);
-        up_pix_packed =
-            _mm_cvtepi32_ps(_mm_unpacklo_epi16(up_pix_packed_i, zeros));
-
-        out_pix_packed_i =
-            _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(DWORD *)out_pix), zeros);
-        out_pix_packed =
-            _mm_cvtepi32_ps(_mm_unpacklo_epi16(out_pix_packed_i, zeros));
-
-        out_pix_packed = _mm_add_ps(up_pix_packed,
-                                    _mm_mul_ps(out_pix_packed, factor_packed));
-        out_pix_packed = _mm_min_ps(maxChanneValue_packed, out_pix_packed);
-
-        out_pix_packed_i    = _mm_cvtps_epi32(out_pix_packed);
-        out_pix_packed_i    = _mm_packs_epi32(out_pix_packed_i, zeros);
-        out_pix_packed_i    = _mm_packus_epi16(out_pix_packed_i, zeros);
-        *(DWORD *)(out_pix) = _mm_cvtsi128_si32(out_pix_packed_i);
-      }
-    }
-  }
-}
-
-#endif
-
-//-----------------------------------------------------------------------------
-
 void do_over(TRaster32P rout, const TRasterGR8P &rup) {
   assert(rout->getSize() == rup->getSize());
   for (int y = rout->getLy(); --y >= 0;) {
@@ -253,6 +630,10 @@ void do_over(TRasterGR8P rout, const TRaster32P &rup) {
 //-----------------------------------------------------------------------------
 
 void do_over(TRasterFP rout, const TRasterFP &rup) {
+#ifdef USE_SSE2
+  if (do_over_SIMD(rout, rout, rup, false)) return;
+#endif
+
   assert(rout->getSize() == rup->getSize());
   for (int y = 0; y < rout->getLy(); y++) {
     TPixelF *out_pix       = rout->pixels(y);
@@ -357,14 +738,9 @@ void TRop::over(const TRasterP &rout, const TRasterP &rup, const TPoint &pos) {
   rup->lock();
 
   // TRaster64P rout64 = rout, rin64 = rin;
-  if (rout32 && rup32) {
-#ifdef USE_SSE2
-    if (TSystem::getCPUExtensions() & TSystem::CpuSupportsSse2)
-      do_over_SSE2(rout32, rup32);
-    else
-#endif
-      do_overT2<TPixel32, UCHAR>(rout32, rup32);
-  } else if (rout64) {
+  if (rout32 && rup32)
+    do_overT2<TPixel32, UCHAR>(rout32, rup32);
+  else if (rout64) {
     if (!rup64) {
       TRaster64P raux(cRup->getSize());
       TRop::convert(raux, cRup);
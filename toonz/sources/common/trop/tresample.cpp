@@ -6,6 +6,7 @@
 
 // #include "tspecialstyleid.h"
 #include "tsystem.h"
+#include "tthread.h"
 
 #include "tcolorstyles.h"
 #include "tpixelutils.h"
@@ -22,11 +23,17 @@ using namespace TConsts;
 #define USE_SSE2
 #endif
 
-#ifdef USE_SSE2
+// The separable resample only needs SSE2 at compile time
+#if defined(USE_SSE2) || defined(__SSE2__)
+#define USE_SSE2_SEPARABLE
+#endif
+
+#ifdef USE_SSE2_SEPARABLE
 #include <emmintrin.h>  // per SSE2
 #endif
 
 #include <memory>
+#include <vector>
 
 //===========================================================================
 /*
@@ -2512,6 +2519,370 @@ TCALLOC (colval,    lu);*/
 
 //---------------------------------------------------------------------------
 
+//***************************************************************************
+//    Separable resample
+//***************************************************************************
+
+/*
+  When the affine is made of scales and translations only, the weight that
+  resample_main_rgbm() gives to a source pixel is the product of a weight
+  depending on its u and one depending on its v. The resample is then split
+  into an horizontal and a vertical pass, whose normalized weights are
+  tabulated once per output column and row.
+
+  Source rows filtered by the horizontal pass are kept in a small ring - each
+  of them is filtered once per band of output rows. Bands are shared among
+  the calling thread and a number of helper tasks.
+*/
+
+#ifdef USE_SSE2_SEPARABLE
+
+typedef __m128 Float4;
+
+inline Float4 f4zero() { return _mm_setzero_ps(); }
+
+inline Float4 f4madd(Float4 acc, Float4 val, float w) {
+  return _mm_add_ps(acc, _mm_mul_ps(val, _mm_set1_ps(w)));
+}
+
+inline Float4 f4load(const float *ptr) { return _mm_loadu_ps(ptr); }
+
+inline void f4store(float *ptr, Float4 val) { _mm_storeu_ps(ptr, val); }
+
+#else
+
+struct Float4 {
+  float v[4];
+};
+
+inline Float4 f4zero() {
+  Float4 result = {{0.f, 0.f, 0.f, 0.f}};
+  return result;
+}
+
+inline Float4 f4madd(Float4 acc, const Float4 &val, float w) {
+  for (int c = 0; c < 4; ++c) acc.v[c] += val.v[c] * w;
+  return acc;
+}
+
+inline Float4 f4load(const float *ptr) {
+  Float4 result = {{ptr[0], ptr[1], ptr[2], ptr[3]}};
+  return result;
+}
+
+inline void f4store(float *ptr, const Float4 &val) {
+  for (int c = 0; c < 4; ++c) ptr[c] = val.v[c];
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+
+//! Converts pixels to and from 4 floats, in the pixel's channels order. Stored
+//! values are clamped and rounded like in resample_main_rgbm().
+template <class T>
+struct SeparablePixel {
+  typedef typename T::Channel Channel;
+
+  static Float4 load(const T &pix) {
+    const Channel *c = reinterpret_cast<const Channel *>(&pix);
+    float val[4]     = {(float)c[0], (float)c[1], (float)c[2], (float)c[3]};
+    return f4load(val);
+  }
+
+  static void store(T &pix, Float4 val) {
+    float out[4];
+    f4store(out, val);
+
+    Channel *c = reinterpret_cast<Channel *>(&pix);
+    for (int k = 0; k < 4; ++k)
+      c[k] = std::min(troundp(std::max(out[k], 0.f)), T::maxChannelValue);
+  }
+};
+
+#ifdef USE_SSE2_SEPARABLE
+
+template <>
+struct SeparablePixel<TPixel32> {
+  static Float4 load(const TPixel32 &pix) {
+    __m128i val = _mm_cvtsi32_si128(*reinterpret_cast<const int *>(&pix));
+    val         = _mm_unpacklo_epi8(val, _mm_setzero_si128());
+    val         = _mm_unpacklo_epi16(val, _mm_setzero_si128());
+    return _mm_cvtepi32_ps(val);
+  }
+
+  static void store(TPixel32 &pix, Float4 val) {
+    val = _mm_min_ps(_mm_max_ps(val, _mm_setzero_ps()), _mm_set1_ps(255.f));
+
+    __m128i out = _mm_cvttps_epi32(_mm_add_ps(val, _mm_set1_ps(0.5f)));
+    out         = _mm_packs_epi32(out, out);
+    out         = _mm_packus_epi16(out, out);
+
+    *reinterpret_cast<int *>(&pix) = _mm_cvtsi128_si32(out);
+  }
+};
+
+template <>
+struct SeparablePixel<TPixel64> {
+  static Float4 load(const TPixel64 &pix) {
+    __m128i val = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&pix));
+    val         = _mm_unpacklo_epi16(val, _mm_setzero_si128());
+    return _mm_cvtepi32_ps(val);
+  }
+
+  static void store(TPixel64 &pix, Float4 val) {
+    val = _mm_min_ps(_mm_max_ps(val, _mm_setzero_ps()), _mm_set1_ps(65535.f));
+
+    // No unsigned 32 to 16 bits pack in SSE2 - shift to the signed range
+    __m128i out = _mm_cvttps_epi32(_mm_add_ps(val, _mm_set1_ps(0.5f)));
+    out         = _mm_sub_epi32(out, _mm_set1_epi32(0x8000));
+    out         = _mm_packs_epi32(out, out);
+    out         = _mm_xor_si128(out, _mm_set1_epi16((short)0x8000));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(&pix), out);
+  }
+};
+
+#endif
+
+template <>
+struct SeparablePixel<TPixelF> {
+  static Float4 load(const TPixelF &pix) {
+    return f4load(reinterpret_cast<const float *>(&pix));
+  }
+
+  static void store(TPixelF &pix, Float4 val) {
+    // Color channels are not clamped - see resample_main_rgbm<TPixelF>
+    f4store(reinterpret_cast<float *>(&pix), val);
+    pix.m = tcrop(pix.m, 0.f, 1.f);
+  }
+};
+
+//---------------------------------------------------------------------------
+
+//! The taps of a 1D resample pass. Output coordinate i reads the source
+//! coordinates starting at m_first[i], for m_count[i] taps weighted by
+//! m_weights[i * m_size + k]. Taps outside the source are already excluded.
+struct SeparableTaps {
+  int m_size;  //!< Maximum number of taps per output coordinate
+
+  std::vector<int> m_ref;  //!< Source coordinate under each output center
+  std::vector<int> m_first, m_count;
+  std::vector<float> m_weights;
+
+public:
+  SeparableTaps() : m_size(0) {}
+
+  const float *weights(int i) const { return &m_weights[i * m_size]; }
+
+  /*!
+Builds the taps along an axis where output center x_ maps to source coordinate
+a * x_ + b, and source displacements map to filter displacements through
+fgScale. Taps are chosen and weighted like in rop_resample_rgbm().
+*/
+  void build(int lOut, int lIn, double a, double b, double fgScale,
+             int minPixRef, int maxPixRef, int minPixRefF, int maxPixRefF,
+             const short *filter) {
+    m_size = maxPixRef - minPixRef + 1;
+
+    m_ref.resize(lOut);
+    m_first.resize(lOut);
+    m_count.resize(lOut);
+    m_weights.assign(lOut * m_size, 0.f);
+
+    // Filter displacement of each tap, from the integer part of the pre-image
+    std::vector<int> pixRefF(m_size);
+    for (int k = 0; k < m_size; ++k)
+      pixRefF[k] = tround(fgScale * (minPixRef + k));
+
+    std::vector<float> w(m_size);
+
+    double x_ = 0.5;
+    for (int x = 0; x < lOut; ++x, x_ += 1.0) {
+      double u_   = a * x_ + b;
+      int ref     = intLE(u_);
+      int refOutF = tround(fgScale * (ref - u_));
+      float sumW  = 0.f;
+
+      for (int k = 0; k < m_size; ++k) {
+        int f = pixRefF[k];
+        w[k]  = (minPixRefF <= f && f <= maxPixRefF) ? filter[f + refOutF] : 0;
+        sumW += w[k];
+      }
+
+      // Taps outside the source are 0-padding - they still count in the
+      // normalization
+      int kBegin = std::max(-(ref + minPixRef), 0);
+      int kEnd   = std::min(lIn - (ref + minPixRef), m_size);
+
+      m_ref[x]   = ref;
+      m_first[x] = ref + minPixRef + kBegin;
+      m_count[x] = std::max(kEnd - kBegin, 0);
+
+      float *out = &m_weights[x * m_size];
+      if (sumW != 0.f)
+        for (int k = kBegin; k < kEnd; ++k) *out++ = w[k] / sumW;
+    }
+  }
+};
+
+//---------------------------------------------------------------------------
+
+// Output rasters are split into bands of no less than this many rows
+const int minSeparableBandRows = 16;
+
+// Smaller outputs are resampled by the calling thread alone
+const int minSeparableParallelPixels = 1 << 16;
+
+//! A separable resample, whose bands of output rows can be processed in
+//! parallel.
+template <class T>
+class SeparableResample {
+public:
+  const T *m_in;
+  T *m_out;
+  int m_lu, m_lv, m_wrapIn;
+  int m_lx, m_ly, m_wrapOut;
+
+  SeparableTaps m_tapsX, m_tapsY;
+
+  //! Source pixels whose filter mask is uniform are copied - as in
+  //! resample_main_rgbm()
+  UCHAR *m_calc;
+  int m_calcBytewrap;
+
+public:
+  SeparableResample() : m_calc(0), m_calcBytewrap(0) {}
+  ~SeparableResample() { delete[] m_calc; }
+
+private:
+  bool mustCalc(int u, int v) const {
+    if ((UINT)u >= (UINT)m_lu || (UINT)v >= (UINT)m_lv) return true;
+
+    UCHAR calcValue = m_calc[(u >> 3) + v * m_calcBytewrap];
+    return calcValue && ((calcValue >> (u & 7)) & 1);
+  }
+
+  //! Applies the horizontal pass to source row v.
+  void filterRow(int v, float *out) const {
+    const T *rowIn = m_in + v * m_wrapIn;
+
+    for (int x = 0; x < m_lx; ++x, out += 4) {
+      const T *pix   = rowIn + m_tapsX.m_first[x];
+      const float *w = m_tapsX.weights(x);
+      Float4 acc     = f4zero();
+      int k, count   = m_tapsX.m_count[x];
+
+      for (k = 0; k < count; ++k)
+        acc = f4madd(acc, SeparablePixel<T>::load(pix[k]), w[k]);
+
+      f4store(out, acc);
+    }
+  }
+
+public:
+  //! Resamples output rows [y0, y1).
+  void resampleRows(int y0, int y1) const {
+    // Ring of horizontally filtered source rows, indexed by v % ringSize
+    int ringSize = m_tapsY.m_size;
+
+    std::vector<float> ring(ringSize * m_lx * 4);
+    std::vector<int> ringRows(ringSize, -1);
+    std::vector<const float *> rows(ringSize);
+
+    for (int y = y0; y < y1; ++y) {
+      T *rowOut       = m_out + y * m_wrapOut;
+      int first       = m_tapsY.m_first[y];
+      int count       = m_tapsY.m_count[y];
+      const float *wy = m_tapsY.weights(y);
+
+      for (int k = 0; k < count; ++k) {
+        int v = first + k, slot = v % ringSize;
+        float *row = &ring[slot * m_lx * 4];
+
+        if (ringRows[slot] != v) {
+          filterRow(v, row);
+          ringRows[slot] = v;
+        }
+
+        rows[k] = row;
+      }
+
+      int refV = m_tapsY.m_ref[y];
+
+      for (int x = 0; x < m_lx; ++x) {
+        int refU = m_tapsX.m_ref[x];
+        if (!mustCalc(refU, refV)) {
+          rowOut[x] = m_in[refU + refV * m_wrapIn];
+          continue;
+        }
+
+        Float4 acc = f4zero();
+        for (int k = 0; k < count; ++k)
+          acc = f4madd(acc, f4load(rows[k] + 4 * x), wy[k]);
+
+        SeparablePixel<T>::store(rowOut[x], acc);
+      }
+    }
+  }
+};
+
+//---------------------------------------------------------------------------
+
+//! Resamples through an affine with no rotation or shear component. The
+//! parameters are the ones of resample_main_rgbm(), plus the fg bounds of
+//! the filter taps.
+template <class T>
+void resample_main_rgbm_separable(TRasterPT<T> rout, const TRasterPT<T> &rin,
+                                  const TAffine &aff_xy2uv,
+                                  const TAffine &aff0_uv2fg, int min_pix_ref_u,
+                                  int min_pix_ref_v, int max_pix_ref_u,
+                                  int max_pix_ref_v, int min_pix_ref_f,
+                                  int min_pix_ref_g, int max_pix_ref_f,
+                                  int max_pix_ref_g, short *filter) {
+  assert(aff_xy2uv.a12 == 0.0 && aff_xy2uv.a21 == 0.0);
+
+  if (!(rout->getLx() > 0 && rout->getLy() > 0)) return;
+
+  if (!(rin->getLx() > 0 && rin->getLy() > 0)) {
+    rout->clear();
+    return;
+  }
+
+  SeparableResample<T> resample;
+
+  resample.m_in      = rin->pixels();
+  resample.m_out     = rout->pixels();
+  resample.m_lu      = rin->getLx();
+  resample.m_lv      = rin->getLy();
+  resample.m_wrapIn  = rin->getWrap();
+  resample.m_lx      = rout->getLx();
+  resample.m_ly      = rout->getLy();
+  resample.m_wrapOut = rout->getWrap();
+
+  resample.m_tapsX.build(resample.m_lx, resample.m_lu, aff_xy2uv.a11,
+                         aff_xy2uv.a13, aff0_uv2fg.a11, min_pix_ref_u,
+                         max_pix_ref_u, min_pix_ref_f, max_pix_ref_f, filter);
+  resample.m_tapsY.build(resample.m_ly, resample.m_lv, aff_xy2uv.a22,
+                         aff_xy2uv.a23, aff0_uv2fg.a22, min_pix_ref_v,
+                         max_pix_ref_v, min_pix_ref_g, max_pix_ref_g, filter);
+
+  int calcAllocsize = 0;
+  create_calc(rin, min_pix_ref_u, max_pix_ref_u, min_pix_ref_v, max_pix_ref_v,
+              resample.m_calc, calcAllocsize, resample.m_calcBytewrap);
+
+  int bandsCount = 1;
+  if ((double)resample.m_lx * resample.m_ly >= minSeparableParallelPixels)
+    bandsCount = tcrop(resample.m_ly / minSeparableBandRows, 1,
+                       2 * TSystem::getProcessorCount());
+
+  TThread::parallelForBands(resample.m_ly, bandsCount,
+                            [&resample](int y0, int y1) {
+                              resample.resampleRows(y0, y1);
+                            });
+}
+
+//---------------------------------------------------------------------------
+
 // #define USE_STATIC_VARS
 
 //---------------------------------------------------------------------------
@@ -2821,6 +3192,15 @@ void rop_resample_rgbm(TRasterPT<T> rout, const TRasterPT<T> &rin,
     }
   }
 
+  // Without rotations and shears, the filter is separable
+  if (aff_uv2xy.a12 == 0.0 && aff_uv2xy.a21 == 0.0) {
+    resample_main_rgbm_separable<T>(
+        rout, rin, aff_xy2uv, aff0_uv2fg, min_pix_ref_u, min_pix_ref_v,
+        max_pix_ref_u, max_pix_ref_v, min_pix_ref_f, min_pix_ref_g,
+        max_pix_ref_f, max_pix_ref_g, filter);
+    return;
+  }
+
 #ifdef USE_SSE2
   if ((TSystem::getCPUExtensions() & TSystem::CpuSupportsSse2) &&
       T::maxChannelValue == 255)
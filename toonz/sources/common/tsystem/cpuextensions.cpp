@@ -6,13 +6,45 @@
 #include <winnt.h>
 #include <emmintrin.h>
 #endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
 
 using namespace TSystem;
 
 #ifdef x64
+namespace {
+
+long CPUCheckForAvx2Support() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return TSystem::CPUExtensionsNone;
+
+  // AVX registers must be enabled by the OS too
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    return TSystem::CPUExtensionsNone;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) ? TSystem::CpuSupportsAvx2
+                              : TSystem::CPUExtensionsNone;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  return __builtin_cpu_supports("avx2") ? TSystem::CpuSupportsAvx2
+                                        : TSystem::CPUExtensionsNone;
+#else
+  return TSystem::CPUExtensionsNone;
+#endif
+}
+
+}  // namespace
+
 long TSystem::getCPUExtensions() {
-  return TSystem::CpuSupportsSse |
-         TSystem::CpuSupportsSse2;  // TSystem::CPUExtensionsNone
+  static const long avx2 = CPUCheckForAvx2Support();
+
+  return TSystem::CpuSupportsSse | TSystem::CpuSupportsSse2 | avx2;
 }
 
 #else
@@ -136,6 +136,8 @@ public:
   }
 };
 
+class IntersectionPointIndex;
+
 class IntersectionData {
 public:
   UINT maxAutocloseId;
@@ -143,7 +145,10 @@ public:
   map<int, VIStroke *> m_autocloseMap;
   vector<IntersectedStrokeEdges> m_intersectedStrokeArray;
 
-  IntersectionData() : maxAutocloseId(1), m_intList() {}
+  //! Index of m_intList by position - available during findIntersections()
+  IntersectionPointIndex *m_pointIndex;
+
+  IntersectionData() : maxAutocloseId(1), m_intList(), m_pointIndex(0) {}
 
   ~IntersectionData();
 };
@@ -190,6 +195,153 @@ public:
   };
 };
 
+//-----------------------------------------------------------------------------
+
+//! Buckets the intersections of a list by position, so that the one at a
+//! given point can be found without scanning the whole list.
+class IntersectionPointIndex {
+  struct Entry {
+    Intersection *m_intersection;
+    UINT m_order;  //!< Position in the list
+  };
+
+  std::map<std::pair<int, int>, std::vector<Entry>> m_cells;
+  UINT m_count;
+
+  static const double cellSize;
+
+public:
+  IntersectionPointIndex(const VIList<Intersection> &intList) : m_count(0) {
+    for (Intersection *p = intList.first(); p; p = p->next()) add(p);
+  }
+
+  //! Adds an intersection appended to the list.
+  void add(Intersection *p) {
+    Entry entry = {p, m_count++};
+    m_cells[std::make_pair(tfloor(p->m_intersection.x / cellSize),
+                           tfloor(p->m_intersection.y / cellSize))]
+        .push_back(entry);
+  }
+
+  //! Returns the first intersection in the list at the specified point - or
+  //! nearer than the specified tolerance, if positive.
+  Intersection *find(const TPointD &point, double tolerance) const {
+    int x0 = tfloor((point.x - tolerance) / cellSize),
+        x1 = tfloor((point.x + tolerance) / cellSize),
+        y0 = tfloor((point.y - tolerance) / cellSize),
+        y1 = tfloor((point.y + tolerance) / cellSize);
+
+    const Entry *found = 0;
+
+    for (int y = y0; y <= y1; ++y)
+      for (int x = x0; x <= x1; ++x) {
+        std::map<std::pair<int, int>, std::vector<Entry>>::const_iterator it =
+            m_cells.find(std::make_pair(x, y));
+        if (it == m_cells.end()) continue;
+
+        std::vector<Entry>::const_iterator et, eEnd = it->second.end();
+        for (et = it->second.begin(); et != eEnd; ++et)
+          if ((!found || et->m_order < found->m_order) &&
+              (et->m_intersection->m_intersection == point ||
+               (tolerance > 0.0 &&
+                areAlmostEqual(et->m_intersection->m_intersection, point,
+                               tolerance))))
+            found = &*et;
+      }
+
+    return found ? found->m_intersection : 0;
+  }
+};
+
+const double IntersectionPointIndex::cellSize = 1.0;
+
+//-----------------------------------------------------------------------------
+
+//! Uniform grid over the bounding boxes of a set of strokes, used to find the
+//! strokes that may intersect a given one without testing all of them.
+class StrokeBBoxGrid {
+  TRectD m_bounds;
+  double m_cellSize;
+  int m_lx, m_ly;
+  std::vector<std::vector<int>> m_cells;
+
+public:
+  //! Builds the grid over the specified boxes. Empty boxes are not inserted.
+  StrokeBBoxGrid(const std::vector<TRectD> &bboxes);
+
+  //! Returns the sorted indices of the boxes that may overlap the specified
+  //! one - the caller is responsible for testing them.
+  void query(const TRectD &bbox, std::vector<int> &indices) const;
+
+private:
+  void getCells(const TRectD &bbox, int &x0, int &y0, int &x1, int &y1) const {
+    x0 = tcrop((int)((bbox.x0 - m_bounds.x0) / m_cellSize), 0, m_lx - 1);
+    y0 = tcrop((int)((bbox.y0 - m_bounds.y0) / m_cellSize), 0, m_ly - 1);
+    x1 = tcrop((int)((bbox.x1 - m_bounds.x0) / m_cellSize), 0, m_lx - 1);
+    y1 = tcrop((int)((bbox.y1 - m_bounds.y0) / m_cellSize), 0, m_ly - 1);
+  }
+};
+
+//-----------------------------------------------------------------------------
+
+StrokeBBoxGrid::StrokeBBoxGrid(const std::vector<TRectD> &bboxes)
+    : m_cellSize(1.0), m_lx(1), m_ly(1) {
+  int i, count = (int)bboxes.size(), inserted = 0;
+  double sizesSum = 0.0;
+
+  for (i = 0; i < count; ++i) {
+    if (bboxes[i].isEmpty()) continue;
+
+    m_bounds += bboxes[i];
+    sizesSum += std::max(bboxes[i].getLx(), bboxes[i].getLy());
+    ++inserted;
+  }
+
+  if (inserted == 0) return;
+
+  // Cells as large as the average box, but no more than 4 per box
+  m_cellSize = std::max(sizesSum / inserted, 1e-3);
+
+  double minCellSize =
+      sqrt(m_bounds.getLx() * m_bounds.getLy() / (4.0 * inserted));
+  m_cellSize = std::max(m_cellSize, minCellSize);
+
+  m_lx = (int)(m_bounds.getLx() / m_cellSize) + 1;
+  m_ly = (int)(m_bounds.getLy() / m_cellSize) + 1;
+
+  m_cells.resize(m_lx * m_ly);
+
+  for (i = 0; i < count; ++i) {
+    if (bboxes[i].isEmpty()) continue;
+
+    int x, y, x0, y0, x1, y1;
+    getCells(bboxes[i], x0, y0, x1, y1);
+
+    for (y = y0; y <= y1; ++y)
+      for (x = x0; x <= x1; ++x) m_cells[y * m_lx + x].push_back(i);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void StrokeBBoxGrid::query(const TRectD &bbox,
+                           std::vector<int> &indices) const {
+  indices.clear();
+  if (m_cells.empty() || !bbox.overlaps(m_bounds)) return;
+
+  int x, y, x0, y0, x1, y1;
+  getCells(bbox, x0, y0, x1, y1);
+
+  for (y = y0; y <= y1; ++y)
+    for (x = x0; x <= x1; ++x) {
+      const std::vector<int> &cell = m_cells[y * m_lx + x];
+      indices.insert(indices.end(), cell.begin(), cell.end());
+    }
+
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+}
+
 //=============================================================================
 
 template <class T>
@@ -2200,23 +2352,28 @@ void addIntersection(IntersectionData &intData, const vector<VIStroke *> &s,
 
   point = s[ii]->m_s->getPoint(intersection.first);
 
-  for (p = intData.m_intList.first(); p; p = p->next())
-    if (p->m_intersection == point ||
-        (isVectorized &&
-         areAlmostEqual(
-             p->m_intersection, point,
-             1e-2)))  // devono essere rigorosamente uguali, altrimenti
-    // il calcolo dell'ordine dei rami con le tangenti sballa
-    {
-      addBranches(intData, *p, s, ii, jj, intersection, strokeSize);
-      return;
-    }
+  // devono essere rigorosamente uguali, altrimenti
+  // il calcolo dell'ordine dei rami con le tangenti sballa
+  if (intData.m_pointIndex)
+    p = intData.m_pointIndex->find(point, isVectorized ? 1e-2 : 0.0);
+  else
+    for (p = intData.m_intList.first(); p; p = p->next())
+      if (p->m_intersection == point ||
+          (isVectorized && areAlmostEqual(p->m_intersection, point, 1e-2)))
+        break;
+
+  if (p) {
+    addBranches(intData, *p, s, ii, jj, intersection, strokeSize);
+    return;
+  }
 
   intData.m_intList.pushBack(new Intersection);
 
   if (!makeIntersection(intData, s, ii, jj, intersection, strokeSize,
                         *intData.m_intList.last()))
     intData.m_intList.erase(intData.m_intList.last());
+  else if (intData.m_pointIndex)
+    intData.m_pointIndex->add(intData.m_intList.last());
 }
 
 //-----------------------------------------------------------------------------
@@ -2229,6 +2386,10 @@ void TVectorImage::Imp::findIntersections() {
   bool isVectorized = (m_autocloseTolerance < 0);
 
   assert(intData.m_intersectedStrokeArray.empty());
+
+  IntersectionPointIndex pointIndex(intData.m_intList);
+  intData.m_pointIndex = &pointIndex;
+
 #define AUTOCLOSE_ATTIVO
 #ifdef AUTOCLOSE_ATTIVO
   intData.maxAutocloseId++;
@@ -2264,48 +2425,77 @@ void TVectorImage::Imp::findIntersections() {
   }
 #endif
 
+  // Both the intersections and the autoclose links are looked for only
+  // between pairs of strokes whose boxes, enlarged by the autoclose distance,
+  // overlap. Find them through a grid, rather than testing all pairs - at
+  // least one stroke in a pair must be new.
+  vector<TRectD> bboxes(strokeSize);
+  vector<double> enlarges(strokeSize);
+
+  for (i = 0; i < strokeSize; i++) {
+    if (strokeArray[i]->m_isPoint) continue;
+
+    TStroke *s1 = strokeArray[i]->m_s;
+    enlarges[i] = (m_autocloseTolerance + 0.7) *
+                  (s1->getMaxThickness() > 0 ? s1->getMaxThickness() : 2.5);
+    bboxes[i] = s1->getBBox().enlarge(std::max(enlarges[i], 0.0));
+  }
+
+  StrokeBBoxGrid grid(bboxes);
+
+  vector<pair<int, int>> pairs;
+  vector<int> neighbours;
+
+  for (i = 0; i < strokeSize; i++) {
+    if (strokeArray[i]->m_isPoint || !strokeArray[i]->m_isNewForFill) continue;
+
+    grid.query(bboxes[i], neighbours);
+
+    for (UINT n = 0; n < neighbours.size(); n++) {
+      j = neighbours[n];
+      if (!strokeArray[j]->m_isPoint &&
+          strokeArray[i]->m_groupId == strokeArray[j]->m_groupId)
+        pairs.push_back(std::make_pair(std::min(i, j), std::max(i, j)));
+    }
+  }
+
+  // Pairs are visited in the same order as a full scan would
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
   // poi,  intersezioni tra stroke, in cui almeno uno dei due deve essere nuovo
 
   map<pair<int, int>, vector<DoublePair>> intersectionMap;
 
-  for (i = 0; i < strokeSize; i++) {
+  vector<pair<int, int>>::iterator pt, pEnd = pairs.end();
+  for (pt = pairs.begin(); pt != pEnd; ++pt) {
+    i = pt->first, j = pt->second;
     TStroke *s1 = strokeArray[i]->m_s;
-    if (strokeArray[i]->m_isPoint) continue;
-    for (j = i; j < strokeSize /*&& (strokeArray[i]->getBBox().x1>=
-                                  strokeArray[j]->getBBox().x0)*/
-         ;
-         j++) {
-      TStroke *s2 = strokeArray[j]->m_s;
+    TStroke *s2 = strokeArray[j]->m_s;
 
-      if (strokeArray[j]->m_isPoint ||
-          !(strokeArray[i]->m_isNewForFill || strokeArray[j]->m_isNewForFill))
-        continue;
-      if (strokeArray[i]->m_groupId != strokeArray[j]->m_groupId) continue;
+    vector<DoublePair> parIntersections;
+    if (s1->getBBox().overlaps(s2->getBBox())) {
+      UINT size = intData.m_intList.size();
 
-      vector<DoublePair> parIntersections;
-      if (s1->getBBox().overlaps(s2->getBBox())) {
-        UINT size = intData.m_intList.size();
-
-        if (intersect(s1, s2, parIntersections, false)) {
-          // if (i==0 && j==1) parIntersections.erase(parIntersections.begin());
-          intersectionMap[pair<int, int>(i, j)] = parIntersections;
-          addIntersections(intData, strokeArray, i, j, parIntersections,
-                           strokeSize, isVectorized);
-        } else
-          intersectionMap[pair<int, int>(i, j)] = vector<DoublePair>();
+      if (intersect(s1, s2, parIntersections, false)) {
+        // if (i==0 && j==1) parIntersections.erase(parIntersections.begin());
+        intersectionMap[pair<int, int>(i, j)] = parIntersections;
+        addIntersections(intData, strokeArray, i, j, parIntersections,
+                         strokeSize, isVectorized);
+      } else
+        intersectionMap[pair<int, int>(i, j)] = vector<DoublePair>();
 
-        if (!strokeArray[i]->m_isNewForFill &&
-            size != intData.m_intList.size() &&
-            !strokeArray[i]->m_edgeList.empty())  // aggiunte nuove intersezioni
-        {
-          intData.m_intersectedStrokeArray.push_back(IntersectedStrokeEdges(i));
-          list<TEdge *> &_list =
-              intData.m_intersectedStrokeArray.back().m_edgeList;
-          list<TEdge *>::const_iterator it;
-          for (it = strokeArray[i]->m_edgeList.begin();
-               it != strokeArray[i]->m_edgeList.end(); ++it)
-            _list.push_back(new TEdge(**it, false));
-        }
+      if (!strokeArray[i]->m_isNewForFill &&
+          size != intData.m_intList.size() &&
+          !strokeArray[i]->m_edgeList.empty())  // aggiunte nuove intersezioni
+      {
+        intData.m_intersectedStrokeArray.push_back(IntersectedStrokeEdges(i));
+        list<TEdge *> &_list =
+            intData.m_intersectedStrokeArray.back().m_edgeList;
+        list<TEdge *>::const_iterator it;
+        for (it = strokeArray[i]->m_edgeList.begin();
+             it != strokeArray[i]->m_edgeList.end(); ++it)
+          _list.push_back(new TEdge(**it, false));
       }
     }
   }
@@ -2313,26 +2503,17 @@ void TVectorImage::Imp::findIntersections() {
 #ifdef AUTOCLOSE_ATTIVO
   TL2LAutocloser l2lautocloser;
 
+  pt = pairs.begin();
   for (i = 0; i < strokeSize; i++) {
     TStroke *s1 = strokeArray[i]->m_s;
     if (strokeArray[i]->m_isPoint) continue;
-    for (j = i; j < strokeSize; j++) {
-      if (strokeArray[i]->m_groupId != strokeArray[j]->m_groupId) continue;
+    for (; pt != pEnd && pt->first == i; ++pt) {
+      j = pt->second;
 
       TStroke *s2 = strokeArray[j]->m_s;
-      if (strokeArray[j]->m_isPoint) continue;
-      if (!(strokeArray[i]->m_isNewForFill || strokeArray[j]->m_isNewForFill))
-        continue;
-
-      double enlarge1 =
-          (m_autocloseTolerance + 0.7) *
-          (s1->getMaxThickness() > 0 ? s1->getMaxThickness() : 2.5);
-      double enlarge2 =
-          (m_autocloseTolerance + 0.7) *
-          (s2->getMaxThickness() > 0 ? s2->getMaxThickness() : 2.5);
 
-      if (s1->getBBox().enlarge(enlarge1).overlaps(
-              s2->getBBox().enlarge(enlarge2))) {
+      if (s1->getBBox().enlarge(enlarges[i]).overlaps(
+              s2->getBBox().enlarge(enlarges[j]))) {
         map<pair<int, int>, vector<DoublePair>>::iterator it =
             intersectionMap.find(pair<int, int>(i, j));
         if (it == intersectionMap.end())
@@ -2372,8 +2553,12 @@ void TVectorImage::Imp::findIntersections() {
         addIntersections(intData, strokeArray, i, j, parIntersections,
                          strokeSize, isVectorized);
     }
-    for (j = 0; j < strokeSize; ++j)  // intersezione segmento-curva
+
+    grid.query(s1->getBBox(), neighbours);
+
+    for (UINT n = 0; n < neighbours.size(); ++n)  // intersezione segmento-curva
     {
+      j = neighbours[n];
       if (strokeArray[j]->m_isPoint) continue;
       if (strokeArray[i]->m_groupId != strokeArray[j]->m_groupId) continue;
 
@@ -2384,6 +2569,8 @@ void TVectorImage::Imp::findIntersections() {
                          strokeSize, isVectorized);
     }
   }
+
+  intData.m_pointIndex = 0;
 }
 
 // la struttura delle intersezioni viene poi visitata per trovare
@@ -3025,9 +3212,11 @@ TRegion *TVectorImage::findRegion(const TRegion &region) const {
 //------------------------------------------------------------
 
 void TVectorImage::Imp::addRegion(TRegion *region) {
+  TGroupId groupId = getGroupId(region, m_strokes);
+
   for (std::vector<TRegion *>::iterator it = m_regions.begin();
        it != m_regions.end(); ++it) {
-    if (getGroupId(region, m_strokes) != getGroupId(*it, m_strokes)) continue;
+    if (groupId != getGroupId(*it, m_strokes)) continue;
 
     if (region->contains(**it)) {
       // region->addSubregion(*it);
@@ -26,13 +26,10 @@ TRegionProp::TRegionProp(const TRegion *region)
 //-------------------------------------------------------------------
 
 //===================================================================
-namespace {
 
-//-------------------------------------------------------------------
-
-bool computeOutline(const TRegion *region,
-                    TRegionOutline::PointVector &polyline,
-                    const double pixelSize) {
+bool OutlineRegionProp::computeOutline(const TRegion *region,
+                                       TRegionOutline::PointVector &polyline,
+                                       const double pixelSize) {
   bool doAntialiasing = false;
   polyline.clear();
 
@@ -116,10 +113,6 @@ bool computeOutline(const TRegion *region,
 */
 //-------------------------------------------------------------------
 
-//-------------------------------------------------------------------
-}  // end namaspace
-//-------------------------------------------------------------------
-
 //-------------------------------------------------------------------
 
 void OutlineRegionProp::computeRegionOutline() {
@@ -0,0 +1,514 @@
+// TnzCore includes
+#include "tvectorimage.h"
+#include "tvectorrenderdata.h"
+#include "tregion.h"
+#include "tregionprop.h"
+#include "tstroke.h"
+#include "tstrokeoutline.h"
+#include "tpalette.h"
+#include "tsimplecolorstyles.h"
+#include "tcolorfunctions.h"
+#include "tthreadmessage.h"
+
+// Qt includes
+#include <QMutexLocker>
+
+// STD includes
+#include <vector>
+#include <cmath>
+#include <typeinfo>
+
+#include "tvectorrasterizer.h"
+
+//***************************************************************************************
+//    Local namespace
+//***************************************************************************************
+
+namespace {
+
+/*!
+  Accumulates the area covered by a set of closed polygons over a rect of
+  pixels.
+
+  Each polygon edge deposits, in the cells of the rows it crosses, the signed
+  area it encloses to its right - so that the running sum of a row gives, at
+  each pixel, the winding-weighted coverage of the pixel. Edges must form
+  closed polygons, but can be added in any order.
+*/
+
+class CoverageAccumulator {
+  TRect m_rect;  //!< Accumulated pixels, in raster coordinates
+  int m_wrap;    //!< Accumulator cells per row - 2 more than pixels
+  std::vector<float> &m_cells;
+
+public:
+  //! The specified buffer is reused among accumulators; cells must be 0.
+  CoverageAccumulator(const TRect &rect, std::vector<float> &buffer)
+      : m_rect(rect), m_wrap(rect.getLx() + 2), m_cells(buffer) {
+    size_t size = m_wrap * rect.getLy();
+    if (m_cells.size() < size) m_cells.resize(size, 0.0f);
+  }
+
+  const TRect &getRect() const { return m_rect; }
+
+  void addEdge(const TPointD &p0, const TPointD &p1);
+
+  void addTriangle(TPointD a, TPointD b, TPointD c) {
+    double area = cross(b - a, c - a);
+    if (area == 0.0) return;
+
+    if (area < 0.0) std::swap(b, c);
+    addEdge(a, b), addEdge(b, c), addEdge(c, a);
+  }
+
+  /*!
+Calls the specified functor with the coverage of each covered pixel, then
+clears the accumulator. Coverage is taken with the specified sign, and either
+analytic or thresholded at half pixel.
+*/
+  template <typename Func>
+  void flush(double sign, bool antialiasing, Func &func);
+
+private:
+  void addClippedEdge(double x0, double y0, double x1, double y1);
+};
+
+//-----------------------------------------------------------------------------
+
+void CoverageAccumulator::addEdge(const TPointD &p0, const TPointD &p1) {
+  // Work relative to the accumulated rect
+  double ox = m_rect.x0, oy = m_rect.y0;
+  double lx = m_rect.getLx();
+
+  double x0 = p0.x - ox, y0 = p0.y - oy, x1 = p1.x - ox, y1 = p1.y - oy;
+
+  // Parts of the edge outside the rect horizontally only matter for their
+  // winding: they are split and flattened on the rect sides
+  double xs[2];
+  int s, sCount = 0;
+  if ((x0 < 0.0) != (x1 < 0.0)) xs[sCount++] = 0.0;
+  if ((x0 < lx) != (x1 < lx)) xs[sCount++] = lx;
+  if (sCount == 2 && (x0 > x1)) std::swap(xs[0], xs[1]);
+
+  for (s = 0; s < sCount; ++s) {
+    double ys = y0 + (y1 - y0) * (xs[s] - x0) / (x1 - x0);
+    addClippedEdge(x0, y0, xs[s], ys);
+    x0 = xs[s], y0 = ys;
+  }
+
+  addClippedEdge(x0, y0, x1, y1);
+}
+
+//-----------------------------------------------------------------------------
+
+void CoverageAccumulator::addClippedEdge(double x0, double y0, double x1,
+                                         double y1) {
+  if (y0 == y1) return;
+
+  double lx = m_rect.getLx(), ly = m_rect.getLy();
+
+  x0 = tcrop(x0, 0.0, lx), x1 = tcrop(x1, 0.0, lx);
+
+  // Edges are accumulated upwards. Counterclockwise polygons get positive
+  // coverage.
+  float dir = -1.0f;
+  if (y0 > y1) std::swap(x0, x1), std::swap(y0, y1), dir = 1.0f;
+
+  if (y1 <= 0.0 || y0 >= ly) return;
+
+  double dxdy = (x1 - x0) / (y1 - y0);
+
+  double x = x0;
+  if (y0 < 0.0) x -= y0 * dxdy, y0 = 0.0;
+  if (y1 > ly) y1 = ly;
+
+  int y, yEnd = (int)std::ceil(y1);
+  for (y = (int)y0; y < yEnd; ++y) {
+    float *row = &m_cells[y * m_wrap];
+
+    double dy = std::min(y + 1.0, y1) - std::max((double)y, y0);
+    double xNext = x + dxdy * dy;
+    float d      = (float)dy * dir;
+
+    double xa = std::min(x, xNext), xb = std::max(x, xNext);
+
+    double xaFloor = std::floor(xa), xbCeil = std::ceil(xb);
+    int xai = (int)xaFloor, xbi = (int)xbCeil;
+
+    if (xbi <= xai + 1) {
+      // The edge is inside a single pixel column
+      float xm = (float)(0.5 * (x + xNext) - xaFloor);
+      row[xai] += d - d * xm;
+      row[xai + 1] += d * xm;
+    } else {
+      float invDx = (float)(1.0 / (xb - xa));
+      float xaf   = (float)(xa - xaFloor);
+      float xbf   = (float)(xb - xbCeil + 1.0);
+      float a0 = 0.5f * invDx * (1.0f - xaf) * (1.0f - xaf);
+      float am = 0.5f * invDx * xbf * xbf;
+
+      row[xai] += d * a0;
+
+      if (xbi == xai + 2)
+        row[xai + 1] += d * (1.0f - a0 - am);
+      else {
+        float a1 = invDx * (1.5f - xaf);
+        row[xai + 1] += d * (a1 - a0);
+
+        int xi;
+        for (xi = xai + 2; xi < xbi - 1; ++xi) row[xi] += d * invDx;
+
+        float a2 = a1 + (xbi - xai - 3) * invDx;
+        row[xbi - 1] += d * (1.0f - a2 - am);
+      }
+
+      row[xbi] += d * am;
+    }
+
+    x = xNext;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename Func>
+void CoverageAccumulator::flush(double sign, bool antialiasing, Func &func) {
+  int lx = m_rect.getLx(), ly = m_rect.getLy();
+
+  int x, y;
+  for (y = 0; y < ly; ++y) {
+    float *row = &m_cells[y * m_wrap];
+
+    float acc = 0.0f;
+    for (x = 0; x < lx; ++x) {
+      acc += row[x], row[x] = 0.0f;
+
+      double coverage = tcrop(sign * acc, 0.0, 1.0);
+      if (!antialiasing) coverage = (coverage >= 0.5) ? 1.0 : 0.0;
+
+      if (coverage > 1e-4) func(m_rect.x0 + x, m_rect.y0 + y, coverage);
+    }
+
+    row[lx] = row[lx + 1] = 0.0f;
+  }
+}
+
+//=============================================================================
+
+//! Composites coverage with a color over a raster, the way TOfflineGL blends
+//! antialiased primitives in alpha channel mode.
+template <typename PIXEL>
+class OverBlender {
+  TRasterPT<PIXEL> m_ras;
+  double m_r, m_g, m_b, m_m;
+
+public:
+  OverBlender(const TRasterPT<PIXEL> &ras, const TPixel32 &color)
+      : m_ras(ras) {
+    const double scale = PIXEL::maxChannelValue / 255.0;
+
+    m_r = color.r * scale, m_g = color.g * scale, m_b = color.b * scale;
+    m_m = color.m / 255.0;
+  }
+
+  void operator()(int x, int y, double coverage) {
+    typedef typename PIXEL::Channel Channel;
+
+    PIXEL &pix = m_ras->pixels(y)[x];
+
+    double a = m_m * coverage, ia = 1.0 - a;
+
+    pix.r = (Channel)(m_r * a + pix.r * ia + 0.5);
+    pix.g = (Channel)(m_g * a + pix.g * ia + 0.5);
+    pix.b = (Channel)(m_b * a + pix.b * ia + 0.5);
+    pix.m = (Channel)(PIXEL::maxChannelValue * a + pix.m * ia + 0.5);
+  }
+};
+
+//=============================================================================
+
+//! Returns the specified style as a plain solid color style, or 0 if it draws
+//! in any other way.
+const TSolidColorStyle *solidStyle(const TColorStyle *style) {
+  // Classes derived from TSolidColorStyle draw differently
+  if (!style || typeid(*style) != typeid(TSolidColorStyle)) return 0;
+
+  const TSolidColorStyle *solid = static_cast<const TSolidColorStyle *>(style);
+  if (solid->getRegionOutlineModifier()) return 0;
+
+  return solid;
+}
+
+//-----------------------------------------------------------------------------
+
+bool isOThick(const TStroke *s) {
+  int i;
+  for (i = 0; i < s->getControlPointCount(); i++)
+    if (s->getControlPoint(i).thick != 0) return false;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool canRasterizeRegion(const TRegion *r, const TPalette *palette) {
+  if (r->getStyle() && !solidStyle(palette->getStyle(r->getStyle())))
+    return false;
+
+  UINT i, count = r->getSubregionCount();
+  for (i = 0; i < count; ++i)
+    if (!canRasterizeRegion(r->getSubregion(i), palette)) return false;
+
+  return true;
+}
+
+//***************************************************************************************
+//    Rasterizer definition
+//***************************************************************************************
+
+template <typename PIXEL>
+class Rasterizer {
+  TRasterPT<PIXEL> m_ras;
+  const TVectorRenderData &m_rd;
+  const TPalette *m_palette;
+
+  std::vector<float> m_cells;
+  double m_pixelSize;
+
+public:
+  Rasterizer(const TRasterPT<PIXEL> &ras, const TVectorRenderData &rd,
+             const TPalette *palette)
+      : m_ras(ras), m_rd(rd), m_palette(palette) {
+    double det = fabs(rd.m_aff.det());
+    m_pixelSize = (det > 0.0) ? 1.0 / sqrt(det) : 1.0;
+  }
+
+  void draw(const TVectorImage *vim);
+
+private:
+  bool getColor(int styleId, bool isStroke, TPixel32 &color) const;
+  bool getBounds(const TRectD &bbox, TRect &bounds) const;
+
+  void drawStroke(const TStroke *s);
+  void drawRegion(const TRegion *r);
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename PIXEL>
+bool Rasterizer<PIXEL>::getColor(int styleId, bool isStroke,
+                                 TPixel32 &color) const {
+  const TColorStyle *style = m_palette->getStyle(styleId);
+  if (!style || !style->isEnabled() ||
+      (isStroke ? !style->isStrokeStyle() : !style->isRegionStyle()))
+    return false;
+
+  const TSolidColorStyle *solid = solidStyle(style);
+  assert(solid);
+  if (!solid) return false;
+
+  color = solid->getMainColor();
+  if (m_rd.m_cf) color = (*m_rd.m_cf)(color);
+
+  return color.m != 0;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename PIXEL>
+bool Rasterizer<PIXEL>::getBounds(const TRectD &bbox, TRect &bounds) const {
+  TRectD rasBBox(m_rd.m_aff * bbox);
+
+  bounds = TRect(tfloor(rasBBox.x0), tfloor(rasBBox.y0), tceil(rasBBox.x1),
+                 tceil(rasBBox.y1)) *
+           m_ras->getBounds();
+
+  if (m_rd.m_clippingRect != TRect()) bounds *= m_rd.m_clippingRect;
+
+  return !bounds.isEmpty();
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename PIXEL>
+void Rasterizer<PIXEL>::drawStroke(const TStroke *s) {
+  int styleId = s->getStyle();
+
+  TPixel32 color;
+  if (!getColor(styleId, true, color)) return;
+
+  if (!m_rd.m_show0ThickStrokes && isOThick(s)) return;
+
+  TRect bounds;
+  if (!getBounds(s->getBBox(), bounds)) return;
+
+  TStrokeOutline outline;
+  TOutlineUtil::makeOutline(*s, outline, TOutlineUtil::OutlineParameter());
+
+  const std::vector<TOutlinePoint> &v = outline.getArray();
+  if (v.size() < 4) return;
+
+  // The outline is a quad strip. Its quads may overlap, but pixels must be
+  // blended just once: accumulate them all and clamp the coverage.
+  CoverageAccumulator acc(bounds, m_cells);
+
+  const TAffine &aff = m_rd.m_aff;
+
+  UINT i, quadsCount = v.size() / 2 - 1;
+  for (i = 0; i < quadsCount; ++i) {
+    const TOutlinePoint &a = v[2 * i], &b = v[2 * i + 1], &c = v[2 * i + 2],
+                        &d = v[2 * i + 3];
+
+    TPointD pa(aff * TPointD(a.x, a.y)), pb(aff * TPointD(b.x, b.y)),
+        pc(aff * TPointD(c.x, c.y)), pd(aff * TPointD(d.x, d.y));
+
+    acc.addTriangle(pa, pb, pd);
+    acc.addTriangle(pa, pd, pc);
+  }
+
+  OverBlender<PIXEL> blender(m_ras, color);
+  acc.flush(1.0, m_rd.m_antiAliasing, blender);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename PIXEL>
+void Rasterizer<PIXEL>::drawRegion(const TRegion *r) {
+  TPixel32 color;
+  TRect bounds;
+
+  if (r->getStyle() && getColor(r->getStyle(), false, color) &&
+      getBounds(r->getBBox(), bounds)) {
+    CoverageAccumulator acc(bounds, m_cells);
+    const TAffine &aff = m_rd.m_aff;
+
+    // Subregions are holes - their boundaries are traversed backwards.
+    // As in GL tessellation, the winding direction of the exterior decides
+    // which side is inside.
+    TRegionOutline::PointVector polyline;
+    double area = 0.0;
+
+    UINT sr, srCount = r->getSubregionCount();
+    for (sr = 0; sr <= srCount; ++sr) {
+      const TRegion *boundary = (sr == 0) ? r : r->getSubregion(sr - 1);
+      OutlineRegionProp::computeOutline(boundary, polyline, m_pixelSize);
+
+      UINT p, pCount = polyline.size();
+      if (pCount < 3) continue;
+
+      TPointD prev(aff * TPointD(polyline.back().x, polyline.back().y));
+      for (p = 0; p < pCount; ++p) {
+        TPointD next(aff * TPointD(polyline[p].x, polyline[p].y));
+
+        if (sr == 0)
+          acc.addEdge(prev, next), area += cross(prev, next);
+        else
+          acc.addEdge(next, prev), area -= cross(prev, next);
+
+        prev = next;
+      }
+    }
+
+    if (area != 0.0) {
+      OverBlender<PIXEL> blender(m_ras, color);
+      acc.flush((area > 0.0) ? 1.0 : -1.0,
+                m_rd.m_antiAliasing && m_rd.m_regionAntialias, blender);
+    } else {
+      // Nothing to draw - just clear the accumulator
+      struct Discard {
+        void operator()(int, int, double) {}
+      } discard;
+      acc.flush(1.0, true, discard);
+    }
+  }
+
+  UINT i, count = r->getSubregionCount();
+  for (i = 0; i < count; ++i) drawRegion(r->getSubregion(i));
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename PIXEL>
+void Rasterizer<PIXEL>::draw(const TVectorImage *vim) {
+  // Same drawing order as tglDraw(): each group's regions, then its strokes
+  UINT strokeIndex = 0, strokeCount = vim->getStrokeCount();
+  while (strokeIndex < strokeCount) {
+    UINT currStrokeIndex = strokeIndex;
+
+    if (m_rd.m_drawRegions) {
+      UINT r, rCount = vim->getRegionCount();
+      for (r = 0; r < rCount; ++r)
+        if (vim->sameGroupStrokeAndRegion(currStrokeIndex, r))
+          drawRegion(vim->getRegion(r));
+    }
+
+    while (strokeIndex < strokeCount &&
+           vim->sameGroup(strokeIndex, currStrokeIndex))
+      drawStroke(vim->getStroke(strokeIndex++));
+  }
+}
+
+}  // namespace
+
+//***************************************************************************************
+//    TVectorRasterizer implementation
+//***************************************************************************************
+
+bool TVectorRasterizer::canRasterize(const TVectorImage *vim,
+                                     const TVectorRenderData &rd) {
+  if (!vim) return false;
+
+  // Check modes and viewer-only features are left to GL
+  if (!rd.m_alphaChannel || rd.m_tcheckEnabled || rd.m_inkCheckEnabled ||
+      rd.m_ink1CheckEnabled || rd.m_paintCheckEnabled ||
+      rd.m_showGuidedDrawing || rd.m_is3dView)
+    return false;
+
+  const TPalette *palette = rd.m_palette ? rd.m_palette : vim->getPalette();
+  if (!palette) return false;
+
+  QMutexLocker sl(vim->getMutex());
+
+  if (vim->isInsideGroup() > 0) return false;
+
+  UINT i, count = vim->getStrokeCount();
+  for (i = 0; i < count; ++i) {
+    const TStroke *s = vim->getStroke(i);
+    if (s->isCenterLine() || !solidStyle(palette->getStyle(s->getStyle())))
+      return false;
+  }
+
+  if (rd.m_drawRegions) {
+    count = vim->getRegionCount();
+    for (i = 0; i < count; ++i)
+      if (!canRasterizeRegion(vim->getRegion(i), palette)) return false;
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void TVectorRasterizer::rasterize(const TRasterP &ras, const TVectorImage *vim,
+                                  const TVectorRenderData &rd) {
+  assert(vim);
+  if (!vim) return;
+
+  const TPalette *palette = rd.m_palette ? rd.m_palette : vim->getPalette();
+  if (!palette) return;
+
+  QMutexLocker sl(vim->getMutex());
+
+  TRaster32P ras32(ras);
+  TRaster64P ras64(ras);
+
+  ras->lock();
+
+  if (ras32)
+    Rasterizer<TPixel32>(ras32, rd, palette).draw(vim);
+  else if (ras64)
+    Rasterizer<TPixel64>(ras64, rd, palette).draw(vim);
+  else
+    assert(!"TVectorRasterizer::rasterize: unsupported raster type");
+
+  ras->unlock();
+}
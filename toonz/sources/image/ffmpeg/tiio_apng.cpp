@@ -61,9 +61,14 @@ TLevelWriterAPng::TLevelWriterAPng(const TFilePath &path, TPropertyGroup *winfo)
 //-----------------------------------------------------------
 
 TLevelWriterAPng::~TLevelWriterAPng() {
-  QStringList preIArgs;
-  QStringList postIArgs;
+  ffmpegWriter->finishEncoding();
+  ffmpegWriter->cleanUpFiles();
+}
+
+//-----------------------------------------------------------
 
+void TLevelWriterAPng::getEncodeArgs(QStringList &preIArgs,
+                                     QStringList &postIArgs) {
   int outLx = m_lx;
   int outLy = m_ly;
 
@@ -84,9 +89,6 @@ TLevelWriterAPng::~TLevelWriterAPng() {
   postIArgs << "apng";
   postIArgs << "-s";
   postIArgs << QString::number(outLx) + "x" + QString::number(outLy);
-
-  ffmpegWriter->runFfmpeg(preIArgs, postIArgs, false, false, true);
-  ffmpegWriter->cleanUpFiles();
 }
 
 //-----------------------------------------------------------
@@ -114,7 +116,12 @@ void TLevelWriterAPng::save(const TImageP &img, int frameIndex) {
   TRasterImageP image(img);
   m_lx = image->getRaster()->getLx();
   m_ly = image->getRaster()->getLy();
-  ffmpegWriter->createIntermediateImage(img, frameIndex);
+  if (!ffmpegWriter->isEncoding()) {
+    QStringList preIArgs, postIArgs;
+    getEncodeArgs(preIArgs, postIArgs);
+    ffmpegWriter->startEncoding(preIArgs, postIArgs);
+  }
+  ffmpegWriter->addFrame(img, frameIndex);
 }
 
 //===========================================================
@@ -205,11 +212,7 @@ TDimension TLevelReaderAPng::getSize() { return m_size; }
 //------------------------------------------------
 
 TImageP TLevelReaderAPng::load(int frameIndex) {
-  if (!ffmpegFramesCreated) {
-    ffmpegReader->getFramesFromMovie();
-    ffmpegFramesCreated = true;
-  }
-  return ffmpegReader->getImage(frameIndex);
+  return ffmpegReader->decodeFrame(frameIndex);
 }
 
 Tiio::APngWriterProperties::APngWriterProperties()
@@ -35,6 +35,9 @@ private:
   int m_scale;
   bool m_looping;
   bool m_extPng;
+
+  // ffmpeg arguments, once the frame size is known
+  void getEncodeArgs(QStringList &preIArgs, QStringList &postIArgs);
 };
 
 //===========================================================
@@ -58,7 +61,6 @@ public:
   TDimension getSize();
 private:
   Ffmpeg *ffmpegReader;
-  bool ffmpegFramesCreated = false;
   TDimension m_size;
   int m_frameCount, m_lx, m_ly;
 };
@@ -59,9 +59,14 @@ TLevelWriterFFMov::TLevelWriterFFMov(const TFilePath &path,
 //-----------------------------------------------------------
 
 TLevelWriterFFMov::~TLevelWriterFFMov() {
-  QStringList preIArgs;
-  QStringList postIArgs;
+  ffmpegWriter->finishEncoding();
+  ffmpegWriter->cleanUpFiles();
+}
+
+//-----------------------------------------------------------
 
+void TLevelWriterFFMov::getEncodeArgs(QStringList &preIArgs,
+                                      QStringList &postIArgs) {
   int outLx = m_lx;
   int outLy = m_ly;
 
@@ -95,9 +100,6 @@ TLevelWriterFFMov::~TLevelWriterFFMov() {
   postIArgs << QString::number(outLx) + "x" + QString::number(outLy);
   postIArgs << "-b";
   postIArgs << QString::number(finalBitrate) + "k";
-
-  ffmpegWriter->runFfmpeg(preIArgs, postIArgs, false, false, true);
-  ffmpegWriter->cleanUpFiles();
 }
 
 //-----------------------------------------------------------
@@ -125,7 +127,12 @@ void TLevelWriterFFMov::save(const TImageP &img, int frameIndex) {
   TRasterImageP image(img);
   m_lx = image->getRaster()->getLx();
   m_ly = image->getRaster()->getLy();
-  ffmpegWriter->createIntermediateImage(img, frameIndex);
+  if (!ffmpegWriter->isEncoding()) {
+    QStringList preIArgs, postIArgs;
+    getEncodeArgs(preIArgs, postIArgs);
+    ffmpegWriter->startEncoding(preIArgs, postIArgs);
+  }
+  ffmpegWriter->addFrame(img, frameIndex);
 }
 
 //===========================================================
@@ -217,11 +224,7 @@ TDimension TLevelReaderFFMov::getSize() { return m_size; }
 //------------------------------------------------
 
 TImageP TLevelReaderFFMov::load(int frameIndex) {
-  if (!ffmpegFramesCreated) {
-    ffmpegReader->getFramesFromMovie();
-    ffmpegFramesCreated = true;
-  }
-  return ffmpegReader->getImage(frameIndex);
+  return ffmpegReader->decodeFrame(frameIndex);
 }
 
 Tiio::FFMovWriterProperties::FFMovWriterProperties()
@@ -13,15 +13,194 @@
 #include <QDir>
 #include <QtGui/QImage>
 #include <QRegExp>
+#include <QThread>
+#include <QWaitCondition>
 #include "tmsgcore.h"
+#include "trop.h"
 #include "thirdparty.h"
 
+#include <algorithm>
+
+namespace {
+
+// raw frames are piped in the memory layout of TPixel32, top row first
+#if defined(TNZ_MACHINE_CHANNEL_ORDER_BGRM)
+const char rawPixelFormat[] = "bgra";
+#elif defined(TNZ_MACHINE_CHANNEL_ORDER_MBGR)
+const char rawPixelFormat[] = "abgr";
+#elif defined(TNZ_MACHINE_CHANNEL_ORDER_RGBM)
+const char rawPixelFormat[] = "rgba";
+#elif defined(TNZ_MACHINE_CHANNEL_ORDER_MRGB)
+const char rawPixelFormat[] = "argb";
+#endif
+
+// frames waiting to be piped to the encoder: beyond it, writers wait
+const int maxQueuedFrames = 8;
+
+// frames decoded at once, and kept for the following requests
+const int maxDecodedFrames = 16;
+const int maxDecodedBytes  = 128 << 20;
+
+//-----------------------------------------------------------
+
+QByteArray getRawFrame(const TRaster32P &ras) {
+  int rowBytes = ras->getLx() * 4;
+  QByteArray frame(rowBytes * ras->getLy(), Qt::Uninitialized);
+
+  ras->lock();
+  char *dst = frame.data();
+  for (int y = ras->getLy() - 1; y >= 0; --y, dst += rowBytes)
+    memcpy(dst, ras->pixels(y), rowBytes);
+  ras->unlock();
+
+  return frame;
+}
+
+//-----------------------------------------------------------
+
+void setRawFrame(const TRaster32P &ras, const char *src) {
+  int rowBytes = ras->getLx() * 4;
+
+  ras->lock();
+  for (int y = ras->getLy() - 1; y >= 0; --y, src += rowBytes)
+    memcpy(ras->pixels(y), src, rowBytes);
+  ras->unlock();
+}
+
+//-----------------------------------------------------------
+
+void warnTimeout() {
+  DVGui::warning(
+      QObject::tr("FFmpeg timed out.\n"
+                  "Please check the file for errors.\n"
+                  "If the file doesn't play or is incomplete, \n"
+                  "Please try raising the FFmpeg timeout in Preferences."));
+}
+
+}  // namespace
+
+//===========================================================
+//
+//  FfmpegEncodeThread
+//
+//===========================================================
+
+// Owns the encoding process, which must be used by one thread only: frames
+// are queued by the writer and piped to the process by this thread.
+
+class FfmpegEncodeThread final : public QThread {
+  enum State { Starting, Running, Stopped };
+
+  QStringList m_args;
+  int m_timeout;
+
+  QMutex m_mutex;
+  QWaitCondition m_cond;
+  std::deque<QByteArray> m_frames;
+  State m_state;
+  bool m_closed;
+
+  // results, to be read after wait()
+  bool m_started, m_timedOut;
+  int m_exitCode;
+
+public:
+  FfmpegEncodeThread(const QStringList &args, int timeout)
+      : m_args(args)
+      , m_timeout(timeout)
+      , m_state(Starting)
+      , m_closed(false)
+      , m_started(false)
+      , m_timedOut(false)
+      , m_exitCode(0) {}
+
+  // returns false if the process could not be started
+  bool waitForStarted() {
+    QMutexLocker locker(&m_mutex);
+    while (m_state == Starting) m_cond.wait(&m_mutex);
+    return m_started;
+  }
+
+  // waits while the queue is full; returns false if the process has stopped
+  bool push(const QByteArray &frame) {
+    QMutexLocker locker(&m_mutex);
+    while (m_state == Running && (int)m_frames.size() >= maxQueuedFrames)
+      m_cond.wait(&m_mutex);
+    if (m_state != Running) return false;
+    m_frames.push_back(frame);
+    m_cond.wakeAll();
+    return true;
+  }
+
+  // no more frames: the process ends once the queue is written
+  void close() {
+    QMutexLocker locker(&m_mutex);
+    m_closed = true;
+    m_cond.wakeAll();
+  }
+
+  bool timedOut() const { return m_timedOut; }
+  int exitCode() const { return m_exitCode; }
+
+protected:
+  void run() override {
+    QProcess ffmpeg;
+    // the output is not read, so it must not fill the pipes
+    ffmpeg.setStandardOutputFile(QProcess::nullDevice());
+    ffmpeg.setStandardErrorFile(QProcess::nullDevice());
+    ThirdParty::runFFmpeg(ffmpeg, m_args);
+    m_started = ffmpeg.waitForStarted(m_timeout);
+
+    setState(m_started ? Running : Stopped);
+    if (!m_started) return;
+
+    bool written = true;
+    while (written) {
+      QByteArray frame;
+      {
+        QMutexLocker locker(&m_mutex);
+        while (m_frames.empty() && !m_closed) m_cond.wait(&m_mutex);
+        if (m_frames.empty()) break;
+        frame = m_frames.front();
+        m_frames.pop_front();
+        m_cond.wakeAll();
+      }
+
+      ffmpeg.write(frame);
+      while (written && ffmpeg.bytesToWrite() > 0)
+        written = ffmpeg.waitForBytesWritten(m_timeout);
+    }
+
+    // writers are not kept waiting while the encoder ends
+    setState(Stopped);
+
+    ffmpeg.closeWriteChannel();
+    if (ffmpeg.waitForFinished(m_timeout))
+      m_exitCode = ffmpeg.exitCode();
+    else {
+      m_timedOut = true;
+      ffmpeg.kill();
+      ffmpeg.waitForFinished();
+    }
+  }
+
+private:
+  void setState(State state) {
+    QMutexLocker locker(&m_mutex);
+    m_state = state;
+    if (state == Stopped) m_frames.clear();
+    m_cond.wakeAll();
+  }
+};
+
+//===========================================================
+
 Ffmpeg::Ffmpeg() {
   m_ffmpegTimeout      = ThirdParty::getFFmpegTimeout() * 1000;
   m_intermediateFormat = "png";
   m_startNumber        = 2147483647;  // Lowest frame determines starting frame
 }
-Ffmpeg::~Ffmpeg() {}
+Ffmpeg::~Ffmpeg() { finishEncoding(); }
 
 bool Ffmpeg::checkFormat(std::string format) {
   static std::string strResults = "";
@@ -158,13 +337,7 @@ QString Ffmpeg::runFfprobe(QStringList args) {
 bool Ffmpeg::waitFfmpeg(QProcess &ffmpeg, bool asyncProcess) {
   if (!asyncProcess) {
     bool status = ffmpeg.waitForFinished(m_ffmpegTimeout);
-    if (!status) {
-      DVGui::warning(
-          QObject::tr("FFmpeg timed out.\n"
-                      "Please check the file for errors.\n"
-                      "If the file doesn't play or is incomplete, \n"
-                      "Please try raising the FFmpeg timeout in Preferences."));
-    }
+    if (!status) warnTimeout();
     return status;
   }
 
@@ -174,13 +347,7 @@ bool Ffmpeg::waitFfmpeg(QProcess &ffmpeg, bool asyncProcess) {
     DVGui::warning(
         QObject::tr("FFmpeg returned error-code: %1").arg(ffmpeg.exitCode()));
   }
-  if (exitCode == -2) {
-    DVGui::warning(
-        QObject::tr("FFmpeg timed out.\n"
-                    "Please check the file for errors.\n"
-                    "If the file doesn't play or is incomplete, \n"
-                    "Please try raising the FFmpeg timeout in Preferences."));
-  }
+  if (exitCode == -2) warnTimeout();
   return false;
 }
 
@@ -267,36 +434,6 @@ ffmpegFileInfo Ffmpeg::getInfo() {
   info.m_frameCount = m_frameCount;
   return info;
 }
-TRasterImageP Ffmpeg::getImage(int frameIndex) {
-  QString ffmpegCachePath = getFfmpegCache().getQString();
-  QString tempPath        = ffmpegCachePath + "//" + cleanPathSymbols();
-  std::string tmpPath     = tempPath.toStdString();
-  // QString tempPath= m_path.getQString();
-  QString number   = QString("%1").arg(frameIndex, 4, 10, QChar('0'));
-  QString tempName = "In" + number + ".png";
-  tempName         = tempPath + tempName;
-
-  // for debugging
-  std::string strPath = tempName.toStdString();
-  if (TSystem::doesExistFileOrLevel(TFilePath(tempName))) {
-    QImage *temp = new QImage(tempName, "PNG");
-    if (temp) {
-      QImage tempToo = temp->convertToFormat(QImage::Format_ARGB32);
-      delete temp;
-      const UCHAR *bits = tempToo.bits();
-
-      TRasterPT<TPixelRGBM32> ret;
-      ret.create(m_lx, m_ly);
-      ret->lock();
-      memcpy(ret->getRawData(), bits, m_lx * m_ly * 4);
-      ret->unlock();
-      ret->yMirror();
-      return TRasterImageP(ret);
-    }
-  }
-  return TRasterImageP();
-}
-
 double Ffmpeg::getFrameRate() {
   QStringList fpsArgs;
   int fpsNum = 0, fpsDen = 0;
@@ -404,55 +541,6 @@ int Ffmpeg::getFrameCount() {
   return m_frameCount;
 }
 
-void Ffmpeg::getFramesFromMovie(int frame) {
-  QString ffmpegCachePath = getFfmpegCache().getQString();
-  QString tempPath        = ffmpegCachePath + "//" + cleanPathSymbols();
-  std::string tmpPath     = tempPath.toStdString();
-  QString tempName        = "In%04d." + m_intermediateFormat;
-  tempName                = tempPath + tempName;
-  QString tempStart;
-  if (frame == -1) {
-    tempStart = "In0001." + m_intermediateFormat;
-    tempStart = tempPath + tempStart;
-  } else {
-    QString number = QString("%1").arg(frame, 4, 10, QChar('0'));
-    tempStart      = tempPath + "In" + number + "." + m_intermediateFormat;
-  }
-  QString tempBase = tempPath + "In";
-  QString addToDelete;
-  if (!TSystem::doesExistFileOrLevel(TFilePath(tempStart))) {
-    // for debugging
-    std::string strPath = tempName.toStdString();
-
-    QStringList preIFrameArgs;
-    QStringList postIFrameArgs;
-    // frameArgs << "-accurate_seek";
-    // frameArgs << "-ss";
-    // frameArgs << "0" + QString::number(frameIndex / m_info->m_frameRate);
-    if (m_path.getType() == "webm") {
-      // To load in webm transparency
-      preIFrameArgs << "-vcodec";
-      preIFrameArgs << "libvpx";
-    }
-    preIFrameArgs << "-i";
-    preIFrameArgs << m_path.getQString();
-    postIFrameArgs << "-y";
-    postIFrameArgs << "-f";
-    postIFrameArgs << "image2";
-
-    postIFrameArgs << tempName;
-
-    runFfmpeg(preIFrameArgs, postIFrameArgs, true, true, true, false);
-
-    for (int i = 1; i <= m_frameCount; i++) {
-      QString number      = QString("%1").arg(i, 4, 10, QChar('0'));
-      addToDelete         = tempBase + number + "." + m_intermediateFormat;
-      std::string delPath = addToDelete.toStdString();
-      // addToCleanUp(addToDelete);
-    }
-  }
-}
-
 QString Ffmpeg::cleanPathSymbols() {
   return m_path.getQString().remove(QRegExp(
       QString::fromUtf8("[-`~!@#$%^&*()_+=|:;<>«»,.?/{}\'\"\\[\\]\\\\]")));
@@ -494,6 +582,182 @@ void Ffmpeg::disablePrecompute() {
   Preferences::instance()->setPrecompute(false);
 }
 
+//-----------------------------------------------------------
+
+void Ffmpeg::startEncoding(const QStringList &preIArgs,
+                           const QStringList &postIArgs) {
+  QMutexLocker locker(&m_encodeMutex);
+  if (m_encoding) return;
+  m_encoding        = true;
+  m_encodePreIArgs  = preIArgs;
+  m_encodePostIArgs = postIArgs;
+}
+
+//-----------------------------------------------------------
+
+void Ffmpeg::addFrame(const TImageP &img, int frameIndex) {
+  TRasterImageP ri(img);
+  if (!ri || !ri->getRaster()) return;
+
+  // frames are piped as 32-bit pixels
+  TRasterImageP ri32(ri);
+  TRaster32P ras(ri->getRaster());
+  if (!ras) {
+    ras = TRaster32P(ri->getRaster()->getSize());
+    TRop::convert(ras, ri->getRaster());
+    ri32 = TRasterImageP(ras);
+  }
+
+  QMutexLocker locker(&m_encodeMutex);
+  assert(m_encoding);
+
+  // the pipe takes frames in the order they come: writers must add them in
+  // order, starting from the first frame of the range
+  if (m_frameCount > 0 && frameIndex <= m_lastFrame)
+    throw TImageException(m_path, "frames must be saved in order");
+  m_lastFrame = frameIndex;
+
+  // the process is started at the first frame, since it needs the size
+  if (m_frameCount == 0) {
+    m_lx  = ras->getLx();
+    m_ly  = ras->getLy();
+    m_bpp = ras->getPixelSize();
+
+    QStringList args = m_encodePreIArgs;
+    args << "-f" << "rawvideo" << "-pix_fmt" << rawPixelFormat;
+    args << "-s" << QString::number(m_lx) + "x" + QString::number(m_ly);
+    args << "-i" << "-";
+    if (m_hasSoundTrack) args = args + m_audioArgs;
+    args = args + m_encodePostIArgs;
+    args << "-y" << m_path.getQString();
+
+    m_encoder = new FfmpegEncodeThread(args, m_ffmpegTimeout);
+    m_encoder->start();
+    if (!m_encoder->waitForStarted()) {
+      m_encoder->wait();
+      delete m_encoder;
+      m_encoder = nullptr;
+    }
+  }
+
+  if (!m_encoder) {
+    createIntermediateImage(ri32, frameIndex);
+    return;
+  }
+
+  m_frameCount++;
+  m_encoder->push(getRawFrame(ras));
+}
+
+//-----------------------------------------------------------
+
+void Ffmpeg::finishEncoding() {
+  QMutexLocker locker(&m_encodeMutex);
+  if (!m_encoding) return;
+  m_encoding = false;
+
+  if (!m_encoder) {
+    // intermediate images
+    if (m_frameCount > 0)
+      runFfmpeg(m_encodePreIArgs, m_encodePostIArgs, false, false, true);
+    return;
+  }
+
+  m_encoder->close();
+  m_encoder->wait();
+
+  if (m_encoder->timedOut())
+    warnTimeout();
+  else if (m_encoder->exitCode() != 0)
+    DVGui::warning(QObject::tr("FFmpeg returned error-code: %1")
+                       .arg(m_encoder->exitCode()));
+
+  delete m_encoder;
+  m_encoder = nullptr;
+}
+
+//-----------------------------------------------------------
+
+TRasterImageP Ffmpeg::decodeFrame(int frameIndex) {
+  QMutexLocker locker(&m_decodeMutex);
+
+  std::map<int, TRasterP>::iterator it = m_decodedFrames.find(frameIndex);
+  if (it == m_decodedFrames.end()) {
+    int frameBytes = m_lx * m_ly * 4;
+    if (frameBytes <= 0) return TRasterImageP();
+    int count = std::max(
+        1, std::min(maxDecodedFrames, maxDecodedBytes / frameBytes));
+
+    if (!decodeFrames(frameIndex, count)) return TRasterImageP();
+    it = m_decodedFrames.find(frameIndex);
+    if (it == m_decodedFrames.end()) return TRasterImageP();
+  }
+
+  // kept frames are not given away, since images can be modified
+  return TRasterImageP(it->second->clone());
+}
+
+//-----------------------------------------------------------
+
+bool Ffmpeg::decodeFrames(int frameIndex, int count) {
+  QStringList args;
+  if (m_path.getType() == "webm") {
+    // To load in webm transparency
+    args << "-vcodec";
+    args << "libvpx";
+  }
+  // seek half a frame before the requested one (frames start at 1), so that
+  // rounding cannot skip it
+  if (frameIndex > 1 && m_frameRate > 0) {
+    args << "-ss";
+    args << QString::number((frameIndex - 1.5) / m_frameRate, 'f', 6);
+  }
+  args << "-i" << m_path.getQString();
+  args << "-frames:v" << QString::number(count);
+  args << "-f" << "rawvideo" << "-pix_fmt" << rawPixelFormat << "-";
+
+  QProcess ffmpeg;
+  ffmpeg.setStandardErrorFile(QProcess::nullDevice());
+  ThirdParty::runFFmpeg(ffmpeg, args);
+  if (!ffmpeg.waitForStarted(m_ffmpegTimeout)) return false;
+
+  int frameBytes = m_lx * m_ly * 4;
+  QByteArray data;
+  int decoded = 0;
+  for (; decoded < count; ++decoded) {
+    for (;;) {
+      data += ffmpeg.readAllStandardOutput();
+      if (data.size() >= frameBytes ||
+          !ffmpeg.waitForReadyRead(m_ffmpegTimeout))
+        break;
+    }
+    data += ffmpeg.readAllStandardOutput();
+    if (data.size() < frameBytes) break;
+
+    TRaster32P ras(m_lx, m_ly);
+    setRawFrame(ras, data.constData());
+    data.remove(0, frameBytes);
+
+    int index = frameIndex + decoded;
+    if (m_decodedFrames.count(index))
+      m_decodedOrder.erase(
+          std::find(m_decodedOrder.begin(), m_decodedOrder.end(), index));
+    m_decodedOrder.push_back(index);
+    m_decodedFrames[index] = ras;
+  }
+
+  if (!ffmpeg.waitForFinished(m_ffmpegTimeout)) ffmpeg.kill();
+  ffmpeg.close();
+
+  // keep the last two batches
+  while ((int)m_decodedOrder.size() > 2 * count) {
+    m_decodedFrames.erase(m_decodedOrder.front());
+    m_decodedOrder.pop_front();
+  }
+
+  return decoded > 0;
+}
+
 //===========================================================
 //
 //  TImageReaderFFmpeg
@@ -583,9 +847,5 @@ TDimension TLevelReaderFFmpeg::getSize() { return m_size; }
 //------------------------------------------------
 
 TImageP TLevelReaderFFmpeg::load(int frameIndex) {
-  if (!ffmpegFramesCreated) {
-    ffmpegReader->getFramesFromMovie();
-    ffmpegFramesCreated = true;
-  }
-  return ffmpegReader->getImage(frameIndex);
+  return ffmpegReader->decodeFrame(frameIndex);
 }
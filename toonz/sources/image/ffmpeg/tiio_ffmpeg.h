@@ -9,12 +9,18 @@
 #include <QVector>
 #include <QStringList>
 #include <QProcess>
+#include <QMutex>
+
+#include <deque>
+#include <map>
 
 struct ffmpegFileInfo {
   int m_lx, m_ly, m_frameCount;
   double m_frameRate;
 };
 
+class FfmpegEncodeThread;
+
 class Ffmpeg {
 public:
   Ffmpeg();
@@ -35,13 +41,28 @@ public:
   double getFrameRate();
   TDimension getSize();
   int getFrameCount();
-  void getFramesFromMovie(int frame = -1);
-  TRasterImageP getImage(int frameIndex);
   TFilePath getFfmpegCache();
   ffmpegFileInfo getInfo();
   void disablePrecompute();
   int getGifFrameCount();
 
+  // Streaming encode: writers start it at the first frame, with the arguments
+  // they would give to runFfmpeg(). Frames are then piped raw to the ffmpeg
+  // process while it encodes, with no intermediate images - unless the
+  // process cannot be started, in which case intermediate images are saved
+  // and ffmpeg is run on them by finishEncoding().
+  // Frames are piped as they come, so they must be added in order, starting
+  // from the first frame of the range: addFrame() throws otherwise.
+  void startEncoding(const QStringList &preIArgs, const QStringList &postIArgs);
+  bool isEncoding() const { return m_encoding; }
+  void addFrame(const TImageP &image, int frameIndex);
+  void finishEncoding();
+
+  // Decodes frames on demand: an ffmpeg process seeks to the requested frame
+  // and pipes it raw, along with a few of the following ones which are kept
+  // for the next requests.
+  TRasterImageP decodeFrame(int frameIndex);
+
 private:
   QString m_intermediateFormat, m_audioPath, m_audioFormat;
   int m_frameCount    = 0, m_lx, m_ly, m_bpp, m_bitsPerSample, m_channelCount,
@@ -54,6 +75,19 @@ private:
   TUINT32 m_sampleRate;
   QString cleanPathSymbols();
   bool waitFfmpeg(QProcess &ffmpeg, bool asyncProcess);
+
+  // streaming encode
+  bool m_encoding = false;
+  QStringList m_encodePreIArgs, m_encodePostIArgs;
+  FfmpegEncodeThread *m_encoder = nullptr;
+  int m_lastFrame               = 0;
+  QMutex m_encodeMutex;  // guards the streaming encode
+
+  // on demand decode
+  QMutex m_decodeMutex;
+  std::map<int, TRasterP> m_decodedFrames;
+  std::deque<int> m_decodedOrder;  // oldest first
+  bool decodeFrames(int frameIndex, int count);
 };
 
 //===========================================================
@@ -78,7 +112,6 @@ public:
 
 private:
   Ffmpeg *ffmpegReader;
-  bool ffmpegFramesCreated = false;
   TDimension m_size;
   int m_frameCount, m_lx, m_ly;
 };
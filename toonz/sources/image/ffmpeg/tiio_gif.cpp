@@ -62,8 +62,14 @@ TLevelWriterGif::TLevelWriterGif(const TFilePath &path, TPropertyGroup *winfo)
 //-----------------------------------------------------------
 
 TLevelWriterGif::~TLevelWriterGif() {
-  QStringList preIArgs;
-  QStringList postIArgs;
+  ffmpegWriter->finishEncoding();
+  ffmpegWriter->cleanUpFiles();
+}
+
+//-----------------------------------------------------------
+
+void TLevelWriterGif::getEncodeArgs(QStringList &preIArgs,
+                                    QStringList &postIArgs) {
   QStringList palettePreIArgs;
   QStringList palettePostIArgs;
 
@@ -147,11 +153,6 @@ TLevelWriterGif::~TLevelWriterGif() {
     postIArgs << "-loop";
     postIArgs << "-1";
   }
-
-  std::string outPath = m_path.getQString().toStdString();
-
-  ffmpegWriter->runFfmpeg(preIArgs, postIArgs, false, false, true);
-  ffmpegWriter->cleanUpFiles();
 }
 
 //-----------------------------------------------------------
@@ -180,7 +181,12 @@ void TLevelWriterGif::save(const TImageP &img, int frameIndex) {
   TRasterImageP image(img);
   m_lx = image->getRaster()->getLx();
   m_ly = image->getRaster()->getLy();
-  ffmpegWriter->createIntermediateImage(img, frameIndex);
+  if (!ffmpegWriter->isEncoding()) {
+    QStringList preIArgs, postIArgs;
+    getEncodeArgs(preIArgs, postIArgs);
+    ffmpegWriter->startEncoding(preIArgs, postIArgs);
+  }
+  ffmpegWriter->addFrame(img, frameIndex);
 }
 
 //===========================================================
@@ -277,11 +283,7 @@ TDimension TLevelReaderGif::getSize() { return m_size; }
 //------------------------------------------------
 
 TImageP TLevelReaderGif::load(int frameIndex) {
-  if (!ffmpegFramesCreated) {
-    ffmpegReader->getFramesFromMovie();
-    ffmpegFramesCreated = true;
-  }
-  return ffmpegReader->getImage(frameIndex);
+  return ffmpegReader->decodeFrame(frameIndex);
 }
 
 Tiio::GifWriterProperties::GifWriterProperties()
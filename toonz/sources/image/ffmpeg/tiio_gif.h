@@ -40,6 +40,9 @@ private:
   bool m_looping  = true;
   int m_mode      = 0;
   int m_maxcolors = 256;
+
+  // ffmpeg arguments, once the frame size is known
+  void getEncodeArgs(QStringList &preIArgs, QStringList &postIArgs);
 };
 
 //===========================================================
@@ -65,7 +68,6 @@ public:
   // void *m_decompressedBuffer;
 private:
   Ffmpeg *ffmpegReader;
-  bool ffmpegFramesCreated = false;
   TDimension m_size;
   int m_frameCount, m_lx, m_ly;
 };
@@ -36,6 +36,9 @@ private:
   int m_scale;
   int m_vidQuality;
   // void *m_buffer;
+
+  // ffmpeg arguments, once the frame size is known
+  void getEncodeArgs(QStringList &preIArgs, QStringList &postIArgs);
 };
 
 //===========================================================
@@ -61,7 +64,6 @@ public:
   // void *m_decompressedBuffer;
 private:
   Ffmpeg *ffmpegReader;
-  bool ffmpegFramesCreated = false;
   TDimension m_size;
   int m_frameCount, m_lx, m_ly;
 };
@@ -52,10 +52,14 @@ TLevelWriterWebm::TLevelWriterWebm(const TFilePath &path, TPropertyGroup *winfo)
 //-----------------------------------------------------------
 
 TLevelWriterWebm::~TLevelWriterWebm() {
-  // QProcess createWebm;
-  QStringList preIArgs;
-  QStringList postIArgs;
+  ffmpegWriter->finishEncoding();
+  ffmpegWriter->cleanUpFiles();
+}
+
+//-----------------------------------------------------------
 
+void TLevelWriterWebm::getEncodeArgs(QStringList &preIArgs,
+                                     QStringList &postIArgs) {
   int outLx = m_lx;
   int outLy = m_ly;
 
@@ -91,9 +95,6 @@ TLevelWriterWebm::~TLevelWriterWebm() {
   postIArgs << "3";
   postIArgs << "-quality";
   postIArgs << "good";
-
-  ffmpegWriter->runFfmpeg(preIArgs, postIArgs, false, false, true);
-  ffmpegWriter->cleanUpFiles();
 }
 
 //-----------------------------------------------------------
@@ -123,7 +124,12 @@ void TLevelWriterWebm::save(const TImageP &img, int frameIndex) {
   TRasterImageP image(img);
   m_lx = image->getRaster()->getLx();
   m_ly = image->getRaster()->getLy();
-  ffmpegWriter->createIntermediateImage(img, frameIndex);
+  if (!ffmpegWriter->isEncoding()) {
+    QStringList preIArgs, postIArgs;
+    getEncodeArgs(preIArgs, postIArgs);
+    ffmpegWriter->startEncoding(preIArgs, postIArgs);
+  }
+  ffmpegWriter->addFrame(img, frameIndex);
 }
 
 //===========================================================
@@ -218,11 +224,7 @@ TDimension TLevelReaderWebm::getSize() { return m_size; }
 //------------------------------------------------
 
 TImageP TLevelReaderWebm::load(int frameIndex) {
-  if (!ffmpegFramesCreated) {
-    ffmpegReader->getFramesFromMovie();
-    ffmpegFramesCreated = true;
-  }
-  return ffmpegReader->getImage(frameIndex);
+  return ffmpegReader->decodeFrame(frameIndex);
 }
 
 Tiio::WebmWriterProperties::WebmWriterProperties()
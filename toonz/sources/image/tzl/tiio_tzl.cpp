@@ -20,6 +20,13 @@
 #include "trasterimage.h"
 
 #include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <list>
 
 #if !defined(TNZ_LITTLE_ENDIAN)
 TNZ_LITTLE_ENDIAN undefined !!
@@ -299,6 +306,305 @@ bool readHeaderAndOffsets(FILE *chan, TzlOffsetMap &frameOffsTable,
 }
 }  // namespace
 
+//===================================================================
+//
+// TzlMappedFile
+//
+//-------------------------------------------------------------------
+
+//! A read-only memory mapping of a tlv file. Frames are decompressed straight
+//! from the mapped pages, which the OS shares among all the readers.
+class TzlMappedFile {
+  QFile m_file;
+  const UCHAR *m_data;
+  qint64 m_size;
+  QDateTime m_lastModified;  //!< File stamp at mapping time
+
+public:
+  TzlMappedFile(const QString &path, const QFileInfo &fi)
+      : m_file(path), m_data(0), m_size(0), m_lastModified(fi.lastModified()) {
+    if (!m_file.open(QIODevice::ReadOnly)) return;
+
+    // Mapping may fail, eg for huge files on 32-bit systems
+    m_size = m_file.size();
+    if (m_size > 0 && m_size == fi.size()) m_data = m_file.map(0, m_size);
+  }
+
+  ~TzlMappedFile() {
+    if (m_data) m_file.unmap(const_cast<UCHAR *>(m_data));
+  }
+
+  bool isValid() const { return m_data != 0; }
+
+  //! Returns true if the file still has the size and modification time it
+  //! was mapped with. Pages of a truncated file would fault when read.
+  bool isCurrent(const QFileInfo &fi) const {
+    return fi.size() == m_size && fi.lastModified() == m_lastModified;
+  }
+
+  //! Returns true if the specified chunk lies entirely in the mapping.
+  //! Chunks written after the mapping was created may not.
+  bool contains(const TzlChunk &chunk) const {
+    return m_data && chunk.m_offs >= 0 && chunk.m_length >= 0 &&
+           (qint64)chunk.m_offs + chunk.m_length <= m_size;
+  }
+
+  QString path() const { return m_file.fileName(); }
+  const UCHAR *data() const { return m_data; }
+  qint64 size() const { return m_size; }
+};
+
+//===================================================================
+//
+// TzlFilesRegistry
+//
+//-------------------------------------------------------------------
+
+namespace {
+
+// Bytes at the start of a tlv file kept as the index stamp. They hold the
+// header, with the frames count and the offset tables position.
+const int indexStampHeaderSize = 128;
+
+//! The parsed header and offset tables of a tlv file.
+struct TzlFileIndex {
+  TzlOffsetMap m_frameOffsTable, m_iconOffsTable;
+  TDimension m_res;
+  int m_version;
+  QString m_creator;
+
+  QDateTime m_lastModified;  //!< File stamp the index was parsed at
+  qint64 m_fileSize;
+
+  QByteArray m_stamp;  //!< The header bytes the index was parsed with
+};
+
+//-------------------------------------------------------------------
+
+//! Reads the first bytes of a tlv file, up to indexStampHeaderSize. A change
+//! to the offset tables rewrites the frames count and the tables position in
+//! the header, so that comparing these bytes is enough to validate an index.
+//! Returns an empty array on failure.
+QByteArray readIndexStamp(FILE *chan, qint64 fileSize) {
+  qint64 size = std::min<qint64>(indexStampHeaderSize, fileSize);
+  if (size <= 0) return QByteArray();
+
+  QByteArray stamp(size, Qt::Uninitialized);
+
+  fseek(chan, 0, SEEK_SET);
+  if (fread(stamp.data(), size, 1, chan) != 1) return QByteArray();
+
+  return stamp;
+}
+
+//-------------------------------------------------------------------
+
+//! Shares file mappings among readers, and keeps the indices of the most
+//! recently read files - so that levels that are reopened frame after frame
+//! don't need their header parsed every time. Indices are reused only while
+//! the file modification time, size and header bytes are unchanged.
+//!
+//! Files open by a TLevelWriterTzl of this process are never mapped.
+class TzlFilesRegistry {
+  QMutex m_mutex;
+
+  std::map<QString, std::weak_ptr<TzlMappedFile>> m_mappings;
+  std::map<QString, int> m_writers;   //!< Open writers count per path
+  std::list<TzlFileIndex> m_indices;  //!< Most recently used first
+  std::list<QString> m_indexPaths;    //!< Paths of m_indices, same order
+
+  static const int maxIndicesCount = 64;
+
+public:
+  static TzlFilesRegistry *instance() {
+    static TzlFilesRegistry theInstance;
+    return &theInstance;
+  }
+
+  //! Returns a mapping of the specified file, or an empty pointer if the
+  //! file is being written or cannot be mapped.
+  std::shared_ptr<TzlMappedFile> getMapping(const QString &path,
+                                            const QFileInfo &fi) {
+    QMutexLocker locker(&m_mutex);
+
+    if (m_writers.count(path)) return std::shared_ptr<TzlMappedFile>();
+
+    std::shared_ptr<TzlMappedFile> mapping = m_mappings[path].lock();
+    if (mapping && mapping->isCurrent(fi)) return mapping;
+
+    mapping.reset(new TzlMappedFile(path, fi));
+    if (!mapping->isValid()) {
+      m_mappings.erase(path);
+      return std::shared_ptr<TzlMappedFile>();
+    }
+
+    // Forget expired mappings
+    std::map<QString, std::weak_ptr<TzlMappedFile>>::iterator it;
+    for (it = m_mappings.begin(); it != m_mappings.end();)
+      if (it->second.expired())
+        m_mappings.erase(it++);
+      else
+        ++it;
+
+    m_mappings[path] = mapping;
+    return mapping;
+  }
+
+  //! Returns true if the specified mapping can still be read: no writer has
+  //! the file open, and its size and modification time are unchanged. Costs
+  //! a file stat.
+  bool isReadable(const TzlMappedFile &mapping) {
+    QString path(mapping.path());
+
+    {
+      QMutexLocker locker(&m_mutex);
+      if (m_writers.count(path)) return false;
+    }
+
+    return mapping.isCurrent(QFileInfo(path));
+  }
+
+  bool getIndex(const QString &path, const QFileInfo &fi,
+                TzlFileIndex &index) {
+    QMutexLocker locker(&m_mutex);
+
+    std::list<TzlFileIndex>::iterator it = m_indices.begin();
+    std::list<QString>::iterator pt;
+    for (pt = m_indexPaths.begin(); pt != m_indexPaths.end(); ++pt, ++it) {
+      if (*pt != path) continue;
+
+      if (it->m_lastModified != fi.lastModified() ||
+          it->m_fileSize != fi.size())
+        return false;
+
+      // Move to front
+      m_indices.splice(m_indices.begin(), m_indices, it);
+      m_indexPaths.splice(m_indexPaths.begin(), m_indexPaths, pt);
+
+      index = m_indices.front();
+      return true;
+    }
+
+    return false;
+  }
+
+  void storeIndex(const QString &path, const TzlFileIndex &index) {
+    QMutexLocker locker(&m_mutex);
+
+    doInvalidateIndex(path);
+
+    m_indices.push_front(index);
+    m_indexPaths.push_front(path);
+
+    if ((int)m_indices.size() > maxIndicesCount) {
+      m_indices.pop_back();
+      m_indexPaths.pop_back();
+    }
+  }
+
+  //! Called on file writes. Readers already holding the old mapping stop
+  //! reading from it, see isReadable().
+  void invalidate(const QString &path) {
+    QMutexLocker locker(&m_mutex);
+
+    doInvalidateIndex(path);
+    m_mappings.erase(path);
+  }
+
+  //! Marks the specified file as open for writing, until endWrite().
+  void beginWrite(const QString &path) {
+    QMutexLocker locker(&m_mutex);
+
+    ++m_writers[path];
+    doInvalidateIndex(path);
+    m_mappings.erase(path);
+  }
+
+  void endWrite(const QString &path) {
+    QMutexLocker locker(&m_mutex);
+
+    std::map<QString, int>::iterator it = m_writers.find(path);
+    if (it != m_writers.end() && --it->second <= 0) m_writers.erase(it);
+
+    doInvalidateIndex(path);
+    m_mappings.erase(path);
+  }
+
+private:
+  void doInvalidateIndex(const QString &path) {
+    std::list<TzlFileIndex>::iterator it = m_indices.begin();
+    std::list<QString>::iterator pt;
+    for (pt = m_indexPaths.begin(); pt != m_indexPaths.end(); ++pt, ++it)
+      if (*pt == path) {
+        m_indices.erase(it);
+        m_indexPaths.erase(pt);
+        return;
+      }
+  }
+};
+
+//-------------------------------------------------------------------
+
+//! Ends a TLevelWriterTzl write on the registry when going out of scope.
+class TzlWriteEnd {
+  QString m_path;
+
+public:
+  TzlWriteEnd(const QString &path) : m_path(path) {}
+  ~TzlWriteEnd() { TzlFilesRegistry::instance()->endWrite(m_path); }
+};
+
+//-------------------------------------------------------------------
+
+//! Reads frame data either from a file mapping, or from a FILE channel.
+class TzlStream {
+  FILE *m_chan;
+  const UCHAR *m_data;
+  qint64 m_size, m_pos;
+
+public:
+  TzlStream(FILE *chan, const UCHAR *data, qint64 size)
+      : m_chan(chan), m_data(data), m_size(size), m_pos(0) {}
+
+  bool isMapped() const { return m_data != 0; }
+
+  void seek(TINT32 offs) {
+    if (m_data)
+      m_pos = offs;
+    else
+      fseek(m_chan, offs, SEEK_SET);
+  }
+
+  void read(void *dst, size_t size) {
+    if (!m_data) {
+      if (fread(dst, size, 1, m_chan) != 1)
+        throw TException("Loading tlv: unexpected end of file.");
+      return;
+    }
+
+    if (m_pos + (qint64)size > m_size)
+      throw TException("Loading tlv: unexpected end of file.");
+
+    memcpy(dst, m_data + m_pos, size);
+    m_pos += size;
+  }
+
+  //! Returns a pointer to the next \b size bytes in the mapping, or 0 if
+  //! the stream is not mapped.
+  const UCHAR *map(size_t size) {
+    if (!m_data) return 0;
+
+    if (m_pos + (qint64)size > m_size)
+      throw TException("Loading tlv: unexpected end of file.");
+
+    const UCHAR *result = m_data + m_pos;
+    m_pos += size;
+    return result;
+  }
+};
+
+}  // namespace
+
 static bool adjustIconAspectRatio(TDimension &outDimension,
                                   TDimension inDimension, TDimension imageRes) {
   TINT32 iconLx = inDimension.lx, iconLy = inDimension.ly;
@@ -523,6 +829,7 @@ TLevelWriterTzl::TLevelWriterTzl(const TFilePath &path, TPropertyGroup *info)
     , m_overwritePaletteFlag(true) {
   m_path        = path;
   m_palettePath = path.withNoFrame().withType("tpl");
+  TzlFilesRegistry::instance()->beginWrite(path.getQString());
   TFileStatus fs(path);
   m_magic     = (m_version == 14) ? "TLV14B1a" : "TLV15B1a";  // actual version
   erasedFrame = false;
@@ -574,6 +881,9 @@ TLevelWriterTzl::TLevelWriterTzl(const TFilePath &path, TPropertyGroup *info)
 //-------------------------------------------------------------------
 
 TLevelWriterTzl::~TLevelWriterTzl() {
+  // Readers may map the file again once it is complete
+  TzlWriteEnd writeEnd(m_path.getQString());
+
   if (m_version < currentVersion()) {
     if (!convertToLatestVersion()) return;
     assert(m_version == currentVersion());
@@ -640,6 +950,8 @@ TLevelWriterTzl::~TLevelWriterTzl() {
   fclose(m_chan);
   m_chan = 0;
 
+  TzlFilesRegistry::instance()->invalidate(m_path.getQString());
+
   if (m_palette && m_overwritePaletteFlag &&
       (m_palette->getDirtyFlag() ||
        !TSystem::doesExistFileOrLevel(m_palettePath))) {
@@ -662,7 +974,10 @@ TLevelWriterTzl::~TLevelWriterTzl() {
   // è maggiore di una certa soglia oppure è stato rimosso almeno un frame
   // allora ottimizzo il file
   // (in pratica risalvo il file da capo senza buchi).
-  if (getFreeSpace() > 0.3 || erasedFrame) optimize();
+  if (getFreeSpace() > 0.3 || erasedFrame) {
+    optimize();
+    TzlFilesRegistry::instance()->invalidate(m_path.getQString());
+  }
 }
 
 //-------------------------------------------------------------------
@@ -1486,9 +1801,47 @@ TLevelReaderTzl::TLevelReaderTzl(const TFilePath &path)
 
   if (!m_chan) return;
 
-  if (!readHeaderAndOffsets(m_chan, m_frameOffsTable, m_iconOffsTable, m_res,
-                            m_version, m_creator, 0, 0, 0, m_level))
-    return;
+  TzlFilesRegistry *registry = TzlFilesRegistry::instance();
+
+  QString qpath(path.getQString());
+  QFileInfo fi(qpath);
+
+  TzlFileIndex index;
+  if (registry->getIndex(qpath, fi, index) &&
+      readIndexStamp(m_chan, fi.size()) == index.m_stamp) {
+    m_frameOffsTable = index.m_frameOffsTable;
+    m_iconOffsTable  = index.m_iconOffsTable;
+    m_res            = index.m_res;
+    m_version        = index.m_version;
+    m_creator        = index.m_creator;
+
+    TzlOffsetMap::iterator it;
+    for (it = m_frameOffsTable.begin(); it != m_frameOffsTable.end(); ++it)
+      m_level->setFrame(it->first, TImageP());
+  } else {
+    rewind(m_chan);
+    if (!readHeaderAndOffsets(m_chan, m_frameOffsTable, m_iconOffsTable, m_res,
+                              m_version, m_creator, 0, 0, 0, m_level))
+      return;
+
+    // Version 10 files are indexed lazily while reading frames
+    if (m_version > 10) {
+      index.m_frameOffsTable = m_frameOffsTable;
+      index.m_iconOffsTable  = m_iconOffsTable;
+      index.m_res            = m_res;
+      index.m_version        = m_version;
+      index.m_creator        = m_creator;
+      index.m_lastModified   = fi.lastModified();
+      index.m_fileSize       = fi.size();
+
+      // Reusing the index takes reading the header only - not the tables
+      index.m_stamp = readIndexStamp(m_chan, fi.size());
+      if (!index.m_stamp.isEmpty()) registry->storeIndex(qpath, index);
+    }
+  }
+
+  // Frames data of recent versions can be read from a shared mapping
+  if (m_version >= 14) m_mapping = registry->getMapping(qpath, fi);
 
   TFilePath historyFp = path.withNoFrame().withType("hst");
   FILE *historyChan   = fopen(historyFp, "r");
@@ -2087,14 +2440,29 @@ TImageP TImageReaderTzl::load14() {
       iconIt == m_lrp->m_iconOffsTable.end())
     throw TException("Loading tlv: frame ID not found.");
 
-  fseek(chan, it->second.m_offs, SEEK_SET);
-  fread(&sbx0, sizeof(TINT32), 1, chan);
-  fread(&sby0, sizeof(TINT32), 1, chan);
-  fread(&sblx, sizeof(TINT32), 1, chan);
-  fread(&sbly, sizeof(TINT32), 1, chan);
-  fread(&actualBuffSize, sizeof(TINT32), 1, chan);
-  fread(&xdpi, sizeof(double), 1, chan);
-  fread(&ydpi, sizeof(double), 1, chan);
+  // Read straight from the file mapping, while the file is unchanged since
+  // it was mapped. Data on big endian machines must be swapped in place, so
+  // they always read a copy.
+  TzlMappedFile *mapping = m_lrp->m_mapping.get();
+#if TNZ_LITTLE_ENDIAN
+  bool mapped = mapping && mapping->contains(it->second) &&
+                mapping->contains(iconIt->second) &&
+                TzlFilesRegistry::instance()->isReadable(*mapping);
+#else
+  bool mapped = false;
+#endif
+
+  TzlStream stream(chan, mapped ? mapping->data() : 0,
+                   mapped ? mapping->size() : 0);
+
+  stream.seek(it->second.m_offs);
+  stream.read(&sbx0, sizeof(TINT32));
+  stream.read(&sby0, sizeof(TINT32));
+  stream.read(&sblx, sizeof(TINT32));
+  stream.read(&sbly, sizeof(TINT32));
+  stream.read(&actualBuffSize, sizeof(TINT32));
+  stream.read(&xdpi, sizeof(double));
+  stream.read(&ydpi, sizeof(double));
 
   if (sbx0 < 0 || sby0 < 0 || sblx < 0 || sbly < 0 || sblx > m_lx ||
       sbly > m_ly)
@@ -2112,23 +2480,27 @@ TImageP TImageReaderTzl::load14() {
 
   // Carico l'icona dal file
   if (m_isIcon) {
-    fseek(chan, iconIt->second.m_offs, SEEK_SET);
-    fread(&iconLx, sizeof(TINT32), 1, chan);
-    fread(&iconLy, sizeof(TINT32), 1, chan);
+    stream.seek(iconIt->second.m_offs);
+    stream.read(&iconLx, sizeof(TINT32));
+    stream.read(&iconLy, sizeof(TINT32));
     assert(iconLx > 0 && iconLy > 0);
     if (iconLx < 0 || iconLy < 0 || iconLx > m_lx || iconLy > m_ly)
       throw TException("Loading tlv: bad icon size.");
-    fread(&actualBuffSize, sizeof(TINT32), 1, chan);
+    stream.read(&actualBuffSize, sizeof(TINT32));
 
     if (actualBuffSize <= 0 ||
         actualBuffSize > (int)(iconLx * iconLx * sizeof(TPixelCM32)))
       throw TException("Loading tlv: icon buffer size error.");
 
-    TRasterCM32P raux = TRasterCM32P(iconLx, iconLy);
-    if (!raux) return TImageP();
-    raux->lock();
-    imgBuff = (UCHAR *)raux->getRawData();  // new UCHAR[imgBuffSize];
-    fread(imgBuff, actualBuffSize, 1, chan);
+    // When not mapped, only the compressed data is read - not a whole raster
+    const UCHAR *mappedBuff = stream.map(actualBuffSize);
+
+    std::vector<UCHAR> buff;
+    if (!mappedBuff) {
+      buff.resize(actualBuffSize);
+      imgBuff = buff.data();
+      stream.read(imgBuff, actualBuffSize);
+    }
 
 #if !TNZ_LITTLE_ENDIAN
     Header *header    = (Header *)imgBuff;
@@ -2139,11 +2511,10 @@ TImageP TImageReaderTzl::load14() {
 
     TRasterCodecLZO codec("LZO", false);
     TRasterP ras;
-    if (!codec.decompress(imgBuff, actualBuffSize, ras, m_safeMode))
+    if (!codec.decompress(mappedBuff ? mappedBuff : imgBuff, actualBuffSize,
+                          ras, m_safeMode))
       return TImageP();
     assert((TRasterCM32P)ras);
-    raux->unlock();
-    raux = TRasterCM32P();
 
 #if !TNZ_LITTLE_ENDIAN
 
@@ -2224,18 +2595,17 @@ TImageP TImageReaderTzl::load14() {
       actualBuffSize > (int)(m_lx * m_ly * sizeof(TPixelCM32)))
     throw TException("Loading tlv: buffer size error");
 
-  TRasterCM32P raux = TRasterCM32P(m_lx, m_ly);
+  // When not mapped, only the compressed data is read - not a whole raster
+  const UCHAR *mappedBuff = stream.map(actualBuffSize);
 
-  // imgBuffSize = m_lx*m_ly*sizeof(TPixelCM32);
-
-  raux->lock();
-  imgBuff = (UCHAR *)raux->getRawData();  // new UCHAR[imgBuffSize];
-  // int ret =
-
-  fread(imgBuff, actualBuffSize, 1, chan);
-  // assert(ret==1);
+  std::vector<UCHAR> buff;
+  if (!mappedBuff) {
+    buff.resize(actualBuffSize);
+    imgBuff = buff.data();
+    stream.read(imgBuff, actualBuffSize);
+  }
 
-  Header *header = (Header *)imgBuff;
+  Header *header = (Header *)(mappedBuff ? mappedBuff : imgBuff);
 
 #if !TNZ_LITTLE_ENDIAN
   header->m_lx      = swapTINT32(header->m_lx);
@@ -2245,7 +2615,8 @@ TImageP TImageReaderTzl::load14() {
 
   TRasterCodecLZO codec("LZO", false);
   TRasterP ras;
-  if (!codec.decompress(imgBuff, actualBuffSize, ras, m_safeMode))
+  if (!codec.decompress(mappedBuff ? mappedBuff : imgBuff, actualBuffSize, ras,
+                        m_safeMode))
     return TImageP();
   assert((TRasterCM32P)ras);
   assert(ras->getLx() == header->m_lx);
@@ -2254,8 +2625,6 @@ TImageP TImageReaderTzl::load14() {
     throw TException("Loading tlv: lx dimension error.");
   if (ras->getLy() != header->m_ly)
     throw TException("Loading tlv: ly dimension error.");
-  raux->unlock();
-  raux = TRasterCM32P();
 
 #if !TNZ_LITTLE_ENDIAN
 
@@ -5,9 +5,11 @@
 
 #include "tlevel_io.h"
 #include <set>
+#include <memory>
 
 class TImageWriterTzl;
 class TImageReaderTzl;
+class TzlMappedFile;
 
 //===========================================================================
 
@@ -175,6 +177,10 @@ private:
   QString m_creator;
   bool m_readPalette;
 
+  //! Read-only memory mapping of the file, shared among the readers of the
+  //! same file. May be empty, in which case m_chan is used.
+  std::shared_ptr<TzlMappedFile> m_mapping;
+
 public:
   static TLevelReader *create(const TFilePath &f) {
     return new TLevelReaderTzl(f);
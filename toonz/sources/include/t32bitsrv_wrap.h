@@ -9,6 +9,7 @@
 // TnzCore includes
 #include "tcommon.h"
 #include "traster.h"
+#include "timage_io.h"
 #include "tipc.h"
 
 // Qt includes
@@ -102,6 +103,36 @@ public:
   int write(char *dstBuf, int len) override;
 };
 
+//*************************************************************************************
+//  Raster saver
+//*************************************************************************************
+
+/*!
+  Saves a 32-bit raster received through tipc::readShMemBuffer(). When the
+  raster fits in the shared memory segment, it is saved directly from there -
+  without copying it to a local raster first.
+*/
+class DVAPI RasterSaver final : public tipc::ShMemReader {
+  TImageWriterP m_iw;
+  int m_lx, m_ly;
+
+  TRaster32P m_ras;  //!< Holds the raster received in more chunks
+  int m_received;
+  bool m_saved, m_ok;
+
+public:
+  RasterSaver(const TImageWriterP &iw, int lx, int ly);
+
+  int read(const char *srcBuf, int len) override;
+
+  //! Saves the raster, unless already saved. Returns whether the raster
+  //! was saved successfully.
+  bool save();
+
+private:
+  void save(const TRaster32P &ras);
+};
+
 }  // namespace t32bitsrv
 
 #endif  // T32BITSRV_WRAP
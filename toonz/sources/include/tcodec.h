@@ -5,6 +5,8 @@
 
 #include "traster.h"
 
+#include <vector>
+
 #undef DVAPI
 #undef DVVAR
 #ifdef TRASTERIMAGE_EXPORTS
@@ -18,10 +20,26 @@
 //------------------------------------------------------------------------------
 
 class DVAPI TRasterCodec {
+public:
+  typedef TRasterCodec *(*Creator)(const std::string &name);
+
 public:
   TRasterCodec(const std::string &name) : m_name(name) {}
   virtual ~TRasterCodec() {}
 
+  const std::string &getName() const { return m_name; }
+
+  //! Returns a GR8 raster storing the compressed data, or an empty raster
+  //! on failure.
+  virtual TRasterP compress(const TRasterP &inRas, int allocUnit,
+                            TINT32 &outDataSize) {
+    return TRasterP();
+  }
+  virtual void decompress(const TRasterP &compressedRas, TRasterP &outRas) {}
+
+  //! Releases the internal compression buffers.
+  virtual void reset() {}
+
   // virtual int getMaxCompressionSize(int size) = 0;
   // virtual void compress  (const TRasterP &inRas, int allocUnit, UCHAR**
   // outData, TINT32 &outDataSize) = 0;
@@ -32,8 +50,17 @@ public:
   // virtual UCHAR *removeHeader(const UCHAR* inData, TINT32 inDataSize, TINT32
   // &outDataSize, int &lx, int &ly) = 0;
 
+  /*!
+    Returns a new instance of the codec declared with the specified name, or
+    0 if none was declared. The name may be followed by a colon-separated
+    compression level (eg "LZ4-HC:12"), which is passed to the creator with
+    the rest of the name.
+  */
   static TRasterCodec *create(const std::string &name);
 
+  static void declare(const std::string &name, Creator creator);
+  static void getDeclaredNames(std::vector<std::string> &names);
+
 private:
   std::string m_name;
 };
@@ -107,17 +134,28 @@ private:
 
 //------------------------------------------------------------------------------
 
+/*!
+  LZ4 frame codec. Compression levels from 3 up use the slower LZ4-HC
+  compressor, which produces noticeably smaller outputs - decompression speed
+  is unaffected. Large rasters are compressed in parallel by horizontal bands,
+  stored as consecutive LZ4 frames.
+*/
 class DVAPI TRasterCodecLz4 : public TRasterCodec {
 public:
-  TRasterCodecLz4(const std::string &name, bool useCache);
+  TRasterCodecLz4(const std::string &name, bool useCache,
+                  int compressionLevel = 0);
   ~TRasterCodecLz4();
 
-  TRasterP compress(const TRasterP &inRas, int allocUnit, TINT32 &outDataSize);
+  void setCompressionLevel(int level) { m_compressionLevel = level; }
+  int getCompressionLevel() const { return m_compressionLevel; }
+
+  TRasterP compress(const TRasterP &inRas, int allocUnit,
+                    TINT32 &outDataSize) override;
   bool decompress(const UCHAR *inData, TINT32 inDataSize, TRasterP &outRas,
                   bool safeMode);
-  void decompress(const TRasterP &compressedRas, TRasterP &outRas);
+  void decompress(const TRasterP &compressedRas, TRasterP &outRas) override;
 
-  void reset() {
+  void reset() override {
     if (m_useCache) return;
     m_raster = TRasterGR8P();
   }
@@ -126,6 +164,7 @@ private:
   TRasterGR8P m_raster;
   std::string m_cacheId;
   bool m_useCache;
+  int m_compressionLevel;
 
 private:
   UINT doCompress(const TRasterP &inRas, int allocUnit, TRasterGR8P &outRas);
@@ -138,12 +177,13 @@ public:
   TRasterCodecLZO(const std::string &name, bool useCache);
   ~TRasterCodecLZO();
 
-  TRasterP compress(const TRasterP &inRas, int allocUnit, TINT32 &outDataSize);
+  TRasterP compress(const TRasterP &inRas, int allocUnit,
+                    TINT32 &outDataSize) override;
   bool decompress(const UCHAR *inData, TINT32 inDataSize, TRasterP &outRas,
                   bool safeMode);
-  void decompress(const TRasterP &compressedRas, TRasterP &outRas);
+  void decompress(const TRasterP &compressedRas, TRasterP &outRas) override;
 
-  void reset() {
+  void reset() override {
     if (m_useCache) return;
     m_raster = TRasterGR8P();
   }
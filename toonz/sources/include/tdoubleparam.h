@@ -82,6 +82,11 @@ public:
   // (e.g. expression and linear) then getValue(frame,true) can be !=
   // getValue(frame,false)
 
+  //! stores in values the value at frame, frame + step, ... (count values):
+  //! faster than calling getValue() for each frame
+  void getValues(double frame, int count, double *values,
+                 double step = 1.0) const;
+
   bool setValue(double frame, double value);
 
   // returns the incoming speed vector for keyframe kIndex. kIndex-1 must be
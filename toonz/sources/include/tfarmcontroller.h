@@ -92,6 +92,15 @@ public:
 
   virtual void queryTaskInfo(const QString &id, TFarmTask &task) = 0;
 
+  // resizes tasks to the number of ids, and updates each task with the infoes
+  // about the task whose id has the same index. Proxies query all the tasks
+  // in a single request
+  virtual void queryTaskInfo(const std::vector<QString> &ids,
+                             std::vector<TFarmTask> &tasks) {
+    tasks.resize(ids.size());
+    for (int i = 0; i < (int)ids.size(); ++i) queryTaskInfo(ids[i], tasks[i]);
+  }
+
   virtual void queryTaskShortInfo(const QString &id, QString &parentId,
                                   QString &name, TaskState &status) = 0;
 
@@ -110,6 +119,11 @@ public:
   virtual void taskProgress(const QString &taskId, int step, int stepCount,
                             int frameNumber, FrameState state) = 0;
 
+  // used by a running task to know the last frame of its range, which the
+  // controller may shorten to assign the remaining frames to an idle server.
+  // Returns -1 if the range is unknown
+  virtual int queryTaskRangeEnd(const QString &taskId) = 0;
+
   // used by a server to notify a task completion
   virtual void taskCompleted(const QString &taskId, int exitCode) = 0;
 
@@ -139,6 +139,18 @@ public:
   QString getCommandLine(bool isFarmTask = false) const;
   void parseCommandLine(QString commandLine);
 
+  //! Returns the number of frames in the task range
+  int getFrameCount() const { return (m_to - m_from) / m_step + 1; }
+
+  //! Returns how many frames an idle server should take from the tail of this
+  //! running task, rendered at the specified speed - or 0, when they are not
+  //! worth the start-up of another task
+  int getStealableFrames(double secondsPerFrame) const;
+
+  //! Shortens the task range to its first keptFrames frames, returning the
+  //! ones left in [from, to]. Returns false if there are none.
+  bool splitRange(int keptFrames, int &from, int &to);
+
   // TPersist
   void loadData(TIStream &is) override;
   void saveData(TOStream &os) override;
@@ -187,4 +199,31 @@ private:
   std::unique_ptr<Imp> m_imp;
 };
 
+//------------------------------------------------------------------------------
+
+//! Numbers the tasks added to a farm controller, across its restarts.
+/*!
+  Task ids are increasing numbers - subtasks append ".<n>" to the id of their
+  parent. The next number is kept in a file, which may be outdated when the
+  controller was not stopped properly: the numbers of the tasks reloaded at
+  startup must be skipped too.
+*/
+class TFARMAPI TFarmTaskIds {
+public:
+  TFarmTaskIds(const TFilePath &fp);
+
+  void load();        //!< Reads the next number from the file, if any
+  void save() const;  //!< Writes the next number to the file
+
+  //! Makes sure that next ids come after the specified (loaded) one
+  void skip(const TFarmTask::Id &id);
+
+  TFarmTask::Id next() { return QString::number(m_next++); }
+  int getNextNumber() const { return m_next; }
+
+private:
+  TFilePath m_fp;
+  int m_next;
+};
+
 #endif
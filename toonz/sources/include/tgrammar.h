@@ -4,6 +4,7 @@
 #define TGRAMMAR_INCLUDED
 
 #include <memory>
+#include <vector>
 
 // TnzCore includes
 #include "tcommon.h"
@@ -31,6 +32,7 @@ class TUnit;
 namespace TSyntax {
 class Token;
 class Calculator;
+class CalculatorNode;
 }  // namespace TSyntax
 
 //==============================================
@@ -49,6 +51,77 @@ public:
 
 //-------------------------------------------------------------------
 
+//! The flat, postfix form of a calculator nodes tree, run on a stack of
+//! values. Nodes which can't be compiled are computed as a whole.
+
+class DVAPI CalculatorProgram {
+public:
+  typedef double (*Op1)(double);
+  typedef double (*Op2)(double, double);
+  typedef double (*Op3)(double, double, double);
+
+private:
+  enum OpCode {
+    PushNumber,
+    PushVariable,
+    CallOp1,
+    CallOp2,
+    CallOp3,
+    Chs,
+    Not,
+    JumpIfZero,
+    Jump,
+    ComputeNode
+  };
+
+  struct Instruction {
+    int m_opCode;
+    int m_arg;  //!< Variable index, or jump target
+    union {
+      double m_value;
+      Op1 m_op1;
+      Op2 m_op2;
+      Op3 m_op3;
+      const CalculatorNode *m_node;
+    };
+
+    Instruction(int opCode) : m_opCode(opCode), m_arg(0), m_value(0) {}
+  };
+
+  std::vector<Instruction> m_code;
+  int m_depth, m_maxDepth;  //!< Stack size after the code, and its maximum
+
+public:
+  CalculatorProgram() : m_depth(0), m_maxDepth(0) {}
+
+  void clear();
+
+  void addNumber(double value);
+  void addVariable(int varIdx);
+  void addOp1(Op1 op);
+  void addOp2(Op2 op);
+  void addOp3(Op3 op);
+  void addChs();
+  void addNot();
+  void addNode(const CalculatorNode *node);  //!< Pushes node->compute()
+
+  //! Pops a value, and jumps to the target set by setJumpTarget() if zero.
+  //! Returns the jump to be passed to setJumpTarget().
+  int addJumpIfZero();
+  //! Jumps to the target set by setJumpTarget(). The value pushed before the
+  //! jump is on the stack at the target only.
+  int addJump();
+  //! Sets the target of the jump to the next added instruction
+  void setJumpTarget(int jump);
+
+  double run(double vars[3]) const;
+
+private:
+  void add(const Instruction &instruction, int depthChange);
+};
+
+//-------------------------------------------------------------------
+
 class DVAPI CalculatorNode {
   Calculator *m_calculator;
 
@@ -63,6 +136,11 @@ public:
 
   virtual void accept(CalculatorNodeVisitor &visitor) = 0;
 
+  //! Appends the node to program. By default, it is computed as a whole.
+  virtual void compile(CalculatorProgram &program) const {
+    program.addNode(this);
+  }
+
   virtual bool hasReference() const { return false; }
 
 private:
@@ -74,7 +152,8 @@ private:
 //-------------------------------------------------------------------
 
 class DVAPI Calculator {
-  CalculatorNode *m_rootNode;  //!< (owned) Root calculator node
+  CalculatorNode *m_rootNode;   //!< (owned) Root calculator node
+  CalculatorProgram m_program;  //!< The compiled root node
 
   TDoubleParam *m_param;  //!< (not owned) Owner of the calculator object
   const TUnit *m_unit;    //!< (not owned)
@@ -88,7 +167,7 @@ public:
   double compute(double t, double frame, double rframe) {
     double vars[3];
     vars[0] = t, vars[1] = frame, vars[2] = rframe;
-    return m_rootNode->compute(vars);
+    return m_program.run(vars);
   }
 
   void accept(CalculatorNodeVisitor &visitor) { m_rootNode->accept(visitor); }
@@ -119,6 +198,10 @@ public:
   double compute(double vars[3]) const override { return m_value; }
 
   void accept(CalculatorNodeVisitor &visitor) override {}
+
+  void compile(CalculatorProgram &program) const override {
+    program.addNumber(m_value);
+  }
 };
 
 //-------------------------------------------------------------------
@@ -133,6 +216,10 @@ public:
   double compute(double vars[3]) const override { return vars[m_varIdx]; }
 
   void accept(CalculatorNodeVisitor &visitor) override {}
+
+  void compile(CalculatorProgram &program) const override {
+    program.addVariable(m_varIdx);
+  }
 };
 
 //-------------------------------------------------------------------
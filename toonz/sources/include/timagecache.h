@@ -79,6 +79,19 @@ public:
   //! Returns true or false whether the cache is active or not.
   bool isEnabled();
 
+  //! Sets the maximum amount of memory (in bytes) that cached images may
+  //! occupy before the least recently used ones get compressed or swapped to
+  //! disk. A zero budget (the default) relies on the system's memory shortage
+  //! heuristics instead.
+  void setMemoryBudget(TUINT64 bytes);
+  TUINT64 getMemoryBudget() const;
+
+  //! Sets the codec used to compress images in memory, by its declared
+  //! TRasterCodec name (eg "LZ4", "LZ4-HC" or "LZ4-HC:12"). Returns false
+  //! if no such codec was declared.
+  bool setCompressionCodec(const std::string &codecName);
+  std::string getCompressionCodec() const;
+
   //! Sets the hard disk swap directory. It is set by default in the
   //! \it{stuff\cache} folder.
   void setRootDir(const TFilePath &fp);
@@ -123,15 +136,15 @@ public:
   //! no image was found.
   TImageP get(const std::string &id, bool toBeModified) const;
 
-  //! Returns the RAM memory size (KB) occupied by the image cache.
-  UINT getMemUsage() const;
+  //! Returns the RAM memory size (bytes) occupied by the image cache.
+  TUINT64 getMemUsage() const;
   //! Returns the swap files size (KB) currently allocated by the image cache.
   //! \n \n \b{NOTE:} This function is not implemented yet!
   UINT getDiskUsage() const;
 
   UINT getUncompressedMemUsage(const std::string &id) const;
 
-  //! Returns the RAM memory size (KB) of the image associated to passed id.
+  //! Returns the RAM memory size (bytes) of the image associated to passed id.
   UINT getMemUsage(const std::string &id) const;
   UINT getDiskUsage(const std::string &id) const;
 
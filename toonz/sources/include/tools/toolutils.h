@@ -480,6 +480,15 @@ void DVAPI updateSaveBox(const TXshSimpleLevelP &sl, const TFrameId &fid,
                          TImageP img);
 void DVAPI updateSaveBox();
 
+/*
+    Same as above, for colormap frames which have only been painted (with
+   non-transparent styles) inside paintedRect: the savebox is enlarged to
+   include it, without scanning the image.
+  */
+
+void DVAPI expandSaveBox(const TXshSimpleLevelP &sl, const TFrameId &fid,
+                         const TRect &paintedRect);
+
 bool DVAPI isJustCreatedSpline(TImage *image);
 
 TRectD DVAPI interpolateRect(const TRectD &rect1, const TRectD &rect2,
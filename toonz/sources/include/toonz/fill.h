@@ -62,8 +62,10 @@ class TTileSaverFullColor;
 //=============================================================================
 
 // returns true if the savebox is changed typically, if you fill the bg)
+// If filledBox is given, it is enlarged to include the painted pixels - so
+// that the savebox can be updated without scanning the whole raster.
 DVAPI bool fill(const TRasterCM32P &r, const FillParameters &params,
-                TTileSaverCM32 *saver = 0);
+                TTileSaverCM32 *saver = 0, TRect *filledBox = 0);
 
 DVAPI void fill(const TRaster32P &ras, const TRaster32P &ref,
                 const FillParameters &params, TTileSaverFullColor *saver = 0);
@@ -0,0 +1,150 @@
+#pragma once
+
+#ifndef IMAGEPREFETCHER_H
+#define IMAGEPREFETCHER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// TnzCore includes
+#include "tcommon.h"
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TOONZLIB_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//=====================================================
+
+//  Forward declarations
+
+class TXsheet;
+class TXshSimpleLevel;
+class TFrameId;
+
+//=====================================================
+
+//***************************************************************************************
+//    ImagePrefetcher declaration
+//***************************************************************************************
+
+//! ImagePrefetcher is a singleton class that loads in background the level
+//! frames that are about to be displayed during playback or scrubbing.
+/*!
+    Whenever the current frame changes, users should invoke prefetch() with the
+    current xsheet row and the play direction. The prefetcher walks the next
+    cells of the xsheet (entering sub-xsheets) and loads the associated images
+    through the ImageManager on background threads - so that built images are
+    stored in the TImageCache exactly as if the viewer had requested them.
+    Viewers showing frames from other sources (eg the flipbook) pass the frames
+    to be displayed next, each with its own loader.
+    \n\n
+    A request for a new frame supersedes any pending load of the previous ones.
+    The frames loaded ahead of the current one are bounded by both the
+    look-ahead and the memory budget.
+    \n\n
+    Viewers report through recordDisplay() whether the frames of the last
+    request were found in cache when they were actually displayed. The
+    resulting statistics are reset when playback starts, and reported to the
+    TLogger when it stops - see setPlaying().
+*/
+
+class DVAPI ImagePrefetcher {
+public:
+  struct Statistics {
+    int m_hits;        //!< Displayed frames that were already in cache
+    int m_misses;      //!< Displayed frames that had to be loaded on demand
+    int m_loaded;      //!< Frames loaded by the prefetcher
+    int m_overBudget;  //!< Prefetches skipped due to the memory budget
+
+  public:
+    Statistics() : m_hits(0), m_misses(0), m_loaded(0), m_overBudget(0) {}
+
+    double hitRatio() const {
+      return (m_hits + m_misses) ? m_hits / (double)(m_hits + m_misses) : 0.0;
+    }
+  };
+
+  //! A frame to be displayed, as seen by the prefetcher.
+  struct Frame {
+    std::string m_id;  //!< The frame id in the TImageCache
+    //! Loads the frame into the TImageCache, unless already there. Returns
+    //! whether the frame was loaded. Invoked on a background thread.
+    std::function<bool()> m_load;
+  };
+
+public:
+  static ImagePrefetcher *instance();
+
+  //! Enables or disables prefetching. Disabling cancels pending loads.
+  void setEnabled(bool enabled);
+  bool isEnabled() const;
+
+  //! Sets the number of xsheet rows to be loaded ahead of the current one.
+  void setLookAhead(int rows);
+  int getLookAhead() const;
+
+  //! Sets the maximum memory, in MegaBytes, that images ahead of the current
+  //! row may take in the cache.
+  void setMemoryBudget(int megaBytes);
+  int getMemoryBudget() const;
+
+  //! Sets the maximum number of simultaneous background loads.
+  void setThreadsCount(int count);
+
+  /*!
+Starts loading the cells in the \b lookAhead rows following the specified one,
+in the specified direction (1 forward, -1 backward). Pending loads of previous
+requests are canceled. The cells at the specified row are the ones whose
+display is recorded next.
+*/
+  void prefetch(TXsheet *xsh, int row, int direction = 1);
+
+  /*!
+Starts loading the specified frames, which must be sorted by display order
+after the \b current one. Pending loads of previous requests are canceled.
+*/
+  void prefetch(const std::string &current, const std::vector<Frame> &next);
+
+  //! Returns the frame of a level in the ImageManager, as loaded by the xsheet
+  //! viewers.
+  static Frame levelFrame(TXshSimpleLevel *sl, const TFrameId &fid);
+
+  /*!
+Records whether a frame passed as current to the last prefetch() was found in
+cache when displayed. Each frame is recorded once per request, so that redraws
+do not count - other frames are ignored.
+*/
+  void recordDisplay(const std::string &id, bool cached);
+
+  //! Resets the statistics when playback starts, and reports them to the
+  //! TLogger when it stops.
+  void setPlaying(bool playing);
+
+  //! Cancels pending loads. Loads already in progress are completed.
+  void cancel();
+
+  Statistics getStatistics() const;
+  void resetStatistics();
+
+private:
+  class Imp;
+  std::unique_ptr<Imp> m_imp;
+
+private:
+  ImagePrefetcher();
+  ~ImagePrefetcher();
+
+  // Not copyable
+  ImagePrefetcher(const ImagePrefetcher &);
+  ImagePrefetcher &operator=(const ImagePrefetcher &);
+};
+
+#endif  // IMAGEPREFETCHER_H
@@ -123,6 +123,7 @@ public:
   void enableAutosave();
   void setAutosavePeriod();
   void setUndoMemorySize();
+  void setImageCacheMemorySize();
   // Interface
   void setPixelsOnly();
   void setUnits();
@@ -172,6 +173,9 @@ public:
   }
   bool isStartupPopupEnabled() { return getBoolValue(startupPopupEnabled); }
   int getUndoMemorySize() const { return getIntValue(undoMemorySize); }
+  int getImageCacheMemorySize() const {
+    return getIntValue(imageCacheMemorySize);
+  }
   int getDefaultTaskChunkSize() const { return getIntValue(taskchunksize); }
   bool isReplaceAfterSaveLevelAsEnabled() const {
     return getBoolValue(replaceAfterSaveLevelAs);
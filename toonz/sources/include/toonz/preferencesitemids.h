@@ -7,6 +7,7 @@ enum PreferencesItemId {
   rasterOptimizedMemory,
   startupPopupEnabled,
   undoMemorySize,
+  imageCacheMemorySize,
   taskchunksize,
   sceneNumberingEnabled,
   watchFileSystemEnabled,
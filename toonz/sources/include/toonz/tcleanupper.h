@@ -7,6 +7,8 @@
 #include "ttoonzimage.h"
 #include "toonz/cleanupparameters.h"
 
+#include <QStringList>
+
 #undef DVAPI
 #undef DVVAR
 #ifdef TOONZLIB_EXPORTS
@@ -86,6 +88,8 @@ The main cleanup method.
 \warning The input image reference is internally released at the most
 appropriate
 time, to unlock a possibly useful memory block.
+\note Warnings are shown to the user, unless a warnings list is given - to be
+reported by the caller, when processing outside the main thread.
 */
   CleanupPreprocessedImage *process(TRasterImageP &image, bool first_image,
                                     TRasterImageP &onlyResampledImage,
@@ -93,7 +97,8 @@ time, to unlock a possibly useful memory block.
                                     bool returnResampled          = false,
                                     bool onlyForSwatch            = false,
                                     TAffine *aff                  = 0,
-                                    TRasterP templateForResampled = 0);
+                                    TRasterP templateForResampled = 0,
+                                    QStringList *warnings         = 0);
 
   void finalize(const TRaster32P &dst, CleanupPreprocessedImage *src);
   TToonzImageP finalize(CleanupPreprocessedImage *src,
@@ -148,6 +148,8 @@ public:
   TXshColumn *getXshColumn() const override;
 
   bool isCachable() const override { return false; }
+  // The palette is read from file
+  bool isPersistentCachable() const override { return false; }
 
   bool canHandle(const TRenderSettings &info, double frame) override;
 
@@ -0,0 +1,130 @@
+#pragma once
+
+#ifndef TPERSISTENTFXCACHE_INCLUDED
+#define TPERSISTENTFXCACHE_INCLUDED
+
+#include "tcommon.h"
+#include "tfilepath.h"
+#include "tgeometry.h"
+
+#include <memory>
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TFX_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//============================================================================
+
+//  Forward declarations
+class TTile;
+class TRenderSettings;
+
+//============================================================================
+
+//=====================================
+//    TPersistentFxCache class
+//-------------------------------------
+
+/*!
+  The TPersistentFxCache is a content-addressed, on-disk store of fx render
+  results that survives the process lifetime.
+
+  Entries are keyed by a hash of the fx subtree alias (which already encodes
+  the fx types, the connected inputs and the parameter values at the given
+  frame), the frame, the rendered tile geometry and the TRenderSettings
+  fields that affect the output pixels. Settings that only influence \a how
+  a render is performed (like the maximum tile size or the swatch flag) are
+  deliberately left out, so that the GUI and \p tcomposer instances pointing
+  to the same folder reuse each other's tiles.
+
+  Entries are written by a dedicated thread, so that render threads only
+  copy the result. Files are written to a temporary name and then renamed,
+  so the folder can be shared among concurrent processes (eg farm nodes).
+  When the folder exceeds the specified maximum size, the least recently
+  used entries are removed.
+
+  Fxs whose output depends on data not described by their alias (like
+  external files) opt out by returning false from
+  TRasterFx::isPersistentCachable(): their aliases then contain the
+  uncachableToken(), and no subtree including them is stored.
+
+  The entries in the folder are indexed in memory, so that cache misses do
+  not access the disk. The index is rebuilt periodically by the writer
+  thread, to pick up the entries stored by other processes.
+
+  The cache is disabled until a valid path is specified with setPath().
+*/
+
+class DVAPI TPersistentFxCache {
+  class Imp;
+  std::unique_ptr<Imp> m_imp;
+
+  TPersistentFxCache();
+  ~TPersistentFxCache();
+
+public:
+  static TPersistentFxCache *instance();
+
+  //! Sets the cache folder. An empty path disables the cache.
+  void setPath(const TFilePath &path);
+  TFilePath getPath() const;
+
+  bool isEnabled() const;
+
+  //! Sets the maximum size, in MegaBytes, of the cache folder.
+  void setMaximumSize(int megaBytes);
+  int getMaximumSize() const;
+
+  //! Sets the minimum time, in milliseconds, that an fx computation must
+  //! take in order to be stored on disk.
+  void setMinimumComputeTime(int msec);
+  int getMinimumComputeTime() const;
+
+  //! Returns true if the cache folder holds no entry.
+  bool isEmpty() const;
+
+  //! Returns the key associated to the specified fx computation.
+  std::string getKey(const std::string &alias, double frame,
+                     const TRectD &rect, const TRenderSettings &info) const;
+
+  //! Attempts retrieval of the specified entry into the passed tile, whose
+  //! raster must already be allocated. Returns false on cache miss.
+  bool load(const std::string &key, const TTile &tile);
+
+  //! Queues the tile content for storage. The entry is written by the writer
+  //! thread - or dropped, if too many bytes are already waiting.
+  void store(const std::string &key, const TTile &tile);
+
+  //! Waits until the queued entries have been written.
+  void flush();
+
+  //! Prevents the reuse of entries whose alias embeds the specified level
+  //! path for the rest of the session. Used on level editing. A path with a
+  //! frame invalidates that frame only, as found in column aliases; a path
+  //! without frame invalidates every frame of the level.
+  void invalidateLevel(const std::string &levelPath);
+
+  //! Returns whether results of the fx subtree with the specified alias
+  //! may be stored and retrieved.
+  bool isCachable(const std::string &alias) const;
+
+  //! The token marking the aliases of fxs that opted out of the cache.
+  static const char *uncachableToken() { return "$uncachable"; }
+
+  //! Removes every entry from the cache folder.
+  void clear();
+
+  //! Returns a string identifying the current disk version of the
+  //! specified file - to be used in the aliases of file-based fxs. If the
+  //! file does not exist or has unsaved \a modifications, the returned stamp
+  //! is unique to this process, so that other sessions won't reuse results.
+  static std::string getFileStamp(const TFilePath &fp, bool modified = false);
+};
+
+#endif  // TPERSISTENTFXCACHE_INCLUDED
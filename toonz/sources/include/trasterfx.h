@@ -264,6 +264,11 @@ public:
 
   virtual bool isCachable() const { return true; }
 
+  //! Returns false if the fx output depends on data not described by its
+  //! alias (like external files), so that it must not be stored in the
+  //! persistent fx cache. See TPersistentFxCache.
+  virtual bool isPersistentCachable() const { return true; }
+
   virtual void transform(double frame, int port, const TRectD &rectOnOutput,
                          const TRenderSettings &infoOnOutput,
                          TRectD &rectOnInput, TRenderSettings &infoOnInput);
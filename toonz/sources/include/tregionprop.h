@@ -83,6 +83,13 @@ class OutlineRegionProp final : public TRegionProp {
 public:
   OutlineRegionProp(const TRegion *region, const TOutlineStyleP regionStyle);
 
+  //! Builds the polyline bounding the specified region, linearizing its edges
+  //! up to the specified pixel size. Returns whether the region needs
+  //! antialiasing - ie if at least one of its edges is invisible.
+  static bool computeOutline(const TRegion *region,
+                             TRegionOutline::PointVector &polyline,
+                             const double pixelSize);
+
   void draw(const TVectorRenderData &rd) override;
 
   const TColorStyle *getColorStyle() const override;
@@ -215,6 +215,11 @@ public:
   void enablePrecomputing(bool on);
   bool isPrecomputingEnabled() const;
 
+  //! Enables the subdivision of frames into tiles that are computed in
+  //! parallel, whenever fewer frames than threads are being rendered.
+  void enableTiledRendering(bool on);
+  bool isTiledRenderingEnabled() const;
+
   void setThreadsCount(int nThreads);
 
   static TRenderer instance();
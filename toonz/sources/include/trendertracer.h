@@ -0,0 +1,109 @@
+#pragma once
+
+#ifndef TRENDERTRACER_INCLUDED
+#define TRENDERTRACER_INCLUDED
+
+#include "tcommon.h"
+#include "tfilepath.h"
+
+#include <memory>
+#include <vector>
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TFX_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//============================================================================
+
+//=================================
+//    TRenderTracer class
+//---------------------------------
+
+/*!
+  The TRenderTracer records timed events about the render pipeline - fx
+  computations, tile allocations, cache hits and misses - in order to find
+  out which fxs are responsible for the cost of a frame.
+
+  Events are recorded per thread, and can be saved in the Chrome trace-event
+  JSON format (to be opened with chrome://tracing or similar viewers).
+
+  The tracer is disabled by default; while disabled, recording functions
+  return immediately.
+*/
+
+class DVAPI TRenderTracer {
+  class Imp;
+  std::unique_ptr<Imp> m_imp;
+
+  TRenderTracer();
+  ~TRenderTracer();
+
+public:
+  //! Additional event data, as (name, JSON value) pairs.
+  typedef std::vector<std::pair<std::string, std::string>> Args;
+
+public:
+  static TRenderTracer *instance();
+
+  //! Enables or disables events recording. Enabling the tracer also resets
+  //! its time origin.
+  void setEnabled(bool enabled);
+  bool isEnabled() const;
+
+  //! Discards every recorded event.
+  void clear();
+
+  //! Returns the microseconds elapsed since the tracer was enabled.
+  long long now() const;
+
+  //! Records an event with duration, in the current thread.
+  void addCompleteEvent(const std::string &name, const std::string &category,
+                        long long start, long long duration,
+                        const Args &args = Args());
+
+  //! Records an instantaneous event, in the current thread.
+  void addInstantEvent(const std::string &name, const std::string &category,
+                       const Args &args = Args());
+
+  //! Saves the recorded events in Chrome trace-event JSON format.
+  bool save(const TFilePath &fp) const;
+
+  static std::string toJson(const std::string &str);
+  static std::string toJson(double value);
+};
+
+//============================================================================
+
+//=================================
+//    TRenderTraceScope class
+//---------------------------------
+
+//! Records a complete event spanning the lifetime of the object.
+class DVAPI TRenderTraceScope {
+  std::string m_name, m_category;
+  TRenderTracer::Args m_args;
+  long long m_start;
+  bool m_enabled;
+
+public:
+  TRenderTraceScope(const std::string &category, const std::string &name);
+  ~TRenderTraceScope();
+
+  bool isEnabled() const { return m_enabled; }
+
+  void addArg(const std::string &name, const std::string &value);
+  void addArg(const std::string &name, double value);
+
+private:
+  // Not copyable
+  TRenderTraceScope(const TRenderTraceScope &);
+  TRenderTraceScope &operator=(const TRenderTraceScope &);
+};
+
+#endif  // TRENDERTRACER_INCLUDED
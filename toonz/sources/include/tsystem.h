@@ -220,6 +220,7 @@ enum CPUExtensions {
   CpuSupportsSse2 = 0x00000020L,
   // CpuSupports3DNow      = 0x00000040L,
   // CpuSupports3DNowExt   = 0x00000080L
+  CpuSupportsAvx2 = 0x00000100L,
 };
 
 /*! returns a bit mask containing the CPU extensions supported */
@@ -4,6 +4,7 @@
 #define TTCPIP_H
 
 #include <memory>
+#include <vector>
 
 #include "tcommon.h"
 
@@ -34,6 +35,8 @@ class TFARMAPI TTcpIpServer : public QThread {
   int m_exitCode;
 
 public:
+  //! Port 0 lets the system choose a free port, returned by getPort() once
+  //! the server is listening.
   TTcpIpServer(int port);
   virtual ~TTcpIpServer();
 
@@ -63,7 +66,8 @@ enum {
   CONNECTION_REFUSED,
   CONNECTION_TIMEDOUT,
   SEND_FAILED,
-  RECEIVE_FAILED
+  RECEIVE_FAILED,
+  PROTOCOL_UNSUPPORTED
 };
 
 class TFARMAPI TTcpIpClient {
@@ -78,4 +82,47 @@ public:
   int send(int sock, const QString &data, QString &reply);
 };
 
+//---------------------------------------------------------------------
+
+class TTcpIpConnectionImp;
+
+/*!
+  A persistent connection to a TTcpIpServer, using the binary protocol.
+
+  Unlike TTcpIpClient, the connection is kept open across requests, and
+  several requests can be sent before reading their replies: post() returns
+  an id to be passed to receive(), which must be called for every posted
+  request. Different threads can use the same connection at the same time.
+*/
+
+class TFARMAPI TTcpIpConnection {
+public:
+  TTcpIpConnection();
+  ~TTcpIpConnection();
+
+  //! Returns PROTOCOL_UNSUPPORTED if the server only knows the text protocol
+  int connect(const QString &name, const QString &addr, int port);
+  void disconnect();
+
+  //! Returns false if the connection has been closed - for example because
+  //! the server has been restarted.
+  bool isConnected() const;
+
+  int post(const QString &data, unsigned int &requestId);
+  int receive(unsigned int requestId, QString &reply);
+
+  int send(const QString &data, QString &reply);
+
+  //! Sends the requests in a single message; replies are in the same order.
+  int sendBatch(const std::vector<QString> &data,
+                std::vector<QString> &replies);
+
+private:
+  std::unique_ptr<TTcpIpConnectionImp> m_imp;
+
+  // Not copyable
+  TTcpIpConnection(const TTcpIpConnection &);
+  TTcpIpConnection &operator=(const TTcpIpConnection &);
+};
+
 #endif
@@ -7,6 +7,8 @@
 
 #include <QThread>
 
+#include <functional>
+
 #undef DVAPI
 #undef DVVAR
 #ifdef TNZCORE_EXPORTS
@@ -238,6 +240,35 @@ private:
   Executor(const Executor &);
 };
 
+//------------------------------------------------------------------------------
+
+//! Returns an Executor shared by the whole application, running at most one
+//! task per processor at a time. It is meant for computations split among
+//! threads by parallelFor().
+DVAPI Executor &sharedExecutor();
+
+//! Calls func(i) for each i in [0, count). Items are shared among the calling
+//! thread and some sharedExecutor() tasks - at most maxThreads threads
+//! overall, or one per processor if maxThreads is not positive - so func must
+//! be safe to call concurrently on different items.
+//! Returns once all the items have been processed; an exception thrown by
+//! func is rethrown then.
+DVAPI void parallelFor(int count, const std::function<void(int)> &func,
+                       int maxThreads = 0);
+
+//! Calls func(y0, y1) on bandsCount consecutive bands of rows covering
+//! [0, ly), through parallelFor().
+inline void parallelForBands(int ly, int bandsCount,
+                             const std::function<void(int, int)> &func,
+                             int maxThreads = 0) {
+  parallelFor(
+      bandsCount,
+      [&](int b) {
+        func((ly * b) / bandsCount, (ly * (b + 1)) / bandsCount);
+      },
+      maxThreads);
+}
+
 }  // namespace TThread
 
 #endif  // TTHREAD_H
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef TVECTORRASTERIZER_INCLUDED
+#define TVECTORRASTERIZER_INCLUDED
+
+#include "traster.h"
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TVRENDER_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//============================================================================
+
+//    Forward declarations
+
+class TVectorImage;
+class TVectorRenderData;
+
+//============================================================================
+
+//=================================
+//    TVectorRasterizer class
+//---------------------------------
+
+/*!
+  TVectorRasterizer draws vector images directly on 32 or 64-bit rasters,
+  without OpenGL - for machines where only software GL is available.
+
+  Stroke outlines and region boundaries are scan-converted computing the
+  exact area each pixel has covered, so antialiasing comes analytically and
+  no tessellation is needed. No state is shared among calls: different
+  threads can rasterize at the same time - for example, different tiles of
+  the same image.
+
+  Only strokes and regions painted with plain solid color styles are
+  supported. canRasterize() must be checked first - and TOfflineGL used
+  otherwise.
+*/
+
+class DVAPI TVectorRasterizer {
+public:
+  //! Returns whether the image can be rasterized with the specified render
+  //! data.
+  static bool canRasterize(const TVectorImage *vim,
+                           const TVectorRenderData &rd);
+
+  /*!
+Draws the image over the specified raster, which must be either 32 or 64-bit.
+As in TOfflineGL, rd.m_aff maps the image to raster coordinates, where pixel
+(x, y) spans the [x, x + 1] x [y, y + 1] square. Colors are premultiplied.
+*/
+  static void rasterize(const TRasterP &ras, const TVectorImage *vim,
+                        const TVectorRenderData &rd);
+};
+
+#endif  // TVECTORRASTERIZER_INCLUDED
@@ -12,7 +12,6 @@
 
 namespace {
 QReadWriteLock lock;
-QMutex mutex;
 
 // modify fft coordinate to normal
 inline int getCoord(int index, int lx, int ly) {
@@ -49,373 +48,12 @@ TRasterGR8P allocateRasterAndLock(T** buf, TDimensionI dim) {
   return ras;
 }
 
-// release all registered raster memories and free all fft plans
-void releaseAllRastersAndPlans(QList<TRasterGR8P>& rasterList,
-                               QList<kiss_fftnd_cfg>& planList) {
+// release all registered raster memories
+void releaseAllRasters(QList<TRasterGR8P>& rasterList) {
   for (int r = 0; r < rasterList.size(); r++) rasterList.at(r)->unlock();
-  for (int p = 0; p < planList.size(); p++) kiss_fft_free(planList.at(p));
 }
 }  // namespace
 
-//--------------------------------------------
-// thread for computing bokeh of each channel
-//--------------------------------------------
-
-BokehUtils::MyThread::MyThread(Channel channel, TRasterP layerTileRas,
-                               double4* result, double* alpha_bokeh,
-                               kiss_fft_cpx* kissfft_comp_iris,
-                               double layerGamma, double masterGamma)
-    : m_channel(channel)
-    , m_layerTileRas(layerTileRas)
-    , m_result(result)
-    , m_alpha_bokeh(alpha_bokeh)
-    , m_kissfft_comp_iris(kissfft_comp_iris)
-    , m_layerGamma(layerGamma)
-    , m_masterGamma(masterGamma)
-    , m_finished(false)
-    , m_kissfft_comp_in(0)
-    , m_kissfft_comp_out(0)
-    , m_isTerminated(false) {
-  if (m_masterGamma == 0.0) m_masterGamma = m_layerGamma;
-}
-
-bool BokehUtils::MyThread::init() {
-  // obtain the input image size
-  int lx, ly;
-  lx = m_layerTileRas->getSize().lx;
-  ly = m_layerTileRas->getSize().ly;
-
-  // memory allocation for input
-  m_kissfft_comp_in_ras = TRasterGR8P(lx * sizeof(kiss_fft_cpx), ly);
-  m_kissfft_comp_in_ras->lock();
-  m_kissfft_comp_in = (kiss_fft_cpx*)m_kissfft_comp_in_ras->getRawData();
-
-  // allocation check
-  if (m_kissfft_comp_in == 0) return false;
-
-  // cancel check
-  if (m_isTerminated) {
-    m_kissfft_comp_in_ras->unlock();
-    return false;
-  }
-
-  // memory allocation for output
-  m_kissfft_comp_out_ras = TRasterGR8P(lx * sizeof(kiss_fft_cpx), ly);
-  m_kissfft_comp_out_ras->lock();
-  m_kissfft_comp_out = (kiss_fft_cpx*)m_kissfft_comp_out_ras->getRawData();
-
-  // allocation check
-  if (m_kissfft_comp_out == 0) {
-    m_kissfft_comp_in_ras->unlock();
-    m_kissfft_comp_in = 0;
-    return false;
-  }
-
-  // cancel check
-  if (m_isTerminated) {
-    m_kissfft_comp_in_ras->unlock();
-    m_kissfft_comp_in = 0;
-    m_kissfft_comp_out_ras->unlock();
-    m_kissfft_comp_out = 0;
-    return false;
-  }
-
-  // create the forward FFT plan
-  int dims[2]        = {ly, lx};
-  int ndims          = 2;
-  m_kissfft_plan_fwd = kiss_fftnd_alloc(dims, ndims, false, 0, 0);
-  // allocation and cancel check
-  if (m_kissfft_plan_fwd == NULL || m_isTerminated) {
-    m_kissfft_comp_in_ras->unlock();
-    m_kissfft_comp_in = 0;
-    m_kissfft_comp_out_ras->unlock();
-    m_kissfft_comp_out = 0;
-    return false;
-  }
-
-  // create the backward FFT plan
-  m_kissfft_plan_bkwd = kiss_fftnd_alloc(dims, ndims, true, 0, 0);
-  // allocation and cancel check
-  if (m_kissfft_plan_bkwd == NULL || m_isTerminated) {
-    m_kissfft_comp_in_ras->unlock();
-    m_kissfft_comp_in = 0;
-    m_kissfft_comp_out_ras->unlock();
-    m_kissfft_comp_out = 0;
-    kiss_fft_free(m_kissfft_plan_fwd);
-    m_kissfft_plan_fwd = NULL;
-    return false;
-  }
-
-  // return true if all the initializations are done
-  return true;
-}
-
-//------------------------------------------------------------
-// convert layer RGB to exposure
-// multiply alpha
-// set to kiss_fft_cpx
-
-template <typename RASTER, typename PIXEL>
-void BokehUtils::MyThread::setLayerRaster(const RASTER srcRas,
-                                          kiss_fft_cpx* dstMem,
-                                          TDimensionI dim) {
-  for (int j = 0; j < dim.ly; j++) {
-    PIXEL* pix = srcRas->pixels(j);
-    for (int i = 0; i < dim.lx; i++, pix++) {
-      if (pix->m != 0) {
-        double val = (m_channel == Red)     ? (double)pix->r
-                     : (m_channel == Green) ? (double)pix->g
-                                            : (double)pix->b;
-        // multiply the exposure by alpha channel value
-        dstMem[j * dim.lx + i].r =
-            m_conv->valueToExposure(val / (double)PIXEL::maxChannelValue) *
-            ((double)pix->m / (double)PIXEL::maxChannelValue);
-      }
-    }
-  }
-}
-
-//------------------------------------------------------------
-
-void BokehUtils::MyThread::run() {
-  // get the source image size
-  TDimensionI dim = m_layerTileRas->getSize();
-  // int lx,ly;
-  int lx = m_layerTileRas->getSize().lx;
-  int ly = m_layerTileRas->getSize().ly;
-
-  // initialize
-  for (int i = 0; i < dim.lx * dim.ly; i++) {
-    m_kissfft_comp_in[i].r = 0.0;  // real part
-    m_kissfft_comp_in[i].i = 0.0;  // imaginary part
-  }
-
-  TRaster32P ras32 = (TRaster32P)m_layerTileRas;
-  TRaster64P ras64 = (TRaster64P)m_layerTileRas;
-  TRasterFP rasF   = (TRasterFP)m_layerTileRas;
-  // Prepare data for FFT.
-  // Convert the RGB values to the exposure, then multiply it by the alpha
-  // channel value
-  {
-    lock.lockForRead();
-    if (ras32)
-      setLayerRaster<TRaster32P, TPixel32>(ras32, m_kissfft_comp_in, dim);
-    else if (ras64)
-      setLayerRaster<TRaster64P, TPixel64>(ras64, m_kissfft_comp_in, dim);
-    else if (rasF)
-      setLayerRaster<TRasterFP, TPixelF>(rasF, m_kissfft_comp_in, dim);
-    else {
-      lock.unlock();
-      return;
-    }
-
-    lock.unlock();
-  }
-
-  if (checkTerminationAndCleanupThread()) return;
-
-  kiss_fftnd(m_kissfft_plan_fwd, m_kissfft_comp_in, m_kissfft_comp_out);
-  kiss_fft_free(m_kissfft_plan_fwd);  // we don't need this plan anymore
-  m_kissfft_plan_fwd = NULL;
-
-  if (checkTerminationAndCleanupThread()) return;
-
-  // Filtering. Multiply by the iris FFT data
-  {
-    for (int i = 0; i < lx * ly; i++) {
-      kiss_fft_scalar re, im;
-      re = m_kissfft_comp_out[i].r * m_kissfft_comp_iris[i].r -
-           m_kissfft_comp_out[i].i * m_kissfft_comp_iris[i].i;
-      im = m_kissfft_comp_out[i].r * m_kissfft_comp_iris[i].i +
-           m_kissfft_comp_iris[i].r * m_kissfft_comp_out[i].i;
-      m_kissfft_comp_out[i].r = re;
-      m_kissfft_comp_out[i].i = im;
-    }
-  }
-
-  if (checkTerminationAndCleanupThread()) return;
-
-  kiss_fftnd(m_kissfft_plan_bkwd, m_kissfft_comp_out,
-             m_kissfft_comp_in);       // Backward FFT
-  kiss_fft_free(m_kissfft_plan_bkwd);  // we don't need this plan anymore
-  m_kissfft_plan_bkwd = NULL;
-
-  // In the backward FFT above, "m_kissfft_comp_out" is used as input and
-  // "m_kissfft_comp_in" as output.
-  // So we don't need "m_kissfft_comp_out" anymore.
-  m_kissfft_comp_out_ras->unlock();
-  m_kissfft_comp_out = 0;
-
-  if (checkTerminationAndCleanupThread()) return;
-
-  {
-    QMutexLocker locker(&mutex);
-
-    double* alp_p  = m_alpha_bokeh;
-    double4* res_p = m_result;
-
-    for (int i = 0; i < dim.lx * dim.ly; i++, alp_p++, res_p++) {
-      if ((*alp_p) < 0.00001) continue;
-
-      double exposure =
-          (double)m_kissfft_comp_in[getCoord(i, dim.lx, dim.ly)].r /
-          (double)(dim.lx * dim.ly);
-
-      // convert to layer hardness
-      if (m_masterGamma != m_layerGamma) {
-        if (isGammaBased())
-          exposure =
-              std::pow(exposure / (*alp_p), m_masterGamma / m_layerGamma) *
-              (*alp_p);
-        else  // hardness based
-          exposure =
-              std::pow(exposure / (*alp_p), m_layerGamma / m_masterGamma) *
-              (*alp_p);
-      }
-
-      double* res = (m_channel == Red)     ? (&((*res_p).x))
-                    : (m_channel == Green) ? (&((*res_p).y))
-                                           : (&((*res_p).z));
-
-      // composite exposure
-      if ((*alp_p) >= 1.0 || (*res) == 0.0)
-        (*res) = exposure;
-      else {
-        (*res) *= 1.0 - (*alp_p);
-        (*res) += exposure;
-      }
-
-      // over compoite alpha
-      if (m_channel == Red) {
-        if ((*res_p).w < 1.0) {
-          if ((*alp_p) > 1.0)
-            (*res_p).w = 1.0;
-          else
-            (*res_p).w = (*alp_p) + (*res_p).w * (1.0 - (*alp_p));
-        }
-      }
-      //---
-    }
-  }
-
-  m_kissfft_comp_in_ras->unlock();
-  m_kissfft_comp_in = 0;
-
-  m_finished = true;
-}
-
-bool BokehUtils::MyThread::checkTerminationAndCleanupThread() {
-  if (!m_isTerminated) return false;
-
-  if (m_kissfft_comp_in) m_kissfft_comp_in_ras->unlock();
-  if (m_kissfft_comp_out) m_kissfft_comp_out_ras->unlock();
-
-  if (m_kissfft_plan_fwd) kiss_fft_free(m_kissfft_plan_fwd);
-  if (m_kissfft_plan_bkwd) kiss_fft_free(m_kissfft_plan_bkwd);
-
-  m_finished = true;
-  return true;
-}
-
-//------------------------------------
-BokehUtils::BokehRefThread::BokehRefThread(
-    int channel, kiss_fft_cpx* fftcpx_channel_before,
-    kiss_fft_cpx* fftcpx_channel, kiss_fft_cpx* fftcpx_alpha,
-    kiss_fft_cpx* fftcpx_iris, double4* result_buff,
-    kiss_fftnd_cfg kissfft_plan_fwd, kiss_fftnd_cfg kissfft_plan_bkwd,
-    TDimensionI& dim)
-    : m_channel(channel)
-    , m_fftcpx_channel_before(fftcpx_channel_before)
-    , m_fftcpx_channel(fftcpx_channel)
-    , m_fftcpx_alpha(fftcpx_alpha)
-    , m_fftcpx_iris(fftcpx_iris)
-    , m_result_buff(result_buff)
-    , m_kissfft_plan_fwd(kissfft_plan_fwd)
-    , m_kissfft_plan_bkwd(kissfft_plan_bkwd)
-    , m_dim(dim)
-    , m_finished(false)
-    , m_isTerminated(false) {}
-
-//------------------------------------
-
-void BokehUtils::BokehRefThread::run() {
-  // execute channel fft
-  kiss_fftnd(m_kissfft_plan_fwd, m_fftcpx_channel_before, m_fftcpx_channel);
-
-  // cancel check
-  if (m_isTerminated) {
-    m_finished = true;
-    return;
-  }
-
-  int size = m_dim.lx * m_dim.ly;
-
-  // multiply filter
-  for (int i = 0; i < size; i++) {
-    kiss_fft_scalar re, im;
-    re = m_fftcpx_channel[i].r * m_fftcpx_iris[i].r -
-         m_fftcpx_channel[i].i * m_fftcpx_iris[i].i;
-    im = m_fftcpx_channel[i].r * m_fftcpx_iris[i].i +
-         m_fftcpx_iris[i].r * m_fftcpx_channel[i].i;
-    m_fftcpx_channel[i].r = re;
-    m_fftcpx_channel[i].i = im;
-  }
-  // execute invert fft
-  kiss_fftnd(m_kissfft_plan_bkwd, m_fftcpx_channel, m_fftcpx_channel_before);
-
-  // cancel check
-  if (m_isTerminated) {
-    m_finished = true;
-    return;
-  }
-
-  // pixels with smaller index : normal composite exposure value
-  // pixels with the same or larger index : replace exposure value
-  double4* result_p = m_result_buff;
-  for (int i = 0; i < size; i++, result_p++) {
-    // modify fft coordinate to normal
-    int coord = getCoord(i, m_dim.lx, m_dim.ly);
-
-    double alpha = (double)m_fftcpx_alpha[coord].r / (double)size;
-    // ignore transpalent pixels
-    if (alpha < 0.00001) continue;
-
-    double exposure = (double)m_fftcpx_channel_before[coord].r / (double)size;
-
-    // in case of using upper layer at all
-    if (alpha >= 1.0 || (m_channel == 0 && (*result_p).x == 0.0) ||
-        (m_channel == 1 && (*result_p).y == 0.0) ||
-        (m_channel == 2 && (*result_p).z == 0.0)) {
-      // set exposure
-      if (m_channel == 0)  // R
-        (*result_p).x = exposure;
-      else if (m_channel == 1)  // G
-        (*result_p).y = exposure;
-      else  // B
-        (*result_p).z = exposure;
-    }
-    // in case of compositing both layers
-    else {
-      if (m_channel == 0)  // R
-      {
-        (*result_p).x *= 1.0 - alpha;
-        (*result_p).x += exposure;
-      } else if (m_channel == 1)  // G
-      {
-        (*result_p).y *= 1.0 - alpha;
-        (*result_p).y += exposure;
-      } else  // B
-      {
-        (*result_p).z *= 1.0 - alpha;
-        (*result_p).z += exposure;
-      }
-    }
-  }
-  m_finished = true;
-}
-
-//------------------------------------------------------------
-
 //------------------------------------------------------------
 // normalize the source raster image to 0-1 and set to dstMem
 // returns true if the source is (seems to be) premultiplied
@@ -951,7 +589,7 @@ void BokehUtils::compositeAsIs(const double4* segment_layer_buff,
 // Normalize the brightness of the iris image.
 // Enlarge the iris to the output size.
 void BokehUtils::convertIris(const double irisSize,
-                             kiss_fft_cpx* kissfft_comp_iris_before,
+                             kiss_fft_scalar* iris_plane,
                              const TDimensionI& dimOut, const TRectD& irisBBox,
                              const TTile& irisTile) {
   // the original size of iris image
@@ -1004,10 +642,7 @@ void BokehUtils::convertIris(const double irisSize,
 
   int iris_j = 0;
   // Initialize
-  for (int i = 0; i < dimOut.lx * dimOut.ly; i++) {
-    kissfft_comp_iris_before[i].r = 0.0f;
-    kissfft_comp_iris_before[i].i = 0.0f;
-  }
+  std::fill_n(iris_plane, dimOut.lx * dimOut.ly, 0.0f);
   for (int j = (dimOut.ly - filterSize.y) / 2; iris_j < filterSize.y;
        j++, iris_j++) {
     TPixel64* pix = resizedIris->pixels(iris_j);
@@ -1015,18 +650,18 @@ void BokehUtils::convertIris(const double irisSize,
     for (int i = (dimOut.lx - filterSize.x) / 2; iris_i < filterSize.x;
          i++, iris_i++) {
       // Value = 0.3R 0.59G 0.11B
-      kissfft_comp_iris_before[j * dimOut.lx + i].r =
+      iris_plane[j * dimOut.lx + i] =
           ((float)pix->r * 0.3f + (float)pix->g * 0.59f +
            (float)pix->b * 0.11f) /
           (float)USHRT_MAX;
-      irisValAmount += kissfft_comp_iris_before[j * dimOut.lx + i].r;
+      irisValAmount += iris_plane[j * dimOut.lx + i];
       pix++;
     }
   }
 
   // Normalize value
   for (int i = 0; i < dimOut.lx * dimOut.ly; i++) {
-    kissfft_comp_iris_before[i].r /= irisValAmount;
+    iris_plane[i] /= irisValAmount;
   }
 }
 
@@ -1034,54 +669,72 @@ void BokehUtils::convertIris(const double irisSize,
 // retrieve segment layer image for each channel
 //--------------------------------------------
 void BokehUtils::retrieveChannel(const double4* segment_layer_buff,  // src
-                                 kiss_fft_cpx* fftcpx_r_before,      // dst
-                                 kiss_fft_cpx* fftcpx_g_before,      // dst
-                                 kiss_fft_cpx* fftcpx_b_before,      // dst
-                                 kiss_fft_cpx* fftcpx_a_before,      // dst
+                                 kiss_fft_scalar* r_plane,           // dst
+                                 kiss_fft_scalar* g_plane,           // dst
+                                 kiss_fft_scalar* b_plane,           // dst
+                                 kiss_fft_scalar* a_plane,           // dst
                                  int size) {
   double4* layer_p = (double4*)segment_layer_buff;
   for (int i = 0; i < size; i++, layer_p++) {
-    fftcpx_r_before[i].r = (*layer_p).x;
-    fftcpx_g_before[i].r = (*layer_p).y;
-    fftcpx_b_before[i].r = (*layer_p).z;
-    fftcpx_a_before[i].r = (*layer_p).w;
-  }
-}
-
-//--------------------------------------------
-// multiply filter on channel
-//--------------------------------------------
-void BokehUtils::multiplyFilter(kiss_fft_cpx* fftcpx_channel,  // dst
-                                kiss_fft_cpx* fftcpx_iris,     // filter
-                                int size) {
-  for (int i = 0; i < size; i++) {
-    kiss_fft_scalar re, im;
-    re = fftcpx_channel[i].r * fftcpx_iris[i].r -
-         fftcpx_channel[i].i * fftcpx_iris[i].i;
-    im = fftcpx_channel[i].r * fftcpx_iris[i].i +
-         fftcpx_channel[i].i * fftcpx_iris[i].r;
-
-    fftcpx_channel[i].r = re;
-    fftcpx_channel[i].i = im;
+    r_plane[i] = (*layer_p).x;
+    g_plane[i] = (*layer_p).y;
+    b_plane[i] = (*layer_p).z;
+    a_plane[i] = (*layer_p).w;
   }
 }
 
 //--------------------------------------------
 // normal comosite the alpha channel
 //--------------------------------------------
-void BokehUtils::compositeAlpha(const double4* result_buff,        // dst
-                                const kiss_fft_cpx* fftcpx_alpha,  // alpha
+void BokehUtils::compositeAlpha(const double4* result_buff,      // dst
+                                const kiss_fft_scalar* a_plane,  // alpha
                                 int lx, int ly) {
   int size          = lx * ly;
   double4* result_p = (double4*)result_buff;
   for (int i = 0; i < size; i++, result_p++) {
     // modify fft coordinate to normal
-    double alpha  = (double)fftcpx_alpha[getCoord(i, lx, ly)].r / (double)size;
+    double alpha  = (double)a_plane[getCoord(i, lx, ly)] / (double)size;
     alpha         = clamp01(alpha);
     (*result_p).w = alpha + ((*result_p).w * (1.0 - alpha));
   }
 }
 
+//--------------------------------------------
+// composite the filtered exposures of the segment layer
+// pixels with smaller index : normal composite exposure value
+// pixels with the same or larger index : replace exposure value
+//--------------------------------------------
+void BokehUtils::compositeChannels(const double4* result_buff,      // dst
+                                   const kiss_fft_scalar* r_plane,  // src
+                                   const kiss_fft_scalar* g_plane,  // src
+                                   const kiss_fft_scalar* b_plane,  // src
+                                   const kiss_fft_scalar* a_plane,  // alpha
+                                   int lx, int ly) {
+  int size                         = lx * ly;
+  const kiss_fft_scalar* planes[3] = {r_plane, g_plane, b_plane};
+  double4* result_p                = (double4*)result_buff;
+  for (int i = 0; i < size; i++, result_p++) {
+    // modify fft coordinate to normal
+    int coord = getCoord(i, lx, ly);
+
+    double alpha = (double)a_plane[coord] / (double)size;
+    // ignore transpalent pixels
+    if (alpha < 0.00001) continue;
+
+    double* res[3] = {&(*result_p).x, &(*result_p).y, &(*result_p).z};
+    for (int c = 0; c < 3; c++) {
+      double exposure = (double)planes[c][coord] / (double)size;
+      // in case of using upper layer at all
+      if (alpha >= 1.0 || (*res[c]) == 0.0) (*res[c]) = exposure;
+      // in case of compositing both layers
+      else {
+        (*res[c]) *= 1.0 - alpha;
+        (*res[c]) += exposure;
+      }
+    }
+  }
+}
+
 //--------------------------------------------
 // interpolate main and sub exposures
 // set to result
@@ -1191,99 +844,100 @@ void BokehUtils::compositLayerAsIs(TTile& layerTile, double4* result,
   layer_buff_ras->unlock();
 }
 
-//--------------------------------------------
-// Do FFT the alpha channel.
-// Forward FFT -> Multiply by the iris data -> Backward FFT
-void BokehUtils::calcAlfaChannelBokeh(kiss_fft_cpx* kissfft_comp_iris,
-                                      TTile& layerTile, double* alpha_bokeh) {
-  // Obtain the source size
-  int lx, ly;
-  lx = layerTile.getRaster()->getSize().lx;
-  ly = layerTile.getRaster()->getSize().ly;
-
-  // Allocate the FFT data
-  kiss_fft_cpx *kissfft_comp_in, *kissfft_comp_out;
-
-  TRasterGR8P kissfft_comp_in_ras(lx * sizeof(kiss_fft_cpx), ly);
-  kissfft_comp_in_ras->lock();
-  kissfft_comp_in = (kiss_fft_cpx*)kissfft_comp_in_ras->getRawData();
-  TRasterGR8P kissfft_comp_out_ras(lx * sizeof(kiss_fft_cpx), ly);
-  kissfft_comp_out_ras->lock();
-  kissfft_comp_out = (kiss_fft_cpx*)kissfft_comp_out_ras->getRawData();
-
-  // Initialize the FFT data
-  for (int i = 0; i < lx * ly; i++) {
-    kissfft_comp_in[i].r = 0.0;  // real part
-    kissfft_comp_in[i].i = 0.0;  // imaginary part
-  }
+//------------------------------------------------------------
+// convert layer RGB to exposure
+// multiply alpha
+// set to the channel planes
+
+template void BokehUtils::setLayerRaster<TRaster32P, TPixel32>(
+    const TRaster32P srcRas, kiss_fft_scalar* r_plane,
+    kiss_fft_scalar* g_plane, kiss_fft_scalar* b_plane,
+    kiss_fft_scalar* a_plane, TDimensionI dim, const ExposureConverter& conv);
+template void BokehUtils::setLayerRaster<TRaster64P, TPixel64>(
+    const TRaster64P srcRas, kiss_fft_scalar* r_plane,
+    kiss_fft_scalar* g_plane, kiss_fft_scalar* b_plane,
+    kiss_fft_scalar* a_plane, TDimensionI dim, const ExposureConverter& conv);
+template void BokehUtils::setLayerRaster<TRasterFP, TPixelF>(
+    const TRasterFP srcRas, kiss_fft_scalar* r_plane,
+    kiss_fft_scalar* g_plane, kiss_fft_scalar* b_plane,
+    kiss_fft_scalar* a_plane, TDimensionI dim, const ExposureConverter& conv);
 
-  TRaster32P ras32 = (TRaster32P)layerTile.getRaster();
-  TRaster64P ras64 = (TRaster64P)layerTile.getRaster();
-  TRasterFP rasF   = (TRasterFP)layerTile.getRaster();
-  if (ras32) {
-    for (int j = 0; j < ly; j++) {
-      TPixel32* pix = ras32->pixels(j);
-      for (int i = 0; i < lx; i++) {
-        kissfft_comp_in[j * lx + i].r = (double)pix->m / (double)UCHAR_MAX;
-        pix++;
+template <typename RASTER, typename PIXEL>
+void BokehUtils::setLayerRaster(const RASTER srcRas, kiss_fft_scalar* r_plane,
+                                kiss_fft_scalar* g_plane,
+                                kiss_fft_scalar* b_plane,
+                                kiss_fft_scalar* a_plane, TDimensionI dim,
+                                const ExposureConverter& conv) {
+  for (int j = 0; j < dim.ly; j++) {
+    PIXEL* pix = srcRas->pixels(j);
+    for (int i = 0; i < dim.lx; i++, pix++) {
+      int index = j * dim.lx + i;
+      double alpha = (double)pix->m / (double)PIXEL::maxChannelValue;
+      a_plane[index] = alpha;
+      if (pix->m == 0) {
+        r_plane[index] = g_plane[index] = b_plane[index] = 0.0f;
+        continue;
       }
+      // multiply the exposure by alpha channel value
+      r_plane[index] = conv.valueToExposure((double)pix->r /
+                                            (double)PIXEL::maxChannelValue) *
+                       alpha;
+      g_plane[index] = conv.valueToExposure((double)pix->g /
+                                            (double)PIXEL::maxChannelValue) *
+                       alpha;
+      b_plane[index] = conv.valueToExposure((double)pix->b /
+                                            (double)PIXEL::maxChannelValue) *
+                       alpha;
     }
-  } else if (ras64) {
-    for (int j = 0; j < ly; j++) {
-      TPixel64* pix = ras64->pixels(j);
-      for (int i = 0; i < lx; i++) {
-        kissfft_comp_in[j * lx + i].r = (double)pix->m / (double)USHRT_MAX;
-        pix++;
+  }
+}
+
+//--------------------------------------------
+// "Over" composite the filtered layer to the output exposure
+
+void BokehUtils::compositeLayer(const double4* result,
+                                const kiss_fft_scalar* r_plane,
+                                const kiss_fft_scalar* g_plane,
+                                const kiss_fft_scalar* b_plane,
+                                const kiss_fft_scalar* a_plane, TDimensionI dim,
+                                double layerGamma, double masterGamma,
+                                bool isGammaBased) {
+  int size                         = dim.lx * dim.ly;
+  const kiss_fft_scalar* planes[3] = {r_plane, g_plane, b_plane};
+  double4* res_p                   = (double4*)result;
+  for (int i = 0; i < size; i++, res_p++) {
+    // modify fft coordinate to normal
+    int coord = getCoord(i, dim.lx, dim.ly);
+
+    double alpha = clamp01((double)a_plane[coord] / (double)size);
+    if (alpha < 0.00001) continue;
+
+    double* res[3] = {&(*res_p).x, &(*res_p).y, &(*res_p).z};
+    for (int c = 0; c < 3; c++) {
+      double exposure = (double)planes[c][coord] / (double)size;
+
+      // convert to layer hardness
+      if (masterGamma != layerGamma) {
+        if (isGammaBased)
+          exposure =
+              std::pow(exposure / alpha, masterGamma / layerGamma) * alpha;
+        else  // hardness based
+          exposure =
+              std::pow(exposure / alpha, layerGamma / masterGamma) * alpha;
       }
-    }
-  } else if (rasF) {
-    for (int j = 0; j < ly; j++) {
-      TPixelF* pix = rasF->pixels(j);
-      for (int i = 0; i < lx; i++) {
-        kissfft_comp_in[j * lx + i].r = (double)pix->m;
-        pix++;
+
+      // composite exposure
+      if (alpha >= 1.0 || (*res[c]) == 0.0)
+        (*res[c]) = exposure;
+      else {
+        (*res[c]) *= 1.0 - alpha;
+        (*res[c]) += exposure;
       }
     }
-  } else
-    return;
 
-  int dims[2]             = {ly, lx};
-  int ndims               = 2;
-  kiss_fftnd_cfg plan_fwd = kiss_fftnd_alloc(dims, ndims, false, 0, 0);
-  kiss_fftnd(plan_fwd, kissfft_comp_in, kissfft_comp_out);
-  kiss_fft_free(plan_fwd);  // we don't need this plan anymore
-
-  // Filtering. Multiply by the iris FFT data
-  for (int i = 0; i < lx * ly; i++) {
-    kiss_fft_scalar re, im;
-    re = kissfft_comp_out[i].r * kissfft_comp_iris[i].r -
-         kissfft_comp_out[i].i * kissfft_comp_iris[i].i;
-    im = kissfft_comp_out[i].r * kissfft_comp_iris[i].i +
-         kissfft_comp_iris[i].r * kissfft_comp_out[i].i;
-    kissfft_comp_out[i].r = re;
-    kissfft_comp_out[i].i = im;
+    // over compoite alpha
+    if ((*res_p).w < 1.0) (*res_p).w = alpha + (*res_p).w * (1.0 - alpha);
   }
-
-  kiss_fftnd_cfg plan_bkwd = kiss_fftnd_alloc(dims, ndims, true, 0, 0);
-  kiss_fftnd(plan_bkwd, kissfft_comp_out, kissfft_comp_in);  // Backward FFT
-  kiss_fft_free(plan_bkwd);  // we don't need this plan anymore
-
-  // In the backward FFT above, "kissfft_comp_out" is used as input and
-  // "kissfft_comp_in" as output.
-  // So we don't need "kissfft_comp_out" anymore.
-  kissfft_comp_out_ras->unlock();
-
-  // store to the buffer
-  double* alp_p = alpha_bokeh;
-  for (int j = 0; j < ly; j++) {
-    for (int i = 0; i < lx; i++, alp_p++) {
-      (*alp_p) = (double)kissfft_comp_in[getCoord(j * lx + i, lx, ly)].r /
-                 (double)(lx * ly);
-      (*alp_p) = clamp01(*alp_p);
-    }
-  }
-
-  kissfft_comp_in_ras->unlock();
 }
 
 //-----------------------------------------------------
@@ -1421,14 +1075,8 @@ void Iwa_BokehCommonFx::doFx(TTile& tile, double frame,
   // QMutexLocker fx_locker(&fx_mutex);
 
   QList<TRasterGR8P> rasterList;
-  QList<kiss_fftnd_cfg> planList;
 
-  kiss_fft_cpx* kissfft_comp_iris;
-  double* alpha_bokeh = nullptr;
-  double4* result     = nullptr;
-  rasterList.append(
-      allocateRasterAndLock<kiss_fft_cpx>(&kissfft_comp_iris, dimOut));
-  rasterList.append(allocateRasterAndLock<double>(&alpha_bokeh, dimOut));
+  double4* result = nullptr;
   rasterList.append(allocateRasterAndLock<double4>(&result, dimOut));
 
   double4 zero = {0.0, 0.0, 0.0, 0.0};
@@ -1445,7 +1093,7 @@ void Iwa_BokehCommonFx::doFx(TTile& tile, double frame,
 
   // cancel check
   if (settings.m_isCanceled && *settings.m_isCanceled) {
-    releaseAllRastersAndPlans(rasterList, planList);
+    releaseAllRasters(rasterList);
     return;
   }
 
@@ -1453,7 +1101,7 @@ void Iwa_BokehCommonFx::doFx(TTile& tile, double frame,
   for (int i = 0; i < layerValues.size(); i++) {
     // cancel check
     if (settings.m_isCanceled && *settings.m_isCanceled) {
-      releaseAllRastersAndPlans(rasterList, planList);
+      releaseAllRasters(rasterList);
       return;
     }
 
@@ -1468,7 +1116,7 @@ void Iwa_BokehCommonFx::doFx(TTile& tile, double frame,
       if (!layer.premultiply) TRop::depremultiply(layerTile->getRaster());
 
       doBokehRef(result, frame, settings, bokehPixelAmount, margin, dimOut,
-                 irisBBox, irisTile, kissfft_comp_iris, layer, ctrls[ctrlIndex],
+                 irisBBox, irisTile, layer, ctrls[ctrlIndex],
                  tile.getRaster()->isLinear());
 
       continue;
@@ -1498,44 +1146,42 @@ void Iwa_BokehCommonFx::doFx(TTile& tile, double frame,
       continue;
     }
 
+    FftUtils::Buffer irisSpectrumBuf;
+    kiss_fft_cpx* iris_spectrum = irisSpectrumBuf.allocate<kiss_fft_cpx>(
+        FftUtils::spectrumDim(dimOut));
     {
       // prepare for iris FFT
-      kiss_fft_cpx* kissfft_comp_iris_before;
-      rasterList.append(allocateRasterAndLock<kiss_fft_cpx>(
-          &kissfft_comp_iris_before, dimOut));
+      FftUtils::Buffer irisBuf;
+      kiss_fft_scalar* iris_plane = irisBuf.allocate<kiss_fft_scalar>(dimOut);
+      if (!iris_spectrum || !iris_plane) {
+        releaseAllRasters(rasterList);
+        return;
+      }
       // Resize / flip the iris image according to the size ratio.
       // Normalize the brightness of the iris image.
       // Enlarge the iris to the output size.
-      BokehUtils::convertIris(irisSize, kissfft_comp_iris_before, dimOut,
-                              irisBBox, irisTile);
+      BokehUtils::convertIris(irisSize, iris_plane, dimOut, irisBBox,
+                              irisTile);
 
       // cancel check
       if (settings.m_isCanceled && *settings.m_isCanceled) {
-        releaseAllRastersAndPlans(rasterList, planList);
+        releaseAllRasters(rasterList);
         return;
       }
 
-      // Create the FFT plan for the iris image.
-      kiss_fftnd_cfg iris_kissfft_plan;
-      while (1) {
-        int dims[2]       = {dimOut.ly, dimOut.lx};
-        int ndims         = 2;
-        iris_kissfft_plan = kiss_fftnd_alloc(dims, ndims, false, 0, 0);
-        if (iris_kissfft_plan != NULL) break;
-      }
       // Do FFT the iris image.
-      kiss_fftnd(iris_kissfft_plan, kissfft_comp_iris_before,
-                 kissfft_comp_iris);
-      kiss_fft_free(iris_kissfft_plan);
-      // release the iris buffer
-      rasterList.takeLast()->unlock();
+      FftUtils::Plan irisPlan(dimOut);
+      if (!irisPlan.forward(iris_plane, iris_spectrum)) {
+        releaseAllRasters(rasterList);
+        return;
+      }
     }
 
-    // Up to here, FFT-ed iris data is stored in kissfft_comp_iris
+    // Up to here, FFT-ed iris data is stored in iris_spectrum
 
     // cancel check
     if (settings.m_isCanceled && *settings.m_isCanceled) {
-      releaseAllRastersAndPlans(rasterList, planList);
+      releaseAllRasters(rasterList);
       return;
     }
 
@@ -1545,28 +1191,17 @@ void Iwa_BokehCommonFx::doFx(TTile& tile, double frame,
 
     if (!layer.premultiply) TRop::depremultiply(layerTile->getRaster());
 
-    //- - - - - - - - - - - - -
-    // Do FFT the alpha channel.
-    // Forward FFT -> Multiply by the iris data -> Backward FFT
-    BokehUtils::calcAlfaChannelBokeh(kissfft_comp_iris, *layerTile,
-                                     alpha_bokeh);
-
-    // cancel check
-    if (settings.m_isCanceled && *settings.m_isCanceled) {
-      releaseAllRastersAndPlans(rasterList, planList);
-      return;
+    // RGB channels and alpha
+    FftUtils::Buffer planeBuf[4];
+    kiss_fft_scalar* planes[4];
+    for (int p = 0; p < 4; p++) {
+      planes[p] = planeBuf[p].allocate<kiss_fft_scalar>(dimOut);
+      if (!planes[p]) {
+        releaseAllRasters(rasterList);
+        return;
+      }
     }
 
-    BokehUtils::MyThread threadR(BokehUtils::MyThread::Red,
-                                 layerTile->getRaster(), result, alpha_bokeh,
-                                 kissfft_comp_iris, layerGamma, masterGamma);
-    BokehUtils::MyThread threadG(BokehUtils::MyThread::Green,
-                                 layerTile->getRaster(), result, alpha_bokeh,
-                                 kissfft_comp_iris, layerGamma, masterGamma);
-    BokehUtils::MyThread threadB(BokehUtils::MyThread::Blue,
-                                 layerTile->getRaster(), result, alpha_bokeh,
-                                 kissfft_comp_iris, layerGamma, masterGamma);
-
     std::shared_ptr<ExposureConverter> conv;
     if (m_linearizeMode->getValue() == Hardness)
       conv.reset(
@@ -1574,113 +1209,43 @@ void Iwa_BokehCommonFx::doFx(TTile& tile, double frame,
                                      layerTile->getRaster()->isLinear()));
     else
       conv.reset(new GammaBasedConverter(layerGamma));
-    threadR.setConverter(conv);
-    threadG.setConverter(conv);
-    threadB.setConverter(conv);
-
-    // If you set this flag to true, the fx will be forced to compute in single
-    // thread.
-    // Under some specific condition (such as calling from single-threaded
-    // tcomposer)
-    // we may need to use this flag... For now, I'll keep this option unused.
-    // TODO: investigate this.
-    bool renderInSingleThread = false;
-
-    // Start the thread when the initialization is done.
-    // Red channel
-    int waitCount = 0;
-    while (1) {
-      // cancel check
-      if ((settings.m_isCanceled && *settings.m_isCanceled) ||
-          waitCount >= 20) {
-        releaseAllRastersAndPlans(rasterList, planList);
-        return;
-      }
-      if (threadR.init()) {
-        if (renderInSingleThread)
-          threadR.run();
-        else
-          threadR.start();
-        break;
-      }
-      QThread::msleep(500);
-      waitCount++;
-    }
 
-    waitCount = 0;
-    while (1) {
-      if ((settings.m_isCanceled && *settings.m_isCanceled) ||
-          waitCount >= 20)  // 10 seconds
-      {
-        if (!threadR.isFinished()) threadR.terminateThread();
-        while (!threadR.isFinished()) {
-        }
-        releaseAllRastersAndPlans(rasterList, planList);
-        return;
-      }
-      if (threadG.init()) {
-        if (renderInSingleThread)
-          threadG.run();
-        else
-          threadG.start();
-        break;
-      }
-      QThread::msleep(500);
-      waitCount++;
-    }
-
-    waitCount = 0;
-    while (1) {
-      if ((settings.m_isCanceled && *settings.m_isCanceled) ||
-          waitCount >= 20)  // 10 seconds
-      {
-        if (!threadR.isFinished()) threadR.terminateThread();
-        if (!threadG.isFinished()) threadG.terminateThread();
-        while (!threadR.isFinished() || !threadG.isFinished()) {
-        }
-        releaseAllRastersAndPlans(rasterList, planList);
-        return;
-      }
-      if (threadB.init()) {
-        if (renderInSingleThread)
-          threadB.run();
-        else
-          threadB.start();
-        break;
-      }
-      QThread::msleep(500);
-      waitCount++;
-    }
+    // Prepare data for FFT.
+    // Convert the RGB values to the exposure, then multiply it by the alpha
+    // channel value
+    TRaster32P ras32 = (TRaster32P)layerTile->getRaster();
+    TRaster64P ras64 = (TRaster64P)layerTile->getRaster();
+    TRasterFP rasF   = (TRasterFP)layerTile->getRaster();
+    lock.lockForRead();
+    if (ras32)
+      BokehUtils::setLayerRaster<TRaster32P, TPixel32>(
+          ras32, planes[0], planes[1], planes[2], planes[3], dimOut, *conv);
+    else if (ras64)
+      BokehUtils::setLayerRaster<TRaster64P, TPixel64>(
+          ras64, planes[0], planes[1], planes[2], planes[3], dimOut, *conv);
+    else if (rasF)
+      BokehUtils::setLayerRaster<TRasterFP, TPixelF>(
+          rasF, planes[0], planes[1], planes[2], planes[3], dimOut, *conv);
+    lock.unlock();
 
     /*
-     * What is done in the thread for each RGB channel:
-     * - Convert channel value -> Exposure
-     * - Multiply by alpha channel
+     * What is done for each RGB channel and the alpha, each one in its own
+     * thread:
      * - Forward FFT
      * - Multiply by the iris FFT data
      * - Backward FFT
-     * - Convert Exposure -> channel value
      */
-
-    waitCount = 0;
-    while (1) {
-      if ((settings.m_isCanceled && *settings.m_isCanceled) ||
-          waitCount >= 2000)  // 100 second timeout
-      {
-        if (!threadR.isFinished()) threadR.terminateThread();
-        if (!threadG.isFinished()) threadG.terminateThread();
-        if (!threadB.isFinished()) threadB.terminateThread();
-        while (!threadR.isFinished() || !threadG.isFinished() ||
-               !threadB.isFinished()) {
-        }
-        releaseAllRastersAndPlans(rasterList, planList);
-        return;
-      }
-      if (threadR.isFinished() && threadG.isFinished() && threadB.isFinished())
-        break;
-      QThread::msleep(50);
-      waitCount++;
+    FftUtils::Convolver convolver(dimOut);
+    for (int p = 0; p < 4; p++) convolver.addPlane(planes[p], iris_spectrum);
+    if (!convolver.run(settings.m_isCanceled)) {
+      releaseAllRasters(rasterList);
+      return;
     }
+
+    // Convert Exposure to the master gamma and composite
+    BokehUtils::compositeLayer(result, planes[0], planes[1], planes[2],
+                               planes[3], dimOut, layerGamma, masterGamma,
+                               conv->isGammaBased());
   }
 
   // convert result image value exposure -> rgb
@@ -1714,16 +1279,15 @@ void Iwa_BokehCommonFx::doFx(TTile& tile, double frame,
                                                     outMargin);
   lock.unlock();
 
-  releaseAllRastersAndPlans(rasterList, planList);
+  releaseAllRasters(rasterList);
 }
 
 void Iwa_BokehCommonFx::doBokehRef(
     double4* result, double frame, const TRenderSettings& settings,
     double bokehPixelAmount, int margin, TDimensionI& dimOut, TRectD& irisBBox,
-    TTile& irisTile, kiss_fft_cpx* kissfft_comp_iris, LayerValue layer,
-    unsigned char* ctrl, const bool isLinear) {
+    TTile& irisTile, LayerValue layer, unsigned char* ctrl,
+    const bool isLinear) {
   QList<TRasterGR8P> rasterList;
-  QList<kiss_fftnd_cfg> planList;
   // source image
   double4* source_buff;
   rasterList.append(allocateRasterAndLock<double4>(&source_buff, dimOut));
@@ -1775,33 +1339,20 @@ void Iwa_BokehCommonFx::doBokehRef(
   double4* layer_buff;
   rasterList.append(allocateRasterAndLock<double4>(&layer_buff, dimOut));
 
-  kiss_fft_cpx* kissfft_comp_iris_before;
-  rasterList.append(
-      allocateRasterAndLock<kiss_fft_cpx>(&kissfft_comp_iris_before, dimOut));
-
-  // alpha channel
-  kiss_fft_cpx* fftcpx_alpha_before;
-  kiss_fft_cpx* fftcpx_alpha;
-  rasterList.append(
-      allocateRasterAndLock<kiss_fft_cpx>(&fftcpx_alpha_before, dimOut));
-  rasterList.append(allocateRasterAndLock<kiss_fft_cpx>(&fftcpx_alpha, dimOut));
-
-  // RGB channels
-  kiss_fft_cpx* fftcpx_r_before;
-  kiss_fft_cpx* fftcpx_g_before;
-  kiss_fft_cpx* fftcpx_b_before;
-  kiss_fft_cpx* fftcpx_r;
-  kiss_fft_cpx* fftcpx_g;
-  kiss_fft_cpx* fftcpx_b;
-  rasterList.append(
-      allocateRasterAndLock<kiss_fft_cpx>(&fftcpx_r_before, dimOut));
-  rasterList.append(
-      allocateRasterAndLock<kiss_fft_cpx>(&fftcpx_g_before, dimOut));
-  rasterList.append(
-      allocateRasterAndLock<kiss_fft_cpx>(&fftcpx_b_before, dimOut));
-  rasterList.append(allocateRasterAndLock<kiss_fft_cpx>(&fftcpx_r, dimOut));
-  rasterList.append(allocateRasterAndLock<kiss_fft_cpx>(&fftcpx_g, dimOut));
-  rasterList.append(allocateRasterAndLock<kiss_fft_cpx>(&fftcpx_b, dimOut));
+  // iris
+  FftUtils::Buffer irisBuf, irisSpectrumBuf;
+  kiss_fft_scalar* iris_plane = irisBuf.allocate<kiss_fft_scalar>(dimOut);
+  kiss_fft_cpx* iris_spectrum = irisSpectrumBuf.allocate<kiss_fft_cpx>(
+      FftUtils::spectrumDim(dimOut));
+
+  // RGB channels and alpha
+  FftUtils::Buffer planeBuf[4];
+  kiss_fft_scalar* planes[4];
+  bool allocated = iris_plane && iris_spectrum;
+  for (int p = 0; p < 4; p++) {
+    planes[p] = planeBuf[p].allocate<kiss_fft_scalar>(dimOut);
+    allocated = allocated && planes[p];
+  }
 
   // for accumulating result image
   double4* result_main_buff;
@@ -1810,30 +1361,12 @@ void Iwa_BokehCommonFx::doBokehRef(
   rasterList.append(allocateRasterAndLock<double4>(&result_sub_buff, dimOut));
 
   // cancel check
-  if (settings.m_isCanceled && *settings.m_isCanceled) {
-    releaseAllRastersAndPlans(rasterList, planList);
+  if (!allocated || (settings.m_isCanceled && *settings.m_isCanceled)) {
+    releaseAllRasters(rasterList);
     return;
   }
 
-  // fft plans
-  int dims[2]                      = {dimOut.ly, dimOut.lx};
-  kiss_fftnd_cfg kissfft_plan_fwd  = kiss_fftnd_alloc(dims, 2, false, 0, 0);
-  kiss_fftnd_cfg kissfft_plan_bkwd = kiss_fftnd_alloc(dims, 2, true, 0, 0);
-  planList.append(kissfft_plan_fwd);
-  planList.append(kissfft_plan_bkwd);
-
-  kiss_fftnd_cfg kissfft_plan_r_fwd  = kiss_fftnd_alloc(dims, 2, false, 0, 0);
-  kiss_fftnd_cfg kissfft_plan_r_bkwd = kiss_fftnd_alloc(dims, 2, true, 0, 0);
-  kiss_fftnd_cfg kissfft_plan_g_fwd  = kiss_fftnd_alloc(dims, 2, false, 0, 0);
-  kiss_fftnd_cfg kissfft_plan_g_bkwd = kiss_fftnd_alloc(dims, 2, true, 0, 0);
-  kiss_fftnd_cfg kissfft_plan_b_fwd  = kiss_fftnd_alloc(dims, 2, false, 0, 0);
-  kiss_fftnd_cfg kissfft_plan_b_bkwd = kiss_fftnd_alloc(dims, 2, true, 0, 0);
-  planList.append(kissfft_plan_r_fwd);
-  planList.append(kissfft_plan_r_bkwd);
-  planList.append(kissfft_plan_g_fwd);
-  planList.append(kissfft_plan_g_bkwd);
-  planList.append(kissfft_plan_b_fwd);
-  planList.append(kissfft_plan_b_bkwd);
+  FftUtils::Plan irisPlan(dimOut);
 
   // initialize result memory
   memset(result_main_buff, 0, sizeof(double4) * size);
@@ -1881,7 +1414,7 @@ void Iwa_BokehCommonFx::doBokehRef(
     for (int index = 0; index < segmentDepth_mainSub.size(); index++) {
       // cancel check
       if (settings.m_isCanceled && *settings.m_isCanceled) {
-        releaseAllRastersAndPlans(rasterList, planList);
+        releaseAllRasters(rasterList);
         return;
       }
 
@@ -1905,104 +1438,54 @@ void Iwa_BokehCommonFx::doBokehRef(
       // Resize / flip the iris image according to the size ratio.
       // Normalize the brightness of the iris image.
       // Enlarge the iris to the output size.
-      BokehUtils::convertIris(irisSize, kissfft_comp_iris_before, dimOut,
-                              irisBBox, irisTile);
+      BokehUtils::convertIris(irisSize, iris_plane, dimOut, irisBBox,
+                              irisTile);
 
       // cancel check
       if (settings.m_isCanceled && *settings.m_isCanceled) {
-        releaseAllRastersAndPlans(rasterList, planList);
+        releaseAllRasters(rasterList);
         return;
       }
       // Do FFT the iris image.
-      kiss_fftnd(kissfft_plan_fwd, kissfft_comp_iris_before, kissfft_comp_iris);
-
-      // initialize alpha
-      memset(fftcpx_alpha_before, 0, sizeof(kiss_fft_cpx) * size);
-      // initialize channels
-      memset(fftcpx_r_before, 0, sizeof(kiss_fft_cpx) * size);
-      memset(fftcpx_g_before, 0, sizeof(kiss_fft_cpx) * size);
-      memset(fftcpx_b_before, 0, sizeof(kiss_fft_cpx) * size);
+      if (!irisPlan.forward(iris_plane, iris_spectrum)) {
+        releaseAllRasters(rasterList);
+        return;
+      }
 
       // retrieve segment layer image for each channel
-      BokehUtils::retrieveChannel(layer_buff,           // src
-                                  fftcpx_r_before,      // dst
-                                  fftcpx_g_before,      // dst
-                                  fftcpx_b_before,      // dst
-                                  fftcpx_alpha_before,  // dst
+      BokehUtils::retrieveChannel(layer_buff,  // src
+                                  planes[0],   // dst
+                                  planes[1],   // dst
+                                  planes[2],   // dst
+                                  planes[3],   // dst
                                   size);
 
-      // forward fft of alpha channel
-      kiss_fftnd(kissfft_plan_fwd, fftcpx_alpha_before, fftcpx_alpha);
-
-      // multiply filter on alpha
-      BokehUtils::multiplyFilter(fftcpx_alpha,       // dst
-                                 kissfft_comp_iris,  // filter
-                                 size);
-
-      // inverse fft the alpha channel
+      // forward fft, multiply filter and inverse fft for each channel and
+      // alpha, each one in its own thread.
       // note that the result is multiplied by the image size
-      kiss_fftnd(kissfft_plan_bkwd, fftcpx_alpha, fftcpx_alpha_before);
+      FftUtils::Convolver convolver(dimOut);
+      for (int p = 0; p < 4; p++) convolver.addPlane(planes[p], iris_spectrum);
+      if (!convolver.run(settings.m_isCanceled)) {
+        releaseAllRasters(rasterList);
+        return;
+      }
 
       // over composite the alpha channel
       BokehUtils::compositeAlpha(result_buff_mainSub,  // dst
-                                 fftcpx_alpha_before,  // alpha
+                                 planes[3],            // alpha
                                  dimOut.lx, dimOut.ly);
 
-      // create worker threads
-      BokehUtils::BokehRefThread threadR(
-          0, fftcpx_r_before, fftcpx_r, fftcpx_alpha_before, kissfft_comp_iris,
-          result_buff_mainSub, kissfft_plan_r_fwd, kissfft_plan_r_bkwd, dimOut);
-      BokehUtils::BokehRefThread threadG(
-          1, fftcpx_g_before, fftcpx_g, fftcpx_alpha_before, kissfft_comp_iris,
-          result_buff_mainSub, kissfft_plan_g_fwd, kissfft_plan_g_bkwd, dimOut);
-      BokehUtils::BokehRefThread threadB(
-          2, fftcpx_b_before, fftcpx_b, fftcpx_alpha_before, kissfft_comp_iris,
-          result_buff_mainSub, kissfft_plan_b_fwd, kissfft_plan_b_bkwd, dimOut);
-
-      // If you set this flag to true, the fx will be forced to compute in
-      // single thread.
-      // Under some specific condition (such as calling from single-threaded
-      // tcomposer)
-      // we may need to use this flag... For now, I'll keep this option unused.
-      // TODO: investigate this.
-      bool renderInSingleThread = false;
-
-      if (renderInSingleThread) {
-        threadR.run();
-        threadG.run();
-        threadB.run();
-      } else {
-        threadR.start();
-        threadG.start();
-        threadB.start();
-        int waitCount = 0;
-        while (1) {
-          if ((settings.m_isCanceled && *settings.m_isCanceled) ||
-              waitCount >= 2000)  // 100 second timeout
-          {
-            if (!threadR.isFinished()) threadR.terminateThread();
-            if (!threadG.isFinished()) threadG.terminateThread();
-            if (!threadB.isFinished()) threadB.terminateThread();
-            while (!threadR.isFinished() || !threadG.isFinished() ||
-                   !threadB.isFinished()) {
-            }
-            releaseAllRastersAndPlans(rasterList, planList);
-            return;
-          }
-          if (threadR.isFinished() && threadG.isFinished() &&
-              threadB.isFinished())
-            break;
-          QThread::msleep(50);
-          waitCount++;
-        }
-      }
-
+      // composite the exposure of each channel
+      BokehUtils::compositeChannels(result_buff_mainSub,  // dst
+                                    planes[0], planes[1], planes[2],
+                                    planes[3],  // alpha
+                                    dimOut.lx, dimOut.ly);
     }  // for each segment
   }    // main and sub
 
   // cancel check
   if (settings.m_isCanceled && *settings.m_isCanceled) {
-    releaseAllRastersAndPlans(rasterList, planList);
+    releaseAllRasters(rasterList);
     return;
   }
 
@@ -2017,5 +1500,5 @@ void Iwa_BokehCommonFx::doBokehRef(
                                                  size, adjustFactor);
 
   // release rasters and plans
-  releaseAllRastersAndPlans(rasterList, planList);
+  releaseAllRasters(rasterList);
 }
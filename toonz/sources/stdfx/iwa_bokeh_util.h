@@ -6,12 +6,11 @@
 #include "tgeometry.h"
 #include "traster.h"
 #include "kiss_fft.h"
-#include "tools/kiss_fftnd.h"
+#include "iwa_fft_util.h"
 #include "ttile.h"
 #include "stdfx.h"
 #include "tfxparam.h"
 
-#include <QThread>
 #include <QVector>
 
 struct double4 {
@@ -80,91 +79,6 @@ namespace BokehUtils {
 
 //------------------------------------
 
-class MyThread : public QThread {
-public:
-  enum Channel { Red = 0, Green, Blue };
-
-private:
-  int m_channel;
-
-  volatile bool m_finished;
-
-  TRasterP m_layerTileRas;
-  double4* m_result;
-  double* m_alpha_bokeh;
-
-  kiss_fft_cpx* m_kissfft_comp_iris;
-
-  double m_layerGamma;
-  double m_masterGamma;
-
-  TRasterGR8P m_kissfft_comp_in_ras, m_kissfft_comp_out_ras;
-  kiss_fft_cpx *m_kissfft_comp_in, *m_kissfft_comp_out;
-  kiss_fftnd_cfg m_kissfft_plan_fwd, m_kissfft_plan_bkwd;
-
-  bool m_isTerminated;
-
-  std::shared_ptr<ExposureConverter> m_conv;
-
-public:
-  MyThread(Channel channel, TRasterP layerTileRas, double4* result,
-           double* alpha_bokeh, kiss_fft_cpx* kissfft_comp_iris,
-           double layerGamma, double masterGamma = 0.0);
-
-  // Convert the pixels from RGB values to exposures and multiply it by alpha
-  // channel value.
-  // Store the results in the real part of kiss_fft_cpx.
-  template <typename RASTER, typename PIXEL>
-  void setLayerRaster(const RASTER srcRas, kiss_fft_cpx* dstMem,
-                      TDimensionI dim);
-
-  void run();
-
-  bool isFinished() { return m_finished; }
-
-  // m
-  bool init();
-
-  void terminateThread() { m_isTerminated = true; }
-
-  bool checkTerminationAndCleanupThread();
-
-  void setConverter(std::shared_ptr<ExposureConverter> conv) { m_conv = conv; }
-  bool isGammaBased() { return m_conv->isGammaBased(); }
-};
-
-//------------------------------------
-
-class BokehRefThread : public QThread {
-  int m_channel;
-  volatile bool m_finished;
-
-  kiss_fft_cpx* m_fftcpx_channel_before;
-  kiss_fft_cpx* m_fftcpx_channel;
-  kiss_fft_cpx* m_fftcpx_alpha;
-  kiss_fft_cpx* m_fftcpx_iris;
-  double4* m_result_buff;
-
-  kiss_fftnd_cfg m_kissfft_plan_fwd, m_kissfft_plan_bkwd;
-
-  TDimensionI m_dim;
-  bool m_isTerminated;
-
-public:
-  BokehRefThread(int channel, kiss_fft_cpx* fftcpx_channel_before,
-                 kiss_fft_cpx* fftcpx_channel, kiss_fft_cpx* fftcpx_alpha,
-                 kiss_fft_cpx* fftcpx_iris, double4* result_buff,
-                 kiss_fftnd_cfg kissfft_plan_fwd,
-                 kiss_fftnd_cfg kissfft_plan_bkwd, TDimensionI& dim);
-
-  void run() override;
-
-  bool isFinished() { return m_finished; }
-  void terminateThread() { m_isTerminated = true; }
-};
-
-//------------------------------------
-
 // normalize the source raster image to 0-1 and set to dstMem
 // returns true if the source is (seems to be) premultiplied
 template <typename RASTER, typename PIXEL>
@@ -213,28 +127,31 @@ void compositeAsIs(const double4* segment_layer_buff,
 // Resize / flip the iris image according to the size ratio.
 // Normalize the brightness of the iris image.
 // Enlarge the iris to the output size.
-void convertIris(const double irisSize, kiss_fft_cpx* kissfft_comp_iris_before,
+void convertIris(const double irisSize, kiss_fft_scalar* iris_plane,
                  const TDimensionI& dimOut, const TRectD& irisBBox,
                  const TTile& irisTile);
 
 // retrieve segment layer image for each channel
 void retrieveChannel(const double4* segment_layer_buff,  // src
-                     kiss_fft_cpx* fftcpx_r_before,      // dst
-                     kiss_fft_cpx* fftcpx_g_before,      // dst
-                     kiss_fft_cpx* fftcpx_b_before,      // dst
-                     kiss_fft_cpx* fftcpx_a_before,      // dst
+                     kiss_fft_scalar* r_plane,           // dst
+                     kiss_fft_scalar* g_plane,           // dst
+                     kiss_fft_scalar* b_plane,           // dst
+                     kiss_fft_scalar* a_plane,           // dst
                      int size);
 
-// multiply filter on channel
-void multiplyFilter(kiss_fft_cpx* fftcpx_channel,  // dst
-                    kiss_fft_cpx* fftcpx_iris,     // filter
-                    int size);
-
 // normal comosite the alpha channel
-void compositeAlpha(const double4* result_buff,        // dst
-                    const kiss_fft_cpx* fftcpx_alpha,  // alpha
+void compositeAlpha(const double4* result_buff,      // dst
+                    const kiss_fft_scalar* a_plane,  // alpha
                     int lx, int ly);
 
+// composite the filtered exposures of the segment layer
+void compositeChannels(const double4* result_buff,      // dst
+                       const kiss_fft_scalar* r_plane,  // src
+                       const kiss_fft_scalar* g_plane,  // src
+                       const kiss_fft_scalar* b_plane,  // src
+                       const kiss_fft_scalar* a_plane,  // alpha
+                       int lx, int ly);
+
 // interpolate main and sub exposures
 // set to result
 void interpolateExposureAndConvertToRGB(
@@ -248,10 +165,21 @@ void interpolateExposureAndConvertToRGB(
 void compositLayerAsIs(TTile& layerTile, double4* result, TDimensionI& dimOut,
                        const ExposureConverter& conv);
 
-// Do FFT the alpha channel.
-// Forward FFT -> Multiply by the iris data -> Backward FFT
-void calcAlfaChannelBokeh(kiss_fft_cpx* kissfft_comp_iris, TTile& layerTile,
-                          double* alpha_bokeh);
+// Convert the layer pixels from RGB values to exposures and multiply them by
+// the alpha channel value. Store the alpha channel as well.
+template <typename RASTER, typename PIXEL>
+void setLayerRaster(const RASTER srcRas, kiss_fft_scalar* r_plane,
+                    kiss_fft_scalar* g_plane, kiss_fft_scalar* b_plane,
+                    kiss_fft_scalar* a_plane, TDimensionI dim,
+                    const ExposureConverter& conv);
+
+// "Over" composite the filtered layer to the output exposure, converting it
+// from the layer gamma / hardness to the master one
+void compositeLayer(const double4* result, const kiss_fft_scalar* r_plane,
+                    const kiss_fft_scalar* g_plane,
+                    const kiss_fft_scalar* b_plane,
+                    const kiss_fft_scalar* a_plane, TDimensionI dim,
+                    double layerGamma, double masterGamma, bool isGammaBased);
 
 // convert to channel value and set to output
 template <typename RASTER, typename PIXEL>
@@ -308,8 +236,8 @@ protected:
   void doBokehRef(double4* result, double frame,
                   const TRenderSettings& settings, double bokehPixelAmount,
                   int margin, TDimensionI& dimOut, TRectD& irisBBox,
-                  TTile& irisTile, kiss_fft_cpx* kissfft_comp_iris,
-                  LayerValue layer, unsigned char* ctrl, const bool isLinear);
+                  TTile& irisTile, LayerValue layer, unsigned char* ctrl,
+                  const bool isLinear);
 
 public:
   Iwa_BokehCommonFx();
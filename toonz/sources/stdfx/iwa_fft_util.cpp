@@ -0,0 +1,330 @@
+#include "iwa_fft_util.h"
+
+#include "tools/kiss_fftnd.h"
+#include "tools/kiss_fftndr.h"
+
+#include "tthread.h"
+#include "trenderresourcemanager.h"
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <list>
+
+namespace {
+
+// idle plans and buffers are released beyond this amount, and once no render
+// is running
+const size_t MaxIdleBytes = 256 << 20;
+
+// the real-to-complex transform needs an even width
+inline bool isRealTransform(const TDimensionI& dim) { return dim.lx % 2 == 0; }
+
+//------------------------------------
+
+struct IdleItem {
+  enum Type { Memory = 0, ForwardPlan, BackwardPlan };
+
+  int m_type;
+  int m_lx, m_ly;  // row bytes and rows for the memory
+  size_t m_bytes;
+  void* m_cfg;
+  TRasterGR8P m_ras;
+};
+
+//------------------------------------
+// Plans and buffers which are not in use, the least recently used first
+
+class Pool {
+  QMutex m_mutex;
+  std::list<IdleItem> m_items;
+  size_t m_bytes;
+
+  Pool() : m_bytes(0) {}
+
+public:
+  // never deleted, so that rasters are not released after the memory
+  // manager on exit
+  static Pool* instance() {
+    static Pool* pool = new Pool();
+    return pool;
+  }
+
+  bool take(int type, int lx, int ly, IdleItem& item) {
+    QMutexLocker locker(&m_mutex);
+    // the most recently used one is the most likely to be in cache
+    for (auto it = m_items.rbegin(); it != m_items.rend(); ++it) {
+      if (it->m_type != type || it->m_lx != lx || it->m_ly != ly) continue;
+      item = *it;
+      m_bytes -= item.m_bytes;
+      m_items.erase(std::next(it).base());
+      return true;
+    }
+    return false;
+  }
+
+  void give(const IdleItem& item) {
+    QMutexLocker locker(&m_mutex);
+    m_items.push_back(item);
+    m_bytes += item.m_bytes;
+    while (m_bytes > MaxIdleBytes) releaseOldest();
+  }
+
+  void clear() {
+    QMutexLocker locker(&m_mutex);
+    while (!m_items.empty()) releaseOldest();
+  }
+
+  size_t bytes() {
+    QMutexLocker locker(&m_mutex);
+    return m_bytes;
+  }
+
+private:
+  void releaseOldest() {
+    IdleItem& oldest = m_items.front();
+    if (oldest.m_cfg) kiss_fft_free(oldest.m_cfg);
+    m_bytes -= oldest.m_bytes;
+    m_items.pop_front();
+  }
+};
+
+//------------------------------------
+
+void* takePlan(const TDimensionI& dim, bool inverse) {
+  int type = (inverse) ? IdleItem::BackwardPlan : IdleItem::ForwardPlan;
+  IdleItem item;
+  if (Pool::instance()->take(type, dim.lx, dim.ly, item)) return item.m_cfg;
+
+  int dims[2] = {dim.ly, dim.lx};
+  if (isRealTransform(dim))
+    return kiss_fftndr_alloc(dims, 2, inverse, 0, 0);
+  else
+    return kiss_fftnd_alloc(dims, 2, inverse, 0, 0);
+}
+
+void givePlan(const TDimensionI& dim, bool inverse, void* cfg) {
+  IdleItem item;
+  item.m_type  = (inverse) ? IdleItem::BackwardPlan : IdleItem::ForwardPlan;
+  item.m_lx    = dim.lx;
+  item.m_ly    = dim.ly;
+  item.m_cfg   = cfg;
+  item.m_bytes = 0;
+  // query the plan size
+  int dims[2] = {dim.ly, dim.lx};
+  if (isRealTransform(dim))
+    kiss_fftndr_alloc(dims, 2, inverse, 0, &item.m_bytes);
+  else
+    kiss_fftnd_alloc(dims, 2, inverse, 0, &item.m_bytes);
+  Pool::instance()->give(item);
+}
+
+//------------------------------------
+
+bool convolvePlane(const TDimensionI& dim, kiss_fft_scalar* plane,
+                   const kiss_fft_scalar* kernel,
+                   const kiss_fft_cpx* kernelSpectrum, const int* isCanceled) {
+  TDimensionI specDim = FftUtils::spectrumDim(dim);
+
+  FftUtils::Buffer spectrumBuf, kernelSpectrumBuf;
+  kiss_fft_cpx* spectrum = spectrumBuf.allocate<kiss_fft_cpx>(specDim);
+  if (!spectrum) return false;
+
+  FftUtils::Plan plan(dim);
+  if (!plan.forward(plane, spectrum)) return false;
+
+  // cancel check
+  if (isCanceled && *isCanceled) return false;
+
+  if (!kernelSpectrum) {
+    kiss_fft_cpx* buf = kernelSpectrumBuf.allocate<kiss_fft_cpx>(specDim);
+    if (!buf || !plan.forward(kernel, buf)) return false;
+    kernelSpectrum = buf;
+  }
+
+  FftUtils::multiply(spectrum, kernelSpectrum, specDim.lx * specDim.ly);
+
+  // cancel check
+  if (isCanceled && *isCanceled) return false;
+
+  return plan.backward(spectrum, plane);
+}
+
+}  // namespace
+
+//--------------------------------------------
+
+//! Releases the idle plans and buffers once the last running render ends,
+//! so that they are kept only while frames are being rendered.
+class FftPoolManager final : public TRenderResourceManager {
+  T_RENDER_RESOURCE_MANAGER
+
+  static QAtomicInt s_runningCount;
+
+public:
+  void onRenderInstanceStart(unsigned long id) override {
+    s_runningCount.ref();
+  }
+  void onRenderInstanceEnd(unsigned long id) override {
+    if (!s_runningCount.deref()) FftUtils::releaseIdle();
+  }
+};
+
+QAtomicInt FftPoolManager::s_runningCount;
+
+//------------------------------------
+
+class FftPoolManagerGenerator final : public TRenderResourceManagerGenerator {
+public:
+  TRenderResourceManager* operator()(void) override {
+    return new FftPoolManager;
+  }
+};
+
+MANAGER_FILESCOPE_DECLARATION(FftPoolManager, FftPoolManagerGenerator);
+
+//--------------------------------------------
+
+TDimensionI FftUtils::spectrumDim(const TDimensionI& dim) {
+  if (isRealTransform(dim)) return TDimensionI(dim.lx / 2 + 1, dim.ly);
+  return dim;
+}
+
+//--------------------------------------------
+
+void FftUtils::releaseIdle() { Pool::instance()->clear(); }
+
+size_t FftUtils::idleBytes() { return Pool::instance()->bytes(); }
+
+//--------------------------------------------
+
+void FftUtils::multiply(kiss_fft_cpx* spectrum, const kiss_fft_cpx* filter,
+                        int count) {
+  kiss_fft_cpx* s_p       = spectrum;
+  const kiss_fft_cpx* f_p = filter;
+  for (int i = 0; i < count; i++, s_p++, f_p++) {
+    kiss_fft_scalar re = (*s_p).r * (*f_p).r - (*s_p).i * (*f_p).i;
+    kiss_fft_scalar im = (*s_p).r * (*f_p).i + (*f_p).r * (*s_p).i;
+    (*s_p).r           = re;
+    (*s_p).i           = im;
+  }
+}
+
+//--------------------------------------------
+
+void* FftUtils::Buffer::allocate(int rowBytes, int rows) {
+  release();
+
+  IdleItem item;
+  if (Pool::instance()->take(IdleItem::Memory, rowBytes, rows, item))
+    m_ras = item.m_ras;
+  else
+    m_ras = TRasterGR8P(rowBytes, rows);
+
+  m_ras->lock();
+  if (!m_ras->getRawData()) {
+    m_ras->unlock();
+    m_ras = TRasterGR8P();
+    return 0;
+  }
+  return m_ras->getRawData();
+}
+
+void FftUtils::Buffer::release() {
+  if (!m_ras) return;
+  m_ras->unlock();
+
+  IdleItem item;
+  item.m_type  = IdleItem::Memory;
+  item.m_lx    = m_ras->getLx();
+  item.m_ly    = m_ras->getLy();
+  item.m_bytes = (size_t)item.m_lx * (size_t)item.m_ly;
+  item.m_cfg   = 0;
+  item.m_ras   = m_ras;
+  m_ras        = TRasterGR8P();
+  Pool::instance()->give(item);
+}
+
+//--------------------------------------------
+
+FftUtils::Plan::Plan(const TDimensionI& dim)
+    : m_dim(dim), m_fwd(0), m_bkwd(0) {}
+
+FftUtils::Plan::~Plan() {
+  if (m_fwd) givePlan(m_dim, false, m_fwd);
+  if (m_bkwd) givePlan(m_dim, true, m_bkwd);
+}
+
+bool FftUtils::Plan::forward(const kiss_fft_scalar* plane,
+                             kiss_fft_cpx* spectrum) {
+  if (!m_fwd) m_fwd = takePlan(m_dim, false);
+  if (!m_fwd) return false;
+
+  if (isRealTransform(m_dim)) {
+    kiss_fftndr((kiss_fftndr_cfg)m_fwd, plane, spectrum);
+    return true;
+  }
+
+  // complex transform
+  Buffer cpxBuffer;
+  kiss_fft_cpx* buf = cpxBuffer.allocate<kiss_fft_cpx>(m_dim);
+  if (!buf) return false;
+  for (int i = 0; i < m_dim.lx * m_dim.ly; i++) {
+    buf[i].r = plane[i];
+    buf[i].i = 0.f;
+  }
+  kiss_fftnd((kiss_fftnd_cfg)m_fwd, buf, spectrum);
+  return true;
+}
+
+bool FftUtils::Plan::backward(const kiss_fft_cpx* spectrum,
+                              kiss_fft_scalar* plane) {
+  if (!m_bkwd) m_bkwd = takePlan(m_dim, true);
+  if (!m_bkwd) return false;
+
+  if (isRealTransform(m_dim)) {
+    kiss_fftndri((kiss_fftndr_cfg)m_bkwd, spectrum, plane);
+    return true;
+  }
+
+  // complex transform
+  Buffer cpxBuffer;
+  kiss_fft_cpx* buf = cpxBuffer.allocate<kiss_fft_cpx>(m_dim);
+  if (!buf) return false;
+  kiss_fftnd((kiss_fftnd_cfg)m_bkwd, spectrum, buf);
+  for (int i = 0; i < m_dim.lx * m_dim.ly; i++) plane[i] = buf[i].r;
+  return true;
+}
+
+//--------------------------------------------
+
+void FftUtils::Convolver::addPlane(kiss_fft_scalar* plane,
+                                   const kiss_fft_cpx* kernelSpectrum) {
+  Job job = {plane, 0, kernelSpectrum};
+  m_jobs.append(job);
+}
+
+void FftUtils::Convolver::addPlane(kiss_fft_scalar* plane,
+                                   const kiss_fft_scalar* kernel) {
+  Job job = {plane, kernel, 0};
+  m_jobs.append(job);
+}
+
+//--------------------------------------------
+
+bool FftUtils::Convolver::run(const int* isCanceled) {
+  if (m_jobs.isEmpty()) return true;
+
+  // planes are shared among the calling thread and the shared executor
+  QAtomicInt failed(0);
+  TThread::parallelFor(m_jobs.size(), [this, isCanceled, &failed](int j) {
+    const Job& job = m_jobs.at(j);
+    if (!convolvePlane(m_dim, job.m_plane, job.m_kernel, job.m_kernelSpectrum,
+                       isCanceled))
+      failed.storeRelease(1);
+  });
+
+  m_jobs.clear();
+  return !failed.loadAcquire() && !(isCanceled && *isCanceled);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#ifndef IWA_FFT_UTIL_H
+#define IWA_FFT_UTIL_H
+
+#include "traster.h"
+#include "kiss_fft.h"
+
+#include <QList>
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TNZSTDFX_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//------------------------------------
+// FFT convolution engine shared by the bokeh and glare fxs.
+//
+// Planes are real, so real-to-complex transforms are used: the spectrum
+// of a lx * ly plane holds only ly * (lx / 2 + 1) values. Widths which are
+// not even fall back to the complex transform, whose spectrum holds
+// lx * ly values - spectrumDim() tells which one is used, spectra are only
+// meant to be multiplied together.
+//
+// Plans and buffers are pooled while renders run, since the fxs request the
+// same sizes frame after frame; they are released when the last render ends. As in kiss_fft, the inverse transform is
+// not normalized and results are centered at (0, 0) - so the usual
+// getCoord() remapping still applies.
+//------------------------------------
+
+namespace FftUtils {
+
+// dimension of the spectrum of a lx * ly real plane
+DVAPI TDimensionI spectrumDim(const TDimensionI& dim);
+
+// release the idle plans and buffers
+DVAPI void releaseIdle();
+// bytes taken by the idle plans and buffers
+DVAPI size_t idleBytes();
+
+// multiply filter on spectrum
+DVAPI void multiply(kiss_fft_cpx* spectrum,      // dst
+                    const kiss_fft_cpx* filter,  // filter
+                    int count);
+
+//------------------------------------
+// Memory taken from the pool and given back on release / destruction.
+// Contents are not initialized.
+
+class DVAPI Buffer {
+  TRasterGR8P m_ras;
+
+  void* allocate(int rowBytes, int rows);
+
+public:
+  Buffer() {}
+  ~Buffer() { release(); }
+
+  template <typename T>
+  T* allocate(const TDimensionI& dim) {
+    return (T*)allocate(dim.lx * sizeof(T), dim.ly);
+  }
+  void release();
+
+private:
+  // not copyable
+  Buffer(const Buffer&);
+  Buffer& operator=(const Buffer&);
+};
+
+//------------------------------------
+// Transforms of a given size. Plans are taken from the cache the first time
+// they are used, and given back on destruction: a Plan must be used by one
+// thread at a time, but any number of them can exist for the same size.
+
+class DVAPI Plan {
+  TDimensionI m_dim;
+  void *m_fwd, *m_bkwd;
+
+public:
+  Plan(const TDimensionI& dim);
+  ~Plan();
+
+  // return false if the plan could not be allocated
+  bool forward(const kiss_fft_scalar* plane, kiss_fft_cpx* spectrum);
+  bool backward(const kiss_fft_cpx* spectrum, kiss_fft_scalar* plane);
+
+private:
+  // not copyable
+  Plan(const Plan&);
+  Plan& operator=(const Plan&);
+};
+
+//------------------------------------
+// Convolves several planes at once, on the shared executor's threads.
+// The result is stored in the plane itself.
+
+class DVAPI Convolver {
+  struct Job {
+    kiss_fft_scalar* m_plane;
+    const kiss_fft_scalar* m_kernel;
+    const kiss_fft_cpx* m_kernelSpectrum;
+  };
+
+  TDimensionI m_dim;
+  QList<Job> m_jobs;
+
+public:
+  Convolver(const TDimensionI& dim) : m_dim(dim) {}
+
+  void addPlane(kiss_fft_scalar* plane, const kiss_fft_cpx* kernelSpectrum);
+  // the kernel is transformed along with the plane
+  void addPlane(kiss_fft_scalar* plane, const kiss_fft_scalar* kernel);
+
+  // return false if canceled or out of memory
+  bool run(const int* isCanceled = 0);
+};
+
+}  // namespace FftUtils
+
+#endif
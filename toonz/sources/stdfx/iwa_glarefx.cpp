@@ -8,6 +8,7 @@
 #include "tparamuiconcept.h"
 
 #include "kiss_fft.h"
+#include "iwa_fft_util.h"
 #include "iwa_cie_d65.h"
 #include "iwa_xyz.h"
 #include "iwa_simplexnoise.h"
@@ -436,26 +437,6 @@ void Iwa_GlareFx::doCompute(TTile& tile, double frame,
     dimOut.ly = new_y;
   }
 
-  kiss_fft_cpx* kissfft_comp_tmp;
-  kiss_fft_cpx* kissfft_comp_glare;
-  kiss_fft_cpx* kissfft_comp_source;
-  TRasterGR8P kissfft_comp_tmp_ras(dimOut.lx * sizeof(kiss_fft_cpx), dimOut.ly);
-  TRasterGR8P kissfft_comp_glare_ras(dimOut.lx * sizeof(kiss_fft_cpx),
-                                     dimOut.ly);
-  TRasterGR8P kissfft_comp_source_ras(dimOut.lx * sizeof(kiss_fft_cpx),
-                                      dimOut.ly);
-  kissfft_comp_tmp    = (kiss_fft_cpx*)kissfft_comp_tmp_ras->getRawData();
-  kissfft_comp_glare  = (kiss_fft_cpx*)kissfft_comp_glare_ras->getRawData();
-  kissfft_comp_source = (kiss_fft_cpx*)kissfft_comp_source_ras->getRawData();
-  kissfft_comp_tmp_ras->lock();
-  kissfft_comp_glare_ras->lock();
-  kissfft_comp_source_ras->lock();
-
-  int dims[2]              = {dimOut.ly, dimOut.lx};
-  int ndims                = 2;
-  kiss_fftnd_cfg plan_fwd  = kiss_fftnd_alloc(dims, ndims, false, 0, 0);
-  kiss_fftnd_cfg plan_bkwd = kiss_fftnd_alloc(dims, ndims, true, 0, 0);
-
   // obtain the source tile
   TTile sourceTile;
   m_source->allocateAndCompute(sourceTile, _rectOut.getP00(), dimOut,
@@ -464,63 +445,77 @@ void Iwa_GlareFx::doCompute(TTile& tile, double frame,
   if (getFxVersion() >= 3 && !isLinear)
     TRop::toLinearRGB(sourceTile.getRaster(), settings.m_colorSpaceGamma);
 
-  // store the source image to tmp
+  // the glare pattern of each channel is convolved with the source, each
+  // channel in its own thread
+  FftUtils::Convolver convolver(dimOut);
+  FftUtils::Buffer glareBuf[3], sourceBuf[3], sourceSpectrumBuf;
+  kiss_fft_scalar* glare_planes[3];
+  kiss_fft_cpx* source_spectrum = 0;
+
+  // the old versions use the brightness of the source for all channels, so
+  // it is transformed only once
   if (getFxVersion() < 3) {
+    kiss_fft_scalar* source_plane =
+        sourceBuf[0].allocate<kiss_fft_scalar>(dimOut);
+    source_spectrum = sourceSpectrumBuf.allocate<kiss_fft_cpx>(
+        FftUtils::spectrumDim(dimOut));
+    if (!source_plane || !source_spectrum) return;
     if (ras32)
       setSourceTileToBuffer<TRaster32P, TPixel32>(sourceTile.getRaster(),
-                                                  kissfft_comp_tmp);
+                                                  source_plane);
     else if (ras64)
       setSourceTileToBuffer<TRaster64P, TPixel64>(sourceTile.getRaster(),
-                                                  kissfft_comp_tmp);
+                                                  source_plane);
     else if (rasF)
       setSourceTileToBuffer<TRasterFP, TPixelF>(sourceTile.getRaster(),
-                                                kissfft_comp_tmp);
+                                                source_plane);
     // FFT the source
-    kiss_fftnd(plan_fwd, kissfft_comp_tmp, kissfft_comp_source);
+    FftUtils::Plan plan(dimOut);
+    if (!plan.forward(source_plane, source_spectrum)) return;
+    sourceBuf[0].release();
   }
 
-  // compute for each rgb channels
   for (int ch = 0; ch < 3; ch++) {
-    // store the source image to tmp for each channel
-    if (getFxVersion() >= 3) {
-      if (ras32)
-        setSourceTileToBuffer<TRaster32P, TPixel32>(sourceTile.getRaster(),
-                                                    kissfft_comp_tmp, ch);
-      else if (ras64)
-        setSourceTileToBuffer<TRaster64P, TPixel64>(sourceTile.getRaster(),
-                                                    kissfft_comp_tmp, ch);
-      else if (rasF)
-        setSourceTileToBuffer<TRasterFP, TPixelF>(sourceTile.getRaster(),
-                                                  kissfft_comp_tmp, ch);
-      // FFT the source
-      kiss_fftnd(plan_fwd, kissfft_comp_tmp, kissfft_comp_source);
-    }
-
-    kissfft_comp_tmp_ras->clear();
-    // store the glare pattern to tmp
-    setGlarePatternToBuffer(glare_pattern, kissfft_comp_tmp, ch, dimIris,
+    glare_planes[ch] = glareBuf[ch].allocate<kiss_fft_scalar>(dimOut);
+    if (!glare_planes[ch]) return;
+    // store the glare pattern
+    setGlarePatternToBuffer(glare_pattern, glare_planes[ch], ch, dimIris,
                             dimOut);
 
-    // FFT the glare pattern
-    kiss_fftnd(plan_fwd, kissfft_comp_tmp, kissfft_comp_glare);
+    if (source_spectrum) {
+      convolver.addPlane(glare_planes[ch], source_spectrum);
+      continue;
+    }
 
-    // multiply the glare and the source
-    multiplyFilter(kissfft_comp_glare, kissfft_comp_source,
-                   dimOut.lx * dimOut.ly);
+    // store the source image for each channel
+    kiss_fft_scalar* source_plane =
+        sourceBuf[ch].allocate<kiss_fft_scalar>(dimOut);
+    if (!source_plane) return;
+    if (ras32)
+      setSourceTileToBuffer<TRaster32P, TPixel32>(sourceTile.getRaster(),
+                                                  source_plane, ch);
+    else if (ras64)
+      setSourceTileToBuffer<TRaster64P, TPixel64>(sourceTile.getRaster(),
+                                                  source_plane, ch);
+    else if (rasF)
+      setSourceTileToBuffer<TRasterFP, TPixelF>(sourceTile.getRaster(),
+                                                source_plane, ch);
+    convolver.addPlane(glare_planes[ch], source_plane);
+  }
 
-    // Backward-FFT the glare pattern to tmp
-    kiss_fftnd(plan_bkwd, kissfft_comp_glare,
-               kissfft_comp_tmp);  // Backward FFT
+  // Forward-FFT, multiply the glare and the source, Backward-FFT
+  if (!convolver.run(settings.m_isCanceled)) return;
 
-    // convert tmp to channel values, store it into the tile
+  // convert to channel values, store them into the tile
+  for (int ch = 0; ch < 3; ch++) {
     if (ras32)
-      setChannelToResult<TRaster32P, TPixel32>(ras32, kissfft_comp_tmp, ch,
+      setChannelToResult<TRaster32P, TPixel32>(ras32, glare_planes[ch], ch,
                                                dimOut);
     else if (ras64)
-      setChannelToResult<TRaster64P, TPixel64>(ras64, kissfft_comp_tmp, ch,
+      setChannelToResult<TRaster64P, TPixel64>(ras64, glare_planes[ch], ch,
                                                dimOut);
     else if (rasF)
-      setChannelToResult<TRasterFP, TPixelF>(rasF, kissfft_comp_tmp, ch,
+      setChannelToResult<TRasterFP, TPixelF>(rasF, glare_planes[ch], ch,
                                              dimOut);
   }
 
@@ -528,12 +523,6 @@ void Iwa_GlareFx::doCompute(TTile& tile, double frame,
     tile.getRaster()->setLinear(true);
     TRop::tosRGB(tile.getRaster(), settings.m_colorSpaceGamma);
   }
-
-  kiss_fft_free(plan_fwd);
-  kiss_fft_free(plan_bkwd);
-
-  kissfft_comp_source_ras->unlock();
-  kissfft_comp_glare_ras->unlock();
 }
 
 //------------------------------------------------
@@ -820,35 +809,35 @@ void Iwa_GlareFx::setFilterPreviewToResult(const RASTER ras, double3* glare,
 
 // put the source tile's brightness to fft buffer
 template <typename RASTER, typename PIXEL>
-void Iwa_GlareFx::setSourceTileToBuffer(const RASTER ras, kiss_fft_cpx* buf) {
-  kiss_fft_cpx* buf_p = buf;
+void Iwa_GlareFx::setSourceTileToBuffer(const RASTER ras,
+                                        kiss_fft_scalar* buf) {
+  kiss_fft_scalar* buf_p = buf;
   for (int j = 0; j < ras->getLy(); j++) {
     PIXEL* pix = ras->pixels(j);
     for (int i = 0; i < ras->getLx(); i++, pix++, buf_p++) {
       // Value = 0.3R 0.59G 0.11B
-      (*buf_p).r = (double(pix->r) * 0.3 + double(pix->g) * 0.59 +
-                    double(pix->b) * 0.11) /
-                   double(PIXEL::maxChannelValue);
+      (*buf_p) = (double(pix->r) * 0.3 + double(pix->g) * 0.59 +
+                  double(pix->b) * 0.11) /
+                 double(PIXEL::maxChannelValue);
     }
   }
 }
 
 // put the source tile's brightness to fft buffer
 template <typename RASTER, typename PIXEL>
-void Iwa_GlareFx::setSourceTileToBuffer(const RASTER ras, kiss_fft_cpx* buf,
-                                        int channel) {
-  kiss_fft_cpx* buf_p = buf;
+void Iwa_GlareFx::setSourceTileToBuffer(const RASTER ras,
+                                        kiss_fft_scalar* buf, int channel) {
+  kiss_fft_scalar* buf_p = buf;
   for (int j = 0; j < ras->getLy(); j++) {
     PIXEL* pix = ras->pixels(j);
     for (int i = 0; i < ras->getLx(); i++, pix++, buf_p++) {
       if (channel == 0)
-        (*buf_p).r = float(pix->r) / float(PIXEL::maxChannelValue);
+        (*buf_p) = float(pix->r) / float(PIXEL::maxChannelValue);
       else if (channel == 1)
-        (*buf_p).r = float(pix->g) / float(PIXEL::maxChannelValue);
+        (*buf_p) = float(pix->g) / float(PIXEL::maxChannelValue);
       else {  // if (channel == 2)
-        (*buf_p).r = float(pix->b) / float(PIXEL::maxChannelValue);
+        (*buf_p) = float(pix->b) / float(PIXEL::maxChannelValue);
       }
-      (*buf_p).i = 0.f;
     }
   }
 }
@@ -856,39 +845,27 @@ void Iwa_GlareFx::setSourceTileToBuffer(const RASTER ras, kiss_fft_cpx* buf,
 //------------------------------------------------
 
 void Iwa_GlareFx::setGlarePatternToBuffer(const double3* glare,
-                                          kiss_fft_cpx* buf, const int channel,
-                                          const int dimIris,
+                                          kiss_fft_scalar* buf,
+                                          const int channel, const int dimIris,
                                           const TDimensionI& dimOut) {
+  std::fill_n(buf, dimOut.lx * dimOut.ly, 0.f);
   int margin_x = (dimOut.lx - dimIris) / 2;
   int margin_y = (dimOut.ly - dimIris) / 2;
   for (int j = margin_y; j < margin_y + dimIris; j++) {
     const double3* glare_p = &glare[(j - margin_y) * dimIris];
-    kiss_fft_cpx* buf_p    = &buf[j * dimOut.lx + margin_x];
+    kiss_fft_scalar* buf_p = &buf[j * dimOut.lx + margin_x];
     for (int i = margin_x; i < margin_x + dimIris; i++, buf_p++, glare_p++) {
-      (*buf_p).r = (channel == 0)   ? (*glare_p).x
-                   : (channel == 1) ? (*glare_p).y
-                                    : (*glare_p).z;
+      (*buf_p) = (channel == 0)   ? (*glare_p).x
+                 : (channel == 1) ? (*glare_p).y
+                                  : (*glare_p).z;
     }
   }
 }
 
 //------------------------------------------------
 
-void Iwa_GlareFx::multiplyFilter(kiss_fft_cpx* glare,
-                                 const kiss_fft_cpx* source, const int count) {
-  kiss_fft_cpx* g_p       = glare;
-  const kiss_fft_cpx* s_p = source;
-  for (int i = 0; i < count; i++, g_p++, s_p++) {
-    double re = (*g_p).r * (*s_p).r - (*g_p).i * (*s_p).i;
-    double im = (*g_p).r * (*s_p).i + (*s_p).r * (*g_p).i;
-    (*g_p).r  = re;
-    (*g_p).i  = im;
-  }
-}
-
-//------------------------------------------------
 template <typename RASTER, typename PIXEL>
-void Iwa_GlareFx::setChannelToResult(const RASTER ras, kiss_fft_cpx* buf,
+void Iwa_GlareFx::setChannelToResult(const RASTER ras, kiss_fft_scalar* buf,
                                      int channel, const TDimensionI& dimOut) {
   auto clamp01 = [](double chan) {
     if (chan < 0.0) return 0.0;
@@ -902,12 +879,11 @@ void Iwa_GlareFx::setChannelToResult(const RASTER ras, kiss_fft_cpx* buf,
   bool doClamp = (ras->getPixelSize() != 16);
 
   for (int j = 0; j < ras->getLy(); j++) {
-    // kiss_fft_cpx* buf_p = &buf[(j + margin_y)*dimOut.lx + margin_x];
     PIXEL* pix = ras->pixels(j);
     for (int i = 0; i < ras->getLx(); i++, pix++) {
-      kiss_fft_cpx fft_val =
+      kiss_fft_scalar fft_val =
           buf[getCoord(i + margin_x, j + margin_y, dimOut.lx, dimOut.ly)];
-      double val = fft_val.r / (dimOut.lx * dimOut.ly);
+      double val = fft_val / (dimOut.lx * dimOut.ly);
       if (doClamp) {
         if (channel == 0)
           pix->r = (typename PIXEL::Channel)(clamp01(val) *
@@ -27,6 +27,7 @@
 #include <QMutexLocker>
 
 #include <sstream>
+#include <algorithm>
 
 namespace {
 QMutex mutex;
@@ -196,7 +197,7 @@ void Iwa_Particles_Engine::roll_particles(
     TTile *tile,                      /*-結果を格納するTile-*/
     std::map<int, TTile *> porttiles, /*-コントロール画像のポート番号／タイル-*/
     const TRenderSettings &ri, /*-現在のフレームの計算用RenderSettings-*/
-    std::list<Iwa_Particle> &myParticles, /*-パーティクルのリスト-*/
+    std::vector<Iwa_Particle> &myParticles, /*-パーティクルのリスト-*/
     struct particles_values &values, /*-現在のフレームでのパラメータ-*/
     float cx,                        /*- 0 で入ってくる-*/
     float cy,                        /*- 0 で入ってくる-*/
@@ -335,24 +336,26 @@ void Iwa_Particles_Engine::roll_particles(
   }
   /*- 既存粒子を動かし、かつ新規粒子を作る -*/
   else {
-    std::list<Iwa_Particle>::iterator it;
-    for (it = myParticles.begin(); it != myParticles.end();) {
-      std::list<Iwa_Particle>::iterator current = it;
-      ++it;
-
-      Iwa_Particle &part = (*current);
-      if (part.scale <= 0.0) continue;
-      if (part.lifetime <= 0)        // Note: This is in line with the above
-                                     // "lifetime>curr_frame-frame"
-        myParticles.erase(current);  // insertion counterpart
-      else {
-        part.move(porttiles, values, ranges, windx, windy, xgravity, ygravity,
-                  dpi, lastframe[part.level]);
-      }
+    // Note: This is in line with the above "lifetime>curr_frame-frame"
+    // insertion counterpart
+    myParticles.erase(std::remove_if(myParticles.begin(), myParticles.end(),
+                                     [](const Iwa_Particle &part) {
+                                       return part.scale > 0.0 &&
+                                              part.lifetime <= 0;
+                                     }),
+                      myParticles.end());
+
+    std::vector<Iwa_Particle>::iterator it;
+    for (it = myParticles.begin(); it != myParticles.end(); ++it) {
+      if (it->scale <= 0.0) continue;
+      it->move(porttiles, values, ranges, windx, windy, xgravity, ygravity, dpi,
+               lastframe[it->level]);
     }
 
     switch (values.toplayer_val) {
-    case Iwa_TiledParticlesFx::TOP_YOUNGER:
+    case Iwa_TiledParticlesFx::TOP_YOUNGER: {
+      // Newborns go on top, the youngest first
+      std::vector<Iwa_Particle> newborns;
       for (i = 0; i < actualBirthParticles; i++) {
         /*- 出発する粒子 -*/
         ParticleOrigin po = particleOrigins.at(leavingPartIndex.at(i));
@@ -369,23 +372,24 @@ void Iwa_Particles_Engine::roll_particles(
                     ranges.lifetime_range * values.random_val->getFloat());
         }
         if (lifetime > curr_frame - frame) {
-          myParticles.push_front(Iwa_Particle(
+          newborns.push_back(Iwa_Particle(
               lifetime, seed, porttiles, values, ranges, totalparticles, 0,
               (int)po.level, lastframe[po.level], po.pos[0], po.pos[1],
               po.isUpward,
               (int)po.initSourceFrame) /*- 素材内の初期フレーム位置 -*/
-                                 );
+                             );
         }
         totalparticles++;
       }
+      myParticles.insert(myParticles.begin(), newborns.rbegin(),
+                         newborns.rend());
       break;
+    }
 
     case Iwa_TiledParticlesFx::TOP_RANDOM:
       for (i = 0; i < actualBirthParticles; i++) {
         double tmp = values.random_val->getFloat() * myParticles.size();
-        std::list<Iwa_Particle>::iterator it = myParticles.begin();
-        for (int j = 0; j < tmp; j++, it++)
-          ;
+        int pos    = (int)std::ceil(tmp);
         {
           /*- 出発する粒子 -*/
           ParticleOrigin po = particleOrigins.at(leavingPartIndex.at(i));
@@ -403,7 +407,7 @@ void Iwa_Particles_Engine::roll_particles(
           }
           if (lifetime > curr_frame - frame) {
             myParticles.insert(
-                it,
+                myParticles.begin() + pos,
                 Iwa_Particle(
                     lifetime, seed, porttiles, values, ranges, totalparticles,
                     0, (int)po.level, lastframe[po.level], po.pos[0], po.pos[1],
@@ -565,10 +569,7 @@ void Iwa_Particles_Engine::render_particles(
 
   bool isFirstFrame = !(pc->isCached(fxId));
 
-  // Retrieve the last rolled frame
-  Iwa_ParticlesManager::FrameData *particlesData = pc->data(fxId);
-
-  std::list<Iwa_Particle> myParticles;
+  std::vector<Iwa_Particle> myParticles;
   TRandom myRandom  = m_parent->randseed_val->getValue();
   values.random_val = &myRandom;
 
@@ -580,9 +581,6 @@ void Iwa_Particles_Engine::render_particles(
   TRectD outTileBBox(tile->m_pos, TDimensionD(tile->getRaster()->getLx(),
                                               tile->getRaster()->getLy()));
 
-  /*- 現在取っておいてあるデータのフレーム番号 -*/
-  int pcFrame = particlesData->m_frame;
-
   /*- マージンをピクセル単位に換算する -*/
   double pixelMargin;
   {
@@ -595,27 +593,23 @@ void Iwa_Particles_Engine::render_particles(
   /*- 外側にマージンを取って粒子を生成 -*/
   TRectD resourceTileBBox = outTileBBox.enlarge(pixelMargin);
 
-  /*- 初期粒子量。これが変わっていなければ、BGはそのまま描く -*/
-  int initialOriginsSize;
-  if (pcFrame > curr_frame) {
-    /*- データを初期化 -*/
-    // Clear stored particlesData
-    particlesData->clear();
-    pcFrame = particlesData->m_frame;
+  // Resume from the latest snapshot of this tile stored by any thread
+  Iwa_ParticlesManager::FrameDataP particlesData =
+      pc->data(fxId, curr_frame, resourceTileBBox, ri.m_affine);
 
-    /*- まだ出発していない粒子情報を初期化 -*/
-    initParticleOrigins(resourceTileBBox, particleOrigins, curr_frame,
-                        ri.m_affine, values, level_n, last_frame, pixelMargin);
-    initialOriginsSize = particleOrigins.size();
-
-  }
+  /*- 現在取っておいてあるデータのフレーム番号 -*/
+  int pcFrame = (std::numeric_limits<int>::min)();
 
-  else if (pcFrame >= startframe - 1) {
+  /*- 初期粒子量。これが変わっていなければ、BGはそのまま描く -*/
+  int initialOriginsSize;
+  if (particlesData && particlesData->m_frame >= startframe - 1) {
+    pcFrame            = particlesData->m_frame;
     myParticles        = particlesData->m_particles;
     myRandom           = particlesData->m_random;
     totalparticles     = particlesData->m_totalParticles;
+    fractpart          = particlesData->m_fractPart;
     particleOrigins    = particlesData->m_particleOrigins;
-    initialOriginsSize = -1;
+    initialOriginsSize = particlesData->m_initialOriginsSize;
   } else {
     /*- まだ出発していない粒子情報を初期化 -*/
     initParticleOrigins(resourceTileBBox, particleOrigins, curr_frame,
@@ -739,16 +733,24 @@ void Iwa_Particles_Engine::render_particles(
                    intpart /*- 実際に生成したい粒子数 -*/
                    );
 
-    // Store the rolled data in the particles manager
-    if (!particlesData->m_calculated ||
-        particlesData->m_frame + particlesData->m_maxTrail < frame) {
-      particlesData->m_frame     = frame;
-      particlesData->m_particles = myParticles;
-      particlesData->m_random    = myRandom;
-      particlesData->buildMaxTrail();
-      particlesData->m_calculated      = true;
-      particlesData->m_totalParticles  = totalparticles;
-      particlesData->m_particleOrigins = particleOrigins;
+    // Store the rolled data in the particles manager if a snapshot is due,
+    // and as the latest state of this thread on the rendered frame
+    bool latest = (frame == curr_frame);
+    if (latest ||
+        pc->isSnapshotFrame(fxId, frame, resourceTileBBox, ri.m_affine)) {
+      Iwa_ParticlesManager::FrameData *data =
+          new Iwa_ParticlesManager::FrameData;
+      data->m_frame              = frame;
+      data->m_random             = myRandom;
+      data->m_particles          = myParticles;
+      data->m_totalParticles     = totalparticles;
+      data->m_fractPart          = fractpart;
+      data->m_particleOrigins    = particleOrigins;
+      data->m_initialOriginsSize = initialOriginsSize;
+      data->m_tileBBox           = resourceTileBBox;
+      data->m_affine             = ri.m_affine;
+
+      pc->addData(fxId, Iwa_ParticlesManager::FrameDataP(data), latest);
     }
 
     // Render the particles if the distance from current frame is a trail
@@ -762,7 +764,7 @@ void Iwa_Particles_Engine::render_particles(
          -*/
       /*-	①飛んでいる粒子 -*/
       if (values.iw_rendermode_val != Iwa_TiledParticlesFx::REND_BG) {
-        std::list<Iwa_Particle>::iterator pt;
+        std::vector<Iwa_Particle>::iterator pt;
         for (pt = myParticles.begin(); pt != myParticles.end(); ++pt) {
           Iwa_Particle &part = *pt;
           int ndx            = part.frame % last_frame[part.level];
@@ -809,12 +811,13 @@ void Iwa_Particles_Engine::render_particles(
       if (values.iw_rendermode_val != Iwa_TiledParticlesFx::REND_BG) {
         if (values.toplayer_val == Iwa_TiledParticlesFx::TOP_SMALLER ||
             values.toplayer_val == Iwa_TiledParticlesFx::TOP_BIGGER)
-          myParticles.sort(Iwa_ComparebySize());
+          std::stable_sort(myParticles.begin(), myParticles.end(),
+                           Iwa_ComparebySize());
 
         if (values.toplayer_val == Iwa_TiledParticlesFx::TOP_SMALLER) {
           int unit  = 1 + (int)myParticles.size() / 100;
           int count = 0;
-          std::list<Iwa_Particle>::iterator pt;
+          std::vector<Iwa_Particle>::iterator pt;
           for (pt = myParticles.begin(); pt != myParticles.end(); ++pt) {
             count++;
 
@@ -833,7 +836,7 @@ void Iwa_Particles_Engine::render_particles(
         } else {
           int unit  = 1 + (int)myParticles.size() / 100;
           int count = 0;
-          std::list<Iwa_Particle>::reverse_iterator pt;
+          std::vector<Iwa_Particle>::reverse_iterator pt;
           for (pt = myParticles.rbegin(); pt != myParticles.rend(); ++pt) {
             count++;
 
@@ -13,13 +13,12 @@
 EXPLANATION:
 
 ParticlesManager improves the old particles system as follows - the particles
-manager stores the
-last particles configuration which had some particle rendered by a thread.
-Under normal cicumstances, this means that every thread has the particles
-configuration that rendered
-last. In case a trail was set, such frame is that beyond the trail.
-This managemer works well on the assumption that each thread builds particle in
-an incremental timeline.
+manager stores snapshots of the particles configuration at regular frame
+intervals, shared by all the render threads. Rendering a frame resumes from
+the latest snapshot before the frame, rather than rolling from the start
+frame. Since particle origins are laid on the rendered tile, snapshots are
+only resumed by renders of the same tile. The latest state rolled by each
+thread is also kept - see ParticlesSnapshots.
 */
 
 //--------------------------------------------------------------------------------------------------
@@ -29,8 +28,6 @@ DEFINE_CLASS_CODE(Iwa_ParticlesManager::FxData,
 
 //--------------------------------------------------------------------------------------------------
 
-typedef std::map<double, Iwa_ParticlesManager::FrameData> FramesMap;
-
 //************************************************************************************************
 //    Preliminaries
 //************************************************************************************************
@@ -52,37 +49,17 @@ MANAGER_FILESCOPE_DECLARATION(Iwa_ParticlesManager,
 //    FrameData implementation
 //************************************************************************************************
 
-Iwa_ParticlesManager::FrameData::FrameData(FxData *fxData)
-    : m_fxData(fxData)
-    , m_frame((std::numeric_limits<int>::min)())
-    , m_calculated(false)
-    , m_maxTrail(-1)
-    , m_totalParticles(0) {
-  m_fxData->addRef();
-}
-
-//-------------------------------------------------------------------------
-
-Iwa_ParticlesManager::FrameData::~FrameData() { m_fxData->release(); }
-
-//-------------------------------------------------------------------------
-
-void Iwa_ParticlesManager::FrameData::buildMaxTrail() {
-  // Store the maximum trail of each particle
-  std::list<Iwa_Particle>::iterator it;
-  for (it = m_particles.begin(); it != m_particles.end(); ++it)
-    m_maxTrail = std::max(m_maxTrail, it->trail);
-}
+Iwa_ParticlesManager::FrameData::FrameData()
+    : m_frame((std::numeric_limits<int>::min)())
+    , m_totalParticles(0)
+    , m_fractPart(0)
+    , m_initialOriginsSize(-1) {}
 
 //-------------------------------------------------------------------------
 
-void Iwa_ParticlesManager::FrameData::clear() {
-  m_frame = (std::numeric_limits<int>::min)();
-  m_particles.clear();
-  m_random         = TRandom();
-  m_calculated     = false;
-  m_maxTrail       = -1;
-  m_totalParticles = 0;
+size_t Iwa_ParticlesManager::FrameData::bytes() const {
+  return sizeof(*this) + m_particles.capacity() * sizeof(Iwa_Particle) +
+         m_particleOrigins.size() * sizeof(ParticleOrigin);
 }
 
 //************************************************************************************************
@@ -120,27 +97,66 @@ void Iwa_ParticlesManager::onRenderStatusStart(int renderStatus) {
 
 //-------------------------------------------------------------------------
 
-Iwa_ParticlesManager::FrameData *Iwa_ParticlesManager::data(
+Iwa_ParticlesManager::FxData *Iwa_ParticlesManager::fxData(
     unsigned long fxId) {
-  QMutexLocker locker(&m_mutex);
-
   std::map<unsigned long, FxData *>::iterator it = m_fxs.find(fxId);
   if (it == m_fxs.end()) {
     it = m_fxs.insert(std::make_pair(fxId, new FxData)).first;
     it->second->addRef();
   }
 
-  FxData *fxData = it->second;
-  FrameData *d   = fxData->m_frames.localData();
-  if (!d) {
-    d = new FrameData(fxData);
-    fxData->m_frames.setLocalData(d);
-  }
+  return it->second;
+}
+
+//-------------------------------------------------------------------------
+
+Iwa_ParticlesManager::FrameDataP Iwa_ParticlesManager::data(
+    unsigned long fxId, int frame, const TRectD &tileBBox,
+    const TAffine &affine) {
+  QMutexLocker locker(&m_mutex);
 
-  return d;
+  // The frame itself is always rolled, since it is the one rendered
+  return fxData(fxId)->m_snapshots.find(
+      frame - 1, [&tileBBox, &affine](const FrameData &data) {
+        return data.isSameTile(tileBBox, affine);
+      });
 }
 
+//-------------------------------------------------------------------------
+
+bool Iwa_ParticlesManager::isSnapshotFrame(unsigned long fxId, int frame,
+                                           const TRectD &tileBBox,
+                                           const TAffine &affine) {
+  QMutexLocker locker(&m_mutex);
+
+  return fxData(fxId)->m_snapshots.isSnapshotFrame(
+      frame, [&tileBBox, &affine](const FrameData &data) {
+        return data.isSameTile(tileBBox, affine);
+      });
+}
+
+//-------------------------------------------------------------------------
+
+void Iwa_ParticlesManager::addData(unsigned long fxId,
+                                   const FrameDataP &data, bool latest) {
+  QMutexLocker locker(&m_mutex);
+
+  ParticlesSnapshots<FrameData> &snapshots = fxData(fxId)->m_snapshots;
+
+  // Another thread may have got there first
+  if (snapshots.isSnapshotFrame(
+          data->m_frame, [&data](const FrameData &other) {
+            return other.isSameTile(data->m_tileBBox, data->m_affine);
+          }))
+    snapshots.add(data);
+
+  if (latest) snapshots.setLatest(data);
+}
+
+//-------------------------------------------------------------------------
+
 bool Iwa_ParticlesManager::isCached(unsigned long fxId) {
+  QMutexLocker locker(&m_mutex);
   std::map<unsigned long, FxData *>::iterator it = m_fxs.find(fxId);
   return (it != m_fxs.end());
 }
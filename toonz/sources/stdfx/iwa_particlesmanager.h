@@ -12,10 +12,14 @@
 #include "trenderresourcemanager.h"
 #include "trandom.h"
 #include "iwa_particles.h"
+#include "particlessnapshots.h"
 
-#include <QThreadStorage>
 #include <QMutex>
 
+#include <map>
+#include <memory>
+#include <vector>
+
 //-----------------------------------------------------------------------
 
 //  Forward declarations
@@ -32,29 +36,37 @@ class Iwa_ParticlesManager final : public TRenderResourceManager {
 public:
   struct FxData;
 
+  // Particles configuration after a frame has been rolled. Snapshots are
+  // shared among the render threads, and never modified once stored.
   struct FrameData {
-    FxData *m_fxData;
-    double m_frame;
+    int m_frame;
     TRandom m_random;
-    std::list<Iwa_Particle> m_particles;
-    bool m_calculated;
-    int m_maxTrail;
+    std::vector<Iwa_Particle> m_particles;
     int m_totalParticles;
+    float m_fractPart;  // Birth rate remainder
 
     /*- しきつめ情報 -*/
     QList<ParticleOrigin> m_particleOrigins;
+    int m_initialOriginsSize;
+
+    // Particle origins depend on the rendered tile
+    TRectD m_tileBBox;
+    TAffine m_affine;
 
-    FrameData(FxData *fxData);
-    ~FrameData();
+    FrameData();
 
-    void buildMaxTrail();
-    void clear();
+    size_t bytes() const;
+    bool isSameTile(const TRectD &tileBBox, const TAffine &affine) const {
+      return m_tileBBox == tileBBox && m_affine == affine;
+    }
   };
 
+  typedef std::shared_ptr<const FrameData> FrameDataP;
+
   struct FxData final : public TSmartObject {
     DECLARE_CLASS_CODE
 
-    QThreadStorage<FrameData *> m_frames;
+    ParticlesSnapshots<FrameData> m_snapshots;
 
     FxData();
   };
@@ -65,7 +77,18 @@ public:
 
   static Iwa_ParticlesManager *instance();
 
-  FrameData *data(unsigned long fxId);
+  //! Returns the latest snapshot of the specified tile before the specified
+  //! frame, or 0 if there is none.
+  FrameDataP data(unsigned long fxId, int frame, const TRectD &tileBBox,
+                  const TAffine &affine);
+
+  //! Returns whether a snapshot of the specified frame should be stored.
+  bool isSnapshotFrame(unsigned long fxId, int frame, const TRectD &tileBBox,
+                       const TAffine &affine);
+
+  //! Stores the specified data as a snapshot, if one is due, and as the
+  //! latest state of the calling thread if required.
+  void addData(unsigned long fxId, const FrameDataP &data, bool latest);
 
   bool isCached(unsigned long fxId);
 
@@ -76,6 +99,8 @@ private:
   int m_renderStatus;
 
   void onRenderStatusStart(int renderStatus) override;
+
+  FxData *fxData(unsigned long fxId);
 };
 
 #endif
@@ -26,6 +26,7 @@
 #include "trenderer.h"
 
 #include <sstream>
+#include <algorithm>
 
 #include <QPointF>
 #include <QMatrix4x4>
@@ -195,9 +196,10 @@ bool Particles_Engine::port_is_used_for_gradient(
 /*-- Startフレームからカレントフレームまで順番に回す関数 --*/
 void Particles_Engine::roll_particles(
     TTile *tile, std::map<int, TTile *> porttiles, const TRenderSettings &ri,
-    std::list<Particle> &myParticles, struct particles_values &values, float cx,
-    float cy, int frame, int curr_frame, int level_n, bool *random_level,
-    float dpi, std::vector<int> lastframe, int &totalparticles) {
+    std::vector<Particle> &myParticles, struct particles_values &values,
+    float cx, float cy, int frame, int curr_frame, int level_n,
+    bool *random_level, float dpi, std::vector<int> lastframe,
+    int &totalparticles) {
   particles_ranges ranges;
   int i, newparticles;
   float xgravity, ygravity, windx, windy;
@@ -295,23 +297,24 @@ void Particles_Engine::roll_particles(
       totalparticles++;
     }
   } else {
-    std::list<Particle>::iterator it;
-    for (it = myParticles.begin(); it != myParticles.end();) {
-      std::list<Particle>::iterator current = it;
-      ++it;
-
-      Particle &part = (*current);
-      if (part.lifetime <= 0)        // Note: This is in line with the above
-                                     // "lifetime>curr_frame-frame"
-        myParticles.erase(current);  // insertion counterpart
-      else
-        part.move(porttiles, values, ranges, windx, windy, xgravity, ygravity,
-                  dpi, lastframe[part.level]);
-    }
+    // Note: This is in line with the above "lifetime>curr_frame-frame"
+    // insertion counterpart
+    myParticles.erase(std::remove_if(myParticles.begin(), myParticles.end(),
+                                     [](const Particle &part) {
+                                       return part.lifetime <= 0;
+                                     }),
+                      myParticles.end());
+
+    std::vector<Particle>::iterator it;
+    for (it = myParticles.begin(); it != myParticles.end(); ++it)
+      it->move(porttiles, values, ranges, windx, windy, xgravity, ygravity, dpi,
+               lastframe[it->level]);
 
     int oldparticles = myParticles.size();
     switch (values.toplayer_val) {
-    case ParticlesFx::TOP_YOUNGER:
+    case ParticlesFx::TOP_YOUNGER: {
+      // Newborns go on top, the youngest first
+      std::vector<Particle> newborns;
       for (i = 0; i < newparticles; i++) {
         int seed  = (int)((std::numeric_limits<int>::max)() *
                          values.random_val->getFloat());
@@ -326,21 +329,21 @@ void Particles_Engine::roll_particles(
                     ranges.lifetime_range * values.random_val->getFloat());
 
         if (lifetime > curr_frame - frame)
-          myParticles.push_front(Particle(lifetime, seed, porttiles, values,
-                                          ranges, myregions, totalparticles, 0,
-                                          level, lastframe[level], myHistogram,
-                                          myWeight));
+          newborns.push_back(Particle(lifetime, seed, porttiles, values, ranges,
+                                      myregions, totalparticles, 0, level,
+                                      lastframe[level], myHistogram, myWeight));
 
         totalparticles++;
       }
+      myParticles.insert(myParticles.begin(), newborns.rbegin(),
+                         newborns.rend());
       break;
+    }
 
     case ParticlesFx::TOP_RANDOM:
       for (i = 0; i < newparticles; i++) {
         double tmp = values.random_val->getFloat() * myParticles.size();
-        std::list<Particle>::iterator it = myParticles.begin();
-        for (int j = 0; j < tmp; j++, it++)
-          ;
+        int pos    = (int)std::ceil(tmp);
         {
           int seed     = (int)((std::numeric_limits<int>::max)() *
                            values.random_val->getFloat());
@@ -355,9 +358,10 @@ void Particles_Engine::roll_particles(
                       ranges.lifetime_range * values.random_val->getFloat());
           if (lifetime > curr_frame - frame)
             myParticles.insert(
-                it, Particle(lifetime, seed, porttiles, values, ranges,
-                             myregions, totalparticles, 0, level,
-                             lastframe[level], myHistogram, myWeight));
+                myParticles.begin() + pos,
+                Particle(lifetime, seed, porttiles, values, ranges, myregions,
+                         totalparticles, 0, level, lastframe[level],
+                         myHistogram, myWeight));
 
           totalparticles++;
         }
@@ -467,24 +471,26 @@ void Particles_Engine::render_particles(
 
   ParticlesManager *pc = ParticlesManager::instance();
 
-  // Retrieve the last rolled frame
-  ParticlesManager::FrameData *particlesData = pc->data(fxId);
-
-  std::list<Particle> myParticles;
+  std::vector<Particle> myParticles;
   TRandom myRandom;
   values.random_val  = &myRandom;
   myRandom           = m_parent->randseed_val->getValue();
   int totalparticles = 0;
 
-  int pcFrame = particlesData->m_frame;
-  if (pcFrame > curr_frame) {
-    // Clear stored particlesData
-    particlesData->clear();
-    pcFrame = particlesData->m_frame;
-  } else if (pcFrame >= startframe - 1) {
+  // Last frame reached by the trails of the rolled particles
+  int trailEnd = (std::numeric_limits<int>::min)();
+
+  // Resume from the latest snapshot stored by any thread
+  int pcFrame = (std::numeric_limits<int>::min)();
+
+  ParticlesManager::FrameDataP particlesData = pc->data(fxId, curr_frame);
+  if (particlesData && particlesData->m_frame >= startframe - 1) {
+    pcFrame        = particlesData->m_frame;
     myParticles    = particlesData->m_particles;
     myRandom       = particlesData->m_random;
     totalparticles = particlesData->m_totalParticles;
+    trailEnd       = std::max(particlesData->m_trailEnd,
+                              pcFrame + particlesData->m_maxTrail);
   }
   /*- スタートからカレントフレームまでループ -*/
   for (frame = startframe - 1; frame <= curr_frame; ++frame) {
@@ -642,25 +648,33 @@ void Particles_Engine::render_particles(
                      curr_frame, level_n, &random_level, 1, last_frame,
                      totalparticles);
 
-      // Store the rolled data in the particles manager
-      if (!particlesData->m_calculated ||
-          particlesData->m_frame + particlesData->m_maxTrail < frame) {
-        particlesData->m_frame     = frame;
-        particlesData->m_particles = myParticles;
-        particlesData->m_random    = myRandom;
-        particlesData->buildMaxTrail();
-        particlesData->m_calculated     = true;
-        particlesData->m_totalParticles = totalparticles;
+      // Store the rolled data in the particles manager if a snapshot is due,
+      // and as the latest state of this thread on the rendered frame
+      bool latest = (frame == curr_frame);
+      if (latest || pc->isSnapshotFrame(fxId, frame)) {
+        ParticlesManager::FrameData *data = new ParticlesManager::FrameData;
+        data->m_frame                     = frame;
+        data->m_random                    = myRandom;
+        data->m_particles                 = myParticles;
+        data->m_trailEnd                  = trailEnd;
+        data->m_totalParticles            = totalparticles;
+        data->buildMaxTrail();
+
+        pc->addData(fxId, ParticlesManager::FrameDataP(data), latest);
       }
+
+      std::vector<Particle>::iterator pt;
+      for (pt = myParticles.begin(); pt != myParticles.end(); ++pt)
+        trailEnd = std::max(trailEnd, frame + pt->trail);
     }
 
     // Render the particles if the distance from current frame is a trail
-    // multiple
-    if (frame >= startframe - 1 &&
+    // multiple. Particles before the resumed snapshot have no trail here.
+    if (frame >= pcFrame &&
         !(dist_frame %
           (values.trailstep_val > 1.0 ? (int)values.trailstep_val : 1))) {
       // Store the maximum particle size before the do_render cycle
-      std::list<Particle>::iterator pt;
+      std::vector<Particle>::iterator pt;
       for (pt = myParticles.begin(); pt != myParticles.end(); ++pt) {
         Particle &part = *pt;
         int ndx        = part.frame % last_frame[part.level];
@@ -677,10 +691,16 @@ void Particles_Engine::render_particles(
 
       if (values.toplayer_val == ParticlesFx::TOP_SMALLER ||
           values.toplayer_val == ParticlesFx::TOP_BIGGER)
-        myParticles.sort(ComparebySize());
+        std::stable_sort(myParticles.begin(), myParticles.end(),
+                         ComparebySize());
+
+      // Particles sharing a level frame share its raster, and are overed on
+      // the tile in batches
+      ParticleSources sources;
+      ParticleSplats splats;
 
       if (values.toplayer_val == ParticlesFx::TOP_SMALLER) {
-        std::list<Particle>::iterator pt;
+        std::vector<Particle>::iterator pt;
         for (pt = myParticles.begin(); pt != myParticles.end(); ++pt) {
           Particle &part = *pt;
           if (dist_frame <= part.trail && part.scale && part.lifetime > 0 &&
@@ -689,11 +709,11 @@ void Particles_Engine::render_particles(
           {
             do_render(&part, tile, part_ports, porttiles, ri, p_size, p_offset,
                       last_frame[part.level], partLevel, values, opacity_range,
-                      dist_frame, partScales);
+                      dist_frame, partScales, sources, splats);
           }
         }
       } else {
-        std::list<Particle>::reverse_iterator pt;
+        std::vector<Particle>::reverse_iterator pt;
         for (pt = myParticles.rbegin(); pt != myParticles.rend(); ++pt) {
           Particle &part = *pt;
           if (dist_frame <= part.trail && part.scale && part.lifetime > 0 &&
@@ -701,10 +721,12 @@ void Particles_Engine::render_particles(
           {
             do_render(&part, tile, part_ports, porttiles, ri, p_size, p_offset,
                       last_frame[part.level], partLevel, values, opacity_range,
-                      dist_frame, partScales);
+                      dist_frame, partScales, sources, splats);
           }
         }
       }
+
+      splats.flush(tile->getRaster());
     }
 
     std::map<int, TTile *>::iterator it;
@@ -720,14 +742,13 @@ void Particles_Engine::do_render(
     TDimension &p_size, TPointD &p_offset, int lastframe,
     std::vector<TLevelP> partLevel, struct particles_values &values,
     double opacity_range, int dist_frame,
-    std::map<std::pair<int, int>, double> &partScales) {
+    std::map<std::pair<int, int>, double> &partScales,
+    ParticleSources &sources, ParticleSplats &splats) {
   // Retrieve the particle frame - that is, the *column frame* from which we are
   // picking
   // the particle to be rendered.
   int ndx = part->frame % lastframe;
 
-  TRasterP tileRas(tile->getRaster());
-
   std::string levelid;
   double aim_angle = 0;
   if (values.pathaim_val) {
@@ -741,22 +762,88 @@ void Particles_Engine::do_render(
   TScale scaleM(part->scale);
   TAffine M(rotM * scaleM);
 
+  // Retrieve the particle raster, once for all the particles sharing it
+  std::pair<int, int> sourceId(part->level, ndx);
+  ParticleSources::iterator st = sources.find(sourceId);
+  if (st == sources.end()) {
+    st = sources.insert(std::make_pair(sourceId, ParticleSource())).first;
+    fetch_particle_source(part->level, ndx, tile, part_ports, ri, partLevel,
+                          partScales[sourceId], st->second);
+  }
+
+  const ParticleSource &source = st->second;
+  if (!source.m_ras) return;
+
+  TRasterP ras     = source.m_ras;
+  TRectD bbox      = source.m_bbox;
+  double partScale = source.m_scale;
+
+  // Deal with particle colors/opacity
+  TRaster32P rfinalpart;
+  double curr_opacity =
+      part->set_Opacity(porttiles, values, opacity_range, dist_frame);
+  if (curr_opacity != 1.0 || part->gencol.fadecol || part->fincol.fadecol ||
+      part->foutcol.fadecol) {
+    /*- 毎フレーム現在位置のピクセル色を参照 -*/
+    if (values.pick_color_for_every_frame_val && values.gencol_ctrl_val &&
+        (porttiles.find(values.gencol_ctrl_val) != porttiles.end()))
+      part->get_image_reference(porttiles[values.gencol_ctrl_val], values,
+                                part->gencol.col);
+
+    rfinalpart = ras->clone();
+    part->modify_colors_and_opacity(values, curr_opacity, dist_frame,
+                                    rfinalpart);
+  } else
+    rfinalpart = ras;
+
+  // Now, let's build the particle transform before it is overed on the output
+  // tile
+
+  // First, complete the transform by adding the rotational and scale
+  // components from
+  // Particles parameters
+  M = ri.m_affine * M * TScale(1.0 / partScale);
+
+  // render with motion blur
+  if (values.motion_blur_val) {
+    if (do_render_motion_blur(part, tile, rfinalpart, M, bbox,
+                              values.trailopacity_val,
+                              values.motion_blur_gamma_adjust_val, ri, splats))
+      return;
+  }
+
+  // Then, retrieve the particle position in current reference.
+  TPointD pos(part->x, part->y);
+  pos = ri.m_affine * pos;
+
+  // Finally, add the translational component to the particle
+  // NOTE: p_offset is added to account for the particle relative position
+  // inside its level's bbox
+  M = TTranslation(pos - tile->m_pos) * M * TTranslation(bbox.getP00());
+
+  splats.add(tile->getRaster(), rfinalpart, M);
+}
+
+//-----------------------------------------------------------------
+/*- do_render から呼ばれる。粒子の素材の (レベル, フレーム) ごとに1回 -*/
+void Particles_Engine::fetch_particle_source(
+    int level, int ndx, TTile *tile, std::vector<TRasterFxPort *> &part_ports,
+    const TRenderSettings &ri, std::vector<TLevelP> &partLevel,
+    double maxScale, ParticleSource &source) {
   // Particles deal with dpi affines on their own
   TAffine scaleAff(m_parent->handledAffine(ri, m_frame));
-  double partScale =
-      scaleAff.a11 * partScales[std::pair<int, int>(part->level, ndx)];
+  double partScale = scaleAff.a11 * maxScale;
   TDimensionD partResolution(0, 0);
   TRenderSettings riNew(ri);
 
   // Retrieve the bounding box in the standard reference
   TRectD bbox(-5.0, -5.0, 5.0, 5.0), standardRefBBox;
-  if (part->level <
-          (int)part_ports.size() &&  // Not the default levelless cases
-      part_ports[part->level]->isConnected()) {
+  if (level < (int)part_ports.size() &&  // Not the default levelless cases
+      part_ports[level]->isConnected()) {
     TRenderSettings riIdentity(ri);
     riIdentity.m_affine = TAffine();
 
-    (*part_ports[part->level])->getBBox(ndx, bbox, riIdentity);
+    (*part_ports[level])->getBBox(ndx, bbox, riIdentity);
 
     // Now sources with infinite bounding box are retrieved with the output tile
     // size. This is especially for levels deformed by plastic mesh which must
@@ -785,11 +872,11 @@ void Particles_Engine::do_render(
 
   std::string alias;
   TRasterImageP rimg;
-  rimg = partLevel[part->level]->frame(ndx);
+  rimg = partLevel[level]->frame(ndx);
   if (rimg) {
     ras = rimg->getRaster();
   } else {
-    alias = "PART: " + (*part_ports[part->level])->getAlias(ndx, riNew);
+    alias = "PART: " + (*part_ports[level])->getAlias(ndx, riNew);
     rimg  = TImageCache::instance()->get(alias, false);
     if (rimg) {
       ras = rimg->getRaster();
@@ -815,7 +902,7 @@ void Particles_Engine::do_render(
   // calculate it
   if (!ras) {
     TTile auxTile;
-    (*part_ports[part->level])
+    (*part_ports[level])
         ->allocateAndCompute(auxTile, bbox.getP00(),
                              TDimension(partResolution.lx, partResolution.ly),
                              tile->getRaster(), ndx, riNew);
@@ -834,65 +921,20 @@ void Particles_Engine::do_render(
     addRenderCache(alias, TRasterImageP(ras));
   }
 
-  if (!ras) return;  // At this point, it should never happen anyway...
-
-  // Deal with particle colors/opacity
-  TRaster32P rfinalpart;
-  double curr_opacity =
-      part->set_Opacity(porttiles, values, opacity_range, dist_frame);
-  if (curr_opacity != 1.0 || part->gencol.fadecol || part->fincol.fadecol ||
-      part->foutcol.fadecol) {
-    /*- 毎フレーム現在位置のピクセル色を参照 -*/
-    if (values.pick_color_for_every_frame_val && values.gencol_ctrl_val &&
-        (porttiles.find(values.gencol_ctrl_val) != porttiles.end()))
-      part->get_image_reference(porttiles[values.gencol_ctrl_val], values,
-                                part->gencol.col);
-
-    rfinalpart = ras->clone();
-    part->modify_colors_and_opacity(values, curr_opacity, dist_frame,
-                                    rfinalpart);
-  } else
-    rfinalpart = ras;
-
-  // Now, let's build the particle transform before it is overed on the output
-  // tile
-
-  // First, complete the transform by adding the rotational and scale
-  // components from
-  // Particles parameters
-  M = ri.m_affine * M * TScale(1.0 / partScale);
-
-  // render with motion blur
-  if (values.motion_blur_val) {
-    if (do_render_motion_blur(part, tile, tileRas, rfinalpart, M, bbox,
-                              values.trailopacity_val,
-                              values.motion_blur_gamma_adjust_val, ri))
-      return;
-  }
-
-  // Then, retrieve the particle position in current reference.
-  TPointD pos(part->x, part->y);
-  pos = ri.m_affine * pos;
-
-  // Finally, add the translational component to the particle
-  // NOTE: p_offset is added to account for the particle relative position
-  // inside its level's bbox
-  M = TTranslation(pos - tile->m_pos) * M * TTranslation(bbox.getP00());
+  // At this point, ras should never be empty anyway...
+  source.m_ras   = ras;
+  source.m_bbox  = bbox;
+  source.m_scale = partScale;
 
-  if (TRaster32P myras32 = tile->getRaster())
-    TRop::over(tileRas, rfinalpart, M);
-  else if (TRaster64P myras64 = tile->getRaster())
-    TRop::over(tileRas, rfinalpart, M);
-  else
-    throw TException("ParticlesFx: unsupported Pixel Type");
 }
 
 /*-----------------------------------------------------------------*/
 
 bool Particles_Engine::do_render_motion_blur(
-    Particle *part, TTile *tile, TRasterP tileRas, TRaster32P rfinalpart,
-    TAffine &M, const TRectD &bbox, const DoublePair &trailOpacity,
-    const double gamma_adjust, const TRenderSettings &ri) {
+    Particle *part, TTile *tile, TRaster32P rfinalpart, TAffine &M,
+    const TRectD &bbox, const DoublePair &trailOpacity,
+    const double gamma_adjust, const TRenderSettings &ri,
+    ParticleSplats &splats) {
   QList<TPointD> points;
   QList<double> lengths;
 
@@ -1249,12 +1291,7 @@ bool Particles_Engine::do_render_motion_blur(
   M   = TTranslation(pos - tile->m_pos) *
       TTranslation(-TPointD(marginLeft, marginBottom) + partBBoxD.getP00());
 
-  if (TRaster32P myras32 = tileRas)
-    TRop::over(tileRas, blurred, M);
-  else if (TRaster64P myras64 = tileRas)
-    TRop::over(tileRas, blurred, M);
-  else
-    throw TException("ParticlesFx: unsupported Pixel Type");
+  splats.add(tile->getRaster(), blurred, M);
 
   return true;
 }
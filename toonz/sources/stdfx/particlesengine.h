@@ -6,12 +6,23 @@
 #include "tlevel.h"
 #include "particles.h"
 #include "particlesfx.h"
+#include "particlessplats.h"
 
 struct float4 {
   float x, y, z, w;
 };
 class Particle;
 
+// The raster of a particle level frame, at the scale of a render pass
+struct ParticleSource {
+  TRasterP m_ras;
+  TRectD m_bbox;
+  double m_scale;
+};
+
+// Sources of a render pass, by (level, frame)
+typedef std::map<std::pair<int, int>, ParticleSource> ParticleSources;
+
 class Particles_Engine {
 public:
   ParticlesFx *m_parent;
@@ -28,7 +39,7 @@ public:
   void fill_value_struct(struct particles_values &value, double frame);
   void roll_particles(TTile *tile, std::map<int, TTile *> porttiles,
                       const TRenderSettings &ri,
-                      std::list<Particle> &myParticles,
+                      std::vector<Particle> &myParticles,
                       struct particles_values &values, float cx, float cy,
                       int frame, int curr_frame, int level_n,
                       bool *random_level, float dpi, std::vector<int> lastframe,
@@ -52,13 +63,21 @@ public:
                  std::vector<TLevelP> partLevel,
                  struct particles_values &values, double opacity_range,
                  int curr_frame,
-                 std::map<std::pair<int, int>, double> &partScales);
+                 std::map<std::pair<int, int>, double> &partScales,
+                 ParticleSources &sources, ParticleSplats &splats);
 
-  bool do_render_motion_blur(Particle *part, TTile *tile, TRasterP tileRas,
-                             TRaster32P rfinalpart, TAffine &M,
-                             const TRectD &bbox, const DoublePair &trailOpacity,
+  bool do_render_motion_blur(Particle *part, TTile *tile, TRaster32P rfinalpart,
+                             TAffine &M, const TRectD &bbox,
+                             const DoublePair &trailOpacity,
                              const double gamma_adjust,
-                             const TRenderSettings &ri);
+                             const TRenderSettings &ri,
+                             ParticleSplats &splats);
+
+  void fetch_particle_source(int level, int ndx, TTile *tile,
+                             std::vector<TRasterFxPort *> &part_ports,
+                             const TRenderSettings &ri,
+                             std::vector<TLevelP> &partLevel, double maxScale,
+                             ParticleSource &source);
 
   bool port_is_used(int i, struct particles_values &values);
   bool port_is_used_for_value(int i, struct particles_values &values);
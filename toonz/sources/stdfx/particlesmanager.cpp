@@ -10,13 +10,11 @@
 EXPLANATION:
 
 ParticlesManager improves the old particles system as follows - the particles
-manager stores the
-last particles configuration which had some particle rendered by a thread.
-Under normal cicumstances, this means that every thread has the particles
-configuration that rendered
-last. In case a trail was set, such frame is that beyond the trail.
-This managemer works well on the assumption that each thread builds particle in
-an incremental timeline.
+manager stores snapshots of the particles configuration at regular frame
+intervals, shared by all the render threads. Rendering a frame resumes from
+the latest snapshot whose particles trails do not reach the frame, rather
+than rolling from the start frame. The latest state rolled by each thread is
+also kept - see ParticlesSnapshots.
 */
 
 //--------------------------------------------------------------------------------------------------
@@ -25,8 +23,6 @@ DEFINE_CLASS_CODE(ParticlesManager::FxData, 110)
 
 //--------------------------------------------------------------------------------------------------
 
-typedef std::map<double, ParticlesManager::FrameData> FramesMap;
-
 //************************************************************************************************
 //    Preliminaries
 //************************************************************************************************
@@ -46,37 +42,25 @@ MANAGER_FILESCOPE_DECLARATION(ParticlesManager, ParticlesManagerGenerator);
 //    FrameData implementation
 //************************************************************************************************
 
-ParticlesManager::FrameData::FrameData(FxData *fxData)
-    : m_fxData(fxData)
-    , m_frame((std::numeric_limits<int>::min)())
-    , m_calculated(false)
+ParticlesManager::FrameData::FrameData()
+    : m_frame((std::numeric_limits<int>::min)())
     , m_maxTrail(-1)
-    , m_totalParticles(0) {
-  m_fxData->addRef();
-}
-
-//-------------------------------------------------------------------------
-
-ParticlesManager::FrameData::~FrameData() { m_fxData->release(); }
+    , m_trailEnd((std::numeric_limits<int>::min)())
+    , m_totalParticles(0) {}
 
 //-------------------------------------------------------------------------
 
 void ParticlesManager::FrameData::buildMaxTrail() {
   // Store the maximum trail of each particle
-  std::list<Particle>::iterator it;
+  std::vector<Particle>::const_iterator it;
   for (it = m_particles.begin(); it != m_particles.end(); ++it)
     m_maxTrail = std::max(m_maxTrail, it->trail);
 }
 
 //-------------------------------------------------------------------------
 
-void ParticlesManager::FrameData::clear() {
-  m_frame = (std::numeric_limits<int>::min)();
-  m_particles.clear();
-  m_random         = TRandom();
-  m_calculated     = false;
-  m_maxTrail       = -1;
-  m_totalParticles = 0;
+size_t ParticlesManager::FrameData::bytes() const {
+  return sizeof(*this) + m_particles.capacity() * sizeof(Particle);
 }
 
 //************************************************************************************************
@@ -114,21 +98,50 @@ void ParticlesManager::onRenderStatusStart(int renderStatus) {
 
 //-------------------------------------------------------------------------
 
-ParticlesManager::FrameData *ParticlesManager::data(unsigned long fxId) {
-  QMutexLocker locker(&m_mutex);
-
+ParticlesManager::FxData *ParticlesManager::fxData(unsigned long fxId) {
   std::map<unsigned long, FxData *>::iterator it = m_fxs.find(fxId);
   if (it == m_fxs.end()) {
     it = m_fxs.insert(std::make_pair(fxId, new FxData)).first;
     it->second->addRef();
   }
 
-  FxData *fxData = it->second;
-  FrameData *d   = fxData->m_frames.localData();
-  if (!d) {
-    d = new FrameData(fxData);
-    fxData->m_frames.setLocalData(d);
-  }
+  return it->second;
+}
+
+//-------------------------------------------------------------------------
+
+ParticlesManager::FrameDataP ParticlesManager::data(unsigned long fxId,
+                                                    int frame) {
+  QMutexLocker locker(&m_mutex);
+
+  // Frames before the snapshot are not rolled again - so, none of the
+  // particles rolled there must leave a trail on the frame
+  return fxData(fxId)->m_snapshots.find(frame, [frame](const FrameData &data) {
+    return data.m_trailEnd < frame;
+  });
+}
+
+//-------------------------------------------------------------------------
+
+bool ParticlesManager::isSnapshotFrame(unsigned long fxId, int frame) {
+  QMutexLocker locker(&m_mutex);
+
+  return fxData(fxId)->m_snapshots.isSnapshotFrame(
+      frame, [](const FrameData &) { return true; });
+}
+
+//-------------------------------------------------------------------------
+
+void ParticlesManager::addData(unsigned long fxId, const FrameDataP &data,
+                               bool latest) {
+  QMutexLocker locker(&m_mutex);
+
+  ParticlesSnapshots<FrameData> &snapshots = fxData(fxId)->m_snapshots;
+
+  // Another thread may have got there first
+  if (snapshots.isSnapshotFrame(data->m_frame,
+                                [](const FrameData &) { return true; }))
+    snapshots.add(data);
 
-  return d;
+  if (latest) snapshots.setLatest(data);
 }
@@ -7,10 +7,14 @@
 #include "trenderresourcemanager.h"
 #include "trandom.h"
 #include "particles.h"
+#include "particlessnapshots.h"
 
-#include <QThreadStorage>
 #include <QMutex>
 
+#include <map>
+#include <memory>
+#include <vector>
+
 //-----------------------------------------------------------------------
 
 //  Forward declarations
@@ -25,26 +29,29 @@ class ParticlesManager final : public TRenderResourceManager {
 public:
   struct FxData;
 
+  // Particles configuration after a frame has been rolled. Snapshots are
+  // shared among the render threads, and never modified once stored.
   struct FrameData {
-    FxData *m_fxData;
-    double m_frame;
+    int m_frame;
     TRandom m_random;
-    std::list<Particle> m_particles;
-    bool m_calculated;
-    int m_maxTrail;
+    std::vector<Particle> m_particles;
+    int m_maxTrail;  // Longest trail among m_particles
+    int m_trailEnd;  // Last frame reached by the trails of the particles
+                     // rolled before m_frame
     int m_totalParticles;
 
-    FrameData(FxData *fxData);
-    ~FrameData();
+    FrameData();
 
     void buildMaxTrail();
-    void clear();
+    size_t bytes() const;
   };
 
+  typedef std::shared_ptr<const FrameData> FrameDataP;
+
   struct FxData final : public TSmartObject {
     DECLARE_CLASS_CODE
 
-    QThreadStorage<FrameData *> m_frames;
+    ParticlesSnapshots<FrameData> m_snapshots;
 
     FxData();
   };
@@ -55,7 +62,16 @@ public:
 
   static ParticlesManager *instance();
 
-  FrameData *data(unsigned long fxId);
+  //! Returns the latest snapshot from which the specified frame can be
+  //! rendered, or 0 if there is none.
+  FrameDataP data(unsigned long fxId, int frame);
+
+  //! Returns whether a snapshot of the specified frame should be stored.
+  bool isSnapshotFrame(unsigned long fxId, int frame);
+
+  //! Stores the specified data as a snapshot, if one is due, and as the
+  //! latest state of the calling thread if required.
+  void addData(unsigned long fxId, const FrameDataP &data, bool latest);
 
 private:
   std::map<unsigned long, FxData *> m_fxs;
@@ -64,6 +80,8 @@ private:
   int m_renderStatus;
 
   void onRenderStatusStart(int renderStatus) override;
+
+  FxData *fxData(unsigned long fxId);
 };
 
 #endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef PARTICLES_SNAPSHOTS_H
+#define PARTICLES_SNAPSHOTS_H
+
+#include <QThread>
+
+#include <map>
+#include <memory>
+
+//-----------------------------------------------------------------------
+
+/*!
+  ParticlesSnapshots stores the particles configurations of an fx, shared by
+  all the render threads. A snapshot is taken every interval() frames - the
+  interval doubles when the snapshots exceed MaxBytes, and those off the new
+  grid are dropped. The latest configuration rolled by each thread is kept
+  too, so that a thread rendering frames in sequence rolls a single frame.
+
+  FrameData must provide the m_frame member and a bytes() method. Snapshots
+  are never modified once stored. The class is not thread-safe: the particles
+  managers access it under their mutex.
+*/
+
+template <class FrameData>
+class ParticlesSnapshots {
+public:
+  typedef std::shared_ptr<const FrameData> FrameDataP;
+
+  static const int DefaultInterval = 4;
+  static const int MaxInterval     = 1 << 16;
+  static const size_t MaxBytes     = 256 << 20;
+
+public:
+  ParticlesSnapshots() : m_interval(DefaultInterval), m_bytes(0) {}
+
+  int interval() const { return m_interval; }
+
+  //! Returns the latest configuration up to the specified frame accepted by
+  //! the usable predicate, or 0 if there is none.
+  template <class Pred>
+  FrameDataP find(int maxFrame, Pred usable) const {
+    FrameDataP result;
+
+    typename FramesMap::const_iterator it = m_frames.upper_bound(maxFrame);
+    while (it != m_frames.begin()) {
+      --it;
+      if (usable(*it->second)) {
+        result = it->second;
+        break;
+      }
+    }
+
+    typename LatestMap::const_iterator lt, lEnd = m_latest.end();
+    for (lt = m_latest.begin(); lt != lEnd; ++lt) {
+      const FrameDataP &data = lt->second;
+      if (data->m_frame <= maxFrame &&
+          (!result || data->m_frame > result->m_frame) && usable(*data))
+        result = data;
+    }
+
+    return result;
+  }
+
+  //! Returns whether a snapshot of the specified frame is due - that is, if
+  //! the frame lies on the grid and no stored snapshot is accepted by the
+  //! same predicate.
+  template <class Pred>
+  bool isSnapshotFrame(int frame, Pred same) const {
+    if (frame % m_interval != 0) return false;
+
+    std::pair<typename FramesMap::const_iterator,
+              typename FramesMap::const_iterator>
+        range = m_frames.equal_range(frame);
+    for (; range.first != range.second; ++range.first)
+      if (same(*range.first->second)) return false;
+
+    return true;
+  }
+
+  void add(const FrameDataP &data) {
+    m_frames.insert(std::make_pair(data->m_frame, data));
+    m_bytes += data->bytes();
+
+    // Keep every other snapshot when running out of memory
+    while (m_bytes > MaxBytes && m_interval < MaxInterval) {
+      m_interval *= 2;
+
+      typename FramesMap::iterator it = m_frames.begin();
+      while (it != m_frames.end()) {
+        if (it->first % m_interval != 0) {
+          m_bytes -= it->second->bytes();
+          m_frames.erase(it++);
+        } else
+          ++it;
+      }
+    }
+  }
+
+  //! Stores the latest configuration rolled by the calling thread. These are
+  //! as many as the render threads, and are not counted in MaxBytes.
+  void setLatest(const FrameDataP &data) {
+    m_latest[QThread::currentThread()] = data;
+  }
+
+private:
+  typedef std::multimap<int, FrameDataP> FramesMap;
+  typedef std::map<QThread *, FrameDataP> LatestMap;
+
+  FramesMap m_frames;
+  LatestMap m_latest;
+  int m_interval;  // Frames between two snapshots
+  size_t m_bytes;
+};
+
+#endif
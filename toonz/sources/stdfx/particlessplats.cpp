@@ -0,0 +1,112 @@
+#include "particlessplats.h"
+
+#include "trop.h"
+#include "tsystem.h"
+#include "tthread.h"
+
+#include <algorithm>
+
+namespace {
+
+// Particles overed on the tile at once, at most - and the memory they may
+// take, with their resampled rasters
+const int SplatBatchSize         = 1024;
+const TUINT64 SplatBatchMaxBytes = 128 << 20;
+// Tile rows composited by each thread, at least
+const int MinBandRows = 32;
+
+}  // namespace
+
+//-----------------------------------------------------------------
+// Same as TRop::over() with an affine, up to the actual over
+
+void ParticleSplats::resample(Splat &splat, const TRect &tileBounds) {
+  TRect rasBounds = splat.m_ras->getBounds();
+  TRectD dbounds(rasBounds.x0, rasBounds.y0, rasBounds.x1 + 1,
+                 rasBounds.y1 + 1);
+  dbounds        = splat.m_aff * dbounds;
+  splat.m_bounds = TRect(tfloor(dbounds.x0), tfloor(dbounds.y0),
+                         tceil(dbounds.x1) - 1, tceil(dbounds.y1) - 1);
+
+  // Particles out of the tile are skipped
+  if (splat.m_bounds.isEmpty() || !splat.m_bounds.overlaps(tileBounds))
+    return;
+
+  TDimension size = splat.m_bounds.getSize();
+  TAffine aff =
+      TTranslation(-splat.m_bounds.x0, -splat.m_bounds.y0) * splat.m_aff;
+
+  splat.m_ras->lock();
+  splat.m_resampled = splat.m_ras->create(size.lx, size.ly);
+  TRop::resample(splat.m_resampled, splat.m_ras, aff);
+  splat.m_ras->unlock();
+}
+
+//-----------------------------------------------------------------
+
+void ParticleSplats::add(const TRasterP &tileRas, const TRasterP &ras,
+                         const TAffine &aff) {
+  Splat splat;
+  splat.m_ras = ras;
+  splat.m_aff = aff;
+  m_splats.push_back(splat);
+
+  // The raster, and its resampled copy - clipped to the tile
+  TRectD bbox = aff * convert(ras->getBounds()) * convert(tileRas->getBounds());
+  double pixels = ras->getLx() * ras->getLy() +
+                  (bbox.isEmpty() ? 0.0 : bbox.getLx() * bbox.getLy());
+  m_bytes += (TUINT64)(pixels * ras->getPixelSize());
+
+  if ((int)m_splats.size() >= SplatBatchSize || m_bytes >= SplatBatchMaxBytes)
+    flush(tileRas);
+}
+
+//-----------------------------------------------------------------
+
+void ParticleSplats::flush(const TRasterP &tileRas) {
+  if (m_splats.empty()) return;
+
+  if (!TRaster32P(tileRas) && !TRaster64P(tileRas))
+    throw TException("ParticlesFx: unsupported Pixel Type");
+
+  TRect tileBounds = tileRas->getBounds();
+  int splatCount   = (int)m_splats.size();
+  int threadCount  = TSystem::getProcessorCount();
+
+  // Resample the particles first, independently of each other
+  TThread::parallelFor(splatCount,
+                       [&](int i) { resample(m_splats[i], tileBounds); });
+
+  // Then bin them by bands of tile rows. Each band is overed by one thread,
+  // in the particles order - so that the stacking order is preserved
+  int bandCount = tcrop(tileBounds.getLy() / MinBandRows, 1, threadCount);
+  int bandRows  = (tileBounds.getLy() + bandCount - 1) / bandCount;
+
+  std::vector<std::vector<int>> bins(bandCount);
+  for (int i = 0; i < splatCount; i++) {
+    const Splat &splat = m_splats[i];
+    if (!splat.m_resampled) continue;
+
+    int b0 = std::max(splat.m_bounds.y0, tileBounds.y0) / bandRows,
+        b1 = std::min(splat.m_bounds.y1, tileBounds.y1) / bandRows;
+    for (int b = b0; b <= b1; b++) bins[b].push_back(i);
+  }
+
+  tileRas->lock();
+  TThread::parallelFor(bandCount, [&](int band) {
+    TRect bandRect(0, band * bandRows, tileBounds.x1,
+                   std::min((band + 1) * bandRows, tileBounds.getLy()) - 1);
+    if (bandRect.isEmpty()) return;
+
+    TRasterP bandRas = tileRas->extract(bandRect);
+    for (int i : bins[band]) {
+      const Splat &splat = m_splats[i];
+      TRop::over(bandRas, splat.m_resampled,
+                 splat.m_bounds.getP00() - bandRect.getP00());
+    }
+  });
+  tileRas->unlock();
+
+  m_splats.clear();
+  m_bytes = 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef PARTICLES_SPLATS_H
+#define PARTICLES_SPLATS_H
+
+#include "traster.h"
+#include "tgeometry.h"
+
+#include <vector>
+
+#undef DVAPI
+#undef DVVAR
+#ifdef TNZSTDFX_EXPORTS
+#define DVAPI DV_EXPORT_API
+#define DVVAR DV_EXPORT_VAR
+#else
+#define DVAPI DV_IMPORT_API
+#define DVVAR DV_IMPORT_VAR
+#endif
+
+//------------------------------------
+// Particle rasters waiting to be overed on the output tile.
+//
+// The result is that of overing each raster on the tile with
+// TRop::over(tile, ras, aff), in the order they are added. Rasters are
+// composited in batches instead: first they are resampled in parallel,
+// then the tile is split in bands of rows, each one overed by one thread.
+//------------------------------------
+
+class DVAPI ParticleSplats {
+  struct Splat {
+    TRasterP m_ras;
+    TAffine m_aff;  // From m_ras to the output tile
+
+    // Filled when compositing: m_ras transformed by m_aff, and its position
+    // on the output tile
+    TRasterP m_resampled;
+    TRect m_bounds;
+  };
+
+  std::vector<Splat> m_splats;
+  TUINT64 m_bytes;  // Taken by the batch, once resampled
+
+public:
+  ParticleSplats() : m_bytes(0) {}
+
+  // Composites the batch first if it has grown too large
+  void add(const TRasterP &tileRas, const TRasterP &ras, const TAffine &aff);
+
+  // Composites the batch on the tile, which must be 32 or 64-bit
+  void flush(const TRasterP &tileRas);
+
+private:
+  static void resample(Splat &splat, const TRect &tileBounds);
+};
+
+#endif
@@ -185,6 +185,8 @@ public:
   bool doGetBBox(double frame, TRectD &bBox,
                  const TRenderSettings &info) override;
   bool canHandle(const TRenderSettings &info, double frame) override;
+  // Shader programs are read from files, which may change between sessions
+  bool isPersistentCachable() const override { return false; }
 
   void doDryCompute(TRectD &rect, double frame,
                     const TRenderSettings &ri) override;
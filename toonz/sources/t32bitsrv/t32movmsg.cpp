@@ -241,20 +241,18 @@ void LWImageWriteParser::operator()(Message &msg) {
 
   msg >> id >> frameIdx >> lx >> ly;
 
-  // Read the data through a shared memory segment
-  TRaster32P ras(lx, ly);
-  t32bitsrv::RasterExchanger<TPixel32> exch(ras);
-  tipc::readShMemBuffer(*stream(), msg, &exch);
-
-  // Save the image
+  TImageWriterP iw;
   try {
-    TImageWriterP iw(writers.find(id).value()->getFrameWriter(frameIdx + 1));
-    iw->save(TRasterImageP(ras));
-
-    msg << QString("ok");
+    iw = writers.find(id).value()->getFrameWriter(frameIdx + 1);
   } catch (...) {
-    msg << QString("err");
   }
+
+  // Read the data through a shared memory segment - the image is saved
+  // directly from there, when possible
+  t32bitsrv::RasterSaver saver(iw, lx, ly);
+  tipc::readShMemBuffer(*stream(), msg, &saver);
+
+  msg << QString(saver.save() ? "ok" : "err");
 }
 
 //************************************************************************
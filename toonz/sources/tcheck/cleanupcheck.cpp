@@ -0,0 +1,150 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tsystem.h"
+#include "tthread.h"
+#include "trasterimage.h"
+#include "ttoonzimage.h"
+#include "trastercm.h"
+
+// TnzLib includes
+#include "toonz/tcleanupper.h"
+#include "toonz/cleanupparameters.h"
+
+// STD includes
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+const int framesCount  = 12;
+const double sourceDpi = 50;
+
+// Noisy strokes on a white sheet, as scanned - red ones on colored drawings
+TRasterImageP makeDrawing(int frame, bool colored) {
+  const int lx = 800, ly = 450;
+
+  std::mt19937 rng(frame);
+  std::uniform_int_distribution<int> noise(0, 40);
+
+  TRaster32P ras(lx, ly);
+  for (int y = 0; y < ly; ++y) {
+    TPixel32 *pix = ras->pixels(y);
+    for (int x = 0; x < lx; ++x) {
+      int d     = (x + 2 * y + 5 * frame) % 61;
+      bool red  = colored && ((x / 100) % 2);
+      int tone  = noise(rng);
+      int paper = 255 - tone / 4;
+
+      if (d >= 3)
+        pix[x] = TPixel32(paper, paper, paper);
+      else if (red)
+        pix[x] = TPixel32(200 + tone, tone, tone);
+      else
+        pix[x] = TPixel32(tone, tone, tone);
+    }
+  }
+
+  TRasterImageP ri(ras);
+  ri->setDpi(sourceDpi, sourceDpi);
+  return ri;
+}
+
+//-----------------------------------------------------------------------------
+
+// The cleanup stages run by tcleanupper on each frame
+TToonzImageP cleanup(int frame, bool colored, bool firstImage) {
+  TCleanupper *cl = TCleanupper::instance();
+
+  TRasterImageP original = makeDrawing(frame, colored), resampled;
+  QStringList warnings;
+
+  CleanupPreprocessedImage *cpi = cl->process(
+      original, firstImage, resampled, false, false, false, 0, 0, &warnings);
+  if (!cpi) return TToonzImageP();
+
+  TToonzImageP ti = cl->finalize(cpi, true);
+  delete cpi;
+  return ti;
+}
+
+//-----------------------------------------------------------------------------
+
+bool sameImage(const TToonzImageP &a, const TToonzImageP &b) {
+  if (!a || !b || a->getSavebox() != b->getSavebox()) return false;
+
+  TRasterCM32P ra = a->getRaster(), rb = b->getRaster();
+  if (ra->getSize() != rb->getSize()) return false;
+
+  int rowSize = ra->getLx() * sizeof(TPixelCM32);
+  for (int y = 0; y < ra->getLy(); ++y)
+    if (memcmp(ra->pixels(y), rb->pixels(y), rowSize)) return false;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Cleans up the frames as tcleanupper does: the first one alone, since it is
+// the auto-adjust reference, then the others on threadsCount threads
+std::vector<TToonzImageP> cleanupFrames(bool colored, int threadsCount) {
+  std::vector<TToonzImageP> images(framesCount);
+  images[0] = cleanup(0, colored, true);
+
+  TThread::parallelFor(framesCount - 1, [&](int i) {
+    images[i + 1] = cleanup(i + 1, colored, false);
+  }, threadsCount);
+
+  return images;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(cleanup, "cleanup frames on one and several threads") {
+  int threadsCount = std::max(4, TSystem::getProcessorCount());
+
+  CleanupParameters params;
+  params.m_camera.setSize(TDimensionD(16, 9));
+  params.m_camera.setRes(TDimension(640, 360));
+
+  TCleanupper *cl = TCleanupper::instance();
+  cl->setParameters(&params);
+  cl->setSourceDpi(TPointD(sourceDpi, sourceDpi));
+
+  bool ok = true;
+
+  // Greys with histogram auto-adjust, then colors - which share the target
+  // colors among the threads
+  for (int colored = 0; colored < 2; ++colored) {
+    params.m_lineProcessingMode = colored ? lpColor : lpGrey;
+    params.m_autoAdjustMode     = colored ? CleanupTypes::AUTO_ADJ_NONE
+                                          : CleanupTypes::AUTO_ADJ_HISTOGRAM;
+
+    const char *mode = colored ? "colors" : "greys";
+
+    std::vector<TToonzImageP> single, multi;
+    TCheck::time(std::string("12 frames, ") + mode + ", 1 thread",
+                 [&]() { single = cleanupFrames(colored, 1); }, 1);
+    TCheck::time(std::string("12 frames, ") + mode + ", " +
+                     std::to_string(threadsCount) + " threads",
+                 [&]() { multi = cleanupFrames(colored, threadsCount); }, 1);
+
+    bool same = true;
+    for (int i = 0; i < framesCount; ++i)
+      same = sameImage(single[i], multi[i]) && same;
+    ok = TCheck::verify(same, std::string(mode) +
+                                  " cleaned up alike on 1 and " +
+                                  std::to_string(threadsCount) + " threads") &&
+         ok;
+  }
+
+  cl->setParameters(0);
+  return ok;
+}
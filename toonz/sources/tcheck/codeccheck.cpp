@@ -0,0 +1,106 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tcodec.h"
+
+// STD includes
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+
+//=============================================================================
+
+namespace {
+
+// A gradient with flat areas and a noisy band - roughly what the cache holds
+template <class T>
+TRasterPT<T> makeRaster(int lx, int ly) {
+  typedef typename T::Channel Channel;
+  const double max = T::maxChannelValue;
+
+  std::mt19937 rng(6);
+  std::uniform_real_distribution<double> noise(0.0, 1.0);
+
+  TRasterPT<T> ras(lx, ly);
+  for (int y = 0; y < ly; ++y) {
+    T *pix = ras->pixels(y);
+    for (int x = 0; x < lx; ++x) {
+      double v = (x < lx / 3) ? 0.5 : (double)x / lx;
+      if (y > ly / 2 && y < ly / 2 + ly / 8) v = noise(rng);
+      pix[x] = T((Channel)(v * max), (Channel)((1 - v) * max),
+                 (Channel)(0.25 * max), (Channel)max);
+    }
+  }
+  return ras;
+}
+
+//-----------------------------------------------------------------------------
+
+bool sameData(const TRasterP &a, const TRasterP &b) {
+  if (!a || !b || a->getSize() != b->getSize() ||
+      a->getPixelSize() != b->getPixelSize())
+    return false;
+
+  for (int y = 0; y < a->getLy(); ++y)
+    if (memcmp(a->getRawData(0, y), b->getRawData(0, y),
+               a->getLx() * a->getPixelSize()))
+      return false;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Compresses and decompresses ras, timing both on large rasters
+bool checkCodec(const std::string &codecName, const TRasterP &ras,
+                const std::string &rasName, bool timed) {
+  std::unique_ptr<TRasterCodec> codec(TRasterCodec::create(codecName));
+  if (!codec) return TCheck::verify(false, codecName + " declared");
+
+  TINT32 size = 0;
+  TRasterP compressed, decompressed;
+
+  if (timed) {
+    TCheck::time(codecName + " compression of " + rasName,
+                 [&]() { compressed = codec->compress(ras, 1, size); }, 3);
+    TCheck::time(codecName + " decompression of " + rasName, [&]() {
+      decompressed = TRasterP();
+      codec->decompress(compressed, decompressed);
+    }, 3);
+  } else {
+    compressed = codec->compress(ras, 1, size);
+    if (compressed) codec->decompress(compressed, decompressed);
+  }
+
+  char ratio[32];
+  sprintf(ratio, " (%.1f%% of the size)",
+          100.0 * size / (ras->getLy() * ras->getRowSize()));
+  return TCheck::verify(compressed && sameData(ras, decompressed),
+                        codecName + " round trip of " + rasName + ratio);
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(codec, "raster codecs round trips, sizes and speed") {
+  const char *codecNames[] = {"LZ4", "LZ4-HC", "LZ4-HC:12"};
+
+  // Small rasters are compressed in one piece, large ones by bands
+  TRasterP small32 = makeRaster<TPixel32>(321, 123);
+  TRasterP small64 = makeRaster<TPixel64>(321, 123);
+  TRasterP smallF  = makeRaster<TPixelF>(321, 123);
+  TRasterP large32 = makeRaster<TPixel32>(3840, 2160);
+
+  bool ok = true;
+  for (const char *name : codecNames) {
+    ok = checkCodec(name, small32, "32-bit 321x123", false) && ok;
+    ok = checkCodec(name, small64, "64-bit 321x123", false) && ok;
+    ok = checkCodec(name, smallF, "float 321x123", false) && ok;
+    ok = checkCodec(name, large32, "32-bit 3840x2160", true) && ok;
+  }
+
+  return ok;
+}
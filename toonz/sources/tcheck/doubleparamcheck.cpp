@@ -0,0 +1,156 @@
+
+
+#include "tcheck.h"
+
+// TnzBase includes
+#include "tdoubleparam.h"
+#include "tdoublekeyframe.h"
+#include "tgrammar.h"
+#include "tparser.h"
+
+// STD includes
+#include <cmath>
+#include <memory>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+struct ExpressionCase {
+  const char *m_text;
+  double (*m_value)(double frame);
+};
+
+double linearValue(double f) { return 2 * f + 1; }
+double powerValue(double f) { return -f * f + std::pow(2.0, 3.0) / 4; }
+double sinValue(double f) { return std::sin(f * 10 * PI / 180); }
+double ternaryValue(double f) { return (f > 5 ? f : -f) * 2; }
+double nestedValue(double f) {
+  return f < 3 ? 1 : f < 7 ? std::fmod(f, 4.0) : !(f > 9) + 10;
+}
+
+const ExpressionCase expressionCases[] = {
+    {"frame*2+1", linearValue},
+    {"-frame*frame + 2^3/4", powerValue},
+    {"sin(frame*10)", sinValue},
+    {"(frame>5 ? frame : -frame)*2", ternaryValue},
+    {"frame<3 ? 1 : (frame<7 ? frame%4 : (!(frame>9)) + 10)", nestedValue},
+};
+
+//-----------------------------------------------------------------------------
+
+TDoubleParamP makeParam(const double *frames, const double *values, int count,
+                        TDoubleKeyframe::Type type) {
+  TDoubleParamP param(new TDoubleParam());
+  for (int i = 0; i < count; ++i) {
+    TDoubleKeyframe k(frames[i], values[i]);
+    k.m_type = type;
+    param->setKeyframe(k);
+  }
+  return param;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(expressions,
+              "compiled expressions match their reference values") {
+  TSyntax::Grammar grammar;
+  TSyntax::Parser parser(&grammar);
+
+  bool ok = true;
+  for (const ExpressionCase &c : expressionCases) {
+    std::unique_ptr<TSyntax::Calculator> calculator(parser.parse(c.m_text));
+    if (!TCheck::verify(calculator && parser.isValid(),
+                        std::string("parse ") + c.m_text)) {
+      ok = false;
+      continue;
+    }
+
+    bool same = true;
+    for (double frame = -2; frame <= 12; frame += 0.5)
+      same = same &&
+             TCheck::areClose(calculator->compute(0, frame, frame),
+                              c.m_value(frame));
+    ok = TCheck::verify(same, std::string("compute ") + c.m_text) && ok;
+  }
+
+  std::unique_ptr<TSyntax::Calculator> calculator(
+      parser.parse("(frame>5 ? sin(frame) : cos(frame))*t + rframe"));
+  if (calculator) {
+    double sum = 0;
+    TCheck::time("1M evaluations", [&]() {
+      for (int i = 0; i < 1000000; ++i)
+        sum += calculator->compute(0.5, i % 10, i % 7);
+    });
+    TCheck::keep(sum);
+  }
+
+  return ok;
+}
+
+//-----------------------------------------------------------------------------
+
+TCHECK_DEFINE(doubleparam, "keyframe interpolation, batch values and copies") {
+  const double frames[] = {0, 10, 25, 40, 100};
+  const double values[] = {0, 50, -20, 30, 30};
+
+  TDoubleParamP param = makeParam(frames, values, 5, TDoubleKeyframe::Linear);
+
+  // Linear segments, clamped outside the keyframes
+  bool ok = true, same = true;
+  for (double frame = -5; frame <= 105; frame += 0.25) {
+    double f = std::min(std::max(frame, 0.0), 100.0), expected = 30;
+    for (int i = 0; i + 1 < 5; ++i)
+      if (f <= frames[i + 1]) {
+        double t = (f - frames[i]) / (frames[i + 1] - frames[i]);
+        expected = values[i] + t * (values[i + 1] - values[i]);
+        break;
+      }
+    same = same && TCheck::areClose(param->getValue(frame), expected);
+  }
+  ok = TCheck::verify(same, "linear values") && ok;
+
+  // getValues() matches getValue(), also stepping backwards
+  std::vector<double> batch(441);
+  param->getValues(-5, 441, &batch[0], 0.25);
+  same = true;
+  for (int i = 0; i < 441; ++i)
+    same = same && batch[i] == param->getValue(-5 + i * 0.25);
+  param->getValues(105, 441, &batch[0], -0.25);
+  for (int i = 0; i < 441; ++i)
+    same = same && batch[i] == param->getValue(105 - i * 0.25);
+  ok = TCheck::verify(same, "getValues() matches getValue()") && ok;
+
+  // A copy replaces every value read before it
+  const double otherValues[] = {100, 0, 100, 0, 100};
+  TDoubleParamP other =
+      makeParam(frames, otherValues, 5, TDoubleKeyframe::SpeedInOut);
+
+  for (double frame = 0; frame <= 100; frame += 1) param->getValue(frame);
+  param->copy(other.getPointer());
+
+  same = true;
+  for (double frame = 0; frame <= 100; frame += 1)
+    same = same && param->getValue(frame) == other->getValue(frame);
+  ok = TCheck::verify(same, "values after copy()") && ok;
+
+  // Timings
+  const int count = 1000000;
+  double sum      = 0;
+  TCheck::time("1M getValue() in sequence", [&]() {
+    for (int i = 0; i < count; ++i) sum += param->getValue(i * 1e-4);
+  });
+  TCheck::time("1M values by getValues()", [&]() {
+    std::vector<double> buffer(count);
+    param->getValues(0, count, &buffer[0], 1e-4);
+    sum += buffer.back();
+  });
+  TCheck::keep(sum);
+
+  return ok;
+}
@@ -0,0 +1,105 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tthread.h"
+
+// Qt includes
+#include <QCoreApplication>
+#include <QEventLoop>
+
+// STD includes
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+// What the tasks of a serialized executor record
+struct Queue {
+  std::atomic<int> m_running, m_overlaps, m_next, m_outOfOrder;
+
+  Queue() : m_running(0), m_overlaps(0), m_next(0), m_outOfOrder(0) {}
+};
+
+//-----------------------------------------------------------------------------
+
+class CheckTask final : public TThread::Runnable {
+  Queue &m_queue;
+  int m_index;
+  std::atomic<int> &m_doneCount;
+
+public:
+  CheckTask(Queue &queue, int index, std::atomic<int> &doneCount)
+      : m_queue(queue), m_index(index), m_doneCount(doneCount) {}
+
+  void run() override {
+    if (++m_queue.m_running > 1) ++m_queue.m_overlaps;
+
+    // Tasks of the same executor start in insertion order
+    if (m_queue.m_next++ != m_index) ++m_queue.m_outOfOrder;
+
+    double sum = 0;
+    for (int i = 0; i < 1000; ++i) sum += i * 0.5;
+    TCheck::keep(sum);
+
+    --m_queue.m_running;
+    ++m_doneCount;
+  }
+};
+
+//-----------------------------------------------------------------------------
+
+// Workers are spawned by the main thread, which has no event loop running
+void waitFor(const std::atomic<int> &doneCount, int count) {
+  while (doneCount < count)
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(executor, "tasks queued on serialized executors") {
+  const int executorsCount = 8, tasksCount = 2500;
+
+  std::vector<std::unique_ptr<TThread::Executor>> executors;
+  std::vector<std::unique_ptr<Queue>> queues;
+  for (int e = 0; e < executorsCount; ++e) {
+    executors.emplace_back(new TThread::Executor);
+    executors.back()->setMaxActiveTasks(1);
+  }
+
+  std::atomic<int> doneCount(0);
+  int total = 0;
+
+  TCheck::time("8 x 2500 tasks", [&]() {
+    queues.clear();
+    for (int e = 0; e < executorsCount; ++e) queues.emplace_back(new Queue);
+
+    // Tasks are queued faster than they run, so the queues grow long
+    for (int t = 0; t < tasksCount; ++t)
+      for (int e = 0; e < executorsCount; ++e)
+        executors[e]->addTask(new CheckTask(*queues[e], t, doneCount));
+
+    total += executorsCount * tasksCount;
+    waitFor(doneCount, total);
+  }, 3);
+
+  int overlaps = 0, outOfOrder = 0, started = 0;
+  for (auto &queue : queues) {
+    overlaps += queue->m_overlaps;
+    outOfOrder += queue->m_outOfOrder;
+    started += queue->m_next;
+  }
+
+  bool ok = TCheck::verify(started == executorsCount * tasksCount,
+                           "every task run once");
+  ok = TCheck::verify(!overlaps, "one task at a time per executor") && ok;
+  ok = TCheck::verify(!outOfOrder, "tasks run in insertion order") && ok;
+
+  return ok;
+}
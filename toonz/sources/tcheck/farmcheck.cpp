@@ -0,0 +1,179 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tthread.h"
+
+// TnzFarm includes
+#include "ttcpip.h"
+
+// STD includes
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+const QString hostName("localhost"), hostAddr("127.0.0.1");
+
+// Listens on a free port chosen by the system, so that runs do not collide
+// with each other or with other servers
+class EchoServer final : public TTcpIpServer {
+public:
+  EchoServer() : TTcpIpServer(0) {}
+
+  void onReceive(int socket, const QString &data) override {
+    sendReply(socket, "echo " + data);
+  }
+};
+
+//-----------------------------------------------------------------------------
+
+// A request through the text protocol, on a connection of its own
+bool textRequest(int port, const QString &data) {
+  TTcpIpClient client;
+  int sock;
+  if (client.connect(hostName, hostAddr, port, sock) != OK) return false;
+
+  QString reply;
+  bool ok = client.send(sock, data, reply) == OK && reply == "echo " + data;
+  client.disconnect(sock);
+  return ok;
+}
+
+//-----------------------------------------------------------------------------
+
+// Opens count binary connections, returning how many the server accepted
+int openConnections(int port,
+                    std::vector<std::unique_ptr<TTcpIpConnection>> &conns,
+                    int count) {
+  int accepted = 0;
+  for (int i = 0; i < count; ++i) {
+    conns.emplace_back(new TTcpIpConnection);
+    if (conns.back()->connect(hostName, hostAddr, port) == OK) ++accepted;
+  }
+  return accepted;
+}
+
+//-----------------------------------------------------------------------------
+
+void stopServer(EchoServer &server) {
+  int port = server.getPort();
+
+  TTcpIpClient client;
+  int sock;
+  if (client.connect(hostName, hostAddr, port, sock) == OK) {
+    client.send(sock, "shutdown");
+    client.disconnect(sock);
+  }
+
+  // The server checks the shutdown flag after accepting a connection
+  for (int i = 0; i < 50 && !server.wait(100); ++i)
+    if (client.connect(hostName, hostAddr, port, sock) == OK)
+      client.disconnect(sock);
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(farm, "farm requests over loopback connections") {
+  const int requestsCount = 500, threadsCount = 8, sessionsCount = 16;
+
+  EchoServer server;
+  server.start();
+
+  // The port is known once the server is listening
+  int port = 0;
+  for (int i = 0; i < 50 && !port && !server.isFinished(); ++i) {
+    port = server.getPort();
+    if (!port) QThread::msleep(100);
+  }
+
+  bool listening = port && textRequest(port, "ping");
+  if (!TCheck::verify(listening, "server listening on a free port")) {
+    if (!server.isFinished()) {
+      server.terminate();
+      server.wait();
+    }
+    return false;
+  }
+
+  bool ok = true;
+
+  // The same requests through the text and the binary protocols
+  bool textOk = true;
+  TCheck::time("500 text requests", [&]() {
+    for (int i = 0; i < requestsCount; ++i)
+      textOk = textRequest(port, QString("request %1").arg(i)) && textOk;
+  }, 3);
+  ok = TCheck::verify(textOk, "text replies") && ok;
+
+  TTcpIpConnection conn;
+  bool binaryOk = conn.connect(hostName, hostAddr, port) == OK;
+  TCheck::time("500 binary requests", [&]() {
+    for (int i = 0; i < requestsCount && binaryOk; ++i) {
+      QString data = QString("request %1").arg(i), reply;
+      binaryOk     = conn.send(data, reply) == OK && reply == "echo " + data;
+    }
+  }, 3);
+  ok = TCheck::verify(binaryOk, "binary replies") && ok;
+
+  std::vector<QString> batch, replies;
+  for (int i = 0; i < requestsCount; ++i)
+    batch.push_back(QString("request %1").arg(i));
+  bool batchOk = true;
+  TCheck::time("500 requests in a batch", [&]() {
+    batchOk = conn.sendBatch(batch, replies) == OK &&
+              replies.size() == batch.size() && batchOk;
+  }, 3);
+  for (size_t i = 0; batchOk && i < batch.size(); ++i)
+    batchOk = replies[i] == "echo " + batch[i];
+  ok = TCheck::verify(batchOk, "batch replies in order") && ok;
+
+  // Several threads sharing a connection, each posting requests before
+  // reading their replies
+  std::atomic<int> failures(0);
+  TThread::parallelFor(threadsCount, [&](int t) {
+    std::vector<unsigned int> ids(100);
+    for (int i = 0; i < 100; ++i)
+      if (conn.post(QString("thread %1 request %2").arg(t).arg(i), ids[i]) !=
+          OK)
+        ++failures;
+    for (int i = 0; i < 100; ++i) {
+      QString reply;
+      if (conn.receive(ids[i], reply) != OK ||
+          reply != QString("echo thread %1 request %2").arg(t).arg(i))
+        ++failures;
+    }
+  }, threadsCount);
+  ok = TCheck::verify(!failures, "posted requests from 8 threads") && ok;
+  conn.disconnect();
+
+  // Connections beyond the sessions limit fall back to the text protocol.
+  // Sessions of closed connections end asynchronously, so the first ones
+  // are retried.
+  std::vector<std::unique_ptr<TTcpIpConnection>> conns;
+  int accepted = 0;
+  for (int i = 0; i < 50 && accepted < sessionsCount; ++i) {
+    conns.clear();
+    accepted = openConnections(port, conns, sessionsCount);
+    if (accepted < sessionsCount) QThread::msleep(100);
+  }
+  ok = TCheck::verify(accepted == sessionsCount,
+                      "16 binary sessions at the same time") &&
+       ok;
+  ok = TCheck::verify(openConnections(port, conns, 4) == 0,
+                      "binary connections beyond 16 refused") &&
+       ok;
+  ok = TCheck::verify(textRequest(port, "fallback"),
+                      "text requests served meanwhile") &&
+       ok;
+  conns.clear();
+
+  stopServer(server);
+  return ok;
+}
@@ -0,0 +1,221 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tstream.h"
+#include "tsystem.h"
+
+// TnzFarm includes
+#include "tfarmtask.h"
+
+// Qt includes
+#include <QDir>
+
+// STD includes
+#include <algorithm>
+#include <set>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+// Saves the tasks as the controller does in its tasks file
+void saveTasks(const TFilePath &fp, const std::vector<TFarmTask::Id> &ids) {
+  TOStream os(fp);
+  os.openChild("tfarmtasks");
+  for (const TFarmTask::Id &id : ids) {
+    TFarmTask task(id, "tcheck", "tcomposer", "user", "host", 1, 50);
+    os << &task;
+  }
+  os.closeChild();
+}
+
+//-----------------------------------------------------------------------------
+
+std::vector<TFarmTask::Id> loadTasks(const TFilePath &fp) {
+  std::vector<TFarmTask::Id> ids;
+
+  TIStream is(fp);
+  std::string tagName;
+  if (is.openChild(tagName) && tagName == "tfarmtasks") {
+    while (!is.eos()) {
+      TPersist *p = 0;
+      is >> p;
+
+      TFarmTask *task = dynamic_cast<TFarmTask *>(p);
+      if (task) ids.push_back(task->m_id);
+      delete p;
+    }
+    is.closeChild();
+  }
+  return ids;
+}
+
+//-----------------------------------------------------------------------------
+
+TFarmTask makeChunk(int from, int to, int step) {
+  TFarmTask chunk;
+  chunk.m_isComposerTask = true;
+  chunk.m_from           = from;
+  chunk.m_to             = to;
+  chunk.m_step           = step;
+  chunk.m_stepCount      = chunk.getFrameCount();
+  return chunk;
+}
+
+//-----------------------------------------------------------------------------
+
+// Frames of the chunks, each counted as many times as it is rendered
+std::multiset<int> getFrames(const std::vector<TFarmTask> &chunks) {
+  std::multiset<int> frames;
+  for (const TFarmTask &chunk : chunks)
+    for (int frame = chunk.m_from; frame <= chunk.m_to; frame += chunk.m_step)
+      frames.insert(frame);
+  return frames;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(farmtaskids, "farm task ids unique across controller restarts") {
+  QDir folder(QDir::temp().filePath("tcheck_farmtaskids"));
+  folder.removeRecursively();
+  QDir::temp().mkdir("tcheck_farmtaskids");
+
+  TFilePath idsFp(folder.filePath("id.txt")),
+      tasksFp(folder.filePath("tasks.txt"));
+
+  std::vector<TFarmTask::Id> tasks;
+  std::set<TFarmTask::Id> usedIds;
+
+  // The id file is saved with the first task only, then the controller
+  // crashes once the next tasks - one with subtasks - are saved
+  {
+    TFarmTaskIds taskIds(idsFp);
+    taskIds.load();
+
+    tasks.push_back(taskIds.next());
+    taskIds.save();
+
+    tasks.push_back(taskIds.next());
+    TFarmTask::Id parentId = taskIds.next();
+    tasks.push_back(parentId);
+    tasks.push_back(parentId + ".1");
+    tasks.push_back(parentId + ".2");
+
+    saveTasks(tasksFp, tasks);
+  }
+  usedIds.insert(tasks.begin(), tasks.end());
+
+  // The restarted controller skips past the reloaded tasks
+  std::vector<TFarmTask::Id> loaded = loadTasks(tasksFp);
+  bool unique                       = true;
+  int nextNumber;
+  {
+    TFarmTaskIds taskIds(idsFp);
+    taskIds.load();
+    for (const TFarmTask::Id &id : loaded) taskIds.skip(id);
+
+    for (int i = 0; i < 3; ++i)
+      unique = usedIds.insert(taskIds.next()).second && unique;
+
+    // Stopped properly this time
+    taskIds.save();
+    nextNumber = taskIds.getNextNumber();
+  }
+
+  bool ok = TCheck::verify(loaded == tasks, "tasks reloaded");
+
+  ok = TCheck::verify(unique, "new ids differ from the reloaded ones") && ok;
+
+  // With no task left to reload, the saved number alone is enough
+  {
+    TFarmTaskIds taskIds(idsFp);
+    taskIds.load();
+
+    ok = TCheck::verify(taskIds.getNextNumber() == nextNumber &&
+                            usedIds.insert(taskIds.next()).second,
+                        "next id read back from the id file") &&
+         ok;
+  }
+
+  folder.removeRecursively();
+  return ok;
+}
+
+//=============================================================================
+
+TCHECK_DEFINE(farmtails, "idle farm servers take the tails of running tasks") {
+  const int serversCount       = 4;
+  const double secondsPerFrame = 5;
+
+  // Tails are taken only once the speed is known, and when long enough
+  TFarmTask chunk = makeChunk(1, 100, 1);
+
+  bool ok = TCheck::verify(chunk.getStealableFrames(secondsPerFrame) == 0,
+                           "no tail taken before the first frame");
+
+  chunk.m_successfullSteps = 10;
+  ok = TCheck::verify(chunk.getStealableFrames(secondsPerFrame) == 45 &&
+                          chunk.getStealableFrames(0.5) == 0,
+                      "half the frames left taken, if worth a minute") &&
+       ok;
+
+  chunk.m_successfullSteps = 95;
+  ok = TCheck::verify(chunk.getStealableFrames(secondsPerFrame) == 0,
+                      "short tails left to the running task") &&
+       ok;
+
+  // A single stepped chunk of 120 frames on an idle farm: as the controller
+  // does, each idle server splits the running chunk with the longest tail.
+  // Every running chunk renders a frame per tick.
+  std::vector<TFarmTask> chunks(1, makeChunk(1, 239, 2));
+  std::multiset<int> frames = getFrames(chunks);
+
+  int ticks       = 0;
+  bool stepCounts = true;
+  for (;;) {
+    int runningCount = 0;
+    for (const TFarmTask &chunk : chunks)
+      if (chunk.m_successfullSteps < chunk.getFrameCount()) ++runningCount;
+
+    for (; runningCount < serversCount; ++runningCount) {
+      int victim = -1, stolenFrames = 0;
+      for (int i = 0; i < (int)chunks.size(); ++i) {
+        int stealable = chunks[i].getStealableFrames(secondsPerFrame);
+        if (stealable > stolenFrames) victim = i, stolenFrames = stealable;
+      }
+
+      int from, to;
+      if (victim < 0 ||
+          !chunks[victim].splitRange(
+              chunks[victim].getFrameCount() - stolenFrames, from, to))
+        break;
+
+      TFarmTask tail = makeChunk(from, to, chunks[victim].m_step);
+      stepCounts     = chunks[victim].m_stepCount ==
+                       chunks[victim].getFrameCount() &&
+                   tail.m_stepCount == stolenFrames && stepCounts;
+      chunks.push_back(tail);
+    }
+
+    if (runningCount == 0) break;
+
+    for (TFarmTask &chunk : chunks)
+      if (chunk.m_successfullSteps < chunk.getFrameCount())
+        ++chunk.m_successfullSteps;
+    ++ticks;
+  }
+
+  ok = TCheck::verify(chunks.size() > 1 && getFrames(chunks) == frames,
+                      "every frame rendered once by the split chunks") &&
+       ok;
+  ok = TCheck::verify(stepCounts, "step counts of the split chunks") && ok;
+  ok = TCheck::verify(ticks < 120 / 3, "frames shared among the servers") &&
+       ok;
+
+  return ok;
+}
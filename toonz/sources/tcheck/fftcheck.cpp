@@ -0,0 +1,147 @@
+
+
+#include "tcheck.h"
+
+// TnzStdfx includes
+#include "iwa_fft_util.h"
+
+// STD includes
+#include <cmath>
+#include <random>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+typedef std::vector<kiss_fft_scalar> Plane;
+
+Plane randomPlane(const TDimensionI &dim, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> values(-1.f, 1.f);
+  Plane plane(dim.lx * dim.ly);
+  for (kiss_fft_scalar &v : plane) v = values(rng);
+  return plane;
+}
+
+//-----------------------------------------------------------------------------
+
+// A kernel with a few non-zero values, as the fxs' ones are mostly zero
+Plane sparseKernel(const TDimensionI &dim, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> index(0, dim.lx * dim.ly - 1);
+  std::uniform_real_distribution<float> values(0.f, 1.f);
+  Plane kernel(dim.lx * dim.ly, 0.f);
+  for (int i = 0; i < 20; ++i) kernel[index(rng)] = values(rng);
+  return kernel;
+}
+
+//-----------------------------------------------------------------------------
+
+// The circular convolution computed from its definition, scaled by the plane
+// size as the inverse transform is not normalized
+Plane directConvolution(const TDimensionI &dim, const Plane &plane,
+                        const Plane &kernel) {
+  Plane result(plane.size(), 0.f);
+  for (int ky = 0; ky < dim.ly; ++ky)
+    for (int kx = 0; kx < dim.lx; ++kx) {
+      kiss_fft_scalar k = kernel[ky * dim.lx + kx];
+      if (k == 0.f) continue;
+      for (int y = 0; y < dim.ly; ++y) {
+        int sy = (y - ky + dim.ly) % dim.ly;
+        for (int x = 0; x < dim.lx; ++x) {
+          int sx = (x - kx + dim.lx) % dim.lx;
+          result[y * dim.lx + x] += k * plane[sy * dim.lx + sx];
+        }
+      }
+    }
+
+  for (kiss_fft_scalar &v : result) v *= dim.lx * dim.ly;
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+
+// The largest difference between a and b, relative to the largest value of b
+double relativeError(const Plane &a, const Plane &b) {
+  double maxDiff = 0, maxValue = 0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    maxDiff  = std::max(maxDiff, (double)std::abs(a[i] - b[i]));
+    maxValue = std::max(maxValue, (double)std::abs(b[i]));
+  }
+  return maxValue > 0 ? maxDiff / maxValue : maxDiff;
+}
+
+//-----------------------------------------------------------------------------
+
+bool checkConvolution(const TDimensionI &dim, std::mt19937 &rng) {
+  const int planesCount = 4;
+
+  Plane kernel = sparseKernel(dim, rng);
+  std::vector<Plane> planes, expected;
+  for (int i = 0; i < planesCount; ++i) {
+    planes.push_back(randomPlane(dim, rng));
+    expected.push_back(directConvolution(dim, planes.back(), kernel));
+  }
+
+  // The first plane transforms the kernel along with it, the others use
+  // its spectrum
+  TDimensionI specDim = FftUtils::spectrumDim(dim);
+  std::vector<kiss_fft_cpx> kernelSpectrum(specDim.lx * specDim.ly);
+  {
+    FftUtils::Plan plan(dim);
+    if (!plan.forward(&kernel[0], &kernelSpectrum[0])) return false;
+  }
+
+  FftUtils::Convolver convolver(dim);
+  convolver.addPlane(&planes[0][0], &kernel[0]);
+  for (int i = 1; i < planesCount; ++i)
+    convolver.addPlane(&planes[i][0], &kernelSpectrum[0]);
+  if (!convolver.run()) return false;
+
+  double error = 0;
+  for (int i = 0; i < planesCount; ++i)
+    error = std::max(error, relativeError(planes[i], expected[i]));
+  return error < 1e-4;
+}
+
+//-----------------------------------------------------------------------------
+
+double timeConvolution(const std::string &what, const TDimensionI &dim,
+                       std::mt19937 &rng) {
+  Plane plane = randomPlane(dim, rng), kernel = sparseKernel(dim, rng);
+  return TCheck::time(what, [&]() {
+    FftUtils::Convolver convolver(dim);
+    convolver.addPlane(&plane[0], &kernel[0]);
+    convolver.run();
+  }, 3);
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(fft, "fft convolutions against the direct ones") {
+  std::mt19937 rng(19);
+
+  // Even widths use the real transform, odd ones the complex one
+  bool ok = TCheck::verify(checkConvolution(TDimensionI(64, 48), rng),
+                           "real transform on 64x48 planes");
+  ok = TCheck::verify(checkConvolution(TDimensionI(63, 48), rng),
+                      "complex transform on 63x48 planes") &&
+       ok;
+
+  ok = TCheck::verify(FftUtils::idleBytes() > 0,
+                      "plans and buffers pooled after use") &&
+       ok;
+  FftUtils::releaseIdle();
+  ok = TCheck::verify(FftUtils::idleBytes() == 0,
+                      "idle plans and buffers released") &&
+       ok;
+
+  // 2025 is odd but has small factors only, as 2000
+  timeConvolution("complex transform on 2025x1200", TDimensionI(2025, 1200),
+                  rng);
+  timeConvolution("real transform on 2000x1200", TDimensionI(2000, 1200), rng);
+  FftUtils::releaseIdle();
+
+  return ok;
+}
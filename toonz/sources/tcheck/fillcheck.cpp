@@ -0,0 +1,175 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "trastercm.h"
+#include "tthread.h"
+
+// TnzLib includes
+#include "toonz/fill.h"
+
+// STD includes
+#include <random>
+#include <stack>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+// The 8-connected, per-pixel ink fill that inkFill() used to be
+void pixelInkFill(const TRasterCM32P &r, const TPoint &pin, int ink) {
+  TPixelCM32 *pixels = r->pixels(0);
+  if (pixels[pin.y * r->getWrap() + pin.x].isPurePaint()) return;
+
+  int oldInk = pixels[pin.y * r->getWrap() + pin.x].getInk();
+  if (oldInk == ink) return;
+
+  std::stack<TPoint> seeds;
+  seeds.push(pin);
+
+  while (!seeds.empty()) {
+    TPoint p = seeds.top();
+    seeds.pop();
+    if (!r->getBounds().contains(p)) continue;
+
+    TPixelCM32 *pix = pixels + (p.y * r->getWrap() + p.x);
+    if (pix->isPurePaint() || pix->getInk() != oldInk) continue;
+
+    pix->setInk(ink);
+
+    for (int dy = -1; dy <= 1; ++dy)
+      for (int dx = -1; dx <= 1; ++dx)
+        if (dx || dy) seeds.push(TPoint(p.x + dx, p.y + dy));
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+// Lines of inks 1 and 2 on paint 0, with some noise
+TRasterCM32P makeLines(int lx, int ly, std::mt19937 &rng) {
+  TRasterCM32P ras(lx, ly);
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  for (int y = 0; y < ly; ++y) {
+    TPixelCM32 *pix = ras->pixels(y);
+    for (int x = 0; x < lx; ++x) {
+      int p = percent(rng);
+      if (p < 45)
+        pix[x] = TPixelCM32(1, 0, p < 30 ? 0 : 128);
+      else if (p < 55)
+        pix[x] = TPixelCM32(2, 0, 0);
+      else
+        pix[x] = TPixelCM32(0, 0, TPixelCM32::getMaxTone());
+    }
+  }
+
+  return ras;
+}
+
+//-----------------------------------------------------------------------------
+
+// Cells of ink 1 lines, each with an opening - so that a fill spreads over
+// the whole raster
+TRasterCM32P makeGrid(int lx, int ly, int cellSize) {
+  TRasterCM32P ras(lx, ly);
+  ras->fill(TPixelCM32(0, 0, TPixelCM32::getMaxTone()));
+
+  for (int y = 0; y < ly; ++y) {
+    TPixelCM32 *pix = ras->pixels(y);
+    for (int x = 0; x < lx; ++x) {
+      bool hLine = (y % cellSize == 0 && x % cellSize > 4);
+      bool vLine = (x % cellSize == 0 && y % cellSize > 4);
+      if (hLine || vLine) pix[x] = TPixelCM32(1, 0, 0);
+    }
+  }
+
+  return ras;
+}
+
+//-----------------------------------------------------------------------------
+
+bool equalRasters(const TRasterCM32P &a, const TRasterCM32P &b) {
+  for (int y = 0; y < a->getLy(); ++y) {
+    const TPixelCM32 *pa = a->pixels(y), *pb = b->pixels(y);
+    for (int x = 0; x < a->getLx(); ++x)
+      if (!(pa[x] == pb[x])) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(inkfill, "span ink fill against the per-pixel flood") {
+  std::mt19937 rng(20);
+  bool same = true;
+
+  for (int i = 0; i < 300 && same; ++i) {
+    TRasterCM32P ras = makeLines(64 + i % 17, 48 + i % 13, rng);
+    TRasterCM32P ref = ras->clone();
+
+    std::uniform_int_distribution<int> xs(0, ras->getLx() - 1),
+        ys(0, ras->getLy() - 1);
+    TPoint p(xs(rng), ys(rng));
+
+    inkFill(ras, p, 3, 0);
+    pixelInkFill(ref, p, 3);
+    same = equalRasters(ras, ref);
+  }
+  bool ok = TCheck::verify(same, "same pixels on 300 random rasters");
+
+  // A single ink region. The per-pixel flood stacks 8 points per pixel, so
+  // the region is kept to 2000x1500.
+  TRasterCM32P ras(2000, 1500);
+  int ink = 1;
+  ras->fill(TPixelCM32(ink, 0, 0));
+
+  TCheck::time("per-pixel flood on 2000x1500",
+               [&]() { pixelInkFill(ras, TPoint(1000, 750), ++ink); }, 1);
+  TCheck::time("span fill on 2000x1500",
+               [&]() { inkFill(ras, TPoint(1000, 750), ++ink, 0); });
+
+  return ok;
+}
+
+//-----------------------------------------------------------------------------
+
+TCHECK_DEFINE(multifill, "paint fills of several frames, one per thread") {
+  const int framesCount = 8;
+
+  std::vector<TRasterCM32P> frames, copies;
+  for (int i = 0; i < framesCount; ++i) {
+    frames.push_back(makeGrid(2000, 1500, 20 + i));
+    copies.push_back(frames.back()->clone());
+  }
+
+  FillParameters params;
+  params.m_styleId = 5;
+  params.m_p       = TPoint(1002, 752);
+
+  TCheck::time("sequential fills", [&]() {
+    for (int i = 0; i < framesCount; ++i) {
+      frames[i]->copy(copies[i]);
+      fill(frames[i], params);
+    }
+  });
+
+  std::vector<TRasterCM32P> results(framesCount);
+  for (int i = 0; i < framesCount; ++i) results[i] = frames[i]->clone();
+
+  TCheck::time("parallel fills", [&]() {
+    TThread::parallelFor(framesCount, [&](int i) {
+      frames[i]->copy(copies[i]);
+      fill(frames[i], params);
+    });
+  });
+
+  bool same = true;
+  for (int i = 0; i < framesCount; ++i)
+    same = same && equalRasters(frames[i], results[i]);
+
+  return TCheck::verify(same, "same pixels as the sequential fills");
+}
@@ -0,0 +1,150 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "traster.h"
+#include "ttile.h"
+
+// TnzBase includes
+#include "trasterfx.h"
+#include "tpersistentfxcache.h"
+
+// Qt includes
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+
+// STD includes
+#include <cstring>
+#include <random>
+
+//=============================================================================
+
+namespace {
+
+// Random pixels, which don't compress - so that entries have a known size
+TRaster32P randomRaster(int lx, int ly, unsigned int seed) {
+  std::mt19937 rng(seed);
+  TRaster32P ras(lx, ly);
+  for (int y = 0; y < ly; ++y) {
+    UINT *pix = (UINT *)ras->pixels(y);
+    for (int x = 0; x < lx; ++x) pix[x] = rng();
+  }
+  return ras;
+}
+
+//-----------------------------------------------------------------------------
+
+bool sameData(const TRasterP &a, const TRasterP &b) {
+  if (a->getSize() != b->getSize()) return false;
+  for (int y = 0; y < a->getLy(); ++y)
+    if (memcmp(a->getRawData(0, y), b->getRawData(0, y), a->getRowSize()))
+      return false;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+qint64 folderSize(const QString &path) {
+  qint64 size = 0;
+  QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext()) {
+    it.next();
+    size += it.fileInfo().size();
+  }
+  return size;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(fxcache, "persistent fx cache keys, entries and eviction") {
+  TPersistentFxCache *cache = TPersistentFxCache::instance();
+
+  QString folder = QDir::temp().filePath("tcheck_fxcache");
+  QDir(folder).removeRecursively();
+
+  cache->setPath(TFilePath(folder));
+  cache->setMaximumSize(1);
+
+  bool ok = TCheck::verify(cache->isEnabled() && cache->isEmpty(),
+                           "cache enabled on an empty folder");
+
+  // Keys depend on the settings affecting the pixels only
+  const std::string alias = "STD_blurFx[10,TLevelColumnFx[+drawings/A..png]]";
+  TRectD rect(0, 0, 256, 256);
+  TRenderSettings info;
+
+  std::string key = cache->getKey(alias, 1, rect, info);
+  ok = TCheck::verify(key == cache->getKey(alias, 1, rect, info),
+                      "same subtree, frame and settings give the same key") &&
+       ok;
+
+  TRenderSettings tiled(info);
+  tiled.m_maxTileSize = 50;
+  ok = TCheck::verify(key == cache->getKey(alias, 1, rect, tiled),
+                      "tile size does not change the key") &&
+       ok;
+
+  TRenderSettings shrunk(info);
+  shrunk.m_shrinkX = shrunk.m_shrinkY = 2;
+  ok = TCheck::verify(key != cache->getKey(alias, 1, rect, shrunk) &&
+                          key != cache->getKey(alias, 2, rect, info),
+                      "changed settings or frame give a different key") &&
+       ok;
+
+  // Round trip, through the writer thread
+  TRaster32P ras = randomRaster(256, 256, 1);
+  cache->store(key, TTile(ras));
+  cache->flush();
+
+  TRaster32P loaded(256, 256);
+  ok = TCheck::verify(cache->load(key, TTile(loaded)) && sameData(ras, loaded),
+                      "stored tile loaded back unchanged") &&
+       ok;
+
+  // 256 KB entries, against a 1 MB bound
+  TCheck::time("store 16 tiles", [&]() {
+    for (int i = 0; i < 16; ++i) {
+      TRaster32P tile = randomRaster(256, 256, 100 + i);
+      cache->store(cache->getKey(alias, 100 + i, rect, info), TTile(tile));
+    }
+    cache->flush();
+  }, 1);
+
+  ok = TCheck::verify(folderSize(folder) <= (1 << 20),
+                      "folder evicted to the size bound") &&
+       ok;
+
+  // Invalidations match whole level paths only
+  const std::string columnAlias =
+      "STD_blurFx[10,TLevelColumnFx[+drawings/B.0001.png,stamp]]";
+
+  cache->invalidateLevel("B");
+  ok = TCheck::verify(cache->isCachable(columnAlias),
+                      "short level names do not match") &&
+       ok;
+
+  cache->invalidateLevel("+drawings/B.0002.png");
+  ok = TCheck::verify(cache->isCachable(columnAlias),
+                      "other frames of the level stay cachable") &&
+       ok;
+
+  cache->invalidateLevel("+drawings/B.0001.png");
+  ok = TCheck::verify(!cache->isCachable(columnAlias),
+                      "invalidated frame not cachable") &&
+       ok;
+
+  cache->invalidateLevel("+drawings/C..png");
+  ok = TCheck::verify(
+           !cache->isCachable("TLevelColumnFx[+drawings/C.0007.png,stamp]"),
+           "invalidated level not cachable on any frame") &&
+       ok;
+
+  cache->setPath(TFilePath());
+  QDir(folder).removeRecursively();
+
+  return ok;
+}
@@ -0,0 +1,66 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "timagecache.h"
+#include "trasterimage.h"
+
+// STD includes
+#include <string>
+
+//=============================================================================
+
+namespace {
+
+const int imagesCount = 32;
+
+std::string imageId(int i) { return "tcheck_lru_" + std::to_string(i); }
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(imagecache, "image cache compresses in global LRU order") {
+  TImageCache *cache = TImageCache::instance();
+  cache->clear();
+
+  // 1 MB images, which compress to almost nothing
+  for (int i = 0; i < imagesCount; ++i) {
+    TRaster32P ras(512, 512);
+    ras->fill(TPixel32::Red);
+    cache->add(imageId(i), TRasterImageP(ras));
+  }
+
+  // Even images are used again, so odd ones are the least recently used -
+  // whatever shard they hash to
+  for (int i = 0; i < imagesCount; i += 2) cache->get(imageId(i), false);
+
+  TUINT64 imageSize = cache->getMemUsage(imageId(0));
+
+  TCheck::time("compress to the budget", [&]() {
+    cache->setMemoryBudget(imageSize * (imagesCount / 2 + 4));
+  }, 1);
+
+  int compressedOdd = 0, compressedEven = 0;
+  for (int i = 0; i < imagesCount; ++i) {
+    if (cache->getMemUsage(imageId(i)) >= imageSize) continue;
+    if (i % 2)
+      ++compressedOdd;
+    else
+      ++compressedEven;
+  }
+
+  bool ok = TCheck::verify(cache->getMemUsage() <=
+                               imageSize * (imagesCount / 2 + 4),
+                           "memory within the budget");
+  ok = TCheck::verify(compressedOdd >= imagesCount / 2 - 4 &&
+                          compressedEven == 0,
+                      "least recently used images compressed first") &&
+       ok;
+
+  cache->setMemoryBudget(0);
+  for (int i = 0; i < imagesCount; ++i) cache->remove(imageId(i));
+
+  return ok;
+}
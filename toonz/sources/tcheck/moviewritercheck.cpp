@@ -0,0 +1,237 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tlevel_io.h"
+#include "trasterimage.h"
+#include "trop.h"
+
+// TnzBase includes
+#include "tbasefx.h"
+#include "toutputproperties.h"
+#include "trenderer.h"
+
+// TnzLib includes
+#include "toonz/movierenderer.h"
+#include "toonz/sceneproperties.h"
+#include "toonz/tcamera.h"
+#include "toonz/toonzscene.h"
+#include "thirdparty.h"
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+
+// STD includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+const int framesCount = 24, threadsCount = 4;
+
+TPixel32 frameColor(int frame) {
+  return TPixel32(10 * frame, 255 - 10 * frame, 128);
+}
+
+//-----------------------------------------------------------------------------
+
+// Fills frames with their color, taking longer on the first frames of each
+// group of threadsCount, so that frames complete out of order
+class ScrambledFx final : public TBaseRasterFx {
+  FX_DECLARATION(ScrambledFx)
+
+public:
+  ScrambledFx() { setName(L"ScrambledFx"); }
+
+  bool canHandle(const TRenderSettings &info, double frame) override {
+    return true;
+  }
+
+  bool doGetBBox(double frame, TRectD &bBox,
+                 const TRenderSettings &info) override {
+    bBox = TConsts::infiniteRectD;
+    return true;
+  }
+
+  std::string getAlias(double frame,
+                       const TRenderSettings &info) const override {
+    return getFxType() + "[" + std::to_string(frame) + "]";
+  }
+
+  void doCompute(TTile &tile, double frame,
+                 const TRenderSettings &info) override {
+    int delay = 20 * (threadsCount - 1 - (int)frame % threadsCount);
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+    TRaster32P ras32 = tile.getRaster();
+    if (!ras32) throw TException("ScrambledFx unsupported pixel type");
+    ras32->fill(frameColor((int)frame));
+  }
+};
+
+FX_IDENTIFIER(ScrambledFx, "tcheckScrambledFx")
+
+//-----------------------------------------------------------------------------
+
+class WriteListener final : public MovieRenderer::Listener {
+public:
+  std::vector<int> m_savedFrames;  // In the order they were written
+  std::atomic<int> m_savedCount, m_failedCount;
+  std::atomic<bool> m_completed;
+
+  WriteListener() : m_savedCount(0), m_failedCount(0), m_completed(false) {}
+
+  bool onFrameCompleted(int frame) override {
+    m_savedFrames.push_back(frame);
+    ++m_savedCount;
+    return true;
+  }
+  bool onFrameFailed(int frame, TException &e) override {
+    ++m_failedCount;
+    return true;
+  }
+  void onSequenceCompleted(const TFilePath &fp) override { m_completed = true; }
+};
+
+//-----------------------------------------------------------------------------
+
+// Workers are spawned by the main thread, which has no event loop running
+template <class Cond>
+bool waitFor(Cond cond) {
+  QElapsedTimer timer;
+  timer.start();
+  while (!cond()) {
+    if (timer.elapsed() > 60000) return false;
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Renders a 64x64 scene to fp, as tcomposer does
+void render(const TFilePath &fp, WriteListener &listener) {
+  ToonzScene scene;
+
+  TCamera *camera = scene.getCurrentCamera();
+  camera->setSize(TDimensionD(1, 1));
+  camera->setRes(TDimension(64, 64));
+
+  TOutputProperties *oprop = scene.getProperties()->getOutputProperties();
+  oprop->setRange(0, framesCount - 1, 1);
+
+  MovieRenderer movieRenderer(&scene, fp, threadsCount, false);
+  movieRenderer.setRenderSettings(oprop->getRenderSettings());
+  movieRenderer.setDpi(camera->getDpi().x, camera->getDpi().y);
+  movieRenderer.addListener(&listener);
+
+  TRasterFxP fx(new ScrambledFx);
+  for (int i = 0; i < framesCount; ++i) {
+    TFxPair fxPair;
+    fxPair.m_frameA = fx;
+    movieRenderer.addFrame(i, fxPair);
+  }
+
+  movieRenderer.start();
+
+  waitFor([&]() {
+    return listener.m_completed ||
+           listener.m_savedCount + listener.m_failedCount == framesCount;
+  });
+}
+
+//-----------------------------------------------------------------------------
+
+bool allFramesSaved(const WriteListener &listener) {
+  if (!listener.m_completed || listener.m_failedCount > 0) return false;
+
+  std::vector<int> frames(listener.m_savedFrames);
+  std::sort(frames.begin(), frames.end());
+
+  bool ok = (int)frames.size() == framesCount;
+  for (int i = 0; ok && i < framesCount; ++i) ok = frames[i] == i;
+  return ok;
+}
+
+//-----------------------------------------------------------------------------
+
+bool sameColor(const TPixel32 &a, const TPixel32 &b) {
+  return std::abs(a.r - b.r) <= 2 && std::abs(a.g - b.g) <= 2 &&
+         std::abs(a.b - b.b) <= 2;
+}
+
+//-----------------------------------------------------------------------------
+
+bool sameFrames(const TFilePath &fp) {
+  TLevelReaderP lr(fp);
+  TLevelP level = lr->loadInfo();
+  if (!level || level->getFrameCount() != framesCount) return false;
+
+  for (int i = 0; i < framesCount; ++i) {
+    TRasterImageP ri = lr->getFrameReader(TFrameId(i + 1))->load();
+    if (!ri) return false;
+
+    TRaster32P ras(ri->getRaster()->getSize());
+    TRop::convert(ras, ri->getRaster());
+    if (!sameColor(ras->pixels(32)[32], frameColor(i))) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(moviewriters, "rendered frames saved by the writer threads") {
+  QDir folder(QDir::temp().filePath("tcheck_moviewriters"));
+  folder.removeRecursively();
+  QDir::temp().mkdir("tcheck_moviewriters");
+
+  bool ok = true;
+
+  // Image sequences are written by several writers, in completion order
+  TFilePath sequenceFp(folder.filePath("frame..png"));
+
+  WriteListener sequenceListener;
+  TCheck::time("24 frames to a png sequence",
+               [&]() { render(sequenceFp, sequenceListener); }, 1);
+
+  ok = TCheck::verify(allFramesSaved(sequenceListener),
+                      "every frame of the sequence saved") &&
+       ok;
+  ok = TCheck::verify(sameFrames(sequenceFp),
+                      "sequence frames read back unchanged") &&
+       ok;
+
+  // Streaming writers take the frames in order, whatever order they complete
+  if (!ThirdParty::checkFFmpeg()) {
+    printf("  %-6s ffmpeg not found\n", "skip");
+  } else {
+    TFilePath gifFp(folder.filePath("movie.gif"));
+
+    WriteListener gifListener;
+    TCheck::time("24 frames to a gif",
+                 [&]() { render(gifFp, gifListener); }, 1);
+
+    ok = TCheck::verify(allFramesSaved(gifListener), "every gif frame saved") &&
+         ok;
+    ok = TCheck::verify(gifListener.m_completed &&
+                            std::is_sorted(gifListener.m_savedFrames.begin(),
+                                           gifListener.m_savedFrames.end()),
+                        "gif frames written in order") &&
+         ok;
+  }
+
+  folder.removeRecursively();
+  return ok;
+}
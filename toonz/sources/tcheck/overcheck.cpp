@@ -0,0 +1,115 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "trop.h"
+#include "tpixelutils.h"
+
+// STD includes
+#include <random>
+
+//=============================================================================
+
+namespace {
+
+// Premultiplied pixels - about a tenth of them transparent, and a tenth
+// opaque
+template <class T>
+TRasterPT<T> randomRaster(int lx, int ly, std::mt19937 &rng) {
+  typedef typename T::Channel Channel;
+  const int max = T::maxChannelValue;
+
+  std::uniform_int_distribution<int> percent(0, 99), matte(1, max - 1);
+  TRasterPT<T> ras(lx, ly);
+
+  for (int y = 0; y < ly; ++y) {
+    T *pix = ras->pixels(y);
+    for (int x = 0; x < lx; ++x) {
+      int p = percent(rng);
+      int m = (p < 10) ? 0 : (p < 20) ? max : matte(rng);
+      std::uniform_int_distribution<int> channel(0, m);
+      pix[x] = T((Channel)channel(rng), (Channel)channel(rng),
+                 (Channel)channel(rng), (Channel)m);
+    }
+  }
+
+  return ras;
+}
+
+//-----------------------------------------------------------------------------
+
+// The scalar in-place over: channels are rounded down
+template <class T>
+T scalarOver(const T &dn, const T &up) {
+  typedef typename T::Channel Channel;
+  const TUINT32 max = T::maxChannelValue;
+
+  if (up.m == max) return up;
+  if (up.m == 0) return dn;
+
+  TUINT32 r = up.r + dn.r * (max - up.m) / max;
+  TUINT32 g = up.g + dn.g * (max - up.m) / max;
+  TUINT32 b = up.b + dn.b * (max - up.m) / max;
+  TUINT32 m = up.m + dn.m * (max - up.m) / max;
+
+  return T((Channel)std::min(r, max), (Channel)std::min(g, max),
+           (Channel)std::min(b, max), (Channel)m);
+}
+
+//-----------------------------------------------------------------------------
+
+// In-place and three-raster overs against the scalar code, on rows whose
+// length is not a multiple of any register size
+template <class T>
+bool checkOver(std::mt19937 &rng) {
+  const int lx = 1001, ly = 37;
+  TRasterPT<T> dn = randomRaster<T>(lx, ly, rng),
+               up = randomRaster<T>(lx, ly, rng);
+
+  TRasterPT<T> inPlace = dn->clone(), out(lx, ly);
+  TRop::over(inPlace, up);
+  TRop::over(out, dn, up);
+
+  bool same = true;
+  for (int y = 0; y < ly; ++y) {
+    const T *dnPix = dn->pixels(y), *upPix = up->pixels(y);
+    const T *inPlacePix = inPlace->pixels(y), *outPix = out->pixels(y);
+    for (int x = 0; x < lx; ++x) {
+      same = same && inPlacePix[x] == scalarOver(dnPix[x], upPix[x]);
+      same = same && outPix[x] == overPix(dnPix[x], upPix[x]);
+    }
+  }
+
+  return same;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(over, "simd over kernels against the scalar code") {
+  std::mt19937 rng(9);
+
+  bool ok = TCheck::verify(checkOver<TPixel32>(rng), "32-bit over");
+  ok      = TCheck::verify(checkOver<TPixel64>(rng), "64-bit over") && ok;
+
+  TRaster32P dn = randomRaster<TPixel32>(1920, 1080, rng),
+             up = randomRaster<TPixel32>(1920, 1080, rng);
+  TRaster32P out(1920, 1080);
+
+  TCheck::time("scalar over on 1920x1080", [&]() {
+    for (int y = 0; y < out->getLy(); ++y) {
+      TPixel32 *outPix = out->pixels(y);
+      const TPixel32 *dnPix = dn->pixels(y), *upPix = up->pixels(y);
+      for (int x = 0; x < out->getLx(); ++x)
+        outPix[x] = scalarOver(dnPix[x], upPix[x]);
+    }
+  });
+  TCheck::time("TRop::over on 1920x1080", [&]() {
+    out->copy(dn);
+    TRop::over(out, up);
+  });
+
+  return ok;
+}
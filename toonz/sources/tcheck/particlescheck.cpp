@@ -0,0 +1,98 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "trop.h"
+
+// TnzStdfx includes
+#include "particlessplats.h"
+
+// STD includes
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+// A premultiplied round blob of the specified color
+TRaster32P makeSprite(int size, const TPixel32 &color) {
+  TRaster32P ras(size, size);
+  double radius = size * 0.5;
+
+  for (int y = 0; y < size; ++y) {
+    TPixel32 *pix = ras->pixels(y);
+    for (int x = 0; x < size; ++x) {
+      double dx = x + 0.5 - radius, dy = y + 0.5 - radius;
+      double a  = std::max(0.0, 1.0 - std::sqrt(dx * dx + dy * dy) / radius);
+      pix[x]    = TPixel32(color.r * a, color.g * a, color.b * a, 255 * a);
+    }
+  }
+  return ras;
+}
+
+//-----------------------------------------------------------------------------
+
+struct Particle {
+  int m_sprite;
+  TAffine m_aff;
+};
+
+// Rotated and scaled particles, some of them partly or fully out of the tile
+std::vector<Particle> makeParticles(int count, const TDimension &tileSize) {
+  std::mt19937 rng(24);
+  std::uniform_int_distribution<int> sprite(0, 3);
+  std::uniform_real_distribution<double> x(-100, tileSize.lx + 100),
+      y(-100, tileSize.ly + 100), angle(0, 360), scale(0.2, 2.0);
+
+  std::vector<Particle> particles(count);
+  for (Particle &p : particles) {
+    p.m_sprite = sprite(rng);
+    p.m_aff    = TTranslation(x(rng), y(rng)) * TRotation(angle(rng)) *
+              TScale(scale(rng)) * TTranslation(-32, -32);
+  }
+  return particles;
+}
+
+bool equalRasters(const TRaster32P &a, const TRaster32P &b) {
+  for (int y = 0; y < a->getLy(); ++y)
+    if (memcmp(a->pixels(y), b->pixels(y), a->getLx() * sizeof(TPixel32)))
+      return false;
+  return true;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(particles, "particles overed by splat batches or one by one") {
+  const TPixel32 colors[] = {TPixel32::Red, TPixel32::Green, TPixel32::Blue,
+                             TPixel32(255, 200, 0)};
+  std::vector<TRaster32P> sprites;
+  for (const TPixel32 &color : colors) sprites.push_back(makeSprite(64, color));
+
+  TRaster32P sequential(1920, 1080), batched(1920, 1080);
+  std::vector<Particle> particles =
+      makeParticles(5000, sequential->getSize());
+
+  // As the particles fx used to, one particle at a time
+  TCheck::time("5000 particles one by one", [&]() {
+    sequential->clear();
+    for (const Particle &p : particles)
+      TRop::over(sequential, sprites[p.m_sprite], p.m_aff);
+  }, 3);
+
+  TCheck::time("5000 particles by splat batches", [&]() {
+    batched->clear();
+    ParticleSplats splats;
+    for (const Particle &p : particles)
+      splats.add(batched, sprites[p.m_sprite], p.m_aff);
+    splats.flush(batched);
+  }, 3);
+
+  return TCheck::verify(equalRasters(sequential, batched),
+                        "same pixels, stacking order included");
+}
@@ -0,0 +1,151 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "timagecache.h"
+#include "trasterimage.h"
+#include "tsystem.h"
+
+// TnzLib includes
+#include "toonz/imageprefetcher.h"
+
+// Qt includes
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+
+// STD includes
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+std::string frameId(int i) { return "tcheck_prefetch_" + std::to_string(i); }
+
+//-----------------------------------------------------------------------------
+
+// 1 MB frames, loaded as a flipbook would
+ImagePrefetcher::Frame makeFrame(int i) {
+  std::string id = frameId(i);
+
+  ImagePrefetcher::Frame frame = {id, [id]() {
+                                    if (TImageCache::instance()->isCached(id))
+                                      return false;
+
+                                    TRaster32P ras(512, 512);
+                                    ras->fill(TPixel32::Green);
+                                    TImageCache::instance()->add(
+                                        id, TRasterImageP(ras));
+                                    return true;
+                                  }};
+  return frame;
+}
+
+//-----------------------------------------------------------------------------
+
+std::vector<ImagePrefetcher::Frame> nextFrames(int i, int count) {
+  std::vector<ImagePrefetcher::Frame> frames;
+  for (int k = 1; k <= count; ++k) frames.push_back(makeFrame(i + k));
+  return frames;
+}
+
+//-----------------------------------------------------------------------------
+
+// Workers are spawned by the main thread, which has no event loop running
+template <class Cond>
+bool waitFor(Cond cond) {
+  QElapsedTimer timer;
+  timer.start();
+  while (!cond()) {
+    if (timer.elapsed() > 10000) return false;
+    QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+  }
+  return true;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(prefetch, "playback prefetch statistics and memory budget") {
+  const int lookAhead = 4, framesCount = 8;
+
+  ImagePrefetcher *prefetcher = ImagePrefetcher::instance();
+  TImageCache *cache          = TImageCache::instance();
+
+  prefetcher->setEnabled(true);
+  prefetcher->setLookAhead(lookAhead);
+  prefetcher->setMemoryBudget(64);
+  prefetcher->setThreadsCount(1);
+  prefetcher->setPlaying(true);
+
+  bool loadedAhead = true;
+
+  // Each frame is displayed once the previous request is done loading - the
+  // first one only is missing
+  TCheck::time("play 8 frames", [&]() {
+    for (int i = 0; i < framesCount; ++i) {
+      prefetcher->prefetch(frameId(i), nextFrames(i, lookAhead));
+
+      bool cached = cache->isCached(frameId(i));
+      prefetcher->recordDisplay(frameId(i), cached);
+      if (!cached) makeFrame(i).m_load();
+
+      // Redraws of the same frame do not count
+      prefetcher->recordDisplay(frameId(i), true);
+
+      loadedAhead = waitFor([&]() {
+                      for (int k = 1; k <= lookAhead; ++k)
+                        if (!cache->isCached(frameId(i + k))) return false;
+                      return true;
+                    }) &&
+                    loadedAhead;
+    }
+  }, 1);
+
+  // Frames of older requests are ignored
+  prefetcher->recordDisplay(frameId(0), false);
+
+  ImagePrefetcher::Statistics stats = prefetcher->getStatistics();
+
+  bool ok = TCheck::verify(loadedAhead, "next frames loaded in background");
+
+  ok = TCheck::verify(stats.m_hits == framesCount - 1 && stats.m_misses == 1,
+                      "hits and misses counted on displayed frames") &&
+       ok;
+  ok = TCheck::verify(stats.m_loaded == framesCount - 1 + lookAhead,
+                      "each frame loaded once") &&
+       ok;
+
+  prefetcher->setPlaying(false);
+
+  // With 1 MB frames, a 2 MB budget stops the loads after the second one
+  for (int i = 0; i <= framesCount + lookAhead; ++i) cache->remove(frameId(i));
+
+  prefetcher->setMemoryBudget(2);
+  prefetcher->resetStatistics();
+  prefetcher->prefetch(frameId(0), nextFrames(0, 6));
+
+  waitFor([&]() {
+    ImagePrefetcher::Statistics current = prefetcher->getStatistics();
+    return current.m_loaded + current.m_overBudget == 6;
+  });
+
+  stats = prefetcher->getStatistics();
+
+  ok = TCheck::verify(stats.m_loaded == 2 && stats.m_overBudget == 4,
+                      "loads stopped at the memory budget") &&
+       ok;
+
+  prefetcher->cancel();
+  prefetcher->setMemoryBudget(512);
+  prefetcher->setLookAhead(12);
+  prefetcher->setThreadsCount(std::max(1, TSystem::getProcessorCount() / 2));
+  for (int i = 0; i <= framesCount + lookAhead; ++i) cache->remove(frameId(i));
+
+  return ok;
+}
@@ -0,0 +1,100 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tstroke.h"
+#include "tvectorimage.h"
+
+// STD includes
+#include <random>
+#include <string>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+TStroke *makeLine(const TPointD &a, const TPointD &b) {
+  std::vector<TThickPoint> points = {TThickPoint(a, 1),
+                                     TThickPoint((a + b) * 0.5, 1),
+                                     TThickPoint(b, 1)};
+  return new TStroke(points);
+}
+
+//-----------------------------------------------------------------------------
+
+// The lines of a grid of hCount x vCount lines, slightly jittered, in
+// alternate order
+std::vector<TStroke *> gridLines(int hCount, int vCount) {
+  const double step = 20, length = step * (std::max(hCount, vCount) + 1);
+  std::mt19937 rng(12);
+  std::uniform_real_distribution<double> jitter(-2.0, 2.0);
+
+  std::vector<TStroke *> lines;
+  for (int i = 0; i < std::max(hCount, vCount); ++i) {
+    if (i < hCount) {
+      double y = (i + 1) * step;
+      lines.push_back(makeLine(TPointD(-step, y + jitter(rng)),
+                               TPointD(length, y + jitter(rng))));
+    }
+    if (i < vCount) {
+      double x = (i + 1) * step;
+      lines.push_back(makeLine(TPointD(x + jitter(rng), -step),
+                               TPointD(x + jitter(rng), length)));
+    }
+  }
+  return lines;
+}
+
+//-----------------------------------------------------------------------------
+
+// Short strokes scattered over a drawing, as in a sketchy one
+TVectorImageP scatteredStrokes(int count) {
+  std::mt19937 rng(12);
+  std::uniform_real_distribution<double> pos(0, 2000), delta(-60, 60);
+
+  TVectorImageP vi = new TVectorImage();
+  for (int i = 0; i < count; ++i) {
+    TPointD a(pos(rng), pos(rng));
+    vi->addStroke(makeLine(a, a + TPointD(delta(rng), delta(rng))));
+  }
+  return vi;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(regions, "regions of a grid of strokes, computation times") {
+  const int hCount = 15, vCount = 12;
+  const UINT cellsCount = (hCount - 1) * (vCount - 1);
+
+  // All the strokes at once
+  TVectorImageP vi = new TVectorImage();
+  for (TStroke *line : gridLines(hCount, vCount)) vi->addStroke(line);
+  vi->findRegions();
+  bool ok = TCheck::verify(vi->getRegionCount() == cellsCount,
+                           "a region per grid cell");
+
+  // One stroke at a time, with the regions computed after each one
+  TVectorImageP incremental = new TVectorImage();
+  for (TStroke *line : gridLines(hCount, vCount)) {
+    incremental->addStroke(line);
+    incremental->findRegions();
+  }
+  ok = TCheck::verify(incremental->getRegionCount() == cellsCount,
+                      "a region per grid cell, adding strokes one by one") &&
+       ok;
+
+  // Twice the strokes should take about twice the time
+  for (int count = 1000; count <= 4000; count *= 2) {
+    TVectorImageP scattered;
+    TCheck::time(std::to_string(count) + " scattered strokes", [&]() {
+      scattered = scatteredStrokes(count);
+      scattered->findRegions();
+    }, 3);
+  }
+
+  return ok;
+}
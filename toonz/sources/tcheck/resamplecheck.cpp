@@ -0,0 +1,105 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "trop.h"
+
+// STD includes
+#include <cstdlib>
+#include <random>
+#include <string>
+
+//=============================================================================
+
+namespace {
+
+TRaster32P randomRaster(int lx, int ly) {
+  std::mt19937 rng(10);
+  std::uniform_int_distribution<int> matte(0, 255);
+
+  TRaster32P ras(lx, ly);
+  for (int y = 0; y < ly; ++y) {
+    TPixel32 *pix = ras->pixels(y);
+    for (int x = 0; x < lx; ++x) {
+      int m = matte(rng);
+      std::uniform_int_distribution<int> channel(0, m);
+      pix[x] = TPixel32(channel(rng), channel(rng), channel(rng), m);
+    }
+  }
+  return ras;
+}
+
+//-----------------------------------------------------------------------------
+
+int maxDifference(const TRaster32P &a, const TRaster32P &b) {
+  int diff = 0;
+  for (int y = 0; y < a->getLy(); ++y) {
+    const TPixel32 *pa = a->pixels(y), *pb = b->pixels(y);
+    for (int x = 0; x < a->getLx(); ++x) {
+      diff = std::max(diff, std::abs(pa[x].r - pb[x].r));
+      diff = std::max(diff, std::abs(pa[x].g - pb[x].g));
+      diff = std::max(diff, std::abs(pa[x].b - pb[x].b));
+      diff = std::max(diff, std::abs(pa[x].m - pb[x].m));
+    }
+  }
+  return diff;
+}
+
+//-----------------------------------------------------------------------------
+
+// A negligible shear, which keeps the affine off the separable path
+TAffine shearedAffine(const TAffine &aff) {
+  TAffine sheared = aff;
+  sheared.a12     = 1e-12;
+  return sheared;
+}
+
+struct FilterCase {
+  TRop::ResampleFilterType m_type;
+  const char *m_name;
+};
+
+const FilterCase filterCases[] = {
+    {TRop::Triangle, "Triangle"}, {TRop::Mitchell, "Mitchell"},
+    {TRop::Cubic5, "Cubic5"},     {TRop::Hann3, "Hann3"},
+    {TRop::Lanczos3, "Lanczos3"}, {TRop::Gauss, "Gauss"},
+};
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(resample, "separable resample against the generic one") {
+  TRaster32P in = randomRaster(400, 300);
+  const TAffine affs[] = {TTranslation(3.25, -2.5) * TScale(0.6),
+                          TTranslation(-7.5, 1.75) * TScale(1.7, 1.3)};
+
+  bool ok = true;
+  for (const FilterCase &c : filterCases) {
+    int diff = 0;
+    for (const TAffine &aff : affs) {
+      TRaster32P separable(500, 400), generic(500, 400);
+      separable->clear();
+      generic->clear();
+      TRop::resample(separable, in, aff, c.m_type);
+      TRop::resample(generic, in, shearedAffine(aff), c.m_type);
+      diff = std::max(diff, maxDifference(separable, generic));
+    }
+    ok = TCheck::verify(diff <= 1, std::string(c.m_name) +
+                                       " within 1 level: " +
+                                       std::to_string(diff)) &&
+         ok;
+  }
+
+  // Downscaling a 4K frame to 1080p
+  TRaster32P frame = randomRaster(3840, 2160), out(1920, 1080);
+  TAffine half     = TScale(0.5);
+  TCheck::time("generic Lanczos3 4K to 1080p", [&]() {
+    TRop::resample(out, frame, shearedAffine(half), TRop::Lanczos3);
+  }, 3);
+  TCheck::time("separable Lanczos3 4K to 1080p",
+               [&]() { TRop::resample(out, frame, half, TRop::Lanczos3); });
+
+  return ok;
+}
@@ -0,0 +1,64 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tipc.h"
+
+// Qt includes
+#include <QSharedMemory>
+
+// STD includes
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+// Writes a frame to the segment, as tipc::writeShMemBuffer() does
+void writeFrame(QSharedMemory &shmem, const std::vector<char> &frame) {
+  shmem.lock();
+  memcpy(shmem.data(), &frame[0], frame.size());
+  shmem.unlock();
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(shmem, "shared memory segments created per frame or reused") {
+  const int framesCount = 50;
+
+  // A 1920x1080 32-bit frame, or the largest segment allowed
+  int size = std::min(1920 * 1080 * 4, tipc::shm_maxSegmentSize());
+  std::vector<char> frame(size, 1);
+
+  bool ok = true;
+
+  TCheck::time("a new segment per frame", [&]() {
+    for (int i = 0; i < framesCount; ++i) {
+      QSharedMemory shmem(tipc::uniqueId());
+      ok = tipc::create(shmem, size) >= size && ok;
+      writeFrame(shmem, frame);
+    }
+  }, 3);
+
+  TCheck::time("a reused segment", [&]() {
+    QSharedMemory shmem(tipc::uniqueId());
+    ok = tipc::create(shmem, size) >= size && ok;
+    for (int i = 0; i < framesCount; ++i) writeFrame(shmem, frame);
+  }, 3);
+
+  // The reader attaches to the writer's segment once
+  QSharedMemory writer(tipc::uniqueId());
+  ok = tipc::create(writer, size) >= size && ok;
+  writeFrame(writer, frame);
+
+  QSharedMemory reader(writer.key());
+  ok = reader.attach() && ok;
+  ok = ok && memcmp(reader.constData(), &frame[0], size) == 0;
+
+  return TCheck::verify(ok, "segments created, attached and read back");
+}
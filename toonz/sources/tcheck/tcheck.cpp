@@ -0,0 +1,108 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tsystem.h"
+#include "tthread.h"
+
+// Image includes
+#include "tnzimage.h"
+
+// Qt includes
+#include <QCoreApplication>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+//************************************************************************************
+//    TCheck implementation
+//************************************************************************************
+
+namespace {
+TCheck *checksHead = 0;
+}
+
+//------------------------------------------------------------------------
+
+TCheck::TCheck(const char *name, const char *description, Function function)
+    : m_name(name)
+    , m_description(description)
+    , m_function(function)
+    , m_next(checksHead) {
+  checksHead = this;
+}
+
+//------------------------------------------------------------------------
+
+TCheck *TCheck::first() { return checksHead; }
+
+//------------------------------------------------------------------------
+
+bool TCheck::verify(bool condition, const std::string &what) {
+  printf("  %-6s %s\n", condition ? "ok" : "FAILED", what.c_str());
+  return condition;
+}
+
+//------------------------------------------------------------------------
+
+bool TCheck::areClose(double a, double b, double tolerance) {
+  return std::abs(a - b) <= tolerance * std::max(1.0, std::abs(a));
+}
+
+//------------------------------------------------------------------------
+
+void TCheck::keep(double value) {
+  static volatile double sink;
+  sink = value;
+}
+
+//------------------------------------------------------------------------
+
+void TCheck::printTime(const std::string &what, double msecs) {
+  printf("  %-6s %s: %.3f ms\n", "time", what.c_str(), msecs);
+}
+
+//************************************************************************************
+//    Main
+//************************************************************************************
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+
+  TSystem::hasMainLoop(false);
+  TThread::init();
+  initImageIo();
+
+  if (argc > 1 && strcmp(argv[1], "-list") == 0) {
+    for (TCheck *check = TCheck::first(); check; check = check->m_next)
+      printf("%-16s %s\n", check->m_name, check->m_description);
+    return 0;
+  }
+
+  // Without arguments, all the checks are run
+  int run = 0, failed = 0;
+  for (TCheck *check = TCheck::first(); check; check = check->m_next) {
+    bool selected = (argc == 1);
+    for (int i = 1; i < argc && !selected; ++i)
+      selected = (strcmp(argv[i], check->m_name) == 0);
+    if (!selected) continue;
+
+    printf("%s - %s\n", check->m_name, check->m_description);
+    ++run;
+    if (!check->m_function()) ++failed;
+  }
+
+  TThread::shutdown();
+
+  if (run == 0) {
+    printf("usage: %s [-list | check...]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%d checks run, %d failed\n", run, failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef TCHECK_H
+#define TCHECK_H
+
+#include <QElapsedTimer>
+
+#include <string>
+
+//=============================================================================
+//    TCheck
+//-----------------------------------------------------------------------------
+
+/*!
+  A named check or benchmark of the toonz libraries, run by "tcheck <name>".
+  Checks are defined at file scope with TCHECK_DEFINE; they print what they
+  verify or measure, and return false on failure.
+*/
+
+class TCheck {
+public:
+  typedef bool (*Function)();
+
+  TCheck(const char *name, const char *description, Function function);
+
+  const char *m_name, *m_description;
+  Function m_function;
+  TCheck *m_next;
+
+  static TCheck *first();
+
+  //! Prints the outcome of a verification, and returns it
+  static bool verify(bool condition, const std::string &what);
+
+  //! Whether a and b are equal up to a relative tolerance
+  static bool areClose(double a, double b, double tolerance = 1e-9);
+
+  //! Keeps the compiler from dropping the computation of a timed result
+  static void keep(double value);
+
+  //! Prints the time taken by function, in msecs - the best of repeat runs
+  template <class Func>
+  static double time(const std::string &what, Func function, int repeat = 5) {
+    double best = -1;
+    for (int i = 0; i < repeat; ++i) {
+      QElapsedTimer timer;
+      timer.start();
+      function();
+      double msecs = timer.nsecsElapsed() * 1e-6;
+      if (best < 0 || msecs < best) best = msecs;
+    }
+    printTime(what, best);
+    return best;
+  }
+
+private:
+  static void printTime(const std::string &what, double msecs);
+};
+
+#define TCHECK_DEFINE(name, description)                                      \
+  static bool name##Check();                                                  \
+  static TCheck name##CheckInstance(#name, description, &name##Check);        \
+  static bool name##Check()
+
+#endif  // TCHECK_H
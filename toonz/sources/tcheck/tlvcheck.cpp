@@ -0,0 +1,154 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tlevel_io.h"
+#include "tpalette.h"
+#include "trastercm.h"
+#include "ttoonzimage.h"
+#include "tsystem.h"
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+// STD includes
+#include <cstring>
+#include <random>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+const int framesCount = 24;
+
+// Inks over a flat paint, with noisy tones - roughly a cleaned up drawing
+TRasterCM32P makeFrame(int lx, int ly, int frame) {
+  std::mt19937 rng(frame);
+  std::uniform_int_distribution<int> tone(0, 255);
+
+  TRasterCM32P ras(lx, ly);
+  for (int y = 0; y < ly; ++y) {
+    TPixelCM32 *pix = ras->pixels(y);
+    for (int x = 0; x < lx; ++x) {
+      bool ink = ((x + y + 8 * frame) % 97) < 4;
+      pix[x]   = TPixelCM32(ink ? 1 : 0, 2, ink ? tone(rng) : 255);
+    }
+  }
+  return ras;
+}
+
+//-----------------------------------------------------------------------------
+
+void writeLevel(const TFilePath &path, int lx, int ly, int count) {
+  TPalette *palette = new TPalette();
+
+  TLevelWriterP lw(path);
+  lw->setPalette(palette);
+  for (int i = 1; i <= count; ++i) {
+    TToonzImageP ti(makeFrame(lx, ly, i), TRect(0, 0, lx - 1, ly - 1));
+    ti->setPalette(palette);
+    lw->getFrameWriter(TFrameId(i))->save(ti);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+bool sameFrame(const TImageP &img, int lx, int ly, int frame) {
+  TToonzImageP ti = img;
+  if (!ti) return false;
+
+  TRasterCM32P ras = ti->getRaster(), ref = makeFrame(lx, ly, frame);
+  if (!ras || ras->getSize() != ref->getSize()) return false;
+
+  for (int y = 0; y < ly; ++y)
+    if (memcmp(ras->pixels(y), ref->pixels(y), lx * sizeof(TPixelCM32)))
+      return false;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Opens the level as the viewer does for each frame fetch, and loads frame
+bool loadFrame(const TFilePath &path, int lx, int ly, int frame) {
+  TLevelReaderP lr(path);
+  lr->loadInfo();
+  return sameFrame(lr->getFrameReader(TFrameId(frame))->load(), lx, ly,
+                   frame);
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(tlv, "tlv frames read back, reopened and truncated") {
+  // TRasterCodecLZO runs the lzo drivers found next to the executable
+  QDir exeDir(QCoreApplication::applicationDirPath());
+  if (!QFileInfo(exeDir.filePath("lzocompress")).exists() &&
+      !QFileInfo(exeDir.filePath("lzocompress.exe")).exists()) {
+    printf("  %-6s lzocompress not found in %s\n", "skip",
+           exeDir.absolutePath().toStdString().c_str());
+    return true;
+  }
+
+  const int lx = 1920, ly = 1080;
+
+  TFilePath path(QDir::temp().filePath("tcheck_tlv.tlv"));
+  TSystem::removeFileOrLevel(path);
+
+  bool ok = true;
+
+  try {
+    writeLevel(path, lx, ly, framesCount);
+
+    bool same = true;
+    for (int i = 1; i <= framesCount; ++i)
+      same = loadFrame(path, lx, ly, i) && same;
+    ok = TCheck::verify(same, "frames read back unchanged") && ok;
+
+    // Reopening reuses the registry index and the shared mapping
+    TCheck::time("reopen and load a frame", [&]() {
+      for (int i = 1; i <= framesCount; ++i)
+        TCheck::keep(loadFrame(path, lx, ly, i));
+    }, 3);
+
+    // Rewritten files must not reuse the old index
+    TSystem::removeFileOrLevel(path);
+    writeLevel(path, lx, ly, framesCount / 2);
+
+    TLevelReaderP lr(path);
+    TLevelP level = lr->loadInfo();
+    ok = TCheck::verify(level && level->getFrameCount() == framesCount / 2,
+                        "rewritten level indexed again") &&
+         ok;
+
+    // A reader open on a file truncated by someone else must fail cleanly,
+    // not fault on the mapped pages past the end
+    ok = TCheck::verify(
+             sameFrame(lr->getFrameReader(TFrameId(1))->load(), lx, ly, 1),
+             "rewritten level read back") &&
+         ok;
+
+    QFile::resize(path.getQString(), QFileInfo(path.getQString()).size() / 2);
+
+    bool failed = false;
+    try {
+      failed = !sameFrame(
+          lr->getFrameReader(TFrameId(framesCount / 2))->load(), lx, ly,
+          framesCount / 2);
+    } catch (...) {
+      failed = true;
+    }
+    ok = TCheck::verify(failed, "truncated file read fails cleanly") && ok;
+  } catch (...) {
+    ok = TCheck::verify(false, "level written and read");
+  }
+
+  TSystem::removeFileOrLevel(path);
+  TSystem::removeFileOrLevel(path.withType("tpl"));
+  return ok;
+}
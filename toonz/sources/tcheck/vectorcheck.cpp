@@ -0,0 +1,96 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tpalette.h"
+#include "tstroke.h"
+#include "tvectorimage.h"
+#include "tvectorrenderdata.h"
+#include "tvectorrasterizer.h"
+
+// TnzLib includes
+#include "toonz/cleanupcolorstyles.h"
+
+// STD includes
+#include <cmath>
+#include <vector>
+
+//=============================================================================
+
+namespace {
+
+// A closed 0-thick triangle, whose region is filled with the specified style
+TVectorImageP makeTriangle(const TPointD &a, const TPointD &b,
+                           const TPointD &c, int styleId) {
+  // Control points halfway along the sides make straight quadratics
+  std::vector<TThickPoint> points = {a, (a + b) * 0.5, b, (b + c) * 0.5,
+                                     c, (c + a) * 0.5, a};
+  TStroke *stroke = new TStroke(points);
+  stroke->setSelfLoop();
+
+  TVectorImageP vi = new TVectorImage();
+  vi->addStroke(stroke);
+  vi->findRegions();
+  vi->fill((a + b + c) * (1.0 / 3.0), styleId);
+  return vi;
+}
+
+//-----------------------------------------------------------------------------
+
+// The covered area, in pixels
+double coveredArea(const TRaster32P &ras) {
+  double area = 0;
+  for (int y = 0; y < ras->getLy(); ++y) {
+    const TPixel32 *pix = ras->pixels(y);
+    for (int x = 0; x < ras->getLx(); ++x) area += pix[x].m;
+  }
+  return area / TPixel32::maxChannelValue;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(vectorraster, "cpu rasterization of vector regions") {
+  TPaletteP palette = new TPalette();
+  int solidId       = palette->addStyle(TPixel32::Red);
+  int cleanupId     = palette->addStyle(new TColorCleanupStyle(TPixel32::Red));
+
+  TPointD a(10.3, 12.6), b(190.2, 31.4), c(61.7, 171.1);
+  double exactArea = 0.5 * std::abs(cross(b - a, c - a));
+
+  TRaster32P ras(200, 200);
+  TVectorRenderData rd(TVectorRenderData::ProductionSettings(), TAffine(),
+                       ras->getBounds(), palette.getPointer());
+
+  // Only plain solid color styles are rasterized - not the derived ones
+  TVectorImageP solid   = makeTriangle(a, b, c, solidId);
+  TVectorImageP cleanup = makeTriangle(a, b, c, cleanupId);
+  bool ok = TCheck::verify(TVectorRasterizer::canRasterize(solid.getPointer(),
+                                                           rd),
+                           "solid color regions rasterized");
+  ok = TCheck::verify(!TVectorRasterizer::canRasterize(cleanup.getPointer(),
+                                                       rd),
+                      "derived styles left to OpenGL") &&
+       ok;
+
+  // Antialiased coverage adds up to the exact area
+  ras->clear();
+  TVectorRasterizer::rasterize(ras, solid.getPointer(), rd);
+  ok = TCheck::verify(TCheck::areClose(coveredArea(ras), exactArea, 1e-2),
+                      "covered area of a triangle") &&
+       ok;
+
+  // A triangle over a 1920x1080 tile
+  TRaster32P tile(1920, 1080);
+  TVectorRenderData tileRd(TVectorRenderData::ProductionSettings(),
+                           TScale(9.6, 6.0), tile->getBounds(),
+                           palette.getPointer());
+  TCheck::time("triangle on a 1920x1080 tile", [&]() {
+    tile->clear();
+    TVectorRasterizer::rasterize(tile, solid.getPointer(), tileRd);
+  });
+
+  return ok;
+}
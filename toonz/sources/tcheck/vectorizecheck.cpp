@@ -0,0 +1,82 @@
+
+
+#include "tcheck.h"
+
+// TnzCore includes
+#include "tpalette.h"
+#include "tstroke.h"
+#include "ttoonzimage.h"
+#include "tvectorimage.h"
+
+// TnzLib includes
+#include "toonz/tcenterlinevectorizer.h"
+
+// STD includes
+#include <cmath>
+
+//=============================================================================
+
+namespace {
+
+// Rings of ink 1 on a grid - each one a separate contour family
+TToonzImageP makeRings(int columns, int rows, int cellSize) {
+  TRasterCM32P ras(columns * cellSize, rows * cellSize);
+  ras->fill(TPixelCM32(0, 0, TPixelCM32::getMaxTone()));
+
+  double outer = cellSize * 0.4, inner = cellSize * 0.3;
+  for (int y = 0; y < ras->getLy(); ++y) {
+    TPixelCM32 *pix = ras->pixels(y);
+    for (int x = 0; x < ras->getLx(); ++x) {
+      double dx = x % cellSize - cellSize * 0.5,
+             dy = y % cellSize - cellSize * 0.5;
+      double d = std::sqrt(dx * dx + dy * dy);
+      if (d >= inner && d <= outer) pix[x] = TPixelCM32(1, 0, 0);
+    }
+  }
+
+  return new TToonzImage(ras, ras->getBounds());
+}
+
+//-----------------------------------------------------------------------------
+
+bool sameStrokes(const TVectorImageP &a, const TVectorImageP &b) {
+  if (a->getStrokeCount() != b->getStrokeCount()) return false;
+
+  for (UINT s = 0; s < a->getStrokeCount(); ++s) {
+    const TStroke *sa = a->getStroke(s), *sb = b->getStroke(s);
+    if (sa->getControlPointCount() != sb->getControlPointCount()) return false;
+    for (int i = 0; i < sa->getControlPointCount(); ++i)
+      if (sa->getControlPoint(i) != sb->getControlPoint(i)) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+//=============================================================================
+
+TCHECK_DEFINE(vectorize, "centerline vectorization of contour families") {
+  const int columns = 8, rows = 6;
+
+  TPaletteP palette  = new TPalette();
+  TToonzImageP image = makeRings(columns, rows, 150);
+
+  CenterlineConfiguration config;
+  config.m_leaveUnpainted = false;
+
+  // Families are skeletonized in parallel, the output is still in order
+  VectorizerCore vectorizer;
+  TVectorImageP first, vi;
+  TCheck::time("48 rings on 1200x900", [&]() {
+    vi = vectorizer.vectorize(image.getPointer(), config, palette.getPointer());
+    if (!first) first = vi;
+  });
+
+  bool ok = TCheck::verify(first && first->getStrokeCount() >= columns * rows,
+                           "a stroke per ring at least");
+  ok = TCheck::verify(first && vi && sameStrokes(first, vi),
+                      "same strokes in the same order on every run") &&
+       ok;
+
+  return ok;
+}
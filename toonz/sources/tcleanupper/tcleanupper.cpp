@@ -44,6 +44,12 @@
 
 // Qt includes
 #include <QApplication>
+#include <QMutex>
+#include <QWaitCondition>
+
+// STD includes
+#include <deque>
+#include <memory>
 
 using namespace TCli;
 using namespace std;
@@ -371,6 +377,222 @@ static void addCleanupDefaultPalette(TXshSimpleLevel *sl) {
   delete defaultPalette;
 }
 
+//========================================================================
+//
+// Batch cleanup pipeline
+//
+// This thread reads the frames in xsheet order and hands them to a pool of
+// tasks, which perform the cleanup stages. Cleaned up frames are written back
+// by this thread, in the same order. Frames in flight are bounded, in order to
+// bound memory usage.
+//
+//------------------------------------------------------------------------
+
+namespace {
+
+//! Statistics of a cleanup session.
+struct CleanupStatistics {
+  int m_frames;       //!< Frames cleaned up
+  TStopWatch m_load;  //!< Time spent reading frames
+  TStopWatch m_save;  //!< Time spent writing frames
+  TStopWatch m_wait;  //!< Time spent waiting for the cleanup tasks
+
+public:
+  CleanupStatistics() : m_frames(0) {}
+};
+
+//------------------------------------------------------------------------
+
+//! A frame going through the cleanup pipeline.
+struct CleanupFrame {
+  TFrameId m_fid;
+  int m_status;
+
+  TRasterImageP m_original;  //!< Released as soon as processed
+  TToonzImageP m_result;     //!< Null if the cleanup failed
+  QStringList m_warnings;    //!< Reported when the frame is written
+  bool m_done;
+
+public:
+  CleanupFrame(const TFrameId &fid, int status, const TRasterImageP &original)
+      : m_fid(fid), m_status(status), m_original(original), m_done(false) {}
+};
+
+typedef std::shared_ptr<CleanupFrame> CleanupFrameP;
+
+//------------------------------------------------------------------------
+
+//! Performs the cleanup stages of a frame. Warnings are collected, since
+//! frames are cleaned up outside the main thread.
+TToonzImageP cleanupFrame(TRasterImageP &original, bool firstImage,
+                          QStringList &warnings) {
+  TCleanupper *cl = TCleanupper::instance();
+
+  try {
+    CleanupPreprocessedImage *cpi;
+    {
+      TRasterImageP resampledImage;
+      cpi = cl->process(original, firstImage, resampledImage, false, false,
+                        false, 0, 0, &warnings);
+    }
+    if (!cpi) return TToonzImageP();
+
+    TToonzImageP timage = cl->finalize(cpi, true);
+    delete cpi;
+
+    return timage;
+  } catch (...) {
+    return TToonzImageP();
+  }
+}
+
+//------------------------------------------------------------------------
+
+//! State shared by a pipeline and its tasks, which may outlive it.
+struct CleanupPipelineState {
+  QMutex m_mutex;
+  QWaitCondition m_frameDone;
+  int m_runningCount;  //!< Tasks processing a frame
+  bool m_closed;       //!< Tasks starting after the pipeline is closed quit
+
+public:
+  CleanupPipelineState() : m_runningCount(0), m_closed(false) {}
+};
+
+typedef std::shared_ptr<CleanupPipelineState> CleanupPipelineStateP;
+
+//------------------------------------------------------------------------
+
+class CleanupPipeline {
+public:
+  CleanupPipelineStateP m_state;
+
+  TThread::Executor m_executor;
+  std::deque<CleanupFrameP> m_frames;  //!< Frames in flight, in xsheet order
+  int m_maxFrames;
+
+public:
+  CleanupPipeline(int threadsCount)
+      : m_state(new CleanupPipelineState), m_maxFrames(2 * threadsCount) {
+    m_executor.setMaxActiveTasks(threadsCount);
+  }
+
+  //! Cancels the frames not started yet, and waits for the others - which
+  //! may happen when writing a frame throws.
+  ~CleanupPipeline() {
+    m_executor.cancelAll();
+
+    QMutexLocker locker(&m_state->m_mutex);
+
+    m_state->m_closed = true;
+    while (m_state->m_runningCount > 0)
+      m_state->m_frameDone.wait(&m_state->m_mutex);
+  }
+
+  bool isFull() const { return (int)m_frames.size() >= m_maxFrames; }
+  bool isEmpty() const { return m_frames.empty(); }
+
+  void submit(const CleanupFrameP &frame);
+
+  //! Waits for the first frame in flight to be processed, and returns it.
+  CleanupFrameP takeNext(CleanupStatistics &stats) {
+    CleanupFrameP frame = m_frames.front();
+    m_frames.pop_front();
+
+    QMutexLocker locker(&m_state->m_mutex);
+
+    stats.m_wait.start();
+    while (!frame->m_done) m_state->m_frameDone.wait(&m_state->m_mutex);
+    stats.m_wait.stop();
+
+    return frame;
+  }
+};
+
+//------------------------------------------------------------------------
+
+class CleanupFrameTask final : public TThread::Runnable {
+  CleanupPipelineStateP m_state;
+  CleanupFrameP m_frame;
+
+public:
+  CleanupFrameTask(const CleanupPipelineStateP &state,
+                   const CleanupFrameP &frame)
+      : m_state(state), m_frame(frame) {}
+
+  void run() override {
+    {
+      QMutexLocker locker(&m_state->m_mutex);
+      if (m_state->m_closed) return;
+
+      ++m_state->m_runningCount;
+    }
+
+    QStringList warnings;
+    TToonzImageP timage = cleanupFrame(m_frame->m_original, false, warnings);
+    m_frame->m_original = TRasterImageP();
+
+    QMutexLocker locker(&m_state->m_mutex);
+
+    m_frame->m_result   = timage;
+    m_frame->m_warnings = warnings;
+    m_frame->m_done     = true;
+
+    --m_state->m_runningCount;
+    m_state->m_frameDone.wakeAll();
+  }
+};
+
+//------------------------------------------------------------------------
+
+void CleanupPipeline::submit(const CleanupFrameP &frame) {
+  m_frames.push_back(frame);
+  m_executor.addTask(new CleanupFrameTask(m_state, frame));
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------
+
+//! Stores a cleaned up frame in the level.
+static void writeCleanupFrame(TXshSimpleLevel *xl, LevelUpdater &updater,
+                              const CleanupFrame &frame, bool firstImage,
+                              CleanupStatistics &stats,
+                              TUserLogAppend &m_userLog) {
+  for (const QString &warning : frame.m_warnings) {
+    m_userLog.warning(warning.toStdString());
+    DVGui::warning(warning);
+  }
+
+  TToonzImageP timage = frame.m_result;
+  if (!timage) {
+    string err = "    *error* cleanup failed on frame " + frame.m_fid.expand();
+    m_userLog.error(err);
+    cout << err << endl;
+    return;
+  }
+
+  stats.m_save.start();
+
+  TPointD dpi(0, 0);
+  timage->getDpi(dpi.x, dpi.y);
+  if (dpi.x != 0 && dpi.y != 0) xl->getProperties()->setDpi(dpi);
+
+  if (firstImage) addCleanupDefaultPalette(xl);
+
+  timage->setPalette(xl->getPalette());
+  xl->setFrameStatus(frame.m_fid, frame.m_status | TXshSimpleLevel::Cleanupped);
+  xl->setFrame(frame.m_fid, timage);
+
+  updater.update(frame.m_fid, timage);
+
+  /*- 1フレーム終わったら、そのフレームのキャッシュは消す -*/
+  xl->invalidateFrame(frame.m_fid);
+
+  stats.m_save.stop();
+  ++stats.m_frames;
+}
+
 //========================================================================
 //
 // cleanupLevel
@@ -383,8 +605,8 @@ static void addCleanupDefaultPalette(TXshSimpleLevel *sl) {
 //------------------------------------------------------------------------
 
 static void cleanupLevel(TXshSimpleLevel *xl, std::set<TFrameId> fidsInXsheet,
-                         ToonzScene *scene, bool overwrite,
-                         TUserLogAppend &m_userLog) {
+                         ToonzScene *scene, bool overwrite, int threadsCount,
+                         CleanupStatistics &stats, TUserLogAppend &m_userLog) {
   prepareToCleanup(xl, scene->getProperties()
                            ->getCleanupParameters()
                            ->m_cleanupPalette.getPointer());
@@ -398,6 +620,9 @@ static void cleanupLevel(TXshSimpleLevel *xl, std::set<TFrameId> fidsInXsheet,
   LevelUpdater updater(xl);
   m_userLog.info(info);
   DVGui::info(QString::fromStdString(info));
+
+  CleanupPipeline pipeline(threadsCount);
+
   bool firstImage = true;
   for (auto const &fid : fidsInXsheet) {
     cout << "  " << fid << endl;
@@ -415,7 +640,11 @@ static void cleanupLevel(TXshSimpleLevel *xl, std::set<TFrameId> fidsInXsheet,
     CleanupParameters *params = scene->getProperties()->getCleanupParameters();
     // if lines are not processed, obtain the original sampled image
     bool toBeLineProcessed = params->m_lineProcessingMode != lpNone;
+
+    stats.m_load.start();
     TRasterImageP original = xl->getFrameToCleanup(fid, toBeLineProcessed);
+    stats.m_load.stop();
+
     if (!original) {
       string err = "    *error* missed frame";
       m_userLog.error(err);
@@ -438,47 +667,46 @@ static void cleanupLevel(TXshSimpleLevel *xl, std::set<TFrameId> fidsInXsheet,
       cl->process(original, false, ri, false, true, true, nullptr,
                   ri->getRaster());
       updater.update(fid, ri);
+      ++stats.m_frames;
       continue;
     }
-    // Obtain the source dpi. Changed it to be done once at the first frame of
-    // each level in order to avoid the following problem:
-    // If the original raster level has no dpi (such as TGA images), obtaining
-    // dpi in every frame causes dpi mismatch between the first frame and the
-    // following frames, since the value
-    // TXshSimpleLevel::m_properties->getDpi() will be changed to the
-    // dpi of cleanup camera (= TLV's dpi) after finishing the first frame.
+
     if (firstImage) {
+      // Obtain the source dpi. Changed it to be done once at the first frame
+      // of each level in order to avoid the following problem:
+      // If the original raster level has no dpi (such as TGA images),
+      // obtaining dpi in every frame causes dpi mismatch between the first
+      // frame and the following frames, since the value
+      // TXshSimpleLevel::m_properties->getDpi() will be changed to the
+      // dpi of cleanup camera (= TLV's dpi) after finishing the first frame.
       TPointD dpi;
       original->getDpi(dpi.x, dpi.y);
       if (dpi.x == 0 && dpi.y == 0) dpi = xl->getProperties()->getDpi();
       cl->setSourceDpi(dpi);
-    }
-
-    CleanupPreprocessedImage *cpi;
-    {
-      TRasterImageP resampledImage;
-      cpi = cl->process(original, firstImage, resampledImage);
-    }
-
-    TToonzImageP timage = cl->finalize(cpi, true);
-    TPointD dpi(0, 0);
-    timage->getDpi(dpi.x, dpi.y);
-    if (dpi.x != 0 && dpi.y != 0) xl->getProperties()->setDpi(dpi);
-
-    if (firstImage) addCleanupDefaultPalette(xl);
-    firstImage = false;
 
-    timage->setPalette(xl->getPalette());
-    xl->setFrameStatus(fid, status | TXshSimpleLevel::Cleanupped);
-    xl->setFrame(fid, timage);
+      // The first frame is the auto-adjust reference, and sets the level's
+      // dpi and palette - it is cleaned up before the following ones start
+      CleanupFrame frame(fid, status, original);
+      original         = TRasterImageP();
+      frame.m_result   = cleanupFrame(frame.m_original, true, frame.m_warnings);
+      frame.m_original = TRasterImageP();
 
-    updater.update(fid, timage);
+      writeCleanupFrame(xl, updater, frame, true, stats, m_userLog);
+      firstImage = false;
+      continue;
+    }
 
-    /*- 1フレーム終わったら、そのフレームのキャッシュは消す -*/
-    xl->invalidateFrame(fid);
+    pipeline.submit(CleanupFrameP(new CleanupFrame(fid, status, original)));
+    original = TRasterImageP();
 
-    delete cpi;
+    while (pipeline.isFull())
+      writeCleanupFrame(xl, updater, *pipeline.takeNext(stats), false, stats,
+                        m_userLog);
   }
+
+  while (!pipeline.isEmpty())
+    writeCleanupFrame(xl, updater, *pipeline.takeNext(stats), false, stats,
+                      m_userLog);
 }
 
 //========================================================================
@@ -492,6 +720,9 @@ static void cleanupLevel(TXshSimpleLevel *xl, std::set<TFrameId> fidsInXsheet,
 int main(int argc, char *argv[]) {
   QApplication app(argc, argv);
 
+  // Initialize thread components
+  TThread::init();
+
   // questo definisce la registry root e inizializza TEnv
   TEnv::setRootVarName(rootVarName);
   TEnv::setSystemVarPrefix(systemVarPrefix);
@@ -554,11 +785,29 @@ int main(int argc, char *argv[]) {
   StringQualifier farmData("-farm data", "TFarm Controller");
   StringQualifier idq("-id n", "id");
   StringQualifier tmsg("-tmsg n", "Internal use only");
+  StringQualifier nthreads("-nthreads n", "Number of cleanup threads");
   Usage usage(argv[0]);
   usage.add(srcName + selectedOnlyOption + overwriteAllOption +
-            overwriteNoPaintOption + farmData + idq + tmsg);
+            overwriteNoPaintOption + farmData + idq + tmsg + nthreads);
   if (!usage.parse(argc, argv)) exit(1);
 
+  int procCount    = TSystem::getProcessorCount();
+  int threadsCount = procCount;
+  if (nthreads.isSelected()) {
+    QString threadCountStr = QString::fromStdString(nthreads.getValue());
+    threadsCount           = (threadCountStr == "single") ? 1
+                             : (threadCountStr == "half") ? procCount / 2
+                             : (threadCountStr == "all")  ? procCount
+                                                          : threadCountStr.toInt();
+
+    if (threadsCount <= 0) {
+      cout << "Qualifier 'nthreads': bad input" << endl;
+      exit(1);
+    }
+  }
+  threadsCount = tcrop(threadsCount, 1, procCount);
+  m_userLog.info("Threads count: " + std::to_string(threadsCount));
+
   TaskId       = idq.getValue();
   string fdata = farmData.getValue();
   if (fdata.empty())
@@ -673,6 +922,11 @@ int main(int argc, char *argv[]) {
 
   /*- XsheetからCleanupするLevelのリストを得る -*/
   searchLevelsToCleanup(levels, scene->getXsheet(), selectedOnly);
+
+  CleanupStatistics stats;
+  TStopWatch cleanupSw;
+  cleanupSw.start();
+
   TSceneProperties *sprop   = scene->getProperties();
   CleanupParameters *params = scene->getProperties()->getCleanupParameters();
   for (int i = 0; i < (int)levels.size(); i++) {
@@ -771,7 +1025,8 @@ int main(int argc, char *argv[]) {
     assert(fidsInXsheet.size() > 0);
 
     xl->load();
-    cleanupLevel(xl, fidsInXsheet, scene, overwrite, m_userLog);
+    cleanupLevel(xl, fidsInXsheet, scene, overwrite, threadsCount, stats,
+                 m_userLog);
 
     /*- Cleanup完了後、Nopaintをnopaintフォルダに保存する -*/
     if (Preferences::instance()->isSaveUnpaintedInCleanupEnable() &&
@@ -822,6 +1077,27 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  cleanupSw.stop();
+
+  {
+    double seconds = cleanupSw.getTotalTime() / 1000.0;
+
+    string msg = "Cleanup completed in " + ::to_string(seconds, 2) +
+                 " seconds\n" + std::to_string(stats.m_frames) +
+                 " frames cleaned up (" +
+                 ::to_string(seconds > 0 ? stats.m_frames / seconds : 0.0, 2) +
+                 " frames per second)";
+    string msg2 =
+        "\n" + ::to_string(stats.m_load.getTotalTime() / 1000.0, 2) +
+        " seconds spent on loading" + "\n" +
+        ::to_string(stats.m_save.getTotalTime() / 1000.0, 2) +
+        " seconds spent on saving" + "\n" +
+        ::to_string(stats.m_wait.getTotalTime() / 1000.0, 2) +
+        " seconds spent waiting for the cleanup threads" + "\n";
+    cout << msg + msg2;
+    m_userLog.info(msg + msg2);
+  }
+
   /*- CleanupParamをGrobalに戻す -*/
   restoreGlobalSettings(params);
 
@@ -48,6 +48,8 @@
 #include "tunit.h"
 #include "tenv.h"
 #include "tpassivecachemanager.h"
+#include "tpersistentfxcache.h"
+#include "trendertracer.h"
 // #include "tcacheresourcepool.h"
 
 // TnzCore includes
@@ -74,6 +76,11 @@
 #include <QApplication>
 #include <QWaitCondition>
 #include <QMessageBox>
+#include <QElapsedTimer>
+
+// STD includes
+#include <limits>
+#include <set>
 
 #ifdef _WIN32
 #ifndef x64
@@ -89,6 +96,11 @@ using namespace TCli;
 typedef ArgumentT<TFilePath> FilePathArgument;
 typedef QualifierT<TFilePath> FilePathQualifier;
 
+TEnv::FilePathVar EnvPersistentFxCacheFolder("PersistentFxCacheFolder",
+                                             TFilePath());
+TEnv::IntVar EnvPersistentFxCacheSize("PersistentFxCacheSize", 2048);
+TEnv::StringVar EnvImageCacheCodec("ImageCacheCodec", "LZ4");
+
 namespace {
 double currentCameraSize = 12;
 double getCurrentCameraSize() { return currentCameraSize; }
@@ -206,7 +218,8 @@ namespace {
 TStopWatch Sw1;
 TStopWatch Sw2;
 
-bool UseRenderFarm = false;
+bool UseRenderFarm  = false;
+bool TiledRendering = false;
 QString FarmControllerName;
 int FarmControllerPort;
 
@@ -263,29 +276,55 @@ void UnsetPremultiplyOptionsInPngLevels(ToonzScene *scene) {
 class MyMovieRenderListener final : public MovieRenderer::Listener {
 public:
   MyMovieRenderListener(const TFilePath &fp, int frameCount,
-                        QWaitCondition &renderCompleted, bool stereo)
+                        QWaitCondition &renderCompleted, bool stereo, int r0,
+                        int r1, int step, double timeStretchFactor)
       : m_fp(fp)
       , m_frameCount(frameCount)
       , m_frameCompletedCount(0)
       , m_frameFailedCount(0)
       , m_renderCompleted(renderCompleted)
-      , m_stereo(stereo) {}
+      , m_stereo(stereo)
+      , m_r0(r0)
+      , m_rangeEnd(r1)
+      , m_step(step)
+      , m_timeStretchFactor(timeStretchFactor)
+      , m_frameLimit((std::numeric_limits<int>::max)()) {
+    m_rangeTimer.start();
+  }
 
   bool onFrameCompleted(int frame) override;
   bool onFrameFailed(int frame, TException &e) override;
   void onSequenceCompleted(const TFilePath &fp) override;
 
+  // Asks the farm controller whether the task range has been shortened, in
+  // favour of an idle server - at most once every rangeQueryTime msecs.
+  // Returns false once all the frames still in the range have been rendered.
+  bool updateRange();
+
+  // The controller takes only tails lasting a minute or more, so a short
+  // delay in noticing it costs little compared to one query per frame
+  static const qint64 rangeQueryTime = 10000;
+
   TFilePath m_fp;
   int m_frameCount;
   int m_frameCompletedCount;
   int m_frameFailedCount;
   QWaitCondition &m_renderCompleted;
   bool m_stereo;
+
+  int m_r0, m_rangeEnd, m_step;  // 0-based range, as passed to generateMovie
+  double m_timeStretchFactor;
+  int m_frameLimit;  // frames from this one on were taken by another task
+  QElapsedTimer m_rangeTimer;
+
+  std::set<int> m_completedFrames, m_failedFrames;
 };
 
 //==================================================================================
 
 bool MyMovieRenderListener::onFrameCompleted(int frame) {
+  if (frame >= m_frameLimit) return updateRange();
+
   TFilePath fp = m_fp.withFrame(frame + 1);
   string msg;
   if (m_stereo)
@@ -310,13 +349,16 @@ bool MyMovieRenderListener::onFrameCompleted(int frame) {
   }
 
   m_frameCompletedCount++;
+  m_completedFrames.insert(frame);
 
-  return true;
+  return updateRange();
 }
 
 //------------------------------------------------------------------------------
 
 bool MyMovieRenderListener::onFrameFailed(int frame, TException &e) {
+  if (frame >= m_frameLimit) return updateRange();
+
   TFilePath fp = m_fp.withFrame(frame + 1);
   string msg;
   msg = ::to_string(fp) + " failed";
@@ -339,8 +381,47 @@ bool MyMovieRenderListener::onFrameFailed(int frame, TException &e) {
   }
 
   m_frameFailedCount++;
+  m_failedFrames.insert(frame);
 
-  return true;
+  return updateRange();
+}
+
+//------------------------------------------------------------------------------
+
+bool MyMovieRenderListener::updateRange() {
+  if (FarmController && m_rangeTimer.elapsed() >= rangeQueryTime) {
+    m_rangeTimer.restart();
+
+    int rangeEnd = -1;
+    try {
+      // The controller expresses ranges 1-based
+      rangeEnd = FarmController->queryTaskRangeEnd(TaskId) - 1;
+    } catch (...) {
+    }
+
+    if (rangeEnd >= m_r0 && rangeEnd < m_rangeEnd) {
+      m_rangeEnd = rangeEnd;
+
+      int numFrames = (int)((m_rangeEnd - m_r0 + 1) / m_timeStretchFactor);
+      m_frameLimit  = m_r0 + numFrames;
+      m_frameCount  = tceil(numFrames / (float)m_step);
+
+      // Frames past the limit are rendered again by the task that took them
+      m_frameCompletedCount =
+          std::distance(m_completedFrames.begin(),
+                        m_completedFrames.lower_bound(m_frameLimit));
+      m_frameFailedCount = std::distance(
+          m_failedFrames.begin(), m_failedFrames.lower_bound(m_frameLimit));
+
+      string msg = "Range shortened to frame " + std::to_string(rangeEnd + 1);
+      cout << msg << endl;
+      m_userLog->info(msg);
+    }
+  }
+
+  // A shortened render is stopped as soon as its frames are done
+  return m_frameLimit == (std::numeric_limits<int>::max)() ||
+         m_frameCompletedCount + m_frameFailedCount < m_frameCount;
 }
 
 //------------------------------------------------------------------------------
@@ -536,10 +617,11 @@ static std::pair<int, int> generateMovie(ToonzScene *scene, const TFilePath &fp,
     movieRenderer.setDpi(cameraXDpi, cameraYDpi);
 
     movieRenderer.enablePrecomputing(true);
+    movieRenderer.getTRenderer()->enableTiledRendering(TiledRendering);
 
-    MyMovieRenderListener *listener =
-        new MyMovieRenderListener(fp, tceil((numFrames) / (float)step),
-                                  renderCompleted, rs.m_stereoscopic);
+    MyMovieRenderListener *listener = new MyMovieRenderListener(
+        fp, tceil((numFrames) / (float)step), renderCompleted,
+        rs.m_stereoscopic, r0, r1, step, timeStretchFactor);
 
     movieRenderer.addListener(listener);
 
@@ -610,9 +692,18 @@ int main(int argc, char *argv[]) {
   StringQualifier nthreads("-nthreads n", "Number of rendering threads");
   StringQualifier tileSize("-maxtilesize n",
                            "Enable tile rendering of max n MB per tile");
+  FilePathQualifier fxCacheFolder("-fxcache folder",
+                                  "Persistent fx render cache folder");
+  IntQualifier fxCacheSize("-fxcachesize n",
+                           "Persistent fx render cache size (MB)");
+  FilePathQualifier traceFile("-trace file",
+                              "Save a render trace (Chrome JSON format)");
+  SimpleQualifier tiled("-tiled",
+                        "Split frames among threads exceeding the frames count");
   StringQualifier tmsg("-tmsg val", "only internal use");
   usageLine = srcName + dstName + range + stepOpt + shrinkOpt + multimedia +
-              farmData + idq + nthreads + tileSize + tmsg;
+              farmData + idq + nthreads + tileSize + fxCacheFolder +
+              fxCacheSize + tiled + traceFile + tmsg;
 
   // system path qualifiers
   std::map<QString, std::unique_ptr<TCli::QualifierT<TFilePath>>>
@@ -758,8 +849,20 @@ int main(int argc, char *argv[]) {
   TFilePath cacheRoot = ToonzFolder::getCacheRootFolder();
   if (cacheRoot.isEmpty()) cacheRoot = TEnv::getStuffDir() + "cache";
   TImageCache::instance()->setRootDir(cacheRoot);
+  TImageCache::instance()->setCompressionCodec(EnvImageCacheCodec);
+
+  // Fx render results shared with the GUI and other farm nodes
+  TPersistentFxCache *fxCache = TPersistentFxCache::instance();
+  fxCache->setMaximumSize(fxCacheSize.isSelected()
+                              ? fxCacheSize.getValue()
+                              : (int)EnvPersistentFxCacheSize);
+  fxCache->setPath(fxCacheFolder.isSelected()
+                       ? fxCacheFolder.getValue()
+                       : (TFilePath)EnvPersistentFxCacheFolder);
   // #endif
 
+  TiledRendering = tiled.isSelected();
+
   TaskId       = QString::fromStdString(idq.getValue());
   string fdata = farmData.getValue();
   if (fdata.empty())
@@ -996,9 +1099,21 @@ int main(int argc, char *argv[]) {
 #endif
 #endif
 
+    if (traceFile.isSelected()) TRenderTracer::instance()->setEnabled(true);
+
     framePair = generateMovie(scene, theDstFilePath, r0, r1, step, shrink,
                               threadCount, maxTileSize);
 
+    // Fx results still queued for the disk cache are kept for the next runs
+    TPersistentFxCache::instance()->flush();
+
+    if (traceFile.isSelected()) {
+      TRenderTracer::instance()->setEnabled(false);
+      if (!TRenderTracer::instance()->save(traceFile.getValue()))
+        m_userLog->error("Can't write the render trace " +
+                         ::to_string(traceFile.getValue()));
+    }
+
     Sw1.stop();
 
     m_userLog->info(
@@ -1018,7 +1133,9 @@ int main(int argc, char *argv[]) {
         ::to_string(TStopWatch::global(0).getTotalTime() / 1000.0, 2) +
         " seconds spent on saving" + "\n" +
         ::to_string(TStopWatch::global(8).getTotalTime() / 1000.0, 2) +
-        " seconds spent on rendering" + "\n";
+        " seconds spent on rendering" + "\n" +
+        ::to_string(TStopWatch::global(1).getTotalTime() / 1000.0, 2) +
+        " seconds of rendering stalled on saving" + "\n";
     cout << msg + msg2;
     m_userLog->info(msg + msg2);
     DVGui::info(QString::fromStdString(msg));
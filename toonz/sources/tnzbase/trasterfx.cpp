@@ -5,6 +5,8 @@
 // Core-system includes
 #include "tsystem.h"
 #include "tthreadmessage.h"
+#include "tstopwatch.h"
+#include "tconvert.h"
 
 // Fx basics
 #include "tparamcontainer.h"
@@ -19,8 +21,12 @@
 // Optimization components
 #include "trenderresourcemanager.h"
 #include "tfxcachemanager.h"
+#include "tpersistentfxcache.h"
 #include "trenderer.h"
 
+// Profiling
+#include "trendertracer.h"
+
 // Diagnostics
 // #define DIAGNOSTICS
 #ifdef DIAGNOSTICS
@@ -357,6 +363,37 @@ private:
 
 FX_IDENTIFIER_IS_HIDDEN(TrFx, "trFx")
 
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Returns the name of the specified fx in render traces - empty if the
+// tracer is disabled, to spare string building in the common case.
+std::string traceName(TFx *fx) {
+  if (!TRenderTracer::instance()->isEnabled()) return std::string();
+
+  std::string name(::to_string(fx->getFxId()));
+  return name.empty() ? fx->getDeclaration()->getId() : name;
+}
+
+//------------------------------------------------------------------------------
+
+void traceInstant(TFx *fx, const std::string &name, double frame,
+                  const TRectD &rect) {
+  TRenderTracer *tracer = TRenderTracer::instance();
+  if (!tracer->isEnabled()) return;
+
+  TRenderTracer::Args args;
+  args.push_back(std::make_pair("fx", TRenderTracer::toJson(traceName(fx))));
+  args.push_back(std::make_pair("frame", TRenderTracer::toJson(frame)));
+  args.push_back(std::make_pair("lx", TRenderTracer::toJson(rect.getLx())));
+  args.push_back(std::make_pair("ly", TRenderTracer::toJson(rect.getLy())));
+
+  tracer->addInstantEvent(name, "cache", args);
+}
+
+}  // namespace
+
 //==============================================================================
 //
 // FxResourceBuilder
@@ -378,6 +415,8 @@ class FxResourceBuilder final : public ResourceBuilder {
 
   TRectD m_outRect;
 
+  int m_computesCount;  //!< Computes performed by the last build
+
 public:
   FxResourceBuilder(const std::string &resourceName, const TRasterFxP &fx,
                     const TRenderSettings &rs, double frame)
@@ -385,7 +424,8 @@ public:
       , m_rfx(fx)
       , m_frame(frame)
       , m_rs(&rs)
-      , m_currTile(0) {}
+      , m_currTile(0)
+      , m_computesCount(0) {}
 
   inline void build(TTile &tile);
 
@@ -411,7 +451,12 @@ inline void FxResourceBuilder::build(TTile &tile) {
   TDimension dim(tile.getRaster()->getSize());
   m_outRect = TRectD(tile.m_pos, TDimensionD(dim.lx, dim.ly));
 
+  m_computesCount = 0;
   ResourceBuilder::build(m_outRect);
+
+  // Without computations, the result came entirely from the cache
+  if (m_computesCount == 0)
+    traceInstant(m_rfx.getPointer(), "Cache hit", m_frame, m_outRect);
 }
 
 //------------------------------------------------------------------------------
@@ -455,6 +500,15 @@ void FxResourceBuilder::compute(const TRectD &tileRect) {
   sw.start();
 #endif
 
+  ++m_computesCount;
+
+  TRenderTraceScope trace("fx", traceName(m_rfx.getPointer()));
+  if (trace.isEnabled()) {
+    trace.addArg("frame", m_frame);
+    trace.addArg("lx", tileRect.getLx());
+    trace.addArg("ly", tileRect.getLy());
+  }
+
   buildTileToCalculate(tileRect);
   m_rfx->doCompute(*m_currTile, m_frame, *m_rs);
 
@@ -641,6 +695,10 @@ std::string TRasterFx::getAlias(double frame,
   }
 
   alias += "]";
+
+  // Results depending on external data must not outlive the session
+  if (!isPersistentCachable()) alias += TPersistentFxCache::uncachableToken();
+
   return alias;
 }
 
@@ -784,6 +842,8 @@ void TRasterFx::doDryCompute(TRectD &rect, double frame,
 void TRasterFx::allocateAndCompute(TTile &tile, const TPointD &pos,
                                    const TDimension &size, TRasterP templateRas,
                                    double frame, const TRenderSettings &info) {
+  TRenderTraceScope trace("allocation", traceName(this));
+
   if (templateRas) {
     TRaster32P ras32(templateRas);
     TRaster64P ras64(templateRas);
@@ -819,6 +879,14 @@ void TRasterFx::allocateAndCompute(TTile &tile, const TPointD &pos,
     tile.getRaster()->setLinear(info.m_linearColorSpace);
   }
 
+  if (trace.isEnabled()) {
+    TRasterP ras(tile.getRaster());
+    trace.addArg("frame", frame);
+    trace.addArg("lx", size.lx);
+    trace.addArg("ly", size.ly);
+    trace.addArg("bytes", (double)size.lx * size.ly * ras->getPixelSize());
+  }
+
   tile.m_pos = pos;
   compute(tile, frame, info);
 }
@@ -951,9 +1019,46 @@ void TRasterFx::compute(TTile &tile, double frame,
 
 #endif
 
-  // Invoke the fx-specific computation process
-  FxResourceBuilder rBuilder(alias, this, info, frame);
-  rBuilder.build(interestingTile);
+  // Look for a result stored by a previous session (or another process)
+  // in the persistent cache. Swatch renders are excluded, and so are the
+  // subtrees depending on external data.
+  TPersistentFxCache *persistentCache = TPersistentFxCache::instance();
+  bool persistent = !info.m_isSwatch && persistentCache->isEnabled() &&
+                    persistentCache->isCachable(alias);
+
+  // The key is hashed only when there are entries to look up
+  std::string persistentKey;
+  bool persistentHit = false;
+  if (persistent && !persistentCache->isEmpty()) {
+    persistentKey = persistentCache->getKey(alias, frame, interestingRect, info);
+    persistentHit = persistentCache->load(persistentKey, interestingTile);
+  }
+
+  if (persistent)
+    traceInstant(this, persistentHit ? "Disk cache hit" : "Disk cache miss",
+                 frame, interestingRect);
+
+  if (!persistentHit) {
+    TStopWatch computeWatch;
+    computeWatch.start();
+
+    // Invoke the fx-specific computation process
+    FxResourceBuilder rBuilder(alias, this, info, frame);
+    rBuilder.build(interestingTile);
+
+    computeWatch.stop();
+
+    // Store expensive results only - cheap ones are faster to recompute
+    // than to read from disk
+    if (persistent && !(info.m_isCanceled && *info.m_isCanceled) &&
+        computeWatch.getTotalTime() >=
+            (TUINT32)persistentCache->getMinimumComputeTime()) {
+      if (persistentKey.empty())
+        persistentKey =
+            persistentCache->getKey(alias, frame, interestingRect, info);
+      persistentCache->store(persistentKey, interestingTile);
+    }
+  }
 
   // convert to linear
   if (isLinear != computeInLinear) {
@@ -26,6 +26,7 @@
 #include "tstroke.h"
 #include "drawutil.h"
 #include "tsystem.h"
+#include "tthread.h"
 #include "tinbetween.h"
 #include "tregion.h"
 #include "tgl.h"
@@ -43,10 +44,13 @@
 
 #include "historytypes.h"
 
+#include <map>
+#include <memory>
 #include <stack>
 
 // For Qt translation support
 #include <QCoreApplication>
+#include <QThread>
 
 using namespace ToolUtils;
 
@@ -894,95 +898,166 @@ void fillAreaWithUndo(const TImageP &img, const TRectD &area, TStroke *stroke,
 }
 
 //=============================================================================
-// doFill
+// RasterFillJob
 //-----------------------------------------------------------------------------
+// A fill on a toonz raster image, split so that the raster work - which
+// does not touch the application - can be done in any thread, while the
+// undo and the savebox are left to the main thread.
 
-void doFill(const TImageP &img, const TPointD &pos, FillParameters &params,
-            bool isShiftFill, TXshSimpleLevel *sl, const TFrameId &fid,
-            bool autopaintLines) {
-  TTool::Application *app = TTool::getApplication();
-  if (!app) return;
+class RasterFillJob {
+  TRasterCM32P m_ras;
+  TPoint m_offs;
+  FillParameters m_params;
+  TTileSetCM32 *m_tileSet;
+  bool m_recomputeSavebox;
+  TRect m_filledBox;
 
-  if (TToonzImageP ti = TToonzImageP(img)) {
-    TPoint offs(0, 0);
-    TRasterCM32P ras = ti->getRaster();
+public:
+  RasterFillJob() : m_tileSet(0), m_recomputeSavebox(false) {}
+  ~RasterFillJob() {
+    if (!m_tileSet) return;
+    delete m_tileSet;
+    m_ras->unlock();
+  }
+
+  // Returns false if there is nothing to fill. As in doFill(), params are
+  // completed with the fill position and the autopaint palette.
+  bool prepare(const TToonzImageP &ti, const TPointD &pos,
+               FillParameters &params, bool isShiftFill, bool autopaintLines);
+  void run();
+  void commit(TXshSimpleLevel *sl, const TFrameId &fid);
+
+private:
+  // not copyable
+  RasterFillJob(const RasterFillJob &);
+  RasterFillJob &operator=(const RasterFillJob &);
+};
 
-    if (Preferences::instance()->getFillOnlySavebox()) {
-      TRectD bbox = ti->getBBox();
-      TRect ibbox = convert(bbox);
-      offs        = ibbox.getP00();
-      ras         = ti->getRaster()->extract(ibbox);
-    }
+//-----------------------------------------------------------------------------
 
-    bool recomputeSavebox = false;
-    TPalette *plt         = ti->getPalette();
+bool RasterFillJob::prepare(const TToonzImageP &ti, const TPointD &pos,
+                            FillParameters &params, bool isShiftFill,
+                            bool autopaintLines) {
+  m_ras = ti->getRaster();
 
-    if (!ras.getPointer() || ras->isEmpty()) return;
+  if (Preferences::instance()->getFillOnlySavebox()) {
+    TRectD bbox = ti->getBBox();
+    TRect ibbox = convert(bbox);
+    m_offs      = ibbox.getP00();
+    m_ras       = ti->getRaster()->extract(ibbox);
+  }
 
-    ras->lock();
+  TPalette *plt = ti->getPalette();
 
-    TTileSetCM32 *tileSet = new TTileSetCM32(ras->getSize());
-    TTileSaverCM32 tileSaver(ras, tileSet);
-    TDimension imageSize = ti->getSize();
-    TPointD p(imageSize.lx % 2 ? 0.0 : 0.5, imageSize.ly % 2 ? 0.0 : 0.5);
+  if (!m_ras.getPointer() || m_ras->isEmpty()) return false;
 
-    /*-- params.m_p = convert(pos-p)では、マイナス座標でずれが生じる --*/
-    TPointD tmp_p = pos - p;
-    params.m_p = TPoint((int)floor(tmp_p.x + 0.5), (int)floor(tmp_p.y + 0.5));
+  TDimension imageSize = ti->getSize();
+  TPointD p(imageSize.lx % 2 ? 0.0 : 0.5, imageSize.ly % 2 ? 0.0 : 0.5);
 
-    params.m_p += ti->getRaster()->getCenter();
-    params.m_p -= offs;
-    params.m_shiftFill = isShiftFill;
+  /*-- params.m_p = convert(pos-p)では、マイナス座標でずれが生じる --*/
+  TPointD tmp_p = pos - p;
+  params.m_p = TPoint((int)floor(tmp_p.x + 0.5), (int)floor(tmp_p.y + 0.5));
 
-    TRect rasRect(ras->getSize());
-    if (!rasRect.contains(params.m_p)) {
-      ras->unlock();
-      return;
+  params.m_p += ti->getRaster()->getCenter();
+  params.m_p -= m_offs;
+  params.m_shiftFill = isShiftFill;
+
+  TRect rasRect(m_ras->getSize());
+  if (!rasRect.contains(params.m_p)) return false;
+
+  // !autoPaintLines will temporary disable autopaint line feature
+  if (plt && hasAutoInks(plt) && autopaintLines) params.m_palette = plt;
+
+  m_params = params;
+
+  m_ras->lock();
+  m_tileSet = new TTileSetCM32(m_ras->getSize());
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void RasterFillJob::run() {
+  TTileSaverCM32 tileSaver(m_ras, m_tileSet);
+
+  if (m_params.m_fillType == ALL || m_params.m_fillType == AREAS) {
+    if (m_params.m_shiftFill) {
+      FillParameters aux(m_params);
+      aux.m_styleId      = (m_params.m_styleId == 0) ? 1 : 0;
+      m_recomputeSavebox = fill(m_ras, aux, &tileSaver);
     }
+    m_recomputeSavebox = fill(m_ras, m_params, &tileSaver, &m_filledBox);
+  }
+  if (m_params.m_fillType == ALL || m_params.m_fillType == LINES) {
+    if (m_params.m_segment)
+      inkSegment(m_ras, m_params.m_p, m_params.m_styleId, 2.51, true,
+                 &tileSaver);
+    else if (!m_params.m_segment)
+      inkFill(m_ras, m_params.m_p, m_params.m_styleId, 2, &tileSaver);
+  }
+}
 
-    // !autoPaintLines will temporary disable autopaint line feature
-    if (plt && hasAutoInks(plt) && autopaintLines) params.m_palette = plt;
+//-----------------------------------------------------------------------------
+
+void RasterFillJob::commit(TXshSimpleLevel *sl, const TFrameId &fid) {
+  TTool::Application *app = TTool::getApplication();
 
-    if (params.m_fillType == ALL || params.m_fillType == AREAS) {
-      if (isShiftFill) {
-        FillParameters aux(params);
-        aux.m_styleId    = (params.m_styleId == 0) ? 1 : 0;
-        recomputeSavebox = fill(ras, aux, &tileSaver);
+  if (m_tileSet->getTileCount() != 0) {
+    static int count = 0;
+    TSystem::outputDebug("FILL" + std::to_string(count++) + "\n");
+    if (m_offs != TPoint())
+      for (int i = 0; i < m_tileSet->getTileCount(); i++) {
+        TTileSet::Tile *t = m_tileSet->editTile(i);
+        t->m_rasterBounds = t->m_rasterBounds + m_offs;
       }
-      recomputeSavebox = fill(ras, params, &tileSaver);
-    }
-    if (params.m_fillType == ALL || params.m_fillType == LINES) {
-      if (params.m_segment)
-        inkSegment(ras, params.m_p, params.m_styleId, 2.51, true, &tileSaver);
-      else if (!params.m_segment)
-        inkFill(ras, params.m_p, params.m_styleId, 2, &tileSaver);
-    }
+    TUndoManager::manager()->add(
+        new RasterFillUndo(m_tileSet, m_params, sl, fid,
+                           Preferences::instance()->getFillOnlySavebox()));
+  } else
+    delete m_tileSet;
+  m_tileSet = 0;
+  m_ras->unlock();
+
+  // al posto di updateFrame:
+  if (!app) return;
 
-    if (tileSaver.getTileSet()->getTileCount() != 0) {
-      static int count = 0;
-      TSystem::outputDebug("FILL" + std::to_string(count++) + "\n");
-      if (offs != TPoint())
-        for (int i = 0; i < tileSet->getTileCount(); i++) {
-          TTileSet::Tile *t = tileSet->editTile(i);
-          t->m_rasterBounds = t->m_rasterBounds + offs;
-        }
-      TUndoManager::manager()->add(
-          new RasterFillUndo(tileSet, params, sl, fid,
-                             Preferences::instance()->getFillOnlySavebox()));
-    }
+  TXshLevel *xl = app->getCurrentLevel()->getLevel();
+  if (!xl) return;
+
+  TXshSimpleLevel *level = xl->getSimpleLevel();
+  level->getProperties()->setDirtyFlag(true);
+  if (m_recomputeSavebox &&
+      Preferences::instance()->isMinimizeSaveboxAfterEditing())
+    ToolUtils::updateSaveBox(level, fid);
+  else if (!m_params.m_shiftFill && m_params.m_styleId != 0)
+    // the fill has only made pixels opaque
+    ToolUtils::expandSaveBox(level, fid, m_filledBox + m_offs);
+}
+
+//-----------------------------------------------------------------------------
 
-    // al posto di updateFrame:
+// Fills of different images are independent: they are shared among the
+// calling thread and the shared executor.
 
-    TXshLevel *xl = app->getCurrentLevel()->getLevel();
-    if (!xl) return;
+void runRasterFillJobs(const std::vector<RasterFillJob *> &jobs) {
+  TThread::parallelFor((int)jobs.size(), [&jobs](int j) { jobs[j]->run(); });
+}
 
-    TXshSimpleLevel *sl = xl->getSimpleLevel();
-    sl->getProperties()->setDirtyFlag(true);
-    if (recomputeSavebox &&
-        Preferences::instance()->isMinimizeSaveboxAfterEditing())
-      ToolUtils::updateSaveBox(sl, fid);
+//=============================================================================
+// doFill
+//-----------------------------------------------------------------------------
+
+void doFill(const TImageP &img, const TPointD &pos, FillParameters &params,
+            bool isShiftFill, TXshSimpleLevel *sl, const TFrameId &fid,
+            bool autopaintLines) {
+  TTool::Application *app = TTool::getApplication();
+  if (!app) return;
 
-    ras->unlock();
+  if (TToonzImageP ti = TToonzImageP(img)) {
+    RasterFillJob job;
+    if (!job.prepare(ti, pos, params, isShiftFill, autopaintLines)) return;
+    job.run();
+    job.commit(sl, fid);
   } else if (TVectorImageP vi = TImageP(img)) {
     int oldStyleId;
     QMutexLocker lock(vi->getMutex());
@@ -1006,8 +1081,18 @@ vi->computeRegion(pos, params.m_styleId);*/
 
 class SequencePainter {
 public:
+  struct Frame {
+    TImageP m_img;
+    double m_t;
+    TFrameId m_fid;
+  };
+
   virtual void process(TImageP img /*, TImageLocation &imgloc*/, double t,
                        TXshSimpleLevel *sl, const TFrameId &fid) = 0;
+  // Called in the main thread on each batch of frames, before they are
+  // process()ed: painters can do here, concurrently, the part of their work
+  // which does not touch the application.
+  virtual void prepare(const std::vector<Frame> &frames) {}
   void processSequence(TXshSimpleLevel *sl, TFrameId firstFid,
                        TFrameId lastFid);
   virtual ~SequencePainter() {}
@@ -1038,22 +1123,36 @@ void SequencePainter::processSequence(TXshSimpleLevel *sl, TFrameId firstFid,
   int m = fids.size();
   assert(m > 0);
 
+  // frames are taken in batches, so that prepare() can keep all the cores
+  // busy without loading the whole range at once
+  int batchSize = std::max(QThread::idealThreadCount(), 1);
+
   TUndoManager::manager()->beginBlock();
-  for (int i = 0; i < m; ++i) {
-    TFrameId fid = fids[i];
-    assert(firstFid <= fid && fid <= lastFid);
-    TImageP img = sl->getFrame(fid, true);
-    double t    = m > 1 ? (double)i / (double)(m - 1) : 0.5;
-    process(img, backward ? 1 - t : t, sl, fid);
-    // Setto il fid come corrente per notificare il cambiamento dell'immagine
-    TTool::Application *app = TTool::getApplication();
-    if (app) {
-      if (app->getCurrentFrame()->isEditingScene())
-        app->getCurrentFrame()->setFrame(fid.getNumber());
-      else
-        app->getCurrentFrame()->setFid(fid);
-      TTool *tool = app->getCurrentTool()->getTool();
-      if (tool) tool->notifyImageChanged(fid);
+  for (int i0 = 0; i0 < m; i0 += batchSize) {
+    std::vector<Frame> frames;
+    for (int i = i0; i < std::min(i0 + batchSize, m); ++i) {
+      TFrameId fid = fids[i];
+      assert(firstFid <= fid && fid <= lastFid);
+      double t     = m > 1 ? (double)i / (double)(m - 1) : 0.5;
+      Frame frame = {sl->getFrame(fid, true), backward ? 1 - t : t, fid};
+      frames.push_back(frame);
+    }
+
+    prepare(frames);
+
+    for (const Frame &frame : frames) {
+      process(frame.m_img, frame.m_t, sl, frame.m_fid);
+      // Setto il fid come corrente per notificare il cambiamento
+      // dell'immagine
+      TTool::Application *app = TTool::getApplication();
+      if (app) {
+        if (app->getCurrentFrame()->isEditingScene())
+          app->getCurrentFrame()->setFrame(frame.m_fid.getNumber());
+        else
+          app->getCurrentFrame()->setFid(frame.m_fid);
+        TTool *tool = app->getCurrentTool()->getTool();
+        if (tool) tool->notifyImageChanged(frame.m_fid);
+      }
     }
   }
   TUndoManager::manager()->endBlock();
@@ -1150,6 +1249,8 @@ class MultiFiller final : public SequencePainter {
   TPointD m_firstPoint, m_lastPoint;
   FillParameters m_params;
   bool m_autopaintLines;
+  // raster fills done in prepare(), waiting to be committed
+  std::map<TFrameId, std::unique_ptr<RasterFillJob>> m_jobs;
 
 public:
   MultiFiller(const TPointD &firstPoint, const TPointD &lastPoint,
@@ -1158,10 +1259,32 @@ public:
       , m_lastPoint(lastPoint)
       , m_params(params)
       , m_autopaintLines(autopaintLines) {}
+
+  void prepare(const std::vector<Frame> &frames) override {
+    std::vector<RasterFillJob *> jobs;
+    for (const Frame &frame : frames) {
+      TToonzImageP ti = frame.m_img;
+      if (!ti) continue;
+      TPointD p = m_firstPoint * (1 - frame.m_t) + m_lastPoint * frame.m_t;
+      std::unique_ptr<RasterFillJob> job(new RasterFillJob());
+      if (!job->prepare(ti, p, m_params, false, m_autopaintLines)) continue;
+      jobs.push_back(job.get());
+      m_jobs[frame.m_fid] = std::move(job);
+    }
+    runRasterFillJobs(jobs);
+  }
+
   void process(TImageP img, double t, TXshSimpleLevel *sl,
                const TFrameId &fid) override {
-    TPointD p = m_firstPoint * (1 - t) + m_lastPoint * t;
-    doFill(img, p, m_params, false, sl, fid, m_autopaintLines);
+    auto it = m_jobs.find(fid);
+    if (it == m_jobs.end()) {
+      TPointD p = m_firstPoint * (1 - t) + m_lastPoint * t;
+      doFill(img, p, m_params, false, sl, fid, m_autopaintLines);
+      return;
+    }
+
+    it->second->commit(sl, fid);
+    m_jobs.erase(it);
   }
 };
 
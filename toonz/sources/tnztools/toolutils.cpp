@@ -121,6 +121,26 @@ void ToolUtils::updateSaveBox(const TXshSimpleLevelP &sl, const TFrameId &fid,
 
 //------------------------------------------------------------
 
+void ToolUtils::expandSaveBox(const TXshSimpleLevelP &sl, const TFrameId &fid,
+                              const TRect &paintedRect) {
+  sl->setDirtyFlag(true);
+
+  TToonzImageP ti = sl->getFrame(fid, true);
+  if (!ti) return;
+
+  const TRect &savebox = ti->getSavebox();
+  if (paintedRect.isEmpty() || savebox.contains(paintedRect)) return;
+
+  // Painted pixels can only enlarge the bounding box, whatever the
+  // 'Minimize Savebox after Editing' preference
+  ti->setSavebox((savebox + paintedRect) * ti->getRaster()->getBounds());
+
+  TImageInfo *info = sl->getFrameInfo(fid, true);
+  ImageBuilder::setImageInfo(*info, ti.getPointer());
+}
+
+//------------------------------------------------------------
+
 void ToolUtils::updateSaveBox() {
   TTool::Application *application = TTool::getApplication();
   if (!application) return;
@@ -977,24 +977,34 @@ public:
 void BatchesController::update() {
   if (m_controller) {
     try {
+      // all the tasks are queried in a single request
+      std::vector<TFarmTask *> batchesTasks;
+      std::vector<QString> batchesTaskIds, farmTaskIds;
+      std::vector<TFarmTask> farmTasks;
+
       std::map<QString, QString>::iterator it = m_farmIdsTable.begin();
       for (; it != m_farmIdsTable.end(); ++it) {
-        QString farmTaskId    = it->second;
-        QString batchesTaskId = it->first;
-
-        TFarmTask *batchesTask = getTask(batchesTaskId);
-        TFarmTask farmTask     = *batchesTask;
-
+        TFarmTask *batchesTask = getTask(it->first);
         if (batchesTask) {
-          QString batchesTaskParentId = batchesTask->m_parentId;
-          m_controller->queryTaskInfo(farmTaskId, farmTask);
-          int chunkSize            = batchesTask->m_chunkSize;
-          *batchesTask             = farmTask;
-          batchesTask->m_chunkSize = chunkSize;
-          batchesTask->m_id        = batchesTaskId;
-          batchesTask->m_parentId  = batchesTaskParentId;
+          batchesTasks.push_back(batchesTask);
+          batchesTaskIds.push_back(it->first);
+          farmTaskIds.push_back(it->second);
+          farmTasks.push_back(*batchesTask);
         }
       }
+
+      m_controller->queryTaskInfo(farmTaskIds, farmTasks);
+
+      for (int i = 0; i < (int)batchesTasks.size(); ++i) {
+        TFarmTask *batchesTask = batchesTasks[i];
+
+        QString batchesTaskParentId = batchesTask->m_parentId;
+        int chunkSize               = batchesTask->m_chunkSize;
+        *batchesTask                = farmTasks[i];
+        batchesTask->m_chunkSize    = chunkSize;
+        batchesTask->m_id           = batchesTaskIds[i];
+        batchesTask->m_parentId     = batchesTaskParentId;
+      }
     } catch (TException &e) {
       ControllerFailureMsg(e).send();
     }
@@ -1068,6 +1078,9 @@ public:
   void taskProgress(const QString &taskId, int step, int stepCount,
                     int frameNumber, FrameState state) override;
 
+  // local tasks are never split
+  int queryTaskRangeEnd(const QString &taskId) override { return -1; }
+
   void taskCompleted(const QString &taskId, int exitCode) override;
 
   void getServers(std::vector<ServerIdentity> &servers) override {
@@ -18,6 +18,7 @@
 #include "toonz/fxdag.h"
 #include "toonz/tcolumnfxset.h"
 #include "toonz/tcolumnfx.h"
+#include "toonz/txshlevel.h"
 #include "toonz/txshlevelcolumn.h"
 #include "toonz/levelset.h"
 #include "toonz/txshchildlevel.h"
@@ -26,6 +27,7 @@
 // Render cache includes
 #include "tpassivecachemanager.h"
 #include "tcacheresourcepool.h"
+#include "tpersistentfxcache.h"
 
 #include "cachefxcommand.h"
 
@@ -104,6 +106,16 @@ CacheFxCommand::CacheFxCommand() {
   ret = ret && connect(app->getCurrentObject(), SIGNAL(objectChanged(bool)),
                        this, SLOT(onObjectChanged()));
 
+  // Level edits must reach the persistent cache even when no preview is open
+  ret = ret && connect(app->getCurrentLevel(), SIGNAL(xshLevelChanged()), this,
+                       SLOT(onCurrentLevelChanged()));
+  ret = ret && connect(app->getPaletteController()->getCurrentLevelPalette(),
+                       SIGNAL(colorStyleChangedOnMouseRelease()), this,
+                       SLOT(onCurrentLevelChanged()));
+  ret = ret && connect(app->getPaletteController()->getCurrentLevelPalette(),
+                       SIGNAL(paletteChanged()), this,
+                       SLOT(onCurrentLevelChanged()));
+
   TCacheResourcePool::instance();  // The resources pool must be instanced
                                    // before the passive delegate
   TPassiveCacheManager::instance()->setTreeDescriptor(&buildTreeDescription);
@@ -141,6 +153,16 @@ void CacheFxCommand::onLevelChanged(const std::string &levelName) {
 
 //---------------------------------------------------------------------------
 
+void CacheFxCommand::onCurrentLevelChanged() {
+  TXshLevel *xl = TApp::instance()->getCurrentLevel()->getLevel();
+  if (!xl) return;
+
+  // Results on disk may refer to the level's old content
+  TPersistentFxCache::instance()->invalidateLevel(::to_string(xl->getPath()));
+}
+
+//---------------------------------------------------------------------------
+
 void CacheFxCommand::onFxChanged() {
   TFx *fx = TApp::instance()->getCurrentFx()->getFx();
   if (fx) TPassiveCacheManager::instance()->onFxChanged(fx);
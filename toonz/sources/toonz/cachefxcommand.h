@@ -30,6 +30,7 @@ public slots:
   void onFxChanged();
   void onXsheetChanged();
   void onObjectChanged();
+  void onCurrentLevelChanged();
 };
 
 //=============================================================================
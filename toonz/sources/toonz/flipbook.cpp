@@ -48,6 +48,8 @@
 #include "toonz/tcamera.h"
 #include "toonz/preferences.h"
 #include "toonz/tproject.h"
+#include "toonz/imagemanager.h"
+#include "toonz/imageprefetcher.h"
 
 // Image painting
 #include "toonz/imagepainter.h"
@@ -135,6 +137,87 @@ inline TRectD getImageBoundsD(const TImageP &img) {
     return vi->getBBox();
   }
 }
+
+//-----------------------------------------------------------------------------
+
+//! How a frame of a viewed file is loaded.
+struct FrameLoadSettings {
+  TFrameId m_fid;
+  int m_shrink;
+  TRect m_loadbox;  //!< The loaded region, empty for the whole image
+  bool m_premultiply, m_16BitRead;
+  double m_colorSpaceGamma;
+  TPaletteP m_palette;
+};
+
+//-----------------------------------------------------------------------------
+
+//! Loads a frame of a viewed file. It does not access the flipbook, so that it
+//! can run in background.
+TImageP loadFrame(const TLevelReaderP &lr, const FrameLoadSettings &s) {
+  TFilePath fp = lr->getFilePath();
+
+  int lx = 0, oriLx = 0;
+  // try to get image info only when loading tlv or pli as it is quite time
+  // consuming
+  if (fp.getType() == "tlv" || fp.getType() == "pli") {
+    if (lr->getImageInfo()) lx = oriLx = lr->getImageInfo()->m_lx;
+  }
+  TImageReaderP ir = lr->getFrameReader(s.m_fid);
+  ir->setShrink(s.m_shrink);
+  ir->setColorSpaceGamma(s.m_colorSpaceGamma);
+  if (s.m_loadbox != TRect()) {
+    ir->setRegion(s.m_loadbox);
+    lx = s.m_loadbox.getLx();
+  }
+
+  if (s.m_16BitRead) ir->enable16BitRead(true);
+
+  // always enable to load float-format images
+  ir->enableFloatRead(true);
+
+  TImageP img = ir->load();
+  if (!img) return img;
+
+  TRasterImageP ri = ((TRasterImageP)img);
+  TToonzImageP ti  = ((TToonzImageP)img);
+  if (s.m_premultiply) {
+    if (ri)
+      TRop::premultiply(ri->getRaster());
+    else if (ti)
+      TRop::premultiply(ti->getRaster());
+  }
+
+  // se e' stata caricata una sottoimmagine alcuni formati in realta'
+  // caricano tutto il raster e fanno extract, non si ha quindi alcun
+  // risparmio di occupazione di memoria; alloco un raster grande
+  // giusto copio la region e butto quello originale.
+  TRect loadbox = s.m_loadbox;
+  if (ri && loadbox != TRect() &&
+      ri->getRaster()->getLx() == oriLx)  // questo serve perche' per avi e
+                                          // mov la setRegion e'
+                                          // completamente ignorata...
+    ri->setRaster(ri->getRaster()->extract(loadbox)->clone());
+  else if (ri && ri->getRaster()->getWrap() > ri->getRaster()->getLx())
+    ri->setRaster(ri->getRaster()->clone());
+  else if (ti && ti->getCMapped()->getWrap() > ti->getCMapped()->getLx())
+    ti->setCMapped(ti->getCMapped()->clone());
+
+  if ((fp.getType() == "tlv" || fp.getType() == "pli") && s.m_shrink > 1 &&
+      (lx == 0 || (ri && ri->getRaster()->getLx() == lx) ||
+       (ti && ti->getRaster()->getLx() == lx))) {
+    if (ri)
+      ri->setRaster(TRop::shrink(ri->getRaster(), s.m_shrink));
+    else if (ti)
+      ti->setCMapped(TRop::shrink(ti->getRaster(), s.m_shrink));
+  }
+
+  TPalette *palette = img->getPalette();
+  if (s.m_palette && (!palette || palette != s.m_palette.getPointer()))
+    img->setPalette(s.m_palette.getPointer());
+
+  return img;
+}
 }  // namespace
 
 //=============================================================================
@@ -189,7 +272,10 @@ FlipBook::FlipBook(QWidget *parent, QString viewerTitle,
     , m_dim()
     , m_loadboxes()
     , m_freezeButton(0)
-    , m_flags(flags) {
+    , m_flags(flags)
+    , m_prefetchFrame(-1)
+    , m_prefetchDirection(1)
+    , m_prefetchValid(new std::atomic<bool>(true)) {
   setAcceptDrops(true);
   setFocusPolicy(Qt::StrongFocus);
 
@@ -224,6 +310,8 @@ FlipBook::FlipBook(QWidget *parent, QString viewerTitle,
   // signal-slot connection
   bool ret = connect(m_flipConsole, SIGNAL(buttonPressed(FlipConsole::EGadget)),
                      this, SLOT(onButtonPressed(FlipConsole::EGadget)));
+  ret = ret && connect(m_flipConsole, SIGNAL(playStateChanged(bool)), this,
+                       SLOT(onPlayStateChanged(bool)));
 
   m_flipConsole->setFrameRate(TApp::instance()
                                   ->getCurrentScene()
@@ -588,6 +676,7 @@ void FlipBook::saveImages() {
 //=============================================================================
 
 FlipBook::~FlipBook() {
+  *m_prefetchValid = false;
   if (m_loadPopup) delete m_loadPopup;
   if (m_savePopup) delete m_savePopup;
 }
@@ -762,6 +851,12 @@ void FlipBook::saveImage() {
 
 //=============================================================================
 
+void FlipBook::onPlayStateChanged(bool isPlaying) {
+  ImagePrefetcher::instance()->setPlaying(isPlaying);
+}
+
+//-----------------------------------------------------------------------------
+
 void FlipBook::onButtonPressed(FlipConsole::EGadget button) {
   switch (button) {
   case FlipConsole::eSound:
@@ -1522,43 +1617,28 @@ TImageP FlipBook::getCurrentImage(int frame) {
   if (m_xl)  // is an xsheet level
   {
     if (m_xl->getFrameCount() <= 0) return 0;
-    return m_xl->getFrame(m_xl->index2fid(frame - 1), false);
-  } else if (!m_levels.empty())  // is a viewfile or a previewFx
-  {
-    TLevelP level;
-    QString levelName;
-    int from, to, step;
-    m_flipConsole->getFrameRange(from, to, step);
 
-    int frameIndex = m_previewedFx ? ((frame - from) / step) + 1 : frame;
+    fid             = m_xl->index2fid(frame - 1);
+    std::string xId = m_xl->getImageId(fid);
+    ImagePrefetcher::instance()->recordDisplay(
+        xId, ImageManager::instance()->isCached(xId));
 
-    int i = 0;
-    // Search all subsequent levels on the flipbook and retrieve the one
-    // containing the required frame
-    for (i = 0; i < m_levels.size(); i++) {
-      int frameIndexesCount = m_levels[i].getIndexesCount();
-      if (frameIndex > 0 && frameIndex <= frameIndexesCount) break;
-      frameIndex -= frameIndexesCount;
-    }
-
-    if (i == m_levels.size() || frame < 0) return 0;
-
-    frame--;
+    return m_xl->getFrame(fid, false);
+  } else if (!m_levels.empty())  // is a viewfile or a previewFx
+  {
+    int i = getLevelFrame(frame, fid);
+    if (i < 0) return 0;
 
     // Now, get the right frame from the level
 
-    level               = m_levels[i].m_level;
     fp                  = m_levels[i].m_fp;  // fp=empty when previewing fx
     randomAccessRead    = m_levels[i].m_randomAccessRead;
     incrementalIndexing = m_levels[i].m_incrementalIndexing;
-    levelName           = m_levelNames[i];
-    fid                 = m_levels[i].flipbookIndexToLevelFrame(frameIndex);
     premultiply         = m_levels[i].m_premultiply;
     colorSpaceGamma     = m_levels[i].m_colorSpaceGamma;
 
     if (fid == TFrameId()) return 0;
-    id = levelName.toStdString() + fid.expand(TFrameId::NO_PAD) +
-         ((m_isPreviewFx) ? "" : ::to_string(this));
+    id = getCacheId(i, fid);
 
     if (!m_isPreviewFx) {
       m_title1 = m_viewerTitle + " :: " + fp.withoutParentDir().withFrame(fid);
@@ -1582,78 +1662,36 @@ TImageP FlipBook::getCurrentImage(int frame) {
     // TImageCache::instance()->add(toString(m_poolIndex) + "lastFlipFrame",
     // img);
     // m_lastViewedFrame = frame+1;
-    if ((showSub && m_loadbox == loadbox) || (!showSub && loadbox == TRect()))
+    if ((showSub && m_loadbox == loadbox) || (!showSub && loadbox == TRect())) {
+      ImagePrefetcher::instance()->recordDisplay(id, true);
       return TImageCache::instance()->get(id, false);
-    else
+    } else
       TImageCache::instance()->remove(id);
   }
+  ImagePrefetcher::instance()->recordDisplay(id, false);
+
   if (fp != TFilePath() && !m_isPreviewFx) {
-    int lx = 0, oriLx = 0;
     // TLevelReaderP lr(fp);
     if (!m_lr || (fp != m_lr->getFilePath())) {
       m_lr = TLevelReaderP(fp);
       m_lr->enableRandomAccessRead(randomAccessRead);
     }
     if (!m_lr) return 0;
-    // try to get image info only when loading tlv or pli as it is quite time
-    // consuming
-    if (fp.getType() == "tlv" || fp.getType() == "pli") {
-      if (m_lr->getImageInfo()) lx = oriLx = m_lr->getImageInfo()->m_lx;
-    }
-    TImageReaderP ir = m_lr->getFrameReader(fid);
-    ir->setShrink(m_shrink);
-    ir->setColorSpaceGamma(colorSpaceGamma);
-    if (m_loadbox != TRect() && showSub) {
-      ir->setRegion(m_loadbox);
-      lx = m_loadbox.getLx();
-    }
-
-    if (Preferences::instance()->is30bitDisplayEnabled())
-      ir->enable16BitRead(true);
 
-    // always enable to load float-format images
-    ir->enableFloatRead(true);
+    FrameLoadSettings settings = {
+        fid,
+        m_shrink,
+        showSub ? m_loadbox : TRect(),
+        premultiply,
+        Preferences::instance()->is30bitDisplayEnabled(),
+        colorSpaceGamma,
+        m_palette};
 
-    TImageP img = ir->load();
+    TImageP img = loadFrame(m_lr, settings);
 
     if (img) {
-      TRasterImageP ri = ((TRasterImageP)img);
-      TToonzImageP ti  = ((TToonzImageP)img);
-      if (premultiply) {
-        if (ri)
-          TRop::premultiply(ri->getRaster());
-        else if (ti)
-          TRop::premultiply(ti->getRaster());
-      }
-
-      // se e' stata caricata una sottoimmagine alcuni formati in realta'
-      // caricano tutto il raster e fanno extract, non si ha quindi alcun
-      // risparmio di occupazione di memoria; alloco un raster grande
-      // giusto copio la region e butto quello originale.
-      if (ri && showSub && m_loadbox != TRect() &&
-          ri->getRaster()->getLx() == oriLx)  // questo serve perche' per avi e
-                                              // mov la setRegion e'
-                                              // completamente ignorata...
-        ri->setRaster(ri->getRaster()->extract(m_loadbox)->clone());
-      else if (ri && ri->getRaster()->getWrap() > ri->getRaster()->getLx())
-        ri->setRaster(ri->getRaster()->clone());
-      else if (ti && ti->getCMapped()->getWrap() > ti->getCMapped()->getLx())
-        ti->setCMapped(ti->getCMapped()->clone());
-
-      if ((fp.getType() == "tlv" || fp.getType() == "pli") && m_shrink > 1 &&
-          (lx == 0 || (ri && ri->getRaster()->getLx() == lx) ||
-           (ti && ti->getRaster()->getLx() == lx))) {
-        if (ri)
-          ri->setRaster(TRop::shrink(ri->getRaster(), m_shrink));
-        else if (ti)
-          ti->setCMapped(TRop::shrink(ti->getRaster(), m_shrink));
-      }
-
-      TPalette *palette = img->getPalette();
-      if (m_palette && (!palette || palette != m_palette))
-        img->setPalette(m_palette);
       TImageCache::instance()->add(id, img);
-      m_loadboxes[id] = showSub ? m_loadbox : TRect();
+      m_loadboxes[id] = settings.m_loadbox;
     }
 
     // An old archived bug says that simultaneous open for read of the same tlv
@@ -1678,6 +1716,145 @@ else*/
 
 //-----------------------------------------------------------------------------
 
+int FlipBook::getLevelFrame(int frame, TFrameId &fid) {
+  int from, to, step;
+  m_flipConsole->getFrameRange(from, to, step);
+
+  int frameIndex = m_previewedFx ? ((frame - from) / step) + 1 : frame;
+
+  int i = 0;
+  // Search all subsequent levels on the flipbook and retrieve the one
+  // containing the required frame
+  for (i = 0; i < m_levels.size(); i++) {
+    int frameIndexesCount = m_levels[i].getIndexesCount();
+    if (frameIndex > 0 && frameIndex <= frameIndexesCount) break;
+    frameIndex -= frameIndexesCount;
+  }
+
+  if (i == m_levels.size() || frame < 0) return -1;
+
+  fid = m_levels[i].flipbookIndexToLevelFrame(frameIndex);
+  return i;
+}
+
+//-----------------------------------------------------------------------------
+
+std::string FlipBook::getCacheId(int levelIndex, const TFrameId &fid) const {
+  return m_levelNames[levelIndex].toStdString() +
+         fid.expand(TFrameId::NO_PAD) +
+         ((m_isPreviewFx) ? "" : ::to_string(this));
+}
+
+//-----------------------------------------------------------------------------
+/*! Starts loading in background the frames following the specified one, in
+    the direction of playback - so that they are in cache when displayed.
+*/
+void FlipBook::prefetch(int frame) {
+  if (frame == m_prefetchFrame) return;
+
+  ImagePrefetcher *prefetcher = ImagePrefetcher::instance();
+
+  int from, to, step;
+  m_flipConsole->getFrameRange(from, to, step);
+  step = std::max(step, 1);
+
+  int lookAhead = prefetcher->isEnabled() ? prefetcher->getLookAhead() : 0;
+
+  // Jumps, like the ones looping back to the first frame, keep the direction
+  if (m_prefetchFrame >= 0 &&
+      std::abs(frame - m_prefetchFrame) <= std::max(lookAhead, 1) * step)
+    m_prefetchDirection = (frame > m_prefetchFrame) ? 1 : -1;
+  m_prefetchFrame = frame;
+
+  std::string current;
+  if (m_xl) {
+    if (m_xl->getFrameCount() <= 0) return;
+    current = m_xl->getImageId(m_xl->index2fid(frame - 1));
+  } else if (!m_levels.empty() && !m_isPreviewFx) {
+    TFrameId fid;
+    int i = getLevelFrame(frame, fid);
+    if (i < 0 || fid == TFrameId()) return;
+    current = getCacheId(i, fid);
+
+    // Images loaded in a sub-region are tracked in m_loadboxes, which
+    // background loads cannot access
+    if (m_loadbox != TRect() &&
+        m_flipConsole->isChecked(FlipConsole::eUseLoadBox))
+      lookAhead = 0;
+  } else  // renders fill the cache on their own
+    return;
+
+  bool loop    = m_flipConsole->isChecked(FlipConsole::eLoop);
+  int count    = (to - from) / step + 1;
+  lookAhead    = std::min(lookAhead, count - 1);
+  bool is30bit = Preferences::instance()->is30bitDisplayEnabled();
+
+  std::vector<ImagePrefetcher::Frame> next;
+  for (int k = 1; k <= lookAhead; ++k) {
+    int f = frame + k * step * m_prefetchDirection;
+    if (f < from || f > to) {
+      if (!loop) break;
+      f += (f < from) ? count * step : -count * step;
+    }
+
+    if (m_xl) {
+      next.push_back(ImagePrefetcher::levelFrame(m_xl, m_xl->index2fid(f - 1)));
+      continue;
+    }
+
+    TFrameId fid;
+    int i = getLevelFrame(f, fid);
+    if (i < 0 || fid == TFrameId()) continue;
+
+    // Movie readers decode from the start when reopened: only levels whose
+    // frames are read independently are loaded ahead
+    const Level &level = m_levels[i];
+    if (level.m_fp.getDots() != ".." && level.m_fp.getType() != "tlv" &&
+        level.m_fp.getType() != "pli")
+      continue;
+
+    std::string id = getCacheId(i, fid);
+    if (!TImageCache::instance()->isCached(id)) m_loadboxes.erase(id);
+
+    FrameLoadSettings settings = {fid,
+                                  m_shrink,
+                                  TRect(),
+                                  level.m_premultiply,
+                                  is30bit,
+                                  level.m_colorSpaceGamma,
+                                  m_palette};
+    TFilePath fp          = level.m_fp;
+    bool randomAccessRead = level.m_randomAccessRead;
+    std::shared_ptr<std::atomic<bool>> valid = m_prefetchValid;
+
+    ImagePrefetcher::Frame prefetched = {
+        id, [fp, randomAccessRead, settings, id, valid]() {
+          if (!*valid || TImageCache::instance()->isCached(id)) return false;
+
+          TLevelReaderP lr(fp);
+          if (!lr) return false;
+          lr->enableRandomAccessRead(randomAccessRead);
+
+          TImageP img = loadFrame(lr, settings);
+          if (!img) return false;
+
+          TImageCache::instance()->add(id, img);
+
+          // The flipbook may have discarded its frames meanwhile
+          if (!*valid) {
+            TImageCache::instance()->remove(id);
+            return false;
+          }
+          return true;
+        }};
+    next.push_back(prefetched);
+  }
+
+  prefetcher->prefetch(current, next);
+}
+
+//-----------------------------------------------------------------------------
+
 /*! Set current level frame to image viewer. Add the view image in cache.
  */
 void FlipBook::onDrawFrame(int frame, const ImagePainter::VisualSettings &vs,
@@ -1686,6 +1863,7 @@ void FlipBook::onDrawFrame(int frame, const ImagePainter::VisualSettings &vs,
     m_imageViewer->setVisual(vs);
     m_imageViewer->setTimerAndTargetInstant(timer, targetInstant);
 
+    prefetch(frame);
     TImageP img = getCurrentImage(frame);
 
     if (!img) return;
@@ -1731,6 +1909,12 @@ void FlipBook::setLoadbox(const TRect &box) {
 void FlipBook::clearCache() {
   TLevel::Iterator it;
 
+  // Frames still loading in background must not be cached
+  *m_prefetchValid = false;
+  m_prefetchValid.reset(new std::atomic<bool>(true));
+  m_prefetchFrame = -1;
+  ImagePrefetcher::instance()->cancel();
+
   if (m_levelNames.empty()) return;
   int i;
 
@@ -18,6 +18,9 @@
 
 #include "toonzqt/flipconsoleowner.h"
 
+#include <atomic>
+#include <memory>
+
 class QPoint;
 class TPalette;
 class TFilePath;
@@ -188,6 +191,12 @@ protected:
 
   TPanelTitleBarButton *m_freezeButton;
 
+  // background loads of the next frames
+  int m_prefetchFrame, m_prefetchDirection;
+  //! Cleared when the cached frames are discarded, so that late loads drop
+  //! their images
+  std::shared_ptr<std::atomic<bool>> m_prefetchValid;
+
 public:
   enum Flags { eDontKeepFilesOpened = 0x1 };
 
@@ -278,6 +287,13 @@ protected:
   void playAudioFrame(int frame);
   TImageP getCurrentImage(int frame);
 
+  //! Returns the index in m_levels of the level shown at the specified frame,
+  //! and its frame id - or -1.
+  int getLevelFrame(int frame, TFrameId &fid);
+  std::string getCacheId(int levelIndex, const TFrameId &fid) const;
+
+  void prefetch(int frame);
+
   void showEvent(QShowEvent *e) override;
   void hideEvent(QHideEvent *e) override;
   void focusInEvent(QFocusEvent *e) override;
@@ -299,6 +315,7 @@ protected slots:
 
   void onDoubleClick(QMouseEvent *me);
   void onButtonPressed(FlipConsole::EGadget button);
+  void onPlayStateChanged(bool isPlaying);
   void onCloseButtonPressed();
   void saveImage();
 
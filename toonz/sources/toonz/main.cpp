@@ -47,6 +47,7 @@
 // TnzBase includes
 #include "permissionsmanager.h"
 #include "tenv.h"
+#include "tpersistentfxcache.h"
 #include "tcli.h"
 
 // TnzCore includes
@@ -93,6 +94,14 @@ using namespace DVGui;
 
 TEnv::IntVar EnvSoftwareCurrentFontSize("SoftwareCurrentFontSize", 12);
 
+// Persistent fx render cache - shared with tcomposer through the env file
+TEnv::FilePathVar EnvPersistentFxCacheFolder("PersistentFxCacheFolder",
+                                             TFilePath());
+TEnv::IntVar EnvPersistentFxCacheSize("PersistentFxCacheSize", 2048);
+
+// In-memory image cache compression codec, by TRasterCodec name
+TEnv::StringVar EnvImageCacheCodec("ImageCacheCodec", "LZ4");
+
 const char *rootVarName     = "TOONZROOT";
 const char *systemVarPrefix = "TOONZ";
 
@@ -229,6 +238,11 @@ project->setUseScenePath(TProject::Extras, false);
   TFilePath cacheDir = ToonzFolder::getCacheRootFolder();
   if (cacheDir.isEmpty()) cacheDir = TEnv::getStuffDir() + "cache";
   TImageCache::instance()->setRootDir(cacheDir);
+  TImageCache::instance()->setCompressionCodec(EnvImageCacheCodec);
+
+  // Fx render results reusable across sessions. Disabled if no folder is set
+  TPersistentFxCache::instance()->setMaximumSize(EnvPersistentFxCacheSize);
+  TPersistentFxCache::instance()->setPath(EnvPersistentFxCacheFolder);
 }
 
 //-----------------------------------------------------------------------------
@@ -848,6 +862,7 @@ int main(int argc, char *argv[]) {
 
   int ret = a.exec();
 
+  TPersistentFxCache::instance()->flush();
   TUndoManager::manager()->reset();
   PreviewFxManager::instance()->reset();
 
@@ -1159,6 +1159,7 @@ QString PreferencesPopup::getUIString(PreferencesItemId id) {
       {autosaveOtherFilesEnabled, tr("Automatically Save Non-Scene Files")},
       {startupPopupEnabled, tr("Show Startup Window when OpenToonz Starts")},
       {undoMemorySize, tr("Undo Memory Size (MB):")},
+      {imageCacheMemorySize, tr("Image Cache Memory Size (MB, 0 = Auto):")},
       {taskchunksize, tr("Render Task Chunk Size:")},
       {replaceAfterSaveLevelAs,
        tr("Replace Toonz Level after SaveLevelAs command")},
@@ -1575,6 +1576,7 @@ QWidget* PreferencesPopup::createGeneralPage() {
   insertUI(rasterOptimizedMemory, lay);
   insertUI(startupPopupEnabled, lay);
   insertUI(undoMemorySize, lay);
+  insertUI(imageCacheMemorySize, lay);
   insertUI(taskchunksize, lay);
   insertUI(sceneNumberingEnabled, lay);
   insertUI(watchFileSystemEnabled, lay);
@@ -20,6 +20,7 @@
 
 // Cache management includes
 #include "tpassivecachemanager.h"
+#include "tpersistentfxcache.h"
 
 // Toonz app (currents)
 #include "tapp.h"
@@ -250,6 +251,7 @@ Previewer::Imp::Imp(Previewer *owner)
   // same TRenderer. This should
   // change in the near future...
   m_renderer.enablePrecomputing(false);
+  m_renderer.enableTiledRendering(true);
   m_renderer.addPort(this);
 
   updateRenderSettings();
@@ -1308,9 +1310,11 @@ void Previewer::onImageChange(TXshLevel *xl, const TFrameId &fid) {
   TFilePath fp             = xl->getPath().withFrame(fid);
   std::string levelKeyword = ::to_string(fp);
 
-  // Inform the cache managers of level invalidation
+  // Inform the cache managers of level invalidation. Entries on disk are
+  // shared by full and subcamera previews, so they are always invalidated.
   if (!m_imp->m_subcamera)
     TPassiveCacheManager::instance()->invalidateLevel(levelKeyword);
+  TPersistentFxCache::instance()->invalidateLevel(levelKeyword);
 
   m_imp->updateAliasKeyword(levelKeyword);
 }
@@ -1378,9 +1382,11 @@ void Previewer::onLevelChange(TXshLevel *xl) {
   TFilePath fp             = xl->getPath();
   std::string levelKeyword = ::to_string(fp);
 
-  // Inform the cache managers of level invalidation
+  // Inform the cache managers of level invalidation. Entries on disk are
+  // shared by full and subcamera previews, so they are always invalidated.
   if (!m_imp->m_subcamera)
     TPassiveCacheManager::instance()->invalidateLevel(levelKeyword);
+  TPersistentFxCache::instance()->invalidateLevel(levelKeyword);
 
   m_imp->updateAliasKeyword(levelKeyword);
   m_imp->updateProgressBarStatus();
@@ -1398,9 +1404,12 @@ void Previewer::onLevelChanged() {
   TFilePath fp = xl->getPath();
   levelKeyword = ::to_string(fp.withType(""));
 
-  // Inform the cache managers of level invalidation
+  // Inform the cache managers of level invalidation. Entries on disk are
+  // shared by full and subcamera previews, so they are always invalidated -
+  // by level path, as their aliases are matched by whole paths.
   if (!m_imp->m_subcamera)
     TPassiveCacheManager::instance()->invalidateLevel(levelKeyword);
+  TPersistentFxCache::instance()->invalidateLevel(::to_string(fp));
 
   m_imp->updateAliasKeyword(levelKeyword);
   m_imp->updateProgressBarStatus();
@@ -348,6 +348,10 @@ PreviewFxInstance::PreviewFxInstance(TFxP fx, TXsheet *xsh)
     , m_end(-1)
     , m_initFrame(0)
     , m_xsheet(xsh) {
+  // Frames are typically requested a few at a time - let idle threads
+  // contribute to the computation of each frame
+  m_renderer.enableTiledRendering(true);
+
   // Install the render port on the instance renderer
   m_renderer.addPort(&m_renderPort);
 
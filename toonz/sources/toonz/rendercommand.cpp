@@ -39,6 +39,7 @@
 #include "tenv.h"
 #include "trenderer.h"
 #include "trasterfx.h"
+#include "trendertracer.h"
 
 // TnzCore includes
 #include "tsystem.h"
@@ -58,6 +59,18 @@
 
 namespace {
 
+// When specified, render traces are saved to this file at the end of renders
+TEnv::FilePathVar EnvRenderTraceFile("RenderTraceFile", TFilePath());
+
+void saveRenderTrace() {
+  TRenderTracer *tracer = TRenderTracer::instance();
+  if (!tracer->isEnabled()) return;
+
+  // May be called outside the main thread - no message boxes here
+  tracer->setEnabled(false);
+  tracer->save(EnvRenderTraceFile);
+}
+
 #include "bravomark.h"
 
 TRaster32P loadLight() {
@@ -426,6 +439,8 @@ public:
     return onFrameCompleted(frame);
   }
   void onSequenceCompleted(const TFilePath &fp) override {
+    saveRenderTrace();
+
     Message(this, -1, "").send();
     OnRenderCompleted(fp, m_error).send();
     m_error = false;
@@ -433,6 +448,8 @@ public:
   }
 
   void onCancel() override {
+    saveRenderTrace();
+
     m_isCanceled = true;
     setLabelText(QObject::tr("Aborting render...", "RenderListener"));
     reset();
@@ -581,6 +598,11 @@ void RenderCommand::rasterRender(bool isPreview) {
   // resetViewer(); //TODO cancella le immagini dell'eventuale render precedente
   // FileViewerPopupPool::instance()->getCurrent()->onClose();
 
+  if (!TFilePath(EnvRenderTraceFile).isEmpty()) {
+    TRenderTracer::instance()->clear();
+    TRenderTracer::instance()->setEnabled(true);
+  }
+
   movieRenderer.start();
 }
 
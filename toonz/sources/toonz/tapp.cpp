@@ -45,6 +45,7 @@
 #include "toonz/tcamera.h"
 #include "toonz/preferences.h"
 #include "toonz/txshsoundcolumn.h"
+#include "toonz/imageprefetcher.h"
 
 // TnzCore includes
 #include "tbigmemorymanager.h"
@@ -52,6 +53,7 @@
 #include "trasterimage.h"
 #include "tunit.h"
 #include "tsystem.h"
+#include "tenv.h"
 
 // Qt includes
 #include <QTimer>
@@ -63,6 +65,12 @@
 
 //===================================================================
 
+TEnv::IntVar EnvPlaybackPrefetch("PlaybackPrefetch", 1);
+TEnv::IntVar EnvPlaybackPrefetchFrames("PlaybackPrefetchFrames", 12);
+TEnv::IntVar EnvPlaybackPrefetchMemory("PlaybackPrefetchMemory", 512);  // MB
+
+//===================================================================
+
 namespace {
 
 double getCurrentCameraSize() {
@@ -105,7 +113,9 @@ TApp::TApp()
     , m_autosaveSuspended(false)
     , m_saveInProgress(false)
     , m_isStarting(false)
-    , m_isPenCloseToTablet(false) {
+    , m_isPenCloseToTablet(false)
+    , m_prefetchRow(0)
+    , m_prefetchDirection(1) {
   m_currentScene         = new TSceneHandle();
   m_currentXsheet        = new TXsheetHandle();
   m_currentFrame         = new TFrameHandle();
@@ -139,6 +149,10 @@ TApp::TApp()
   ret = ret && QObject::connect(m_currentFrame, SIGNAL(frameSwitched()), this,
                                 SLOT(onFrameSwitched()));
 
+  ret = ret &&
+        QObject::connect(m_currentFrame, SIGNAL(isPlayingStatusChanged()), this,
+                         SLOT(onPlayingStatusChanged()));
+
   ret = ret && QObject::connect(m_currentFrame, SIGNAL(frameSwitched()), this,
                                 SLOT(onImageChanged()));
 
@@ -225,6 +239,11 @@ TApp::~TApp() {}
 //-----------------------------------------------------------------------------
 
 void TApp::init() {
+  ImagePrefetcher *prefetcher = ImagePrefetcher::instance();
+  prefetcher->setEnabled(EnvPlaybackPrefetch != 0);
+  prefetcher->setLookAhead(EnvPlaybackPrefetchFrames);
+  prefetcher->setMemoryBudget(EnvPlaybackPrefetchMemory);
+
   m_isStarting = true;
   IoCmd::newScene();
   m_currentColumn->setColumnIndex(0);
@@ -430,6 +449,8 @@ void TApp::updateCurrentFrame() {
 //-----------------------------------------------------------------------------
 
 void TApp::onSceneSwitched() {
+  ImagePrefetcher::instance()->cancel();
+
   // update XSheet
   m_currentXsheet->setXsheet(m_currentScene->getScene()->getXsheet());
 
@@ -494,6 +515,17 @@ void TApp::onXsheetSoundChanged() {
 void TApp::onFrameSwitched() {
   updateXshLevel();
   int row = m_currentFrame->getFrameIndex();
+
+  // Load the next frames in the direction of playback or scrubbing
+  if (m_currentFrame->isEditingScene()) {
+    if (row != m_prefetchRow)
+      m_prefetchDirection = (row > m_prefetchRow) ? 1 : -1;
+    m_prefetchRow = row;
+
+    ImagePrefetcher::instance()->prefetch(m_currentXsheet->getXsheet(), row,
+                                          m_prefetchDirection);
+  }
+
   TCellSelection *sel =
       dynamic_cast<TCellSelection *>(TSelection::getCurrent());
 
@@ -505,6 +537,12 @@ void TApp::onFrameSwitched() {
 
 //-----------------------------------------------------------------------------
 
+void TApp::onPlayingStatusChanged() {
+  ImagePrefetcher::instance()->setPlaying(m_currentFrame->isPlaying());
+}
+
+//-----------------------------------------------------------------------------
+
 void TApp::onFxSwitched() {
   //  if(m_currentFx->getFx() != 0)
   //    m_currentTool->setTool(T_Edit);
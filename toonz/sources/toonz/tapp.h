@@ -94,6 +94,9 @@ class TApp final : public QObject,
   bool m_isStarting;
   bool m_isPenCloseToTablet;
 
+  int m_prefetchRow;        //!< Last row passed to the ImagePrefetcher
+  int m_prefetchDirection;  //!< Last play/scrub direction
+
 public:
   /*!
           A static pointer to the main application.
@@ -222,6 +225,7 @@ protected slots:
   void onXsheetSwitched();
   void onXsheetSoundChanged();
   void onFrameSwitched();
+  void onPlayingStatusChanged();
   void onFxSwitched();
   void onColumnIndexSwitched();
   void onXshLevelSwitched(TXshLevel *);
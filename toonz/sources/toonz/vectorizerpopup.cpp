@@ -46,6 +46,7 @@
 #include "tcolorstyles.h"
 #include "tstroke.h"
 #include "tpersistset.h"
+#include "tthread.h"
 #include "columncommand.h"
 
 // Qt includes
@@ -63,6 +64,12 @@
 #include <QAction>
 #include <QMainWindow>
 #include <QToolButton>
+#include <QMutex>
+#include <QWaitCondition>
+
+// STD includes
+#include <deque>
+#include <memory>
 
 using namespace DVGui;
 
@@ -202,6 +209,78 @@ void replaceMyPaintBrushStyles(TPalette *palette) {
   }
 }
 
+//=============================================================================
+
+//! A frame vectorized in parallel with others.
+struct VectorizedFrame {
+  TFrameId m_fid;
+  TImageP m_img;
+  CenterlineConfiguration m_conf;
+
+  TVectorImageP m_result;
+  bool m_done;
+
+public:
+  VectorizedFrame(const TFrameId &fid, const TImageP &img,
+                  const CenterlineConfiguration &conf)
+      : m_fid(fid), m_img(img), m_conf(conf), m_done(false) {}
+};
+
+typedef std::shared_ptr<VectorizedFrame> VectorizedFrameP;
+
+//=============================================================================
+
+//! Frames vectorized in parallel, waiting to be committed in order.
+struct VectorizedFrames {
+  QMutex m_mutex;
+  QWaitCondition m_frameDone;
+
+  std::deque<VectorizedFrameP> m_frames;
+
+public:
+  //! Waits for the first frame to be vectorized, and returns it.
+  VectorizedFrameP takeNext() {
+    VectorizedFrameP frame = m_frames.front();
+    m_frames.pop_front();
+
+    QMutexLocker locker(&m_mutex);
+    while (!frame->m_done) m_frameDone.wait(&m_mutex);
+
+    return frame;
+  }
+};
+
+//=============================================================================
+
+class VectorizeFrameTask final : public TThread::Runnable {
+  Vectorizer *m_vectorizer;
+  TPalette *m_palette;
+  VectorizedFrames *m_frames;
+  VectorizedFrameP m_frame;
+
+public:
+  VectorizeFrameTask(Vectorizer *vectorizer, TPalette *palette,
+                     VectorizedFrames *frames, const VectorizedFrameP &frame)
+      : m_vectorizer(vectorizer)
+      , m_palette(palette)
+      , m_frames(frames)
+      , m_frame(frame) {}
+
+  void run() override {
+    TVectorImageP vi;
+    if (!m_vectorizer->isCanceled())
+      vi = m_vectorizer->doVectorize(m_frame->m_img, m_palette,
+                                     m_frame->m_conf);
+    m_frame->m_img = TImageP();
+
+    QMutexLocker locker(&m_frames->m_mutex);
+
+    m_frame->m_result = vi;
+    m_frame->m_done   = true;
+    m_frames->m_frameDone.wakeAll();
+  }
+};
+
 }  // namespace
 
 //*****************************************************************************
@@ -352,6 +431,29 @@ int Vectorizer::doVectorize() {
 
   int count = 0;
 
+  auto commitFrame = [&](const TFrameId &frameId, const TVectorImageP &vi) {
+    TFrameId fid = frameId;
+
+    if (fid.getNumber() < 0) fid = TFrameId(1, frameId.getLetter());
+
+    m_vLevel->setFrame(fid, vi);
+    vi->setPalette(m_vLevel->getPalette());
+
+    emit frameDone(++count);
+  };
+
+  // Frames are vectorized in parallel, unless the output palette may be
+  // extended with the colors found in the images (outline mode, fullcolor and
+  // naa sources) - style ids would then depend on the frames completion order.
+  // Frames are committed to the output level in order anyway.
+  bool parallelFrames = !m_params.m_isOutline && !m_params.m_cNaaSource &&
+                        sl->getType() == TZP_XSHLEVEL;
+  int threadsCount = TSystem::getProcessorCount();
+
+  VectorizedFrames frames;
+  TThread::Executor executor;
+  executor.setMaxActiveTasks(threadsCount);
+
   std::vector<TFrameId>::const_iterator ft, fEnd = m_fids.end();
   for (ft = m_fids.begin(); ft != fEnd; ++ft) {
     // Retrieve the image to be vectorized
@@ -390,22 +492,33 @@ int Vectorizer::doVectorize() {
     emit frameName(labelName);
 
     // Perform vectorization
-    if (TVectorImageP vi =
-            doVectorize(img, m_vLevel->getPalette(), configuration)) {
-      TFrameId fid = *ft;
-
-      if (fid.getNumber() < 0) fid = TFrameId(1, ft->getLetter());
-
-      m_vLevel->setFrame(fid, vi);
-      vi->setPalette(m_vLevel->getPalette());
-
-      emit frameDone(++count);
-    }
+    if (parallelFrames) {
+      VectorizedFrameP frame(new VectorizedFrame(*ft, img, locals.m_cConf));
+      img = TImageP();
+
+      frames.m_frames.push_back(frame);
+      executor.addTask(new VectorizeFrameTask(this, m_vLevel->getPalette(),
+                                              &frames, frame));
+
+      // Bound the frames in memory
+      while ((int)frames.m_frames.size() >= 2 * threadsCount) {
+        VectorizedFrameP done = frames.takeNext();
+        if (done->m_result) commitFrame(done->m_fid, done->m_result);
+      }
+    } else if (TVectorImageP vi =
+                   doVectorize(img, m_vLevel->getPalette(), configuration))
+      commitFrame(*ft, vi);
 
     // Stop if canceled
     if (m_isCanceled) break;
   }
 
+  // Tasks started after a cancel return immediately
+  while (!frames.m_frames.empty()) {
+    VectorizedFrameP done = frames.takeNext();
+    if (done->m_result) commitFrame(done->m_fid, done->m_result);
+  }
+
   m_dialogShown = false;
 
   return count;
@@ -290,6 +290,12 @@ public:
     return m_isCanceled;
   }  //!< Tells whether vectorization was canceled.
 
+  //! Makes connections to low-level partial progress signals and cancel slots,
+  //! and invokes the low-level vectorization of \b img. Different frames may
+  //! be vectorized at the same time.
+  TVectorImageP doVectorize(TImageP img, TPalette *palette,
+                            const VectorizerConfiguration &conf);
+
 signals:
 
   //! Frame name is emitted at beginning of a frame vectorization
@@ -333,11 +339,6 @@ private:
 
 private:
   int doVectorize();  //!< Start vectorization of input frames.
-
-  //! Makes connections to low-level partial progress signals and cancel slots,
-  //! and invokes the low-level vectorization of \b img.
-  TVectorImageP doVectorize(TImageP img, TPalette *palette,
-                            const VectorizerConfiguration &conf);
 };
 
 #endif  // VECTORIZERPOPUP_H
@@ -7,11 +7,15 @@
 #undef TFARMAPI
 #endif
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "texception.h"
 
+#include <QMutex>
+#include <QElapsedTimer>
+
 #ifdef _WIN32
 #ifdef TFARM_EXPORTS
 #define TFARMAPI __declspec(dllexport)
@@ -22,8 +26,17 @@
 #define TFARMAPI
 #endif
 
+class TTcpIpConnection;
+
 //------------------------------------------------------------------------------
 
+/*
+  Requests are sent on a persistent connection using the binary protocol,
+  which is opened on the first request. Stubs that refuse it are sent each
+  request on a new connection, using the text protocol - and are asked
+  again for a binary connection after BinaryProtocolRetryTime.
+*/
+
 class TFARMAPI TFarmProxy {
 public:
   TFarmProxy(const QString &hostName, const QString &addr, int port)
@@ -32,12 +45,28 @@ public:
   virtual ~TFarmProxy() {}
 
   QString sendToStub(const QString &data);
+
+  // sends the requests all together, when the stub supports it
+  void sendToStub(const std::vector<QString> &data,
+                  std::vector<QString> &replies);
+
   static int extractArgs(const QString &s, std::vector<QString> &argv);
 
 protected:
   QString m_hostName;
   QString m_addr;
   int m_port;
+
+private:
+  QMutex m_mutex;
+  std::shared_ptr<TTcpIpConnection> m_connection;
+
+  // started when the stub refuses the binary protocol
+  QElapsedTimer m_textProtocolTimer;
+  static const qint64 BinaryProtocolRetryTime = 60000;  // msecs
+
+  std::shared_ptr<TTcpIpConnection> getConnection();
+  void dropConnection(const std::shared_ptr<TTcpIpConnection> &connection);
 };
 
 //------------------------------------------------------------------------------
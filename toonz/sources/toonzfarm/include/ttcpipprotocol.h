@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef TTCPIPPROTOCOL_H
+#define TTCPIPPROTOCOL_H
+
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+/*
+  Binary protocol used on persistent farm connections.
+
+  A client opens the connection sending the handshake, which is a valid
+  text protocol request: servers that understand it answer with the
+  HandshakeReply magic and keep the connection open, older ones reply to an
+  unknown command and close it - so that the client can fall back to the
+  text protocol (one connection per request).
+
+  Then every message is a frame:
+
+    [uint32 size][uint8 type][uint32 requestId][body]
+
+  integers in network byte order, size counting type, requestId and body.
+  A Request body is the same comma separated text sent by the text protocol;
+  a Batch body is a uint32 count followed by that many [uint32 size][text]
+  strings. Replies have the type and requestId of their request, and are
+  sent in the order the requests were received - so clients can send
+  several requests before reading the replies.
+*/
+
+namespace TTcpIpProtocol {
+
+const char Handshake[]    = "#$#THS01.0017#$#THEuseBinaryProtocol";
+const int HandshakeLength = sizeof(Handshake) - 1;
+
+const char HandshakeReply[]    = "#$#TBP02";
+const int HandshakeReplyLength = sizeof(HandshakeReply) - 1;
+
+// frames exceeding this size are considered a protocol error
+const unsigned int MaxFrameSize = 64 << 20;
+
+// msecs a client waits for a reply before dropping the connection
+const int ReplyTimeout = 60000;
+
+enum FrameType { Request = 1, Batch = 2 };
+
+// return false if the connection has been closed or an error occurred
+bool sendAll(int sock, const char *buff, int size);
+bool recvAll(int sock, char *buff, int size);
+
+bool writeFrame(int sock, int type, unsigned int requestId,
+                const std::string &body);
+bool readFrame(int sock, int &type, unsigned int &requestId,
+               std::string &body);
+
+void encodeStrings(const std::vector<std::string> &strings, std::string &body);
+bool decodeStrings(const std::string &body, std::vector<std::string> &strings);
+
+}  // namespace TTcpIpProtocol
+
+#endif
@@ -14,6 +14,49 @@ namespace {
 
 //------------------------------------------------------------------------------
 
+void parseTaskInfo(const QString &reply, TFarmTask &task) {
+  // la stringa restituita contiene le informazioni desiderate separate da ","
+  std::vector<QString> argv;
+  int count = TFarmProxy::extractArgs(reply, argv);
+
+  if (reply == "") return;
+
+  assert(argv.size() > 15);
+  int incr    = 0;
+  task.m_name = argv[incr++];
+  task.parseCommandLine(argv[incr++]);
+  task.m_priority = argv[incr++].toInt();
+
+  task.m_user     = argv[incr++];
+  task.m_hostName = argv[incr++];
+
+  task.m_id       = argv[incr++];
+  task.m_parentId = argv[incr++];
+
+  task.m_status = (TaskState)argv[incr++].toInt();
+
+  task.m_server         = argv[incr++];
+  task.m_submissionDate = QDateTime::fromString(argv[incr++]);
+  task.m_startDate      = QDateTime::fromString(argv[incr++]);
+  task.m_completionDate = QDateTime::fromString(argv[incr++]);
+
+  task.m_successfullSteps = argv[incr++].toInt();
+  task.m_failedSteps      = argv[incr++].toInt();
+  task.m_stepCount        = argv[incr++].toInt();
+
+  if (incr < count) {
+    task.m_platform = (TFarmPlatform)argv[incr++].toInt();
+    int depCount    = 0;
+    depCount        = argv[incr++].toInt();
+    if (depCount > 0) {
+      task.m_dependencies = new TFarmTask::Dependencies;
+      for (int i = 0; i < depCount; ++i) task.m_dependencies->add(argv[incr++]);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
 class Controller final : public TFarmController, public TFarmProxy {
 public:
   Controller(const QString &hostName, const QString &addr, int port)
@@ -35,6 +78,9 @@ public:
 
   void queryTaskInfo(const QString &id, TFarmTask &task) override;
 
+  void queryTaskInfo(const std::vector<QString> &ids,
+                     std::vector<TFarmTask> &tasks) override;
+
   void queryTaskShortInfo(const QString &id, QString &parentId, QString &name,
                           TaskState &status) override;
 
@@ -49,6 +95,8 @@ public:
   void taskProgress(const QString &taskId, int step, int stepCount,
                     int frameNumber, FrameState state) override;
 
+  int queryTaskRangeEnd(const QString &taskId) override;
+
   void taskCompleted(const QString &taskId, int exitCode) override;
 
   // fills the servers vector with the names of the servers
@@ -232,46 +280,23 @@ void Controller::queryTaskInfo(const QString &id, TFarmTask &task) {
   data += ",";
   data += id;
 
-  QString reply = sendToStub(data);
-
-  // la stringa restituita contiene le informazioni desiderate separate da ","
-  std::vector<QString> argv;
-  int count = extractArgs(reply, argv);
-
-  if (reply == "") return;
-
-  assert(argv.size() > 15);
-  int incr    = 0;
-  task.m_name = argv[incr++];
-  task.parseCommandLine(argv[incr++]);
-  task.m_priority = argv[incr++].toInt();
-
-  task.m_user     = argv[incr++];
-  task.m_hostName = argv[incr++];
+  parseTaskInfo(sendToStub(data), task);
+}
 
-  task.m_id       = argv[incr++];
-  task.m_parentId = argv[incr++];
+//------------------------------------------------------------------------------
 
-  task.m_status = (TaskState)argv[incr++].toInt();
+void Controller::queryTaskInfo(const std::vector<QString> &ids,
+                               std::vector<TFarmTask> &tasks) {
+  std::vector<QString> data, replies;
 
-  task.m_server         = argv[incr++];
-  task.m_submissionDate = QDateTime::fromString(argv[incr++]);
-  task.m_startDate      = QDateTime::fromString(argv[incr++]);
-  task.m_completionDate = QDateTime::fromString(argv[incr++]);
+  std::vector<QString>::const_iterator it;
+  for (it = ids.begin(); it != ids.end(); ++it)
+    data.push_back(QString("queryTaskInfo_2,") + *it);
 
-  task.m_successfullSteps = argv[incr++].toInt();
-  task.m_failedSteps      = argv[incr++].toInt();
-  task.m_stepCount        = argv[incr++].toInt();
+  sendToStub(data, replies);
 
-  if (incr < count) {
-    task.m_platform = (TFarmPlatform)argv[incr++].toInt();
-    int depCount    = 0;
-    depCount        = argv[incr++].toInt();
-    if (depCount > 0) {
-      task.m_dependencies = new TFarmTask::Dependencies;
-      for (int i = 0; i < depCount; ++i) task.m_dependencies->add(argv[incr++]);
-    }
-  }
+  tasks.resize(ids.size());
+  for (int i = 0; i < (int)ids.size(); ++i) parseTaskInfo(replies[i], tasks[i]);
 }
 
 //------------------------------------------------------------------------------
@@ -358,6 +383,21 @@ void Controller::taskProgress(const QString &taskId, int step, int stepCount,
 
 //------------------------------------------------------------------------------
 
+int Controller::queryTaskRangeEnd(const QString &taskId) {
+  QString data("queryTaskRangeEnd");
+  data += ",";
+  data += taskId;
+
+  QString reply = sendToStub(data);
+
+  // controllers that do not resize tasks reply with an empty string
+  bool ok;
+  int rangeEnd = reply.toInt(&ok);
+  return (ok && rangeEnd > 0) ? rangeEnd : -1;
+}
+
+//------------------------------------------------------------------------------
+
 void Controller::taskCompleted(const QString &taskId, int exitCode) {
   QString data("taskCompleted");
   data += ",";
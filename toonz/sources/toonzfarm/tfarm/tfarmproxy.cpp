@@ -4,10 +4,60 @@
 #include "tfarmproxy.h"
 #include "ttcpip.h"
 #include <QStringList>
+#include <QMutexLocker>
+
+//------------------------------------------------------------------------------
+
+std::shared_ptr<TTcpIpConnection> TFarmProxy::getConnection() {
+  QMutexLocker sl(&m_mutex);
+
+  // stubs that failed the handshake are asked again after a while - they
+  // may have been updated, or just been too busy to open a session
+  if (m_textProtocolTimer.isValid()) {
+    if (!m_textProtocolTimer.hasExpired(BinaryProtocolRetryTime))
+      return std::shared_ptr<TTcpIpConnection>();
+    m_textProtocolTimer.invalidate();
+  }
+
+  // the stub may have been restarted since the last request
+  if (m_connection && m_connection->isConnected()) return m_connection;
+
+  std::shared_ptr<TTcpIpConnection> connection(new TTcpIpConnection);
+  int ret = connection->connect(m_hostName, m_addr, m_port);
+  if (ret == PROTOCOL_UNSUPPORTED) {
+    m_textProtocolTimer.start();
+    m_connection.reset();
+  } else if (ret != OK) {
+    m_connection.reset();
+    throw CantConnectToStub(m_hostName, m_addr, m_port);
+  } else
+    m_connection = connection;
+
+  return m_connection;
+}
+
+//------------------------------------------------------------------------------
+
+void TFarmProxy::dropConnection(
+    const std::shared_ptr<TTcpIpConnection> &connection) {
+  QMutexLocker sl(&m_mutex);
+  if (m_connection == connection) m_connection.reset();
+}
 
 //------------------------------------------------------------------------------
 
 QString TFarmProxy::sendToStub(const QString &data) {
+  std::shared_ptr<TTcpIpConnection> connection = getConnection();
+  if (connection) {
+    QString reply;
+    if (connection->send(data, reply) != OK) {
+      dropConnection(connection);
+      throw CantConnectToStub(m_hostName, m_addr, m_port);
+    }
+
+    return reply;
+  }
+
   TTcpIpClient client;
 
   int sock;
@@ -29,6 +79,27 @@ QString TFarmProxy::sendToStub(const QString &data) {
 
 //------------------------------------------------------------------------------
 
+void TFarmProxy::sendToStub(const std::vector<QString> &data,
+                            std::vector<QString> &replies) {
+  std::shared_ptr<TTcpIpConnection> connection = getConnection();
+  if (connection) {
+    if (connection->sendBatch(data, replies) != OK) {
+      dropConnection(connection);
+      throw CantConnectToStub(m_hostName, m_addr, m_port);
+    }
+
+    return;
+  }
+
+  replies.clear();
+
+  std::vector<QString>::const_iterator it;
+  for (it = data.begin(); it != data.end(); ++it)
+    replies.push_back(sendToStub(*it));
+}
+
+//------------------------------------------------------------------------------
+
 int TFarmProxy::extractArgs(const QString &s, std::vector<QString> &argv) {
   argv.clear();
   if (s == "") return 0;
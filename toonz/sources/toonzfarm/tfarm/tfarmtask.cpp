@@ -8,6 +8,7 @@
 // TnzCore includes
 #include "tconvert.h"
 #include "texception.h"
+#include "tfilepath_io.h"
 #include "tstream.h"
 #include "tsystem.h"
 #include "tutil.h"
@@ -16,6 +17,9 @@
 #include <QStringList>
 #include <QSettings>
 
+// STD includes
+#include <algorithm>
+
 // MACOSX includes
 #ifdef _WIN32
 #include <winsock.h>
@@ -602,6 +606,41 @@ QString TFarmTask::getCommandLine(bool) const {
 
 namespace {
 
+// The tail of a running task is taken by an idle server only if it would take
+// at least this time, so that the start-up of the new task pays off
+const double minStealSeconds = 60.0;
+const int minStealFrames     = 4;
+
+}  // namespace
+
+int TFarmTask::getStealableFrames(double secondsPerFrame) const {
+  // the render speed is unknown until some frame is done
+  int doneFrames = m_successfullSteps + m_failedSteps;
+  if (doneFrames == 0 || m_step <= 0) return 0;
+
+  int remainingFrames = getFrameCount() - doneFrames;
+  if (remainingFrames < 2 * minStealFrames) return 0;
+
+  // the second half of the remaining frames is taken
+  int stolenFrames = remainingFrames / 2;
+  return (stolenFrames * secondsPerFrame > minStealSeconds) ? stolenFrames : 0;
+}
+
+//------------------------------------------------------------------------------
+
+bool TFarmTask::splitRange(int keptFrames, int &from, int &to) {
+  from = m_from + keptFrames * m_step, to = m_to;
+  if (keptFrames < 1 || from > to) return false;
+
+  m_to        = from - m_step;
+  m_stepCount = getFrameCount();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+namespace {
+
 class TFarmTaskDeclaration final : public TPersistDeclaration {
 public:
   TFarmTaskDeclaration(const std::string &id) : TPersistDeclaration(id) {}
@@ -829,3 +868,29 @@ public:
 const TPersistDeclaration *TFarmTaskGroup::getDeclaration() const {
   return &FarmTaskGroupDeclaration;
 }
+
+//*************************************************************************
+//    TFarmTaskIds  implementation
+//*************************************************************************
+
+TFarmTaskIds::TFarmTaskIds(const TFilePath &fp) : m_fp(fp), m_next(0) {}
+
+//------------------------------------------------------------------------------
+
+void TFarmTaskIds::load() {
+  Tifstream is(m_fp);
+  if (is.good()) is >> m_next;
+}
+
+//------------------------------------------------------------------------------
+
+void TFarmTaskIds::save() const {
+  Tofstream os(m_fp);
+  if (os.good()) os << m_next;
+}
+
+//------------------------------------------------------------------------------
+
+void TFarmTaskIds::skip(const TFarmTask::Id &id) {
+  m_next = std::max(m_next, id.section('.', 0, 0).toInt() + 1);
+}
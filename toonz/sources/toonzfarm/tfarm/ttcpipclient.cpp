@@ -1,8 +1,14 @@
 
 
 #include "ttcpip.h"
+#include "ttcpipprotocol.h"
 #include "tconvert.h"
 
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <map>
+
 #ifdef _WIN32
 #include <winsock2.h>
 #else
@@ -14,7 +20,9 @@
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <poll.h>
 #endif
 
 #ifndef _WIN32
@@ -366,3 +374,239 @@ int TTcpIpClient::send(int sock, const std::string &data, string &reply)
   return ret;
 }
 */
+
+//==============================================================================
+
+class TTcpIpConnectionImp {
+public:
+  TTcpIpConnectionImp() : m_sock(-1), m_lastRequestId(0) {}
+
+  int post(int type, const std::string &body, unsigned int &requestId);
+  int receive(unsigned int requestId, std::string &body);
+
+  int m_sock;
+  unsigned int m_lastRequestId;
+
+  QMutex m_sendMutex, m_receiveMutex;
+
+  // replies read while waiting for the one of another request
+  std::map<unsigned int, std::string> m_replies;
+};
+
+//------------------------------------------------------------------------------
+
+int TTcpIpConnectionImp::post(int type, const std::string &body,
+                              unsigned int &requestId) {
+  QMutexLocker sl(&m_sendMutex);
+  if (m_sock == -1) return SEND_FAILED;
+
+  requestId = ++m_lastRequestId;
+  return TTcpIpProtocol::writeFrame(m_sock, type, requestId, body)
+             ? OK
+             : SEND_FAILED;
+}
+
+//------------------------------------------------------------------------------
+
+int TTcpIpConnectionImp::receive(unsigned int requestId, std::string &body) {
+  QMutexLocker sl(&m_receiveMutex);
+
+  std::map<unsigned int, std::string>::iterator it = m_replies.find(requestId);
+  if (it != m_replies.end()) {
+    body.swap(it->second);
+    m_replies.erase(it);
+    return OK;
+  }
+
+  if (m_sock == -1) return RECEIVE_FAILED;
+
+  int type;
+  unsigned int id;
+  std::string reply;
+  while (TTcpIpProtocol::readFrame(m_sock, type, id, reply)) {
+    if (id == requestId) {
+      body.swap(reply);
+      return OK;
+    }
+    m_replies[id].swap(reply);
+  }
+
+  // the stream may have been left in the middle of a frame (eg on a timeout):
+  // the connection can't be used anymore
+  ::shutdown(m_sock, 2);
+  return RECEIVE_FAILED;
+}
+
+//------------------------------------------------------------------------------
+
+static void setReceiveTimeout(int sock, int msecs) {
+#ifdef _WIN32
+  DWORD timeout = msecs;
+#else
+  struct timeval timeout = {msecs / 1000, (msecs % 1000) * 1000};
+#endif
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout,
+             sizeof timeout);
+}
+
+//------------------------------------------------------------------------------
+
+TTcpIpConnection::TTcpIpConnection() : m_imp(new TTcpIpConnectionImp) {
+#ifdef _WIN32
+  WSADATA wsaData;
+  WORD wVersionRequested = MAKEWORD(1, 1);
+  WSAStartup(wVersionRequested, &wsaData);
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+TTcpIpConnection::~TTcpIpConnection() {
+  disconnect();
+#ifdef _WIN32
+  WSACleanup();
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+int TTcpIpConnection::connect(const QString &name, const QString &addr,
+                              int port) {
+  using namespace TTcpIpProtocol;
+
+  disconnect();
+
+  TTcpIpClient client;
+
+  int sock;
+  int ret = client.connect(name, addr, port, sock);
+  if (ret != OK) return ret;
+
+  // requests are small and sent without waiting for the previous replies:
+  // they must not be delayed to be coalesced
+  int noDelay = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay,
+             sizeof noDelay);
+
+  // older servers reply to the handshake as to an unknown text request;
+  // the timeout covers the ones that do not reply at all
+  setReceiveTimeout(sock, 10000);
+
+  char reply[HandshakeReplyLength];
+  if (!sendAll(sock, Handshake, HandshakeLength) ||
+      !recvAll(sock, reply, HandshakeReplyLength)) {
+    client.disconnect(sock);
+    return PROTOCOL_UNSUPPORTED;
+  }
+
+  if (memcmp(reply, HandshakeReply, HandshakeReplyLength) != 0) {
+    client.disconnect(sock);
+    return PROTOCOL_UNSUPPORTED;
+  }
+
+  // a peer that stops replying must not block the requesting threads forever
+  setReceiveTimeout(sock, ReplyTimeout);
+
+  QMutexLocker ssl(&m_imp->m_sendMutex);
+  QMutexLocker rsl(&m_imp->m_receiveMutex);
+  m_imp->m_sock = sock;
+  return OK;
+}
+
+//------------------------------------------------------------------------------
+
+void TTcpIpConnection::disconnect() {
+  QMutexLocker ssl(&m_imp->m_sendMutex);
+  if (m_imp->m_sock == -1) return;
+
+  // threads waiting for a reply are woken up by the shutdown
+  ::shutdown(m_imp->m_sock, 2);
+
+  QMutexLocker rsl(&m_imp->m_receiveMutex);
+  TTcpIpClient().disconnect(m_imp->m_sock);
+  m_imp->m_sock = -1;
+  m_imp->m_replies.clear();
+}
+
+//------------------------------------------------------------------------------
+
+bool TTcpIpConnection::isConnected() const {
+  QMutexLocker sl(&m_imp->m_sendMutex);
+  int sock = m_imp->m_sock;
+  if (sock == -1) return false;
+
+  // a closed connection is readable, with no data to read
+#ifdef _WIN32
+  // winsock fd_sets are socket lists, not limited by the socket values
+  fd_set readSet;
+  FD_ZERO(&readSet);
+  FD_SET(sock, &readSet);
+
+  struct timeval timeout = {0, 0};
+  if (select(sock + 1, &readSet, 0, 0, &timeout) <= 0) return true;
+#else
+  struct pollfd pfd;
+  pfd.fd      = sock;
+  pfd.events  = POLLIN;
+  pfd.revents = 0;
+  if (poll(&pfd, 1, 0) <= 0) return true;
+#endif
+
+  char c;
+  return recv(sock, &c, 1, MSG_PEEK) > 0;
+}
+
+//------------------------------------------------------------------------------
+
+int TTcpIpConnection::post(const QString &data, unsigned int &requestId) {
+  return m_imp->post(TTcpIpProtocol::Request, data.toUtf8().toStdString(),
+                     requestId);
+}
+
+//------------------------------------------------------------------------------
+
+int TTcpIpConnection::receive(unsigned int requestId, QString &reply) {
+  std::string body;
+  int ret = m_imp->receive(requestId, body);
+  if (ret == OK) reply = QString::fromUtf8(body.data(), body.size());
+  return ret;
+}
+
+//------------------------------------------------------------------------------
+
+int TTcpIpConnection::send(const QString &data, QString &reply) {
+  unsigned int requestId;
+  int ret = post(data, requestId);
+  if (ret == OK) ret = receive(requestId, reply);
+  return ret;
+}
+
+//------------------------------------------------------------------------------
+
+int TTcpIpConnection::sendBatch(const std::vector<QString> &data,
+                                std::vector<QString> &replies) {
+  replies.clear();
+
+  std::vector<std::string> strings;
+  std::vector<QString>::const_iterator it;
+  for (it = data.begin(); it != data.end(); ++it)
+    strings.push_back(it->toUtf8().toStdString());
+
+  std::string body;
+  TTcpIpProtocol::encodeStrings(strings, body);
+
+  unsigned int requestId;
+  int ret = m_imp->post(TTcpIpProtocol::Batch, body, requestId);
+  if (ret == OK) ret = m_imp->receive(requestId, body);
+  if (ret != OK) return ret;
+
+  if (!TTcpIpProtocol::decodeStrings(body, strings) ||
+      strings.size() != data.size())
+    return RECEIVE_FAILED;
+
+  std::vector<std::string>::iterator st;
+  for (st = strings.begin(); st != strings.end(); ++st)
+    replies.push_back(QString::fromUtf8(st->data(), st->size()));
+
+  return OK;
+}
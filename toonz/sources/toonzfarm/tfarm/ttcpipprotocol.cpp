@@ -0,0 +1,150 @@
+
+
+#include "ttcpipprotocol.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+void putUInt32(std::string &s, unsigned int v) {
+  v = htonl(v);
+  s.append((const char *)&v, 4);
+}
+
+//------------------------------------------------------------------------------
+
+unsigned int getUInt32(const char *buff) {
+  unsigned int v;
+  memcpy(&v, buff, 4);
+  return ntohl(v);
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+
+bool TTcpIpProtocol::sendAll(int sock, const char *buff, int size) {
+  while (size > 0) {
+    // a peer closing the connection must not raise SIGPIPE
+    int ret = ::send(sock, buff, size, MSG_NOSIGNAL);
+    if (ret <= 0) {
+#ifndef _WIN32
+      if (ret < 0 && errno == EINTR) continue;
+#endif
+      return false;
+    }
+    buff += ret;
+    size -= ret;
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool TTcpIpProtocol::recvAll(int sock, char *buff, int size) {
+  while (size > 0) {
+    int ret = ::recv(sock, buff, size, 0);
+    if (ret <= 0) {
+#ifndef _WIN32
+      if (ret < 0 && errno == EINTR) continue;
+#endif
+      return false;
+    }
+    buff += ret;
+    size -= ret;
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool TTcpIpProtocol::writeFrame(int sock, int type, unsigned int requestId,
+                                const std::string &body) {
+  // header and body are sent together, to save a packet on small requests
+  std::string frame;
+  frame.reserve(body.size() + 9);
+  putUInt32(frame, body.size() + 5);
+  frame.push_back((char)type);
+  putUInt32(frame, requestId);
+  frame += body;
+
+  return sendAll(sock, frame.data(), frame.size());
+}
+
+//------------------------------------------------------------------------------
+
+bool TTcpIpProtocol::readFrame(int sock, int &type, unsigned int &requestId,
+                               std::string &body) {
+  char header[9];
+  if (!recvAll(sock, header, 9)) return false;
+
+  unsigned int size = getUInt32(header);
+  if (size < 5 || size > MaxFrameSize) return false;
+
+  type      = (unsigned char)header[4];
+  requestId = getUInt32(header + 5);
+
+  body.resize(size - 5);
+  return body.empty() || recvAll(sock, &body[0], body.size());
+}
+
+//------------------------------------------------------------------------------
+
+void TTcpIpProtocol::encodeStrings(const std::vector<std::string> &strings,
+                                   std::string &body) {
+  body.clear();
+  putUInt32(body, strings.size());
+
+  std::vector<std::string>::const_iterator it;
+  for (it = strings.begin(); it != strings.end(); ++it) {
+    putUInt32(body, it->size());
+    body += *it;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+bool TTcpIpProtocol::decodeStrings(const std::string &body,
+                                   std::vector<std::string> &strings) {
+  strings.clear();
+  if (body.size() < 4) return false;
+
+  const char *p = body.data(), *end = p + body.size();
+
+  unsigned int count = getUInt32(p);
+  p += 4;
+
+  // each string takes at least its size
+  if (count > (unsigned int)(end - p) / 4) return false;
+
+  strings.reserve(count);
+  for (unsigned int i = 0; i < count; ++i) {
+    if (end - p < 4) return false;
+
+    unsigned int size = getUInt32(p);
+    p += 4;
+    if (size > (unsigned int)(end - p)) return false;
+
+    strings.push_back(std::string(p, size));
+    p += size;
+  }
+
+  return p == end;
+}
@@ -1,6 +1,7 @@
 
 
 #include "ttcpip.h"
+#include "ttcpipprotocol.h"
 #include "tconvert.h"
 
 #ifdef _WIN32
@@ -14,6 +15,7 @@
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #endif
 
@@ -24,11 +26,13 @@
 #endif
 
 #include <string>
+#include <map>
+#include <atomic>
 using namespace std;
 
 #define MAXHOSTNAME 1024
 
-int establish(unsigned short portnum, int &sock);
+int establish(unsigned short &portnum, int &sock);
 int get_connection(int s);
 void fireman(int);
 void do_something(int);
@@ -44,13 +48,19 @@ public:
   TTcpIpServerImp(int port) : m_port(port), m_s(-1), m_server(0) {}
 
   int readData(int sock, QString &data);
-  void onReceive(int sock, const QString &data);
+
+  // if reply is specified, the reply to the request is stored there instead
+  // of being sent on the socket
+  void onReceive(int sock, const QString &data, QString *reply = 0);
 
   int m_s;  // socket id
-  int m_port;
+  std::atomic<int> m_port;
   TTcpIpServer *m_server;  // back pointer
 
   TThread::Mutex m_mutex;
+
+  // replies of the requests received on binary protocol connections
+  std::map<int, QString *> m_replies;
 };
 
 //---------------------------------------------------------------------
@@ -225,9 +235,12 @@ int TTcpIpServerImp::readData(int sock, string &data) {
 
 //---------------------------------------------------------------------
 
-void TTcpIpServerImp::onReceive(int sock, const QString &data) {
+void TTcpIpServerImp::onReceive(int sock, const QString &data,
+                                QString *reply) {
   QMutexLocker sl(&m_mutex);
+  if (reply) m_replies[sock] = reply;
   m_server->onReceive(sock, data);
+  if (reply) m_replies.erase(sock);
 }
 
 //---------------------------------------------------------------------
@@ -267,6 +280,135 @@ static void shutdown_cb(int) { Sthutdown = true; }
 
 //---------------------------------------------------------------------
 
+// Returns whether the client opened the connection with the binary protocol
+// handshake. Nothing is read, so that text requests can be parsed as usual.
+static bool isBinaryConnection(int sock) {
+  using namespace TTcpIpProtocol;
+
+  // text requests differ from the handshake within its length, which
+  // holds the size of the request. Clients sending a truncated request are
+  // not waited for more than a few seconds.
+  char buff[HandshakeLength];
+  for (int i = 0; i < 5000; ++i) {
+    int cnt = recv(sock, buff, HandshakeLength, MSG_PEEK);
+    if (cnt <= 0 || memcmp(buff, Handshake, cnt) != 0) return false;
+    if (cnt == HandshakeLength) return true;
+
+    QThread::msleep(1);
+  }
+
+  return false;
+}
+
+//---------------------------------------------------------------------
+
+// Binary sessions last as long as their connections, so they run on a
+// bounded pool of their own. When all its threads are busy, further
+// connections are served as text ones: the handshake is replied to as an
+// unknown request, and the client falls back to the text protocol.
+static const int MaxBinarySessions = 16;
+
+static std::atomic<int> BinarySessionsCount(0);
+
+static TThread::Executor &sessionsExecutor() {
+  static TThread::Executor *executor = [] {
+    TThread::Executor *executor = new TThread::Executor;
+    executor->setMaxActiveTasks(MaxBinarySessions);
+    return executor;
+  }();
+
+  return *executor;
+}
+
+// Reserves a thread of the sessions pool, if any is left
+static bool acquireBinarySession() {
+  if (++BinarySessionsCount <= MaxBinarySessions) return true;
+
+  --BinarySessionsCount;
+  return false;
+}
+
+//---------------------------------------------------------------------
+
+// Serves the requests received on a binary protocol connection, until the
+// client closes it. Requests are processed in the order they arrive, and
+// replied to as soon as processed.
+class BinarySession final : public TThread::Runnable {
+public:
+  BinarySession(int clientSocket, std::shared_ptr<TTcpIpServerImp> serverImp)
+      : m_clientSocket(clientSocket), m_serverImp(std::move(serverImp)) {}
+
+  void run() override;
+
+  int m_clientSocket;
+  std::shared_ptr<TTcpIpServerImp> m_serverImp;
+
+private:
+  QString execute(const QString &request);
+};
+
+//---------------------------------------------------------------------
+
+QString BinarySession::execute(const QString &request) {
+  QString reply;
+  if (request == QString("shutdown"))
+    Sthutdown = true;
+  else
+    m_serverImp->onReceive(m_clientSocket, request, &reply);
+  return reply;
+}
+
+//---------------------------------------------------------------------
+
+void BinarySession::run() {
+  using namespace TTcpIpProtocol;
+
+  // replies must not be delayed to be coalesced with the next ones
+  int noDelay = 1;
+  setsockopt(m_clientSocket, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay,
+             sizeof noDelay);
+
+  char handshake[HandshakeLength];
+  if (recvAll(m_clientSocket, handshake, HandshakeLength) &&
+      sendAll(m_clientSocket, HandshakeReply, HandshakeReplyLength)) {
+    int type;
+    unsigned int requestId;
+    std::string body, replyBody;
+
+    while (!Sthutdown && readFrame(m_clientSocket, type, requestId, body)) {
+      if (type == Request) {
+        replyBody = execute(QString::fromUtf8(body.data(), body.size()))
+                        .toUtf8()
+                        .toStdString();
+      } else if (type == Batch) {
+        std::vector<std::string> requests, replies;
+        if (!decodeStrings(body, requests)) break;
+
+        std::vector<std::string>::iterator it;
+        for (it = requests.begin(); it != requests.end(); ++it)
+          replies.push_back(execute(QString::fromUtf8(it->data(), it->size()))
+                                .toUtf8()
+                                .toStdString());
+
+        encodeStrings(replies, replyBody);
+      } else
+        break;
+
+      if (!writeFrame(m_clientSocket, type, requestId, replyBody)) break;
+    }
+  }
+
+#ifdef _WIN32
+  closesocket(m_clientSocket);
+#else
+  close(m_clientSocket);
+#endif
+
+  --BinarySessionsCount;
+}
+
+//---------------------------------------------------------------------
+
 class DataReader final : public TThread::Runnable {
 public:
   DataReader(int clientSocket, std::shared_ptr<TTcpIpServerImp> serverImp)
@@ -279,6 +421,11 @@ public:
 };
 
 void DataReader::run() {
+  if (isBinaryConnection(m_clientSocket) && acquireBinarySession()) {
+    sessionsExecutor().addTask(new BinarySession(m_clientSocket, m_serverImp));
+    return;
+  }
+
   QString data;
   int ret = m_serverImp->readData(m_clientSocket, data);
   if (ret != -1) {
@@ -328,7 +475,9 @@ void TTcpIpServer::run() {
   try {
 #ifdef _WIN32
 
-    int err = establish(m_imp->m_port, m_imp->m_s);
+    unsigned short port = m_imp->m_port;
+    int err             = establish(port, m_imp->m_s);
+    m_imp->m_port       = port;
     if (!err && m_imp->m_s != -1) {
       int t;  // client socket
 
@@ -341,6 +490,11 @@ void TTcpIpServer::run() {
           return;
         }
 
+        if (isBinaryConnection(t) && acquireBinarySession()) {
+          sessionsExecutor().addTask(new BinarySession(t, m_imp));
+          continue;
+        }
+
         QString data;
         int ret = m_imp->readData(t, data);
         if (ret != -1 && data != "") {
@@ -363,7 +517,9 @@ void TTcpIpServer::run() {
 
 #else  // !_WIN32
 
-    int err = establish(m_imp->m_port, m_imp->m_s);
+    unsigned short port = m_imp->m_port;
+    int err             = establish(port, m_imp->m_s);
+    m_imp->m_port       = port;
     if (!err && m_imp->m_s != -1) {
 //      signal(SIGCHLD, fireman);           /* this eliminates zombies */
 
@@ -412,6 +568,16 @@ int TTcpIpServer::getExitCode() const { return m_exitCode; }
 //---------------------------------------------------------------------
 
 void TTcpIpServer::sendReply(int socket, const QString &reply) {
+  {
+    // binary protocol sessions send the reply by themselves
+    QMutexLocker sl(&m_imp->m_mutex);
+    std::map<int, QString *>::iterator it = m_imp->m_replies.find(socket);
+    if (it != m_imp->m_replies.end()) {
+      *it->second = reply;
+      return;
+    }
+  }
+
   string replyUtf8 = reply.toStdString();
 
   QString header("#$#THS01.00");
@@ -444,7 +610,7 @@ void TTcpIpServer::sendReply(int socket, const QString &reply) {
 //---------------------------------------------------------------------
 //---------------------------------------------------------------------
 
-int establish(unsigned short portnum, int &sock) {
+int establish(unsigned short &portnum, int &sock) {
   char myname[MAXHOSTNAME + 1];
   struct sockaddr_in sa;
   struct hostent *hp;
@@ -478,7 +644,20 @@ int establish(unsigned short portnum, int &sock) {
 #endif
   }
 
-  return listen(sock, 3); /* max # of queued connects */
+  int err = listen(sock, 3); /* max # of queued connects */
+
+  // port 0 lets the system choose a free port: read back the assigned one
+  if (!err && portnum == 0) {
+#ifdef _WIN32
+    int len = sizeof(struct sockaddr_in);
+#else
+    socklen_t len = sizeof(struct sockaddr_in);
+#endif
+    if (getsockname(sock, (struct sockaddr *)&sa, &len) == 0)
+      portnum = ntohs(sa.sin_port);
+  }
+
+  return err;
 }
 
 //-----------------------------------------------------------------------
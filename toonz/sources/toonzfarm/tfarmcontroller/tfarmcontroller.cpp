@@ -15,13 +15,17 @@ using namespace TVER;
 #include "tthread.h"
 #include "tstream.h"
 #include "tlog.h"
+#include "tlevel_io.h"
 
 #include <QObject>
 #include <QCoreApplication>
 #include <QEventLoop>
+#include <QTimer>
+#include <QSaveFile>
 
 #include "tthread.h"
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 using namespace std;
@@ -195,28 +199,37 @@ bool isAScript(TFarmTask *task) {
   return false;  // todo per gli script
 }
 
+//-------------------------------------------------------------------
+
+// Composer sub-tasks are resized to take about this time, once the render
+// speed of their parent task has been measured
+const double targetChunkSeconds = 300.0;
+
 }  // anonymous namespace
 
 //==============================================================================
 
 class CtrlFarmTask final : public TFarmTask {
 public:
-  CtrlFarmTask() : m_toBeDeleted(false), m_failureCount(0) {}
+  CtrlFarmTask()
+      : m_toBeDeleted(false), m_failureCount(0), m_secondsPerFrame(0) {}
 
   CtrlFarmTask(const QString &id, const QString &name, const QString &cmdline,
                const QString &user, const QString &host, int stepCount,
                int priority)
       : TFarmTask(id, name, cmdline, user, host, stepCount, priority)
       , m_toBeDeleted(false)
-      , m_failureCount(0) {
+      , m_failureCount(0)
+      , m_secondsPerFrame(0) {
     m_id     = id;
     m_status = Waiting;
   }
 
   CtrlFarmTask(const CtrlFarmTask &rhs) : TFarmTask(rhs) {
-    m_serverId    = rhs.m_serverId;
-    m_subTasks    = rhs.m_subTasks;
-    m_toBeDeleted = rhs.m_toBeDeleted;
+    m_serverId        = rhs.m_serverId;
+    m_subTasks        = rhs.m_subTasks;
+    m_toBeDeleted     = rhs.m_toBeDeleted;
+    m_secondsPerFrame = rhs.m_secondsPerFrame;
   }
 
   // TPersist implementation
@@ -230,6 +243,10 @@ public:
   bool m_toBeDeleted;
   int m_failureCount;
 
+  // measured render time per frame - averaged over the sub-tasks for a
+  // composite task
+  double m_secondsPerFrame;
+
   vector<QString> m_failedOnServers;
 };
 
@@ -573,6 +590,8 @@ public:
     return *this;
   }
 
+  int getSubId() const { return m_subId; }
+
   // operator string() const;
   QString toString() const {
     QString id(QString::number(m_id));
@@ -583,6 +602,336 @@ public:
 
 //==============================================================================
 
+//! Keeps the tasks that can be dispatched indexed, so that choosing the next
+//! one to start does not require scanning the whole task list and resolving
+//! the dependencies of each queued task.
+/*!
+  Every task is indexed with the number of its dependencies that are not
+  completed yet; the counts of the dependent tasks are updated whenever a task
+  enters or leaves the Completed state. Tasks with no pending dependency are
+  kept in per-submitter ready queues, sorted by priority.
+  \n\n
+  Among submitters with ready tasks of the same priority, the one with less
+  running tasks is served first - so that a large submission does not starve
+  the other users of the farm.
+  \n\n
+  The scheduler must be notified through update() of any change to the status
+  or the failure count of a task, and through removeTask() before a task is
+  deleted.
+*/
+
+class TaskScheduler {
+public:
+  TaskScheduler() : m_revision(0) {}
+
+  void addTask(CtrlFarmTask *task);
+  void update(CtrlFarmTask *task);
+  void removeTask(CtrlFarmTask *task);
+  void clear();
+
+  bool dependenciesCompleted(CtrlFarmTask *task) const;
+
+  // returns the sub-task to be started next among the Waiting ones and the
+  // Aborted ones that can be retried
+  CtrlFarmTask *getTaskToStart(FarmServerProxy *server) const;
+
+  // returns the task to be started next among the Waiting ones, except the
+  // specified one
+  CtrlFarmTask *getNextTaskToStart(CtrlFarmTask *except,
+                                   FarmServerProxy *server) const;
+
+  // incremented at each change of the indexed tasks
+  unsigned int getRevision() const { return m_revision; }
+
+private:
+  // ready tasks sorted by decreasing priority, then by id
+  typedef map<std::pair<int, TaskId>, CtrlFarmTask *> ReadyQueue;
+
+  struct Submitter {
+    ReadyQueue m_waiting;  // Waiting sub-tasks
+    ReadyQueue m_retries;  // Aborted sub-tasks that can be retried
+    ReadyQueue m_tasks;    // Waiting top level tasks
+    int m_runningCount;    // running tasks (composite ones excluded)
+
+    Submitter() : m_runningCount(0) {}
+  };
+
+  struct Entry {
+    CtrlFarmTask *m_task;
+    TaskState m_status;   // the status the task is indexed with
+    int m_pendingCount;   // dependencies not completed yet
+    bool m_running;       // whether counted in the submitter's running tasks
+    ReadyQueue *m_queue;  // the ready queue containing the task, if any
+  };
+
+  struct Candidate {
+    CtrlFarmTask *m_task;
+    int m_rank;  // 0 for retried tasks, 1 otherwise
+    int m_runningCount;
+  };
+
+  map<TaskId, Entry> m_entries;
+  map<TaskId, vector<TaskId>> m_dependents;
+  map<QString, Submitter> m_submitters;
+  unsigned int m_revision;
+
+private:
+  static std::pair<int, TaskId> queueKey(const CtrlFarmTask *task) {
+    return std::make_pair(-task->m_priority, TaskId(task->m_id));
+  }
+
+  ReadyQueue *readyQueue(const CtrlFarmTask *task);
+  void reindex(Entry &entry);
+  void updateDependents(const QString &id, int pendingDelta);
+
+  static void choose(Candidate &best, const ReadyQueue &queue, int rank,
+                     int runningCount, CtrlFarmTask *except,
+                     FarmServerProxy *server);
+};
+
+//------------------------------------------------------------------------------
+
+TaskScheduler::ReadyQueue *TaskScheduler::readyQueue(const CtrlFarmTask *task) {
+  Submitter &submitter = m_submitters[task->m_user];
+
+  if (task->m_parentId == "")
+    return (task->m_status == Waiting && task->m_priority > 0)
+               ? &submitter.m_tasks
+               : 0;
+
+  if (task->m_status == Waiting)
+    return (task->m_priority > 0) ? &submitter.m_waiting : 0;
+
+  if (task->m_status == Aborted && task->m_failureCount < 3)
+    return &submitter.m_retries;
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void TaskScheduler::reindex(Entry &entry) {
+  ReadyQueue *queue =
+      (entry.m_pendingCount == 0) ? readyQueue(entry.m_task) : 0;
+  if (queue == entry.m_queue) return;
+
+  std::pair<int, TaskId> key = queueKey(entry.m_task);
+  if (entry.m_queue) entry.m_queue->erase(key);
+  if (queue) queue->insert(std::make_pair(key, entry.m_task));
+
+  entry.m_queue = queue;
+}
+
+//------------------------------------------------------------------------------
+
+void TaskScheduler::updateDependents(const QString &id, int pendingDelta) {
+  map<TaskId, vector<TaskId>>::iterator it = m_dependents.find(TaskId(id));
+  if (it == m_dependents.end()) return;
+
+  vector<TaskId>::iterator itDep = it->second.begin();
+  for (; itDep != it->second.end(); ++itDep) {
+    map<TaskId, Entry>::iterator itEntry = m_entries.find(*itDep);
+    if (itEntry != m_entries.end()) {
+      itEntry->second.m_pendingCount += pendingDelta;
+      reindex(itEntry->second);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+void TaskScheduler::addTask(CtrlFarmTask *task) {
+  TaskId id(task->m_id);
+  if (m_entries.find(id) != m_entries.end()) {
+    update(task);
+    return;
+  }
+
+  ++m_revision;
+
+  Entry entry;
+  entry.m_task         = task;
+  entry.m_status       = task->m_status;
+  entry.m_pendingCount = 0;
+  entry.m_running      = false;
+  entry.m_queue        = 0;
+
+  if (task->m_dependencies) {
+    int count = task->m_dependencies->getTaskCount();
+    for (int i = 0; i < count; ++i) {
+      TaskId depId(task->m_dependencies->getTaskId(i));
+      m_dependents[depId].push_back(id);
+
+      map<TaskId, Entry>::iterator itDep = m_entries.find(depId);
+      if (itDep != m_entries.end() && itDep->second.m_status != Completed)
+        ++entry.m_pendingCount;
+    }
+  }
+
+  Entry &newEntry = m_entries.insert(std::make_pair(id, entry)).first->second;
+
+  // tasks submitted earlier may depend on this one
+  if (task->m_status != Completed) updateDependents(task->m_id, 1);
+
+  if (task->m_status == Running && task->m_subTasks.empty()) {
+    ++m_submitters[task->m_user].m_runningCount;
+    newEntry.m_running = true;
+  }
+
+  reindex(newEntry);
+}
+
+//------------------------------------------------------------------------------
+
+void TaskScheduler::update(CtrlFarmTask *task) {
+  map<TaskId, Entry>::iterator it = m_entries.find(TaskId(task->m_id));
+  if (it == m_entries.end()) return;
+
+  ++m_revision;
+
+  Entry &entry = it->second;
+
+  bool wasCompleted = (entry.m_status == Completed);
+  bool isCompleted  = (task->m_status == Completed);
+  entry.m_status    = task->m_status;
+
+  if (wasCompleted != isCompleted)
+    updateDependents(task->m_id, isCompleted ? -1 : 1);
+
+  bool running = (task->m_status == Running && task->m_subTasks.empty());
+  if (running != entry.m_running) {
+    m_submitters[task->m_user].m_runningCount += running ? 1 : -1;
+    entry.m_running = running;
+  }
+
+  reindex(entry);
+}
+
+//------------------------------------------------------------------------------
+
+void TaskScheduler::removeTask(CtrlFarmTask *task) {
+  TaskId id(task->m_id);
+
+  map<TaskId, Entry>::iterator it = m_entries.find(id);
+  if (it == m_entries.end()) return;
+
+  ++m_revision;
+
+  Entry &entry = it->second;
+  if (entry.m_queue) entry.m_queue->erase(queueKey(task));
+  if (entry.m_running) --m_submitters[task->m_user].m_runningCount;
+
+  // missing dependencies are considered completed
+  if (entry.m_status != Completed) updateDependents(task->m_id, -1);
+
+  if (task->m_dependencies) {
+    int count = task->m_dependencies->getTaskCount();
+    for (int i = 0; i < count; ++i) {
+      map<TaskId, vector<TaskId>>::iterator itDep =
+          m_dependents.find(TaskId(task->m_dependencies->getTaskId(i)));
+      if (itDep == m_dependents.end()) continue;
+
+      vector<TaskId> &dependents = itDep->second;
+      dependents.erase(std::remove(dependents.begin(), dependents.end(), id),
+                       dependents.end());
+      if (dependents.empty()) m_dependents.erase(itDep);
+    }
+  }
+
+  m_entries.erase(it);
+}
+
+//------------------------------------------------------------------------------
+
+void TaskScheduler::clear() {
+  ++m_revision;
+
+  m_entries.clear();
+  m_dependents.clear();
+  m_submitters.clear();
+}
+
+//------------------------------------------------------------------------------
+
+bool TaskScheduler::dependenciesCompleted(CtrlFarmTask *task) const {
+  map<TaskId, Entry>::const_iterator it = m_entries.find(TaskId(task->m_id));
+  return it == m_entries.end() || it->second.m_pendingCount == 0;
+}
+
+//------------------------------------------------------------------------------
+
+void TaskScheduler::choose(Candidate &best, const ReadyQueue &queue, int rank,
+                           int runningCount, CtrlFarmTask *except,
+                           FarmServerProxy *server) {
+  // the first task in the queue that can run on the server
+  CtrlFarmTask *task = 0;
+
+  ReadyQueue::const_iterator it = queue.begin();
+  for (; it != queue.end(); ++it) {
+    CtrlFarmTask *t = it->second;
+    if (t != except &&
+        (!server || t->m_platform == NoPlatform ||
+         t->m_platform == server->m_platform)) {
+      task = t;
+      break;
+    }
+  }
+
+  if (!task) return;
+
+  if (best.m_task) {
+    // higher priority first, then retried tasks, then the least served
+    // submitter, then the oldest task
+    if (task->m_priority != best.m_task->m_priority) {
+      if (task->m_priority < best.m_task->m_priority) return;
+    } else if (rank != best.m_rank) {
+      if (rank > best.m_rank) return;
+    } else if (runningCount != best.m_runningCount) {
+      if (runningCount > best.m_runningCount) return;
+    } else if (TaskId(best.m_task->m_id) < TaskId(task->m_id))
+      return;
+  }
+
+  best.m_task         = task;
+  best.m_rank         = rank;
+  best.m_runningCount = runningCount;
+}
+
+//------------------------------------------------------------------------------
+
+CtrlFarmTask *TaskScheduler::getTaskToStart(FarmServerProxy *server) const {
+  Candidate best = {0, 0, 0};
+
+  map<QString, Submitter>::const_iterator it = m_submitters.begin();
+  for (; it != m_submitters.end(); ++it) {
+    const Submitter &submitter = it->second;
+    choose(best, submitter.m_retries, 0, submitter.m_runningCount, 0, server);
+    choose(best, submitter.m_waiting, 1, submitter.m_runningCount, 0, server);
+  }
+
+  return best.m_task;
+}
+
+//------------------------------------------------------------------------------
+
+CtrlFarmTask *TaskScheduler::getNextTaskToStart(CtrlFarmTask *except,
+                                                FarmServerProxy *server) const {
+  Candidate best = {0, 0, 0};
+
+  map<QString, Submitter>::const_iterator it = m_submitters.begin();
+  for (; it != m_submitters.end(); ++it) {
+    const Submitter &submitter = it->second;
+    choose(best, submitter.m_waiting, 1, submitter.m_runningCount, except,
+           server);
+    choose(best, submitter.m_tasks, 1, submitter.m_runningCount, except,
+           server);
+  }
+
+  return best.m_task;
+}
+
+//==============================================================================
+
 class FarmController final : public TFarmExecutor, public TFarmController {
 public:
   FarmController(const QString &hostName, const QString &addr, int port,
@@ -634,6 +983,9 @@ public:
   // used (by a server) to notify a task completion
   void taskCompleted(const QString &taskId, int exitCode) override;
 
+  // used by a running task to know where its range ends
+  int queryTaskRangeEnd(const QString &taskId) override;
+
   // fills the servers vector with the names of the servers
   void getServers(vector<ServerIdentity> &servers) override;
 
@@ -662,6 +1014,18 @@ public:
   CtrlFarmTask *getTaskToStart(FarmServerProxy *server = 0);
   CtrlFarmTask *getNextTaskToStart(CtrlFarmTask *task, FarmServerProxy *server);
 
+  // splits the frame range of a composer sub-task after keptFrames frames,
+  // returning the new Waiting sub-task that takes the remaining ones
+  CtrlFarmTask *splitTask(CtrlFarmTask *task, int keptFrames);
+
+  // resizes a Waiting sub-task about to be started to the render speed
+  // measured on its parent, splitting it or absorbing the following ones
+  void adaptChunk(CtrlFarmTask *task, CtrlFarmTask *parent);
+
+  // splits the unrendered tail of the longest running task in favour of an
+  // idle server; returns the sub-task to be started on the server, if any
+  CtrlFarmTask *stealTask(FarmServerProxy *server);
+
   // looks for a ready server to which to assign the task
   // returns true iff the task has been started
   bool tryToStartTask(CtrlFarmTask *task);
@@ -678,6 +1042,10 @@ public:
 
   void activateReadyServers();
 
+  // saves the tasks if they changed since the last save
+  void saveTasks(const TFilePath &fp);
+  void saveNextTaskId();
+
   // controller name, address and port
   QString m_hostName;
   QString m_addr;
@@ -687,13 +1055,14 @@ public:
   map<TaskId, CtrlFarmTask *> m_tasks;
   map<QString, FarmServerProxy *> m_servers;
 
+  TaskScheduler m_scheduler;
+  unsigned int m_savedRevision;
+
   TThread::Mutex m_mutex;
 
-  static int NextTaskId;
+  TFarmTaskIds m_taskIds;
 };
 
-int FarmController::NextTaskId = 0;
-
 //------------------------------------------------------------------------------
 
 FarmController::FarmController(const QString &hostName, const QString &addr,
@@ -702,11 +1071,10 @@ FarmController::FarmController(const QString &hostName, const QString &addr,
     , m_hostName(hostName)
     , m_addr(addr)
     , m_port(port)
-    , m_userLog(log) {
-  TFilePath rootDir            = getGlobalRoot();
-  TFilePath lastUsedIdFilePath = rootDir + "config" + "id.txt";
-  Tifstream is(lastUsedIdFilePath);
-  if (is.good()) is >> NextTaskId;
+    , m_userLog(log)
+    , m_savedRevision(0)
+    , m_taskIds(getGlobalRoot() + "config" + "id.txt") {
+  m_taskIds.load();
 }
 
 //------------------------------------------------------------------------------
@@ -1009,6 +1377,8 @@ QString FarmController::execute(const vector<QString> &argv) {
 
       taskCompleted(taskId, exitCode);
       return "";
+    } else if (argv[0] == "queryTaskRangeEnd" && argv.size() > 1) {
+      return QString::number(queryTaskRangeEnd(argv[1]));
     } else if (argv[0] == "getServers") {
       vector<ServerIdentity> servers;
       getServers(servers);
@@ -1119,6 +1489,10 @@ void FarmController::startTask(CtrlFarmTask *task, FarmServerProxy *server) {
     }
   }
 
+  // the chunk size adapts to the measured render speed
+  if (taskToBeSubmittedParent && taskToBeSubmitted->m_status == Waiting)
+    adaptChunk(taskToBeSubmitted, taskToBeSubmittedParent);
+
   int rc = 0;
   try {
     server->addTask(taskToBeSubmitted);
@@ -1140,6 +1514,9 @@ void FarmController::startTask(CtrlFarmTask *task, FarmServerProxy *server) {
 
     taskToBeSubmitted->m_serverId = server->getId();
 
+    if (taskToBeSubmittedParent) m_scheduler.update(taskToBeSubmittedParent);
+    m_scheduler.update(taskToBeSubmitted);
+
     QString msg = "Task " + taskToBeSubmitted->m_id + " assigned to ";
     msg += server->getHostName();
     msg += "\n\n";
@@ -1151,44 +1528,7 @@ void FarmController::startTask(CtrlFarmTask *task, FarmServerProxy *server) {
 
 CtrlFarmTask *FarmController::getTaskToStart(FarmServerProxy *server) {
   QMutexLocker sl(&m_mutex);
-
-  int maxPriority         = 0;
-  CtrlFarmTask *candidate = 0;
-
-  map<TaskId, CtrlFarmTask *>::iterator itTask = m_tasks.begin();
-  for (; itTask != m_tasks.end(); ++itTask) {
-    CtrlFarmTask *task = itTask->second;
-    if ((!server || (task->m_platform == NoPlatform ||
-                     task->m_platform == server->m_platform)) &&
-        (((task->m_status == Waiting && task->m_priority > maxPriority) ||
-          (task->m_status == Aborted && task->m_failureCount < 3)) &&
-         task->m_parentId != "")) {
-      bool dependenciesCompleted = true;
-
-      if (task->m_dependencies) {
-        int count = task->m_dependencies->getTaskCount();
-        for (int i = 0; i < count; ++i) {
-          TFarmTask::Id id = task->m_dependencies->getTaskId(i);
-          map<TaskId, CtrlFarmTask *>::iterator itDepTask =
-              m_tasks.find(TaskId(id));
-          if (itDepTask != m_tasks.end()) {
-            CtrlFarmTask *depTask = itDepTask->second;
-            if (depTask->m_status != Completed) {
-              dependenciesCompleted = false;
-              break;
-            }
-          }
-        }
-      }
-
-      if (dependenciesCompleted) {
-        maxPriority = task->m_priority;
-        candidate   = task;
-      }
-    }
-  }
-
-  return candidate;
+  return m_scheduler.getTaskToStart(server);
 }
 
 //------------------------------------------------------------------------------
@@ -1199,43 +1539,7 @@ CtrlFarmTask *FarmController::getTaskToStart(FarmServerProxy *server) {
 CtrlFarmTask *FarmController::getNextTaskToStart(CtrlFarmTask *except,
                                                  FarmServerProxy *server) {
   QMutexLocker sl(&m_mutex);
-
-  int maxPriority         = 0;
-  CtrlFarmTask *candidate = 0;
-
-  map<TaskId, CtrlFarmTask *>::iterator itTask = m_tasks.begin();
-  for (; itTask != m_tasks.end(); ++itTask) {
-    CtrlFarmTask *task = itTask->second;
-    if (except == task) continue;
-    if ((task->m_platform == NoPlatform ||
-         task->m_platform == server->m_platform) &&
-        task->m_status == Waiting && task->m_priority > maxPriority) {
-      bool dependenciesCompleted = true;
-
-      if (task->m_dependencies) {
-        int count = task->m_dependencies->getTaskCount();
-        for (int i = 0; i < count; ++i) {
-          TFarmTask::Id id = task->m_dependencies->getTaskId(i);
-          map<TaskId, CtrlFarmTask *>::iterator itDepTask =
-              m_tasks.find(TaskId(id));
-          if (itDepTask != m_tasks.end()) {
-            CtrlFarmTask *depTask = itDepTask->second;
-            if (depTask->m_status != Completed) {
-              dependenciesCompleted = false;
-              break;
-            }
-          }
-        }
-      }
-
-      if (dependenciesCompleted) {
-        maxPriority = task->m_priority;
-        candidate   = task;
-      }
-    }
-  }
-
-  return candidate;
+  return m_scheduler.getNextTaskToStart(except, server);
 }
 
 //------------------------------------------------------------------------------
@@ -1243,25 +1547,7 @@ CtrlFarmTask *FarmController::getNextTaskToStart(CtrlFarmTask *except,
 bool FarmController::tryToStartTask(CtrlFarmTask *task) {
   QMutexLocker sl(&m_mutex);
 
-  bool dependenciesCompleted = true;
-
-  if (task->m_dependencies) {
-    int count = task->m_dependencies->getTaskCount();
-    for (int i = 0; i < count; ++i) {
-      TFarmTask::Id id = task->m_dependencies->getTaskId(i);
-      map<TaskId, CtrlFarmTask *>::iterator itDepTask =
-          m_tasks.find(TaskId(id));
-      if (itDepTask != m_tasks.end()) {
-        CtrlFarmTask *depTask = itDepTask->second;
-        if (depTask->m_status != Completed) {
-          dependenciesCompleted = false;
-          break;
-        }
-      }
-    }
-  }
-
-  if (!dependenciesCompleted) return false;
+  if (!m_scheduler.dependenciesCompleted(task)) return false;
 
   if (task->m_subTasks.empty()) {
     vector<FarmServerProxy *> m_partiallyBusyServers;
@@ -1332,6 +1618,186 @@ bool FarmController::tryToStartTask(CtrlFarmTask *task) {
 
 //------------------------------------------------------------------------------
 
+// Whether the frame range of a task can be shared among more tasks
+static bool isSplittable(const CtrlFarmTask *task) {
+  return task->m_isComposerTask && task->m_parentId != "" &&
+         task->m_multimedia == 0 && task->m_step > 0 &&
+         !task->m_toBeDeleted && !isMovieType(task->m_outputPath);
+}
+
+//------------------------------------------------------------------------------
+
+// Names a sub-task after its range, as TFarmTaskGroup does
+static QString getChunkName(const CtrlFarmTask *parent,
+                            const CtrlFarmTask *task) {
+  return parent->m_name + " " +
+         QString::number(task->m_from).rightJustified(2, '0') + "-" +
+         QString::number(task->m_to).rightJustified(2, '0');
+}
+
+//------------------------------------------------------------------------------
+
+CtrlFarmTask *FarmController::splitTask(CtrlFarmTask *task, int keptFrames) {
+  QMutexLocker sl(&m_mutex);
+
+  map<TaskId, CtrlFarmTask *>::iterator itParent =
+      m_tasks.find(TaskId(task->m_parentId));
+  if (itParent == m_tasks.end()) return 0;
+
+  CtrlFarmTask *parent = itParent->second;
+
+  int from, to;
+  if (!task->splitRange(keptFrames, from, to)) return 0;
+
+  // the new sub-task takes the first free sub-id
+  int subId = 0;
+
+  vector<QString>::iterator itSubTaskId = parent->m_subTasks.begin();
+  for (; itSubTaskId != parent->m_subTasks.end(); ++itSubTaskId)
+    subId = std::max(subId, TaskId(*itSubTaskId).getSubId() + 1);
+
+  QString id = parent->m_id + "." + QString::number(subId);
+
+  task->m_name = getChunkName(parent, task);
+
+  CtrlFarmTask *tail =
+      doAddTask(id, parent->m_id, parent->m_name, task->getCommandLine(),
+                task->m_user, task->m_hostName, false,
+                (to - from) / task->m_step + 1, task->m_priority,
+                task->m_platform);
+
+  tail->m_from = from;
+  tail->m_to   = to;
+  tail->m_name = getChunkName(parent, tail);
+  if (task->m_dependencies) *tail->m_dependencies = *task->m_dependencies;
+
+  parent->m_subTasks.push_back(id);
+  m_scheduler.addTask(tail);
+
+  return tail;
+}
+
+//------------------------------------------------------------------------------
+
+void FarmController::adaptChunk(CtrlFarmTask *task, CtrlFarmTask *parent) {
+  QMutexLocker sl(&m_mutex);
+
+  if (!isSplittable(task) || parent->m_secondsPerFrame <= 0) return;
+
+  int chunkFrames =
+      std::max(1, tround(targetChunkSeconds / parent->m_secondsPerFrame));
+  int maxFrames  = chunkFrames + chunkFrames / 2;
+  int frameCount = task->getFrameCount();
+
+  if (frameCount > maxFrames) {
+    splitTask(task, chunkFrames);
+    return;
+  }
+
+  // chunks too short absorb the following ones, if not yet started
+  while (frameCount < chunkFrames) {
+    CtrlFarmTask *next = 0;
+
+    vector<QString>::iterator itSubTaskId = parent->m_subTasks.begin();
+    for (; itSubTaskId != parent->m_subTasks.end(); ++itSubTaskId) {
+      map<TaskId, CtrlFarmTask *>::iterator itSubTask =
+          m_tasks.find(TaskId(*itSubTaskId));
+      if (itSubTask == m_tasks.end()) continue;
+
+      CtrlFarmTask *subTask = itSubTask->second;
+      if (subTask != task && subTask->m_from == task->m_to + task->m_step) {
+        if (subTask->m_status == Waiting && subTask->m_failureCount == 0 &&
+            subTask->m_step == task->m_step && isSplittable(subTask))
+          next = subTask;
+        break;
+      }
+    }
+
+    if (!next) break;
+
+    int nextFrameCount = next->getFrameCount();
+    if (frameCount + nextFrameCount > maxFrames) break;
+
+    task->m_to        = next->m_to;
+    task->m_stepCount = task->getFrameCount();
+    frameCount += nextFrameCount;
+
+    parent->m_subTasks.erase(itSubTaskId);
+    m_scheduler.removeTask(next);
+    m_tasks.erase(TaskId(next->m_id));
+    delete next;
+  }
+
+  task->m_name = getChunkName(parent, task);
+}
+
+//------------------------------------------------------------------------------
+
+CtrlFarmTask *FarmController::stealTask(FarmServerProxy *server) {
+  QMutexLocker sl(&m_mutex);
+
+  CtrlFarmTask *victim = 0;
+  int victimKeptFrames = 0;
+  double maxSeconds    = 0;
+
+  map<QString, FarmServerProxy *>::iterator itServer = m_servers.begin();
+  for (; itServer != m_servers.end(); ++itServer) {
+    const vector<QString> &tasks = itServer->second->getTasks();
+
+    vector<QString>::const_iterator itTaskId = tasks.begin();
+    for (; itTaskId != tasks.end(); ++itTaskId) {
+      map<TaskId, CtrlFarmTask *>::iterator itTask =
+          m_tasks.find(TaskId(*itTaskId));
+      if (itTask == m_tasks.end()) continue;
+
+      CtrlFarmTask *task = itTask->second;
+      if (task->m_status != Running || !isSplittable(task)) continue;
+
+      if (!(task->m_platform == NoPlatform ||
+            task->m_platform == server->m_platform))
+        continue;
+
+      if (find(task->m_failedOnServers.begin(), task->m_failedOnServers.end(),
+               server->getId()) != task->m_failedOnServers.end())
+        continue;
+
+      int stolenFrames = task->getStealableFrames(task->m_secondsPerFrame);
+      double seconds   = stolenFrames * task->m_secondsPerFrame;
+      if (stolenFrames > 0 && seconds > maxSeconds) {
+        victim           = task;
+        victimKeptFrames = task->getFrameCount() - stolenFrames;
+        maxSeconds       = seconds;
+      }
+    }
+  }
+
+  if (!victim) return 0;
+
+  CtrlFarmTask *tail = splitTask(victim, victimKeptFrames);
+  if (tail) {
+    QString msg = "Task " + victim->m_id + " split: frames " +
+                  QString::number(tail->m_from) + "-" +
+                  QString::number(tail->m_to) + " moved to task " +
+                  tail->m_id + "\n\n";
+    m_userLog->info(msg);
+  }
+
+  return tail;
+}
+
+//------------------------------------------------------------------------------
+
+int FarmController::queryTaskRangeEnd(const QString &taskId) {
+  QMutexLocker sl(&m_mutex);
+
+  map<TaskId, CtrlFarmTask *>::iterator itTask = m_tasks.find(TaskId(taskId));
+  if (itTask == m_tasks.end() || !isSplittable(itTask->second)) return -1;
+
+  return itTask->second->m_to;
+}
+
+//------------------------------------------------------------------------------
+
 ServerState FarmController::getServerState(FarmServerProxy *server,
                                            QString &taskId) {
   ServerState state;
@@ -1403,8 +1869,9 @@ QString FarmController::addTask(const QString &name, const QString &cmdline,
                                 TFarmPlatform platform) {
   QString parentId = "";
   CtrlFarmTask *task =
-      doAddTask(QString::number(NextTaskId++), parentId, name, cmdline, user,
-                host, suspended, 1, priority, platform);
+      doAddTask(m_taskIds.next(), parentId, name, cmdline, user, host,
+                suspended, 1, priority, platform);
+  m_scheduler.addTask(task);
 
   return task->m_id;
 }
@@ -1437,7 +1904,7 @@ void TaskStarter::run() {
 //------------------------------------------------------------------------------
 
 QString FarmController::addTask(const TFarmTask &task, bool suspended) {
-  QString id = QString::number(NextTaskId++);
+  QString id = m_taskIds.next();
 
   CtrlFarmTask *myTask = 0;
 
@@ -1447,6 +1914,7 @@ QString FarmController::addTask(const TFarmTask &task, bool suspended) {
     myTask = doAddTask(id, parentId, task.m_name, task.getCommandLine(),
                        task.m_user, task.m_hostName, suspended,
                        task.m_stepCount, task.m_priority, task.m_platform);
+    m_scheduler.addTask(myTask);
   } else {
     myTask =
         new CtrlFarmTask(id, task.m_name, task.getCommandLine(), task.m_user,
@@ -1474,7 +1942,10 @@ QString FarmController::addTask(const TFarmTask &task, bool suspended) {
           new TFarmTask::Dependencies(*task.m_dependencies);
 
       myTask->m_subTasks.push_back(subTaskId);
+      m_scheduler.addTask(mySubTask);
     }
+
+    m_scheduler.addTask(myTask);
   }
 
   TThread::Executor executor;
@@ -1501,8 +1972,9 @@ void FarmController::removeTask(const QString &id) {
         CtrlFarmTask *subTask = it3->second;
         if (subTask->m_status != Running) {
           it2 = task->m_subTasks.erase(it2);
+          m_scheduler.removeTask(subTask);
           m_tasks.erase(it3);
-          delete it3->second;
+          delete subTask;
         } else {
           it2 = task->m_subTasks.erase(it2);
 
@@ -1530,8 +2002,9 @@ void FarmController::removeTask(const QString &id) {
     }
 
     if (task->m_status != Running || !aSubtaskIsRunning) {
+      m_scheduler.removeTask(task);
       m_tasks.erase(it);
-      delete it->second;
+      delete task;
     } else
       task->m_toBeDeleted = true;
   }
@@ -1568,9 +2041,11 @@ void FarmController::suspendTask(const QString &id) {
           }
         }
         subTask->m_status = Suspended;
+        m_scheduler.update(subTask);
       }
     }
     task->m_status = Suspended;
+    m_scheduler.update(task);
   }
 }
 
@@ -1604,6 +2079,7 @@ void FarmController::doRestartTask(const QString &id, bool fromClient,
       task->m_serverId       = "";
       task->m_failedSteps = task->m_successfullSteps = 0;
       task->m_failureCount                           = 0;
+      m_scheduler.update(task);
 
       if (!task->m_subTasks.empty()) {
         vector<QString>::iterator itSubTaskId = task->m_subTasks.begin();
@@ -1622,6 +2098,7 @@ void FarmController::doRestartTask(const QString &id, bool fromClient,
             subtask->m_serverId       = "";
             subtask->m_failedSteps = subtask->m_successfullSteps = 0;
             subtask->m_failureCount                              = 0;
+            m_scheduler.update(subtask);
           }
         }
       }
@@ -1749,8 +2226,12 @@ void FarmController::taskSubmissionError(const QString &taskId, int errCode) {
     task->m_status     = Aborted;
 
     task->m_completionDate = QDateTime::currentDateTime();
+    m_scheduler.update(task);
 
-    if (task->m_toBeDeleted) m_tasks.erase(itTask);
+    if (task->m_toBeDeleted) {
+      m_scheduler.removeTask(task);
+      m_tasks.erase(itTask);
+    }
 
     CtrlFarmTask *parentTask = 0;
 
@@ -1777,9 +2258,13 @@ void FarmController::taskSubmissionError(const QString &taskId, int errCode) {
         }
 
         parentTask->m_status = parentTaskState;
+        m_scheduler.update(parentTask);
         if (parentTask->m_status == Aborted) {
           parentTask->m_completionDate = task->m_completionDate;
-          if (parentTask->m_toBeDeleted) m_tasks.erase(itParent);
+          if (parentTask->m_toBeDeleted) {
+            m_scheduler.removeTask(parentTask);
+            m_tasks.erase(itParent);
+          }
         }
       }
     }
@@ -1798,18 +2283,11 @@ void FarmController::taskSubmissionError(const QString &taskId, int errCode) {
 
   if (server && !server->m_offline) {
     // cerca un task da sottomettere al server
-
-    itTask = m_tasks.begin();
-    for (; itTask != m_tasks.end(); ++itTask) {
-      CtrlFarmTask *task = itTask->second;
-      if (task->m_status == Waiting) {
-        try {
-          startTask(task, server);
-        } catch (TException & /*e*/) {
-          continue;
-        }
-
-        break;
+    CtrlFarmTask *task = getNextTaskToStart(0, server);
+    if (task) {
+      try {
+        startTask(task, server);
+      } catch (TException & /*e*/) {
       }
     }
   }
@@ -1828,6 +2306,13 @@ void FarmController::taskProgress(const QString &taskId, int step,
     else
       ++task->m_failedSteps;
 
+    if (task->m_startDate.isValid()) {
+      double seconds =
+          task->m_startDate.msecsTo(QDateTime::currentDateTime()) / 1000.0;
+      task->m_secondsPerFrame =
+          seconds / (task->m_successfullSteps + task->m_failedSteps);
+    }
+
     if (task->m_parentId != "") {
       map<TaskId, CtrlFarmTask *>::iterator itParentTask =
           m_tasks.find(TaskId(task->m_parentId));
@@ -1836,6 +2321,13 @@ void FarmController::taskProgress(const QString &taskId, int step,
         ++parentTask->m_successfullSteps;
       else
         ++parentTask->m_failedSteps;
+
+      // moving average over the sub-tasks of the parent
+      parentTask->m_secondsPerFrame =
+          (parentTask->m_secondsPerFrame > 0)
+              ? 0.75 * parentTask->m_secondsPerFrame +
+                    0.25 * task->m_secondsPerFrame
+              : task->m_secondsPerFrame;
     }
   }
 }
@@ -1880,7 +2372,12 @@ void FarmController::taskCompleted(const QString &taskId, int exitCode) {
       ++task->m_failureCount;
     }
 
-    if (task->m_toBeDeleted) m_tasks.erase(itTask);
+    m_scheduler.update(task);
+
+    if (task->m_toBeDeleted) {
+      m_scheduler.removeTask(task);
+      m_tasks.erase(itTask);
+    }
 
     CtrlFarmTask *parentTask = 0;
 
@@ -1923,10 +2420,15 @@ void FarmController::taskCompleted(const QString &taskId, int exitCode) {
         else
           parentTask->m_status = parentTaskState;
 
+        m_scheduler.update(parentTask);
+
         if (parentTask->m_status == Completed ||
             parentTask->m_status == Aborted) {
           parentTask->m_completionDate = task->m_completionDate;
-          if (parentTask->m_toBeDeleted) m_tasks.erase(itParent);
+          if (parentTask->m_toBeDeleted) {
+            m_scheduler.removeTask(parentTask);
+            m_tasks.erase(itParent);
+          }
         }
       }
     }
@@ -1971,6 +2473,7 @@ void FarmController::taskCompleted(const QString &taskId, int exitCode) {
   if (server && !server->m_offline && exitCode != RENDER_LICENSE_NOT_FOUND) {
     // cerca un task da sottomettere al server
     CtrlFarmTask *task = getTaskToStart(server);
+    if (!task) task = stealTask(server);
     if (task) {
       try {
         if (task->m_status == Aborted) {
@@ -2055,6 +2558,7 @@ void FarmController::activateServer(const QString &id) {
     for (int i = 0; i < server->m_maxTaskCount; ++i) {
       // cerca un task da sottomettere al server
       CtrlFarmTask *task = getTaskToStart(server);
+      if (!task) task = stealTask(server);
       if (task) {
         try {
           if (task->m_status == Aborted) {
@@ -2107,6 +2611,7 @@ void FarmController::load(const TFilePath &fp) {
   TIStream is(fp);
 
   m_tasks.clear();
+  m_scheduler.clear();
 
   string tagName;
   is.openChild(tagName);
@@ -2141,6 +2646,16 @@ void FarmController::load(const TFilePath &fp) {
       }
     }
   }
+
+  for (it = m_tasks.begin(); it != m_tasks.end(); ++it)
+    m_scheduler.addTask(it->second);
+
+  m_savedRevision = m_scheduler.getRevision();
+
+  // the last used id may not have been saved, if the controller was not
+  // stopped properly: new tasks must not take the id of a loaded one
+  for (it = m_tasks.begin(); it != m_tasks.end(); ++it)
+    m_taskIds.skip(it->second->m_id);
 }
 
 //------------------------------------------------------------------------------
@@ -2165,6 +2680,46 @@ void FarmController::save(const TFilePath &fp) const {
 
 //------------------------------------------------------------------------------
 
+void FarmController::saveTasks(const TFilePath &fp) {
+  QMutexLocker sl(&m_mutex);
+
+  unsigned int revision = m_scheduler.getRevision();
+  if (revision == m_savedRevision) return;
+
+  // the file is replaced only once completely written, so that a controller
+  // that was interrupted always finds an intact file when restarted
+  TFilePath tempFp = fp.withName(fp.getWideName() + L"_new");
+  bool saved       = false;
+  try {
+    save(tempFp);
+
+    QFile tempFile(tempFp.getQString());
+    QSaveFile file(fp.getQString());
+    if (tempFile.open(QIODevice::ReadOnly) &&
+        file.open(QIODevice::WriteOnly)) {
+      file.write(tempFile.readAll());
+      saved = file.commit();
+    }
+  } catch (...) {
+  }
+  TSystem::removeFileOrLevel(tempFp);
+
+  if (!saved) {
+    m_userLog->error("Unable to save the tasks to " + fp.getQString() + "\n");
+    return;
+  }
+
+  saveNextTaskId();
+
+  m_savedRevision = revision;
+}
+
+//------------------------------------------------------------------------------
+
+void FarmController::saveNextTaskId() { m_taskIds.save(); }
+
+//------------------------------------------------------------------------------
+
 void FarmController::activateReadyServers() {
   QMutexLocker sl(&m_mutex);
 
@@ -2179,6 +2734,7 @@ void FarmController::activateReadyServers() {
       for (int i = 0; i < (server->m_maxTaskCount - tasksCount); ++i) {
         // cerca un task da sottomettere al server
         CtrlFarmTask *task = getTaskToStart(server);
+        if (!task) task = stealTask(server);
         if (task) {
           try {
             if (task->m_status == Aborted) {
@@ -2327,6 +2883,12 @@ void ControllerService::onStart(int argc, char *argv[]) {
 
   QEventLoop eventLoop;
 
+  // Tasks are saved periodically, so that the queue is resumed on restart
+  QTimer saveTimer;
+  QObject::connect(&saveTimer, &QTimer::timeout,
+                   [this, fp]() { m_controller->saveTasks(fp); });
+  saveTimer.start(10000);
+
   // Connect the server's listening finished signal to main loop quit.
   QObject::connect(m_controller, SIGNAL(finished()), &eventLoop, SLOT(quit()));
 
@@ -2353,13 +2915,8 @@ void ControllerService::onStart(int argc, char *argv[]) {
 //------------------------------------------------------------------------------
 
 void ControllerService::onStop() {
-  // TFilePath fp = getTasksDataFile();
-  // m_controller->save(fp);
-
-  TFilePath rootDir            = getGlobalRoot();
-  TFilePath lastUsedIdFilePath = rootDir + "config" + "id.txt";
-  Tofstream os(lastUsedIdFilePath);
-  if (os.good()) os << FarmController::NextTaskId;
+  m_controller->saveTasks(getTasksDataFile());
+  m_controller->saveNextTaskId();
 
   TTcpIpClient client;
 
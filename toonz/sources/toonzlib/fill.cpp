@@ -364,7 +364,7 @@ bool floodCheck(const TPixel32 &clickColor, const TPixel32 *targetPix,
 //-----------------------------------------------------------------------------
 /*-- The return value is whether the saveBox has been updated or not. --*/
 bool fill(const TRasterCM32P &r, const FillParameters &params,
-          TTileSaverCM32 *saver) {
+          TTileSaverCM32 *saver, TRect *filledBox) {
   TPixelCM32 *pix, *limit, *pix0, *oldpix;
   int oldy, xa, xb, xc, xd, dy;
   int oldxc, oldxd;
@@ -421,6 +421,7 @@ bool fill(const TRasterCM32P &r, const FillParameters &params,
   std::stack<FillSeed> seeds;
 
   fillRow(r, p, xa, xb, paint, params.m_palette, saver, params.m_prevailing);
+  if (filledBox && xa <= xb) *filledBox += TRect(xa, y, xb, y);
   seeds.push(FillSeed(xa, xb, y, 1));
   seeds.push(FillSeed(xa, xb, y, -1));
 
@@ -441,15 +442,25 @@ bool fill(const TRasterCM32P &r, const FillParameters &params,
     oldxd      = (std::numeric_limits<int>::min)();
     oldxc      = (std::numeric_limits<int>::max)();
     while (pix <= limit) {
+      // skip at once the runs which are already painted, typically the
+      // ones filled from a sibling seed
+      if (pix->getPaint() == paint) {
+        TPixelCM32 *run = pix;
+        while (pix <= limit && pix->getPaint() == paint) pix++;
+        oldpix += pix - run;
+        x += pix - run;
+        continue;
+      }
       oldtone = threshTone(*oldpix, fillDepth);
       tone    = threshTone(*pix, fillDepth);
       // the last condition is added in order to prevent fill area from
       // protruding behind the colored line
-      if (pix->getPaint() != paint && tone <= oldtone && tone != 0 &&
+      if (tone <= oldtone && tone != 0 &&
           (pix->getPaint() != pix->getInk() ||
            pix->getPaint() == paintAtClickedPos)) {
         fillRow(r, TPoint(x, y), xc, xd, paint, params.m_palette, saver,
                 params.m_prevailing);
+        if (filledBox && xc <= xd) *filledBox += TRect(xc, y, xd, y);
         if (xc < xa) seeds.push(FillSeed(xc, xa - 1, y, -dy));
         if (xd > xb) seeds.push(FillSeed(xb + 1, xd, y, -dy));
         if (oldxd >= xc - 1)
@@ -467,7 +478,7 @@ bool fill(const TRasterCM32P &r, const FillParameters &params,
         oldpix++, x++;
       }
     }
-    if (oldxd > 0) seeds.push(FillSeed(oldxc, oldxd, y, dy));
+    if (oldxd >= 0) seeds.push(FillSeed(oldxc, oldxd, y, dy));
   }
 
   bool saveBoxChanged = false;
@@ -651,30 +662,45 @@ void inkFill(const TRasterCM32P &r, const TPoint &pin, int ink, int searchRay,
 
   oldInk = pix->getInk();
 
+  TRect bounds = r->getBounds();
+  if (insideRect) bounds *= *insideRect;
+
+  // the line is filled a span at a time: each span is expanded in its row,
+  // then one seed is pushed for each run of old ink touching it (diagonals
+  // included) in the rows above and below
+  auto isOldInk = [oldInk](const TPixelCM32 *pix) {
+    return !pix->isPurePaint() && pix->getInk() == oldInk;
+  };
+
   std::stack<TPoint> seeds;
-  seeds.push(p);
+  if (bounds.contains(p)) seeds.push(p);
 
   while (!seeds.empty()) {
     p = seeds.top();
     seeds.pop();
-    if (!r->getBounds().contains(p)) continue;
-    if (insideRect && !insideRect->contains(p)) continue;
 
-    TPixelCM32 *pix = pixels + (p.y * r->getWrap() + p.x);
-    if (pix->isPurePaint() || pix->getInk() != oldInk) continue;
+    TPixelCM32 *line = pixels + p.y * r->getWrap();
+    if (!isOldInk(line + p.x)) continue;
+
+    int xa = p.x, xb = p.x;
+    while (xa > bounds.x0 && isOldInk(line + xa - 1)) xa--;
+    while (xb < bounds.x1 && isOldInk(line + xb + 1)) xb++;
 
-    if (saver) saver->save(p);
+    if (saver) saver->save(TRect(xa, p.y, xb, p.y));
 
-    pix->setInk(ink);
+    for (int x = xa; x <= xb; x++) line[x].setInk(ink);
 
-    seeds.push(TPoint(p.x - 1, p.y - 1));
-    seeds.push(TPoint(p.x - 1, p.y));
-    seeds.push(TPoint(p.x - 1, p.y + 1));
-    seeds.push(TPoint(p.x, p.y - 1));
-    seeds.push(TPoint(p.x, p.y + 1));
-    seeds.push(TPoint(p.x + 1, p.y - 1));
-    seeds.push(TPoint(p.x + 1, p.y));
-    seeds.push(TPoint(p.x + 1, p.y + 1));
+    int x0 = std::max(xa - 1, bounds.x0);
+    int x1 = std::min(xb + 1, bounds.x1);
+    for (int y = p.y - 1; y <= p.y + 1; y += 2) {
+      if (y < bounds.y0 || y > bounds.y1) continue;
+      TPixelCM32 *row = pixels + y * r->getWrap();
+      for (int x = x0; x <= x1; x++) {
+        if (!isOldInk(row + x)) continue;
+        seeds.push(TPoint(x, y));
+        while (x < x1 && isOldInk(row + x + 1)) x++;
+      }
+    }
   }
   r->unlock();
 }
@@ -0,0 +1,364 @@
+#include "toonz/imageprefetcher.h"
+
+// TnzLib includes
+#include "toonz/txsheet.h"
+#include "toonz/txshcell.h"
+#include "toonz/txshcolumn.h"
+#include "toonz/txshsimplelevel.h"
+#include "toonz/txshchildlevel.h"
+#include "toonz/imagemanager.h"
+
+// TnzCore includes
+#include "tthread.h"
+#include "tsystem.h"
+#include "tlogger.h"
+#include "timagecache.h"
+
+// Qt includes
+#include <QMutex>
+#include <QMutexLocker>
+
+// STD includes
+#include <set>
+
+//***************************************************************************************
+//    Local namespace
+//***************************************************************************************
+
+namespace {
+
+typedef ImagePrefetcher::Frame Frame;
+
+//-----------------------------------------------------------------------------
+
+const int maxSubXsheetDepth = 8;
+
+//-----------------------------------------------------------------------------
+
+//! Collects the level frames displayed at the specified xsheet row, entering
+//! sub-xsheets.
+void collectFrames(TXsheet *xsh, int row, std::vector<Frame> &frames,
+                   int depth = 0) {
+  if (row < 0 || depth > maxSubXsheetDepth) return;
+
+  int c, cCount = xsh->getColumnCount();
+  for (c = 0; c < cCount; ++c) {
+    TXshColumn *column = xsh->getColumn(c);
+    if (!column || !column->isCamstandVisible()) continue;
+
+    const TXshCell &cell = xsh->getCell(row, c);
+    if (cell.isEmpty()) continue;
+
+    if (TXshSimpleLevel *sl = cell.getSimpleLevel()) {
+      if (!sl->isFid(cell.getFrameId())) continue;
+
+      frames.push_back(ImagePrefetcher::levelFrame(sl, cell.getFrameId()));
+    } else if (TXshChildLevel *cl = cell.getChildLevel())
+      collectFrames(cl->getXsheet(), cell.getFrameId().getNumber() - 1, frames,
+                    depth + 1);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+//! The prefetcher data shared with the loading tasks.
+struct PrefetchState {
+  QMutex m_mutex;
+
+  bool m_enabled;
+  int m_lookAhead;
+  int m_budgetKB;
+
+  //! Ids of the frames being loaded
+  std::set<std::string> m_loading;
+  //! Ids of the current frames, not displayed yet
+  std::set<std::string> m_toBeDisplayed;
+  //! Cache memory taken by the frames ahead of the current row
+  UINT m_aheadKB;
+
+  ImagePrefetcher::Statistics m_stats;
+
+public:
+  PrefetchState()
+      : m_enabled(true), m_lookAhead(12), m_budgetKB(512 << 10), m_aheadKB(0) {}
+};
+
+//***************************************************************************************
+//    PrefetchTask definition
+//***************************************************************************************
+
+class PrefetchTask final : public TThread::Runnable {
+  PrefetchState *m_state;
+  Frame m_frame;
+
+public:
+  PrefetchTask(PrefetchState *state, const Frame &frame)
+      : m_state(state), m_frame(frame) {}
+
+  void run() override {
+    {
+      QMutexLocker locker(&m_state->m_mutex);
+
+      if (m_state->m_aheadKB >= (UINT)m_state->m_budgetKB) {
+        ++m_state->m_stats.m_overBudget;
+        return;
+      }
+
+      // Another request may already be loading the frame
+      if (!m_state->m_loading.insert(m_frame.m_id).second) return;
+    }
+
+    bool loaded = false;
+    try {
+      loaded = m_frame.m_load();
+    } catch (...) {
+    }
+
+    // the cache reports bytes
+    UINT memUsageKB =
+        loaded
+            ? TImageCache::instance()->getUncompressedMemUsage(m_frame.m_id) >>
+                  10
+            : 0;
+
+    QMutexLocker locker(&m_state->m_mutex);
+
+    m_state->m_loading.erase(m_frame.m_id);
+    if (loaded) {
+      ++m_state->m_stats.m_loaded;
+      m_state->m_aheadKB += memUsageKB;
+    }
+  }
+};
+
+}  // namespace
+
+//***************************************************************************************
+//    ImagePrefetcher::Imp definition
+//***************************************************************************************
+
+class ImagePrefetcher::Imp final : public PrefetchState {
+public:
+  TThread::Executor m_executor;
+
+public:
+  Imp() {
+    m_executor.setMaxActiveTasks(std::max(1, TSystem::getProcessorCount() / 2));
+  }
+
+  void prefetch(const std::vector<Frame> &current,
+                const std::vector<Frame> &next);
+};
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::Imp::prefetch(const std::vector<Frame> &current,
+                                    const std::vector<Frame> &next) {
+  TImageCache *cache = TImageCache::instance();
+
+  // Pending loads refer to the previous frame
+  m_executor.cancelAll();
+
+  std::set<std::string> visited;
+
+  std::vector<Frame>::const_iterator ft, fEnd = current.end();
+  for (ft = current.begin(); ft != fEnd; ++ft) visited.insert(ft->m_id);
+
+  int budgetKB;
+  {
+    QMutexLocker locker(&m_mutex);
+
+    m_toBeDisplayed = visited;
+
+    if (!m_enabled) return;
+    budgetKB = m_budgetKB;
+  }
+
+  // Frames already in cache count against the budget like the ones to be
+  // loaded
+  std::vector<Frame> toBeLoaded;
+  UINT aheadKB = 0;
+
+  for (ft = next.begin(), fEnd = next.end();
+       ft != fEnd && aheadKB < (UINT)budgetKB; ++ft) {
+    if (!visited.insert(ft->m_id).second) continue;
+
+    if (cache->isCached(ft->m_id))
+      aheadKB += cache->getUncompressedMemUsage(ft->m_id) >> 10;
+    else
+      toBeLoaded.push_back(*ft);
+  }
+
+  QMutexLocker locker(&m_mutex);
+
+  m_aheadKB = aheadKB;
+
+  // Nearest frames first
+  for (ft = toBeLoaded.begin(), fEnd = toBeLoaded.end(); ft != fEnd; ++ft)
+    if (m_loading.count(ft->m_id) == 0)
+      m_executor.addTask(new PrefetchTask(this, *ft));
+}
+
+//***************************************************************************************
+//    ImagePrefetcher implementation
+//***************************************************************************************
+
+ImagePrefetcher::ImagePrefetcher() : m_imp(new Imp) {}
+
+//-----------------------------------------------------------------------------
+
+ImagePrefetcher::~ImagePrefetcher() {}
+
+//-----------------------------------------------------------------------------
+
+ImagePrefetcher *ImagePrefetcher::instance() {
+  static ImagePrefetcher theInstance;
+  return &theInstance;
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::setEnabled(bool enabled) {
+  {
+    QMutexLocker locker(&m_imp->m_mutex);
+    m_imp->m_enabled = enabled;
+  }
+
+  if (!enabled) cancel();
+}
+
+//-----------------------------------------------------------------------------
+
+bool ImagePrefetcher::isEnabled() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return m_imp->m_enabled;
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::setLookAhead(int rows) {
+  QMutexLocker locker(&m_imp->m_mutex);
+  m_imp->m_lookAhead = std::max(rows, 0);
+}
+
+//-----------------------------------------------------------------------------
+
+int ImagePrefetcher::getLookAhead() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return m_imp->m_lookAhead;
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::setMemoryBudget(int megaBytes) {
+  QMutexLocker locker(&m_imp->m_mutex);
+  m_imp->m_budgetKB = std::max(megaBytes, 0) << 10;
+}
+
+//-----------------------------------------------------------------------------
+
+int ImagePrefetcher::getMemoryBudget() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return m_imp->m_budgetKB >> 10;
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::setThreadsCount(int count) {
+  m_imp->m_executor.setMaxActiveTasks(std::max(count, 1));
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::prefetch(TXsheet *xsh, int row, int direction) {
+  if (!xsh) return;
+
+  int lookAhead;
+  {
+    QMutexLocker locker(&m_imp->m_mutex);
+    lookAhead = m_imp->m_enabled ? m_imp->m_lookAhead : 0;
+  }
+
+  std::vector<Frame> current, next;
+  collectFrames(xsh, row, current);
+
+  direction = (direction < 0) ? -1 : 1;
+
+  int r, rEnd = row + direction * (lookAhead + 1);
+  for (r = row + direction; r != rEnd; r += direction)
+    collectFrames(xsh, r, next);
+
+  m_imp->prefetch(current, next);
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::prefetch(const std::string &current,
+                               const std::vector<Frame> &next) {
+  Frame frame = {current, std::function<bool()>()};
+  m_imp->prefetch(std::vector<Frame>(1, frame), next);
+}
+
+//-----------------------------------------------------------------------------
+
+ImagePrefetcher::Frame ImagePrefetcher::levelFrame(TXshSimpleLevel *sl,
+                                                   const TFrameId &fid) {
+  TXshSimpleLevelP slP(sl);
+  std::string id = sl->getImageId(fid);
+
+  Frame frame = {id, [slP, fid, id]() {
+                   return !ImageManager::instance()->isCached(id) &&
+                          (bool)slP->getFrame(fid, false);
+                 }};
+  return frame;
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::recordDisplay(const std::string &id, bool cached) {
+  QMutexLocker locker(&m_imp->m_mutex);
+
+  if (m_imp->m_toBeDisplayed.erase(id) == 0) return;
+
+  if (cached)
+    ++m_imp->m_stats.m_hits;
+  else
+    ++m_imp->m_stats.m_misses;
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::setPlaying(bool playing) {
+  if (playing) {
+    resetStatistics();
+    return;
+  }
+
+  Statistics stats = getStatistics();
+  if (stats.m_hits + stats.m_misses == 0) return;
+
+  TLogger::info() << "Playback: " << stats.m_hits << " of "
+                  << stats.m_hits + stats.m_misses
+                  << " frames found in cache ("
+                  << (int)(100.0 * stats.hitRatio() + 0.5) << "%), "
+                  << stats.m_loaded << " loaded ahead, "
+                  << stats.m_overBudget << " skipped over the memory budget";
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::cancel() { m_imp->m_executor.cancelAll(); }
+
+//-----------------------------------------------------------------------------
+
+ImagePrefetcher::Statistics ImagePrefetcher::getStatistics() const {
+  QMutexLocker locker(&m_imp->m_mutex);
+  return m_imp->m_stats;
+}
+
+//-----------------------------------------------------------------------------
+
+void ImagePrefetcher::resetStatistics() {
+  QMutexLocker locker(&m_imp->m_mutex);
+  m_imp->m_stats = Statistics();
+}
@@ -30,6 +30,12 @@
 // Qt includes
 #include <QCoreApplication>
 #include <QTimer>
+#include <QThread>
+#include <QWaitCondition>
+
+// STD includes
+#include <deque>
+#include <memory>
 
 #include "toonz/movierenderer.h"
 
@@ -41,6 +47,10 @@ namespace {
 
 int RenderSessionId = 0;
 
+// Rendered frames waiting to be saved, per writer thread. Rendering stalls
+// beyond this amount, until the writers catch up.
+const int MaxQueuedFramesPerWriter = 2;
+
 //---------------------------------------------------------
 
 void addMark(const TRasterP &mark, TRasterImageP img) {
@@ -98,6 +108,14 @@ QString getPreviewName(unsigned long renderSessionId) {
   return "previewed" + QString::number(renderSessionId) + ".noext";
 }
 
+//---------------------------------------------------------
+
+// Writers piping frames to an ffmpeg process (or to a movie) are not
+// reentrant, and encode the frames in the order they are given
+bool isStreamedType(const TFilePath &fp) {
+  return isMovieType(fp) || fp.isFfmpegType();
+}
+
 }  // namespace
 
 //**************************************************************************
@@ -105,6 +123,15 @@ QString getPreviewName(unsigned long renderSessionId) {
 //**************************************************************************
 
 class MovieRenderer::Imp final : public TRenderPort, public TSmartObject {
+public:
+  class WriterThread;
+
+  struct SaveRequest {
+    double m_frame;
+    std::pair<TRasterP, TRasterP> m_rasters;
+    bool m_applyGamma;
+  };
+
 public:
   ToonzScene *m_scene;
   TRenderer m_renderer;
@@ -128,17 +155,33 @@ public:
 
   TThread::Mutex m_mutex;
 
+  // Frames are encoded and written by dedicated threads, so that slow
+  // writers do not hold the render threads. Image sequences are written by
+  // several threads at once, movies and ffmpeg formats by one thread, in
+  // order.
+  std::vector<std::unique_ptr<WriterThread>> m_writers;
+  std::deque<SaveRequest> m_writeQueue;
+  QMutex m_writeMutex;  // Guards the writer members below
+  QWaitCondition m_frameQueued, m_frameTaken;
+  int m_writerCount;
+  int m_reservedFrames;  //!< Queue slots taken by completing render threads
+  int m_savingThreadsCount;
+  int m_stalledThreadsCount;
+  bool m_writersClosing;
+  bool m_writeCanceled;
+
   int m_renderSessionId;
   long m_whiteSample;
 
   int m_nextFrameIdxToSave;
-  int m_savingThreadsCount;
   bool m_firstCompletedRaster;
   bool m_failure;
   bool m_cacheResults;
   bool m_preview;
   bool m_movieType;
   bool m_seqRequired;
+  bool m_streamed;
+  bool m_saveInOrder;
   bool m_waitAfterFinish;
 
 public:
@@ -174,9 +217,16 @@ public:
 
   //! Saves the specified rasters at the specified time; returns whether the
   //! frames were successfully saved, and
-  //! the associated time-adjusted level frame.
-  std::pair<bool, int> saveFrame(double frame,
-                                 const std::pair<TRasterP, TRasterP> &rasters);
+  //! the associated time-adjusted level frame. Nothing is saved once the
+  //! render has been canceled.
+  std::pair<bool, int> saveFrame(const SaveRequest &request, bool canceled);
+
+  // Writer stage
+  void startWriters();
+  void stopWriters();
+  void waitForWriters();  //!< Reserves a queue slot, blocking while full
+  void queueFrames(const std::vector<SaveRequest> &requests);
+  void writeFrames();  //!< Body of the writer threads
   std::string getRenderCacheId();
 
   // returns board duration in frame
@@ -185,6 +235,17 @@ public:
 
 //---------------------------------------------------------
 
+class MovieRenderer::Imp::WriterThread final : public QThread {
+  Imp *m_imp;
+
+public:
+  WriterThread(Imp *imp) : m_imp(imp) {}
+
+  void run() override { m_imp->writeFrames(); }
+};
+
+//---------------------------------------------------------
+
 MovieRenderer::Imp::Imp(ToonzScene *scene, const TFilePath &moviePath,
                         int threadCount, bool cacheResults)
     : m_scene(scene)
@@ -193,9 +254,14 @@ MovieRenderer::Imp::Imp(ToonzScene *scene, const TFilePath &moviePath,
     , m_frameSize(scene->getCurrentCamera()->getRes())
     , m_xDpi(72)
     , m_yDpi(72)
+    , m_writerCount(1)
+    , m_reservedFrames(0)
+    , m_savingThreadsCount(0)
+    , m_stalledThreadsCount(0)
+    , m_writersClosing(false)
+    , m_writeCanceled(false)
     , m_renderSessionId(RenderSessionId++)
     , m_nextFrameIdxToSave(0)
-    , m_savingThreadsCount(0)
     , m_whiteSample(0)
     , m_firstCompletedRaster(
           true)         //< I know, sounds weird - it's just set to false
@@ -203,7 +269,9 @@ MovieRenderer::Imp::Imp(ToonzScene *scene, const TFilePath &moviePath,
     , m_cacheResults(cacheResults)
     , m_preview(moviePath.isEmpty())
     , m_movieType(isMovieType(moviePath))
-    , m_seqRequired(isSequencialRequired(moviePath)) {
+    , m_seqRequired(isSequencialRequired(moviePath))
+    , m_streamed(isStreamedType(moviePath))
+    , m_saveInOrder(m_streamed) {
   m_renderCacheId =
       m_fp.withName(m_fp.getName() + "#RENDERID" +
                     QString::number(m_renderSessionId).toStdString())
@@ -211,11 +279,15 @@ MovieRenderer::Imp::Imp(ToonzScene *scene, const TFilePath &moviePath,
 
   m_renderer.addPort(this);
   m_waitAfterFinish = m_movieType && !m_seqRequired && threadCount > 1;
+
+  // Streaming writers take one frame at a time, in order
+  if (!m_streamed) m_writerCount = std::max(threadCount, 1);
 }
 
 //---------------------------------------------------------
 
 MovieRenderer::Imp::~Imp() {
+  stopWriters();
   m_renderer.removePort(this);  // Please, note: a TRenderer instance is
                                 // currently a shared-pointer-like
 }  // object to a private worker. *That* object may outlive the TRenderer
@@ -321,6 +393,137 @@ void MovieRenderer::Imp::prepareForStart() {
       m_levelUpdaterA.reset();
       m_levelUpdaterB.reset();
     }
+
+    startWriters();
+  }
+}
+
+//---------------------------------------------------------
+
+void MovieRenderer::Imp::startWriters() {
+  for (int i = 0; i < m_writerCount; ++i) {
+    m_writers.emplace_back(new WriterThread(this));
+    m_writers.back()->start();
+  }
+}
+
+//---------------------------------------------------------
+
+void MovieRenderer::Imp::stopWriters() {
+  {
+    QMutexLocker writeLocker(&m_writeMutex);
+    m_writersClosing = true;
+    m_frameQueued.wakeAll();
+    m_frameTaken.wakeAll();
+  }
+
+  // Writers flush the frames still in the queue before quitting
+  for (auto &writer : m_writers) writer->wait();
+  m_writers.clear();
+}
+
+//---------------------------------------------------------
+
+void MovieRenderer::Imp::waitForWriters() {
+  QMutexLocker writeLocker(&m_writeMutex);
+
+  // The slot is reserved under the same lock as the check, so that threads
+  // completing at once cannot all pass it. It is filled by queueFrames().
+  int maxQueuedFrames = m_writerCount * MaxQueuedFramesPerWriter;
+  if ((int)m_writeQueue.size() + m_reservedFrames >= maxQueuedFrames) {
+    // Time the rendering stalls, to be told apart from the saving time
+    if (m_stalledThreadsCount++ == 0) TStopWatch::global(1).start();
+
+    while ((int)m_writeQueue.size() + m_reservedFrames >= maxQueuedFrames &&
+           !m_writersClosing)
+      m_frameTaken.wait(&m_writeMutex);
+
+    if (--m_stalledThreadsCount == 0) TStopWatch::global(1).stop();
+  }
+
+  ++m_reservedFrames;
+}
+
+//---------------------------------------------------------
+
+void MovieRenderer::Imp::queueFrames(const std::vector<SaveRequest> &requests) {
+  QMutexLocker writeLocker(&m_writeMutex);
+
+  m_writeQueue.insert(m_writeQueue.end(), requests.begin(), requests.end());
+  --m_reservedFrames;
+
+  m_frameQueued.wakeAll();
+  m_frameTaken.wakeAll();  // In case the slot was left empty
+}
+
+//---------------------------------------------------------
+
+void MovieRenderer::Imp::writeFrames() {
+  QMutexLocker writeLocker(&m_writeMutex);
+
+  for (;;) {
+    while (m_writeQueue.empty() && !m_writersClosing)
+      m_frameQueued.wait(&m_writeMutex);
+
+    if (m_writeQueue.empty()) break;
+
+    SaveRequest request = m_writeQueue.front();
+    m_writeQueue.pop_front();
+    m_frameTaken.wakeAll();
+
+    bool canceled = m_writeCanceled;
+
+    // Save current frame, timing the saving procedure
+    if (m_savingThreadsCount++ == 0) TStopWatch::global(0).start();
+    writeLocker.unlock();
+
+    std::pair<bool, int> savedFrame = saveFrame(request, canceled);
+
+    writeLocker.relock();
+    if (--m_savingThreadsCount == 0) TStopWatch::global(0).stop();
+    writeLocker.unlock();
+
+    // Report status and deal with responses
+    bool okToContinue = true;
+    {
+      QMutexLocker locker(&m_mutex);
+
+      std::set<MovieRenderer::Listener *>::iterator lt = m_listeners.begin();
+
+      if (savedFrame.first) {
+        for (; lt != m_listeners.end(); ++lt)
+          okToContinue &= (*lt)->onFrameCompleted(savedFrame.second);
+      } else {
+        for (; lt != m_listeners.end(); ++lt) {
+          TException e;
+          okToContinue &= (*lt)->onFrameFailed(savedFrame.second, e);
+        }
+      }
+
+      if (!okToContinue && !canceled) {
+        // Some listener invoked termination of the render procedure. It seems
+        // it's their right
+        // to do so. I wonder what happens if two listeners would disagree on
+        // the matter...
+        // BTW stop the rendering, alright.
+
+        int from, to;
+        getRange(m_scene, false, from,
+                 to);  // It's ok since cancels can only happen from Toonz...
+
+        for (int i = from; i < to; i++)
+          TImageCache::instance()->remove(m_renderCacheId +
+                                          std::to_string(i + 1));
+
+        m_renderer.stopRendering();
+      }
+    }
+
+    writeLocker.relock();
+
+    // No more saving. Further frames will be rejected and treated as
+    // failures.
+    if (!okToContinue) m_writeCanceled = true;
   }
 }
 
@@ -419,8 +622,11 @@ void MovieRenderer::Imp::postProcessImage(const TRasterImageP &img,
 
 //---------------------------------------------------------------------
 
-std::pair<bool, int> MovieRenderer::Imp::saveFrame(
-    double frame, const std::pair<TRasterP, TRasterP> &rasters) {
+std::pair<bool, int> MovieRenderer::Imp::saveFrame(const SaveRequest &request,
+                                                   bool canceled) {
+  double frame                                 = request.m_frame;
+  const std::pair<TRasterP, TRasterP> &rasters = request.m_rasters;
+
   bool success = false;
 
   // Build the frame number to write to
@@ -438,7 +644,7 @@ std::pair<bool, int> MovieRenderer::Imp::saveFrame(
 
   TFrameId fid(fr + 1 + boardDuration);
 
-  if (m_levelUpdaterA.get()) {
+  if (m_levelUpdaterA.get() && !canceled) {
     assert(m_levelUpdaterB.get() || !rasters.second);
 
     // Analyze writer
@@ -473,7 +679,7 @@ std::pair<bool, int> MovieRenderer::Imp::saveFrame(
     /*--- When caching the same raster, gamma only the first one and use the
 result in subsequent frames
 ---*/
-    if (m_renderSettings.m_gamma != 1.0 && m_toBeAppliedGamma[frame]) {
+    if (m_renderSettings.m_gamma != 1.0 && request.m_applyGamma) {
       TRop::gammaCorrect(rasterA, m_renderSettings.m_gamma);
       if (rasterB) TRop::gammaCorrect(rasterB, m_renderSettings.m_gamma);
     }
@@ -482,7 +688,7 @@ result in subsequent frames
     try {
       TRasterImageP imgA(rasterA);
       postProcessImage(imgA, has64bitOutputSupport, writeInLinearColorSpace,
-                       m_toBeAppliedGamma[frame], writingGamma,
+                       request.m_applyGamma, writingGamma,
                        m_renderSettings.m_colorSpaceGamma,
                        m_renderSettings.m_mark, fid.getNumber());
 
@@ -491,7 +697,7 @@ result in subsequent frames
       if (rasterB) {
         TRasterImageP imgB(rasterB);
         postProcessImage(imgB, has64bitOutputSupport, writeInLinearColorSpace,
-                         m_toBeAppliedGamma[frame], writingGamma,
+                         request.m_applyGamma, writingGamma,
                          m_renderSettings.m_colorSpaceGamma,
                          m_renderSettings.m_mark, fid.getNumber());
 
@@ -532,10 +738,10 @@ void MovieRenderer::Imp::doRenderRasterCompleted(const RenderData &renderData) {
   assert(!(m_cacheResults &&
            m_levelUpdaterB.get()));  // Cannot cache results on stereoscopy
 
-  QMutexLocker locker(&m_mutex);
+  // Don't pile up frames while the writers are behind
+  waitForWriters();
 
-  bool allowMT    = Preferences::instance()->getFfmpegMultiThread();
-  bool requireSeq = allowMT ? m_seqRequired : m_movieType;
+  QMutexLocker locker(&m_mutex);
 
   // Build soundtrack at the first time a frame is completed - and the filetype
   // is that of a movie.
@@ -582,7 +788,8 @@ void MovieRenderer::Imp::doRenderRasterCompleted(const RenderData &renderData) {
     m_toBeAppliedGamma[*jt] = false;
   }
 
-  // Attempt flushing as many frames as possible to the level updater(s)
+  // Hand as many frames as possible to the writers
+  std::vector<SaveRequest> requests;
   while (!m_toBeSaved.empty()) {
     std::map<double, std::pair<TRasterP, TRasterP>>::iterator ft =
         m_toBeSaved.begin();
@@ -590,86 +797,23 @@ void MovieRenderer::Imp::doRenderRasterCompleted(const RenderData &renderData) {
     // In the *movie type* case, frames must be saved sequentially.
     // If the frame is not the next one in the sequence, wait until *that* frame
     // is available.
-    if (requireSeq &&
+    if (m_saveInOrder &&
         (ft->first != m_framesToBeRendered[m_nextFrameIdxToSave].first))
       break;
 
-    // This thread will be the one processing ft - remove it from the map to
-    // prevent another
-    // thread from interfering
-    double frame                          = ft->first;
-    std::pair<TRasterP, TRasterP> rasters = ft->second;
+    SaveRequest request = {ft->first, ft->second,
+                           m_toBeAppliedGamma[ft->first]};
 
     ++m_nextFrameIdxToSave;
+    m_toBeAppliedGamma.erase(ft->first);
     m_toBeSaved.erase(ft);
 
-    // Save current frame
-    std::pair<bool, int> savedFrame;
-    {
-      // Time the saving procedure
-      struct SaveTimer {
-        int &m_count;
-        SaveTimer(int &count) : m_count(count) {
-          if (m_count++ == 0) TStopWatch::global(0).start();
-        }
-        ~SaveTimer() {
-          if (--m_count == 0) TStopWatch::global(0).stop();
-        }
-      } saveTimer(m_savingThreadsCount);
-
-      // Unlock the mutex only in case this is NOT a movie type. Single images
-      // can be saved concurrently.
-      struct MutexUnlocker {
-        QMutexLocker *m_locker;
-        ~MutexUnlocker() {
-          if (m_locker) m_locker->relock();
-        }
-      } unlocker = {requireSeq ? (QMutexLocker *)0
-                               : (locker.unlock(), &locker)};
-
-      savedFrame = saveFrame(frame, rasters);
-    }
-
-    // Report status and deal with responses
-    bool okToContinue = true;
-
-    std::set<MovieRenderer::Listener *>::iterator lt = m_listeners.begin();
-
-    if (savedFrame.first) {
-      for (; lt != m_listeners.end(); ++lt)
-        okToContinue &= (*lt)->onFrameCompleted(savedFrame.second);
-    } else {
-      for (; lt != m_listeners.end(); ++lt) {
-        TException e;
-        okToContinue &= (*lt)->onFrameFailed(savedFrame.second, e);
-      }
-    }
-
-    if (!okToContinue) {
-      // Some listener invoked termination of the render procedure. It seems
-      // it's their right
-      // to do so. I wonder what happens if two listeners would disagree on the
-      // matter...
-      // BTW stop the rendering, alright.
-
-      {
-        int from, to;
-        getRange(m_scene, false, from,
-                 to);  // It's ok since cancels can only happen from Toonz...
-
-        for (int i = from; i < to; i++)
-          TImageCache::instance()->remove(m_renderCacheId +
-                                          std::to_string(i + 1));
-      }
-
-      m_renderer.stopRendering();
-
-      m_levelUpdaterA
-          .reset();  // No more saving. Further attempts to save images
-      m_levelUpdaterB.reset();  // will be rejected and treated as failures.
-    }
+    requests.push_back(request);
   }
 
+  // Still under m_mutex, so that frames are queued in order
+  queueFrames(requests);
+
   m_firstCompletedRaster = false;
 }
 
@@ -750,9 +894,6 @@ void MovieRenderer::Imp::onRenderFailure(const RenderData &renderData,
                               // No sense making it later in this case!
   m_failure = true;
 
-  bool allowMT    = Preferences::instance()->getFfmpegMultiThread();
-  bool requireSeq = allowMT ? m_seqRequired : m_movieType;
-
   // If the saver object has already been destroyed - or it was never
   // created to begin with, nothing to be done
   if (!m_levelUpdaterA.get()) return;  // The preview case would fall here
@@ -764,7 +905,7 @@ void MovieRenderer::Imp::onRenderFailure(const RenderData &renderData,
   std::map<double, std::pair<TRasterP, TRasterP>>::iterator it =
       m_toBeSaved.begin();
   while (it != m_toBeSaved.end()) {
-    if (requireSeq &&
+    if (m_saveInOrder &&
         (it->first != m_framesToBeRendered[m_nextFrameIdxToSave].first))
       break;
 
@@ -814,6 +955,9 @@ void MovieRenderer::Imp::onRenderFinished(bool isCanceled) {
     eloop.exec();
   }
 
+  // Let the writers flush the queued frames
+  stopWriters();
+
   // Close updaters. After this, the output levels should be finalized on disk.
   m_levelUpdaterA.reset();
   m_levelUpdaterB.reset();
@@ -19,6 +19,7 @@
 #include "tundo.h"
 #include "tbigmemorymanager.h"
 #include "timage_io.h"
+#include "timagecache.h"
 
 // Qt includes
 #include <QSettings>
@@ -268,6 +269,7 @@ Preferences::Preferences() {
   setUnits();
   setCameraUnits();
   setUndoMemorySize();
+  setImageCacheMemorySize();
 
   // Load level formats
   getDefaultLevelFormats(m_levelFormats);
@@ -373,6 +375,8 @@ void Preferences::definePreferenceItems() {
          false);
   define(startupPopupEnabled, "startupPopupEnabled", QMetaType::Bool, true);
   define(undoMemorySize, "undoMemorySize", QMetaType::Int, 100, 0, 2000);
+  define(imageCacheMemorySize, "imageCacheMemorySize", QMetaType::Int, 0, 0,
+         1048576);
   define(taskchunksize, "taskchunksize", QMetaType::Int, 10, 1, 2000);
   define(sceneNumberingEnabled, "sceneNumberingEnabled", QMetaType::Bool,
          false);
@@ -384,6 +388,7 @@ void Preferences::definePreferenceItems() {
          (int)ProjectFolderOnly);
 
   setCallBack(undoMemorySize, &Preferences::setUndoMemorySize);
+  setCallBack(imageCacheMemorySize, &Preferences::setImageCacheMemorySize);
 
   // Interface
   define(CurrentStyleSheetName, "CurrentStyleSheetName", QMetaType::QString,
@@ -953,6 +958,14 @@ void Preferences::setUndoMemorySize() {
 
 //-----------------------------------------------------------------
 
+void Preferences::setImageCacheMemorySize() {
+  // 0 leaves the cache to the system's memory shortage checks
+  TUINT64 memorySize = getIntValue(imageCacheMemorySize);
+  TImageCache::instance()->setMemoryBudget(memorySize << 20);
+}
+
+//-----------------------------------------------------------------
+
 void Preferences::setPixelsOnly() {
   bool pixelSelected = getBoolValue(pixelsOnly);
   if (pixelSelected)
@@ -9,12 +9,29 @@
 #include "toonz/txshcell.h"
 #include "toonz/textureutils.h"
 #include "toonz/imagemanager.h"
+#include "toonz/imageprefetcher.h"
 #include "imagebuilders.h"
 
 #include "toonz/stageplayer.h"
 
 using namespace Stage;
 
+//*****************************************************************************************
+//    Local namespace
+//*****************************************************************************************
+
+namespace {
+
+//! Tells the prefetcher whether the image of a displayed frame, built with
+//! the specified id, was in cache.
+void recordDisplay(TXshSimpleLevel *sl, const TFrameId &fid,
+                   const std::string &id) {
+  ImagePrefetcher::instance()->recordDisplay(
+      sl->getImageId(fid), ImageManager::instance()->isCached(id));
+}
+
+}  // namespace
+
 //*****************************************************************************************
 //    Stage::Player  implementation
 //*****************************************************************************************
@@ -62,6 +79,8 @@ TImageP Stage::Player::image() const {
       (slType == OVL_XSHLEVEL || slType == TZI_XSHLEVEL))
     id = id + "_filled";
 
+  recordDisplay(m_sl, m_fid, id);
+
   ImageLoader::BuildExtData extData(m_sl, m_fid);
   return ImageManager::instance()->getImage(id, ImageManager::none, &extData);
 }
@@ -70,6 +89,8 @@ TImageP Stage::Player::image() const {
 
 DrawableTextureDataP Stage::Player::texture() const {
   if (m_sl) {
+    recordDisplay(m_sl, m_fid, m_sl->getImageId(m_fid));
+
     // Ask the sLevel directly
     return texture_utils::getTextureData(
         m_sl, m_fid, -1);  // -1 stands for 'current subsampling'
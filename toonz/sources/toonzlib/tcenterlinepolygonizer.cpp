@@ -1,6 +1,7 @@
 
 
 #include "tcenterlinevectP.h"
+#include "tthread.h"
 
 //==========================================================================
 
@@ -843,22 +844,20 @@ inline void reduceBorder(RawBorder &border, Contour &res,
 
 //--------------------------------------------------------------------------
 
-// Reduction caller and list copier.
+// Reduction caller and list copier. Families are reduced in parallel.
 inline void reduceBorders(BorderList &borders, Contours &result,
                           bool ambiguitiesCheck) {
-  unsigned int i, j;
-
   // Initialize output container
   result.resize(borders.size());
 
   // Copy results
-  for (i = 0; i < borders.size(); ++i) {
+  TThread::parallelFor(borders.size(), [&](int i) {
     result[i].resize(borders[i].size());
-    for (j = 0; j < borders[i].size(); ++j) {
+    for (unsigned int j = 0; j < borders[i].size(); ++j) {
       reduceBorder(*borders[i][j], result[i][j], ambiguitiesCheck);
       delete borders[i][j];
     }
-  }
+  });
 }
 
 //--------------------------------------------------------------------------
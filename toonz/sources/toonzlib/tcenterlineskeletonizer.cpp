@@ -1,6 +1,7 @@
 
 
 #include "tcenterlinevectP.h"
+#include "tthread.h"
 
 //#define _SSDEBUG                                              // Uncomment to
 // enable the debug viewer
@@ -1797,25 +1798,47 @@ static SkeletonGraph *skeletonize(ContourFamily &regionContours,
 
 SkeletonList *skeletonize(Contours &contours, VectorizerCore *thisVectorizer,
                           VectorizerCoreGlobals &g) {
-  VectorizationContext context(&g);
-
-  SkeletonList *res = new SkeletonList;
-  unsigned int i, j;
+  unsigned int i, j, familiesCount = contours.size();
 
   // Find overall number of nodes
   unsigned int overallNodes = 0;
-  for (i = 0; i < contours.size(); ++i)
+  std::vector<std::pair<unsigned int, int>> familySizes(familiesCount);
+  for (i = 0; i < familiesCount; ++i) {
+    unsigned int familyNodes = 0;
     for (j = 0; j < contours[i].size(); ++j)
-      overallNodes += contours[i][j].size();
+      familyNodes += contours[i][j].size();
+
+    overallNodes += familyNodes;
+    familySizes[i] = std::make_pair(familyNodes, -(int)i);
+  }
 
   thisVectorizer->setOverallPartials(overallNodes);
 
-  for (i = 0; i < contours.size(); ++i) {
-    res->push_back(skeletonize(contours[i], context, thisVectorizer));
+  // Families are independent, and are skeletonized in parallel - each with its
+  // own context. Larger families are started first, for a better balance.
+  std::sort(familySizes.begin(), familySizes.end(),
+            std::greater<std::pair<unsigned int, int>>());
 
-    if (thisVectorizer->isCanceled()) break;
+  std::vector<SkeletonGraph *> skeletons(familiesCount, (SkeletonGraph *)0);
+  TThread::parallelFor(familiesCount, [&](int k) {
+    if (thisVectorizer->isCanceled()) return;
+
+    int f = -familySizes[k].second;
+
+    VectorizationContext context(&g);
+    skeletons[f] = skeletonize(contours[f], context, thisVectorizer);
+  });
+
+  // Output skeletons follow the families order, as in sequential processing
+  SkeletonList *res = new SkeletonList;
+  for (i = 0; i < familiesCount; ++i) {
+    if (!skeletons[i]) break;
+    res->push_back(skeletons[i]);
   }
 
+  // Skeletons past a canceled family are discarded
+  for (; i < familiesCount; ++i) delete skeletons[i];
+
   return res;
 }
 
@@ -14,10 +14,19 @@
 #include "cleanuppalette.h"
 #include "cleanupcommon.h"
 #include "tmsgcore.h"
+#include "tthread.h"
+#include "tsystem.h"
 #include "toonz/cleanupparameters.h"
 
 #include "toonz/tcleanupper.h"
 
+// Qt includes
+#include <QMutex>
+#include <QMutexLocker>
+
+// STD includes
+#include <functional>
+
 using namespace CleanupTypes;
 
 /*  The Cleanup Process Reworked   -   EXPLANATION (by Daniele)
@@ -243,30 +252,84 @@ public:
 
 //=========================================================================
 
+//! Shared state
+
+/*
+  The batch cleanupper processes several frames at the same time. The parameters'
+  target colors are rebuilt from the cleanup palette at each process() call -
+  so they are updated and copied under a lock, and the per-pixel stages work on
+  the copies. The autocenter and auto-adjust stages keep their state in globals
+  (and auto-adjust refers to the first processed frame), so they are serialized.
+*/
+
+QMutex colorsMutex;
+QMutex autoProcessMutex;
+
+//! Updates the parameters' target colors with the current cleanup palette,
+//! and returns a copy of them.
+TargetColors updateColors(CleanupParameters *parameters) {
+  QMutexLocker locker(&colorsMutex);
+
+  parameters->m_colors.update(parameters->m_cleanupPalette.getPointer(),
+                              parameters->m_noAntialias);
+  return parameters->m_colors;
+}
+
+//------------------------------------------------------------------------------------
+
+//! Returns a copy of the parameters' target colors.
+TargetColors currentColors(const CleanupParameters *parameters) {
+  QMutexLocker locker(&colorsMutex);
+  return parameters->m_colors;
+}
+
+//=========================================================================
+
+//! Row bands
+
+// Smaller rasters are not worth the threads synchronization
+const int minParallelPixels = 1 << 18;
+const int minBandRows       = 32;
+
+//! Calls func(y0, y1) on consecutive bands of rows covering [0, ly). Bands of
+//! large rasters are processed in parallel - so func must only access the
+//! rows it receives.
+void forEachRowBand(int lx, int ly, const std::function<void(int, int)> &func) {
+  int bandsCount = 1;
+  if ((double)lx * ly >= minParallelPixels)
+    bandsCount = tcrop(ly / minBandRows, 1, 2 * TSystem::getProcessorCount());
+
+  TThread::parallelForBands(ly, bandsCount, func);
+}
+
+//=========================================================================
+
 //! Brightness/Contrast functions
 
 void brightnessContrast(const TRasterCM32P &cm, const TargetColors &colors) {
   TransfFunction transform(colors);
   USHORT *transf_fun = transform.getTransfFun();
 
-  int ink, tone;
-  int newTone, newInk;
+  forEachRowBand(cm->getLx(), cm->getLy(), [&](int y0, int y1) {
+    int ink, tone;
+    int newTone, newInk;
 
-  for (int y = 0; y < cm->getLy(); ++y) {
-    TPixelCM32 *pix    = cm->pixels(y);
-    TPixelCM32 *endPix = pix + cm->getLx();
+    for (int y = y0; y < y1; ++y) {
+      TPixelCM32 *pix    = cm->pixels(y);
+      TPixelCM32 *endPix = pix + cm->getLx();
 
-    for (; pix < endPix; ++pix) {
-      tone = pix->getTone();
-      if (tone < 255) {
-        ink     = pix->getInk();
-        newTone = transf_fun[ink << 8 | tone];
-        newInk  = (newTone == 255) ? 0 : colors.getColor(ink).m_index;
+      for (; pix < endPix; ++pix) {
+        tone = pix->getTone();
+        if (tone < 255) {
+          ink     = pix->getInk();
+          newTone = transf_fun[ink << 8 | tone];
+          newInk  = (newTone == 255) ? 0 : colors.getColor(ink).m_index;
 
-        *pix = TPixelCM32(newInk, 0, newTone);
+          *pix = TPixelCM32(newInk, 0, newTone);
+        }
       }
     }
-  }
+  });
 }
 
 //------------------------------------------------------------------------------------
@@ -275,17 +338,21 @@ void brightnessContrastGR8(const TRasterCM32P &cm, const TargetColors &colors) {
   TransfFunction transform(colors);
   USHORT *transf_fun = transform.getTransfFun();
 
-  int val, black = colors.getColor(1).m_index;
+  int black = colors.getColor(1).m_index;
+
+  forEachRowBand(cm->getLx(), cm->getLy(), [&](int y0, int y1) {
+    int val;
 
-  for (int y = 0; y < cm->getLy(); ++y) {
-    TPixelCM32 *pix    = cm->pixels(y);
-    TPixelCM32 *endPix = pix + cm->getLx();
+    for (int y = y0; y < y1; ++y) {
+      TPixelCM32 *pix    = cm->pixels(y);
+      TPixelCM32 *endPix = pix + cm->getLx();
 
-    for (; pix < endPix; ++pix) {
-      val  = transf_fun[pix->getValue() + 256];
-      *pix = (val < 255) ? TPixelCM32(black, 0, val) : TPixelCM32();
+      for (; pix < endPix; ++pix) {
+        val  = transf_fun[pix->getValue() + 256];
+        *pix = (val < 255) ? TPixelCM32(black, 0, val) : TPixelCM32();
+      }
     }
-  }
+  });
 }
 
 //=========================================================================
@@ -293,22 +360,25 @@ void brightnessContrastGR8(const TRasterCM32P &cm, const TargetColors &colors) {
 //! Transparency check
 
 void transparencyCheck(const TRasterCM32P &cmin, const TRaster32P &rasout) {
-  for (int y = 0; y < cmin->getLy(); ++y) {
-    TPixelCM32 *pix    = cmin->pixels(y);
-    TPixelCM32 *endPix = pix + cmin->getLx();
-
-    TPixel32 *outPix = rasout->pixels(y);
-    for (; pix < endPix; ++pix, ++outPix) {
-      int ink  = pix->getInk();
-      int tone = pix->getTone();
-
-      if (ink == 4095)
-        *outPix = TPixel32::Green;
-      else
-        *outPix = (tone == 0) ? TPixel32::Black
-                              : (tone == 255) ? TPixel32::White : TPixel32::Red;
+  forEachRowBand(cmin->getLx(), cmin->getLy(), [&](int y0, int y1) {
+    for (int y = y0; y < y1; ++y) {
+      TPixelCM32 *pix    = cmin->pixels(y);
+      TPixelCM32 *endPix = pix + cmin->getLx();
+
+      TPixel32 *outPix = rasout->pixels(y);
+      for (; pix < endPix; ++pix, ++outPix) {
+        int ink  = pix->getInk();
+        int tone = pix->getTone();
+
+        if (ink == 4095)
+          *outPix = TPixel32::Green;
+        else
+          *outPix = (tone == 0)
+                        ? TPixel32::Black
+                        : (tone == 255) ? TPixel32::White : TPixel32::Red;
+      }
     }
-  }
+  });
 }
 
 }  // namespace
@@ -359,12 +429,14 @@ CleanupPreprocessedImage::CleanupPreprocessedImage(
   }
 
   if (!m_wasFromGR8) {
+    TargetColors colors(currentColors(parameters));
+
     const TPixel32 white(255, 255, 255, 0);
-    for (int i = 0; i < parameters->m_colors.getColorCount(); ++i) {
-      TPixel32 cc = parameters->m_colors.getColor(i).m_color;
+    for (int i = 0; i < colors.getColorCount(); ++i) {
+      TPixel32 cc = colors.getColor(i).m_color;
       for (int tone = 0; tone < 256; tone++) {
-        m_pixelsLut.push_back(blend(parameters->m_colors.getColor(i).m_color,
-                                    white, tone, TPixelCM32::getMaxTone()));
+        m_pixelsLut.push_back(blend(colors.getColor(i).m_color, white, tone,
+                                    TPixelCM32::getMaxTone()));
       }
     }
   }
@@ -512,8 +584,7 @@ TRasterP TCleanupper::processColors(const TRasterP &rin) {
   }
 
   // Copy current cleanup palette to parameters' colors
-  m_parameters->m_colors.update(m_parameters->m_cleanupPalette.getPointer(),
-                                m_parameters->m_noAntialias);
+  TargetColors colors(updateColors(m_parameters));
 
   bool toGr8 = (m_parameters->m_lineProcessingMode == lpGrey);
   if (toGr8) {
@@ -551,7 +622,7 @@ TRasterP TCleanupper::processColors(const TRasterP &rin) {
     rcm->unlock();
   } else {
     assert(TRaster32P(rin));
-    preprocessColors(rcm, rin, m_parameters->m_colors);
+    preprocessColors(rcm, rin, colors);
   }
 
   // outImg->setDpi(outDpi.x, outDpi.y);
@@ -569,18 +640,19 @@ TRasterP TCleanupper::processColors(const TRasterP &rin) {
 CleanupPreprocessedImage *TCleanupper::process(
     TRasterImageP &image, bool first_image, TRasterImageP &onlyResampledImage,
     bool isCameraTest, bool returnResampled, bool onlyForSwatch,
-    TAffine *resampleAff, TRasterP templateForResampled) {
+    TAffine *resampleAff, TRasterP templateForResampled,
+    QStringList *warnings) {
   TAffine aff;
   double blur;
   TDimension outDim(0, 0);
   TPointD outDpi;
 
+  // Autocenter and auto-adjust are not reentrant
+  QMutexLocker autoProcessLocker(&autoProcessMutex);
+
   bool isSameDpi    = false;
   bool autocentered = getResampleValues(image, aff, blur, outDim, outDpi,
                                         isCameraTest, isSameDpi);
-  if (m_parameters->m_autocenterType != AUTOCENTER_NONE && !autocentered)
-    DVGui::warning(
-        QObject::tr("The autocentering failed on the current drawing."));
 
   bool fromGr8 = (bool)TRasterGR8P(image->getRaster());
   bool toGr8   = (m_parameters->m_lineProcessingMode == lpGrey);
@@ -651,6 +723,17 @@ CleanupPreprocessedImage *TCleanupper::process(
     }
   }
 
+  autoProcessLocker.unlock();
+
+  if (m_parameters->m_autocenterType != AUTOCENTER_NONE && !autocentered) {
+    QString msg =
+        QObject::tr("The autocentering failed on the current drawing.");
+    if (warnings)
+      warnings->append(msg);
+    else
+      DVGui::warning(msg);
+  }
+
   fromGr8 = (bool)TRasterGR8P(
       image->getRaster());  // may have changed type due to auto-adjust
 
@@ -730,8 +813,7 @@ CleanupPreprocessedImage *TCleanupper::process(
   assert(finalRas);
 
   // Copy current cleanup palette to parameters' colors
-  m_parameters->m_colors.update(m_parameters->m_cleanupPalette.getPointer(),
-                                m_parameters->m_noAntialias);
+  TargetColors colors(updateColors(m_parameters));
 
   if (toGr8) {
     // No (color) processing. Not even thresholding. This just means that all
@@ -765,7 +847,7 @@ CleanupPreprocessedImage *TCleanupper::process(
   } else {
     // WARNING: finalRas and tmp_ras may share the SAME buffer!
     assert(TRaster32P(tmp_ras));
-    preprocessColors(finalRas, tmp_ras, m_parameters->m_colors);
+    preprocessColors(finalRas, tmp_ras, colors);
   }
 
   TToonzImageP final;
@@ -1112,28 +1194,30 @@ void TCleanupper::preprocessColors(const TRasterCM32P &outRas,
   raster32->lock();
   outRas->lock();
 
-  // For every image pixel, process it
-  for (int j = 0; j < raster32->getLy(); j++) {
-    TPixel32 *pix      = raster32->pixels(j);
-    TPixel32 *endPix   = pix + raster32->getLx();
-    TPixelCM32 *outPix = outRas->pixels(j);
-
-    while (pix < endPix) {
-      if (*pix == TPixel32::White ||
-          pix->m <
-              255)  // sometimes the resampling produces semitransparent pixels
-        // on the  border of the raster; I discards those pixels.
-        //(which otherwise creates a black border in the final cleanupped image)
-        // vinz
-        *outPix = TPixelCM32();
-      else
-        preprocessColor(*pix, blackData, pencilsHSV, pencilsHSV.size(),
-                        *outPix);
-
-      pix++;
-      outPix++;
+  // For every image pixel, process it. NOTE: outRas and raster32 may share
+  // the same buffer - but each row band only touches its own rows.
+  forEachRowBand(raster32->getLx(), raster32->getLy(), [&](int y0, int y1) {
+    for (int j = y0; j < y1; j++) {
+      TPixel32 *pix      = raster32->pixels(j);
+      TPixel32 *endPix   = pix + raster32->getLx();
+      TPixelCM32 *outPix = outRas->pixels(j);
+
+      while (pix < endPix) {
+        if (*pix == TPixel32::White ||
+            pix->m < 255)  // sometimes the resampling produces semitransparent
+          // pixels on the  border of the raster; I discards those pixels.
+          //(which otherwise creates a black border in the final cleanupped
+          // image) vinz
+          *outPix = TPixelCM32();
+        else
+          preprocessColor(*pix, blackData, pencilsHSV, pencilsHSV.size(),
+                          *outPix);
+
+        pix++;
+        outPix++;
+      }
     }
-  }
+  });
 
   raster32->unlock();
   outRas->unlock();
@@ -1180,7 +1264,7 @@ void TCleanupper::doPostProcessingGR8(const TRaster32P &outRas,
   rasCM32->unlock();
 
   // Apply brightness/contrast and grayscale conversion directly
-  brightnessContrastGR8(cmout, m_parameters->m_colors);
+  brightnessContrastGR8(cmout, currentColors(m_parameters));
 
   // Apply despeckling
   if (m_parameters->m_despeckling)
@@ -1219,7 +1303,7 @@ TToonzImageP TCleanupper::doPostProcessingGR8(
   cmout->lock();
 
   // Apply brightness/contrast and grayscale conversion directly
-  brightnessContrastGR8(cmout, m_parameters->m_colors);
+  brightnessContrastGR8(cmout, currentColors(m_parameters));
 
   // Apply despeckling
   if (m_parameters->m_despeckling)
@@ -1270,7 +1354,7 @@ void TCleanupper::doPostProcessingColor(const TRaster32P &outRas,
   rasCM32->unlock();
 
   // First, deal with brightness/contrast
-  brightnessContrast(cmout, m_parameters->m_colors);
+  brightnessContrast(cmout, currentColors(m_parameters));
 
   // Then, apply despeckling
   if (m_parameters->m_despeckling)
@@ -1308,15 +1392,17 @@ TToonzImageP TCleanupper::doPostProcessingColor(
   else
     outImage = TToonzImageP(imgToProcess->cloneImage());
 
+  TargetColors colors(currentColors(m_parameters));
+
   assert(outImage);
-  assert(m_parameters->m_colors.getColorCount() < 9);
+  assert(colors.getColorCount() < 9);
 
   // Perform post-processing
   TRasterCM32P outRasCM32 = outImage->getRaster();
   outRasCM32->lock();
 
   // Brightness/Contrast
-  brightnessContrast(outRasCM32, m_parameters->m_colors);
+  brightnessContrast(outRasCM32, colors);
 
   // Despeckling
   if (m_parameters->m_despeckling)
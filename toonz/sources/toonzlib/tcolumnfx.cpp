@@ -15,6 +15,8 @@
 #include "tropcm.h"
 #include "tofflinegl.h"
 #include "tvectorrenderdata.h"
+#include "tvectorrasterizer.h"
+#include "tenv.h"
 
 // TnzBase includes
 #include "ttzpimagefx.h"
@@ -22,6 +24,7 @@
 #include "tzeraryfx.h"
 #include "trenderer.h"
 #include "tfxcachemanager.h"
+#include "tpersistentfxcache.h"
 
 // TnzLib includes
 #include "toonz/toonzscene.h"
@@ -79,6 +82,9 @@ TFxDeclarationT<TZeraryColumnFx> zeraryColumnFxInfo(
 TFxDeclarationT<TXsheetFx> infoTXsheetFx(TFxInfo("Toonz_xsheetFx", true));
 TFxDeclarationT<TOutputFx> infoTOutputFx(TFxInfo("Toonz_outputFx", true));
 
+// Draws vector levels without OpenGL, when possible - see TVectorRasterizer
+TEnv::IntVar VectorCpuRasterization("VectorCpuRasterization", 0);
+
 //****************************************************************************************
 //    Local namespace  -  misc functions
 //****************************************************************************************
@@ -1062,29 +1068,51 @@ void TLevelColumnFx::doCompute(TTile &tile, double frame,
       if (info.m_quality == TRenderSettings::ClosestPixel_FilterResampleQuality)
         rd.m_antiAliasing = false;
 
-      if (!m_offlineContext || m_offlineContext->getLx() < size.lx ||
-          m_offlineContext->getLy() < size.ly) {
-        if (m_offlineContext) delete m_offlineContext;
-        m_offlineContext = new TOfflineGL(size);
-      }
+      TRasterP tileRas(tile.getRaster());
+
+      if (VectorCpuRasterization != 0 &&
+          (TRaster32P(tileRas) || TRaster64P(tileRas)) &&
+          TVectorRasterizer::canRasterize(vectorImage.getPointer(), rd)) {
+        // No offline context is needed - so, unless the palette must be
+        // locked, other frames of the column can be rendered concurrently
+        tileRas->clear();
+
+        if (m_isCachable) {
+          m.unlock();
+          TVectorRasterizer::rasterize(tileRas, vectorImage.getPointer(), rd);
+        } else {
+          vpalette->mutex()->lock();
+
+          vpalette->setFrame((int)frame);
+          TVectorRasterizer::rasterize(tileRas, vectorImage.getPointer(), rd);
+          vpalette->setFrame(oldFrame);
+
+          vpalette->mutex()->unlock();
+        }
+      } else {
+        if (!m_offlineContext || m_offlineContext->getLx() < size.lx ||
+            m_offlineContext->getLy() < size.ly) {
+          if (m_offlineContext) delete m_offlineContext;
+          m_offlineContext = new TOfflineGL(size);
+        }
 
-      m_offlineContext->makeCurrent();
-      m_offlineContext->clear(TPixel32(0, 0, 0, 0));
+        m_offlineContext->makeCurrent();
+        m_offlineContext->clear(TPixel32(0, 0, 0, 0));
 
-      // If level has animated palette, it is necessary to lock palette's color
-      // against
-      // concurrents TPalette::setFrame.
-      if (!m_isCachable) vpalette->mutex()->lock();
+        // If level has animated palette, it is necessary to lock palette's
+        // color against concurrents TPalette::setFrame.
+        if (!m_isCachable) vpalette->mutex()->lock();
 
-      vpalette->setFrame((int)frame);
-      m_offlineContext->draw(vectorImage, rd, true);
-      vpalette->setFrame(oldFrame);
+        vpalette->setFrame((int)frame);
+        m_offlineContext->draw(vectorImage, rd, true);
+        vpalette->setFrame(oldFrame);
 
-      if (!m_isCachable) vpalette->mutex()->unlock();
+        if (!m_isCachable) vpalette->mutex()->unlock();
 
-      m_offlineContext->getRaster(tile.getRaster());
+        m_offlineContext->getRaster(tile.getRaster());
 
-      m_offlineContext->doneCurrent();
+        m_offlineContext->doneCurrent();
+      }
     }
   } else {
     // Raster case
@@ -1560,6 +1588,22 @@ std::string TLevelColumnFx::getAlias(double frame,
       rdata += "column_0";
   }
 
+  // Results may be reused across sessions through the persistent cache:
+  // distinguish the different disk versions of the level
+  if (TPersistentFxCache::instance()->isEnabled()) {
+    ToonzScene *scene = sl->getScene();
+    TFilePath decodedPath =
+        scene ? scene->decodeFilePath(path.getDots() == ".." ? fp : path)
+              : path;
+    bool modified = sl->getProperties()->getDirtyFlag();
+
+    rdata += "stamp" + ::to_string(decodedPath.getWideString()) + "@" +
+             TPersistentFxCache::getFileStamp(decodedPath, modified);
+    if (sl->getType() == TZP_XSHLEVEL)
+      rdata += "," + TPersistentFxCache::getFileStamp(
+                         decodedPath.withNoFrame().withType("tpl"), modified);
+  }
+
   return getFxType() + "[" + ::to_string(fp.getWideString()) + "," + rdata +
          "]";
 }
@@ -1713,7 +1757,8 @@ std::wstring TPaletteColumnFx::getColumnId() const {
 std::string TPaletteColumnFx::getAlias(double frame,
                                        const TRenderSettings &info) const {
   TFilePath palettePath = getPalettePath(frame);
-  return "TPaletteColumnFx[" + ::to_string(palettePath.getWideString()) + "]";
+  return "TPaletteColumnFx[" + ::to_string(palettePath.getWideString()) + "]" +
+         TPersistentFxCache::uncachableToken();
 }
 
 //-------------------------------------------------------------------
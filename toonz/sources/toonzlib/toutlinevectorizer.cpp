@@ -1651,7 +1651,7 @@ TVectorImageP VectorizerCore::vectorize(const TImageP &img,
 //-----------------------------------------------------------------
 
 void VectorizerCore::emitPartialDone(void) {
-  emit partialDone(m_currPartial++, m_totalPartials);
+  emit partialDone(m_currPartial.fetchAndAddOrdered(1), m_totalPartials);
 }
 
 //-----------------------------------------------------------------
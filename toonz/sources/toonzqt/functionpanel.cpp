@@ -508,11 +508,15 @@ QPainterPath FunctionPanel::getSegmentPainterPath(TDoubleParam *curve,
     path.lineTo(getWinPos(curve, frame1, curve->getValue(frame1, true)));
   } else {
     // step = 1
-    path.moveTo(getWinPos(curve, frame));
-    while (frame + df < frame1) {
-      frame += df;
-      path.lineTo(getWinPos(curve, frame));
-    }
+    int count = 1;
+    while (frame + count * df < frame1) count++;
+
+    std::vector<double> values(count);
+    curve->getValues(frame, count, &values[0], df);
+
+    path.moveTo(getWinPos(curve, frame, values[0]));
+    for (int i = 1; i < count; i++)
+      path.lineTo(getWinPos(curve, frame + i * df, values[i]));
     path.lineTo(getWinPos(curve, frame1, curve->getValue(frame1, true)));
   }
   return path;
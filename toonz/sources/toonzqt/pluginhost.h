@@ -198,6 +198,8 @@ public:
   ParamView *createParamView();
 
   bool isPlugin() const override { return true; }
+  // Plugin libraries may change between sessions
+  bool isPersistentCachable() const override { return false; }
   bool isPluginZerary() const override { return pi_->desc_->is_geometric(); }
 
   bool isZerary() const override { return isPluginZerary(); };